@@ -24,9 +24,14 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <algorithm>
+#include <atomic>
+#include <functional>
 #include <iostream>
 #include <map>
 #include <memory>
+#include <optional>
+#include <sstream>
+#include <thread>
 
 #ifdef _WIN32
 #include <io.h>
@@ -34,9 +39,16 @@
 #include <sys/stat.h>
 #endif
 
+#include <android-base/parseint.h>
 #include <android-base/strings.h>
+#include <openssl/evp.h>
 
+#include "aidl/mapping_table.h"
+#include "aidl_cache.h"
+#include "aidl_checkapi.h"
 #include "aidl_language.h"
+#include "aidl_precompile.h"
+#include "aidl_profile.h"
 #include "aidl_typenames.h"
 #include "generate_aidl_mappings.h"
 #include "generate_cpp.h"
@@ -76,8 +88,10 @@ const int kLastCallTransaction = 0x00ffffff;
 const int kFirstMetaMethodId = kLastCallTransaction - kFirstCallTransaction;
 const int kGetInterfaceVersionId = kFirstMetaMethodId;
 const int kGetInterfaceHashId = kFirstMetaMethodId - 1;
+// kFirstMetaMethodId - 2 is kBatchTransactionId, which the backends share, so
+// it is defined outside of this namespace.
 // Additional meta transactions implemented by AIDL should use
-// kFirstMetaMethodId -1, -2, ...and so on.
+// kFirstMetaMethodId -3, -4, ...and so on.
 
 // Reserve 100 IDs for meta methods, which is more than enough. If we don't reserve,
 // in the future, a newly added meta transaction ID will have a chance to
@@ -150,37 +164,22 @@ bool check_filename(const std::string& filename, const AidlDefinedType& defined_
     return valid;
 }
 
-bool write_dep_file(const Options& options, const AidlDefinedType& defined_type,
-                    const vector<string>& imports, const IoDelegate& io_delegate,
-                    const string& input_file, const string& output_file) {
-  string dep_file_name = options.DependencyFile();
-  if (dep_file_name.empty() && options.AutoDepFile()) {
-    dep_file_name = output_file + ".d";
-  }
-
-  if (dep_file_name.empty()) {
-    return true;  // nothing to do
-  }
-
+// Writes a dependency file saying that |targets| and |headers| depend on
+// |source_aidl|.
+static bool write_dep_rules(const Options& options, const IoDelegate& io_delegate,
+                            const string& dep_file_name, const vector<string>& targets,
+                            const vector<string>& source_aidl, const vector<string>& headers) {
   CodeWriterPtr writer = io_delegate.GetCodeWriter(dep_file_name);
   if (!writer) {
     LOG(ERROR) << "Could not open dependency file: " << dep_file_name;
     return false;
   }
 
-  vector<string> source_aidl = {input_file};
-  for (const auto& import : imports) {
-    source_aidl.push_back(import);
-  }
-
   // Encode that the output file depends on aidl input files.
-  if (defined_type.AsUnstructuredParcelable() != nullptr &&
-      options.TargetLanguage() == Options::Language::JAVA) {
-    // Legacy behavior. For parcelable declarations in Java, don't emit output file as
-    // the dependency target. b/141372861
+  if (targets.empty()) {
     writer->Write(" : \\\n");
   } else {
-    writer->Write("%s : \\\n", output_file.c_str());
+    writer->Write("%s : \\\n", Join(targets, " \\\n").c_str());
   }
   writer->Write("  %s", Join(source_aidl, " \\\n  ").c_str());
   writer->Write("\n");
@@ -194,25 +193,70 @@ bool write_dep_file(const Options& options, const AidlDefinedType& defined_type,
     }
   }
 
-  if (options.IsCppOutput()) {
-    if (!options.DependencyFileNinja()) {
-      using ::android::aidl::cpp::ClassNames;
-      using ::android::aidl::cpp::HeaderFile;
-      vector<string> headers;
-      for (ClassNames c : {ClassNames::CLIENT, ClassNames::SERVER, ClassNames::RAW}) {
-        headers.push_back(options.OutputHeaderDir() +
-                          HeaderFile(defined_type, c, false /* use_os_sep */));
-      }
+  if (!headers.empty() && !options.DependencyFileNinja()) {
+    writer->Write("\n");
+
+    // Generated headers also depend on the source aidl files.
+    writer->Write("%s : \\\n    %s\n", Join(headers, " \\\n    ").c_str(),
+                  Join(source_aidl, " \\\n    ").c_str());
+  }
+
+  return true;
+}
 
-      writer->Write("\n");
+// The dependency targets of the code generated for |defined_type|, which go
+// to |targets| and |headers|.
+static void add_dep_targets(const Options& options, const AidlDefinedType& defined_type,
+                            const string& output_file, vector<string>* targets,
+                            vector<string>* headers) {
+  if (defined_type.AsUnstructuredParcelable() != nullptr &&
+      options.TargetLanguage() == Options::Language::JAVA) {
+    // Legacy behavior. For parcelable declarations in Java, don't emit output file as
+    // the dependency target. b/141372861
+  } else {
+    targets->push_back(output_file);
+  }
 
-      // Generated headers also depend on the source aidl files.
-      writer->Write("%s : \\\n    %s\n", Join(headers, " \\\n    ").c_str(),
-                    Join(source_aidl, " \\\n    ").c_str());
+  if (options.IsCppOutput()) {
+    using ::android::aidl::cpp::ClassNames;
+    using ::android::aidl::cpp::HeaderFile;
+    for (ClassNames c : {ClassNames::CLIENT, ClassNames::SERVER, ClassNames::RAW}) {
+      headers->push_back(options.OutputHeaderDir() +
+                         HeaderFile(defined_type, c, false /* use_os_sep */));
     }
   }
+}
 
-  return true;
+// Adds the files other than AIDL files that the generated code depends on to
+// |inputs|.
+static void add_dep_inputs(const Options& options, vector<string>* inputs) {
+  if (options.TargetLanguage() == Options::Language::JAVA &&
+      !options.TransactProfileFile().empty()) {
+    inputs->push_back(options.TransactProfileFile());
+  }
+}
+
+bool write_dep_file(const Options& options, const AidlDefinedType& defined_type,
+                    const vector<string>& imports, const IoDelegate& io_delegate,
+                    const string& input_file, const string& output_file) {
+  string dep_file_name = options.DependencyFile();
+  if (dep_file_name.empty() && options.AutoDepFile()) {
+    dep_file_name = output_file + ".d";
+  }
+
+  if (dep_file_name.empty()) {
+    return true;  // nothing to do
+  }
+
+  vector<string> source_aidl = {input_file};
+  for (const auto& import : imports) {
+    source_aidl.push_back(import);
+  }
+  add_dep_inputs(options, &source_aidl);
+  vector<string> targets;
+  vector<string> headers;
+  add_dep_targets(options, defined_type, output_file, &targets, &headers);
+  return write_dep_rules(options, io_delegate, dep_file_name, targets, source_aidl, headers);
 }
 
 string generate_outputFileName(const Options& options, const AidlDefinedType& defined_type) {
@@ -299,133 +343,174 @@ bool check_and_assign_method_ids(const std::vector<std::unique_ptr<AidlMethod>>&
 }
 
 // TODO: Remove this in favor of using the YACC parser b/25479378
-bool ParsePreprocessedLine(const string& line, string* decl,
-                           vector<string>* package, string* class_name) {
+bool ParsePreprocessedLine(std::string_view line, std::string_view* decl,
+                           std::string_view* type) {
   // erase all trailing whitespace and semicolons
   const size_t end = line.find_last_not_of(" ;\t");
-  if (end == string::npos) {
+  if (end == std::string_view::npos) {
     return false;
   }
-  if (line.rfind(';', end) != string::npos) {
+  if (line.rfind(';', end) != std::string_view::npos) {
     return false;
   }
 
-  decl->clear();
-  string type;
-  vector<string> pieces = Split(line.substr(0, end + 1), " \t");
-  for (const string& piece : pieces) {
-    if (piece.empty()) {
-      continue;
-    }
+  *decl = {};
+  *type = {};
+  line = line.substr(0, end + 1);
+  for (size_t begin = line.find_first_not_of(" \t"); begin != std::string_view::npos;) {
+    const size_t piece_end = std::min(line.find_first_of(" \t", begin), line.size());
+    const std::string_view piece = line.substr(begin, piece_end - begin);
     if (decl->empty()) {
-      *decl = std::move(piece);
-    } else if (type.empty()) {
-      type = std::move(piece);
+      *decl = piece;
+    } else if (type->empty()) {
+      *type = piece;
     } else {
       return false;
     }
+    begin = line.find_first_not_of(" \t", piece_end);
   }
-
-  // Note that this logic is absolutely wrong.  Given a parcelable
-  // org.some.Foo.Bar, the class name is Foo.Bar, but this code will claim that
-  // the class is just Bar.  However, this was the way it was done in the past.
-  //
-  // See b/17415692
-  size_t dot_pos = type.rfind('.');
-  if (dot_pos != string::npos) {
-    *class_name = type.substr(dot_pos + 1);
-    *package = Split(type.substr(0, dot_pos), ".");
-  } else {
-    *class_name = type;
-    package->clear();
-  }
-
   return true;
 }
 
 }  // namespace
 
+const int kBatchTransactionId = kFirstMetaMethodId - 2;
+
 namespace internals {
 
+string NormalizePath(const string& path) {
+  const string sep(1, OS_PATH_SEPARATOR);
+  vector<string> components;
+  for (const string& c : Split(path, sep)) {
+    if (c.empty() || c == ".") {
+      continue;
+    }
+    if (c == ".." && !components.empty() && components.back() != "..") {
+      components.pop_back();
+      continue;
+    }
+    components.push_back(c);
+  }
+  string result = Join(components, sep);
+  if (!path.empty() && path[0] == OS_PATH_SEPARATOR) {
+    result = sep + result;
+  }
+  return result;
+}
+
 bool parse_preprocessed_file(const IoDelegate& io_delegate, const string& filename,
                              AidlTypenames* typenames) {
-  bool success = true;
-  unique_ptr<LineReader> line_reader = io_delegate.GetLineReader(filename);
-  if (!line_reader) {
+  ProfileScope profile_scope("parse preprocessed", filename);
+  std::shared_ptr<FileBuffer> buffer = io_delegate.GetFileBuffer(filename);
+  if (!buffer) {
     LOG(ERROR) << "cannot open preprocessed file: " << filename;
-    success = false;
-    return success;
+    return false;
   }
+  if (Stats* stats = Stats::Current(); stats != nullptr) {
+    stats->AddSource(filename, buffer->Size());
+  }
+  // Only the names are read here; the types are made when they are looked
+  // up, and refer to the buffer until then.
+  typenames->Arena()->Retain(buffer);
 
-  string line;
+  const std::string_view contents(buffer->Data(), buffer->Size());
   int lineno = 1;
-  for ( ; line_reader->ReadLine(&line); ++lineno) {
+  for (size_t begin = 0; begin < contents.size(); ++lineno) {
+    const size_t end = std::min(contents.find('\n', begin), contents.size());
+    const std::string_view line = contents.substr(begin, end - begin);
+    begin = end + 1;
     if (line.empty() || line.compare(0, 2, "//") == 0) {
       // skip comments and empty lines
       continue;
     }
 
-    string decl;
-    vector<string> package;
-    string class_name;
-    if (!ParsePreprocessedLine(line, &decl, &package, &class_name)) {
-      success = false;
-      break;
+    std::string_view decl;
+    std::string_view type;
+    if (!ParsePreprocessedLine(line, &decl, &type)) {
+      LOG(ERROR) << filename << ':' << lineno << " malformed preprocessed file line: '" << line
+                 << "'";
+      return false;
     }
 
-    AidlLocation::Point point = {.line = lineno, .column = 0 /*column*/};
-    AidlLocation location = AidlLocation(filename, point, point);
-
+    AidlTypenames::PreprocessedKind kind;
     if (decl == "parcelable") {
       // ParcelFileDescriptor is treated as a built-in type, but it's also in the framework.aidl.
       // So aidl should ignore built-in types in framework.aidl to prevent duplication.
       // (b/130899491)
-      if (AidlTypenames::IsBuiltinTypename(class_name)) {
+      const size_t dot = type.rfind('.');
+      if (AidlTypenames::IsBuiltinTypename(
+              string(dot == std::string_view::npos ? type : type.substr(dot + 1)))) {
         continue;
       }
-      AidlParcelable* doc = new AidlParcelable(
-          location, new AidlQualifiedName(location, class_name, ""), package, "" /* comments */);
-      typenames->AddPreprocessedType(unique_ptr<AidlParcelable>(doc));
+      kind = AidlTypenames::PreprocessedKind::PARCELABLE;
     } else if (decl == "structured_parcelable") {
-      auto temp = new std::vector<std::unique_ptr<AidlVariableDeclaration>>();
-      AidlStructuredParcelable* doc =
-          new AidlStructuredParcelable(location, new AidlQualifiedName(location, class_name, ""),
-                                       package, "" /* comments */, temp);
-      typenames->AddPreprocessedType(unique_ptr<AidlStructuredParcelable>(doc));
+      kind = AidlTypenames::PreprocessedKind::STRUCTURED_PARCELABLE;
     } else if (decl == "interface") {
-      auto temp = new std::vector<std::unique_ptr<AidlMember>>();
-      AidlInterface* doc = new AidlInterface(location, class_name, "", false, temp, package);
-      typenames->AddPreprocessedType(unique_ptr<AidlInterface>(doc));
+      kind = AidlTypenames::PreprocessedKind::INTERFACE;
     } else {
-      success = false;
-      break;
+      LOG(ERROR) << filename << ':' << lineno << " malformed preprocessed file line: '" << line
+                 << "'";
+      return false;
     }
+    typenames->AddPreprocessedDeclaration(kind, type, filename, lineno);
   }
-  if (!success) {
-    LOG(ERROR) << filename << ':' << lineno
-               << " malformed preprocessed file line: '" << line << "'";
-  }
-
-  return success;
+  return true;
 }
 
-AidlError load_and_validate_aidl(const std::string& input_file_name, const Options& options,
-                                 const IoDelegate& io_delegate, AidlTypenames* typenames,
-                                 vector<AidlDefinedType*>* defined_types,
-                                 vector<string>* imported_files) {
+// An input file between the loading and the validation phases of
+// load_and_validate_aidl()
+struct LoadedInput {
+  string input_file;
+  Parser* main_parser = nullptr;
+  vector<string> import_paths;
+  // The parsers of the files, unless a shared ParsedFiles keeps them
+  vector<unique_ptr<Parser>> own_parsers;
+};
+
+// Parses |input_file_name| and the files it imports into |typenames|, and
+// resolves the references of its types.
+static AidlError load_aidl(const std::string& input_file_name, const Options& options,
+                           const IoDelegate& io_delegate, AidlTypenames* typenames,
+                           ParsedFiles* parsed_files, LoadedInput* loaded) {
+  ProfileScope scope("load", input_file_name);
   AidlError err = AidlError::OK;
+  loaded->input_file = input_file_name;
 
   //////////////////////////////////////////////////////////////////////////
   // Loading phase
   //////////////////////////////////////////////////////////////////////////
 
+  // Parsers are kept by |parsed_files| when it is shared, and by |loaded| otherwise.
+  auto parse = [&](const string& filename, Parser::Mode mode) -> Parser* {
+    if (parsed_files == nullptr) {
+      loaded->own_parsers.emplace_back(Parser::Parse(filename, io_delegate, *typenames, mode));
+      return loaded->own_parsers.back().get();
+    }
+    return parsed_files->parsers.Parse(filename, io_delegate, mode);
+  };
+  // Imports are only skimmed, unless they are inputs themselves, which the
+  // shared |parsed_files| may have to validate and generate later.
+  set<string> input_files;
+  for (const string& input : options.InputFiles()) {
+    input_files.insert(NormalizePath(input));
+  }
+  auto import_mode = [&](const string& filename) {
+    return input_files.count(NormalizePath(filename)) > 0 ? Parser::Mode::FULL
+                                                          : Parser::Mode::SKIM;
+  };
+
   // Parse the main input file
-  std::unique_ptr<Parser> main_parser = Parser::Parse(input_file_name, io_delegate, *typenames);
+  Parser* main_parser = parse(input_file_name, Parser::Mode::FULL);
   if (main_parser == nullptr) {
     return AidlError::PARSE_ERROR;
   }
+  // Types that are defined by this input or by the files it imports. This is
+  // a subset of the defined types in |typenames| when |parsed_files| is shared.
+  set<const AidlDefinedType*> visible_types(main_parser->GetDefinedTypes().begin(),
+                                            main_parser->GetDefinedTypes().end());
   int num_interfaces_or_structured_parcelables = 0;
   for (AidlDefinedType* type : main_parser->GetDefinedTypes()) {
+    typenames->MarkCompiled(type);
     if (type->AsInterface() != nullptr || type->AsStructuredParcelable() != nullptr) {
       num_interfaces_or_structured_parcelables++;
     }
@@ -437,6 +522,9 @@ AidlError load_and_validate_aidl(const std::string& input_file_name, const Optio
 
   // Import the preprocessed file
   for (const string& s : options.PreprocessedFiles()) {
+    if (parsed_files != nullptr && !parsed_files->preprocessed_files.insert(s).second) {
+      continue;
+    }
     if (!parse_preprocessed_file(io_delegate, s, typenames)) {
       err = AidlError::BAD_PRE_PROCESSED_FILE;
     }
@@ -445,10 +533,38 @@ AidlError load_and_validate_aidl(const std::string& input_file_name, const Optio
     return err;
   }
 
-  // Find files to import and parse them
+  // Load the precompiled modules. Their types are complete, so an import of
+  // one of them doesn't need the *.aidl file to be found and parsed.
   vector<string> import_paths;
+  set<const AidlDefinedType*> precompiled_types;
+  for (const string& s : options.PrecompiledFiles()) {
+    vector<AidlDefinedType*> loaded_types;
+    vector<AidlDefinedType*>* types = &loaded_types;
+    if (parsed_files != nullptr) {
+      auto it = parsed_files->precompiled_modules.find(s);
+      if (it != parsed_files->precompiled_modules.end()) {
+        types = &it->second;
+      } else {
+        types = &parsed_files->precompiled_modules[s];
+        if (!load_precompiled_module(io_delegate, s, typenames, types)) {
+          err = AidlError::BAD_PRECOMPILED_MODULE;
+        }
+      }
+    } else if (!load_precompiled_module(io_delegate, s, typenames, types)) {
+      err = AidlError::BAD_PRECOMPILED_MODULE;
+    }
+    precompiled_types.insert(types->begin(), types->end());
+    import_paths.emplace_back(s);
+  }
+  if (err != AidlError::OK) {
+    return err;
+  }
+  visible_types.insert(precompiled_types.begin(), precompiled_types.end());
+
+  // Find files to import and parse them
   ImportResolver import_resolver{io_delegate, input_file_name, options.ImportDirs(),
-                                 options.InputFiles()};
+                                 options.InputFiles(),
+                                 parsed_files != nullptr ? &parsed_files->import_index : nullptr};
 
   vector<string> type_from_import_statements;
   for (const auto& import : main_parser->GetImports()) {
@@ -472,7 +588,18 @@ AidlError load_and_validate_aidl(const std::string& input_file_name, const Optio
   import_candidates.insert(import_candidates.end(), unresolved_types.begin(),
                            unresolved_types.end());
   for (const auto& import : import_candidates) {
-    if (typenames->IsIgnorableImport(import)) {
+    bool ignorable = typenames->IsIgnorableImport(import);
+    if (ignorable && parsed_files != nullptr) {
+      // A type defined by another input's closure still has to be imported
+      // (from the already parsed file) so that it is listed in our dep file.
+      const AidlDefinedType* type = typenames->TryGetDefinedType(import);
+      ignorable = type == nullptr || visible_types.count(type) > 0;
+    }
+    if (!ignorable && precompiled_types.count(typenames->TryGetDefinedType(import)) > 0) {
+      // Defined by a precompiled module, and not by the compiled sources
+      ignorable = true;
+    }
+    if (ignorable) {
       // There are places in the Android tree where an import doesn't resolve,
       // but we'll pick the type up through the preprocessed types.
       // This seems like an error, but legacy support demands we support it...
@@ -499,12 +626,22 @@ AidlError load_and_validate_aidl(const std::string& input_file_name, const Optio
 
     import_paths.emplace_back(import_path);
 
-    std::unique_ptr<Parser> import_parser = Parser::Parse(import_path, io_delegate, *typenames);
+    const Parser::Mode mode = import_mode(import_path);
+    Parser* import_parser = parse(import_path, mode);
     if (import_parser == nullptr) {
-      cerr << "error while importing " << import_path << " for " << import << endl;
+      ::AidlError::ThreadOutput() << "error while importing " << import_path << " for " << import
+                                  << endl;
       err = AidlError::BAD_IMPORT;
       continue;
     }
+    visible_types.insert(import_parser->GetDefinedTypes().begin(),
+                         import_parser->GetDefinedTypes().end());
+    if (mode == Parser::Mode::FULL) {
+      // An input itself
+      for (AidlDefinedType* type : import_parser->GetDefinedTypes()) {
+        typenames->MarkCompiled(type);
+      }
+    }
   }
   if (err != AidlError::OK) {
     return err;
@@ -513,12 +650,18 @@ AidlError load_and_validate_aidl(const std::string& input_file_name, const Optio
   for (const auto& imported_file : options.ImportFiles()) {
     import_paths.emplace_back(imported_file);
 
-    std::unique_ptr<Parser> import_parser = Parser::Parse(imported_file, io_delegate, *typenames);
+    const Parser::Mode mode = import_mode(imported_file);
+    Parser* import_parser = parse(imported_file, mode);
     if (import_parser == nullptr) {
       AIDL_ERROR(imported_file) << "error while importing " << imported_file;
       err = AidlError::BAD_IMPORT;
       continue;
     }
+    if (mode == Parser::Mode::FULL) {
+      for (AidlDefinedType* type : import_parser->GetDefinedTypes()) {
+        typenames->MarkCompiled(type);
+      }
+    }
   }
   if (err != AidlError::OK) {
     return err;
@@ -532,7 +675,8 @@ AidlError load_and_validate_aidl(const std::string& input_file_name, const Optio
     return AidlError::BAD_TYPE;
   }
 
-  typenames->IterateTypes([&](const AidlDefinedType& type) {
+  // Preprocessed types that nothing refers to are never enums.
+  typenames->IterateLoadedTypes([&](const AidlDefinedType& type) {
     AidlEnumDeclaration* enum_decl = const_cast<AidlEnumDeclaration*>(type.AsEnumDeclaration());
     if (enum_decl != nullptr) {
       // BackingType is filled in for all known enums, including imported enums,
@@ -557,10 +701,22 @@ AidlError load_and_validate_aidl(const std::string& input_file_name, const Optio
   if (err != AidlError::OK) {
     return err;
   }
+  loaded->main_parser = main_parser;
+  loaded->import_paths = std::move(import_paths);
+  return AidlError::OK;
+}
 
-  //////////////////////////////////////////////////////////////////////////
-  // Validation phase
-  //////////////////////////////////////////////////////////////////////////
+// Validates the types of |loaded|. This only reads |typenames|, and only
+// changes the types of |loaded| themselves, so that the inputs of one
+// invocation can be validated in parallel once they have all been loaded.
+static AidlError validate_aidl(const Options& options, const AidlTypenames& typenames,
+                               LoadedInput* loaded, vector<AidlDefinedType*>* defined_types,
+                               vector<string>* imported_files) {
+  ProfileScope scope("validate", loaded->input_file);
+  AidlError err = AidlError::OK;
+  const string& input_file_name = loaded->input_file;
+  Parser* main_parser = loaded->main_parser;
+  const bool is_check_api = options.GetTask() == Options::Task::CHECK_API;
 
   // For legacy reasons, by default, compiling an unstructured parcelable (which contains no output)
   // is allowed. This must not be returned as an error until the very end of this procedure since
@@ -573,16 +729,21 @@ AidlError load_and_validate_aidl(const std::string& input_file_name, const Optio
     CHECK(defined_type != nullptr);
 
     // Language specific validation
-    if (!defined_type->LanguageSpecificCheckValid(options.TargetLanguage())) {
-      return AidlError::BAD_TYPE;
+    for (Options::Language language : options.TargetLanguages()) {
+      if (!defined_type->LanguageSpecificCheckValid(language)) {
+        return AidlError::BAD_TYPE;
+      }
     }
 
     AidlParcelable* unstructuredParcelable = defined_type->AsUnstructuredParcelable();
     if (unstructuredParcelable != nullptr) {
-      if (!unstructuredParcelable->CheckValid(*typenames)) {
+      if (!unstructuredParcelable->CheckValid(typenames)) {
         return AidlError::BAD_TYPE;
       }
-      bool isStable = unstructuredParcelable->IsStableApiParcelable(options.TargetLanguage());
+      bool isStable = true;
+      for (Options::Language language : options.TargetLanguages()) {
+        isStable = isStable && unstructuredParcelable->IsStableApiParcelable(language);
+      }
       if (options.IsStructured() && !isStable) {
         AIDL_ERROR(unstructuredParcelable)
             << "Cannot declared parcelable in a --structured interface. Parcelable must be defined "
@@ -607,6 +768,15 @@ AidlError load_and_validate_aidl(const std::string& input_file_name, const Optio
       return AidlError::NOT_STRUCTURED;
     }
 
+    // The other versions of a versioned parcelable rely on its size header
+    if (defined_type->IsHeaderless() &&
+        (options.Version() > 0 || options.GetStability() == Options::Stability::VINTF)) {
+      AIDL_ERROR(defined_type) << "A @Headerless parcelable cannot be compiled with --version or "
+                                  "--stability, since the other versions of a versioned "
+                                  "parcelable need its size header.";
+      return AidlError::NOT_STRUCTURED;
+    }
+
     // Ensure that a type is either an interface, structured parcelable, or
     // enum.
     AidlInterface* interface = defined_type->AsInterface();
@@ -623,7 +793,7 @@ AidlError load_and_validate_aidl(const std::string& input_file_name, const Optio
     if (!is_check_api) {
       // No need to do this for check api because all typespecs are already
       // using fully qualified name and we don't import in AIDL files.
-      if (!defined_type->CheckValid(*typenames)) {
+      if (!defined_type->CheckValid(typenames)) {
         return AidlError::BAD_TYPE;
       }
     }
@@ -633,7 +803,7 @@ AidlError load_and_validate_aidl(const std::string& input_file_name, const Optio
       if (options.Version() > 0) {
         AidlTypeSpecifier* ret =
             new AidlTypeSpecifier(AIDL_LOCATION_HERE, "int", false, nullptr, "");
-        ret->Resolve(*typenames);
+        ret->Resolve(typenames);
         vector<unique_ptr<AidlArgument>>* args = new vector<unique_ptr<AidlArgument>>();
         AidlMethod* method =
             new AidlMethod(AIDL_LOCATION_HERE, false, ret, "getInterfaceVersion", args, "",
@@ -644,7 +814,7 @@ AidlError load_and_validate_aidl(const std::string& input_file_name, const Optio
       if (!options.Hash().empty()) {
         AidlTypeSpecifier* ret =
             new AidlTypeSpecifier(AIDL_LOCATION_HERE, "String", false, nullptr, "");
-        ret->Resolve(*typenames);
+        ret->Resolve(typenames);
         vector<unique_ptr<AidlArgument>>* args = new vector<unique_ptr<AidlArgument>>();
         AidlMethod* method = new AidlMethod(AIDL_LOCATION_HERE, false, ret, kGetInterfaceHash, args,
                                             "", kGetInterfaceHashId, false /* is_user_defined */);
@@ -664,7 +834,7 @@ AidlError load_and_validate_aidl(const std::string& input_file_name, const Optio
           case AidlConstantValue::Type::FLOATING:  // fall-through
           case AidlConstantValue::Type::UNARY:     // fall-through
           case AidlConstantValue::Type::BINARY: {
-            bool success = constant->CheckValid(*typenames);
+            bool success = constant->CheckValid(typenames);
             if (!success) {
               return AidlError::BAD_TYPE;
             }
@@ -682,19 +852,25 @@ AidlError load_and_validate_aidl(const std::string& input_file_name, const Optio
     }
   }
 
-  typenames->IterateTypes([&](const AidlDefinedType& type) {
-    if (options.IsStructured() && type.AsUnstructuredParcelable() != nullptr &&
-        !type.AsUnstructuredParcelable()->IsStableApiParcelable(options.TargetLanguage())) {
-      err = AidlError::NOT_STRUCTURED;
-      LOG(ERROR) << type.GetCanonicalName()
-                 << " is not structured, but this is a structured interface.";
-    }
-    if (options.GetStability() == Options::Stability::VINTF && !type.IsVintfStability()) {
-      err = AidlError::NOT_STRUCTURED;
-      LOG(ERROR) << type.GetCanonicalName()
-                 << " does not have VINTF level stability, but this interface requires it.";
-    }
-  });
+  // Only these checks need every type, including all preprocessed ones.
+  if (options.IsStructured() || options.GetStability() == Options::Stability::VINTF) {
+    typenames.IterateTypes([&](const AidlDefinedType& type) {
+      for (Options::Language language : options.TargetLanguages()) {
+        if (options.IsStructured() && type.AsUnstructuredParcelable() != nullptr &&
+            !type.AsUnstructuredParcelable()->IsStableApiParcelable(language)) {
+          err = AidlError::NOT_STRUCTURED;
+          AIDL_ERROR(type) << type.GetCanonicalName()
+                           << " is not structured, but this is a structured interface.";
+          break;
+        }
+      }
+      if (options.GetStability() == Options::Stability::VINTF && !type.IsVintfStability()) {
+        err = AidlError::NOT_STRUCTURED;
+        AIDL_ERROR(type) << type.GetCanonicalName()
+                         << " does not have VINTF level stability, but this interface requires it.";
+      }
+    });
+  }
 
   if (err != AidlError::OK) {
     return err;
@@ -705,7 +881,7 @@ AidlError load_and_validate_aidl(const std::string& input_file_name, const Optio
   }
 
   if (imported_files != nullptr) {
-    *imported_files = import_paths;
+    *imported_files = loaded->import_paths;
   }
 
   if (contains_unstructured_parcelable) {
@@ -716,69 +892,569 @@ AidlError load_and_validate_aidl(const std::string& input_file_name, const Optio
   return AidlError::OK;
 }
 
+AidlError load_and_validate_aidl(const std::string& input_file_name, const Options& options,
+                                 const IoDelegate& io_delegate, AidlTypenames* typenames,
+                                 vector<AidlDefinedType*>* defined_types,
+                                 vector<string>* imported_files, ParsedFiles* parsed_files) {
+  ProfileScope scope("load and validate", input_file_name);
+  LoadedInput loaded;
+  if (AidlError err =
+          load_aidl(input_file_name, options, io_delegate, typenames, parsed_files, &loaded);
+      err != AidlError::OK) {
+    return err;
+  }
+  return validate_aidl(options, *typenames, &loaded, defined_types, imported_files);
+}
+
 } // namespace internals
 
-int compile_aidl(const Options& options, const IoDelegate& io_delegate) {
+// An input file that has been validated and is ready for code generation.
+struct CompileJob {
+  string input_file;
+  vector<AidlDefinedType*> defined_types;
+  vector<string> imported_files;
+  // False when the dependencies of all jobs go to one dependency file.
+  bool writes_dep_file = true;
+};
+
+// Writes the dependency file of a batch of inputs: every output of the batch
+// depends on every input and import of it.
+static bool write_batch_dep_file(const Options& options, const IoDelegate& io_delegate,
+                                 const vector<CompileJob>& jobs) {
+  vector<string> targets;
+  vector<string> headers;
+  vector<string> source_aidl;
+  for (const CompileJob& job : jobs) {
+    source_aidl.push_back(job.input_file);
+    for (const auto defined_type : job.defined_types) {
+      const string output_file = generate_outputFileName(options, *defined_type);
+      if (output_file.empty()) {
+        return false;
+      }
+      add_dep_targets(options, *defined_type, output_file, &targets, &headers);
+    }
+  }
+  set<string> listed;
+  for (const string& input_file : source_aidl) {
+    listed.insert(internals::NormalizePath(input_file));
+  }
+  for (const CompileJob& job : jobs) {
+    for (const string& import : job.imported_files) {
+      if (listed.insert(internals::NormalizePath(import)).second) {
+        source_aidl.push_back(import);
+      }
+    }
+  }
+  add_dep_inputs(options, &source_aidl);
+  return write_dep_rules(options, io_delegate, options.DependencyFile(), targets, source_aidl,
+                         headers);
+}
+
+// With --dedup-with, finds the structured parcelables of the inputs whose
+// code the frozen versions share: those that every dump has the same and
+// whose fields refer only to enums that every dump has the same and to other
+// such parcelables. Interfaces aren't shared, as their code differs in the
+// version and hash, and neither are the types that the dumps don't have.
+static bool find_shared_types(const Options& options, const IoDelegate& io_delegate,
+                              const AidlTypenames& typenames, const vector<CompileJob>& jobs,
+                              set<string>* shared_types) {
+  vector<std::map<string, string>> dumps(options.DedupDirs().size());
+  for (size_t i = 0; i < dumps.size(); i++) {
+    if (!load_api_fingerprints(io_delegate, options.DedupDirs()[i], &dumps[i])) {
+      return false;
+    }
+  }
+  auto same_in_every_dump = [&](const AidlDefinedType& type) {
+    const auto first = dumps[0].find(type.GetCanonicalName());
+    return first != dumps[0].end() &&
+           std::all_of(dumps.begin() + 1, dumps.end(), [&](const auto& dump) {
+             const auto found = dump.find(first->first);
+             return found != dump.end() && found->second == first->second;
+           });
+  };
+
+  vector<const AidlStructuredParcelable*> candidates;
+  for (const CompileJob& job : jobs) {
+    for (const AidlDefinedType* type : job.defined_types) {
+      if (type->AsStructuredParcelable() != nullptr && same_in_every_dump(*type)) {
+        candidates.push_back(type->AsStructuredParcelable());
+        shared_types->insert(type->GetCanonicalName());
+      }
+    }
+  }
+
+  // A parcelable that refers to one which isn't shared isn't either, until
+  // the remaining ones only refer to each other.
+  std::function<bool(const AidlTypeSpecifier&)> refers_to_shared =
+      [&](const AidlTypeSpecifier& type) {
+        if (const AidlDefinedType* defined = typenames.TryGetDefinedType(type.GetName());
+            defined != nullptr) {
+          const bool shared = defined->AsEnumDeclaration() != nullptr
+                                  ? same_in_every_dump(*defined)
+                                  : shared_types->count(defined->GetCanonicalName()) > 0;
+          if (!shared) {
+            return false;
+          }
+        }
+        if (type.IsGeneric()) {
+          for (const auto& parameter : type.GetTypeParameters()) {
+            if (!refers_to_shared(*parameter)) {
+              return false;
+            }
+          }
+        }
+        return true;
+      };
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (const AidlStructuredParcelable* parcelable : candidates) {
+      if (shared_types->count(parcelable->GetCanonicalName()) == 0) {
+        continue;
+      }
+      for (const auto& field : parcelable->GetFields()) {
+        if (!refers_to_shared(field->GetType())) {
+          shared_types->erase(parcelable->GetCanonicalName());
+          changed = true;
+          break;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+static bool generate_outputs(const Options& options, const IoDelegate& io_delegate,
+                             const AidlTypenames& typenames, const CompileJob& job,
+                             const set<string>& shared_types) {
   const Options::Language lang = options.TargetLanguage();
-  for (const string& input_file : options.InputFiles()) {
-    AidlTypenames typenames;
+  for (const auto defined_type : job.defined_types) {
+    CHECK(defined_type != nullptr);
 
-    vector<AidlDefinedType*> defined_types;
-    vector<string> imported_files;
+    string output_file_name = options.OutputFile();
+    // if needed, generate the output file name from the base folder
+    if (output_file_name.empty() && !options.OutputDir().empty()) {
+      output_file_name = generate_outputFileName(options, *defined_type);
+      if (output_file_name.empty()) {
+        return false;
+      }
+    }
 
-    AidlError aidl_err = internals::load_and_validate_aidl(
-        input_file, options, io_delegate, &typenames, &defined_types, &imported_files);
+    if (job.writes_dep_file &&
+        !write_dep_file(options, *defined_type, job.imported_files, io_delegate, job.input_file,
+                        output_file_name)) {
+      return false;
+    }
+
+    // With --dedup-with, the code of the shared types is in the sources of
+    // --dedup-shared, and only theirs is.
+    const bool with_source =
+        options.DedupDirs().empty() ||
+        (shared_types.count(defined_type->GetCanonicalName()) > 0) == options.DedupShared();
+
+    ProfileScope scope("generate", defined_type->GetCanonicalName());
+    const uint64_t written_bytes = ThreadWrittenBytes();
+    bool success = false;
+    if (lang == Options::Language::CPP) {
+      success = cpp::GenerateCpp(output_file_name, options, typenames, *defined_type, io_delegate,
+                                 with_source);
+    } else if (lang == Options::Language::NDK) {
+      ndk::GenerateNdk(output_file_name, options, typenames, *defined_type, io_delegate,
+                       with_source);
+      success = true;
+    } else if (lang == Options::Language::JAVA) {
+      if (defined_type->AsUnstructuredParcelable() != nullptr) {
+        // Legacy behavior. For parcelable declarations in Java, don't generate output file.
+        success = true;
+      } else {
+        success =
+            java::generate_java(output_file_name, defined_type, typenames, io_delegate, options);
+      }
+    } else {
+      LOG(FATAL) << "Should not reach here" << endl;
+      return false;
+    }
+    if (Stats* stats = Stats::Current(); stats != nullptr) {
+      stats->AddOutput(to_string(lang), ThreadWrittenBytes() - written_bytes);
+    }
+    if (!success) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// With --unity-sources=N, writes aidl_unity_0.cpp to aidl_unity_<N-1>.cpp,
+// which include the generated sources between them in order. A library of
+// many types then compiles N translation units, each of which parses the
+// headers of libbinder and of the types once rather than once per type.
+static bool write_unity_sources(const Options& options, const IoDelegate& io_delegate,
+                                const vector<CompileJob>& jobs) {
+  vector<string> sources;
+  for (const CompileJob& job : jobs) {
+    for (const auto defined_type : job.defined_types) {
+      // The sources of enums and parcelable declarations are placeholders
+      if (defined_type->AsEnumDeclaration() != nullptr ||
+          defined_type->AsUnstructuredParcelable() != nullptr) {
+        continue;
+      }
+      // Included relative to the unity source, which is in the output directory
+      string source =
+          generate_outputFileName(options, *defined_type).substr(options.OutputDir().size());
+      std::replace(source.begin(), source.end(), OS_PATH_SEPARATOR, '/');
+      sources.push_back(source);
+    }
+  }
+
+  const size_t shards = options.UnitySources();
+  for (size_t i = 0; i < shards; i++) {
+    const string path = options.OutputDir() + "aidl_unity_" + std::to_string(i) + ".cpp";
+    CodeWriterPtr writer = io_delegate.GetCodeWriter(path);
+    for (size_t j = i * sources.size() / shards; j < (i + 1) * sources.size() / shards; j++) {
+      writer->Write("#include \"%s\"\n", sources[j].c_str());
+    }
+    if (!writer->Close()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+namespace internals {
+
+void run_tasks(size_t num_tasks, size_t num_threads, const std::function<bool(size_t)>& task,
+               vector<std::ostringstream>* diagnostics,
+               std::unique_ptr<std::atomic_bool[]>* succeeded) {
+  *diagnostics = vector<std::ostringstream>(num_tasks);
+  succeeded->reset(new std::atomic_bool[num_tasks]);
+  std::atomic_size_t next_task = 0;
+  auto worker = [&]() {
+    for (size_t i = next_task++; i < num_tasks; i = next_task++) {
+      ::AidlError::SetThreadOutput(&(*diagnostics)[i]);
+      (*succeeded)[i] = task(i);
+      ::AidlError::SetThreadOutput(nullptr);
+    }
+  };
+  vector<std::thread> threads;
+  for (size_t i = 1; i < num_threads; i++) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+}  // namespace internals
+
+// Whether a job can leave out the inputs whose outputs are up to date, which
+// it can't when some of its outputs are made from all of its inputs together.
+static bool skips_up_to_date_inputs(const Options& options) {
+  return options.UnitySources() == 0 && options.DedupDirs().empty() &&
+         (options.DependencyFile().empty() || options.InputFiles().size() <= 1);
+}
+
+// The outputs of |job| in |language|, as its dependency file lists them, and
+// the dependency file itself.
+static vector<string> outputs_of(const Options& language, const CompileJob& job) {
+  vector<string> outputs;
+  for (const auto defined_type : job.defined_types) {
+    string output_file = language.OutputFile();
+    if (output_file.empty() && !language.OutputDir().empty()) {
+      output_file = generate_outputFileName(language, *defined_type);
+    }
+    vector<string> headers;
+    add_dep_targets(language, *defined_type, output_file, &outputs, &headers);
+    outputs.insert(outputs.end(), headers.begin(), headers.end());
+    if (job.writes_dep_file && !language.DependencyFile().empty()) {
+      outputs.push_back(language.DependencyFile());
+    } else if (job.writes_dep_file && language.AutoDepFile()) {
+      outputs.push_back(output_file + ".d");
+    }
+  }
+  return outputs;
+}
+
+// Compiles the inputs of |options| other than those in |up_to_date|, and
+// records what they read and wrote in |dependencies|, if not null.
+static int compile_inputs(const Options& options, const IoDelegate& io_delegate,
+                          AidlTypenames& typenames, internals::ParsedFiles& parsed_files,
+                          DependencyIndex* dependencies = nullptr,
+                          const set<string>& up_to_date = {}) {
+  set<string> compiled_files(up_to_date);
+  vector<string> input_files;
+  for (const string& input_file : options.InputFiles()) {
+    if (compiled_files.insert(internals::NormalizePath(input_file)).second) {
+      input_files.push_back(input_file);  // unless listed more than once or up to date
+    }
+  }
+  auto accepts = [&](AidlError aidl_err) {
     bool allowError = aidl_err == AidlError::FOUND_PARCELABLE && !options.FailOnParcelable();
-    if (aidl_err != AidlError::OK && !allowError) {
+    return aidl_err == AidlError::OK || allowError;
+  };
+
+  vector<CompileJob> jobs;
+  const size_t num_validation_threads = std::min<size_t>(options.Jobs(), input_files.size());
+  if (num_validation_threads <= 1) {
+    StatsPhase phase("load and validate");
+    for (const string& input_file : input_files) {
+      CompileJob job{input_file, {}, {}};
+      AidlError aidl_err = internals::load_and_validate_aidl(input_file, options, io_delegate,
+                                                             &typenames, &job.defined_types,
+                                                             &job.imported_files, &parsed_files);
+      if (!accepts(aidl_err)) {
+        return 1;
+      }
+      jobs.emplace_back(std::move(job));
+    }
+  } else {
+    // Loading adds the types of the inputs and their imports to typenames, so
+    // every input is loaded first. The inputs are then validated in parallel
+    // against typenames, which no longer changes. The errors are printed in
+    // the order of the inputs, up to the first one that fails, as they would
+    // be without the threads.
+    StatsPhase phase("load and validate");
+    vector<internals::LoadedInput> loaded(input_files.size());
+    for (size_t i = 0; i < input_files.size(); i++) {
+      if (!accepts(internals::load_aidl(input_files[i], options, io_delegate, &typenames,
+                                        &parsed_files, &loaded[i]))) {
+        return 1;
+      }
+    }
+    jobs.resize(input_files.size());
+    vector<std::ostringstream> diagnostics;
+    std::unique_ptr<std::atomic_bool[]> succeeded;
+    internals::run_tasks(
+        input_files.size(), num_validation_threads,
+        [&](size_t i) {
+          jobs[i].input_file = input_files[i];
+          return accepts(internals::validate_aidl(options, typenames, &loaded[i],
+                                                  &jobs[i].defined_types,
+                                                  &jobs[i].imported_files));
+        },
+        &diagnostics, &succeeded);
+    for (size_t i = 0; i < input_files.size(); i++) {
+      cerr << diagnostics[i].str();
+      if (!succeeded[i]) {
+        return 1;
+      }
+    }
+  }
+
+  if (Stats* stats = Stats::Current(); stats != nullptr) {
+    stats->AddTypes(typenames);
+  }
+
+  if (!options.DependencyFile().empty() && jobs.size() > 1) {
+    for (CompileJob& job : jobs) {
+      job.writes_dep_file = false;
+    }
+    if (!write_batch_dep_file(options, io_delegate, jobs)) {
       return 1;
     }
+  }
 
-    for (const auto defined_type : defined_types) {
-      CHECK(defined_type != nullptr);
-
-      string output_file_name = options.OutputFile();
-      // if needed, generate the output file name from the base folder
-      if (output_file_name.empty() && !options.OutputDir().empty()) {
-        output_file_name = generate_outputFileName(options, *defined_type);
-        if (output_file_name.empty()) {
-          return 1;
-        }
-      }
+  set<string> shared_types;
+  if (!options.DedupDirs().empty() &&
+      !find_shared_types(options, io_delegate, typenames, jobs, &shared_types)) {
+    return 1;
+  }
 
-      if (!write_dep_file(options, *defined_type, imported_files, io_delegate, input_file,
-                          output_file_name)) {
+  // The code of every language is generated from the same validated types.
+  StatsPhase generate_phase("generate");
+  vector<Options> language_options;
+  for (Options::Language language : options.TargetLanguages()) {
+    language_options.push_back(options.ForLanguage(language));
+  }
+  // Task i generates the code of job i / languages for language i % languages.
+  const size_t num_tasks = jobs.size() * language_options.size();
+  auto run_task = [&](size_t i) {
+    return generate_outputs(language_options[i % language_options.size()], io_delegate, typenames,
+                            jobs[i / language_options.size()], shared_types);
+  };
+
+  auto write_unity = [&]() {
+    if (options.UnitySources() == 0) {
+      return 0;
+    }
+    for (const Options& language : language_options) {
+      if (!write_unity_sources(language, io_delegate, jobs)) {
         return 1;
       }
+    }
+    return 0;
+  };
 
-      bool success = false;
-      if (lang == Options::Language::CPP) {
-        success =
-            cpp::GenerateCpp(output_file_name, options, typenames, *defined_type, io_delegate);
-      } else if (lang == Options::Language::NDK) {
-        ndk::GenerateNdk(output_file_name, options, typenames, *defined_type, io_delegate);
-        success = true;
-      } else if (lang == Options::Language::JAVA) {
-        if (defined_type->AsUnstructuredParcelable() != nullptr) {
-          // Legacy behavior. For parcelable declarations in Java, don't generate output file.
-          success = true;
-        } else {
-          success =
-              java::generate_java(output_file_name, defined_type, typenames, io_delegate, options);
+  auto record = [&]() {
+    if (dependencies == nullptr) {
+      return;
+    }
+    for (const CompileJob& job : jobs) {
+      vector<string> imports = job.imported_files;
+      imports.insert(imports.end(), options.PreprocessedFiles().begin(),
+                     options.PreprocessedFiles().end());
+      vector<string> outputs;
+      for (const Options& language : language_options) {
+        for (string& output : outputs_of(language, job)) {
+          outputs.push_back(std::move(output));
         }
-      } else {
-        LOG(FATAL) << "Should not reach here" << endl;
-        return 1;
       }
-      if (!success) {
+      dependencies->Record(job.input_file, options, imports, outputs, io_delegate);
+    }
+  };
+
+  const size_t num_threads = std::min<size_t>(options.Jobs(), num_tasks);
+  if (num_threads <= 1) {
+    for (size_t i = 0; i < num_tasks; i++) {
+      if (!run_task(i)) {
         return 1;
       }
     }
+    const int ret = write_unity();
+    if (ret == 0) {
+      record();
+    }
+    return ret;
+  }
+
+  // From here on typenames is only read: validation has resolved every type
+  // and evaluated every constant of the types that are generated.
+  vector<std::ostringstream> diagnostics;
+  std::unique_ptr<std::atomic_bool[]> succeeded;
+  internals::run_tasks(num_tasks, num_threads, run_task, &diagnostics, &succeeded);
+
+  int ret = 0;
+  for (size_t i = 0; i < num_tasks; i++) {
+    cerr << diagnostics[i].str();
+    if (!succeeded[i]) {
+      ret = 1;
+    }
+  }
+  ret = ret != 0 ? ret : write_unity();
+  if (ret == 0) {
+    record();
+  }
+  return ret;
+}
+
+int compile_aidl(const Options& options, const IoDelegate& io_delegate) {
+  auto compile = [&](const IoDelegate& io_delegate) {
+    // All inputs are validated against the same typenames, so that the
+    // imports and preprocessed files they have in common are parsed only once.
+    AidlTypenames typenames;
+    internals::ParsedFiles parsed_files(typenames);
+    return compile_inputs(options, io_delegate, typenames, parsed_files);
+  };
+  if (!options.CacheDir().empty()) {
+    return compile_cached(options, io_delegate, compile);
+  }
+  return compile(io_delegate);
+}
+
+int compile_aidl(const Options& options, const IoDelegate& io_delegate, CompileSession* session) {
+  if (!options.CacheDir().empty()) {
+    // The files that the session has parsed before wouldn't be recorded for
+    // the cache.
+    return compile_aidl(options, io_delegate);
+  }
+  internals::ParsedFiles* parsed_files = session->Prepare(options, io_delegate);
+  const int ret = compile_inputs(options, io_delegate, *session->Typenames(), *parsed_files,
+                                 &session->Dependencies(), session->UpToDateInputs());
+  if (ret != 0) {
+    // Validation may have stopped half way through the types.
+    session->Clear();
+  }
+  return ret;
+}
+
+static std::optional<size_t> HashFile(const IoDelegate& io_delegate, const string& filename) {
+  unique_ptr<FileBuffer> buffer = io_delegate.GetFileBuffer(filename);
+  if (buffer == nullptr) {
+    return std::nullopt;
   }
-  return 0;
+  return std::hash<std::string_view>()({buffer->Data(), buffer->Size()});
+}
+
+internals::ParsedFiles* CompileSession::Prepare(const Options& options,
+                                                const IoDelegate& io_delegate) {
+  // Everything that affects how the files are parsed and validated.
+  std::ostringstream settings;
+  string dir;
+  IoDelegate::GetAbsolutePath(".", &dir);
+  settings << dir << "\n";
+  for (Options::Language language : options.TargetLanguages()) {
+    settings << static_cast<int>(language) << ",";
+  }
+  settings << "\n"
+           << options.IsStructured() << static_cast<int>(options.GetStability()) << "\n"
+           << options.Version() << "\n" << options.Hash() << "\n";
+  const set<string>& import_dirs = options.ImportDirs();
+  const set<string>& import_files = options.ImportFiles();
+  for (const auto& list : {vector<string>(import_dirs.begin(), import_dirs.end()),
+                           vector<string>(import_files.begin(), import_files.end()),
+                           options.PreprocessedFiles(), options.PrecompiledFiles()}) {
+    settings << Join(list, ":") << "\n";
+  }
+
+  // The inputs whose outputs are still those of an earlier job are left out.
+  up_to_date_inputs_.clear();
+  if (skips_up_to_date_inputs(options)) {
+    for (const string& input : options.InputFiles()) {
+      if (dependencies_.IsUpToDate(input, options, io_delegate)) {
+        up_to_date_inputs_.insert(internals::NormalizePath(input));
+      }
+    }
+  }
+
+  bool reuse = typenames_ != nullptr && settings.str() == settings_ &&
+               parsed_files_->parsers.IsUpToDate(io_delegate);
+  for (const auto& [filename, hash] : included_files_) {
+    reuse = reuse && HashFile(io_delegate, filename) == hash;
+  }
+  for (const string& input : options.InputFiles()) {
+    if (up_to_date_inputs_.count(internals::NormalizePath(input)) > 0) {
+      continue;
+    }
+    // Validating an input again would add its meta methods twice, and an
+    // input that was skimmed as an import lacks its members.
+    reuse = reuse && compiled_inputs_.count(internals::NormalizePath(input)) == 0 &&
+            !parsed_files_->parsers.IsSkimmed(input);
+  }
+
+  if (reuse) {
+    reuses_++;
+    // Files may have been added to the import directories since.
+    parsed_files_->import_index.Clear();
+  } else {
+    Clear();
+    settings_ = settings.str();
+    typenames_ = std::make_unique<AidlTypenames>();
+    parsed_files_ = std::make_unique<internals::ParsedFiles>(*typenames_);
+    for (const auto& list : {options.PreprocessedFiles(), options.PrecompiledFiles()}) {
+      for (const string& filename : list) {
+        included_files_[filename] = HashFile(io_delegate, filename);
+      }
+    }
+  }
+  for (const string& input : options.InputFiles()) {
+    if (up_to_date_inputs_.count(internals::NormalizePath(input)) == 0) {
+      compiled_inputs_.insert(internals::NormalizePath(input));
+    }
+  }
+  return parsed_files_.get();
+}
+
+void CompileSession::Clear() {
+  // The parsers refer to the typenames.
+  parsed_files_.reset();
+  typenames_.reset();
+  compiled_inputs_.clear();
+  included_files_.clear();
+  settings_.clear();
 }
 
 bool dump_mappings(const Options& options, const IoDelegate& io_delegate) {
   android::aidl::mappings::SignatureMap all_mappings;
+  std::vector<mappings::TransactionMapping> transactions;
   for (const string& input_file : options.InputFiles()) {
     AidlTypenames typenames;
     vector<AidlDefinedType*> defined_types;
@@ -791,10 +1467,24 @@ bool dump_mappings(const Options& options, const IoDelegate& io_delegate) {
       continue;
     }
     for (const auto defined_type : defined_types) {
+      if (options.ApiMappingBinary()) {
+        auto methods = mappings::generate_transaction_mappings(defined_type, typenames);
+        std::move(methods.begin(), methods.end(), std::back_inserter(transactions));
+        continue;
+      }
       auto mappings = mappings::generate_mappings(defined_type, typenames);
       all_mappings.insert(mappings.begin(), mappings.end());
     }
   }
+  if (options.ApiMappingBinary()) {
+    std::vector<mapping_table::Method> methods;
+    for (const auto& t : transactions) {
+      methods.push_back(mapping_table::Method{t.descriptor, t.code, t.name, t.signature,
+                                              t.arguments, t.oneway});
+    }
+    auto writer = io_delegate.GetCodeWriter(options.OutputFile());
+    return writer->WriteBytes(mapping_table::Encode(std::move(methods))) && writer->Close();
+  }
   std::stringstream mappings_str;
   for (const auto& mapping : all_mappings) {
     mappings_str << mapping.first << "\n" << mapping.second << "\n";
@@ -805,22 +1495,70 @@ bool dump_mappings(const Options& options, const IoDelegate& io_delegate) {
 }
 
 bool preprocess_aidl(const Options& options, const IoDelegate& io_delegate) {
-  unique_ptr<CodeWriter> writer = io_delegate.GetCodeWriter(options.OutputFile());
-
-  for (const auto& file : options.InputFiles()) {
+  // Only the kinds and the names of the types are written, so the bodies of
+  // the inputs are skimmed. Each input is parsed into typenames of its own,
+  // which lets them be parsed in parallel with --jobs; the lines are joined
+  // in the order of the inputs and written at once.
+  const vector<string>& input_files = options.InputFiles();
+  vector<string> lines(input_files.size());
+  auto preprocess = [&](size_t i) {
     AidlTypenames typenames;
-    std::unique_ptr<Parser> p = Parser::Parse(file, io_delegate, typenames);
+    std::unique_ptr<Parser> p =
+        Parser::Parse(input_files[i], io_delegate, typenames, Parser::Mode::SKIM);
     if (p == nullptr) return false;
 
     for (const auto& defined_type : p->GetDefinedTypes()) {
-      if (!writer->Write("%s %s;\n", defined_type->GetPreprocessDeclarationName().c_str(),
-                         defined_type->GetCanonicalName().c_str())) {
+      lines[i] += defined_type->GetPreprocessDeclarationName() + " " +
+                  defined_type->GetCanonicalName() + ";\n";
+    }
+    return true;
+  };
+
+  const size_t num_threads = std::min<size_t>(options.Jobs(), input_files.size());
+  if (num_threads <= 1) {
+    for (size_t i = 0; i < input_files.size(); i++) {
+      if (!preprocess(i)) {
+        return false;
+      }
+    }
+  } else {
+    vector<std::ostringstream> diagnostics;
+    std::unique_ptr<std::atomic_bool[]> succeeded;
+    internals::run_tasks(input_files.size(), num_threads, preprocess, &diagnostics, &succeeded);
+    for (size_t i = 0; i < input_files.size(); i++) {
+      cerr << diagnostics[i].str();
+      if (!succeeded[i]) {
         return false;
       }
     }
   }
 
-  return writer->Close();
+  unique_ptr<CodeWriter> writer = io_delegate.GetCodeWriter(options.OutputFile());
+  return writer->WriteBytes(Join(lines, "")) && writer->Close();
+}
+
+bool precompile_aidl(const Options& options, const IoDelegate& io_delegate) {
+  // As in compile_aidl, the inputs share one typenames so that the types they
+  // refer to can be resolved against each other.
+  AidlTypenames typenames;
+  internals::ParsedFiles parsed_files(typenames);
+  set<string> precompiled_files;
+  vector<const AidlDefinedType*> types;
+  for (const string& input_file : options.InputFiles()) {
+    if (!precompiled_files.insert(internals::NormalizePath(input_file)).second) {
+      continue;  // listed more than once
+    }
+    vector<AidlDefinedType*> defined_types;
+    AidlError aidl_err = internals::load_and_validate_aidl(
+        input_file, options, io_delegate, &typenames, &defined_types, nullptr, &parsed_files);
+    if (aidl_err != AidlError::OK && aidl_err != AidlError::FOUND_PARCELABLE) {
+      return false;
+    }
+    types.insert(types.end(), defined_types.begin(), defined_types.end());
+  }
+
+  unique_ptr<CodeWriter> writer = io_delegate.GetCodeWriter(options.OutputFile());
+  return write_precompiled_module(types, writer.get());
 }
 
 static string GetApiDumpPathFor(const AidlDefinedType& defined_type, const Options& options) {
@@ -830,25 +1568,201 @@ static string GetApiDumpPathFor(const AidlDefinedType& defined_type, const Optio
          ".aidl";
 }
 
+string internals::Sha1Hex(std::string_view data) {
+  unsigned char digest[EVP_MAX_MD_SIZE];
+  unsigned int size = 0;
+  CHECK(EVP_Digest(data.data(), data.size(), digest, &size, EVP_sha1(), nullptr));
+  static const char kHexDigits[] = "0123456789abcdef";
+  string hex;
+  for (unsigned int i = 0; i < size; i++) {
+    hex.push_back(kHexDigits[digest[i] >> 4]);
+    hex.push_back(kHexDigits[digest[i] & 0xf]);
+  }
+  return hex;
+}
+
+// The hash of an API dump is what the build used to compute with
+//   (find ./ -name "*.aidl" -print0 | LC_ALL=C sort -z | xargs -0 sha1sum && echo VERSION) |
+//       sha1sum
+// |file_hashes| maps the paths of the files in the dump, e.g. "./p/IFoo.aidl",
+// to the hashes of their contents, and is sorted like "LC_ALL=C sort".
+static string HashApiDump(const std::map<string, string>& file_hashes, const string& version) {
+  string listing;
+  for (const auto& [path, hash] : file_hashes) {
+    listing += hash + "  " + path + "\n";
+  }
+  listing += version + "\n";
+  return internals::Sha1Hex(listing);
+}
+
+// The manifest of an API dump (see --api-manifest) maps the paths of its
+// files, e.g. "./p/IFoo.aidl", to the hashes of their contents and to the
+// stamps that the files had when those were hashed. Each line of the file is
+// "HASH SIZE MTIME PATH".
+struct ApiManifestEntry {
+  string hash;
+  FileStamp stamp;
+};
+using ApiManifest = std::map<string, ApiManifestEntry>;
+
+constexpr char kApiManifestHeader[] = "aidl-api-manifest 1";
+
+// A manifest that is missing or broken is empty, so that every file of the
+// dump is hashed again.
+static ApiManifest read_api_manifest(const IoDelegate& io_delegate, const string& path) {
+  ApiManifest manifest;
+  unique_ptr<string> contents = io_delegate.GetFileContents(path);
+  if (contents == nullptr) {
+    return manifest;
+  }
+  vector<string> lines = Split(*contents, "\n");
+  if (lines.empty() || lines.front() != kApiManifestHeader) {
+    return manifest;
+  }
+  for (size_t i = 1; i < lines.size(); i++) {
+    if (lines[i].empty()) continue;
+    vector<string> fields = Split(lines[i], " ");
+    ApiManifestEntry entry;
+    if (fields.size() != 4 || !android::base::ParseInt(fields[1], &entry.stamp.size) ||
+        !android::base::ParseInt(fields[2], &entry.stamp.mtime_ns)) {
+      return {};
+    }
+    entry.hash = fields[0];
+    manifest[fields[3]] = entry;
+  }
+  return manifest;
+}
+
+static bool write_api_manifest(const IoDelegate& io_delegate, const string& path,
+                               const ApiManifest& manifest) {
+  CodeWriterPtr writer = io_delegate.GetCodeWriter(path);
+  (*writer) << kApiManifestHeader << "\n";
+  for (const auto& [file, entry] : manifest) {
+    (*writer) << entry.hash << " " << std::to_string(entry.stamp.size) << " "
+              << std::to_string(entry.stamp.mtime_ns) << " " << file << "\n";
+  }
+  return writer->Close();
+}
+
+static std::map<string, string> file_hashes_of(const ApiManifest& manifest) {
+  std::map<string, string> file_hashes;
+  for (const auto& [file, entry] : manifest) {
+    file_hashes[file] = entry.hash;
+  }
+  return file_hashes;
+}
+
 bool dump_api(const Options& options, const IoDelegate& io_delegate) {
+  const bool incremental = !options.ApiManifestFile().empty();
+  const ApiManifest previous =
+      incremental ? read_api_manifest(io_delegate, options.ApiManifestFile()) : ApiManifest();
+  ApiManifest manifest;
   for (const auto& file : options.InputFiles()) {
     AidlTypenames typenames;
     vector<AidlDefinedType*> defined_types;
     if (internals::load_and_validate_aidl(file, options, io_delegate, &typenames, &defined_types,
                                           nullptr) == AidlError::OK) {
       for (const auto type : defined_types) {
-        unique_ptr<CodeWriter> writer =
-            io_delegate.GetCodeWriter(GetApiDumpPathFor(*type, options));
+        // The dump is hashed as it is written, instead of being read back.
+        string dump;
+        CodeWriterPtr dump_writer = CodeWriter::ForString(&dump);
         if (!type->GetPackage().empty()) {
-          (*writer) << kPreamble << "package " << type->GetPackage() << ";\n";
+          (*dump_writer) << kPreamble << "package " << type->GetPackage() << ";\n";
+        }
+        type->Dump(dump_writer.get());
+        dump_writer->Close();
+
+        const string path = GetApiDumpPathFor(*type, options);
+        const string dump_path = "./" + path.substr(options.OutputDir().size());
+        ApiManifestEntry& entry = manifest[dump_path];
+        entry.hash = internals::Sha1Hex(dump);
+        // A file which still is what the previous dump wrote is left alone.
+        if (auto found = previous.find(dump_path);
+            found != previous.end() && found->second.hash == entry.hash &&
+            io_delegate.GetFileStamp(path) == found->second.stamp) {
+          entry.stamp = found->second.stamp;
+          continue;
+        }
+        unique_ptr<CodeWriter> writer = io_delegate.GetCodeWriter(path);
+        (*writer) << dump;
+        if (incremental) {
+          if (!writer->Close()) {
+            AIDL_ERROR(path) << "Can't write the API file.";
+            return false;
+          }
+          entry.stamp = io_delegate.GetFileStamp(path).value_or(FileStamp{});
         }
-        type->Dump(writer.get());
       }
     } else {
       return false;
     }
   }
-  return true;
+  if (incremental) {
+    // The rest are the files of types that have been removed since.
+    for (const auto& [dump_path, entry] : previous) {
+      if (manifest.count(dump_path) == 0) {
+        io_delegate.RemovePath(options.OutputDir() + dump_path.substr(2));
+      }
+    }
+  }
+  if (!options.HashApiVersion().empty()) {
+    unique_ptr<CodeWriter> writer = io_delegate.GetCodeWriter(options.OutputDir() + ".hash");
+    (*writer) << HashApiDump(file_hashes_of(manifest), options.HashApiVersion()) << "\n";
+  }
+  return !incremental || write_api_manifest(io_delegate, options.ApiManifestFile(), manifest);
+}
+
+bool hash_api(const Options& options, const IoDelegate& io_delegate) {
+  string dir = options.InputFiles().front();
+  while (dir.size() > 1 && dir.back() == OS_PATH_SEPARATOR) {
+    dir.pop_back();
+  }
+  const ApiManifest previous = options.ApiManifestFile().empty()
+                                   ? ApiManifest()
+                                   : read_api_manifest(io_delegate, options.ApiManifestFile());
+  ApiManifest manifest;
+  for (const string& file : io_delegate.ListFiles(dir)) {
+    if (!android::base::EndsWith(file, ".aidl")) continue;
+    size_t begin = dir.size();
+    while (begin < file.size() && file[begin] == OS_PATH_SEPARATOR) {
+      begin++;
+    }
+    const string dump_path = "./" + file.substr(begin);
+    ApiManifestEntry& entry = manifest[dump_path];
+    // The stamp is taken first, so that a file written while it is being
+    // read is hashed again the next time.
+    const std::optional<FileStamp> stamp = io_delegate.GetFileStamp(file);
+    if (auto found = previous.find(dump_path);
+        found != previous.end() && stamp && *stamp == found->second.stamp) {
+      entry = found->second;
+      continue;
+    }
+    unique_ptr<FileBuffer> buffer = io_delegate.GetFileBuffer(file);
+    if (buffer == nullptr) {
+      AIDL_ERROR(file) << "Can't read the API file.";
+      return false;
+    }
+    entry.hash = internals::Sha1Hex({buffer->Data(), buffer->Size()});
+    entry.stamp = stamp.value_or(FileStamp{});
+  }
+
+  // Like "read -r hash extra", only the first word of the file is the hash.
+  const string hash_file = dir + OS_PATH_SEPARATOR + ".hash";
+  unique_ptr<string> contents = io_delegate.GetFileContents(hash_file);
+  if (contents == nullptr) {
+    AIDL_ERROR(hash_file) << "Can't read the hash of the API dump.";
+    return false;
+  }
+  const string recorded = Split(android::base::Trim(*contents), " \t\n").front();
+  const string actual = HashApiDump(file_hashes_of(manifest), options.HashApiVersion());
+  if (recorded != actual) {
+    AIDL_ERROR(hash_file) << "The API dump has been modified: its hash at version "
+                          << options.HashApiVersion() << " is " << actual << ", not "
+                          << recorded << ".";
+    return false;
+  }
+  return options.ApiManifestFile().empty() ||
+         write_api_manifest(io_delegate, options.ApiManifestFile(), manifest);
 }
 
 }  // namespace aidl
@@ -16,11 +16,19 @@
 
 #pragma once
 
+#include <atomic>
+#include <functional>
 #include <limits>
+#include <map>
 #include <memory>
+#include <optional>
+#include <set>
+#include <sstream>
 #include <string>
+#include <string_view>
 #include <vector>
 
+#include "aidl_dependency_index.h"
 #include "aidl_language.h"
 #include "import_resolver.h"
 #include "io_delegate.h"
@@ -41,13 +49,16 @@ enum class AidlError {
   GENERATION_ERROR,
   BAD_INPUT,
   NOT_STRUCTURED,
+  BAD_PRECOMPILED_MODULE,
 
   OK = 0,
 };
 
 int compile_aidl(const Options& options, const IoDelegate& io_delegate);
 bool preprocess_aidl(const Options& options, const IoDelegate& io_delegate);
+bool precompile_aidl(const Options& options, const IoDelegate& io_delegate);
 bool dump_api(const Options& options, const IoDelegate& io_delegate);
+bool hash_api(const Options& options, const IoDelegate& io_delegate);
 bool dump_mappings(const Options& options, const IoDelegate& io_delegate);
 
 const char kPreamble[] =
@@ -72,18 +83,114 @@ const char kPreamble[] =
 
 const string kGetInterfaceVersion("getInterfaceVersion");
 const string kGetInterfaceHash("getInterfaceHash");
+const string kFlushBatchedCalls("flushBatchedCalls");
+
+// The meta transaction that carries the queued calls of the @Batchable methods
+// of an interface, as an offset from FIRST_CALL_TRANSACTION
+extern const int kBatchTransactionId;
+// A proxy sends its queued calls once it has this many of them, or this many
+// bytes of them
+const int kMaxBatchedCalls = 32;
+const int kMaxBatchBytes = 64 * 1024;
+// ... or once its oldest queued call has waited this long. It is
+// BatchTimer::kMaxDelay in aidl/batch_timer.h, which the C++ and NDK proxies
+// schedule their flushes on.
+const int kMaxBatchDelayMs = 10;
 
 namespace internals {
 
+// Files that have been parsed into an AidlTypenames which is shared by several
+// calls to load_and_validate_aidl(), e.g. for all inputs of one compile_aidl()
+// invocation. A file that is imported by many inputs, or that is imported by
+// one input and compiled as another, is parsed only once.
+struct ParsedFiles {
+  explicit ParsedFiles(AidlTypenames& typenames) : parsers(typenames) {}
+  ParsedFileCache parsers;
+  std::set<std::string> preprocessed_files;
+  // Types loaded from each precompiled module
+  std::map<std::string, std::vector<AidlDefinedType*>> precompiled_modules;
+  // The import directories listed so far
+  ImportIndex import_index;
+};
+
+// Lexically normalizes |path| (drops "." and empty components and folds "..")
+// so that the same file reached through different paths is recognized.
+std::string NormalizePath(const std::string& path);
+
+// The SHA-1 of |data| in lowercase hex
+std::string Sha1Hex(std::string_view data);
+
+// When |parsed_files| is not null, |typenames| must be the one it was created for.
 AidlError load_and_validate_aidl(const std::string& input_file_name, const Options& options,
                                  const IoDelegate& io_delegate, AidlTypenames* typenames,
                                  vector<AidlDefinedType*>* defined_types,
-                                 vector<string>* imported_files);
+                                 vector<string>* imported_files,
+                                 ParsedFiles* parsed_files = nullptr);
 
 bool parse_preprocessed_file(const IoDelegate& io_delegate, const std::string& filename,
                              AidlTypenames* typenames);
 
+// Runs task(i) for each i < num_tasks on up to |num_threads| threads. The
+// errors of each task are buffered in diagnostics[i], for the caller to print
+// them in order once all tasks are done: those of AIDL_ERROR, those written to
+// AidlError::ThreadOutput(), and the LOG() messages when AidlError::Logger()
+// is the logger, as main() makes it.
+void run_tasks(size_t num_tasks, size_t num_threads, const std::function<bool(size_t)>& task,
+               std::vector<std::ostringstream>* diagnostics,
+               std::unique_ptr<std::atomic_bool[]>* succeeded);
+
 } // namespace internals
 
+// The files that a resident compiler (see --server) keeps parsed between jobs,
+// so that the imports that the inputs of consecutive jobs have in common are
+// parsed only once. The jobs then behave like the inputs of one compile_aidl()
+// invocation.
+class CompileSession {
+ public:
+  CompileSession() = default;
+
+  // Returns the parsed files to compile the inputs of |options| against. The
+  // files of the previous jobs are kept only if those were run with the same
+  // settings from the same directory, none of the files has changed since
+  // and none of the inputs has been compiled before; otherwise the session
+  // starts over. The inputs that are up to date in Dependencies() are left
+  // out of the job, and don't count as compiled again.
+  internals::ParsedFiles* Prepare(const Options& options, const IoDelegate& io_delegate);
+
+  // Drops all parsed files, e.g. after a job has failed. The dependencies of
+  // the inputs that have been compiled are kept.
+  void Clear();
+
+  // What the inputs of the jobs so far have read and written, e.g. to find
+  // the outputs that a change to a file makes stale or to compile its
+  // dependents again with DependencyIndex::Invalidate().
+  DependencyIndex& Dependencies() { return dependencies_; }
+  const DependencyIndex& Dependencies() const { return dependencies_; }
+
+  // The normalized paths of the inputs that the last Prepare() left out.
+  const std::set<std::string>& UpToDateInputs() const { return up_to_date_inputs_; }
+
+  AidlTypenames* Typenames() const { return typenames_.get(); }
+
+  // Number of Prepare() calls that kept the files of the previous jobs.
+  size_t Reuses() const { return reuses_; }
+
+ private:
+  std::string settings_;
+  // Hashes of the preprocessed files and precompiled modules, if they exist.
+  std::map<std::string, std::optional<size_t>> included_files_;
+  std::set<std::string> compiled_inputs_;
+  std::unique_ptr<AidlTypenames> typenames_;
+  std::unique_ptr<internals::ParsedFiles> parsed_files_;
+  DependencyIndex dependencies_;
+  std::set<std::string> up_to_date_inputs_;
+  size_t reuses_ = 0;
+
+  DISALLOW_COPY_AND_ASSIGN(CompileSession);
+};
+
+// Like compile_aidl() above, but reuses the files that |session| has parsed.
+int compile_aidl(const Options& options, const IoDelegate& io_delegate, CompileSession* session);
+
 }  // namespace aidl
 }  // namespace android
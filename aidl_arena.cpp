@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "aidl_arena.h"
+
+#include <new>
+
+#include "logging.h"
+
+namespace android {
+namespace aidl {
+
+namespace {
+
+// Every allocation is preceded by a header that tells Free() where the memory
+// came from.
+struct alignas(std::max_align_t) AllocationHeader {
+  AidlArena* arena;  // nullptr for heap allocations
+};
+
+constexpr size_t kAlignment = alignof(std::max_align_t);
+constexpr size_t kBlockSize = 64 * 1024;
+
+thread_local AidlArena* current_arena = nullptr;
+
+size_t AlignUp(size_t size) {
+  return (size + kAlignment - 1) & ~(kAlignment - 1);
+}
+
+}  // namespace
+
+AidlArena::~AidlArena() {
+  // Objects are destroyed before the blocks they live in, the last made
+  // first.
+  for (auto it = owned_.rbegin(); it != owned_.rend(); ++it) {
+    it->destroy(it->object);
+  }
+}
+
+void* AidlArena::Allocate(size_t size) {
+  const size_t total = sizeof(AllocationHeader) + AlignUp(size);
+  AllocationHeader* header;
+  if (current_arena != nullptr) {
+    header = static_cast<AllocationHeader*>(current_arena->AllocateInBlock(total));
+  } else {
+    header = static_cast<AllocationHeader*>(::operator new(total));
+  }
+  header->arena = current_arena;
+  return header + 1;
+}
+
+void AidlArena::Free(void* p) {
+  if (p == nullptr) {
+    return;
+  }
+  AllocationHeader* header = static_cast<AllocationHeader*>(p) - 1;
+  if (header->arena == nullptr) {
+    ::operator delete(header);
+  }
+  // Arena memory is released with the arena.
+}
+
+void* AidlArena::AllocateOwned(size_t size, void (*destroy)(void*)) {
+  CHECK(current_arena != nullptr) << "No arena to own the object";
+  void* object = current_arena->AllocateInBlock(AlignUp(size));
+  if (destroy != nullptr) {
+    current_arena->owned_.push_back({object, destroy});
+  }
+  return object;
+}
+
+void* AidlArena::AllocateInBlock(size_t size) {
+  bytes_allocated_ += size;
+  if (size > kBlockSize / 4) {
+    // Large allocations get a block of their own, so that the current block
+    // isn't wasted.
+    blocks_.emplace_back(new char[size]);
+    return blocks_.back().get();
+  }
+  if (size > remaining_) {
+    blocks_.emplace_back(new char[kBlockSize]);
+    next_ = blocks_.back().get();
+    remaining_ = kBlockSize;
+  }
+  void* p = next_;
+  next_ += size;
+  remaining_ -= size;
+  return p;
+}
+
+AidlArena::Scope::Scope(AidlArena* arena) : previous_(current_arena) {
+  current_arena = arena;
+}
+
+AidlArena::Scope::~Scope() {
+  current_arena = previous_;
+}
+
+}  // namespace aidl
+}  // namespace android
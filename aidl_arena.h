@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <android-base/macros.h>
+
+namespace android {
+namespace aidl {
+
+// A bump allocator for the AST nodes that are created while parsing.
+//
+// Nodes keep their usual owners (unique_ptrs in AidlTypenames, Parser and the
+// nodes themselves), which run their destructors. Deleting a node that lives
+// in an arena doesn't free anything; all its memory is released at once when
+// the arena is destroyed. The arena is shared by AidlTypenames and the
+// parsers that allocated from it, so it outlives all of their nodes.
+//
+// Objects can also be owned by the arena itself (see Make()), for trees that
+// are built and dropped as a whole, like the Java AST.
+class AidlArena {
+ public:
+  AidlArena() = default;
+  ~AidlArena();
+
+  // Allocates |size| bytes from the arena of the current thread, if any, or
+  // from the heap otherwise. The memory must be released with Free().
+  static void* Allocate(size_t size);
+  static void Free(void* p);
+
+  // Makes |arena| the arena of the current thread for the lifetime of the
+  // scope.
+  class Scope {
+   public:
+    explicit Scope(AidlArena* arena);
+    ~Scope();
+
+   private:
+    AidlArena* const previous_;
+
+    DISALLOW_COPY_AND_ASSIGN(Scope);
+  };
+
+  // Constructs a T in the arena of the current thread, which owns it. The
+  // object is destroyed along with the arena and must not be deleted. There
+  // must be a current arena.
+  template <typename T, typename... Args>
+  static T* Make(Args&&... args) {
+    void (*destroy)(void*) = nullptr;
+    if constexpr (!std::is_trivially_destructible_v<T>) {
+      destroy = [](void* object) { static_cast<T*>(object)->~T(); };
+    }
+    return ::new (AllocateOwned(sizeof(T), destroy)) T(std::forward<Args>(args)...);
+  }
+
+  // Total number of bytes handed out by this arena.
+  size_t BytesAllocated() const { return bytes_allocated_; }
+
+  // Keeps |object| alive as long as the arena. Used for the source buffers
+  // that the nodes refer to.
+  void Retain(std::shared_ptr<const void> object) { retained_.push_back(std::move(object)); }
+
+ private:
+  struct OwnedObject {
+    void* object;
+    void (*destroy)(void*);
+  };
+
+  void* AllocateInBlock(size_t size);
+  // Allocates an object that is destroyed by |destroy|, if any, with the
+  // arena of the current thread.
+  static void* AllocateOwned(size_t size, void (*destroy)(void*));
+
+  std::vector<OwnedObject> owned_;
+  std::vector<std::shared_ptr<const void>> retained_;
+  std::vector<std::unique_ptr<char[]>> blocks_;
+  char* next_ = nullptr;
+  size_t remaining_ = 0;
+  size_t bytes_allocated_ = 0;
+
+  DISALLOW_COPY_AND_ASSIGN(AidlArena);
+};
+
+}  // namespace aidl
+}  // namespace android
@@ -0,0 +1,387 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "aidl_cache.h"
+
+#include <sys/stat.h>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+#include <android-base/stringprintf.h>
+#include <android-base/strings.h>
+
+#include "aidl.h"
+#include "aidl_profile.h"
+#include "logging.h"
+#include "os.h"
+
+using android::base::EndsWith;
+using android::base::Join;
+using android::base::Split;
+using android::base::StartsWith;
+using android::base::StringPrintf;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+namespace android {
+namespace aidl {
+
+namespace {
+
+constexpr char kEntryHeader[] = "aidl-cache 1";
+constexpr char kEntryEnd[] = "end";
+
+// What an entry records for a file that couldn't be read
+constexpr char kMissing[] = "-";
+
+// The kinds of the lines of an entry: "KIND VALUE PATH"
+constexpr char kRead[] = "read";          // VALUE is the hash of the contents
+constexpr char kReadable[] = "readable";  // VALUE is 1 or 0
+constexpr char kList[] = "list";          // VALUE is the hash of the listing
+constexpr char kListDir[] = "listdir";    // VALUE is the hash of the listing
+constexpr char kOutput[] = "out";         // VALUE is the hash of the object
+
+string CachePath(const Options& options, const char* dir, const string& hash) {
+  return options.CacheDir() + dir + OS_PATH_SEPARATOR + hash.substr(0, 2) + OS_PATH_SEPARATOR +
+         hash;
+}
+
+string ContentsHash(const FileBuffer* buffer) {
+  return buffer == nullptr ? kMissing : internals::Sha1Hex({buffer->Data(), buffer->Size()});
+}
+
+// Only the .aidl files count, which are all that a compilation looks for in a
+// listing, so that the other files of an import directory, like the cache
+// itself, don't make misses.
+string ListingHash(const vector<string>& files) {
+  vector<string> aidl_files;
+  for (const string& file : files) {
+    if (EndsWith(file, ".aidl")) {
+      aidl_files.push_back(file);
+    }
+  }
+  return internals::Sha1Hex(Join(aidl_files, "\n"));
+}
+
+// What |io_delegate| finds now for the line of an entry, or nullopt if
+// |kind| is unknown.
+std::optional<string> Observe(const IoDelegate& io_delegate, const string& kind,
+                              const string& path) {
+  if (kind == kRead) {
+    return ContentsHash(io_delegate.GetFileBuffer(path).get());
+  } else if (kind == kReadable) {
+    return io_delegate.FileIsReadable(path) ? "1" : "0";
+  } else if (kind == kList) {
+    return ListingHash(io_delegate.ListFiles(path));
+  } else if (kind == kListDir) {
+    return ListingHash(io_delegate.ListDirectory(path));
+  }
+  return std::nullopt;
+}
+
+// Identifies the build of the compiler by the size and the modification time
+// of its executable, so that the outputs of one build aren't restored by
+// another. Empty where the build can't be identified, elsewhere than on Linux.
+string CompilerId() {
+#ifdef __linux__
+  struct stat st;
+  if (stat("/proc/self/exe", &st) == 0) {
+    return StringPrintf("%lld:%lld.%09ld", static_cast<long long>(st.st_size),
+                        static_cast<long long>(st.st_mtim.tv_sec), st.st_mtim.tv_nsec);
+  }
+#endif
+  return "";
+}
+
+// Whether args[*i] is one of the arguments that don't change the outputs. If
+// its value is the next argument, *i is moved to that.
+bool IsIgnoredArg(const vector<string>& args, size_t* i) {
+  const string& arg = args[*i];
+  if (arg == "--write-if-changed") {
+    return true;
+  }
+  static const vector<string> kArgsWithValues = {"--cache-dir", "--jobs", "-j"};
+  for (const string& name : kArgsWithValues) {
+    if (arg == name) {
+      if (*i + 1 < args.size()) {
+        (*i)++;
+      }
+      return true;
+    }
+    if (StartsWith(arg, name + "=") || (name == "-j" && StartsWith(arg, name))) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Forwards to another IoDelegate, recording what the compilation finds when
+// it reads, lists or looks for files. The outputs are held back until
+// Commit(), so that they can be stored in the cache as well.
+class RecordingIoDelegate : public IoDelegate {
+ public:
+  explicit RecordingIoDelegate(const IoDelegate& io_delegate) : io_delegate_(io_delegate) {}
+
+  unique_ptr<string> GetFileContents(const string& filename,
+                                     const string& content_suffix = "") const override {
+    unique_ptr<FileBuffer> buffer = GetFileBuffer(filename);
+    if (buffer == nullptr) {
+      return nullptr;
+    }
+    return std::make_unique<string>(string(buffer->Data(), buffer->Size()) + content_suffix);
+  }
+
+  unique_ptr<FileBuffer> GetFileBuffer(const string& filename) const override {
+    unique_ptr<FileBuffer> buffer = io_delegate_.GetFileBuffer(filename);
+    Record(kRead, filename, ContentsHash(buffer.get()));
+    return buffer;
+  }
+
+  unique_ptr<LineReader> GetLineReader(const string& file_path) const override {
+    unique_ptr<string> contents = GetFileContents(file_path);
+    if (contents == nullptr) {
+      return nullptr;
+    }
+    return LineReader::ReadFromMemory(*contents);
+  }
+
+  bool FileIsReadable(const string& path) const override {
+    const bool readable = io_delegate_.FileIsReadable(path);
+    Record(kReadable, path, readable ? "1" : "0");
+    return readable;
+  }
+
+  std::optional<FileStamp> GetFileStamp(const string& path) const override {
+    return io_delegate_.GetFileStamp(path);
+  }
+
+  vector<string> ListFiles(const string& dir) const override {
+    vector<string> files = io_delegate_.ListFiles(dir);
+    Record(kList, dir, ListingHash(files));
+    return files;
+  }
+
+  vector<string> ListDirectory(const string& dir) const override {
+    vector<string> files = io_delegate_.ListDirectory(dir);
+    Record(kListDir, dir, ListingHash(files));
+    return files;
+  }
+
+  unique_ptr<CodeWriter> GetCodeWriter(const string& file_path) const override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    string& contents = outputs_[file_path];
+    contents.clear();
+    CodeWriterPtr writer = CodeWriter::ForString(&contents);
+    writer->CountAsOutput();
+    return writer;
+  }
+
+  void RemovePath(const string& file_path) const override {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      outputs_.erase(file_path);
+    }
+    io_delegate_.RemovePath(file_path);
+  }
+
+  bool LinkOrCopyFile(const string& from, const string& to) const override {
+    unique_ptr<string> contents = GetFileContents(from);
+    if (contents == nullptr) {
+      return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    outputs_[to] = std::move(*contents);
+    return true;
+  }
+
+  // Writes the outputs through the IoDelegate this one forwards to.
+  bool Commit() const {
+    for (const auto& [path, contents] : outputs_) {
+      CodeWriterPtr writer = io_delegate_.GetCodeWriter(path);
+      if (writer == nullptr || !writer->WriteBytes(contents) || !writer->Close()) {
+        AIDL_ERROR(path) << "Can't write the output.";
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // The contents of an entry for what the compilation found and wrote, whose
+  // outputs are the objects |object_hashes| maps them to.
+  string Entry(const std::map<string, string>& object_hashes) const {
+    std::ostringstream entry;
+    entry << kEntryHeader << "\n";
+    for (const auto& [line, value] : records_) {
+      entry << line.first << " " << value << " " << line.second << "\n";
+    }
+    for (const auto& [path, hash] : object_hashes) {
+      entry << kOutput << " " << hash << " " << path << "\n";
+    }
+    entry << kEntryEnd << "\n";
+    return entry.str();
+  }
+
+  const std::map<string, string>& Outputs() const { return outputs_; }
+
+ private:
+  void Record(const char* kind, const string& path, const string& value) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // The first time counts, should the file change during the compilation.
+    records_.emplace(std::make_pair(kind, path), value);
+  }
+
+  const IoDelegate& io_delegate_;
+  mutable std::mutex mutex_;
+  mutable std::map<std::pair<string, string>, string> records_;
+  mutable std::map<string, string> outputs_;
+};
+
+// Restores the outputs of |entry| if everything that its compilation found
+// is still the same, and the objects of the outputs are intact.
+bool Restore(const Options& options, const IoDelegate& io_delegate, const string& entry) {
+  const vector<string> lines = Split(entry, "\n");
+  if (lines.empty() || lines[0] != kEntryHeader) {
+    return false;
+  }
+  vector<std::pair<string, string>> outputs;  // the objects and the paths
+  bool complete = false;
+  for (size_t i = 1; i < lines.size() && !complete; i++) {
+    const string& line = lines[i];
+    if (line == kEntryEnd) {
+      complete = true;
+      continue;
+    }
+    const size_t kind_end = line.find(' ');
+    const size_t value_end = kind_end == string::npos ? kind_end : line.find(' ', kind_end + 1);
+    if (value_end == string::npos) {
+      return false;
+    }
+    const string kind = line.substr(0, kind_end);
+    const string value = line.substr(kind_end + 1, value_end - kind_end - 1);
+    const string path = line.substr(value_end + 1);
+    if (kind == kOutput) {
+      const string object = CachePath(options, "objects", value);
+      if (ContentsHash(io_delegate.GetFileBuffer(object).get()) != value) {
+        return false;
+      }
+      outputs.emplace_back(object, path);
+    } else if (Observe(io_delegate, kind, path) != value) {
+      return false;
+    }
+  }
+  if (!complete) {
+    return false;
+  }
+  for (const auto& [object, path] : outputs) {
+    if (!io_delegate.LinkOrCopyFile(object, path)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Stores the outputs of |recorder| and the entry for them at |entry_path|.
+// The entry is written last, so that it only ever refers to complete objects.
+void Store(const Options& options, const IoDelegate& io_delegate, const string& entry_path,
+           const RecordingIoDelegate& recorder) {
+  auto write = [&](const string& path, const string& contents) {
+    // A new file rather than one that an output may be a link to
+    io_delegate.RemovePath(path);
+    CodeWriterPtr writer = io_delegate.GetCodeWriter(path);
+    return writer != nullptr && writer->WriteBytes(contents) && writer->Close();
+  };
+  std::map<string, string> object_hashes;
+  for (const auto& [path, contents] : recorder.Outputs()) {
+    const string hash = internals::Sha1Hex(contents);
+    const string object = CachePath(options, "objects", hash);
+    if (ContentsHash(io_delegate.GetFileBuffer(object).get()) != hash &&
+        !write(object, contents)) {
+      return;
+    }
+    object_hashes[path] = hash;
+  }
+  write(entry_path, recorder.Entry(object_hashes));
+}
+
+}  // namespace
+
+namespace internals {
+
+std::optional<string> cache_key(const Options& options, const IoDelegate& io_delegate) {
+  std::ostringstream key;
+  key << kEntryHeader << '\0' << CompilerId() << '\0';
+  const vector<string>& args = options.Args();
+  for (size_t i = 0; i < args.size(); i++) {
+    if (!IsIgnoredArg(args, &i)) {
+      key << args[i] << '\0';
+    }
+  }
+  for (const string& input : options.InputFiles()) {
+    unique_ptr<FileBuffer> buffer = io_delegate.GetFileBuffer(input);
+    if (buffer == nullptr) {
+      return std::nullopt;
+    }
+    key << '\0' << input << '\0' << ContentsHash(buffer.get());
+  }
+  return Sha1Hex(key.str());
+}
+
+}  // namespace internals
+
+int compile_cached(const Options& options, const IoDelegate& io_delegate,
+                   const std::function<int(const IoDelegate&)>& compile) {
+  // A hit would leave the profile and the stats without the compilation that
+  // they report on, and without the build of the compiler in the key, the
+  // outputs of another build could be restored.
+  if (!options.ProfileFile().empty() || !options.StatsFile().empty() || CompilerId().empty()) {
+    return compile(io_delegate);
+  }
+  std::optional<string> key;
+  {
+    ProfileScope scope("cache lookup");
+    key = internals::cache_key(options, io_delegate);
+    if (key) {
+      unique_ptr<string> entry = io_delegate.GetFileContents(CachePath(options, "entries", *key));
+      if (entry != nullptr && Restore(options, io_delegate, *entry)) {
+        return 0;
+      }
+    }
+  }
+  if (!key) {
+    // The compilation reports the input that can't be read.
+    return compile(io_delegate);
+  }
+
+  RecordingIoDelegate recorder(io_delegate);
+  int ret = compile(recorder);
+  if (!recorder.Commit()) {
+    ret = 1;
+  }
+  if (ret == 0) {
+    ProfileScope scope("cache store");
+    Store(options, io_delegate, CachePath(options, "entries", *key), recorder);
+  }
+  return ret;
+}
+
+}  // namespace aidl
+}  // namespace android
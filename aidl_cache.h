@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <functional>
+#include <optional>
+#include <string>
+
+#include "io_delegate.h"
+#include "options.h"
+
+namespace android {
+namespace aidl {
+
+// Runs |compile|, unless the cache in options.CacheDir() (see --cache-dir)
+// has the outputs of an earlier compilation with the same key. Then the
+// outputs, including the dependency file, are restored from the cache
+// without parsing anything, provided every file that the earlier
+// compilation read, listed or looked for is still the same.
+//
+// Otherwise |compile| runs against an IoDelegate that records what it reads
+// and holds its outputs back until it returns. The outputs are then written,
+// and stored in the cache if the compilation succeeded.
+//
+// The cache is bypassed with --profile and --stats, and where the build of
+// the compiler can't be identified.
+//
+// The cache is a directory of
+//   objects/XX/HASH   the outputs, named by the SHA-1 of their contents
+//   entries/XX/KEY    what the compilation of KEY read and wrote
+// which any number of processes may share. A file of the cache that is
+// broken or was changed through a hard link only makes a miss.
+int compile_cached(const Options& options, const IoDelegate& io_delegate,
+                   const std::function<int(const IoDelegate&)>& compile);
+
+namespace internals {
+
+// The key of the outputs of compiling |options|: the SHA-1 of the build of
+// the compiler, of the arguments that affect the outputs and of the names and
+// the contents of the input files. nullopt if an input can't be read.
+std::optional<std::string> cache_key(const Options& options, const IoDelegate& io_delegate);
+
+}  // namespace internals
+}  // namespace aidl
+}  // namespace android
@@ -17,10 +17,15 @@
 #include "aidl.h"
 #include "aidl_language.h"
 #include "import_resolver.h"
+#include "io_delegate.h"
 #include "logging.h"
 #include "options.h"
 
+#include <atomic>
+#include <iostream>
 #include <map>
+#include <memory>
+#include <sstream>
 #include <string>
 #include <vector>
 
@@ -245,50 +250,79 @@ static bool are_compatible_enums(const AidlEnumDeclaration& older,
   return compatible;
 }
 
-bool check_api(const Options& options, const IoDelegate& io_delegate) {
-  CHECK(options.IsStructured());
-  CHECK(options.InputFiles().size() == 2) << "--checkapi requires two inputs "
-                                          << "but got " << options.InputFiles().size();
-  AidlTypenames old_tns;
-  const string old_dir = options.InputFiles().at(0);
-  vector<AidlDefinedType*> old_types;
-  vector<string> old_files = io_delegate.ListFiles(old_dir);
-  if (old_files.size() == 0) {
-    AIDL_ERROR(old_dir) << "No API file exist";
-    return false;
+// Everything the compatibility checks compare is in the dump of a type,
+// except the annotations on the types of constants.
+static string structural_fingerprint(const AidlDefinedType& type) {
+  string fingerprint;
+  CodeWriterPtr writer = CodeWriter::ForString(&fingerprint);
+  type.Dump(writer.get());
+  writer->Close();
+  if (const AidlInterface* interface = type.AsInterface(); interface != nullptr) {
+    for (const auto& c : interface->GetConstantDeclarations()) {
+      fingerprint += c->GetType().Signature() + "\n";
+    }
   }
-  for (const auto& file : old_files) {
+  return fingerprint;
+}
+
+// Returns the .aidl files of an API dump, keyed by their path in the dump.
+static map<string, string> list_api_files(const string& dir, const vector<string>& files) {
+  map<string, string> api_files;
+  for (const auto& file : files) {
     if (!android::base::EndsWith(file, ".aidl")) continue;
+    api_files.emplace(file.substr(dir.size()), file);
+  }
+  return api_files;
+}
 
-    vector<AidlDefinedType*> types;
-    if (internals::load_and_validate_aidl(file, options, io_delegate, &old_tns, &types,
-                                          nullptr /* imported_files */) != AidlError::OK) {
-      AIDL_ERROR(file) << "Failed to read.";
+// Frozen versions are usually checked against dumps they are copies of.
+static bool are_identical_dumps(const IoDelegate& io_delegate, const map<string, string>& older,
+                                const map<string, string>& newer) {
+  if (older.size() != newer.size()) {
+    return false;
+  }
+  for (auto old_it = older.begin(), new_it = newer.begin(); old_it != older.end();
+       ++old_it, ++new_it) {
+    if (old_it->first != new_it->first) {
+      return false;
+    }
+    unique_ptr<FileBuffer> old_buffer = io_delegate.GetFileBuffer(old_it->second);
+    unique_ptr<FileBuffer> new_buffer = io_delegate.GetFileBuffer(new_it->second);
+    if (old_buffer == nullptr || new_buffer == nullptr ||
+        std::string_view(old_buffer->Data(), old_buffer->Size()) !=
+            std::string_view(new_buffer->Data(), new_buffer->Size())) {
       return false;
     }
-    old_types.insert(old_types.end(), types.begin(), types.end());
   }
+  return true;
+}
 
-  AidlTypenames new_tns;
-  const string new_dir = options.InputFiles().at(1);
-  vector<AidlDefinedType*> new_types;
-  vector<string> new_files = io_delegate.ListFiles(new_dir);
-  if (new_files.size() == 0) {
-    AIDL_ERROR(new_dir) << "No API file exist";
-    return false;
+static bool load_api_dump(const Options& options, const IoDelegate& io_delegate,
+                          const map<string, string>& files, AidlTypenames* typenames,
+                          vector<AidlDefinedType*>* defined_types) {
+  // The files are read ahead, so that each one is parsed while the next ones
+  // are on their way, rather than after it has been waited for.
+  constexpr size_t kReadAheadThreads = 4;
+  vector<string> paths;
+  for (const auto& [path, file] : files) {
+    paths.push_back(file);
   }
-  for (const auto& file : new_files) {
-    if (!android::base::EndsWith(file, ".aidl")) continue;
-
+  const ReadAheadIoDelegate read_ahead(io_delegate, std::move(paths), kReadAheadThreads);
+  for (const auto& [path, file] : files) {
     vector<AidlDefinedType*> types;
-    if (internals::load_and_validate_aidl(file, options, io_delegate, &new_tns, &types,
+    if (internals::load_and_validate_aidl(file, options, read_ahead, typenames, &types,
                                           nullptr /* imported_files */) != AidlError::OK) {
       AIDL_ERROR(file) << "Failed to read.";
       return false;
     }
-    new_types.insert(new_types.end(), types.begin(), types.end());
+    defined_types->insert(defined_types->end(), types.begin(), types.end());
   }
+  return true;
+}
 
+// Whether the types of |newer| are backwards compatible with those of |older|
+static bool are_compatible_dumps(const vector<AidlDefinedType*>& old_types,
+                                 const vector<AidlDefinedType*>& new_types) {
   map<string, AidlDefinedType*> new_map;
   for (const auto t : new_types) {
     new_map.emplace(t->GetCanonicalName(), t);
@@ -304,6 +338,12 @@ bool check_api(const Options& options, const IoDelegate& io_delegate) {
     }
     const auto new_type = found->second;
 
+    // Unstructured parcelables are never compatible, not even with themselves.
+    if (old_type->AsUnstructuredParcelable() == nullptr &&
+        structural_fingerprint(*old_type) == structural_fingerprint(*new_type)) {
+      continue;
+    }
+
     if (old_type->AsInterface() != nullptr) {
       if (new_type->AsInterface() == nullptr) {
         AIDL_ERROR(new_type) << "Type mismatch: " << old_type->GetCanonicalName()
@@ -343,5 +383,112 @@ bool check_api(const Options& options, const IoDelegate& io_delegate) {
   return compatible;
 }
 
+// A version of an API, which is loaded unless the versions next to it are
+// identical copies of it
+struct ApiDump {
+  string dir;
+  map<string, string> files;
+  AidlTypenames typenames;
+  vector<AidlDefinedType*> types;
+};
+
+bool check_api(const Options& options, const IoDelegate& io_delegate) {
+  CHECK(options.IsStructured());
+  CHECK(options.InputFiles().size() >= 2) << "--checkapi requires at least two inputs "
+                                          << "but got " << options.InputFiles().size();
+  const size_t num_dumps = options.InputFiles().size();
+  vector<std::unique_ptr<ApiDump>> dumps;
+  for (const string& dir : options.InputFiles()) {
+    vector<string> files = io_delegate.ListFiles(dir);
+    if (files.size() == 0) {
+      AIDL_ERROR(dir) << "No API file exist";
+      return false;
+    }
+    dumps.push_back(std::make_unique<ApiDump>());
+    dumps.back()->dir = dir;
+    dumps.back()->files = list_api_files(dir, files);
+  }
+
+  // Each pair of consecutive dumps is checked, each dump being loaded once. A
+  // dump that is an identical copy of the one before it is neither loaded nor
+  // checked against it, but the first of a run of copies is still loaded, so
+  // that a dump that is invalid fails even when it is copied unchanged.
+  vector<bool> identical(num_dumps, false);  // to the one before
+  vector<size_t> to_load;
+  for (size_t i = 0; i < num_dumps; i++) {
+    if (i > 0) {
+      identical[i] = are_identical_dumps(io_delegate, dumps[i - 1]->files, dumps[i]->files);
+    }
+    if (!identical[i]) {
+      to_load.push_back(i);
+    }
+  }
+
+  // The dumps share nothing, so they are loaded side by side with --jobs. The
+  // errors are printed in order, up to those of the first dump that fails,
+  // and a dump after that one isn't loaded when the threads get to it.
+  const size_t num_threads = std::min<size_t>(options.Jobs(), to_load.size());
+  std::atomic_size_t first_failure = to_load.size();
+  vector<std::ostringstream> diagnostics;
+  std::unique_ptr<std::atomic_bool[]> loaded;
+  internals::run_tasks(
+      to_load.size(), num_threads,
+      [&](size_t i) {
+        if (i > first_failure) {
+          return false;
+        }
+        ApiDump& dump = *dumps[to_load[i]];
+        if (load_api_dump(options, io_delegate, dump.files, &dump.typenames, &dump.types)) {
+          return true;
+        }
+        size_t failure = first_failure;
+        while (i < failure && !first_failure.compare_exchange_weak(failure, i)) {
+        }
+        return false;
+      },
+      &diagnostics, &loaded);
+  for (size_t i = 0; i < to_load.size(); i++) {
+    std::cerr << diagnostics[i].str();
+    if (!loaded[i]) {
+      return false;
+    }
+  }
+
+  // Every pair is checked, so that all the incompatible ones are reported.
+  bool all_compatible = true;
+  for (size_t i = 1; i < num_dumps; i++) {
+    if (identical[i]) {
+      continue;
+    }
+    if (!are_compatible_dumps(dumps[i - 1]->types, dumps[i]->types)) {
+      if (num_dumps > 2) {
+        AIDL_ERROR(dumps[i]->dir) << "Not backwards compatible with " << dumps[i - 1]->dir;
+      }
+      all_compatible = false;
+    }
+  }
+  return all_compatible;
+}
+
+bool load_api_fingerprints(const IoDelegate& io_delegate, const string& dir,
+                           map<string, string>* fingerprints) {
+  vector<string> files = io_delegate.ListFiles(dir);
+  if (files.size() == 0) {
+    AIDL_ERROR(dir) << "No API file exist";
+    return false;
+  }
+  // The dump is parsed for --checkapi, which takes two of them.
+  const Options options = Options::From(vector<string>{"aidl", "--checkapi", dir, dir});
+  AidlTypenames typenames;
+  vector<AidlDefinedType*> types;
+  if (!load_api_dump(options, io_delegate, list_api_files(dir, files), &typenames, &types)) {
+    return false;
+  }
+  for (const AidlDefinedType* type : types) {
+    (*fingerprints)[type->GetCanonicalName()] = structural_fingerprint(*type);
+  }
+  return true;
+}
+
 }  // namespace aidl
 }  // namespace android
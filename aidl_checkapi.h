@@ -14,15 +14,24 @@
  */
 #pragma once
 
+#include <map>
+#include <string>
+
 #include "io_delegate.h"
 #include "options.h"
 
 namespace android {
 namespace aidl {
 
-// Compare the two API dumps, which are given as input files, and test whether
-// the second API dump is backwards compatible with the first API dump.
+// Compare the API dumps, which are given as input files, and test whether
+// each API dump is backwards compatible with the one before it.
 bool check_api(const Options& options, const IoDelegate& io_delegate);
 
+// Loads the API dump in |dir| as --checkapi does and returns, by canonical
+// name, the fingerprints of its types, which are equal whenever --checkapi
+// finds two versions of a type the same.
+bool load_api_fingerprints(const IoDelegate& io_delegate, const std::string& dir,
+                           std::map<std::string, std::string>* fingerprints);
+
 }  // namespace aidl
 }  // namespace android
@@ -22,6 +22,7 @@
 #include <algorithm>
 #include <iostream>
 #include <memory>
+#include <mutex>
 
 #include <android-base/parsedouble.h>
 #include <android-base/parseint.h>
@@ -33,12 +34,17 @@ using std::string;
 using std::unique_ptr;
 using std::vector;
 
+namespace {
+// Guards the folded literals while they are set.
+std::mutex folded_literals_mutex;
+}  // namespace
+
 #define SHOULD_NOT_REACH() CHECK(false) << LOG(FATAL) << ": should not reach here: "
-#define OPEQ(__y__) (string(op_) == string(__y__))
+#define OPEQ(__y__) (op_ == __y__)
 #define COMPUTE_UNARY(__op__) \
-  if (op == string(#__op__)) return __op__ val;
+  if (op == #__op__) return __op__ val;
 #define COMPUTE_BINARY(__op__) \
-  if (op == string(#__op__)) return lval __op__ rval;
+  if (op == #__op__) return lval __op__ rval;
 #define OP_IS_BIN_ARITHMETIC (OPEQ("+") || OPEQ("-") || OPEQ("*") || OPEQ("/") || OPEQ("%"))
 #define OP_IS_BIN_BITFLIP (OPEQ("|") || OPEQ("^") || OPEQ("&"))
 #define OP_IS_BIN_COMP \
@@ -267,17 +273,21 @@ bool AidlConstantValue::ParseIntegral(const string& value, int64_t* parsed_value
 
   if (!isLong) {
     // guess literal type.
-    if (*parsed_value <= INT8_MAX && *parsed_value >= INT8_MIN) {
-      *parsed_type = Type::INT8;
-    } else if (*parsed_value <= INT32_MAX && *parsed_value >= INT32_MIN) {
-      *parsed_type = Type::INT32;
-    } else {
-      *parsed_type = Type::INT64;
-    }
+    *parsed_type = IntegralTypeOf(*parsed_value);
   }
   return true;
 }
 
+AidlConstantValue::Type AidlConstantValue::IntegralTypeOf(int64_t value) {
+  if (value <= INT8_MAX && value >= INT8_MIN) {
+    return Type::INT8;
+  }
+  if (value <= INT32_MAX && value >= INT32_MIN) {
+    return Type::INT32;
+  }
+  return Type::INT64;
+}
+
 AidlConstantValue* AidlConstantValue::Integral(const AidlLocation& location, const string& value) {
   CHECK(!value.empty());
 
@@ -316,16 +326,20 @@ AidlConstantValue* AidlConstantValue::ShallowIntegralCopy(const AidlConstantValu
     AIDL_ERROR(other) << "Failed to parse expression as integer: " << other.value_;
     return nullptr;
   }
-  const std::string& value = other.ValueString(type, AidlConstantValueDecorator);
-  if (value.empty()) {
-    return nullptr;  // error already logged
-  }
-
-  AidlConstantValue* result = Integral(AIDL_LOCATION_HERE, value);
-  if (result == nullptr) {
-    AIDL_FATAL(other) << "Unable to perform ShallowIntegralCopy.";
+  switch (other.final_type_) {
+    case Type::BOOLEAN:  // fall-through
+    case Type::INT8:     // fall-through
+    case Type::INT32:    // fall-through
+    case Type::INT64:
+      // The evaluated value is copied as is, rather than printed and parsed
+      // again.
+      return new AidlConstantValue(AIDL_LOCATION_HERE, IntegralTypeOf(other.final_value_),
+                                   other.final_value_, std::to_string(other.final_value_));
+    default:
+      // Not an integer; this logs why.
+      other.ValueString(type, AidlConstantValueDecorator);
+      return nullptr;
   }
-  return result;
 }
 
 string AidlConstantValue::ValueString(const AidlTypeSpecifier& type,
@@ -347,19 +361,66 @@ string AidlConstantValue::ValueString(const AidlTypeSpecifier& type,
     AIDL_ERROR(this) << "Invalid constant value: " + value_;
     return "";
   }
+
+  if (final_type_ == Type::ARRAY) {
+    if (!type.IsArray()) {
+      AIDL_ERROR(this) << "Invalid type specifier for " << ToString(final_type_) << ": "
+                       << type.GetName();
+      return "";
+    }
+    if (type.IsFixedSizeArray() && values_.size() != type.FixedArraySize()) {
+      AIDL_ERROR(this) << "A value of " << type.ToString() << " must have "
+                       << type.FixedArraySize() << " elements, not " << values_.size();
+      return "";
+    }
+    vector<string> value_strings;
+    value_strings.reserve(values_.size());
+    for (const auto& value : values_) {
+      const AidlTypeSpecifier& array_base = type.ArrayBase();
+      const string value_string = value->ValueString(array_base, decorator);
+      if (value_string.empty()) {
+        AIDL_ERROR(this) << "Invalid type specifier for " << ToString(final_type_) << ": "
+                         << type.GetName();
+        return "";
+      }
+      value_strings.push_back(value_string);
+    }
+    return decorator(type, "{" + Join(value_strings, ", ") + "}");
+  }
+
+  // Backends ask again for the values that validation has already asked for.
+  if (is_folded_.load(std::memory_order_acquire) && folded_type_name_ == type.GetName()) {
+    return decorator(type, folded_literal_);
+  }
+  std::optional<string> literal = FoldedLiteral(type);
+  if (!literal) {
+    return "";
+  }
+  if (!is_folded_.load(std::memory_order_relaxed)) {
+    std::lock_guard<std::mutex> lock(folded_literals_mutex);
+    if (!is_folded_.load(std::memory_order_relaxed)) {
+      folded_type_name_ = type.GetName();
+      folded_literal_ = *literal;
+      is_folded_.store(true, std::memory_order_release);
+    }
+  }
+  return decorator(type, *literal);
+}
+
+std::optional<string> AidlConstantValue::FoldedLiteral(const AidlTypeSpecifier& type) const {
   const string& type_string = type.GetName();
   int err = 0;
 
   switch (final_type_) {
     case Type::CHARACTER:
       if (type_string == "char") {
-        return decorator(type, final_string_value_);
+        return final_string_value_;
       }
       err = -1;
       break;
     case Type::STRING:
       if (type_string == "String") {
-        return decorator(type, final_string_value_);
+        return final_string_value_;
       }
       err = -1;
       break;
@@ -372,45 +433,20 @@ string AidlConstantValue::ValueString(const AidlTypeSpecifier& type,
           err = -1;
           break;
         }
-        return decorator(type, std::to_string(static_cast<int8_t>(final_value_)));
+        return std::to_string(static_cast<int8_t>(final_value_));
       } else if (type_string == "int") {
         if (final_value_ > INT32_MAX || final_value_ < INT32_MIN) {
           err = -1;
           break;
         }
-        return decorator(type, std::to_string(static_cast<int32_t>(final_value_)));
+        return std::to_string(static_cast<int32_t>(final_value_));
       } else if (type_string == "long") {
-        return decorator(type, std::to_string(final_value_));
+        return std::to_string(final_value_);
       } else if (type_string == "boolean") {
-        return decorator(type, final_value_ ? "true" : "false");
+        return final_value_ ? "true" : "false";
       }
       err = -1;
       break;
-    case Type::ARRAY: {
-      if (!type.IsArray()) {
-        err = -1;
-        break;
-      }
-      vector<string> value_strings;
-      value_strings.reserve(values_.size());
-      bool success = true;
-
-      for (const auto& value : values_) {
-        const AidlTypeSpecifier& array_base = type.ArrayBase();
-        const string value_string = value->ValueString(array_base, decorator);
-        if (value_string.empty()) {
-          success = false;
-          break;
-        }
-        value_strings.push_back(value_string);
-      }
-      if (!success) {
-        err = -1;
-        break;
-      }
-
-      return decorator(type, "{" + Join(value_strings, ", ") + "}");
-    }
     case Type::FLOATING: {
       std::string_view raw_view(value_.c_str());
       bool is_float_literal = ConsumeSuffix(&raw_view, "f");
@@ -423,7 +459,7 @@ string AidlConstantValue::ValueString(const AidlTypeSpecifier& type,
           err = -1;
           break;
         }
-        return decorator(type, std::to_string(parsed_value));
+        return std::to_string(parsed_value);
       }
       if (is_float_literal && type_string == "float") {
         float parsed_value;
@@ -432,7 +468,7 @@ string AidlConstantValue::ValueString(const AidlTypeSpecifier& type,
           err = -1;
           break;
         }
-        return decorator(type, std::to_string(parsed_value) + "f");
+        return std::to_string(parsed_value) + "f";
       }
       err = -1;
       break;
@@ -444,13 +480,14 @@ string AidlConstantValue::ValueString(const AidlTypeSpecifier& type,
 
   CHECK(err != 0);
   AIDL_ERROR(this) << "Invalid type specifier for " << ToString(final_type_) << ": " << type_string;
-  return "";
+  return std::nullopt;
 }
 
 bool AidlConstantValue::CheckValid() const {
   // Nothing needs to be checked here. The constant value will be validated in
   // the constructor or in the evaluate() function.
-  if (is_evaluated_) return is_valid_;
+  if (is_evaluated_ || is_checked_) return is_valid_;
+  is_checked_ = true;
 
   switch (type_) {
     case Type::BOOLEAN:    // fall-through
@@ -583,11 +620,13 @@ string AidlConstantValue::ToString(Type type) {
 }
 
 bool AidlUnaryConstExpression::CheckValid() const {
-  if (is_evaluated_) return is_valid_;
+  // Evaluating a subexpression checks it again, so the result is kept.
+  if (is_evaluated_ || is_checked_) return is_valid_;
   CHECK(unary_ != nullptr);
 
   is_valid_ = unary_->CheckValid();
   if (!is_valid_) {
+    is_checked_ = true;
     final_type_ = Type::ERROR;
     return false;
   }
@@ -634,7 +673,7 @@ bool AidlUnaryConstExpression::evaluate(const AidlTypeSpecifier& type) const {
 
 bool AidlBinaryConstExpression::CheckValid() const {
   bool success = false;
-  if (is_evaluated_) return is_valid_;
+  if (is_evaluated_ || is_checked_) return is_valid_;
   CHECK(left_val_ != nullptr);
   CHECK(right_val_ != nullptr);
 
@@ -651,6 +690,7 @@ bool AidlBinaryConstExpression::CheckValid() const {
   }
 
   if (final_type_ == Type::ERROR) {
+    is_checked_ = true;
     is_valid_ = false;
     return false;
   }
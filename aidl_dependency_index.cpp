@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "aidl_dependency_index.h"
+
+#include <functional>
+#include <string_view>
+
+#include "aidl.h"
+
+using std::optional;
+using std::set;
+using std::string;
+using std::vector;
+
+namespace android {
+namespace aidl {
+
+namespace {
+
+optional<size_t> HashContents(const IoDelegate& io_delegate, const string& filename) {
+  std::unique_ptr<FileBuffer> buffer = io_delegate.GetFileBuffer(filename);
+  if (buffer == nullptr) {
+    return std::nullopt;
+  }
+  return std::hash<std::string_view>()({buffer->Data(), buffer->Size()});
+}
+
+// The arguments of |options| other than the inputs, which decide what the
+// outputs of an input are
+string SettingsOf(const Options& options) {
+  set<string> inputs(options.InputFiles().begin(), options.InputFiles().end());
+  string settings;
+  for (const string& arg : options.Args()) {
+    if (inputs.count(arg) == 0) {
+      settings += arg;
+      settings += '\0';
+    }
+  }
+  return settings;
+}
+
+}  // namespace
+
+void DependencyIndex::Record(const string& input, const Options& options,
+                             const vector<string>& imports, const vector<string>& outputs,
+                             const IoDelegate& io_delegate) {
+  const string key = internals::NormalizePath(input);
+  Forget(key);
+  Entry& entry = inputs_[key];
+  entry.settings = SettingsOf(options);
+  entry.read_files[key] = HashContents(io_delegate, input);
+  for (const string& import : imports) {
+    const string file = internals::NormalizePath(import);
+    entry.read_files[file] = HashContents(io_delegate, import);
+    readers_[file].insert(key);
+  }
+  for (const string& output : outputs) {
+    entry.outputs[output] = io_delegate.GetFileStamp(output);
+  }
+}
+
+bool DependencyIndex::IsUpToDate(const string& input, const Options& options,
+                                 const IoDelegate& io_delegate) const {
+  auto it = inputs_.find(internals::NormalizePath(input));
+  if (it == inputs_.end() || it->second.settings != SettingsOf(options)) {
+    return false;
+  }
+  for (const auto& [file, hash] : it->second.read_files) {
+    if (HashContents(io_delegate, file) != hash) {
+      return false;
+    }
+  }
+  for (const auto& [output, stamp] : it->second.outputs) {
+    if (io_delegate.GetFileStamp(output) != stamp) {
+      return false;
+    }
+  }
+  return true;
+}
+
+set<string> DependencyIndex::Dependents(const string& file) const {
+  set<string> dependents;
+  vector<string> pending = {internals::NormalizePath(file)};
+  while (!pending.empty()) {
+    const string next = std::move(pending.back());
+    pending.pop_back();
+    if (inputs_.count(next) > 0 && !dependents.insert(next).second) {
+      continue;  // and so are its dependents
+    }
+    if (auto it = readers_.find(next); it != readers_.end()) {
+      for (const string& reader : it->second) {
+        if (dependents.count(reader) == 0) {
+          pending.push_back(reader);
+        }
+      }
+    }
+  }
+  return dependents;
+}
+
+set<string> DependencyIndex::Outputs(const string& file) const {
+  set<string> outputs;
+  for (const string& input : Dependents(file)) {
+    for (const auto& [output, stamp] : inputs_.at(input).outputs) {
+      outputs.insert(output);
+    }
+  }
+  return outputs;
+}
+
+set<string> DependencyIndex::Invalidate(const string& file) {
+  set<string> outputs = Outputs(file);
+  for (const string& input : Dependents(file)) {
+    Forget(input);
+  }
+  return outputs;
+}
+
+void DependencyIndex::Clear() {
+  inputs_.clear();
+  readers_.clear();
+}
+
+void DependencyIndex::Forget(const string& input) {
+  auto it = inputs_.find(input);
+  if (it == inputs_.end()) {
+    return;
+  }
+  for (const auto& [file, hash] : it->second.read_files) {
+    if (auto readers = readers_.find(file); readers != readers_.end()) {
+      readers->second.erase(input);
+      if (readers->second.empty()) {
+        readers_.erase(readers);
+      }
+    }
+  }
+  inputs_.erase(it);
+}
+
+}  // namespace aidl
+}  // namespace android
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "io_delegate.h"
+#include "options.h"
+
+namespace android {
+namespace aidl {
+
+// What the inputs that a resident compiler (see CompileSession) has compiled
+// read and wrote: for each input, the files that it imported, as its
+// dependency file lists them, and the outputs generated from it. Indexed the
+// other way round, from each file to the inputs that read it, this tells
+// which outputs a change to one file makes stale, so that a job can skip the
+// inputs that nothing it depends on has changed for.
+//
+// The files are keyed by their normalized paths.
+class DependencyIndex {
+ public:
+  DependencyIndex() = default;
+
+  // Records that compiling |input| with |options| read |imports| and wrote
+  // |outputs|, replacing what was recorded for it before. Keeps the hashes of
+  // the contents of |input| and |imports| and the stamps of |outputs|.
+  void Record(const std::string& input, const Options& options,
+              const std::vector<std::string>& imports, const std::vector<std::string>& outputs,
+              const IoDelegate& io_delegate);
+
+  // Whether |input| was recorded with options that generate the same outputs
+  // as |options|, and neither the files it read nor its outputs have changed
+  // since.
+  bool IsUpToDate(const std::string& input, const Options& options,
+                  const IoDelegate& io_delegate) const;
+
+  // The recorded inputs that depend on |file|: itself, if it was compiled,
+  // the inputs that import it, and those that depend on those in turn.
+  std::set<std::string> Dependents(const std::string& file) const;
+
+  // The outputs generated from the Dependents() of |file|.
+  std::set<std::string> Outputs(const std::string& file) const;
+
+  // Forgets the Dependents() of |file|, so that the next jobs compile them
+  // again, and returns their outputs.
+  std::set<std::string> Invalidate(const std::string& file);
+
+  void Clear();
+
+  size_t Size() const { return inputs_.size(); }
+
+ private:
+  struct Entry {
+    // The arguments of the job other than its inputs
+    std::string settings;
+    std::map<std::string, std::optional<size_t>> read_files;
+    std::map<std::string, std::optional<FileStamp>> outputs;
+  };
+
+  void Forget(const std::string& input);
+
+  std::map<std::string, Entry> inputs_;
+  // The recorded inputs that read each file
+  std::map<std::string, std::set<std::string>> readers_;
+};
+
+}  // namespace aidl
+}  // namespace android
@@ -21,10 +21,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include <algorithm>
+#include <deque>
 #include <iostream>
+#include <mutex>
 #include <set>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <utility>
 
 #include <android-base/parsedouble.h>
@@ -32,6 +36,8 @@
 #include <android-base/strings.h>
 
 #include "aidl_language_y-module.h"
+#include "aidl_lexer.h"
+#include "aidl_profile.h"
 #include "logging.h"
 
 #include "aidl.h"
@@ -85,15 +91,90 @@ int yyparse(Parser*);
 YY_BUFFER_STATE yy_scan_buffer(char *, size_t, void *);
 void yy_delete_buffer(YY_BUFFER_STATE, void *);
 
-AidlToken::AidlToken(const std::string& text, const std::string& comments)
+namespace {
+std::mutex comments_mutex;
+}  // namespace
+
+AidlComments::AidlComments(const std::string& text) : text_(text), materialized_(true) {}
+
+AidlComments::AidlComments(const AidlComments& other) {
+  *this = other;
+}
+
+AidlComments& AidlComments::operator=(const AidlComments& other) {
+  if (this != &other) {
+    ranges_ = other.ranges_;
+    const bool materialized = other.materialized_.load(std::memory_order_acquire);
+    text_ = materialized ? other.text_ : "";
+    materialized_.store(materialized, std::memory_order_relaxed);
+  }
+  return *this;
+}
+
+const std::string& AidlComments::str() const {
+  if (!materialized_.load(std::memory_order_acquire)) {
+    std::lock_guard<std::mutex> lock(comments_mutex);
+    if (!materialized_.load(std::memory_order_relaxed)) {
+      for (std::string_view range : ranges_) {
+        text_.append(range);
+        // The lexer leaves the newline out of line comments.
+        if (android::base::StartsWith(range, "//")) text_ += '\n';
+      }
+      materialized_.store(true, std::memory_order_release);
+    }
+  }
+  return text_;
+}
+
+AidlToken::AidlToken(const std::string& text, const AidlComments& comments)
     : text_(text),
       comments_(comments) {}
 
+namespace {
+// The table is shared by the whole process, not kept per compilation: the
+// locations are also made where there is no compilation at hand, like
+// AIDL_LOCATION_HERE in the generators. A process may run many compilations,
+// the jobs of --server and --job-file, and the types that a CompileSession
+// keeps between the jobs hold on to their ids, so the table is not reset per
+// job. It only grows by the distinct paths that the jobs read, because a
+// path seen before keeps its id.
+std::mutex source_files_mutex;
+// Never shrinks, so that references to the names stay valid.
+std::deque<std::string> source_files;
+std::unordered_map<std::string, uint32_t> source_file_ids;
+}  // namespace
+
+uint32_t AidlLocation::InternFile(const std::string& file) {
+  // Consecutive locations are almost always in the same file.
+  thread_local std::string last_file;
+  thread_local uint32_t last_id = 0;
+  thread_local bool has_last = false;
+  if (has_last && file == last_file) {
+    return last_id;
+  }
+
+  std::lock_guard<std::mutex> lock(source_files_mutex);
+  auto it = source_file_ids.find(file);
+  if (it == source_file_ids.end()) {
+    source_files.push_back(file);
+    it = source_file_ids.emplace(file, source_files.size() - 1).first;
+  }
+  last_file = file;
+  last_id = it->second;
+  has_last = true;
+  return last_id;
+}
+
+const std::string& AidlLocation::File() const {
+  std::lock_guard<std::mutex> lock(source_files_mutex);
+  return source_files[file_id_];
+}
+
 AidlLocation::AidlLocation(const std::string& file, Point begin, Point end)
-    : file_(file), begin_(begin), end_(end) {}
+    : file_id_(InternFile(file)), begin_(begin), end_(end) {}
 
 std::ostream& operator<<(std::ostream& os, const AidlLocation& l) {
-  os << l.file_ << ":" << l.begin_.line << "." << l.begin_.column << "-";
+  os << l.File() << ":" << l.begin_.line << "." << l.begin_.column << "-";
   if (l.begin_.line != l.end_.line) {
     os << l.end_.line << ".";
   }
@@ -105,24 +186,37 @@ AidlNode::AidlNode(const AidlLocation& location) : location_(location) {}
 
 std::string AidlNode::PrintLine() const {
   std::stringstream ss;
-  ss << location_.file_ << ":" << location_.begin_.line;
+  ss << location_.File() << ":" << location_.begin_.line;
   return ss.str();
 }
 
 std::string AidlNode::PrintLocation() const {
   std::stringstream ss;
-  ss << location_.file_ << ":" << location_.begin_.line << ":" << location_.begin_.column << ":"
+  ss << location_.File() << ":" << location_.begin_.line << ":" << location_.begin_.column << ":"
      << location_.end_.line << ":" << location_.end_.column;
   return ss.str();
 }
 
-AidlError::AidlError(bool fatal) : os_(std::cerr), fatal_(fatal) {
+// Fatal errors abort right away, so they are never buffered.
+AidlError::AidlError(bool fatal)
+    : os_(sThreadOutput != nullptr && !fatal ? *sThreadOutput : std::cerr), fatal_(fatal) {
   sHadError = true;
 
   os_ << "ERROR: ";
 }
 
-bool AidlError::sHadError = false;
+std::atomic_bool AidlError::sHadError = false;
+thread_local std::ostream* AidlError::sThreadOutput = nullptr;
+
+void AidlError::Logger(android::base::LogId id, android::base::LogSeverity severity,
+                       const char* tag, const char* file, unsigned int line, const char* message) {
+  if (sThreadOutput == nullptr || severity >= android::base::FATAL_WITHOUT_ABORT) {
+    android::base::StderrLogger(id, severity, tag, file, line, message);
+    return;
+  }
+  *sThreadOutput << (tag != nullptr ? tag : "aidl") << " " << "VDIWEFF"[severity] << " " << file
+                 << ":" << line << "] " << message << std::endl;
+}
 
 static const string kNullable("nullable");
 static const string kUtf8InCpp("utf8InCpp");
@@ -131,29 +225,65 @@ static const string kUnsupportedAppUsage("UnsupportedAppUsage");
 static const string kJavaStableParcelable("JavaOnlyStableParcelable");
 static const string kHide("Hide");
 static const string kBacking("Backing");
+static const string kSharedMemory("SharedMemory");
+static const string kFixedSize("FixedSize");
+static const string kArrayView("ArrayView");
+static const string kMoveIn("MoveIn");
+static const string kPolymorphicAllocator("PolymorphicAllocator");
+static const string kHashable("Hashable");
+static const string kCacheable("Cacheable");
+static const string kBatchable("Batchable");
+static const string kDelta("Delta");
+static const string kStringView("StringView");
+static const string kSingleFlight("SingleFlight");
+static const string kHeaderless("Headerless");
+
+namespace {
+struct AnnotationSchema {
+  AidlAnnotation::Type type;
+  // The types of the parameters, by name
+  std::map<std::string, std::string> parameters;
+};
+}  // namespace
 
-static const std::map<string, std::map<std::string, std::string>> kAnnotationParameters{
-    {kNullable, {}},
-    {kUtf8InCpp, {}},
-    {kVintfStability, {}},
+static const std::map<string, AnnotationSchema> kAnnotationSchemas{
+    {kNullable, {AidlAnnotation::Type::NULLABLE, {}}},
+    {kUtf8InCpp, {AidlAnnotation::Type::UTF8_IN_CPP, {}}},
+    {kVintfStability, {AidlAnnotation::Type::VINTF_STABILITY, {}}},
     {kUnsupportedAppUsage,
-     {{"expectedSignature", "String"},
-      {"implicitMember", "String"},
-      {"maxTargetSdk", "int"},
-      {"publicAlternatives", "String"},
-      {"trackingBug", "long"}}},
-    {kJavaStableParcelable, {}},
-    {kHide, {}},
-    {kBacking, {{"type", "String"}}}};
+     {AidlAnnotation::Type::UNSUPPORTED_APP_USAGE,
+      {{"expectedSignature", "String"},
+       {"implicitMember", "String"},
+       {"maxTargetSdk", "int"},
+       {"publicAlternatives", "String"},
+       {"trackingBug", "long"}}}},
+    {kJavaStableParcelable, {AidlAnnotation::Type::JAVA_STABLE_PARCELABLE, {}}},
+    {kHide, {AidlAnnotation::Type::HIDE, {}}},
+    {kBacking, {AidlAnnotation::Type::BACKING, {{"type", "String"}}}},
+    {kSharedMemory, {AidlAnnotation::Type::SHARED_MEMORY, {{"threshold", "int"}}}},
+    {kFixedSize, {AidlAnnotation::Type::FIXED_SIZE, {}}},
+    {kArrayView, {AidlAnnotation::Type::ARRAY_VIEW, {}}},
+    {kMoveIn, {AidlAnnotation::Type::MOVE_IN, {}}},
+    {kPolymorphicAllocator, {AidlAnnotation::Type::POLYMORPHIC_ALLOCATOR, {}}},
+    {kHashable, {AidlAnnotation::Type::HASHABLE, {}}},
+    {kCacheable, {AidlAnnotation::Type::CACHEABLE, {}}},
+    {kBatchable, {AidlAnnotation::Type::BATCHABLE, {}}},
+    {kDelta, {AidlAnnotation::Type::DELTA, {}}},
+    {kStringView, {AidlAnnotation::Type::STRING_VIEW, {}}},
+    {kSingleFlight, {AidlAnnotation::Type::SINGLE_FLIGHT, {}}},
+    {kHeaderless, {AidlAnnotation::Type::HEADERLESS, {}}}};
+
+static_assert(static_cast<int>(AidlAnnotation::Type::HEADERLESS) < 32,
+              "the types of annotations must fit the bits of AidlAnnotatable");
 
 AidlAnnotation* AidlAnnotation::Parse(
     const AidlLocation& location, const string& name,
     std::map<std::string, std::shared_ptr<AidlConstantValue>>* parameter_list) {
-  if (kAnnotationParameters.find(name) == kAnnotationParameters.end()) {
+  if (kAnnotationSchemas.find(name) == kAnnotationSchemas.end()) {
     std::ostringstream stream;
     stream << "'" << name << "' is not a recognized annotation. ";
     stream << "It must be one of:";
-    for (const auto& kv : kAnnotationParameters) {
+    for (const auto& kv : kAnnotationSchemas) {
       stream << " " << kv.first;
     }
     stream << ".";
@@ -173,15 +303,18 @@ AidlAnnotation::AidlAnnotation(const AidlLocation& location, const string& name)
 AidlAnnotation::AidlAnnotation(
     const AidlLocation& location, const string& name,
     std::map<std::string, std::shared_ptr<AidlConstantValue>>&& parameters)
-    : AidlNode(location), name_(name), parameters_(std::move(parameters)) {}
+    : AidlNode(location),
+      name_(name),
+      type_(kAnnotationSchemas.at(name).type),
+      parameters_(std::move(parameters)) {}
 
 bool AidlAnnotation::CheckValid() const {
-  auto supported_params_iterator = kAnnotationParameters.find(GetName());
-  if (supported_params_iterator == kAnnotationParameters.end()) {
+  auto supported_params_iterator = kAnnotationSchemas.find(GetName());
+  if (supported_params_iterator == kAnnotationSchemas.end()) {
     AIDL_ERROR(this) << GetName() << " annotation does not have any supported parameters.";
     return false;
   }
-  const auto& supported_params = supported_params_iterator->second;
+  const auto& supported_params = supported_params_iterator->second.parameters;
   for (const auto& name_and_param : parameters_) {
     const std::string& param_name = name_and_param.first;
     const std::shared_ptr<AidlConstantValue>& param = name_and_param.second;
@@ -217,7 +350,7 @@ bool AidlAnnotation::CheckValid() const {
 std::map<std::string, std::string> AidlAnnotation::AnnotationParams(
     const ConstantValueDecorator& decorator) const {
   std::map<std::string, std::string> raw_params;
-  const auto& supported_params = kAnnotationParameters.at(GetName());
+  const auto& supported_params = kAnnotationSchemas.at(GetName()).parameters;
   for (const auto& name_and_param : parameters_) {
     const std::string& param_name = name_and_param.first;
     const std::shared_ptr<AidlConstantValue>& param = name_and_param.second;
@@ -246,45 +379,24 @@ std::string AidlAnnotation::ToString(const ConstantValueDecorator& decorator) co
   }
 }
 
-static bool HasAnnotation(const vector<AidlAnnotation>& annotations, const string& name) {
-  for (const auto& a : annotations) {
-    if (a.GetName() == name) {
-      return true;
-    }
-  }
-  return false;
-}
+AidlAnnotatable::AidlAnnotatable(const AidlLocation& location) : AidlNode(location) {}
 
-static const AidlAnnotation* GetAnnotation(const vector<AidlAnnotation>& annotations,
-                                           const string& name) {
-  for (const auto& a : annotations) {
-    if (a.GetName() == name) {
+const AidlAnnotation* AidlAnnotatable::Get(AidlAnnotation::Type type) const {
+  if (!Has(type)) return nullptr;
+  for (const auto& a : annotations_) {
+    if (a.GetType() == type) {
       return &a;
     }
   }
   return nullptr;
 }
 
-AidlAnnotatable::AidlAnnotatable(const AidlLocation& location) : AidlNode(location) {}
-
-bool AidlAnnotatable::IsNullable() const {
-  return HasAnnotation(annotations_, kNullable);
-}
-
-bool AidlAnnotatable::IsUtf8InCpp() const {
-  return HasAnnotation(annotations_, kUtf8InCpp);
-}
-
-bool AidlAnnotatable::IsVintfStability() const {
-  return HasAnnotation(annotations_, kVintfStability);
-}
-
 const AidlAnnotation* AidlAnnotatable::UnsupportedAppUsage() const {
-  return GetAnnotation(annotations_, kUnsupportedAppUsage);
+  return Get(AidlAnnotation::Type::UNSUPPORTED_APP_USAGE);
 }
 
 const AidlTypeSpecifier* AidlAnnotatable::BackingType(const AidlTypenames& typenames) const {
-  auto annotation = GetAnnotation(annotations_, kBacking);
+  auto annotation = Get(AidlAnnotation::Type::BACKING);
   if (annotation != nullptr) {
     auto annotation_params = annotation->AnnotationParams(AidlConstantValueDecorator);
     if (auto it = annotation_params.find("type"); it != annotation_params.end()) {
@@ -300,12 +412,17 @@ const AidlTypeSpecifier* AidlAnnotatable::BackingType(const AidlTypenames& typen
   return nullptr;
 }
 
-bool AidlAnnotatable::IsStableApiParcelable(Options::Language lang) const {
-  return HasAnnotation(annotations_, kJavaStableParcelable) && lang == Options::Language::JAVA;
-}
-
-bool AidlAnnotatable::IsHide() const {
-  return HasAnnotation(annotations_, kHide);
+int32_t AidlAnnotatable::SharedMemoryThreshold() const {
+  constexpr int32_t kDefaultThreshold = 64 * 1024;
+  auto annotation = Get(AidlAnnotation::Type::SHARED_MEMORY);
+  if (annotation == nullptr) return -1;
+  auto params = annotation->AnnotationParams(AidlConstantValueDecorator);
+  int32_t threshold;
+  if (auto it = params.find("threshold");
+      it != params.end() && android::base::ParseInt(it->second, &threshold)) {
+    return threshold;
+  }
+  return kDefaultThreshold;
 }
 
 void AidlAnnotatable::DumpAnnotations(CodeWriter* writer) const {
@@ -336,14 +453,47 @@ string AidlAnnotatable::ToString() const {
 AidlTypeSpecifier::AidlTypeSpecifier(const AidlLocation& location, const string& unresolved_name,
                                      bool is_array,
                                      vector<unique_ptr<AidlTypeSpecifier>>* type_params,
-                                     const string& comments)
+                                     const AidlComments& comments)
     : AidlAnnotatable(location),
       AidlParameterizable<unique_ptr<AidlTypeSpecifier>>(type_params),
       unresolved_name_(unresolved_name),
+      builtin_kind_(AidlTypenames::GetBuiltinKind(unresolved_name)),
       is_array_(is_array),
       comments_(comments),
       split_name_(Split(unresolved_name, ".")) {}
 
+AidlTypeSpecifier::AidlTypeSpecifier(const AidlTypeSpecifier& other)
+    : AidlAnnotatable(other),
+      AidlParameterizable<unique_ptr<AidlTypeSpecifier>>(other),
+      unresolved_name_(other.unresolved_name_),
+      fully_qualified_name_(other.fully_qualified_name_),
+      builtin_kind_(other.builtin_kind_),
+      is_array_(other.is_array_),
+      fixed_array_size_(other.fixed_array_size_),
+      comments_(other.comments_),
+      split_name_(other.split_name_) {}
+
+AidlTypeSpecifier::~AidlTypeSpecifier() {
+  delete memos_.load(std::memory_order_relaxed);
+}
+
+AidlTypeSpecifier::Memos::~Memos() {
+  for (auto& memoized : strings) {
+    delete memoized.load(std::memory_order_relaxed);
+  }
+}
+
+std::atomic<const string*>& AidlTypeSpecifier::MemoSlot(Memo memo) const {
+  Memos* memos = memos_.load(std::memory_order_acquire);
+  if (memos == nullptr) {
+    auto made = std::make_unique<Memos>();
+    if (memos_.compare_exchange_strong(memos, made.get(), std::memory_order_acq_rel)) {
+      memos = made.release();
+    }
+  }
+  return memos->strings[static_cast<size_t>(memo)];
+}
+
 AidlTypeSpecifier AidlTypeSpecifier::ArrayBase() const {
   AIDL_FATAL_IF(!is_array_, this);
   // Declaring array of generic type cannot happen, it is grammar error.
@@ -351,6 +501,7 @@ AidlTypeSpecifier AidlTypeSpecifier::ArrayBase() const {
 
   AidlTypeSpecifier array_base = *this;
   array_base.is_array_ = false;
+  array_base.fixed_array_size_ = 0;
   return array_base;
 }
 
@@ -359,27 +510,33 @@ bool AidlTypeSpecifier::IsHidden() const {
 }
 
 string AidlTypeSpecifier::ToString() const {
-  string ret = GetName();
-  if (IsGeneric()) {
-    vector<string> arg_names;
-    for (const auto& ta : GetTypeParameters()) {
-      arg_names.emplace_back(ta->ToString());
+  return Memoized(Memo::TO_STRING, [&]() {
+    string ret = GetName();
+    if (IsGeneric()) {
+      vector<string> arg_names;
+      for (const auto& ta : GetTypeParameters()) {
+        arg_names.emplace_back(ta->ToString());
+      }
+      ret += "<" + Join(arg_names, ",") + ">";
     }
-    ret += "<" + Join(arg_names, ",") + ">";
-  }
-  if (IsArray()) {
-    ret += "[]";
-  }
-  return ret;
+    if (IsFixedSizeArray()) {
+      ret += "[" + std::to_string(fixed_array_size_) + "]";
+    } else if (IsArray()) {
+      ret += "[]";
+    }
+    return ret;
+  });
 }
 
 string AidlTypeSpecifier::Signature() const {
-  string ret = ToString();
-  string annotations = AidlAnnotatable::ToString();
-  if (annotations != "") {
-    ret = annotations + " " + ret;
-  }
-  return ret;
+  return Memoized(Memo::SIGNATURE, [&]() {
+    string ret = ToString();
+    string annotations = AidlAnnotatable::ToString();
+    if (annotations != "") {
+      ret = annotations + " " + ret;
+    }
+    return ret;
+  });
 }
 
 bool AidlTypeSpecifier::Resolve(const AidlTypenames& typenames) {
@@ -387,11 +544,20 @@ bool AidlTypeSpecifier::Resolve(const AidlTypenames& typenames) {
   pair<string, bool> result = typenames.ResolveTypename(unresolved_name_);
   if (result.second) {
     fully_qualified_name_ = result.first;
+    builtin_kind_ = AidlTypenames::GetBuiltinKind(fully_qualified_name_);
     split_name_ = Split(fully_qualified_name_, ".");
   }
   return result.second;
 }
 
+void AidlTypeSpecifier::ResolveLike(const AidlTypeSpecifier& resolved) {
+  CHECK(!IsResolved());
+  CHECK(resolved.IsResolved() && resolved.unresolved_name_ == unresolved_name_);
+  fully_qualified_name_ = resolved.fully_qualified_name_;
+  builtin_kind_ = resolved.builtin_kind_;
+  split_name_ = resolved.split_name_;
+}
+
 bool AidlTypeSpecifier::CheckValid(const AidlTypenames& typenames) const {
   if (!CheckValidAnnotations()) {
     return false;
@@ -456,6 +622,41 @@ bool AidlTypeSpecifier::CheckValid(const AidlTypenames& typenames) const {
     return false;
   }
 
+  if (IsSharedMemory()) {
+    if (GetName() != "byte" || !IsArray() || IsNullable()) {
+      AIDL_ERROR(this) << "@SharedMemory can only be used on byte[] that is not @nullable.";
+      return false;
+    }
+    if (SharedMemoryThreshold() < 0) {
+      AIDL_ERROR(this) << "The threshold of @SharedMemory cannot be negative.";
+      return false;
+    }
+  }
+
+  if (IsArrayView()) {
+    const bool has_view = GetName() == "byte" || GetName() == "int" || GetName() == "float";
+    if (!has_view || !IsArray() || IsNullable() || IsSharedMemory()) {
+      AIDL_ERROR(this) << "@ArrayView can only be used on byte[], int[] and float[] that are not "
+                          "@nullable or @SharedMemory.";
+      return false;
+    }
+  }
+
+  if (IsStringView() && (GetName() != "String" || IsArray() || IsNullable() || !IsUtf8InCpp())) {
+    AIDL_ERROR(this) << "@StringView can only be used on @utf8InCpp Strings that are not arrays "
+                        "or @nullable.";
+    return false;
+  }
+
+  if (IsFixedSizeArray()) {
+    if (!AidlTypenames::IsPrimitiveTypename(GetName()) || IsNullable() || IsSharedMemory() ||
+        IsArrayView()) {
+      AIDL_ERROR(this) << "Fixed-size arrays can only be of primitive types, and cannot be "
+                          "@nullable, @SharedMemory or @ArrayView.";
+      return false;
+    }
+  }
+
   if (GetName() == "void") {
     if (IsArray() || IsNullable() || IsUtf8InCpp()) {
       AIDL_ERROR(this) << "void type cannot be an array or nullable or utf8 string";
@@ -614,14 +815,14 @@ string AidlConstantDeclaration::Signature() const {
 
 AidlMethod::AidlMethod(const AidlLocation& location, bool oneway, AidlTypeSpecifier* type,
                        const std::string& name, std::vector<std::unique_ptr<AidlArgument>>* args,
-                       const std::string& comments)
+                       const AidlComments& comments)
     : AidlMethod(location, oneway, type, name, args, comments, 0, true) {
   has_id_ = false;
 }
 
 AidlMethod::AidlMethod(const AidlLocation& location, bool oneway, AidlTypeSpecifier* type,
                        const std::string& name, std::vector<std::unique_ptr<AidlArgument>>* args,
-                       const std::string& comments, int id, bool is_user_defined)
+                       const AidlComments& comments, int id, bool is_user_defined)
     : AidlMember(location),
       oneway_(oneway),
       comments_(comments),
@@ -664,7 +865,7 @@ string AidlMethod::ToString() const {
 }
 
 AidlDefinedType::AidlDefinedType(const AidlLocation& location, const std::string& name,
-                                 const std::string& comments,
+                                 const AidlComments& comments,
                                  const std::vector<std::string>& package)
     : AidlAnnotatable(location), name_(name), comments_(comments), package_(package) {}
 
@@ -691,8 +892,9 @@ void AidlDefinedType::DumpHeader(CodeWriter* writer) const {
 }
 
 AidlParcelable::AidlParcelable(const AidlLocation& location, AidlQualifiedName* name,
-                               const std::vector<std::string>& package, const std::string& comments,
-                               const std::string& cpp_header, std::vector<std::string>* type_params)
+                               const std::vector<std::string>& package,
+                               const AidlComments& comments, const std::string& cpp_header,
+                               std::vector<std::string>* type_params)
     : AidlDefinedType(location, name->GetDotName(), comments, package),
       AidlParameterizable<std::string>(type_params),
       name_(name),
@@ -759,7 +961,7 @@ void AidlParcelable::Dump(CodeWriter* writer) const {
 
 AidlStructuredParcelable::AidlStructuredParcelable(
     const AidlLocation& location, AidlQualifiedName* name, const std::vector<std::string>& package,
-    const std::string& comments, std::vector<std::unique_ptr<AidlVariableDeclaration>>* variables)
+    const AidlComments& comments, std::vector<std::unique_ptr<AidlVariableDeclaration>>* variables)
     : AidlParcelable(location, name, package, comments, "" /*cpp_header*/),
       variables_(std::move(*variables)) {}
 
@@ -781,6 +983,100 @@ bool AidlStructuredParcelable::CheckValid(const AidlTypenames& typenames) const
   bool success = true;
   for (const auto& v : GetFields()) {
     success = success && v->CheckValid(typenames);
+    if (success && v->GetType().IsArrayView()) {
+      AIDL_ERROR(v) << "@ArrayView can only be used on in arguments.";
+      return false;
+    }
+    if (success && v->GetType().IsStringView()) {
+      AIDL_ERROR(v) << "@StringView can only be used on in arguments.";
+      return false;
+    }
+    if (success && v->GetType().IsMoveIn()) {
+      AIDL_ERROR(v) << "@MoveIn can only be used on interfaces and methods.";
+      return false;
+    }
+  }
+  if (success && IsMoveIn()) {
+    AIDL_ERROR(this) << "@MoveIn can only be used on interfaces and methods.";
+    return false;
+  }
+  if (success && IsFixedSize()) {
+    for (const auto& v : GetFields()) {
+      const AidlTypeSpecifier& type = v->GetType();
+      const bool is_primitive = AidlTypenames::IsPrimitiveTypename(type.GetName()) ||
+                                typenames.GetEnumDeclaration(type) != nullptr;
+      if (!is_primitive || type.IsArray() || type.GetName() == "void") {
+        AIDL_ERROR(v) << "A @FixedSize parcelable can only have fields of primitive and enum "
+                         "types, but "
+                      << v->GetName() << " is " << type.ToString() << ".";
+        return false;
+      }
+    }
+  }
+  if (success && IsPolymorphicAllocator()) {
+    for (const auto& v : GetFields()) {
+      const AidlTypeSpecifier& type = v->GetType();
+      const AidlTypeSpecifier& element = type.IsGeneric() ? *type.GetTypeParameters()[0] : type;
+      bool is_allowed = AidlTypenames::IsPrimitiveTypename(element.GetName()) ||
+                        (element.GetName() == "String" && type.IsUtf8InCpp());
+      if (auto defined_type = typenames.TryGetDefinedType(element.GetName()); defined_type) {
+        is_allowed = defined_type->AsEnumDeclaration() != nullptr ||
+                     defined_type->AsStructuredParcelable() != nullptr;
+      }
+      if (!is_allowed || type.IsNullable() || type.IsSharedMemory()) {
+        AIDL_ERROR(v) << "A @PolymorphicAllocator parcelable can only have fields of primitive, "
+                         "enum, @utf8InCpp String and structured parcelable types and of their "
+                         "arrays and Lists, none of them @nullable, but "
+                      << v->GetName() << " is " << type.ToString() << ".";
+        return false;
+      }
+    }
+  }
+  if (success && IsHashable()) {
+    for (const auto& v : GetFields()) {
+      const AidlTypeSpecifier& type = v->GetType();
+      const AidlTypeSpecifier& element = type.IsGeneric() ? *type.GetTypeParameters()[0] : type;
+      bool is_allowed =
+          AidlTypenames::IsPrimitiveTypename(element.GetName()) || element.GetName() == "String";
+      if (auto defined_type = typenames.TryGetDefinedType(element.GetName()); defined_type) {
+        is_allowed = defined_type->AsEnumDeclaration() != nullptr ||
+                     (defined_type->AsStructuredParcelable() != nullptr &&
+                      defined_type->IsHashable());
+      }
+      if (!is_allowed || type.IsNullable()) {
+        AIDL_ERROR(v) << "A @Hashable parcelable can only have fields of primitive, enum, String "
+                         "and @Hashable parcelable types and of their arrays and Lists, none of "
+                         "them @nullable, but "
+                      << v->GetName() << " is " << type.ToString() << ".";
+        return false;
+      }
+    }
+  }
+  if (success && IsDelta()) {
+    // The fields of a Delta are the bits of an int64
+    if (GetFields().size() > 64) {
+      AIDL_ERROR(this) << "A @Delta parcelable can have at most 64 fields, but " << GetName()
+                       << " has " << GetFields().size() << ".";
+      return false;
+    }
+    for (const auto& v : GetFields()) {
+      const AidlTypeSpecifier& type = v->GetType();
+      const AidlTypeSpecifier& element = type.IsGeneric() ? *type.GetTypeParameters()[0] : type;
+      bool is_allowed =
+          AidlTypenames::IsPrimitiveTypename(element.GetName()) || element.GetName() == "String";
+      if (auto defined_type = typenames.TryGetDefinedType(element.GetName()); defined_type) {
+        is_allowed = defined_type->AsEnumDeclaration() != nullptr ||
+                     (defined_type->AsStructuredParcelable() != nullptr &&
+                      (defined_type->IsDelta() || defined_type->IsHashable()));
+      }
+      if (!is_allowed || type.IsNullable()) {
+        AIDL_ERROR(v) << "A @Delta parcelable can only have fields of primitive, enum, String "
+                         "and @Delta or @Hashable parcelable types and of their arrays and "
+                         "Lists, none of them @nullable, but "
+                      << v->GetName() << " is " << type.ToString() << ".";
+        return false;
+      }
+    }
   }
   return success;
 }
@@ -870,7 +1166,7 @@ bool AidlStructuredParcelable::LanguageSpecificCheckValid(Options::Language lang
 }
 
 AidlEnumerator::AidlEnumerator(const AidlLocation& location, const std::string& name,
-                               AidlConstantValue* value, const std::string& comments)
+                               AidlConstantValue* value, const AidlComments& comments)
     : AidlNode(location), name_(name), value_(value), comments_(comments) {}
 
 bool AidlEnumerator::CheckValid(const AidlTypeSpecifier& enum_backing_type) const {
@@ -895,7 +1191,7 @@ string AidlEnumerator::ValueString(const AidlTypeSpecifier& backing_type,
 AidlEnumDeclaration::AidlEnumDeclaration(const AidlLocation& location, const std::string& name,
                                          std::vector<std::unique_ptr<AidlEnumerator>>* enumerators,
                                          const std::vector<std::string>& package,
-                                         const std::string& comments)
+                                         const AidlComments& comments)
     : AidlDefinedType(location, name, comments, package), enumerators_(std::move(*enumerators)) {}
 
 void AidlEnumDeclaration::SetBackingType(std::unique_ptr<const AidlTypeSpecifier> type) {
@@ -966,7 +1262,7 @@ bool AidlInterface::LanguageSpecificCheckValid(Options::Language lang) const {
 }
 
 AidlInterface::AidlInterface(const AidlLocation& location, const std::string& name,
-                             const std::string& comments, bool oneway,
+                             const AidlComments& comments, bool oneway,
                              std::vector<std::unique_ptr<AidlMember>>* members,
                              const std::vector<std::string>& package)
     : AidlDefinedType(location, name, comments, package) {
@@ -1010,10 +1306,107 @@ void AidlInterface::Dump(CodeWriter* writer) const {
   writer->Write("}\n");
 }
 
+// The results of a @Cacheable method are looked up by its in arguments, so
+// they have to be values that compare, and the results have to be copies that
+// a proxy can hand out more than once.
+static bool CheckCacheable(const AidlMethod& m, const AidlTypenames& typenames) {
+  const AidlTypeSpecifier& ret = m.GetType();
+  if (m.IsOneway() || ret.GetName() == "void") {
+    AIDL_ERROR(m) << "A @Cacheable method has to return a value, but '" << m.GetName()
+                  << "' does not.";
+    return false;
+  }
+  if (ret.IsNullable() || ret.GetName() == "FileDescriptor" ||
+      ret.GetName() == "ParcelFileDescriptor") {
+    AIDL_ERROR(m) << "A @Cacheable method cannot return a @nullable, FileDescriptor or "
+                     "ParcelFileDescriptor, but '"
+                  << m.GetName() << "' returns " << ret.ToString() << ".";
+    return false;
+  }
+  for (const auto& arg : m.GetArguments()) {
+    const AidlTypeSpecifier& type = arg->GetType();
+    const bool is_value = AidlTypenames::IsPrimitiveTypename(type.GetName()) ||
+                          typenames.GetEnumDeclaration(type) != nullptr ||
+                          type.GetName() == "String";
+    if (type.IsStringView()) {
+      AIDL_ERROR(arg) << "A @Cacheable method cannot take @StringView arguments, which its cache "
+                         "would outlive, but "
+                      << arg->GetName() << " is one.";
+      return false;
+    }
+    if (arg->IsOut() || !is_value || type.IsArray() || type.IsNullable()) {
+      AIDL_ERROR(arg) << "A @Cacheable method can only take in arguments of primitive, enum and "
+                         "String types, but "
+                      << arg->GetName() << " is " << (arg->IsOut() ? "out " : "")
+                      << type.ToString() << ".";
+      return false;
+    }
+  }
+  return true;
+}
+
+// The calls of a @SingleFlight method are told apart by their in arguments,
+// which have to be values that compare, and the calls that wait get copies of
+// the result of the call that they waited for.
+static bool CheckSingleFlight(const AidlMethod& m, const AidlTypenames& typenames) {
+  const auto is_value = [&](const AidlTypeSpecifier& type) {
+    const AidlDefinedType* defined_type = typenames.TryGetDefinedType(type.GetName());
+    const bool is_hashable = defined_type != nullptr &&
+                             defined_type->AsStructuredParcelable() != nullptr &&
+                             defined_type->IsHashable();
+    return !type.IsNullable() &&
+           (AidlTypenames::IsPrimitiveTypename(type.GetName()) ||
+            typenames.GetEnumDeclaration(type) != nullptr || type.GetName() == "String" ||
+            is_hashable);
+  };
+  if (m.IsOneway()) {
+    AIDL_ERROR(m) << "A @SingleFlight method has to have a reply, but '" << m.GetName()
+                  << "' is oneway.";
+    return false;
+  }
+  const AidlTypeSpecifier& ret = m.GetType();
+  if (ret.GetName() != "void" && !is_value(ret)) {
+    AIDL_ERROR(m) << "A @SingleFlight method can only return void or a value of a primitive, "
+                     "enum, String or @Hashable parcelable type, but '"
+                  << m.GetName() << "' returns " << ret.ToString() << ".";
+    return false;
+  }
+  for (const auto& arg : m.GetArguments()) {
+    const AidlTypeSpecifier& type = arg->GetType();
+    if (arg->IsOut() || type.IsArray() || !is_value(type)) {
+      AIDL_ERROR(arg) << "A @SingleFlight method can only take in arguments of primitive, enum, "
+                         "String and @Hashable parcelable types, but "
+                      << arg->GetName() << " is " << (arg->IsOut() ? "out " : "")
+                      << type.ToString() << ".";
+      return false;
+    }
+  }
+  return true;
+}
+
 bool AidlInterface::CheckValid(const AidlTypenames& typenames) const {
   if (!CheckValidAnnotations()) {
     return false;
   }
+  if (IsSingleFlight()) {
+    AIDL_ERROR(this) << "@SingleFlight can only be used on methods.";
+    return false;
+  }
+  if (IsCacheable()) {
+    AIDL_ERROR(this) << "@Cacheable can only be used on methods.";
+    return false;
+  }
+  if (IsBatchable()) {
+    AIDL_ERROR(this) << "@Batchable can only be used on oneway methods.";
+    return false;
+  }
+  if (IsHeaderless()) {
+    AIDL_ERROR(this) << "@Headerless can only be used on structured parcelables.";
+    return false;
+  }
+  const bool has_batchable_methods =
+      std::any_of(GetMethods().begin(), GetMethods().end(),
+                  [](const auto& m) { return m->GetType().IsBatchable(); });
   // Has to be a pointer due to deleting copy constructor. No idea why.
   map<string, const AidlMethod*> method_names;
   for (const auto& m : GetMethods()) {
@@ -1026,6 +1419,19 @@ bool AidlInterface::CheckValid(const AidlTypenames& typenames) const {
       return false;
     }
 
+    if (m->GetType().IsSharedMemory()) {
+      AIDL_ERROR(m) << "@SharedMemory can only be used on in arguments and parcelable fields.";
+      return false;
+    }
+    if (m->GetType().IsArrayView()) {
+      AIDL_ERROR(m) << "@ArrayView can only be used on in arguments.";
+      return false;
+    }
+    if (m->GetType().IsStringView()) {
+      AIDL_ERROR(m) << "@StringView can only be used on in arguments.";
+      return false;
+    }
+
     set<string> argument_names;
     for (const auto& arg : m->GetArguments()) {
       auto it = argument_names.find(arg->GetName());
@@ -1044,6 +1450,38 @@ bool AidlInterface::CheckValid(const AidlTypenames& typenames) const {
         AIDL_ERROR(m) << "oneway method '" << m->GetName() << "' cannot have out parameters";
         return false;
       }
+      if (arg->GetType().IsSharedMemory() && arg->IsOut()) {
+        AIDL_ERROR(arg) << "@SharedMemory can only be used on in arguments and parcelable fields.";
+        return false;
+      }
+      if (arg->GetType().IsArrayView() && arg->IsOut()) {
+        AIDL_ERROR(arg) << "@ArrayView can only be used on in arguments.";
+        return false;
+      }
+      if (arg->GetType().IsStringView() && arg->IsOut()) {
+        AIDL_ERROR(arg) << "@StringView can only be used on in arguments.";
+        return false;
+      }
+      if (arg->GetType().IsFixedSizeArray() && arg->IsOut()) {
+        AIDL_ERROR(arg) << "Fixed-size arrays can only be used on in arguments.";
+        return false;
+      }
+      if (arg->GetType().IsMoveIn()) {
+        AIDL_ERROR(arg) << "@MoveIn can only be used on interfaces and methods.";
+        return false;
+      }
+      if (arg->GetType().IsCacheable()) {
+        AIDL_ERROR(arg) << "@Cacheable can only be used on methods.";
+        return false;
+      }
+      if (arg->GetType().IsBatchable()) {
+        AIDL_ERROR(arg) << "@Batchable can only be used on oneway methods.";
+        return false;
+      }
+      if (arg->GetType().IsSingleFlight()) {
+        AIDL_ERROR(arg) << "@SingleFlight can only be used on methods.";
+        return false;
+      }
       const bool can_be_out = typenames.CanBeOutParameter(arg->GetType());
       if (!arg->DirectionWasSpecified() && can_be_out) {
         AIDL_ERROR(arg) << "'" << arg->GetType().ToString()
@@ -1069,6 +1507,25 @@ bool AidlInterface::CheckValid(const AidlTypenames& typenames) const {
       }
     }
 
+    if (m->GetType().IsCacheable() && !CheckCacheable(*m, typenames)) {
+      return false;
+    }
+    if (m->GetType().IsSingleFlight() && !CheckSingleFlight(*m, typenames)) {
+      return false;
+    }
+    if (m->GetType().IsBatchable() && !m->IsOneway()) {
+      AIDL_ERROR(m) << "@Batchable can only be used on oneway methods, but '" << m->GetName()
+                    << "' is not oneway.";
+      return false;
+    }
+    // The proxies of an interface with @Batchable methods have a method that
+    // sends their queued calls
+    if (has_batchable_methods && m->GetName() == android::aidl::kFlushBatchedCalls) {
+      AIDL_ERROR(m) << "method " << android::aidl::kFlushBatchedCalls
+                    << " is reserved for the interfaces with @Batchable methods.";
+      return false;
+    }
+
     auto it = method_names.find(m->GetName());
     // prevent duplicate methods
     if (it == method_names.end()) {
@@ -1103,7 +1560,7 @@ bool AidlInterface::CheckValid(const AidlTypenames& typenames) const {
 }
 
 AidlQualifiedName::AidlQualifiedName(const AidlLocation& location, const std::string& term,
-                                     const std::string& comments)
+                                     const AidlComments& comments)
     : AidlNode(location), terms_({term}), comments_(comments) {
   if (term.find('.') != string::npos) {
     terms_ = Split(term, ".");
@@ -1122,27 +1579,157 @@ void AidlQualifiedName::AddTerm(const std::string& term) {
 AidlImport::AidlImport(const AidlLocation& location, const std::string& needed_class)
     : AidlNode(location), needed_class_(needed_class) {}
 
+namespace {
+
+// Blanks out the bodies of the interfaces and structured parcelables in
+// |data|, which the lexer then skips as whitespace. The line breaks are kept,
+// so that the locations of everything else stay where they were.
+void SkimBodies(char* data, size_t size) {
+  auto is_identifier_part = [](char c) {
+    return isalnum(static_cast<unsigned char>(c)) || c == '_';
+  };
+  // Returns the end of the comment or literal at |i|, or |i| if there is none.
+  auto skip_comment_or_literal = [&](size_t i) {
+    if (data[i] == '/' && i + 1 < size && data[i + 1] == '/') {
+      while (i < size && data[i] != '\n') i++;
+    } else if (data[i] == '/' && i + 1 < size && data[i + 1] == '*') {
+      for (i += 2; i < size && !(data[i - 1] == '*' && data[i] == '/'); i++) {
+      }
+      i = std::min(i + 1, size);
+    } else if (data[i] == '"' || data[i] == '\'') {
+      // Literals don't span lines, which also bounds a stray quote.
+      const char quote = data[i];
+      for (i++; i < size && data[i] != quote && data[i] != '\n'; i++) {
+        if (data[i] == '\\') i++;
+      }
+      i = std::min(i + 1, size);
+    }
+    return i;
+  };
+
+  // Whether the last declaration keyword starts a body that can be skimmed
+  bool skimmable = false;
+  int parens = 0;
+  for (size_t i = 0; i < size;) {
+    if (const size_t end = skip_comment_or_literal(i); end != i) {
+      i = end;
+    } else if (is_identifier_part(data[i])) {
+      const size_t begin = i;
+      while (i < size && is_identifier_part(data[i])) i++;
+      const std::string_view word(data + begin, i - begin);
+      if (word == "interface" || word == "parcelable") {
+        skimmable = true;
+      } else if (word == "enum") {
+        skimmable = false;
+      }
+    } else if (data[i] == '(' || data[i] == ')') {
+      parens += data[i] == '(' ? 1 : -1;
+      i++;
+    } else if (data[i] == '{' && parens == 0) {
+      // Find the closing brace, then blank out what is in between.
+      const size_t body = ++i;
+      for (int depth = 1; i < size;) {
+        if (const size_t end = skip_comment_or_literal(i); end != i) {
+          i = end;
+          continue;
+        }
+        depth += data[i] == '{' ? 1 : data[i] == '}' ? -1 : 0;
+        if (depth == 0) break;
+        i++;
+      }
+      if (skimmable) {
+        for (size_t j = body; j < i; j++) {
+          if (data[j] != '\n') data[j] = ' ';
+        }
+      }
+      skimmable = false;
+    } else {
+      i++;
+    }
+  }
+}
+
+}  // namespace
+
 std::unique_ptr<Parser> Parser::Parse(const std::string& filename,
                                       const android::aidl::IoDelegate& io_delegate,
-                                      AidlTypenames& typenames) {
+                                      AidlTypenames& typenames, Mode mode) {
   // Make sure we can read the file first, before trashing previous state.
-  unique_ptr<string> raw_buffer = io_delegate.GetFileContents(filename);
-  if (raw_buffer == nullptr) {
+  unique_ptr<android::aidl::FileBuffer> buffer = io_delegate.GetFileBuffer(filename);
+  if (buffer == nullptr) {
     AIDL_ERROR(filename) << "Error while opening file for parsing";
     return nullptr;
   }
+  return ParseContents(filename, std::move(buffer), typenames, mode);
+}
 
-  // We're going to scan this buffer in place, and yacc demands we put two
-  // nulls at the end.
-  raw_buffer->append(2u, '\0');
-
-  std::unique_ptr<Parser> parser(new Parser(filename, *raw_buffer, typenames));
+std::unique_ptr<Parser> Parser::ParseContents(const std::string& filename,
+                                              unique_ptr<android::aidl::FileBuffer> buffer,
+                                              AidlTypenames& typenames, Mode mode) {
+  android::aidl::ProfileScope profile_scope(mode == Mode::SKIM ? "skim" : "parse", filename);
+  if (android::aidl::Stats* stats = android::aidl::Stats::Current(); stats != nullptr) {
+    stats->AddSource(filename, buffer->Size());
+  }
+  if (mode == Mode::SKIM) {
+    SkimBodies(buffer->Data(), buffer->Size());
+  }
+  // The buffer is scanned in place; it is followed by the two nulls that yacc
+  // demands.
+  std::unique_ptr<Parser> parser(new Parser(filename, *buffer, typenames));
+  // Comments refer to the buffer, and the types are added to |typenames|
+  // even when the file has errors.
+  parser->arena_->Retain(std::move(buffer));
 
+  // All nodes of the file are allocated from the arena of |typenames|.
+  android::aidl::AidlArena::Scope arena_scope(parser->arena_.get());
   if (yy::parser(parser.get()).parse() != 0 || parser->HasError()) return nullptr;
 
   return parser;
 }
 
+Parser* ParsedFileCache::Parse(const std::string& filename,
+                               const android::aidl::IoDelegate& io_delegate, Parser::Mode mode) {
+  unique_ptr<android::aidl::FileBuffer> buffer = io_delegate.GetFileBuffer(filename);
+  if (buffer == nullptr) {
+    AIDL_ERROR(filename) << "Error while opening file for parsing";
+    return nullptr;
+  }
+
+  const std::string path = android::aidl::internals::NormalizePath(filename);
+  auto key = std::make_pair(path, std::hash<std::string_view>()({buffer->Data(), buffer->Size()}));
+  auto it = parsers_.find(key);
+  if (it != parsers_.end()) {
+    if (mode == Parser::Mode::FULL && skimmed_.count(path) > 0) {
+      AIDL_ERROR(filename) << "Can't parse a file that was only skimmed as an import";
+      return nullptr;
+    }
+    hits_++;
+    return it->second.get();
+  }
+  if (mode == Parser::Mode::SKIM) {
+    skimmed_.insert(path);
+  }
+  // A file that failed to parse is remembered as well; parsing it again would
+  // only repeat the errors, or report its types as duplicates.
+  auto parser = Parser::ParseContents(filename, std::move(buffer), typenames_, mode);
+  return parsers_.emplace(key, std::move(parser)).first->second.get();
+}
+
+bool ParsedFileCache::IsSkimmed(const std::string& filename) const {
+  return skimmed_.count(android::aidl::internals::NormalizePath(filename)) > 0;
+}
+
+bool ParsedFileCache::IsUpToDate(const android::aidl::IoDelegate& io_delegate) const {
+  for (const auto& [key, parser] : parsers_) {
+    unique_ptr<android::aidl::FileBuffer> buffer = io_delegate.GetFileBuffer(key.first);
+    if (buffer == nullptr ||
+        std::hash<std::string_view>()({buffer->Data(), buffer->Size()}) != key.second) {
+      return false;
+    }
+  }
+  return true;
+}
+
 std::vector<std::string> Parser::Package() const {
   if (!package_) {
     return {};
@@ -1161,8 +1748,18 @@ void Parser::AddImport(std::unique_ptr<AidlImport>&& import) {
 
 bool Parser::Resolve() {
   bool success = true;
+  // A file names the same few types over and over, and no types are added
+  // while it is resolved, so each name is looked up once. Maps a name to the
+  // first typespec resolved with it, or to nullptr if it did not resolve.
+  std::unordered_map<std::string_view, const AidlTypeSpecifier*> resolved;
   for (AidlTypeSpecifier* typespec : unresolved_typespecs_) {
-    if (!typespec->Resolve(typenames_)) {
+    auto [it, inserted] = resolved.emplace(typespec->GetUnresolvedName(), nullptr);
+    if (inserted && typespec->Resolve(typenames_)) {
+      it->second = typespec;
+    } else if (!inserted && it->second != nullptr) {
+      typespec->ResolveLike(*it->second);
+    }
+    if (!typespec->IsResolved()) {
       AIDL_ERROR(typespec) << "Failed to resolve '" << typespec->GetUnresolvedName() << "'";
       success = false;
       // don't stop to show more errors if any
@@ -1171,14 +1768,28 @@ bool Parser::Resolve() {
   return success;
 }
 
-Parser::Parser(const std::string& filename, std::string& raw_buffer,
+namespace {
+std::atomic_bool hand_written_lexer{false};
+}  // namespace
+
+void Parser::SetHandWrittenLexer(bool hand_written) {
+  hand_written_lexer.store(hand_written, std::memory_order_relaxed);
+}
+
+Parser::Parser(const std::string& filename, android::aidl::FileBuffer& buffer,
                android::aidl::AidlTypenames& typenames)
-    : filename_(filename), typenames_(typenames) {
+    : arena_(typenames.Arena()), filename_(filename), typenames_(typenames) {
+  if (hand_written_lexer.load(std::memory_order_relaxed)) {
+    lexer_ = std::make_unique<AidlLexer>(buffer.Data(), buffer.Size());
+    return;
+  }
   yylex_init(&scanner_);
-  buffer_ = yy_scan_buffer(&raw_buffer[0], raw_buffer.length(), scanner_);
+  buffer_ = yy_scan_buffer(buffer.Data(), buffer.Size() + 2, scanner_);
 }
 
 Parser::~Parser() {
-  yy_delete_buffer(buffer_, scanner_);
-  yylex_destroy(scanner_);
+  if (scanner_ != nullptr) {
+    yy_delete_buffer(buffer_, scanner_);
+    yylex_destroy(scanner_);
+  }
 }
@@ -16,15 +16,25 @@
 
 #pragma once
 
+#include "aidl_arena.h"
 #include "aidl_typenames.h"
 #include "code_writer.h"
 #include "io_delegate.h"
+#include "logging.h"
 #include "options.h"
 
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <map>
 #include <memory>
+#include <optional>
 #include <regex>
+#include <set>
 #include <string>
+#include <string_view>
 #include <unordered_set>
+#include <utility>
 #include <vector>
 
 #include <android-base/macros.h>
@@ -33,6 +43,8 @@
 struct yy_buffer_state;
 typedef yy_buffer_state* YY_BUFFER_STATE;
 
+class AidlLexer;
+
 using android::aidl::AidlTypenames;
 using android::aidl::CodeWriter;
 using android::aidl::Options;
@@ -50,19 +62,54 @@ std::string dump_location(const AidlNode& method);
 namespace java {
 std::string dump_location(const AidlNode& method);
 }  // namespace java
+class PrecompiledModuleWriter;
+class Stats;
 }  // namespace aidl
 }  // namespace android
 
+// The comments in front of a token. The lexer records them as ranges of the
+// source buffer, which the arena of the parsed file keeps alive, and they are
+// only copied into a string when somebody asks for the text.
+class AidlComments {
+ public:
+  AidlComments() = default;
+  AidlComments(const char* text) : AidlComments(std::string(text)) {}
+  AidlComments(const std::string& text);
+  AidlComments(const AidlComments& other);
+  AidlComments& operator=(const AidlComments& other);
+
+  // Starts a new comment.
+  void Add(std::string_view text) { ranges_.push_back(text); }
+  // Appends |text|, which directly follows it in the source, to the last
+  // comment.
+  void Extend(std::string_view text) {
+    ranges_.back() = std::string_view(ranges_.back().data(), ranges_.back().size() + text.size());
+  }
+
+  // All comments, in source order. Line comments end with a newline.
+  const std::string& str() const;
+
+ private:
+  std::vector<std::string_view> ranges_;
+  mutable std::string text_;
+  // Set once text_ holds the comments; they may be asked for from several
+  // generator threads at the same time.
+  mutable std::atomic_bool materialized_{false};
+};
+
 class AidlToken {
  public:
-  AidlToken(const std::string& text, const std::string& comments);
+  AidlToken(const std::string& text, const AidlComments& comments);
+
+  static void* operator new(size_t size) { return android::aidl::AidlArena::Allocate(size); }
+  static void operator delete(void* p) { android::aidl::AidlArena::Free(p); }
 
   const std::string& GetText() const { return text_; }
-  const std::string& GetComments() const { return comments_; }
+  const AidlComments& GetComments() const { return comments_; }
 
  private:
   std::string text_;
-  std::string comments_;
+  AidlComments comments_;
 
   DISALLOW_COPY_AND_ASSIGN(AidlToken);
 };
@@ -80,7 +127,12 @@ class AidlLocation {
   friend class AidlNode;
 
  private:
-  const std::string file_;
+  // The names of the source files are kept in a table, so that every node of
+  // a file doesn't carry its own copy of the name.
+  static uint32_t InternFile(const std::string& file);
+  const std::string& File() const;
+
+  const uint32_t file_id_;
   Point begin_;
   Point end_;
 };
@@ -101,6 +153,10 @@ class AidlNode {
   AidlNode(AidlNode&&) = default;
   virtual ~AidlNode() = default;
 
+  // Nodes created while parsing live in the arena of the AidlTypenames.
+  static void* operator new(size_t size) { return android::aidl::AidlArena::Allocate(size); }
+  static void operator delete(void* p) { android::aidl::AidlArena::Free(p); }
+
   // DO NOT ADD. This is intentionally omitted. Nothing should refer to the location
   // for a functional purpose. It is only for error messages.
   // NO const AidlLocation& GetLocation() const { return location_; } NO
@@ -136,13 +192,32 @@ class AidlError {
   std::ostream& os_;
 
   static bool hadError() { return sHadError; }
+  // Forgets the errors reported so far, e.g. before the next job of a server.
+  static void clearError() { sHadError = false; }
+
+  // Redirects the non-fatal errors reported from the calling thread to |os|, or
+  // back to std::cerr when |os| is null. Keeps the output of parallel jobs apart.
+  static void SetThreadOutput(std::ostream* os) { sThreadOutput = os; }
+
+  // The stream that the calling thread reports to, for the diagnostics that
+  // are written without AIDL_ERROR.
+  static std::ostream& ThreadOutput() {
+    return sThreadOutput != nullptr ? *sThreadOutput : std::cerr;
+  }
+
+  // A logger for android::base::InitLogging() that writes the LOG() messages
+  // of a thread to its SetThreadOutput() stream, and the others, like the
+  // fatal ones, with android::base::StderrLogger().
+  static void Logger(android::base::LogId id, android::base::LogSeverity severity,
+                     const char* tag, const char* file, unsigned int line, const char* message);
 
  private:
   AidlError(bool fatal);
 
   bool fatal_;
 
-  static bool sHadError;
+  static std::atomic_bool sHadError;
+  static thread_local std::ostream* sThreadOutput;
 
   DISALLOW_COPY_AND_ASSIGN(AidlError);
 };
@@ -194,6 +269,29 @@ using ConstantValueDecorator =
 
 class AidlAnnotation : public AidlNode {
  public:
+  // The recognized annotations, one bit each in AidlAnnotatable
+  enum class Type {
+    NULLABLE,
+    UTF8_IN_CPP,
+    VINTF_STABILITY,
+    UNSUPPORTED_APP_USAGE,
+    JAVA_STABLE_PARCELABLE,
+    HIDE,
+    BACKING,
+    SHARED_MEMORY,
+    FIXED_SIZE,
+    ARRAY_VIEW,
+    MOVE_IN,
+    POLYMORPHIC_ALLOCATOR,
+    HASHABLE,
+    CACHEABLE,
+    BATCHABLE,
+    DELTA,
+    STRING_VIEW,
+    SINGLE_FLIGHT,
+    HEADERLESS,
+  };
+
   static AidlAnnotation* Parse(
       const AidlLocation& location, const string& name,
       std::map<std::string, std::shared_ptr<AidlConstantValue>>* parameter_list);
@@ -204,19 +302,27 @@ class AidlAnnotation : public AidlNode {
   bool CheckValid() const;
 
   const string& GetName() const { return name_; }
+  Type GetType() const { return type_; }
   string ToString(const ConstantValueDecorator& decorator) const;
   std::map<std::string, std::string> AnnotationParams(
       const ConstantValueDecorator& decorator) const;
-  const string& GetComments() const { return comments_; }
-  void SetComments(const string& comments) { comments_ = comments; }
+  const string& GetComments() const { return comments_.str(); }
+  // The comments as recorded by the lexer, for passing them on to the node
+  // that the annotation belongs to.
+  const AidlComments& GetRawComments() const { return comments_; }
+  void SetComments(const AidlComments& comments) { comments_ = comments; }
 
  private:
   AidlAnnotation(const AidlLocation& location, const string& name);
   AidlAnnotation(const AidlLocation& location, const string& name,
                  std::map<std::string, std::shared_ptr<AidlConstantValue>>&& parameters);
   const string name_;
-  string comments_;
+  const Type type_;
+  AidlComments comments_;
   std::map<std::string, std::shared_ptr<AidlConstantValue>> parameters_;
+
+  friend class android::aidl::PrecompiledModuleWriter;
+  friend class android::aidl::Stats;
 };
 
 static inline bool operator<(const AidlAnnotation& lhs, const AidlAnnotation& rhs) {
@@ -236,14 +342,55 @@ class AidlAnnotatable : public AidlNode {
 
   void Annotate(vector<AidlAnnotation>&& annotations) {
     for (auto& annotation : annotations) {
+      annotation_bits_ |= Bit(annotation.GetType());
       annotations_.emplace_back(std::move(annotation));
     }
   }
-  bool IsNullable() const;
-  bool IsUtf8InCpp() const;
-  bool IsVintfStability() const;
-  bool IsStableApiParcelable(Options::Language lang) const;
-  bool IsHide() const;
+  bool IsNullable() const { return Has(AidlAnnotation::Type::NULLABLE); }
+  bool IsUtf8InCpp() const { return Has(AidlAnnotation::Type::UTF8_IN_CPP); }
+  bool IsVintfStability() const { return Has(AidlAnnotation::Type::VINTF_STABILITY); }
+  // @FixedSize on a structured parcelable of primitives and enums, whose
+  // layout in a parcel is known up front
+  bool IsFixedSize() const { return Has(AidlAnnotation::Type::FIXED_SIZE); }
+  // @ArrayView on an in byte[], int[] or float[], which the C++ and NDK
+  // backends pass as a read-only ::android::aidl::ArrayView
+  bool IsArrayView() const { return Has(AidlAnnotation::Type::ARRAY_VIEW); }
+  // @StringView on an in @utf8InCpp String, which the C++ and NDK backends
+  // pass as a ::std::string_view
+  bool IsStringView() const { return Has(AidlAnnotation::Type::STRING_VIEW); }
+  // @MoveIn on an interface or a method, whose in arguments the C++ and NDK
+  // backends pass as rvalue references for the servers to take
+  bool IsMoveIn() const { return Has(AidlAnnotation::Type::MOVE_IN); }
+  // @PolymorphicAllocator on a structured parcelable, whose containers the C++
+  // and NDK backends hold in ::std::pmr types that take its allocator
+  bool IsPolymorphicAllocator() const { return Has(AidlAnnotation::Type::POLYMORPHIC_ALLOCATOR); }
+  // @Hashable on a structured parcelable, which all the backends compare and
+  // hash field by field
+  bool IsHashable() const { return Has(AidlAnnotation::Type::HASHABLE); }
+  // @Delta on a structured parcelable, for which all the backends generate a
+  // Delta of the fields that changed between two of its values
+  bool IsDelta() const { return Has(AidlAnnotation::Type::DELTA); }
+  // @Cacheable on a method, whose results the proxies of all the backends
+  // keep by its in arguments until the interface invalidates its caches
+  bool IsCacheable() const { return Has(AidlAnnotation::Type::CACHEABLE); }
+  // @Batchable on a oneway method, whose calls the proxies of all the backends
+  // queue and send together in one transaction
+  bool IsBatchable() const { return Has(AidlAnnotation::Type::BATCHABLE); }
+  // @SingleFlight on a method, whose concurrent calls with equal in arguments
+  // the stubs of all the backends make into one call of the service
+  bool IsSingleFlight() const { return Has(AidlAnnotation::Type::SINGLE_FLIGHT); }
+  // @Headerless on a structured parcelable of an unstable interface, which all
+  // the backends marshal without the size header that lets other versions of
+  // it skip the fields that they do not know
+  bool IsHeaderless() const { return Has(AidlAnnotation::Type::HEADERLESS); }
+  bool IsStableApiParcelable(Options::Language lang) const {
+    return lang == Options::Language::JAVA && Has(AidlAnnotation::Type::JAVA_STABLE_PARCELABLE);
+  }
+  bool IsHide() const { return Has(AidlAnnotation::Type::HIDE); }
+  // @SharedMemory(threshold=N), which moves byte[]s longer than N bytes into
+  // shared memory. The threshold is -1 without the annotation.
+  bool IsSharedMemory() const { return Has(AidlAnnotation::Type::SHARED_MEMORY); }
+  int32_t SharedMemoryThreshold() const;
 
   void DumpAnnotations(CodeWriter* writer) const;
 
@@ -255,7 +402,17 @@ class AidlAnnotatable : public AidlNode {
   bool CheckValidAnnotations() const;
 
  private:
+  static constexpr uint32_t Bit(AidlAnnotation::Type type) {
+    return uint32_t{1} << static_cast<int>(type);
+  }
+  bool Has(AidlAnnotation::Type type) const { return (annotation_bits_ & Bit(type)) != 0; }
+  // The annotation of |type|, or nullptr
+  const AidlAnnotation* Get(AidlAnnotation::Type type) const;
+
+  // Kept for dumping, and for the parameters of the annotations
   vector<AidlAnnotation> annotations_;
+  // The bits of the types of annotations_, which the predicates test
+  uint32_t annotation_bits_ = 0;
 };
 
 class AidlQualifiedName;
@@ -266,8 +423,9 @@ class AidlTypeSpecifier final : public AidlAnnotatable,
                                 public AidlParameterizable<unique_ptr<AidlTypeSpecifier>> {
  public:
   AidlTypeSpecifier(const AidlLocation& location, const string& unresolved_name, bool is_array,
-                    vector<unique_ptr<AidlTypeSpecifier>>* type_params, const string& comments);
-  virtual ~AidlTypeSpecifier() = default;
+                    vector<unique_ptr<AidlTypeSpecifier>>* type_params,
+                    const AidlComments& comments);
+  virtual ~AidlTypeSpecifier();
 
   // Copy of this type which is not an array.
   AidlTypeSpecifier ArrayBase() const;
@@ -295,32 +453,102 @@ class AidlTypeSpecifier final : public AidlAnnotatable,
 
   bool IsHidden() const;
 
-  const string& GetComments() const { return comments_; }
+  const string& GetComments() const { return comments_.str(); }
+  const AidlComments& GetRawComments() const { return comments_; }
 
   const std::vector<std::string> GetSplitName() const { return split_name_; }
 
-  void SetComments(const string& comment) { comments_ = comment; }
+  void SetComments(const AidlComments& comment) { comments_ = comment; }
 
   bool IsResolved() const { return fully_qualified_name_ != ""; }
 
   bool IsArray() const { return is_array_; }
+  // A fixed-size array T[N], which is an array too, with its N. The backends
+  // hold it in a ::std::array<T, N> or a T[] of N elements.
+  static constexpr size_t kMaxFixedArraySize = 4096;
+  bool IsFixedSizeArray() const { return fixed_array_size_ > 0; }
+  size_t FixedArraySize() const { return fixed_array_size_; }
+  // Makes this array a T[|size|], before the type is used
+  void SetFixedArraySize(size_t size) {
+    AIDL_FATAL_IF(!is_array_ || size == 0, this);
+    fixed_array_size_ = size;
+  }
+
+  // The kind of the base type if it is a built-in type, kept up to date with
+  // GetName().
+  std::optional<android::aidl::AidlBuiltinKind> GetBuiltinKind() const { return builtin_kind_; }
 
   // Resolve the base type name to a fully-qualified name. Return false if the
   // resolution fails.
   bool Resolve(const AidlTypenames& typenames);
+  // Resolve the base type name like |resolved|, which has the same
+  // unresolved name and was resolved against the same types.
+  void ResolveLike(const AidlTypeSpecifier& resolved);
 
   bool CheckValid(const AidlTypenames& typenames) const;
   bool LanguageSpecificCheckValid(Options::Language lang) const;
   const AidlNode& AsAidlNode() const override { return *this; }
 
+  // The strings that are computed from a resolved type over and over, by this
+  // class and by the backends.
+  enum class Memo {
+    TO_STRING,
+    SIGNATURE,
+    CPP_NAME,
+    CPP_OPTIONAL_NAME,
+    CPP_READ_METHOD,
+    CPP_WRITE_METHOD,
+    NDK_STACK_NAME,
+    NDK_ARGUMENT_NAME,
+    NDK_OUT_ARGUMENT_NAME,
+    JAVA_SIGNATURE,
+    JAVA_INSTANTIABLE_SIGNATURE,
+    COUNT,
+  };
+
+  // Returns what |make| returns, which is computed once per |memo| when the
+  // type and its type parameters are resolved. |make| must only depend on the
+  // type, which doesn't change once it is resolved. Safe to call from several
+  // threads.
+  template <typename Make>
+  string Memoized(Memo memo, Make make) const {
+    if (!IsResolved() || (IsGeneric() && !std::all_of(GetTypeParameters().begin(),
+                                                     GetTypeParameters().end(),
+                                                     [](auto& t) { return t->IsResolved(); }))) {
+      return make();
+    }
+    std::atomic<const string*>& slot = MemoSlot(memo);
+    if (const string* memoized = slot.load(std::memory_order_acquire); memoized != nullptr) {
+      return *memoized;
+    }
+    auto made = std::make_unique<const string>(make());
+    const string* expected = nullptr;
+    if (slot.compare_exchange_strong(expected, made.get(), std::memory_order_acq_rel)) {
+      return *made.release();
+    }
+    return *expected;  // made by another thread meanwhile
+  }
+
  private:
-  AidlTypeSpecifier(const AidlTypeSpecifier&) = default;
+  struct Memos {
+    ~Memos();
+    std::atomic<const string*> strings[static_cast<size_t>(Memo::COUNT)] = {};
+  };
+
+  // Copies all but the memos, which belong to the original type.
+  AidlTypeSpecifier(const AidlTypeSpecifier& other);
+
+  std::atomic<const string*>& MemoSlot(Memo memo) const;
 
   const string unresolved_name_;
   string fully_qualified_name_;
+  std::optional<android::aidl::AidlBuiltinKind> builtin_kind_;
   bool is_array_;
-  string comments_;
+  size_t fixed_array_size_ = 0;
+  AidlComments comments_;
   vector<string> split_name_;
+  // Made on the first Memoized() call
+  mutable std::atomic<Memos*> memos_ = nullptr;
 };
 
 // Returns the universal value unaltered.
@@ -455,8 +683,13 @@ class AidlConstantValue : public AidlNode {
   static string ToString(Type type);
   static bool ParseIntegral(const string& value, int64_t* parsed_value, Type* parsed_type);
   static bool IsHex(const string& value);
+  // The smallest of INT8, INT32 and INT64 that holds |value|.
+  static Type IntegralTypeOf(int64_t value);
 
   virtual bool evaluate(const AidlTypeSpecifier& type) const;
+  // The undecorated ValueString of an evaluated value that isn't an array.
+  // Logs and returns nullopt if the value doesn't fit |type|.
+  std::optional<string> FoldedLiteral(const AidlTypeSpecifier& type) const;
 
   const Type type_ = Type::ERROR;
   const vector<unique_ptr<AidlConstantValue>> values_;  // if type_ == ARRAY
@@ -464,15 +697,25 @@ class AidlConstantValue : public AidlNode {
 
   // State for tracking evaluation of expressions
   mutable bool is_valid_ = false;      // cache of CheckValid, but may be marked false in evaluate
+  mutable bool is_checked_ = false;    // whether CheckValid has been called
   mutable bool is_evaluated_ = false;  // whether evaluate has been called
   mutable Type final_type_;
   mutable int64_t final_value_;
   mutable string final_string_value_ = "";
 
+  // FoldedLiteral() for the first type that ValueString succeeded with, which
+  // is the one the value is validated against. Set once, since backends ask
+  // for it from several threads.
+  mutable std::atomic_bool is_folded_ = false;
+  mutable string folded_type_name_;
+  mutable string folded_literal_;
+
   DISALLOW_COPY_AND_ASSIGN(AidlConstantValue);
 
   friend AidlUnaryConstExpression;
   friend AidlBinaryConstExpression;
+  friend class android::aidl::PrecompiledModuleWriter;
+  friend class android::aidl::Stats;
 };
 
 class AidlUnaryConstExpression : public AidlConstantValue {
@@ -487,6 +730,9 @@ class AidlUnaryConstExpression : public AidlConstantValue {
 
   std::unique_ptr<AidlConstantValue> unary_;
   const string op_;
+
+  friend class android::aidl::PrecompiledModuleWriter;
+  friend class android::aidl::Stats;
 };
 
 class AidlBinaryConstExpression : public AidlConstantValue {
@@ -508,6 +754,9 @@ class AidlBinaryConstExpression : public AidlConstantValue {
   std::unique_ptr<AidlConstantValue> left_val_;
   std::unique_ptr<AidlConstantValue> right_val_;
   const string op_;
+
+  friend class android::aidl::PrecompiledModuleWriter;
+  friend class android::aidl::Stats;
 };
 
 struct AidlAnnotationParameter {
@@ -546,15 +795,15 @@ class AidlConstantDeclaration : public AidlMember {
 class AidlMethod : public AidlMember {
  public:
   AidlMethod(const AidlLocation& location, bool oneway, AidlTypeSpecifier* type, const string& name,
-             vector<unique_ptr<AidlArgument>>* args, const string& comments);
+             vector<unique_ptr<AidlArgument>>* args, const AidlComments& comments);
   AidlMethod(const AidlLocation& location, bool oneway, AidlTypeSpecifier* type, const string& name,
-             vector<unique_ptr<AidlArgument>>* args, const string& comments, int id,
+             vector<unique_ptr<AidlArgument>>* args, const AidlComments& comments, int id,
              bool is_user_defined = true);
   virtual ~AidlMethod() = default;
 
   AidlMethod* AsMethod() override { return this; }
   bool IsHidden() const;
-  const string& GetComments() const { return comments_; }
+  const string& GetComments() const { return comments_.str(); }
   const AidlTypeSpecifier& GetType() const { return *type_; }
   AidlTypeSpecifier* GetMutableType() { return type_.get(); }
 
@@ -592,7 +841,7 @@ class AidlMethod : public AidlMember {
 
  private:
   bool oneway_;
-  std::string comments_;
+  AidlComments comments_;
   std::unique_ptr<AidlTypeSpecifier> type_;
   std::string name_;
   const std::vector<std::unique_ptr<AidlArgument>> arguments_;
@@ -613,11 +862,11 @@ class AidlStructuredParcelable;
 class AidlQualifiedName : public AidlNode {
  public:
   AidlQualifiedName(const AidlLocation& location, const std::string& term,
-                    const std::string& comments);
+                    const AidlComments& comments);
   virtual ~AidlQualifiedName() = default;
 
   const std::vector<std::string>& GetTerms() const { return terms_; }
-  const std::string& GetComments() const { return comments_; }
+  const std::string& GetComments() const { return comments_.str(); }
   std::string GetDotName() const { return android::base::Join(terms_, '.'); }
   std::string GetColonName() const { return android::base::Join(terms_, "::"); }
 
@@ -625,7 +874,7 @@ class AidlQualifiedName : public AidlNode {
 
  private:
   std::vector<std::string> terms_;
-  std::string comments_;
+  AidlComments comments_;
 
   DISALLOW_COPY_AND_ASSIGN(AidlQualifiedName);
 };
@@ -638,13 +887,13 @@ class AidlStructuredParcelable;
 class AidlDefinedType : public AidlAnnotatable {
  public:
   AidlDefinedType(const AidlLocation& location, const std::string& name,
-                  const std::string& comments, const std::vector<std::string>& package);
+                  const AidlComments& comments, const std::vector<std::string>& package);
   virtual ~AidlDefinedType() = default;
 
   const std::string& GetName() const { return name_; };
   bool IsHidden() const;
-  const std::string& GetComments() const { return comments_; }
-  void SetComments(const std::string comments) { comments_ = comments; }
+  const std::string& GetComments() const { return comments_.str(); }
+  void SetComments(const AidlComments& comments) { comments_ = comments; }
 
   /* dot joined package, example: "android.package.foo" */
   std::string GetPackage() const;
@@ -695,7 +944,7 @@ class AidlDefinedType : public AidlAnnotatable {
 
  private:
   std::string name_;
-  std::string comments_;
+  AidlComments comments_;
   const std::vector<std::string> package_;
 
   DISALLOW_COPY_AND_ASSIGN(AidlDefinedType);
@@ -704,7 +953,7 @@ class AidlDefinedType : public AidlAnnotatable {
 class AidlParcelable : public AidlDefinedType, public AidlParameterizable<std::string> {
  public:
   AidlParcelable(const AidlLocation& location, AidlQualifiedName* name,
-                 const std::vector<std::string>& package, const std::string& comments,
+                 const std::vector<std::string>& package, const AidlComments& comments,
                  const std::string& cpp_header = "",
                  std::vector<std::string>* type_params = nullptr);
   virtual ~AidlParcelable() = default;
@@ -732,7 +981,7 @@ class AidlParcelable : public AidlDefinedType, public AidlParameterizable<std::s
 class AidlStructuredParcelable : public AidlParcelable {
  public:
   AidlStructuredParcelable(const AidlLocation& location, AidlQualifiedName* name,
-                           const std::vector<std::string>& package, const std::string& comments,
+                           const std::vector<std::string>& package, const AidlComments& comments,
                            std::vector<std::unique_ptr<AidlVariableDeclaration>>* variables);
 
   const std::vector<std::unique_ptr<AidlVariableDeclaration>>& GetFields() const {
@@ -756,12 +1005,12 @@ class AidlStructuredParcelable : public AidlParcelable {
 class AidlEnumerator : public AidlNode {
  public:
   AidlEnumerator(const AidlLocation& location, const std::string& name, AidlConstantValue* value,
-                 const std::string& comments);
+                 const AidlComments& comments);
   virtual ~AidlEnumerator() = default;
 
   const std::string& GetName() const { return name_; }
   AidlConstantValue* GetValue() const { return value_.get(); }
-  const std::string& GetComments() const { return comments_; }
+  const std::string& GetComments() const { return comments_.str(); }
   bool CheckValid(const AidlTypeSpecifier& enum_backing_type) const;
 
   string ValueString(const AidlTypeSpecifier& backing_type,
@@ -772,7 +1021,7 @@ class AidlEnumerator : public AidlNode {
  private:
   const std::string name_;
   unique_ptr<AidlConstantValue> value_;
-  const std::string comments_;
+  const AidlComments comments_;
 
   DISALLOW_COPY_AND_ASSIGN(AidlEnumerator);
 };
@@ -781,7 +1030,7 @@ class AidlEnumDeclaration : public AidlDefinedType {
  public:
   AidlEnumDeclaration(const AidlLocation& location, const string& name,
                       std::vector<std::unique_ptr<AidlEnumerator>>* enumerators,
-                      const std::vector<std::string>& package, const std::string& comments);
+                      const std::vector<std::string>& package, const AidlComments& comments);
   virtual ~AidlEnumDeclaration() = default;
 
   void SetBackingType(std::unique_ptr<const AidlTypeSpecifier> type);
@@ -807,7 +1056,7 @@ class AidlEnumDeclaration : public AidlDefinedType {
 
 class AidlInterface final : public AidlDefinedType {
  public:
-  AidlInterface(const AidlLocation& location, const std::string& name, const std::string& comments,
+  AidlInterface(const AidlLocation& location, const std::string& name, const AidlComments& comments,
                 bool oneway_, std::vector<std::unique_ptr<AidlMember>>* members,
                 const std::vector<std::string>& package);
   virtual ~AidlInterface() = default;
@@ -853,15 +1102,28 @@ class Parser {
  public:
   ~Parser();
 
+  // How much of a file is parsed. Imported files are usually only needed for
+  // the kinds, names and annotations of their types, so SKIM leaves out the
+  // bodies of interfaces and structured parcelables. Enums are parsed whole,
+  // since their backing types and values are needed.
+  enum class Mode { FULL, SKIM };
+
   // Parse contents of file |filename|. Should only be called once.
   static std::unique_ptr<Parser> Parse(const std::string& filename,
                                        const android::aidl::IoDelegate& io_delegate,
-                                       AidlTypenames& typenames);
+                                       AidlTypenames& typenames, Mode mode = Mode::FULL);
 
   void AddError() { error_++; }
   bool HasError() { return error_ != 0; }
 
+  // Whether the files parsed from now on are scanned by AidlLexer rather
+  // than by flex, see --lexer.
+  static void SetHandWrittenLexer(bool hand_written);
+
   const std::string& FileName() const { return filename_; }
+  // The scanner of the file: either the hand-written lexer, or the flex
+  // scanner when there is none.
+  AidlLexer* Lexer() const { return lexer_.get(); }
   void* Scanner() const { return scanner_; }
 
   void AddImport(std::unique_ptr<AidlImport>&& import);
@@ -894,15 +1156,26 @@ class Parser {
   vector<AidlDefinedType*>& GetDefinedTypes() { return defined_types_; }
 
  private:
-  explicit Parser(const std::string& filename, std::string& raw_buffer,
+  friend class ParsedFileCache;
+
+  explicit Parser(const std::string& filename, android::aidl::FileBuffer& buffer,
                   android::aidl::AidlTypenames& typenames);
 
+  // Scans |buffer| in place. The buffer is handed over to the arena of
+  // |typenames|, since the comments of the nodes refer to it.
+  static std::unique_ptr<Parser> ParseContents(const std::string& filename,
+                                               unique_ptr<android::aidl::FileBuffer> buffer,
+                                               AidlTypenames& typenames, Mode mode);
+
+  // Declared first so that it is released after the nodes owned by the parser.
+  std::shared_ptr<android::aidl::AidlArena> arena_;
   std::string filename_;
   std::unique_ptr<AidlQualifiedName> package_;
   AidlTypenames& typenames_;
 
+  std::unique_ptr<AidlLexer> lexer_;
   void* scanner_ = nullptr;
-  YY_BUFFER_STATE buffer_;
+  YY_BUFFER_STATE buffer_ = nullptr;
   int error_ = 0;
 
   std::vector<std::unique_ptr<AidlImport>> imports_;
@@ -911,3 +1184,37 @@ class Parser {
 
   DISALLOW_COPY_AND_ASSIGN(Parser);
 };
+
+// Parsers of the files that have been parsed into one AidlTypenames, keyed by
+// the normalized path and a hash of the contents of each file. Parsing the same
+// file again, e.g. an import shared by many inputs, is then just a lookup that
+// returns the defined types and unresolved typespecs found the first time.
+class ParsedFileCache {
+ public:
+  explicit ParsedFileCache(AidlTypenames& typenames) : typenames_(typenames) {}
+
+  // Returns the parser for |filename|, which is owned by the cache, or nullptr
+  // if the file can't be read or parsed. A file that was parsed whole also
+  // answers a SKIM, but one that was skimmed can't be parsed whole anymore,
+  // since its types are already defined.
+  Parser* Parse(const std::string& filename, const android::aidl::IoDelegate& io_delegate,
+                Parser::Mode mode = Parser::Mode::FULL);
+
+  // Whether |filename| was only skimmed.
+  bool IsSkimmed(const std::string& filename) const;
+
+  // Number of Parse() calls that were answered from the cache.
+  size_t Hits() const { return hits_; }
+
+  // Whether every cached file still has the contents it was parsed from.
+  bool IsUpToDate(const android::aidl::IoDelegate& io_delegate) const;
+
+ private:
+  AidlTypenames& typenames_;
+  std::map<std::pair<std::string, size_t>, std::unique_ptr<Parser>> parsers_;
+  // Normalized paths of the files that were skimmed
+  std::set<std::string> skimmed_;
+  size_t hits_ = 0;
+
+  DISALLOW_COPY_AND_ASSIGN(ParsedFileCache);
+};
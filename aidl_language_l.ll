@@ -43,20 +43,21 @@ floatvalue  [0-9]*\.?[0-9]+([eE][-+]?[0-9]+)?f?
 %%
 %{
   /* This happens at every call to yylex (every time we receive one token) */
-  std::string extra_text;
+  /* The comments refer to the scanned buffer, which outlives the tokens. */
+  AidlComments extra_text;
   yylloc->step();
 %}
 
-\/\*                  { extra_text += yytext; BEGIN(LONG_COMMENT); }
-<LONG_COMMENT>\*+\/   { extra_text += yytext; yylloc->step(); BEGIN(INITIAL);  }
-<LONG_COMMENT>\*+     { extra_text += yytext; }
-<LONG_COMMENT>\n+     { extra_text += yytext; yylloc->lines(yyleng); }
-<LONG_COMMENT>[^*\n]+ { extra_text += yytext; }
+\/\*                  { extra_text.Add(std::string_view(yytext, yyleng)); BEGIN(LONG_COMMENT); }
+<LONG_COMMENT>\*+\/   { extra_text.Extend(std::string_view(yytext, yyleng)); yylloc->step(); BEGIN(INITIAL);  }
+<LONG_COMMENT>\*+     { extra_text.Extend(std::string_view(yytext, yyleng)); }
+<LONG_COMMENT>\n+     { extra_text.Extend(std::string_view(yytext, yyleng)); yylloc->lines(yyleng); }
+<LONG_COMMENT>[^*\n]+ { extra_text.Extend(std::string_view(yytext, yyleng)); }
 
 \"[^\"]*\"            { yylval->token = new AidlToken(yytext, extra_text);
                         return yy::parser::token::C_STR; }
 
-\/\/.*                { extra_text += yytext; extra_text += "\n"; }
+\/\/.*                { extra_text.Add(std::string_view(yytext, yyleng)); }
 
 \n+                   { yylloc->lines(yyleng); yylloc->step(); }
 {whitespace}          {}
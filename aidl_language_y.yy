@@ -17,6 +17,7 @@
 %{
 #include "aidl_language.h"
 #include "aidl_language_y-module.h"
+#include "aidl_lexer.h"
 #include "logging.h"
 #include <android-base/parseint.h>
 #include <set>
@@ -27,6 +28,12 @@
 
 int yylex(yy::parser::semantic_type *, yy::parser::location_type *, void *);
 
+// Scans with the hand-written lexer of |ps|, if it has one, or with flex.
+int yylex(yy::parser::semantic_type *yylval, yy::parser::location_type *yylloc, Parser *ps) {
+  AidlLexer* lexer = ps->Lexer();
+  return lexer != nullptr ? lexer->Lex(yylval, yylloc) : yylex(yylval, yylloc, ps->Scanner());
+}
+
 AidlLocation loc(const yy::parser::location_type& begin, const yy::parser::location_type& end) {
   CHECK(begin.begin.filename == begin.end.filename);
   CHECK(begin.end.filename == end.begin.filename);
@@ -46,7 +53,7 @@ AidlLocation loc(const yy::parser::location_type& l) {
   return loc(l, l);
 }
 
-#define lex_scanner ps->Scanner()
+#define lex_scanner ps
 
 %}
 
@@ -56,7 +63,7 @@ AidlLocation loc(const yy::parser::location_type& l) {
 }
 
 %parse-param { Parser* ps }
-%lex-param { void *lex_scanner }
+%lex-param { Parser *lex_scanner }
 
 %glr-parser
 %skeleton "glr.cc"
@@ -238,7 +245,7 @@ decl
 
     if ($1->size() > 0 && $$ != nullptr) {
       // copy comments from annotation to decl
-      $$->SetComments($1->begin()->GetComments());
+      $$->SetComments($1->begin()->GetRawComments());
       $$->Annotate(std::move(*$1));
     }
 
@@ -533,11 +540,11 @@ enum_decl
 
 method_decl
  : type identifier '(' arg_list ')' ';' {
-    $$ = new AidlMethod(loc(@2), false, $1, $2->GetText(), $4, $1->GetComments());
+    $$ = new AidlMethod(loc(@2), false, $1, $2->GetText(), $4, $1->GetRawComments());
     delete $2;
   }
  | annotation_list ONEWAY type identifier '(' arg_list ')' ';' {
-    const std::string& comments = ($1->size() > 0) ? $1->begin()->GetComments() : $2->GetComments();
+    const AidlComments& comments = ($1->size() > 0) ? $1->begin()->GetRawComments() : $2->GetComments();
     $$ = new AidlMethod(loc(@4), true, $3, $4->GetText(), $6, comments);
     $3->Annotate(std::move(*$1));
     delete $1;
@@ -550,12 +557,12 @@ method_decl
         AIDL_ERROR(loc(@7)) << "Could not parse int value: " << $7->GetText();
         ps->AddError();
     }
-    $$ = new AidlMethod(loc(@2), false, $1, $2->GetText(), $4, $1->GetComments(), serial);
+    $$ = new AidlMethod(loc(@2), false, $1, $2->GetText(), $4, $1->GetRawComments(), serial);
     delete $2;
     delete $7;
   }
  | annotation_list ONEWAY type identifier '(' arg_list ')' '=' INTVALUE ';' {
-    const std::string& comments = ($1->size() > 0) ? $1->begin()->GetComments() : $2->GetComments();
+    const AidlComments& comments = ($1->size() > 0) ? $1->begin()->GetRawComments() : $2->GetComments();
     int32_t serial = 0;
     if (!android::base::ParseInt($9->GetText(), &serial)) {
         AIDL_ERROR(loc(@9)) << "Could not parse int value: " << $9->GetText();
@@ -607,6 +614,21 @@ unannotated_type
     ps->DeferResolution($$);
     delete $1;
   }
+ | qualified_name '[' INTVALUE ']' {
+    $$ = new AidlTypeSpecifier(loc(@1), $1->GetDotName(), true, nullptr, $1->GetComments());
+    size_t size = 0;
+    if (!android::base::ParseUint($3->GetText(), &size, AidlTypeSpecifier::kMaxFixedArraySize) ||
+        size == 0) {
+      AIDL_ERROR(loc(@3)) << "The size of a fixed-size array must be from 1 to "
+                          << AidlTypeSpecifier::kMaxFixedArraySize << ", not " << $3->GetText();
+      ps->AddError();
+    } else {
+      $$->SetFixedArraySize(size);
+    }
+    ps->DeferResolution($$);
+    delete $1;
+    delete $3;
+  }
  | qualified_name '<' type_args '>' {
     $$ = new AidlTypeSpecifier(loc(@1), $1->GetDotName(), false, $3, $1->GetComments());
     ps->DeferResolution($$);
@@ -618,7 +640,7 @@ type
     $$ = $2;
     if ($1->size() > 0) {
       // copy comments from annotation to type
-      $2->SetComments($1->begin()->GetComments());
+      $2->SetComments($1->begin()->GetRawComments());
     }
     $2->Annotate(std::move(*$1));
     delete $1;
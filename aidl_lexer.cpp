@@ -0,0 +1,282 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "aidl_lexer.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <array>
+#include <string>
+#include <string_view>
+
+using token = yy::parser::token;
+
+namespace {
+
+enum : uint8_t {
+  kIdentifierStart = 1 << 0,  // [_a-zA-Z]
+  kIdentifier = 1 << 1,       // [_a-zA-Z0-9]
+  kDigit = 1 << 2,            // [0-9]
+  kHexDigit = 1 << 3,         // [0-9a-fA-F]
+  kBlank = 1 << 4,            // [ \t\r]
+};
+
+constexpr std::array<uint8_t, 256> MakeClasses() {
+  std::array<uint8_t, 256> classes{};
+  for (int c = 'a'; c <= 'z'; c++) {
+    classes[c] |= kIdentifierStart | kIdentifier;
+    classes[c - 'a' + 'A'] |= kIdentifierStart | kIdentifier;
+  }
+  classes['_'] |= kIdentifierStart | kIdentifier;
+  for (int c = '0'; c <= '9'; c++) {
+    classes[c] |= kIdentifier | kDigit | kHexDigit;
+  }
+  for (int c = 'a'; c <= 'f'; c++) {
+    classes[c] |= kHexDigit;
+    classes[c - 'a' + 'A'] |= kHexDigit;
+  }
+  classes[' '] |= kBlank;
+  classes['\t'] |= kBlank;
+  classes['\r'] |= kBlank;
+  return classes;
+}
+
+constexpr std::array<uint8_t, 256> kClasses = MakeClasses();
+
+inline bool Is(char c, uint8_t cls) {
+  return (kClasses[static_cast<unsigned char>(c)] & cls) != 0;
+}
+
+inline const char* Skip(const char* p, const char* end, uint8_t cls) {
+  while (p < end && Is(*p, cls)) p++;
+  return p;
+}
+
+struct Keyword {
+  std::string_view text;
+  int token;
+  // Whether the token carries an AidlToken with the comments before it
+  bool has_value;
+};
+
+constexpr Keyword kKeywords[] = {
+    {"parcelable", token::PARCELABLE, true},
+    {"import", token::IMPORT, false},
+    {"package", token::PACKAGE, false},
+    {"in", token::IN, false},
+    {"out", token::OUT, false},
+    {"inout", token::INOUT, false},
+    {"cpp_header", token::CPP_HEADER, false},
+    {"const", token::CONST, true},
+    {"true", token::TRUE_LITERAL, false},
+    {"false", token::FALSE_LITERAL, false},
+    {"interface", token::INTERFACE, true},
+    {"oneway", token::ONEWAY, true},
+    {"enum", token::ENUM, true},
+};
+
+// The tokens of two characters, which win over those of their first one
+int TwoCharToken(char first, char second) {
+  switch (first) {
+    case '<':
+      return second == '<' ? token::LSHIFT : second == '=' ? token::LEQ : 0;
+    case '>':
+      return second == '>' ? token::RSHIFT : second == '=' ? token::GEQ : 0;
+    case '&':
+      return second == '&' ? token::LOGICAL_AND : 0;
+    case '|':
+      return second == '|' ? token::LOGICAL_OR : 0;
+    case '=':
+      return second == '=' ? token::EQUALITY : 0;
+    case '!':
+      return second == '=' ? token::NEQ : 0;
+    default:
+      return 0;
+  }
+}
+
+bool IsSymbol(char c) {
+  return c != '\0' && strchr("()<>{}[]:;,.=+-*/%&|^!~", c) != nullptr;
+}
+
+// The "*/" that ends the comment whose body starts at |p|, or nullptr
+const char* FindCommentEnd(const char* p, const char* end) {
+  while (p < end) {
+    const char* star = static_cast<const char*>(memchr(p, '*', end - p));
+    if (star == nullptr || star + 1 >= end) return nullptr;
+    if (star[1] == '/') return star;
+    p = star + 1;
+  }
+  return nullptr;
+}
+
+// Moves |loc| over [begin, end), counting its lines as the comment rules do
+void Advance(yy::parser::location_type* loc, const char* begin, const char* end) {
+  int lines = 0;
+  const char* line_start = begin;
+  for (const char* p = begin;
+       (p = static_cast<const char*>(memchr(p, '\n', end - p))) != nullptr; p++) {
+    lines++;
+    line_start = p + 1;
+  }
+  if (lines > 0) loc->lines(lines);
+  loc->columns(static_cast<int>(end - line_start));
+}
+
+}  // namespace
+
+int AidlLexer::ScanNumber(const char** end) const {
+  // {intvalue}: [0-9]+[lL]?
+  const char* digits = Skip(pos_, end_, kDigit);
+  const char* int_end = pos_;
+  if (digits > pos_) {
+    int_end = digits < end_ && (*digits == 'l' || *digits == 'L') ? digits + 1 : digits;
+  }
+
+  // {floatvalue}: [0-9]*\.?[0-9]+([eE][-+]?[0-9]+)?f?
+  const char* float_end = pos_;
+  const char* mantissa = nullptr;
+  if (digits + 1 < end_ && *digits == '.' && Is(digits[1], kDigit)) {
+    mantissa = Skip(digits + 1, end_, kDigit);
+  } else if (digits > pos_) {
+    mantissa = digits;
+  }
+  if (mantissa != nullptr) {
+    float_end = mantissa;
+    if (float_end < end_ && (*float_end == 'e' || *float_end == 'E')) {
+      const char* exponent = float_end + 1;
+      if (exponent < end_ && (*exponent == '-' || *exponent == '+')) exponent++;
+      if (exponent < end_ && Is(*exponent, kDigit)) float_end = Skip(exponent, end_, kDigit);
+    }
+    if (float_end < end_ && *float_end == 'f') float_end++;
+  }
+
+  // {hexvalue}: 0[x|X][0-9a-fA-F]+
+  const char* hex_end = pos_;
+  if (pos_ + 2 < end_ && pos_[0] == '0' &&
+      (pos_[1] == 'x' || pos_[1] == 'X' || pos_[1] == '|') && Is(pos_[2], kHexDigit)) {
+    hex_end = Skip(pos_ + 2, end_, kHexDigit);
+  }
+
+  // The longest match wins, and the earliest rule on a tie.
+  *end = int_end;
+  int kind = token::INTVALUE;
+  if (float_end > *end) {
+    *end = float_end;
+    kind = token::FLOATVALUE;
+  }
+  if (hex_end > *end) {
+    *end = hex_end;
+    kind = token::HEXVALUE;
+  }
+  return kind;
+}
+
+int AidlLexer::Lex(yy::parser::semantic_type* yylval, yy::parser::location_type* yylloc) {
+  AidlComments extra_text;
+  yylloc->step();
+  while (pos_ < end_) {
+    const char* start = pos_;
+    const char c = *start;
+
+    if (Is(c, kBlank)) {
+      pos_ = Skip(pos_ + 1, end_, kBlank);
+      yylloc->columns(static_cast<int>(pos_ - start));
+      continue;
+    }
+    if (c == '\n') {
+      while (pos_ < end_ && *pos_ == '\n') pos_++;
+      yylloc->lines(static_cast<int>(pos_ - start));
+      yylloc->step();
+      continue;
+    }
+    if (c == '/' && pos_ + 1 < end_ && pos_[1] == '*') {
+      const char* close = FindCommentEnd(pos_ + 2, end_);
+      pos_ = close != nullptr ? close + 2 : end_;
+      extra_text.Add(std::string_view(start, pos_ - start));
+      Advance(yylloc, start, pos_);
+      if (close == nullptr) return 0;  // the input ends in the comment
+      yylloc->step();
+      continue;
+    }
+    if (c == '/' && pos_ + 1 < end_ && pos_[1] == '/') {
+      const char* newline = static_cast<const char*>(memchr(pos_, '\n', end_ - pos_));
+      pos_ = newline != nullptr ? newline : end_;
+      extra_text.Add(std::string_view(start, pos_ - start));
+      yylloc->columns(static_cast<int>(pos_ - start));
+      continue;
+    }
+
+    if (Is(c, kIdentifierStart)) {
+      pos_ = Skip(pos_ + 1, end_, kIdentifier);
+      const std::string_view text(start, pos_ - start);
+      yylloc->columns(static_cast<int>(text.size()));
+      for (const Keyword& keyword : kKeywords) {
+        if (keyword.text == text) {
+          if (keyword.has_value) yylval->token = new AidlToken(std::string(text), extra_text);
+          return keyword.token;
+        }
+      }
+      yylval->token = new AidlToken(std::string(text), extra_text);
+      return token::IDENTIFIER;
+    }
+    if (Is(c, kDigit) || (c == '.' && pos_ + 1 < end_ && Is(pos_[1], kDigit))) {
+      const char* number_end;
+      const int kind = ScanNumber(&number_end);
+      pos_ = number_end;
+      yylloc->columns(static_cast<int>(pos_ - start));
+      yylval->token = new AidlToken(std::string(start, pos_ - start), extra_text);
+      return kind;
+    }
+
+    // Everything else is a single token, of one character unless said otherwise
+    pos_++;
+    int kind = token::UNKNOWN;
+    if (c == '"') {
+      // Strings may span lines, but don't count them
+      const char* quote = static_cast<const char*>(memchr(pos_, '"', end_ - pos_));
+      if (quote != nullptr) {
+        pos_ = quote + 1;
+        yylval->token = new AidlToken(std::string(start, pos_ - start), extra_text);
+        kind = token::C_STR;
+      }
+    } else if (c == '@') {
+      if (pos_ < end_ && Is(*pos_, kIdentifierStart)) {
+        pos_ = Skip(pos_ + 1, end_, kIdentifier);
+        yylval->token = new AidlToken(std::string(start + 1, pos_ - start - 1), extra_text);
+        kind = token::ANNOTATION;
+      }
+    } else if (c == '\'') {
+      if (pos_ + 1 < end_ && *pos_ != '\n' && pos_[1] == '\'') {
+        yylval->character = *pos_;
+        pos_ += 2;
+        kind = token::CHARVALUE;
+      }
+    } else if (IsSymbol(c)) {
+      const int two_char = pos_ < end_ ? TwoCharToken(c, *pos_) : 0;
+      if (two_char != 0) {
+        pos_++;
+        kind = two_char;
+      } else {
+        kind = static_cast<unsigned char>(c);
+      }
+    }
+    yylloc->columns(static_cast<int>(pos_ - start));
+    return kind;
+  }
+  return 0;
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+#include <android-base/macros.h>
+
+#include "aidl_language.h"
+#include "aidl_language_y-module.h"
+
+// A hand-written scanner of the tokens of aidl_language_l.ll, for
+// --lexer=hand-written. It returns the same tokens, values, comments and
+// locations as the flex scanner, but skips comments and strings with memchr()
+// and classifies the other bytes with a table instead of running a DFA over
+// each of them.
+class AidlLexer {
+ public:
+  // Scans the |size| bytes at |data| in place; the comments of the tokens
+  // refer to them.
+  AidlLexer(const char* data, size_t size) : pos_(data), end_(data + size) {}
+
+  // The next token, like yylex(): its value goes to |yylval| and its location
+  // to |yylloc|. 0 at the end of the input.
+  int Lex(yy::parser::semantic_type* yylval, yy::parser::location_type* yylloc);
+
+ private:
+  // The longest number at pos_, either INTVALUE, FLOATVALUE or HEXVALUE
+  int ScanNumber(const char** end) const;
+
+  const char* pos_;
+  const char* const end_;
+
+  DISALLOW_COPY_AND_ASSIGN(AidlLexer);
+};
@@ -0,0 +1,672 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "aidl_precompile.h"
+#include "logging.h"
+
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using std::map;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+namespace android {
+namespace aidl {
+
+namespace {
+
+const char kModuleMagic[] = "AIDLMOD\1";
+const size_t kModuleMagicSize = sizeof(kModuleMagic) - 1;
+// magic + six uint32 fields
+const size_t kModuleHeaderSize = kModuleMagicSize + 6 * 4;
+
+enum class RecordKind {
+  PARCELABLE = 0,
+  STRUCTURED_PARCELABLE = 1,
+  ENUM = 2,
+  INTERFACE = 3,
+};
+
+void AppendUint32(string* out, uint32_t value) {
+  for (int i = 0; i < 4; i++) {
+    out->push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+  }
+}
+
+}  // namespace
+
+class PrecompiledModuleWriter {
+ public:
+  void AddType(const AidlDefinedType& type) {
+    index_.emplace_back(Intern(type.GetCanonicalName()), body_.size());
+    WriteType(type);
+  }
+
+  string Finish() const {
+    string strings;
+    vector<uint32_t> offsets;
+    for (const string& s : strings_) {
+      offsets.push_back(strings.size());
+      strings.append(s);
+    }
+    offsets.push_back(strings.size());
+
+    const uint32_t strings_offset = kModuleHeaderSize;
+    const uint32_t index_offset = strings_offset + 4 * offsets.size() + strings.size();
+    const uint32_t body_offset = index_offset + 8 * index_.size();
+
+    string out(kModuleMagic, kModuleMagicSize);
+    AppendUint32(&out, strings_.size());
+    AppendUint32(&out, strings_offset);
+    AppendUint32(&out, index_.size());
+    AppendUint32(&out, index_offset);
+    AppendUint32(&out, body_offset);
+    AppendUint32(&out, body_.size());
+    for (uint32_t offset : offsets) {
+      AppendUint32(&out, offset);
+    }
+    out.append(strings);
+    for (const auto& entry : index_) {
+      AppendUint32(&out, entry.first);
+      AppendUint32(&out, entry.second);
+    }
+    out.append(body_);
+    return out;
+  }
+
+ private:
+  uint32_t Intern(const string& s) {
+    auto it = string_ids_.find(s);
+    if (it != string_ids_.end()) {
+      return it->second;
+    }
+    const uint32_t id = strings_.size();
+    strings_.push_back(s);
+    string_ids_.emplace(s, id);
+    return id;
+  }
+
+  void WriteVarint(uint64_t value) {
+    do {
+      uint8_t byte = value & 0x7f;
+      value >>= 7;
+      if (value != 0) byte |= 0x80;
+      body_.push_back(static_cast<char>(byte));
+    } while (value != 0);
+  }
+
+  void WriteString(const string& s) { WriteVarint(Intern(s)); }
+
+  void WriteAnnotations(const AidlAnnotatable& node) {
+    WriteVarint(node.GetAnnotations().size());
+    for (const AidlAnnotation& annotation : node.GetAnnotations()) {
+      WriteString(annotation.GetName());
+      WriteString(annotation.GetComments());
+      WriteVarint(annotation.parameters_.size());
+      for (const auto& param : annotation.parameters_) {
+        WriteString(param.first);
+        WriteConstant(*param.second);
+      }
+    }
+  }
+
+  void WriteConstant(const AidlConstantValue& value) {
+    WriteVarint(static_cast<uint64_t>(value.type_));
+    switch (value.type_) {
+      case AidlConstantValue::Type::ARRAY:
+        WriteVarint(value.values_.size());
+        for (const auto& element : value.values_) {
+          WriteConstant(*element);
+        }
+        break;
+      case AidlConstantValue::Type::UNARY: {
+        const auto& unary = static_cast<const AidlUnaryConstExpression&>(value);
+        WriteString(unary.op_);
+        WriteConstant(*unary.unary_);
+        break;
+      }
+      case AidlConstantValue::Type::BINARY: {
+        const auto& binary = static_cast<const AidlBinaryConstExpression&>(value);
+        WriteConstant(*binary.left_val_);
+        WriteString(binary.op_);
+        WriteConstant(*binary.right_val_);
+        break;
+      }
+      default:
+        WriteString(value.value_);
+        break;
+    }
+  }
+
+  void WriteOptionalConstant(const AidlConstantValue* value) {
+    WriteVarint(value != nullptr);
+    if (value != nullptr) {
+      WriteConstant(*value);
+    }
+  }
+
+  void WriteTypeSpecifier(const AidlTypeSpecifier& type) {
+    WriteString(type.GetName());
+    // 0 when not an array, 1 for T[], otherwise N plus one for T[N]
+    WriteVarint(type.IsFixedSizeArray() ? type.FixedArraySize() + 1 : type.IsArray());
+    WriteString(type.GetComments());
+    WriteAnnotations(type);
+    // 0 when not generic, otherwise the number of parameters plus one
+    WriteVarint(type.IsGeneric() ? type.GetTypeParameters().size() + 1 : 0);
+    if (type.IsGeneric()) {
+      for (const auto& param : type.GetTypeParameters()) {
+        WriteTypeSpecifier(*param);
+      }
+    }
+  }
+
+  void WriteType(const AidlDefinedType& type) {
+    const AidlStructuredParcelable* parcelable = type.AsStructuredParcelable();
+    const AidlParcelable* unstructured = type.AsUnstructuredParcelable();
+    const AidlEnumDeclaration* enum_decl = type.AsEnumDeclaration();
+    const AidlInterface* interface = type.AsInterface();
+
+    RecordKind kind = RecordKind::INTERFACE;
+    if (parcelable != nullptr) {
+      kind = RecordKind::STRUCTURED_PARCELABLE;
+    } else if (unstructured != nullptr) {
+      kind = RecordKind::PARCELABLE;
+    } else if (enum_decl != nullptr) {
+      kind = RecordKind::ENUM;
+    }
+    WriteVarint(static_cast<uint64_t>(kind));
+    WriteString(type.GetName());
+    WriteVarint(type.GetSplitPackage().size());
+    for (const string& term : type.GetSplitPackage()) {
+      WriteString(term);
+    }
+    WriteString(type.GetComments());
+    WriteAnnotations(type);
+
+    if (unstructured != nullptr) {
+      WriteString(unstructured->GetCppHeader());
+      WriteVarint(unstructured->IsGeneric() ? unstructured->GetTypeParameters().size() + 1 : 0);
+      if (unstructured->IsGeneric()) {
+        for (const string& param : unstructured->GetTypeParameters()) {
+          WriteString(param);
+        }
+      }
+    } else if (parcelable != nullptr) {
+      WriteVarint(parcelable->GetFields().size());
+      for (const auto& field : parcelable->GetFields()) {
+        WriteTypeSpecifier(field->GetType());
+        WriteString(field->GetName());
+        WriteOptionalConstant(field->GetDefaultValue());
+      }
+    } else if (enum_decl != nullptr) {
+      WriteVarint(enum_decl->GetEnumerators().size());
+      for (const auto& enumerator : enum_decl->GetEnumerators()) {
+        WriteString(enumerator->GetName());
+        WriteString(enumerator->GetComments());
+        WriteOptionalConstant(enumerator->GetValue());
+      }
+    } else if (interface != nullptr) {
+      // Meta methods are added again by the compilation that uses the type.
+      vector<const AidlMethod*> methods;
+      for (const auto& method : interface->GetMethods()) {
+        if (method->IsUserDefined()) methods.push_back(method.get());
+      }
+      WriteVarint(methods.size());
+      for (const AidlMethod* method : methods) {
+        WriteVarint(method->IsOneway());
+        WriteTypeSpecifier(method->GetType());
+        WriteString(method->GetName());
+        WriteString(method->GetComments());
+        WriteVarint(method->HasId());
+        WriteVarint(method->HasId() ? method->GetId() : 0);
+        WriteVarint(method->GetArguments().size());
+        for (const auto& arg : method->GetArguments()) {
+          WriteVarint(arg->DirectionWasSpecified() ? arg->GetDirection() : 0);
+          WriteTypeSpecifier(arg->GetType());
+          WriteString(arg->GetName());
+        }
+      }
+      WriteVarint(interface->GetConstantDeclarations().size());
+      for (const auto& constant : interface->GetConstantDeclarations()) {
+        WriteTypeSpecifier(constant->GetType());
+        WriteString(constant->GetName());
+        WriteConstant(constant->GetValue());
+      }
+    }
+  }
+
+  vector<string> strings_;
+  map<string, uint32_t> string_ids_;
+  vector<std::pair<uint32_t, uint32_t>> index_;
+  string body_;
+};
+
+namespace {
+
+class PrecompiledModuleReader {
+ public:
+  PrecompiledModuleReader(const string& filename, std::string_view data)
+      : data_(data), location_(filename, {0, 0}, {0, 0}) {}
+
+  // Reads and checks the header, string table and type index.
+  bool Init() {
+    if (data_.size() < kModuleHeaderSize ||
+        data_.compare(0, kModuleMagicSize, kModuleMagic, kModuleMagicSize) != 0) {
+      return false;
+    }
+    size_t pos = kModuleMagicSize;
+    uint32_t string_count = ReadUint32(&pos);
+    uint32_t strings_offset = ReadUint32(&pos);
+    uint32_t type_count = ReadUint32(&pos);
+    uint32_t index_offset = ReadUint32(&pos);
+    uint32_t body_offset = ReadUint32(&pos);
+    uint32_t body_size = ReadUint32(&pos);
+
+    if (!InBounds(strings_offset, 4 * (static_cast<uint64_t>(string_count) + 1)) ||
+        !InBounds(index_offset, 8 * static_cast<uint64_t>(type_count)) ||
+        !InBounds(body_offset, body_size)) {
+      return false;
+    }
+    string_count_ = string_count;
+    string_offsets_ = strings_offset;
+    string_data_ = strings_offset + 4 * (static_cast<uint64_t>(string_count) + 1);
+    type_count_ = type_count;
+    index_offset_ = index_offset;
+    body_begin_ = body_offset;
+    body_end_ = body_offset + body_size;
+
+    for (uint32_t i = 0; i <= string_count_; i++) {
+      size_t offset_pos = string_offsets_ + 4 * i;
+      if (!InBounds(string_data_, ReadUint32(&offset_pos))) return false;
+    }
+    return true;
+  }
+
+  size_t TypeCount() const { return type_count_; }
+
+  // Returns the qualified name of the |i|-th type and positions the reader at
+  // its record.
+  bool SeekType(size_t i, string* name) {
+    size_t pos = index_offset_ + 8 * i;
+    uint32_t name_id = ReadUint32(&pos);
+    uint32_t offset = ReadUint32(&pos);
+    if (!GetString(name_id, name) || body_begin_ + offset > body_end_) {
+      return false;
+    }
+    pos_ = body_begin_ + offset;
+    return true;
+  }
+
+  unique_ptr<AidlDefinedType> ReadType() {
+    const uint64_t kind = ReadVarint();
+    const string name = ReadString();
+    vector<string> package(ReadCount());
+    for (string& term : package) {
+      term = ReadString();
+    }
+    const string comments = ReadString();
+    vector<AidlAnnotation> annotations = ReadAnnotations();
+    if (!ok_) return nullptr;
+
+    unique_ptr<AidlDefinedType> type;
+    switch (static_cast<RecordKind>(kind)) {
+      case RecordKind::PARCELABLE: {
+        string cpp_header = ReadString();
+        // AidlParcelable strips the quotation marks of the header as it is
+        // spelled in the source.
+        if (!cpp_header.empty()) cpp_header = "\"" + cpp_header + "\"";
+        vector<string>* type_params = nullptr;
+        if (uint64_t count = ReadCount(); count > 0) {
+          type_params = new vector<string>(count - 1);
+          for (string& param : *type_params) {
+            param = ReadString();
+          }
+        }
+        type.reset(new AidlParcelable(location_, new AidlQualifiedName(location_, name, ""),
+                                      package, comments, cpp_header, type_params));
+        break;
+      }
+      case RecordKind::STRUCTURED_PARCELABLE: {
+        vector<unique_ptr<AidlVariableDeclaration>> fields;
+        for (uint64_t i = ReadCount(); ok_ && i > 0; i--) {
+          AidlTypeSpecifier* field_type = ReadTypeSpecifier().release();
+          const string field_name = ReadString();
+          unique_ptr<AidlConstantValue> default_value = ReadOptionalConstant();
+          if (field_type == nullptr) break;
+          fields.emplace_back(new AidlVariableDeclaration(location_, field_type, field_name,
+                                                          default_value.release()));
+        }
+        type.reset(new AidlStructuredParcelable(
+            location_, new AidlQualifiedName(location_, name, ""), package, comments, &fields));
+        break;
+      }
+      case RecordKind::ENUM: {
+        vector<unique_ptr<AidlEnumerator>> enumerators;
+        for (uint64_t i = ReadCount(); ok_ && i > 0; i--) {
+          const string enumerator_name = ReadString();
+          const string enumerator_comments = ReadString();
+          unique_ptr<AidlConstantValue> value = ReadOptionalConstant();
+          enumerators.emplace_back(new AidlEnumerator(location_, enumerator_name, value.release(),
+                                                      enumerator_comments));
+        }
+        type.reset(new AidlEnumDeclaration(location_, name, &enumerators, package, comments));
+        break;
+      }
+      case RecordKind::INTERFACE: {
+        auto members = new vector<unique_ptr<AidlMember>>();
+        for (uint64_t i = ReadCount(); ok_ && i > 0; i--) {
+          unique_ptr<AidlMethod> method = ReadMethod();
+          if (method == nullptr) break;
+          members->emplace_back(std::move(method));
+        }
+        for (uint64_t i = ReadCount(); ok_ && i > 0; i--) {
+          AidlTypeSpecifier* constant_type = ReadTypeSpecifier().release();
+          const string constant_name = ReadString();
+          unique_ptr<AidlConstantValue> value = ReadConstant();
+          if (constant_type == nullptr || value == nullptr) {
+            delete constant_type;
+            break;
+          }
+          members->emplace_back(new AidlConstantDeclaration(location_, constant_type,
+                                                            constant_name, value.release()));
+        }
+        type.reset(new AidlInterface(location_, name, comments, false /* oneway */, members,
+                                     package));
+        break;
+      }
+      default:
+        ok_ = false;
+    }
+    if (!ok_) return nullptr;
+    type->Annotate(std::move(annotations));
+    return type;
+  }
+
+ private:
+  bool InBounds(uint64_t offset, uint64_t size) const { return offset + size <= data_.size(); }
+
+  uint32_t ReadUint32(size_t* pos) const {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++) {
+      value |= static_cast<uint32_t>(static_cast<uint8_t>(data_[*pos + i])) << (8 * i);
+    }
+    *pos += 4;
+    return value;
+  }
+
+  bool GetString(uint64_t id, string* out) const {
+    if (id >= string_count_) return false;
+    size_t pos = string_offsets_ + 4 * id;
+    uint32_t begin = ReadUint32(&pos);
+    uint32_t end = ReadUint32(&pos);
+    if (begin > end) return false;
+    out->assign(data_.data() + string_data_ + begin, end - begin);
+    return true;
+  }
+
+  uint64_t ReadVarint() {
+    uint64_t value = 0;
+    for (int shift = 0; ok_ && shift < 64; shift += 7) {
+      if (pos_ >= body_end_) break;
+      const uint8_t byte = static_cast<uint8_t>(data_[pos_++]);
+      value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if ((byte & 0x80) == 0) return value;
+    }
+    ok_ = false;
+    return 0;
+  }
+
+  // Reads an element count, which can never exceed the remaining body size.
+  uint64_t ReadCount() {
+    uint64_t count = ReadVarint();
+    if (count > body_end_ - pos_ + 1) {
+      ok_ = false;
+      return 0;
+    }
+    return count;
+  }
+
+  string ReadString() {
+    string s;
+    if (ok_ && !GetString(ReadVarint(), &s)) {
+      ok_ = false;
+    }
+    return s;
+  }
+
+  vector<AidlAnnotation> ReadAnnotations() {
+    vector<AidlAnnotation> annotations;
+    for (uint64_t i = ReadCount(); ok_ && i > 0; i--) {
+      const string name = ReadString();
+      const string comments = ReadString();
+      std::map<string, std::shared_ptr<AidlConstantValue>> params;
+      for (uint64_t j = ReadCount(); ok_ && j > 0; j--) {
+        const string param_name = ReadString();
+        params[param_name] = ReadConstant();
+      }
+      if (!ok_) break;
+      unique_ptr<AidlAnnotation> annotation(AidlAnnotation::Parse(location_, name, &params));
+      if (annotation == nullptr) {
+        ok_ = false;
+        break;
+      }
+      annotation->SetComments(comments);
+      annotations.emplace_back(std::move(*annotation));
+    }
+    return annotations;
+  }
+
+  unique_ptr<AidlConstantValue> ReadConstant() {
+    using Type = AidlConstantValue::Type;
+    const Type type = static_cast<Type>(ReadVarint());
+    unique_ptr<AidlConstantValue> value;
+    switch (type) {
+      case Type::ARRAY: {
+        auto values = std::make_unique<vector<unique_ptr<AidlConstantValue>>>();
+        for (uint64_t i = ReadCount(); ok_ && i > 0; i--) {
+          values->emplace_back(ReadConstant());
+        }
+        value.reset(AidlConstantValue::Array(location_, std::move(values)));
+        break;
+      }
+      case Type::UNARY: {
+        const string op = ReadString();
+        unique_ptr<AidlConstantValue> operand = ReadConstant();
+        if (operand != nullptr) {
+          value = std::make_unique<AidlUnaryConstExpression>(location_, op, std::move(operand));
+        }
+        break;
+      }
+      case Type::BINARY: {
+        unique_ptr<AidlConstantValue> left = ReadConstant();
+        const string op = ReadString();
+        unique_ptr<AidlConstantValue> right = ReadConstant();
+        if (left != nullptr && right != nullptr) {
+          value = std::make_unique<AidlBinaryConstExpression>(location_, std::move(left), op,
+                                                               std::move(right));
+        }
+        break;
+      }
+      case Type::BOOLEAN:
+        value.reset(AidlConstantValue::Boolean(location_, ReadString() == "true"));
+        break;
+      case Type::CHARACTER: {
+        // The value is kept quoted, e.g. 'a'.
+        const string quoted = ReadString();
+        if (quoted.size() == 3) {
+          value.reset(AidlConstantValue::Character(location_, quoted[1]));
+        }
+        break;
+      }
+      case Type::INT8:
+      case Type::INT32:
+      case Type::INT64: {
+        const string literal = ReadString();
+        if (!literal.empty()) {
+          value.reset(AidlConstantValue::Integral(location_, literal));
+        }
+        break;
+      }
+      case Type::FLOATING:
+        value.reset(AidlConstantValue::Floating(location_, ReadString()));
+        break;
+      case Type::STRING:
+        value.reset(AidlConstantValue::String(location_, ReadString()));
+        break;
+      default:
+        break;
+    }
+    if (value == nullptr || value->GetType() == Type::ERROR) {
+      ok_ = false;
+      return nullptr;
+    }
+    return value;
+  }
+
+  unique_ptr<AidlConstantValue> ReadOptionalConstant() {
+    if (ReadVarint() == 0) return nullptr;
+    return ReadConstant();
+  }
+
+  unique_ptr<AidlTypeSpecifier> ReadTypeSpecifier() {
+    const string name = ReadString();
+    const uint64_t array = ReadVarint();
+    const bool is_array = array != 0;
+    const string comments = ReadString();
+    vector<AidlAnnotation> annotations = ReadAnnotations();
+    vector<unique_ptr<AidlTypeSpecifier>>* type_params = nullptr;
+    if (uint64_t count = ReadCount(); count > 0) {
+      type_params = new vector<unique_ptr<AidlTypeSpecifier>>();
+      for (uint64_t i = count - 1; ok_ && i > 0; i--) {
+        type_params->emplace_back(ReadTypeSpecifier());
+      }
+    }
+    // The type is left unresolved, with the qualified name as the name, in
+    // the same way as the types in an API dump.
+    auto type = std::make_unique<AidlTypeSpecifier>(location_, name, is_array, type_params,
+                                                    comments);
+    if (!ok_ || name.empty() || array > AidlTypeSpecifier::kMaxFixedArraySize + 1) {
+      ok_ = false;
+      return nullptr;
+    }
+    if (array > 1) type->SetFixedArraySize(array - 1);
+    type->Annotate(std::move(annotations));
+    return type;
+  }
+
+  unique_ptr<AidlMethod> ReadMethod() {
+    const bool oneway = ReadVarint() != 0;
+    unique_ptr<AidlTypeSpecifier> return_type = ReadTypeSpecifier();
+    const string name = ReadString();
+    const string comments = ReadString();
+    const bool has_id = ReadVarint() != 0;
+    const uint64_t id = ReadVarint();
+    auto args = new vector<unique_ptr<AidlArgument>>();
+    for (uint64_t i = ReadCount(); ok_ && i > 0; i--) {
+      const uint64_t direction = ReadVarint();
+      AidlTypeSpecifier* arg_type = ReadTypeSpecifier().release();
+      const string arg_name = ReadString();
+      if (arg_type == nullptr || direction > AidlArgument::INOUT_DIR) {
+        delete arg_type;
+        ok_ = false;
+        break;
+      }
+      if (direction == 0) {
+        args->emplace_back(new AidlArgument(location_, arg_type, arg_name));
+      } else {
+        args->emplace_back(new AidlArgument(
+            location_, static_cast<AidlArgument::Direction>(direction), arg_type, arg_name));
+      }
+    }
+    if (!ok_ || return_type == nullptr) {
+      delete args;
+      ok_ = false;
+      return nullptr;
+    }
+    if (has_id) {
+      return std::make_unique<AidlMethod>(location_, oneway, return_type.release(), name, args,
+                                          comments, static_cast<int>(id));
+    }
+    return std::make_unique<AidlMethod>(location_, oneway, return_type.release(), name, args,
+                                        comments);
+  }
+
+  const std::string_view data_;
+  const AidlLocation location_;
+  size_t string_count_ = 0;
+  size_t string_offsets_ = 0;
+  size_t string_data_ = 0;
+  size_t type_count_ = 0;
+  size_t index_offset_ = 0;
+  size_t body_begin_ = 0;
+  size_t body_end_ = 0;
+  size_t pos_ = 0;
+  bool ok_ = true;
+};
+
+}  // namespace
+
+bool write_precompiled_module(const vector<const AidlDefinedType*>& types, CodeWriter* writer) {
+  PrecompiledModuleWriter module;
+  for (const AidlDefinedType* type : types) {
+    module.AddType(*type);
+  }
+  return writer->WriteBytes(module.Finish()) && writer->Close();
+}
+
+bool load_precompiled_module(const IoDelegate& io_delegate, const string& filename,
+                             AidlTypenames* typenames, vector<AidlDefinedType*>* loaded_types) {
+  unique_ptr<FileBuffer> contents = io_delegate.GetFileBuffer(filename);
+  if (contents == nullptr) {
+    AIDL_ERROR(filename) << "cannot open precompiled module";
+    return false;
+  }
+
+  PrecompiledModuleReader reader(filename, {contents->Data(), contents->Size()});
+  if (!reader.Init()) {
+    AIDL_ERROR(filename) << "malformed precompiled module header";
+    return false;
+  }
+  for (size_t i = 0; i < reader.TypeCount(); i++) {
+    string name;
+    if (!reader.SeekType(i, &name)) {
+      AIDL_ERROR(filename) << "malformed precompiled module index";
+      return false;
+    }
+    // The type index lets us skip the records of types that are known already.
+    if (typenames->TryGetDefinedType(name) != nullptr) {
+      continue;
+    }
+    unique_ptr<AidlDefinedType> type = reader.ReadType();
+    if (type == nullptr) {
+      AIDL_ERROR(filename) << "malformed precompiled module record for " << name;
+      return false;
+    }
+    AidlDefinedType* raw = type.get();
+    if (typenames->AddPreprocessedType(std::move(type))) {
+      loaded_types->push_back(raw);
+    }
+  }
+  return true;
+}
+
+}  // namespace aidl
+}  // namespace android
@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include "aidl_language.h"
+#include "code_writer.h"
+#include "io_delegate.h"
+
+#include <string>
+#include <vector>
+
+namespace android {
+namespace aidl {
+
+// A precompiled module is a binary serialization of a set of validated
+// AidlDefinedTypes, including their annotations and constant expressions.
+// It is created by --precompile and consumed with --precompiled=FILE in place
+// of re-parsing the .aidl files of the imported types.
+//
+// Layout (all fixed-size integers are little-endian uint32):
+//   magic "AIDLMOD\1"
+//   string count, string table offset
+//   type count, type index offset
+//   body offset, body size
+//   string table: (string count + 1) offsets relative to the string data,
+//                 followed by the string data itself
+//   type index: (qualified name string id, body offset) per type
+//   body: one record per type, encoded with LEB128 varints and string ids
+
+// Serializes |types| and writes them to |writer|.
+bool write_precompiled_module(const std::vector<const AidlDefinedType*>& types,
+                              CodeWriter* writer);
+
+// Loads the types of the module in |filename| into |typenames|. The types are
+// registered as preprocessed types, so types defined by the compiled sources
+// take precedence; types that are already known are skipped. The newly added
+// types are appended to |loaded_types|.
+bool load_precompiled_module(const IoDelegate& io_delegate, const std::string& filename,
+                             AidlTypenames* typenames,
+                             std::vector<AidlDefinedType*>* loaded_types);
+
+}  // namespace aidl
+}  // namespace android
@@ -0,0 +1,416 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "aidl_profile.h"
+
+#include <algorithm>
+#include <atomic>
+#include <tuple>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#include <android-base/logging.h>
+#include <android-base/stringprintf.h>
+
+#include "aidl_language.h"
+#include "aidl_typenames.h"
+#include "code_writer.h"
+
+namespace android {
+namespace aidl {
+
+namespace {
+std::atomic<Profile*> current_profile = nullptr;
+std::atomic<Stats*> current_stats = nullptr;
+std::atomic<SizeReport*> current_size_report = nullptr;
+
+// Plain counters, so that operator new can use them at any time.
+thread_local uint64_t thread_allocations = 0;
+thread_local uint64_t thread_allocated_bytes = 0;
+thread_local uint64_t thread_written_bytes = 0;
+
+uint32_t ThreadNumber() {
+  static std::atomic<uint32_t> next_thread = 1;
+  thread_local uint32_t thread = next_thread++;
+  return thread;
+}
+
+int64_t Microseconds(std::chrono::steady_clock::duration duration) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+}
+
+std::string JsonString(std::string_view s) {
+  std::string json = "\"";
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      json.push_back('\\');
+      json.push_back(c);
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      json += android::base::StringPrintf("\\u%04x", c);
+    } else {
+      json.push_back(c);
+    }
+  }
+  json.push_back('"');
+  return json;
+}
+
+// The most memory that the process has had resident so far, or 0 where it
+// can't be told.
+uint64_t PeakRssBytes() {
+#ifdef _WIN32
+  return 0;
+#else
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+#ifdef __APPLE__
+  return usage.ru_maxrss;
+#else
+  return static_cast<uint64_t>(usage.ru_maxrss) * 1024;  // in KiB
+#endif
+#endif
+}
+}  // namespace
+
+Profile::Profile() : start_(std::chrono::steady_clock::now()) {
+  Profile* expected = nullptr;
+  CHECK(current_profile.compare_exchange_strong(expected, this))
+      << "Only one profile can be recorded at a time";
+}
+
+Profile::~Profile() {
+  current_profile = nullptr;
+}
+
+Profile* Profile::Current() {
+  return current_profile.load(std::memory_order_relaxed);
+}
+
+void Profile::Add(Span span) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  spans_.push_back(std::move(span));
+}
+
+void Profile::WriteTrace(CodeWriter* writer) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  (*writer) << "{\"traceEvents\":[";
+  for (size_t i = 0; i < spans_.size(); i++) {
+    const Span& span = spans_[i];
+    (*writer) << (i == 0 ? "\n" : ",\n");
+    writer->Write(
+        "{\"name\":%s,\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%lld,\"dur\":%lld,"
+        "\"args\":{",
+        JsonString(span.name).c_str(), span.thread, static_cast<long long>(span.begin_us),
+        static_cast<long long>(span.duration_us));
+    if (!span.file.empty()) {
+      (*writer) << "\"file\":" << JsonString(span.file) << ",";
+    }
+    writer->Write("\"allocations\":%llu,\"allocated_bytes\":%llu}}",
+                  static_cast<unsigned long long>(span.allocations),
+                  static_cast<unsigned long long>(span.allocated_bytes));
+  }
+  (*writer) << "\n],\"displayTimeUnit\":\"ms\"}\n";
+}
+
+ProfileScope::ProfileScope(const char* name, std::string_view file)
+    : profile_(Profile::Current()) {
+  if (profile_ == nullptr) {
+    return;
+  }
+  name_ = name;
+  file_ = file;
+  allocations_ = thread_allocations;
+  allocated_bytes_ = thread_allocated_bytes;
+  begin_ = std::chrono::steady_clock::now();
+}
+
+ProfileScope::~ProfileScope() {
+  if (profile_ == nullptr) {
+    return;
+  }
+  const auto end = std::chrono::steady_clock::now();
+  profile_->Add(Profile::Span{
+      name_, std::move(file_), ThreadNumber(), Microseconds(begin_ - profile_->start_),
+      Microseconds(end - begin_), thread_allocations - allocations_,
+      thread_allocated_bytes - allocated_bytes_});
+}
+
+Stats::Stats() {
+  Stats* expected = nullptr;
+  CHECK(current_stats.compare_exchange_strong(expected, this))
+      << "Only one set of stats can be recorded at a time";
+}
+
+Stats::~Stats() {
+  current_stats = nullptr;
+}
+
+Stats* Stats::Current() {
+  return current_stats.load(std::memory_order_relaxed);
+}
+
+void Stats::AddTypes(const AidlTypenames& typenames) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  nodes_.clear();
+  typenames.IterateLoadedTypes([&](const AidlDefinedType& type) { CountType(type); });
+  arena_bytes_ = typenames.Arena()->BytesAllocated();
+}
+
+void Stats::AddSource(std::string_view file, size_t size) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  sources_[std::string(file)] = size;
+}
+
+void Stats::AddOutput(std::string_view backend, uint64_t bytes) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = outputs_.find(backend);
+  if (it == outputs_.end()) {
+    it = outputs_.emplace(backend, 0).first;
+  }
+  it->second += bytes;
+}
+
+void Stats::EndPhase(const char* phase) {
+  const uint64_t peak_rss = PeakRssBytes();
+  std::lock_guard<std::mutex> lock(mutex_);
+  phases_.emplace_back(phase, peak_rss);
+}
+
+void Stats::CountNode(const char* node_class, size_t size) {
+  auto it = nodes_.find(std::string_view(node_class));
+  if (it == nodes_.end()) {
+    it = nodes_.emplace(node_class, NodeCount{}).first;
+  }
+  it->second.count++;
+  it->second.bytes += size;
+}
+
+void Stats::CountAnnotations(const AidlAnnotatable& annotatable) {
+  for (const AidlAnnotation& annotation : annotatable.GetAnnotations()) {
+    CountNode("AidlAnnotation", sizeof(AidlAnnotation));
+    for (const auto& [name, value] : annotation.parameters_) {
+      CountConstantValue(*value);
+    }
+  }
+}
+
+void Stats::CountTypeSpecifier(const AidlTypeSpecifier& type) {
+  CountNode("AidlTypeSpecifier", sizeof(AidlTypeSpecifier));
+  CountAnnotations(type);
+  if (type.IsGeneric()) {
+    for (const auto& parameter : type.GetTypeParameters()) {
+      CountTypeSpecifier(*parameter);
+    }
+  }
+}
+
+void Stats::CountConstantValue(const AidlConstantValue& value) {
+  if (auto unary = dynamic_cast<const AidlUnaryConstExpression*>(&value); unary != nullptr) {
+    CountNode("AidlUnaryConstExpression", sizeof(AidlUnaryConstExpression));
+    CountConstantValue(*unary->unary_);
+  } else if (auto binary = dynamic_cast<const AidlBinaryConstExpression*>(&value);
+             binary != nullptr) {
+    CountNode("AidlBinaryConstExpression", sizeof(AidlBinaryConstExpression));
+    CountConstantValue(*binary->left_val_);
+    CountConstantValue(*binary->right_val_);
+  } else {
+    CountNode("AidlConstantValue", sizeof(AidlConstantValue));
+    for (const auto& element : value.values_) {
+      CountConstantValue(*element);
+    }
+  }
+}
+
+void Stats::CountType(const AidlDefinedType& type) {
+  CountAnnotations(type);
+  if (const AidlInterface* interface = type.AsInterface(); interface != nullptr) {
+    CountNode("AidlInterface", sizeof(AidlInterface));
+    for (const auto& method : interface->GetMethods()) {
+      CountNode("AidlMethod", sizeof(AidlMethod));
+      CountTypeSpecifier(method->GetType());
+      for (const auto& argument : method->GetArguments()) {
+        CountNode("AidlArgument", sizeof(AidlArgument));
+        CountTypeSpecifier(argument->GetType());
+      }
+    }
+    for (const auto& constant : interface->GetConstantDeclarations()) {
+      CountNode("AidlConstantDeclaration", sizeof(AidlConstantDeclaration));
+      CountTypeSpecifier(constant->GetType());
+      CountConstantValue(constant->GetValue());
+    }
+  } else if (const AidlStructuredParcelable* parcelable = type.AsStructuredParcelable();
+             parcelable != nullptr) {
+    CountNode("AidlStructuredParcelable", sizeof(AidlStructuredParcelable));
+    for (const auto& field : parcelable->GetFields()) {
+      CountNode("AidlVariableDeclaration", sizeof(AidlVariableDeclaration));
+      CountTypeSpecifier(field->GetType());
+      if (field->GetDefaultValue() != nullptr) {
+        CountConstantValue(*field->GetDefaultValue());
+      }
+    }
+  } else if (const AidlEnumDeclaration* enum_decl = type.AsEnumDeclaration();
+             enum_decl != nullptr) {
+    CountNode("AidlEnumDeclaration", sizeof(AidlEnumDeclaration));
+    for (const auto& enumerator : enum_decl->GetEnumerators()) {
+      CountNode("AidlEnumerator", sizeof(AidlEnumerator));
+      if (enumerator->GetValue() != nullptr) {
+        CountConstantValue(*enumerator->GetValue());
+      }
+    }
+  } else {
+    CountNode("AidlParcelable", sizeof(AidlParcelable));
+  }
+}
+
+void Stats::WriteJson(CodeWriter* writer) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  using Sizes = std::map<std::string, uint64_t, std::less<>>;
+  auto write_sizes = [&](const char* name, const Sizes& sizes, bool last = false) {
+    (*writer) << JsonString(name) << ":{";
+    for (auto it = sizes.begin(); it != sizes.end(); it++) {
+      (*writer) << (it == sizes.begin() ? "\n" : ",\n") << "  " << JsonString(it->first);
+      writer->Write(":%llu", static_cast<unsigned long long>(it->second));
+    }
+    (*writer) << (sizes.empty() ? "}" : "\n}") << (last ? "\n" : ",\n");
+  };
+
+  (*writer) << "{\n\"nodes\":{";
+  for (auto it = nodes_.begin(); it != nodes_.end(); it++) {
+    (*writer) << (it == nodes_.begin() ? "\n" : ",\n") << "  " << JsonString(it->first);
+    writer->Write(":{\"count\":%llu,\"bytes\":%llu}",
+                  static_cast<unsigned long long>(it->second.count),
+                  static_cast<unsigned long long>(it->second.bytes));
+  }
+  (*writer) << (nodes_.empty() ? "},\n" : "\n},\n");
+  writer->Write("\"arena_bytes\":%llu,\n", static_cast<unsigned long long>(arena_bytes_));
+  write_sizes("sources", sources_);
+  write_sizes("outputs", outputs_);
+  (*writer) << "\"phases\":[";
+  for (size_t i = 0; i < phases_.size(); i++) {
+    (*writer) << (i == 0 ? "\n" : ",\n");
+    writer->Write("  {\"name\":%s,\"peak_rss_bytes\":%llu}", JsonString(phases_[i].first).c_str(),
+                  static_cast<unsigned long long>(phases_[i].second));
+  }
+  (*writer) << (phases_.empty() ? "]\n}\n" : "\n]\n}\n");
+}
+
+StatsPhase::~StatsPhase() {
+  if (stats_ != nullptr) {
+    stats_->EndPhase(name_);
+  }
+}
+
+SizeReport::SizeReport() {
+  SizeReport* expected = nullptr;
+  CHECK(current_size_report.compare_exchange_strong(expected, this))
+      << "Only one size report can be recorded at a time";
+}
+
+SizeReport::~SizeReport() {
+  current_size_report = nullptr;
+}
+
+SizeReport* SizeReport::Current() {
+  return current_size_report.load(std::memory_order_relaxed);
+}
+
+bool SizeReport::Key::operator<(const Key& other) const {
+  return std::tie(backend, type, method, section) <
+         std::tie(other.backend, other.type, other.method, other.section);
+}
+
+void SizeReport::Add(std::string_view backend, const AidlDefinedType& type,
+                     const AidlMethod* method, std::string_view section, std::string_view code) {
+  Add(backend, type, method, section, std::count(code.begin(), code.end(), '\n'), code.size());
+}
+
+void SizeReport::Add(std::string_view backend, const AidlDefinedType& type,
+                     const AidlMethod* method, std::string_view section, uint64_t lines,
+                     uint64_t bytes) {
+  if (bytes == 0) {
+    return;
+  }
+  Key key{std::string(backend), type.GetCanonicalName(),
+          method == nullptr ? "" : method->GetName(), std::string(section)};
+  std::lock_guard<std::mutex> lock(mutex_);
+  Size& size = sizes_[std::move(key)];
+  size.lines += lines;
+  size.bytes += bytes;
+}
+
+void SizeReport::WriteJson(CodeWriter* writer) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  (*writer) << "{\"sizes\":[";
+  for (auto it = sizes_.begin(); it != sizes_.end(); it++) {
+    const Key& key = it->first;
+    (*writer) << (it == sizes_.begin() ? "\n" : ",\n")
+              << "  {\"backend\":" << JsonString(key.backend)
+              << ",\"type\":" << JsonString(key.type);
+    if (!key.method.empty()) {
+      (*writer) << ",\"method\":" << JsonString(key.method);
+    }
+    (*writer) << ",\"section\":" << JsonString(key.section);
+    writer->Write(",\"lines\":%llu,\"bytes\":%llu}",
+                  static_cast<unsigned long long>(it->second.lines),
+                  static_cast<unsigned long long>(it->second.bytes));
+  }
+  (*writer) << (sizes_.empty() ? "]}\n" : "\n]}\n");
+}
+
+SizeScope::SizeScope(const CodeWriter& writer, const char* backend, const AidlDefinedType& type,
+                     const AidlMethod* method, const char* section)
+    : report_(SizeReport::Current()),
+      writer_(writer),
+      backend_(backend),
+      type_(type),
+      method_(method),
+      section_(section) {
+  if (report_ != nullptr) {
+    lines_ = writer_.AppendedLines();
+    bytes_ = writer_.AppendedBytes();
+  }
+}
+
+SizeScope::~SizeScope() {
+  if (report_ != nullptr) {
+    report_->Add(backend_, type_, method_, section_, writer_.AppendedLines() - lines_,
+                 writer_.AppendedBytes() - bytes_);
+  }
+}
+
+void CountWrittenBytes(size_t size) {
+  thread_written_bytes += size;
+}
+
+uint64_t ThreadWrittenBytes() {
+  return thread_written_bytes;
+}
+
+void CountAllocation(size_t size) {
+  thread_allocations++;
+  thread_allocated_bytes += size;
+}
+
+uint64_t ThreadAllocatedBytes() {
+  return thread_allocated_bytes;
+}
+
+}  // namespace aidl
+}  // namespace android
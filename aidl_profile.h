@@ -0,0 +1,240 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <android-base/macros.h>
+
+class AidlAnnotatable;
+class AidlConstantValue;
+class AidlDefinedType;
+class AidlMethod;
+class AidlTypeSpecifier;
+
+namespace android {
+namespace aidl {
+
+class AidlTypenames;
+class CodeWriter;
+
+// Records how long the phases of the compiler take (see --profile), as
+// spans of the threads that ran them. Only one profile is recorded at a
+// time; while there is none, ProfileScope costs a load and a branch.
+class Profile {
+ public:
+  // Starts recording to this profile.
+  Profile();
+  // Stops recording.
+  ~Profile();
+
+  // The profile that is being recorded, if any.
+  static Profile* Current();
+
+  // Writes the spans as Chrome trace-event JSON, which chrome://tracing and
+  // Perfetto open.
+  void WriteTrace(CodeWriter* writer) const;
+
+ private:
+  friend class ProfileScope;
+
+  struct Span {
+    const char* name;
+    std::string file;
+    uint32_t thread;
+    int64_t begin_us;
+    int64_t duration_us;
+    uint64_t allocations;
+    uint64_t allocated_bytes;
+  };
+
+  void Add(Span span);
+
+  const std::chrono::steady_clock::time_point start_;
+  mutable std::mutex mutex_;
+  std::vector<Span> spans_;
+
+  DISALLOW_COPY_AND_ASSIGN(Profile);
+};
+
+// Records the enclosing scope as a span named |name| of the current
+// profile. |file| is the input file or the type the span is about, if any.
+class ProfileScope {
+ public:
+  explicit ProfileScope(const char* name, std::string_view file = {});
+  ~ProfileScope();
+
+ private:
+  Profile* const profile_;
+  const char* name_ = nullptr;
+  std::string file_;
+  std::chrono::steady_clock::time_point begin_;
+  uint64_t allocations_ = 0;
+  uint64_t allocated_bytes_ = 0;
+
+  DISALLOW_COPY_AND_ASSIGN(ProfileScope);
+};
+
+// Records the sizes of a compilation (see --stats): the AST nodes of the
+// loaded types by class, the input files, the bytes generated for each
+// backend and the peak RSS of the process after each phase. Like a Profile,
+// only one is recorded at a time, and the hooks do nothing while there is
+// none.
+class Stats {
+ public:
+  Stats();
+  ~Stats();
+
+  // The stats that are being recorded, if any.
+  static Stats* Current();
+
+  // Counts the nodes of the types that |typenames| has loaded, and the bytes
+  // of its arena, which hold the nodes and their sources.
+  void AddTypes(const AidlTypenames& typenames);
+  void AddSource(std::string_view file, size_t size);
+  void AddOutput(std::string_view backend, uint64_t bytes);
+  void EndPhase(const char* phase);
+
+  // Writes the stats as a JSON object.
+  void WriteJson(CodeWriter* writer) const;
+
+ private:
+  struct NodeCount {
+    uint64_t count = 0;
+    // The bytes of the node objects, not of the strings and vectors that
+    // they own.
+    uint64_t bytes = 0;
+  };
+
+  // These are called with |mutex_| held.
+  void CountNode(const char* node_class, size_t size);
+  void CountAnnotations(const AidlAnnotatable& annotatable);
+  void CountTypeSpecifier(const AidlTypeSpecifier& type);
+  void CountConstantValue(const AidlConstantValue& value);
+  void CountType(const AidlDefinedType& type);
+
+  mutable std::mutex mutex_;
+  std::map<std::string, NodeCount, std::less<>> nodes_;
+  std::map<std::string, uint64_t, std::less<>> sources_;
+  std::map<std::string, uint64_t, std::less<>> outputs_;
+  std::vector<std::pair<const char*, uint64_t>> phases_;  // and their peak RSS
+  uint64_t arena_bytes_ = 0;
+
+  DISALLOW_COPY_AND_ASSIGN(Stats);
+};
+
+// Records the end of the enclosing scope as the end of the phase |name|
+// of the current stats.
+class StatsPhase {
+ public:
+  explicit StatsPhase(const char* name) : stats_(Stats::Current()), name_(name) {}
+  ~StatsPhase();
+
+ private:
+  Stats* const stats_;
+  const char* const name_;
+
+  DISALLOW_COPY_AND_ASSIGN(StatsPhase);
+};
+
+// Records the lines and the bytes of the code that the backends generate
+// for each defined type and method, by section (see --size-report): the
+// proxy, the stub and the default implementation of a method, the parcel
+// reading and writing of a type, and the logging of a method, which is part
+// of its proxy and stub. Like a Stats, only one is recorded at a time, and
+// the hooks do nothing while there is none.
+class SizeReport {
+ public:
+  SizeReport();
+  ~SizeReport();
+
+  // The report that is being recorded, if any.
+  static SizeReport* Current();
+
+  // Adds |code| to |section| of |method| of |type|; |method| is null for the
+  // sections of the type itself.
+  void Add(std::string_view backend, const AidlDefinedType& type, const AidlMethod* method,
+           std::string_view section, std::string_view code);
+  void Add(std::string_view backend, const AidlDefinedType& type, const AidlMethod* method,
+           std::string_view section, uint64_t lines, uint64_t bytes);
+
+  // Writes the sizes as a JSON object with a flat list of them, which is
+  // summed up across modules easily.
+  void WriteJson(CodeWriter* writer) const;
+
+ private:
+  struct Key {
+    std::string backend;
+    std::string type;
+    std::string method;
+    std::string section;
+    bool operator<(const Key& other) const;
+  };
+  struct Size {
+    uint64_t lines = 0;
+    uint64_t bytes = 0;
+  };
+
+  mutable std::mutex mutex_;
+  std::map<Key, Size> sizes_;
+
+  DISALLOW_COPY_AND_ASSIGN(SizeReport);
+};
+
+// Adds what is appended to |writer| in the enclosing scope to |section| of
+// the current size report.
+class SizeScope {
+ public:
+  SizeScope(const CodeWriter& writer, const char* backend, const AidlDefinedType& type,
+            const AidlMethod* method, const char* section);
+  ~SizeScope();
+
+ private:
+  SizeReport* const report_;
+  const CodeWriter& writer_;
+  const char* const backend_;
+  const AidlDefinedType& type_;
+  const AidlMethod* const method_;
+  const char* const section_;
+  uint64_t lines_ = 0;
+  uint64_t bytes_ = 0;
+
+  DISALLOW_COPY_AND_ASSIGN(SizeScope);
+};
+
+// Counts |size| bytes written to an output file on the current thread, see
+// CodeWriter::CountAsOutput().
+void CountWrittenBytes(size_t size);
+
+// Bytes written by the current thread so far, as counted by CountWrittenBytes().
+uint64_t ThreadWrittenBytes();
+
+// Counts an allocation of |size| bytes by the current thread. The aidl
+// binary calls this from its operator new; elsewhere allocations count as 0.
+void CountAllocation(size_t size);
+
+// Bytes allocated by the current thread so far, as counted by CountAllocation().
+uint64_t ThreadAllocatedBytes();
+
+}  // namespace aidl
+}  // namespace android
@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "aidl_scandeps.h"
+
+#include <ctype.h>
+
+#include <map>
+#include <set>
+
+#include "aidl_language.h"
+#include "aidl_profile.h"
+#include "aidl_typenames.h"
+#include "import_resolver.h"
+#include "logging.h"
+
+using std::map;
+using std::set;
+using std::string;
+using std::vector;
+
+namespace android {
+namespace aidl {
+
+namespace internals {
+
+vector<string> scan_needed_names(const string& contents) {
+  vector<string> names;
+  set<string> seen;
+  const size_t size = contents.size();
+  auto is_identifier_start = [](char c) {
+    return isalpha(static_cast<unsigned char>(c)) || c == '_';
+  };
+  auto is_identifier_part = [](char c) {
+    return isalnum(static_cast<unsigned char>(c)) || c == '_';
+  };
+
+  // Set by "package" and "import", whose name follows.
+  enum { NONE, PACKAGE, IMPORT } statement = NONE;
+  size_t i = 0;
+  while (i < size) {
+    const char c = contents[i];
+    if (c == '/' && i + 1 < size && contents[i + 1] == '/') {
+      i = contents.find('\n', i);
+      i = i == string::npos ? size : i + 1;
+    } else if (c == '/' && i + 1 < size && contents[i + 1] == '*') {
+      i = contents.find("*/", i + 2);
+      i = i == string::npos ? size : i + 2;
+    } else if (c == '"' || c == '\'') {
+      for (i++; i < size && contents[i] != c; i++) {
+        if (contents[i] == '\\') i++;
+      }
+      i++;
+    } else if (isdigit(static_cast<unsigned char>(c))) {
+      // Numbers may contain '.' and letters, e.g. 1.5e3f or 0xFFL.
+      while (i < size && (is_identifier_part(contents[i]) || contents[i] == '.')) i++;
+    } else if (is_identifier_start(c)) {
+      const size_t begin = i;
+      while (i < size && is_identifier_part(contents[i])) {
+        i++;
+        if (i + 1 < size && contents[i] == '.' && is_identifier_start(contents[i + 1])) i++;
+      }
+      const string name = contents.substr(begin, i - begin);
+      if (statement == NONE && (name == "package" || name == "import")) {
+        statement = name == "package" ? PACKAGE : IMPORT;
+        continue;
+      }
+      const bool needed =
+          (statement == IMPORT || (statement == NONE && name.find('.') != string::npos)) &&
+          !AidlTypenames::IsBuiltinTypename(name);
+      if (needed && seen.insert(name).second) {
+        names.push_back(name);
+      }
+      statement = NONE;
+    } else {
+      i++;
+    }
+  }
+  return names;
+}
+
+}  // namespace internals
+
+bool scan_deps(const Options& options, const IoDelegate& io_delegate) {
+  ProfileScope profile_scope("scan deps");
+  // The resolver reports duplicate files for the file being scanned.
+  string scanned_file;
+  ImportResolver import_resolver{io_delegate, scanned_file, options.ImportDirs(),
+                                 options.InputFiles()};
+
+  // The files that each scanned file imports directly
+  map<string, vector<string>> direct_imports;
+  bool success = true;
+  auto imports_of = [&](const string& file) -> const vector<string>& {
+    auto it = direct_imports.find(file);
+    if (it != direct_imports.end()) {
+      return it->second;
+    }
+    vector<string>& imports = direct_imports[file];
+    ProfileScope scope("scan", file);
+    auto contents = io_delegate.GetFileContents(file);
+    if (contents == nullptr) {
+      AIDL_ERROR(file) << "Error reading file.";
+      success = false;
+      return imports;
+    }
+    scanned_file = file;
+    for (const string& name : internals::scan_needed_names(*contents)) {
+      string import_file = import_resolver.FindImportFile(name);
+      if (!import_file.empty() && import_file != file) {
+        imports.push_back(std::move(import_file));
+      }
+    }
+    return imports;
+  };
+
+  const string dep_file = options.DependencyFile().empty() ? "-" : options.DependencyFile();
+  CodeWriterPtr writer = io_delegate.GetCodeWriter(dep_file);
+  if (writer == nullptr) {
+    LOG(ERROR) << "Could not open dependency file: " << dep_file;
+    return false;
+  }
+  for (const string& input : options.InputFiles()) {
+    // The transitive imports, in the order in which they are found
+    vector<string> closure;
+    set<string> visited = {input};
+    vector<string> pending = {input};
+    for (size_t next = 0; next < pending.size(); next++) {
+      const string file = pending[next];
+      for (const string& import : imports_of(file)) {
+        if (visited.insert(import).second) {
+          closure.push_back(import);
+          pending.push_back(import);
+        }
+      }
+    }
+    // As in the dependency files of compilations
+    for (const string& file : options.PrecompiledFiles()) {
+      closure.push_back(file);
+    }
+    for (const string& file : options.ImportFiles()) {
+      closure.push_back(file);
+    }
+    writer->Write("%s :", input.c_str());
+    for (const string& file : closure) {
+      writer->Write(" %s", file.c_str());
+    }
+    writer->Write("\n");
+  }
+  return writer->Close() && success;
+}
+
+}  // namespace aidl
+}  // namespace android
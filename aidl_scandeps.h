@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "io_delegate.h"
+#include "options.h"
+
+namespace android {
+namespace aidl {
+
+// Writes "INPUT : FILE..." for each input file, listing the files it imports
+// directly or through other imports, to the dependency file or stdout. The
+// files are only scanned for the names they need; nothing is parsed or
+// validated, so errors in the files are left to the compilation.
+bool scan_deps(const Options& options, const IoDelegate& io_delegate);
+
+namespace internals {
+
+// The qualified names that AIDL source |contents| may need: those of its import
+// statements and the qualified names in its body, which are imported without
+// an import statement. Comments and literals are skipped.
+std::vector<std::string> scan_needed_names(const std::string& contents);
+
+}  // namespace internals
+}  // namespace aidl
+}  // namespace android
@@ -0,0 +1,268 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "aidl_server.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <iostream>
+
+#include <android-base/file.h>
+#include <android-base/parseint.h>
+#include <android-base/unique_fd.h>
+
+#include "aidl_language.h"
+#include "logging.h"
+
+using android::base::ReadFdToString;
+using android::base::unique_fd;
+using android::base::WriteStringToFd;
+using std::string;
+using std::vector;
+
+namespace android {
+namespace aidl {
+
+namespace {
+
+bool MakeAddress(const string& socket_path, sockaddr_un* addr) {
+  memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  if (socket_path.size() >= sizeof(addr->sun_path)) {
+    return false;
+  }
+  strcpy(addr->sun_path, socket_path.c_str());
+  return true;
+}
+
+// Splits a request into the NUL-terminated fields it consists of.
+vector<string> SplitRequest(const string& request) {
+  vector<string> fields;
+  size_t begin = 0;
+  for (size_t end = request.find('\0'); end != string::npos; end = request.find('\0', begin)) {
+    fields.emplace_back(request, begin, end - begin);
+    begin = end + 1;
+  }
+  return fields;
+}
+
+// How long the server waits for a client to send its request, and to take
+// the response, before it gives up on it: the jobs run one at a time, so a
+// stuck client would hold up all the others.
+constexpr int kClientTimeoutSeconds = 10;
+
+bool SetTimeouts(int fd) {
+  timeval timeout = {.tv_sec = kClientTimeoutSeconds, .tv_usec = 0};
+  return setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) == 0 &&
+         setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) == 0;
+}
+
+// Points the file descriptor |target|, stdout or stderr, at a temporary file
+// while it lives. Everything that a job writes there, through std::cout and
+// std::cerr, stdio or LOG(), goes to the file rather than to the terminal of
+// the server.
+class CapturedFd {
+ public:
+  explicit CapturedFd(int target) : target_(target) {
+    Flush();
+    file_ = tmpfile();
+    saved_.reset(dup(target_));
+    if (file_ == nullptr || !saved_.ok() || dup2(fileno(file_), target_) < 0) {
+      saved_.reset();
+    }
+  }
+  ~CapturedFd() { Restore(); }
+
+  // Whether |target| was pointed at the file
+  bool ok() const { return saved_.ok(); }
+
+  // Points |target| back where it was, and returns what was written to it.
+  string Release() {
+    Restore();
+    string contents;
+    if (file_ != nullptr) {
+      if (lseek(fileno(file_), 0, SEEK_SET) == 0) {
+        ReadFdToString(fileno(file_), &contents);
+      }
+      fclose(file_);
+      file_ = nullptr;
+    }
+    return contents;
+  }
+
+ private:
+  static void Flush() {
+    std::cout.flush();
+    std::cerr.flush();
+    fflush(stdout);
+    fflush(stderr);
+  }
+
+  void Restore() {
+    if (saved_.ok()) {
+      Flush();
+      dup2(saved_.get(), target_);
+      saved_.reset();
+    }
+  }
+
+  const int target_;
+  FILE* file_ = nullptr;
+  unique_fd saved_;
+};
+
+int RunJob(const vector<string>& request, const JobHandler& handler) {
+  if (request.size() < 2) {
+    AIDL_ERROR("request") << "Expected a directory and a command line";
+    return 1;
+  }
+  if (chdir(request[0].c_str()) != 0) {
+    AIDL_ERROR(request[0]) << "Can't change to the directory of the client: " << strerror(errno);
+    return 1;
+  }
+  ::AidlError::clearError();
+  return handler(vector<string>(request.begin() + 1, request.end()));
+}
+
+}  // namespace
+
+int run_server(const string& socket_path, const JobHandler& handler) {
+  sockaddr_un addr;
+  if (!MakeAddress(socket_path, &addr)) {
+    AIDL_ERROR(socket_path) << "Socket path is too long";
+    return 1;
+  }
+  unique_fd server(socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0));
+  // A socket that is left over from a previous server is replaced.
+  unlink(socket_path.c_str());
+  if (!server.ok() || bind(server.get(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+      listen(server.get(), SOMAXCONN) != 0) {
+    AIDL_ERROR(socket_path) << "Can't listen on the socket: " << strerror(errno);
+    return 1;
+  }
+  // A client that goes away must not take the server with it.
+  signal(SIGPIPE, SIG_IGN);
+
+  while (true) {
+    unique_fd client(TEMP_FAILURE_RETRY(accept4(server.get(), nullptr, nullptr, SOCK_CLOEXEC)));
+    if (!client.ok()) {
+      AIDL_ERROR(socket_path) << "Can't accept a client: " << strerror(errno);
+      return 1;
+    }
+    string request;
+    if (!SetTimeouts(client.get()) || !ReadFdToString(client.get(), &request)) {
+      continue;
+    }
+
+    // Everything the job writes to stdout and stderr goes back to the client.
+    string out;
+    string err;
+    int status = 1;
+    {
+      CapturedFd captured_out(STDOUT_FILENO);
+      CapturedFd captured_err(STDERR_FILENO);
+      const bool captured = captured_out.ok() && captured_err.ok();
+      if (captured) {
+        status = RunJob(SplitRequest(request), handler);
+      }
+      err = captured_err.Release();
+      out = captured_out.Release();
+      if (!captured) {
+        err += "aidl: the server can't capture the output of the job\n";
+      }
+    }
+
+    WriteStringToFd(std::to_string(status) + " " + std::to_string(out.size()) + "\n" + out + err,
+                    client.get());
+  }
+}
+
+int run_server_job(const vector<string>& args, Options::Language default_lang,
+                   const std::function<int(const Options&)>& run) {
+  vector<const char*> argv;
+  for (const string& arg : args) {
+    argv.push_back(arg.c_str());
+  }
+  argv.push_back(nullptr);
+  Options options(args.size(), argv.data(), default_lang);
+  if (options.UsageRequested()) {
+    std::cerr << options.GetUsage();
+    return 0;
+  }
+  if (!options.Ok() || options.GetTask() == Options::Task::SERVER ||
+      options.GetTask() == Options::Task::JOBS) {
+    std::cerr << options.GetErrorMessage();
+    return 1;
+  }
+  return run(options);
+}
+
+bool run_client(const string& socket_path, const vector<string>& args, int* status) {
+  sockaddr_un addr;
+  if (!MakeAddress(socket_path, &addr)) {
+    return false;
+  }
+  unique_fd server(socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0));
+  if (!server.ok() ||
+      TEMP_FAILURE_RETRY(connect(server.get(), reinterpret_cast<sockaddr*>(&addr),
+                                 sizeof(addr))) != 0) {
+    return false;
+  }
+
+  char dir[PATH_MAX];
+  if (getcwd(dir, sizeof(dir)) == nullptr) {
+    return false;
+  }
+  string request(dir);
+  request.push_back('\0');
+  for (const string& arg : args) {
+    request += arg;
+    request.push_back('\0');
+  }
+  if (!WriteStringToFd(request, server.get()) || shutdown(server.get(), SHUT_WR) != 0) {
+    return false;
+  }
+
+  // A server that dies in the middle of the job doesn't answer at all.
+  string response;
+  if (!ReadFdToString(server.get(), &response)) {
+    return false;
+  }
+  const size_t space = response.find(' ');
+  const size_t newline = response.find('\n');
+  size_t out_size = 0;
+  if (space == string::npos || newline == string::npos || space > newline ||
+      !android::base::ParseInt(response.substr(0, space).c_str(), status) ||
+      !android::base::ParseUint(response.substr(space + 1, newline - space - 1).c_str(),
+                                &out_size) ||
+      out_size > response.size() - newline - 1) {
+    return false;
+  }
+  std::cout << response.substr(newline + 1, out_size) << std::flush;
+  std::cerr << response.substr(newline + 1 + out_size);
+  return true;
+}
+
+}  // namespace aidl
+}  // namespace android
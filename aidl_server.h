@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "options.h"
+
+namespace android {
+namespace aidl {
+
+// A resident compiler runs the jobs of many aidl invocations, so that it
+// starts only once and keeps the files it has parsed (see CompileSession).
+//
+// A job is sent over a Unix socket as the working directory of the client
+// followed by its command line, each terminated by a NUL. The server answers
+// with the exit status and the size of what the job has written to stdout in
+// decimal, separated by a space, and a newline, followed by what the job has
+// written to stdout and then to stderr. A client that doesn't send its whole
+// request, or take the answer, within a few seconds is dropped.
+
+// Runs one job: |args| is the command line, starting with the program name.
+using JobHandler = std::function<int(const std::vector<std::string>& args)>;
+
+// Listens on |socket_path| and runs the jobs that clients send, one at a
+// time, in the working directory of the client. Only returns on errors.
+int run_server(const std::string& socket_path, const JobHandler& handler);
+
+// Parses |args| as main() parses its command line, with |default_lang|, and
+// runs the options with |run|. The jobs that would take over the server,
+// --server and --job-file, are rejected, and --help prints the usage for the
+// client to show rather than exiting.
+int run_server_job(const std::vector<std::string>& args, Options::Language default_lang,
+                   const std::function<int(const Options&)>& run);
+
+// Has the server listening on |socket_path| run |args| and stores the exit
+// status of the job to |status|. Returns false if no server answered, in
+// which case the caller should run the job itself.
+bool run_client(const std::string& socket_path, const std::vector<std::string>& args,
+                int* status);
+
+}  // namespace aidl
+}  // namespace android
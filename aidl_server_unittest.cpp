@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "aidl_server.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "options.h"
+
+using std::string;
+using std::vector;
+using testing::internal::CaptureStderr;
+using testing::internal::GetCapturedStderr;
+
+namespace android {
+namespace aidl {
+
+TEST(AidlServerTest, KeepsRunningAfterAJobAsksForTheUsage) {
+  char dir[] = "/tmp/aidl_server_test_XXXXXX";
+  ASSERT_NE(nullptr, mkdtemp(dir));
+  const string socket_path = string(dir) + "/socket";
+
+  // The server never returns, so its thread outlives the test.
+  struct Jobs {
+    std::mutex mutex;
+    vector<vector<string>> inputs;
+  };
+  auto jobs = std::make_shared<Jobs>();
+  std::thread([socket_path, jobs]() {
+    run_server(socket_path, [jobs](const vector<string>& args) {
+      return run_server_job(args, Options::Language::JAVA, [&](const Options& options) {
+        std::lock_guard<std::mutex> lock(jobs->mutex);
+        jobs->inputs.push_back(options.InputFiles());
+        return 3;
+      });
+    });
+  }).detach();
+
+  int status = -1;
+  CaptureStderr();
+  bool answered = false;
+  for (int attempt = 0; attempt < 200 && !answered; attempt++) {
+    answered = run_client(socket_path, {"aidl", "--help"}, &status);
+    if (!answered) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+  }
+  const string usage = GetCapturedStderr();
+  ASSERT_TRUE(answered);
+  EXPECT_EQ(0, status);
+  EXPECT_EQ(0u, usage.rfind("usage:", 0)) << usage;
+
+  ASSERT_TRUE(run_client(socket_path, {"aidl", "--lang=java", "-o", "out", "IFoo.aidl"}, &status));
+  EXPECT_EQ(3, status);
+  {
+    std::lock_guard<std::mutex> lock(jobs->mutex);
+    EXPECT_EQ((vector<vector<string>>{{"IFoo.aidl"}}), jobs->inputs);
+  }
+
+  unlink(socket_path.c_str());
+  rmdir(dir);
+}
+
+}  // namespace aidl
+}  // namespace android
@@ -21,7 +21,9 @@
 #include <android-base/stringprintf.h>
 #include <android-base/strings.h>
 
+#include <algorithm>
 #include <functional>
+#include <string_view>
 #include <unordered_map>
 
 using android::base::Join;
@@ -36,32 +38,30 @@ namespace cpp {
 namespace {
 std::string RawParcelMethod(const AidlTypeSpecifier& raw_type, const AidlTypenames& typenames,
                             bool readMethod) {
-  static map<string, string> kBuiltin = {
-      {"byte", "Byte"},
-      {"boolean", "Bool"},
-      {"char", "Char"},
-      {"double", "Double"},
-      {"FileDescriptor", "UniqueFileDescriptor"},
-      {"float", "Float"},
-      {"IBinder", "StrongBinder"},
-      {"int", "Int32"},
-      {"long", "Int64"},
-      {"ParcelFileDescriptor", "Parcelable"},
-      {"String", "String16"},
-  };
-
-  static map<string, string> kBuiltinVector = {
-      {"FileDescriptor", "UniqueFileDescriptorVector"},
-      {"double", "DoubleVector"},
-      {"char", "CharVector"},
-      {"boolean", "BoolVector"},
-      {"byte", "ByteVector"},
-      {"float", "FloatVector"},
-      {"IBinder", "StrongBinderVector"},
-      {"String", "String16Vector"},
-      {"int", "Int32Vector"},
-      {"long", "Int64Vector"},
-      {"ParcelFileDescriptor", "ParcelableVector"},
+  // The methods for a type and for a vector of it.
+  static constexpr AidlBuiltinTable<const char*> kBuiltin = {
+      {AidlBuiltinKind::BYTE, false, "Byte"},
+      {AidlBuiltinKind::BYTE, true, "ByteVector"},
+      {AidlBuiltinKind::BOOLEAN, false, "Bool"},
+      {AidlBuiltinKind::BOOLEAN, true, "BoolVector"},
+      {AidlBuiltinKind::CHAR, false, "Char"},
+      {AidlBuiltinKind::CHAR, true, "CharVector"},
+      {AidlBuiltinKind::DOUBLE, false, "Double"},
+      {AidlBuiltinKind::DOUBLE, true, "DoubleVector"},
+      {AidlBuiltinKind::FILE_DESCRIPTOR, false, "UniqueFileDescriptor"},
+      {AidlBuiltinKind::FILE_DESCRIPTOR, true, "UniqueFileDescriptorVector"},
+      {AidlBuiltinKind::FLOAT, false, "Float"},
+      {AidlBuiltinKind::FLOAT, true, "FloatVector"},
+      {AidlBuiltinKind::IBINDER, false, "StrongBinder"},
+      {AidlBuiltinKind::IBINDER, true, "StrongBinderVector"},
+      {AidlBuiltinKind::INT, false, "Int32"},
+      {AidlBuiltinKind::INT, true, "Int32Vector"},
+      {AidlBuiltinKind::LONG, false, "Int64"},
+      {AidlBuiltinKind::LONG, true, "Int64Vector"},
+      {AidlBuiltinKind::PARCEL_FILE_DESCRIPTOR, false, "Parcelable"},
+      {AidlBuiltinKind::PARCEL_FILE_DESCRIPTOR, true, "ParcelableVector"},
+      {AidlBuiltinKind::STRING, false, "String16"},
+      {AidlBuiltinKind::STRING, true, "String16Vector"},
   };
 
   const bool nullable = raw_type.IsNullable();
@@ -70,6 +70,7 @@ std::string RawParcelMethod(const AidlTypeSpecifier& raw_type, const AidlTypenam
   const bool utf8 = raw_type.IsUtf8InCpp();
   const auto& type = raw_type.IsGeneric() ? *raw_type.GetTypeParameters().at(0) : raw_type;
   const string& aidl_name = type.GetName();
+  const std::optional<AidlBuiltinKind> kind = type.GetBuiltinKind();
 
   if (auto enum_decl = typenames.GetEnumDeclaration(raw_type); enum_decl != nullptr) {
     if (isVector) {
@@ -79,32 +80,27 @@ std::string RawParcelMethod(const AidlTypeSpecifier& raw_type, const AidlTypenam
     }
   }
 
-  if (isVector) {
-    if (kBuiltinVector.find(aidl_name) != kBuiltinVector.end()) {
-      CHECK(AidlTypenames::IsBuiltinTypename(aidl_name));
+  if (const char* const* method = kBuiltin.Find(kind, isVector); method != nullptr) {
+    if (isVector) {
       if (utf8) {
-        CHECK(aidl_name == "String");
+        CHECK(kind == AidlBuiltinKind::STRING);
         return readMethod ? "Utf8VectorFromUtf16Vector" : "Utf8VectorAsUtf16Vector";
       }
-      return kBuiltinVector[aidl_name];
-    }
-  } else {
-    if (kBuiltin.find(aidl_name) != kBuiltin.end()) {
-      CHECK(AidlTypenames::IsBuiltinTypename(aidl_name));
-      if (aidl_name == "IBinder" && nullable && readMethod) {
+    } else {
+      if (kind == AidlBuiltinKind::IBINDER && nullable && readMethod) {
         return "NullableStrongBinder";
       }
-      if (aidl_name == "ParcelFileDescriptor" && nullable && !readMethod) {
+      if (kind == AidlBuiltinKind::PARCEL_FILE_DESCRIPTOR && nullable && !readMethod) {
         return "NullableParcelable";
       }
       if (utf8) {
-        CHECK(aidl_name == "String");
+        CHECK(kind == AidlBuiltinKind::STRING);
         return readMethod ? "Utf8FromUtf16" : "Utf8AsUtf16";
       }
-      return kBuiltin[aidl_name];
     }
+    return *method;
   }
-  CHECK(!AidlTypenames::IsBuiltinTypename(aidl_name));
+  CHECK(!kind) << aidl_name;
   auto definedType = typenames.TryGetDefinedType(type.GetName());
   if (definedType != nullptr && definedType->AsInterface() != nullptr) {
     if (isVector) {
@@ -134,54 +130,82 @@ std::string GetRawCppName(const AidlTypeSpecifier& type) {
   return "::" + Join(type.GetSplitName(), "::");
 }
 
-std::string WrapIfNullable(const std::string type_str, const AidlTypeSpecifier& raw_type,
-                           const AidlTypenames& typenames) {
+// Whether a @nullable |raw_type| is held in a ::std::unique_ptr or a
+// ::std::optional, and not as it is like the IBinders
+bool IsWrappedIfNullable(const AidlTypeSpecifier& raw_type, const AidlTypenames& typenames) {
   const auto& type = raw_type.IsGeneric() ? (*raw_type.GetTypeParameters().at(0)) : raw_type;
 
-  if (raw_type.IsNullable() && !AidlTypenames::IsPrimitiveTypename(type.GetName()) &&
-      type.GetName() != "IBinder" && typenames.GetEnumDeclaration(type) == nullptr) {
-    return "::std::unique_ptr<" + type_str + ">";
+  return !AidlTypenames::IsPrimitiveTypename(type.GetName()) && type.GetName() != "IBinder" &&
+         typenames.GetEnumDeclaration(type) == nullptr;
+}
+
+std::string WrapIfNullable(const std::string type_str, const AidlTypeSpecifier& raw_type,
+                           const AidlTypenames& typenames, bool optional) {
+  if (raw_type.IsNullable() && IsWrappedIfNullable(raw_type, typenames)) {
+    return (optional ? "::std::optional<" : "::std::unique_ptr<") + type_str + ">";
   }
   return type_str;
 }
 
-std::string GetCppName(const AidlTypeSpecifier& raw_type, const AidlTypenames& typenames) {
+std::string GetCppName(const AidlTypeSpecifier& raw_type, const AidlTypenames& typenames,
+                       bool optional) {
   // map from AIDL built-in type name to the corresponding Cpp type name
-  static map<string, string> m = {
-      {"boolean", "bool"},
-      {"byte", "int8_t"},
-      {"char", "char16_t"},
-      {"double", "double"},
-      {"FileDescriptor", "::android::base::unique_fd"},
-      {"float", "float"},
-      {"IBinder", "::android::sp<::android::IBinder>"},
-      {"int", "int32_t"},
-      {"long", "int64_t"},
-      {"ParcelFileDescriptor", "::android::os::ParcelFileDescriptor"},
-      {"String", "::android::String16"},
-      {"void", "void"},
+  static constexpr AidlBuiltinTable<const char*> m = {
+      {AidlBuiltinKind::BOOLEAN, false, "bool"},
+      {AidlBuiltinKind::BYTE, false, "int8_t"},
+      {AidlBuiltinKind::CHAR, false, "char16_t"},
+      {AidlBuiltinKind::DOUBLE, false, "double"},
+      {AidlBuiltinKind::FILE_DESCRIPTOR, false, "::android::base::unique_fd"},
+      {AidlBuiltinKind::FLOAT, false, "float"},
+      {AidlBuiltinKind::IBINDER, false, "::android::sp<::android::IBinder>"},
+      {AidlBuiltinKind::INT, false, "int32_t"},
+      {AidlBuiltinKind::LONG, false, "int64_t"},
+      {AidlBuiltinKind::PARCEL_FILE_DESCRIPTOR, false, "::android::os::ParcelFileDescriptor"},
+      {AidlBuiltinKind::STRING, false, "::android::String16"},
+      {AidlBuiltinKind::VOID, false, "void"},
   };
 
   CHECK(!raw_type.IsGeneric() ||
         (raw_type.GetName() == "List" && raw_type.GetTypeParameters().size() == 1));
   const auto& type = raw_type.IsGeneric() ? (*raw_type.GetTypeParameters().at(0)) : raw_type;
-  const string& aidl_name = type.GetName();
-  if (m.find(aidl_name) != m.end()) {
-    CHECK(AidlTypenames::IsBuiltinTypename(aidl_name));
-    if (aidl_name == "byte" && type.IsArray()) {
+  const std::optional<AidlBuiltinKind> kind = type.GetBuiltinKind();
+  if (const char* const* name = m.Find(kind, false); name != nullptr) {
+    if (kind == AidlBuiltinKind::BYTE && type.IsArray()) {
       return "uint8_t";
     } else if (raw_type.IsUtf8InCpp()) {
-      CHECK(aidl_name == "String");
-      return WrapIfNullable("::std::string", raw_type, typenames);
+      CHECK(kind == AidlBuiltinKind::STRING);
+      return WrapIfNullable("::std::string", raw_type, typenames, optional);
     }
-    return WrapIfNullable(m[aidl_name], raw_type, typenames);
+    return WrapIfNullable(*name, raw_type, typenames, optional);
   }
   auto definedType = typenames.TryGetDefinedType(type.GetName());
   if (definedType != nullptr && definedType->AsInterface() != nullptr) {
     return "::android::sp<" + GetRawCppName(type) + ">";
   }
 
-  return WrapIfNullable(GetRawCppName(type), raw_type, typenames);
+  return WrapIfNullable(GetRawCppName(type), raw_type, typenames, optional);
+}
+
+std::string CppNameOf(const AidlTypeSpecifier& type, const AidlTypenames& typenames,
+                      bool optional) {
+  if (type.IsArray() || type.IsGeneric()) {
+    std::string cpp_name = GetCppName(type, typenames, optional);
+    if (type.IsArrayView()) {
+      return "::android::aidl::ArrayView<" + cpp_name + ">";
+    }
+    if (type.IsFixedSizeArray()) {
+      return "::std::array<" + cpp_name + ", " + std::to_string(type.FixedArraySize()) + ">";
+    }
+    if (type.IsNullable()) {
+      return (optional ? "::std::optional<::std::vector<" : "::std::unique_ptr<::std::vector<") +
+             cpp_name + ">>";
+    }
+    return "::std::vector<" + cpp_name + ">";
+  }
+  if (type.IsStringView()) {
+    return "::std::string_view";
+  }
+  return GetCppName(type, typenames, optional);
 }
 }  // namespace
 std::string ConstantValueDecorator(const AidlTypeSpecifier& type, const std::string& raw_value) {
@@ -209,14 +233,31 @@ std::string GetTransactionIdFor(const AidlMethod& method) {
 }
 
 std::string CppNameOf(const AidlTypeSpecifier& type, const AidlTypenames& typenames) {
+  return type.Memoized(AidlTypeSpecifier::Memo::CPP_NAME,
+                       [&]() { return CppNameOf(type, typenames, false /* optional */); });
+}
+
+std::string CppNameOf(const AidlTypeSpecifier& type, const AidlTypenames& typenames,
+                      const Options& options) {
+  if (!options.NullableAsOptional()) {
+    return CppNameOf(type, typenames);
+  }
+  return type.Memoized(AidlTypeSpecifier::Memo::CPP_OPTIONAL_NAME,
+                       [&]() { return CppNameOf(type, typenames, true /* optional */); });
+}
+
+std::string CppPmrNameOf(const AidlTypeSpecifier& type, const AidlTypenames& typenames) {
+  const auto& element = type.IsGeneric() ? (*type.GetTypeParameters().at(0)) : type;
+  const std::string cpp_name = element.GetName() == "String"
+                                   ? "::std::pmr::string"
+                                   : GetCppName(type, typenames, false /* optional */);
+  if (type.IsFixedSizeArray()) {
+    return CppNameOf(type, typenames);
+  }
   if (type.IsArray() || type.IsGeneric()) {
-    std::string cpp_name = GetCppName(type, typenames);
-    if (type.IsNullable()) {
-      return "::std::unique_ptr<::std::vector<" + cpp_name + ">>";
-    }
-    return "::std::vector<" + cpp_name + ">";
+    return "::std::pmr::vector<" + cpp_name + ">";
   }
-  return GetCppName(type, typenames);
+  return cpp_name;
 }
 
 bool IsNonCopyableType(const AidlTypeSpecifier& type, const AidlTypenames& typenames) {
@@ -224,7 +265,7 @@ bool IsNonCopyableType(const AidlTypeSpecifier& type, const AidlTypenames& typen
     return false;
   }
 
-  const std::string cpp_name = GetCppName(type, typenames);
+  const std::string cpp_name = GetCppName(type, typenames, false /* optional */);
   if (cpp_name == "::android::base::unique_fd") {
     return true;
   }
@@ -232,7 +273,9 @@ bool IsNonCopyableType(const AidlTypeSpecifier& type, const AidlTypenames& typen
 }
 
 std::string ParcelReadMethodOf(const AidlTypeSpecifier& type, const AidlTypenames& typenames) {
-  return "read" + RawParcelMethod(type, typenames, true /* readMethod */);
+  return type.Memoized(AidlTypeSpecifier::Memo::CPP_READ_METHOD, [&]() {
+    return "read" + RawParcelMethod(type, typenames, true /* readMethod */);
+  });
 }
 
 std::string ParcelReadCastOf(const AidlTypeSpecifier& type, const AidlTypenames& typenames,
@@ -248,7 +291,9 @@ std::string ParcelReadCastOf(const AidlTypeSpecifier& type, const AidlTypenames&
 }
 
 std::string ParcelWriteMethodOf(const AidlTypeSpecifier& type, const AidlTypenames& typenames) {
-  return "write" + RawParcelMethod(type, typenames, false /* readMethod */);
+  return type.Memoized(AidlTypeSpecifier::Memo::CPP_WRITE_METHOD, [&]() {
+    return "write" + RawParcelMethod(type, typenames, false /* readMethod */);
+  });
 }
 
 std::string ParcelWriteCastOf(const AidlTypeSpecifier& type, const AidlTypenames& typenames,
@@ -267,7 +312,34 @@ std::string ParcelWriteCastOf(const AidlTypeSpecifier& type, const AidlTypenames
   return variable_name;
 }
 
-void AddHeaders(const AidlTypeSpecifier& raw_type, const AidlTypenames& typenames,
+std::string ParcelSizeOf(const AidlTypeSpecifier& type, const AidlTypenames& typenames,
+                         const std::string& variable_name) {
+  // Every element takes a whole int32 in a Parcel, except those of a byte[]
+  static constexpr AidlBuiltinTable<size_t> sizes{
+      {AidlBuiltinKind::BOOLEAN, false, 4}, {AidlBuiltinKind::BYTE, false, 4},
+      {AidlBuiltinKind::CHAR, false, 4},    {AidlBuiltinKind::INT, false, 4},
+      {AidlBuiltinKind::LONG, false, 8},    {AidlBuiltinKind::FLOAT, false, 4},
+      {AidlBuiltinKind::DOUBLE, false, 8},
+  };
+  const std::optional<AidlBuiltinKind> kind = typenames.GetBackingBuiltinKind(type);
+  const size_t* size = sizes.Find(kind, false);
+  if (size == nullptr || type.IsGeneric() || type.IsSharedMemory()) {
+    return "";
+  }
+  if (!type.IsArray()) {
+    return std::to_string(*size);
+  }
+  const std::string count = type.IsNullable()
+                                ? "(" + variable_name + " ? " + variable_name + "->size() : 0)"
+                                : variable_name + ".size()";
+  if (kind == AidlBuiltinKind::BYTE) {
+    return "(4 + ((" + count + " + 3) & ~size_t{3}))";
+  }
+  return "(4 + " + count + " * " + std::to_string(*size) + ")";
+}
+
+namespace {
+void AddHeaders(const AidlTypeSpecifier& raw_type, const AidlTypenames& typenames, bool optional,
                 std::set<std::string>& headers) {
   bool isVector = raw_type.IsArray() || raw_type.IsGeneric();
   bool isNullable = raw_type.IsNullable();
@@ -278,12 +350,15 @@ void AddHeaders(const AidlTypeSpecifier& raw_type, const AidlTypenames& typename
   const auto& type = raw_type.IsGeneric() ? *raw_type.GetTypeParameters().at(0) : raw_type;
   auto definedType = typenames.TryGetDefinedType(type.GetName());
 
-  if (isVector) {
+  if (raw_type.IsFixedSizeArray()) {
+    headers.insert("array");
+    headers.insert("aidl/fixed_array_parcel.h");
+  } else if (isVector) {
     headers.insert("vector");
   }
   if (isNullable) {
-    if (type.GetName() != "IBinder") {
-      headers.insert("memory");
+    if (type.GetName() != "IBinder" || isVector) {
+      headers.insert(optional ? "optional" : "memory");
     }
   }
   if (type.GetName() == "String") {
@@ -298,9 +373,23 @@ void AddHeaders(const AidlTypeSpecifier& raw_type, const AidlTypenames& typename
   if (type.GetName() == "ParcelFileDescriptor") {
     headers.insert("binder/ParcelFileDescriptor.h");
   }
+  if (raw_type.IsSharedMemory()) {
+    headers.insert("aidl/shared_memory_parcel.h");
+  }
+  if (raw_type.IsArrayView()) {
+    headers.insert("aidl/array_view_parcel.h");
+  }
+  if (raw_type.IsStringView()) {
+    headers.insert("aidl/array_view_parcel.h");
+    headers.insert("string_view");
+  }
+  if (raw_type.IsArray() && typenames.GetEnumDeclaration(raw_type) != nullptr) {
+    headers.insert("aidl/enum_vector_parcel.h");
+  }
 
-  static const std::set<string> need_cstdint{"byte", "int", "long"};
-  if (need_cstdint.find(type.GetName()) != need_cstdint.end()) {
+  static constexpr std::string_view need_cstdint[] = {"byte", "int", "long"};
+  if (std::find(std::begin(need_cstdint), std::end(need_cstdint), type.GetName()) !=
+      std::end(need_cstdint)) {
     headers.insert("cstdint");
   }
 
@@ -309,7 +398,7 @@ void AddHeaders(const AidlTypeSpecifier& raw_type, const AidlTypenames& typename
   }
   if (definedType->AsInterface() != nullptr || definedType->AsStructuredParcelable() != nullptr ||
       definedType->AsEnumDeclaration() != nullptr) {
-    AddHeaders(*definedType, headers);
+    cpp::AddHeaders(*definedType, headers);
   } else if (definedType->AsParcelable() != nullptr) {
     const std::string cpp_header = definedType->AsParcelable()->GetCppHeader();
     AIDL_FATAL_IF(cpp_header.empty(), definedType->AsParcelable())
@@ -319,6 +408,18 @@ void AddHeaders(const AidlTypeSpecifier& raw_type, const AidlTypenames& typename
   }
 }
 
+}  // namespace
+
+void AddHeaders(const AidlTypeSpecifier& type, const AidlTypenames& typenames,
+                std::set<std::string>& headers) {
+  AddHeaders(type, typenames, false /* optional */, headers);
+}
+
+void AddHeaders(const AidlTypeSpecifier& type, const AidlTypenames& typenames,
+                const Options& options, std::set<std::string>& headers) {
+  AddHeaders(type, typenames, options.NullableAsOptional(), headers);
+}
+
 void AddHeaders(const AidlDefinedType& definedType, std::set<std::string>& headers) {
   vector<string> name = definedType.GetSplitPackage();
   name.push_back(definedType.GetName());
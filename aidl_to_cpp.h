@@ -37,7 +37,15 @@ struct CodeGeneratorContext {
 
 std::string GetTransactionIdFor(const AidlMethod& method);
 
+// The C++ type of |type|, where the @nullable types are ::std::unique_ptrs
 std::string CppNameOf(const AidlTypeSpecifier& type, const AidlTypenames& typenames);
+// The C++ type of |type|, where the @nullable types are ::std::optionals with
+// --nullable=optional
+std::string CppNameOf(const AidlTypeSpecifier& type, const AidlTypenames& typenames,
+                      const Options& options);
+// The C++ type of |type|, the type of a field of a @PolymorphicAllocator
+// parcelable, where the arrays, the Lists and the Strings are ::std::pmr types
+std::string CppPmrNameOf(const AidlTypeSpecifier& type, const AidlTypenames& typenames);
 
 bool IsNonCopyableType(const AidlTypeSpecifier& type, const AidlTypenames& typenames);
 
@@ -59,8 +67,18 @@ std::string ParcelWriteMethodOf(const AidlTypeSpecifier& type, const AidlTypenam
 std::string ParcelWriteCastOf(const AidlTypeSpecifier& type, const AidlTypenames& typenames,
                               const std::string& variable_name);
 
+// Returns an expression for the bytes that writing |variable_name| of |type|
+// appends to a Parcel: exact for the primitives and the enums, and from the
+// element count for their arrays. Returns "" for the types it cannot size.
+std::string ParcelSizeOf(const AidlTypeSpecifier& type, const AidlTypenames& typenames,
+                         const std::string& variable_name);
+
+// Adds the headers of |type|, where the @nullable types are ::std::unique_ptrs
 void AddHeaders(const AidlTypeSpecifier& type, const AidlTypenames& typenames,
                 std::set<std::string>& headers);
+// Adds the headers of |type|, as it is named by CppNameOf() with |options|
+void AddHeaders(const AidlTypeSpecifier& type, const AidlTypenames& typenames,
+                const Options& options, std::set<std::string>& headers);
 
 void AddHeaders(const AidlDefinedType& parcelable, std::set<std::string>& headers);
 }  // namespace cpp
@@ -16,8 +16,14 @@
 #include "aidl_to_cpp_common.h"
 
 #include <android-base/strings.h>
-#include <unordered_map>
 
+#include <algorithm>
+#include <map>
+#include <set>
+#include <sstream>
+
+#include "aidl.h"
+#include "aidl_wire_schema.h"
 #include "ast_cpp.h"
 #include "logging.h"
 #include "os.h"
@@ -92,30 +98,30 @@ string BuildVarName(const AidlArgument& a) {
 
 struct TypeInfo {
   // name of the type in C++ output
-  std::string cpp_name;
+  const char* cpp_name;
 
   // function that writes an expression to convert a variable to a Json::Value
   // object
-  std::function<void(CodeWriter& w, const string& var_name, bool isNdk)> toJsonValueExpr;
+  void (*toJsonValueExpr)(CodeWriter& w, const string& var_name, bool isNdk);
 };
 
-const static std::unordered_map<std::string, TypeInfo> kTypeInfoMap = {
-    {"void", {"void", nullptr}},
-    {"boolean",
+static constexpr AidlBuiltinTable<TypeInfo> kTypeInfoMap = {
+    {AidlBuiltinKind::VOID, false, {"void", nullptr}},
+    {AidlBuiltinKind::BOOLEAN, false,
      {
          "bool",
          [](CodeWriter& c, const string& var_name, bool) {
            c << "Json::Value(" << var_name << "? \"true\" : \"false\")";
          },
      }},
-    {"byte",
+    {AidlBuiltinKind::BYTE, false,
      {
          "int8_t",
          [](CodeWriter& c, const string& var_name, bool) {
            c << "Json::Value(" << var_name << ")";
          },
      }},
-    {"char",
+    {AidlBuiltinKind::CHAR, false,
      {
          "char16_t",
          [](CodeWriter& c, const string& var_name, bool isNdk) {
@@ -126,35 +132,35 @@ const static std::unordered_map<std::string, TypeInfo> kTypeInfoMap = {
            }
          },
      }},
-    {"int",
+    {AidlBuiltinKind::INT, false,
      {
          "int32_t",
          [](CodeWriter& c, const string& var_name, bool) {
            c << "Json::Value(" << var_name << ")";
          },
      }},
-    {"long",
+    {AidlBuiltinKind::LONG, false,
      {
          "int64_t",
          [](CodeWriter& c, const string& var_name, bool) {
            c << "Json::Value(static_cast<Json::Int64>(" << var_name << "))";
          },
      }},
-    {"float",
+    {AidlBuiltinKind::FLOAT, false,
      {
          "float",
          [](CodeWriter& c, const string& var_name, bool) {
            c << "Json::Value(" << var_name << ")";
          },
      }},
-    {"double",
+    {AidlBuiltinKind::DOUBLE, false,
      {
          "double",
          [](CodeWriter& c, const string& var_name, bool) {
            c << "Json::Value(" << var_name << ")";
          },
      }},
-    {"String",
+    {AidlBuiltinKind::STRING, false,
      {
          "std::string",
          [](CodeWriter& c, const string& var_name, bool) {
@@ -164,23 +170,14 @@ const static std::unordered_map<std::string, TypeInfo> kTypeInfoMap = {
     // missing List, Map, ParcelFileDescriptor, IBinder
 };
 
-TypeInfo GetTypeInfo(const AidlTypeSpecifier& aidl) {
+const TypeInfo* GetTypeInfo(const AidlTypeSpecifier& aidl) {
   CHECK(aidl.IsResolved()) << aidl.ToString();
-  const string& aidl_name = aidl.GetName();
-
-  TypeInfo info;
-  if (AidlTypenames::IsBuiltinTypename(aidl_name)) {
-    auto it = kTypeInfoMap.find(aidl_name);
-    if (it != kTypeInfoMap.end()) {
-      info = it->second;
-    }
-  }
   // Missing interface and parcelable type
-  return info;
+  return kTypeInfoMap.Find(aidl.GetBuiltinKind(), false);
 }
 
-inline bool CanWriteLog(const TypeInfo& t) {
-  return t.cpp_name != "";
+inline bool CanWriteLog(const TypeInfo* t) {
+  return t != nullptr;
 }
 
 bool CanWriteLog(const AidlTypeSpecifier& aidl) {
@@ -189,20 +186,25 @@ bool CanWriteLog(const AidlTypeSpecifier& aidl) {
 
 void WriteLogFor(CodeWriter& writer, const AidlTypeSpecifier& type, const std::string& name,
                  bool isPointer, const std::string& log, bool isNdk) {
-  const TypeInfo info = GetTypeInfo(type);
+  const TypeInfo* info = GetTypeInfo(type);
   if (!CanWriteLog(info)) {
     return;
   }
 
   const string var_object_expr = ((isPointer ? "*" : "")) + name;
+  if (type.IsStringView()) {
+    // Json::Value takes no string_view
+    writer << log << " = Json::Value(std::string(" << var_object_expr << "));\n";
+    return;
+  }
   if (type.IsArray()) {
     writer << log << " = Json::Value(Json::arrayValue);\n";
     writer << "for (const auto& v: " << var_object_expr << ") " << log << ".append(";
-    info.toJsonValueExpr(writer, "v", isNdk);
+    info->toJsonValueExpr(writer, "v", isNdk);
     writer << ");";
   } else {
     writer << log << " = ";
-    info.toJsonValueExpr(writer, var_object_expr, isNdk);
+    info->toJsonValueExpr(writer, var_object_expr, isNdk);
     writer << ";";
   }
   writer << "\n";
@@ -356,6 +358,656 @@ const string GenLogAfterExecute(const string className, const AidlInterface& int
   return code;
 }
 
+const string GenBinaryLogBeforeExecute() {
+  return "const bool _log_binary = ::android::aidl::binary_log::Enabled();\n"
+         "const int64_t _log_binary_start = "
+         "_log_binary ? ::android::aidl::binary_log::Now() : 0;\n";
+}
+
+const string GenBinaryLogAfterExecute(const AidlInterface& interface, const AidlMethod& method,
+                                      const string& statusVarName, const string& addressExpr,
+                                      const string& inputSizeExpr, const string& outputSizeExpr,
+                                      bool isServer, bool isNdk) {
+  string code;
+  CodeWriterPtr writer = CodeWriter::ForString(&code);
+  (*writer) << "if (_log_binary) {\n";
+  (*writer).Indent();
+  // The fields of ::android::aidl::binary_log::Transaction, in order
+  (*writer) << "::android::aidl::binary_log::Log({\n";
+  (*writer).Indent();
+  (*writer) << "\"" << interface.GetCanonicalName() << "\",\n";
+  (*writer) << "\"" << method.GetName() << "\",\n";
+  (*writer) << addressExpr << ",\n";
+  (*writer) << std::to_string(method.GetId()) << ",\n";
+  (*writer) << "::android::aidl::binary_log::Side::" << (isServer ? "STUB" : "PROXY") << ",\n";
+  (*writer) << "_log_binary_start,\n";
+  (*writer) << "::android::aidl::binary_log::Now(),\n";
+  if (isNdk) {
+    (*writer) << "AStatus_getExceptionCode(" << statusVarName << ".get()),\n";
+    (*writer) << "AStatus_getStatus(" << statusVarName << ".get()),\n";
+    (*writer) << "AStatus_getServiceSpecificError(" << statusVarName << ".get()),\n";
+  } else {
+    (*writer) << statusVarName << ".exceptionCode(),\n";
+    (*writer) << statusVarName << ".transactionError(),\n";
+    (*writer) << statusVarName << ".serviceSpecificErrorCode(),\n";
+  }
+  for (const string& size : {inputSizeExpr, outputSizeExpr}) {
+    (*writer) << (size == "0" ? size : "static_cast<uint32_t>(" + size + ")") << ",\n";
+  }
+  (*writer).Dedent();
+  (*writer) << "});\n";
+  (*writer).Dedent();
+  (*writer) << "}\n";
+  writer->Close();
+  return code;
+}
+
+const string GenCaptureRequest(const AidlInterface& interface, const AidlMethod& method,
+                               const string& codeExpr, const string& dataVarName, bool isNdk) {
+  string code;
+  CodeWriterPtr writer = CodeWriter::ForString(&code);
+  const string args = "\"" + interface.GetCanonicalName() + "\", \"" + method.GetName() +
+                      "\", " + codeExpr + ", " + (method.IsOneway() ? "true" : "false");
+  if (isNdk) {
+    (*writer) << "if (::android::aidl::capture::Enabled()) {\n";
+    (*writer).Indent();
+    (*writer) << "::android::aidl::capture::CaptureParcel(" << args << ", " << dataVarName
+              << ");\n";
+  } else {
+    // The binders and file descriptors of a request cannot be sent again
+    (*writer) << "if (::android::aidl::capture::Enabled() && " << dataVarName
+              << ".objectsCount() == 0) {\n";
+    (*writer).Indent();
+    (*writer) << "::android::aidl::capture::Capture(" << args << ", " << dataVarName
+              << ".data(), " << dataVarName << ".dataSize());\n";
+  }
+  (*writer).Dedent();
+  (*writer) << "}\n";
+  writer->Close();
+  return code;
+}
+
+namespace {
+
+string StatsVarName(const string& clazz) {
+  return "_aidl_" + clazz + "_stats";
+}
+
+// The entry of |method| in the table of GenStatsTable()
+string StatsEntry(const AidlInterface& interface, const AidlMethod& method, const string& clazz) {
+  size_t index = 0;
+  for (const auto& m : interface.GetMethods()) {
+    if (m.get() == &method) break;
+    if (m->IsUserDefined()) index++;
+  }
+  return StatsVarName(clazz) + "[" + std::to_string(index) + "]";
+}
+
+}  // namespace
+
+const string GenStatsTable(const AidlInterface& interface, const string& clazz,
+                           const string& firstCallTransaction) {
+  string code;
+  CodeWriterPtr writer = CodeWriter::ForString(&code);
+  size_t size = 0;
+  for (const auto& method : interface.GetMethods()) {
+    if (!method->IsUserDefined()) continue;
+    if (size++ == 0) {
+      (*writer) << "static ::android::aidl::transaction_stats::MethodStats " << StatsVarName(clazz)
+                << "[] = {\n";
+      (*writer).Indent();
+    }
+    (*writer) << "{\"" << method->GetName() << "\", " << firstCallTransaction << " + "
+              << std::to_string(method->GetId()) << "},\n";
+  }
+  if (size > 0) {
+    (*writer).Dedent();
+    (*writer) << "};\n";
+  }
+  (*writer) << "::android::aidl::transaction_stats::Table " << clazz
+            << "::getTransactionStats() {\n";
+  (*writer).Indent();
+  if (size > 0) {
+    (*writer) << "return {" << StatsVarName(clazz) << ", " << std::to_string(size) << "};\n";
+  } else {
+    (*writer) << "return {nullptr, 0};\n";
+  }
+  (*writer).Dedent();
+  (*writer) << "}\n";
+  writer->Close();
+  return code;
+}
+
+const string GenStatsTimer(const AidlInterface& interface, const AidlMethod& method,
+                           const string& clazz) {
+  return "::android::aidl::transaction_stats::ScopedTimer _aidl_stats_timer(&" +
+         StatsEntry(interface, method, clazz) + ");\n";
+}
+
+const string GenStatsRecordSizes(const AidlInterface& interface, const AidlMethod& method,
+                                 const string& clazz, const string& requestSizeExpr,
+                                 const string& replySizeExpr) {
+  return StatsEntry(interface, method, clazz) + ".RecordSizes(" + requestSizeExpr + ", " +
+         replySizeExpr + ");\n";
+}
+
+const string GenPerfettoTransaction(const AidlInterface& interface, const AidlMethod& method,
+                                    const string& side, const string& code,
+                                    const string& replySizeExpr, const string& statusExpr) {
+  return "::android::aidl::trace_events::ScopedTransaction _aidl_perfetto(\"" +
+         interface.GetName() + "::" + method.GetName() + "::" + side + "\", " + code +
+         ", [&]() {\n"
+         "  return ::android::aidl::trace_events::Reply{static_cast<size_t>(" +
+         replySizeExpr + "), " + statusExpr + "};\n"
+         "});\n";
+}
+
+const string GenPerfettoPhase(const string& phase) {
+  return "_aidl_perfetto.Phase(\"" + phase + "\");\n";
+}
+
+const string GenPerfettoRequestBytes(const string& requestSizeExpr) {
+  return "_aidl_perfetto.SetRequestBytes(" + requestSizeExpr + ");\n";
+}
+
+static bool AnyArgumentOrField(const AidlDefinedType& defined_type,
+                               bool (AidlTypeSpecifier::*predicate)() const) {
+  if (const AidlInterface* interface = defined_type.AsInterface(); interface != nullptr) {
+    for (const auto& method : interface->GetMethods()) {
+      for (const auto& arg : method->GetArguments()) {
+        if ((arg->GetType().*predicate)()) return true;
+      }
+    }
+  }
+  if (const AidlStructuredParcelable* parcel = defined_type.AsStructuredParcelable();
+      parcel != nullptr) {
+    for (const auto& field : parcel->GetFields()) {
+      if ((field->GetType().*predicate)()) return true;
+    }
+  }
+  return false;
+}
+
+bool UsesSharedMemory(const AidlDefinedType& defined_type) {
+  return AnyArgumentOrField(defined_type, &AidlTypeSpecifier::IsSharedMemory);
+}
+
+bool UsesArrayView(const AidlDefinedType& defined_type) {
+  return AnyArgumentOrField(defined_type, &AidlTypeSpecifier::IsArrayView);
+}
+
+bool UsesStringView(const AidlDefinedType& defined_type) {
+  return AnyArgumentOrField(defined_type, &AidlTypeSpecifier::IsStringView);
+}
+
+bool UsesFixedSizeArrays(const AidlDefinedType& defined_type) {
+  if (const AidlInterface* interface = defined_type.AsInterface(); interface != nullptr) {
+    for (const auto& method : interface->GetMethods()) {
+      if (method->GetType().IsFixedSizeArray()) return true;
+    }
+  }
+  return AnyArgumentOrField(defined_type, &AidlTypeSpecifier::IsFixedSizeArray);
+}
+
+bool MovesInArguments(const AidlInterface& interface, const AidlMethod& method) {
+  return interface.IsMoveIn() || method.GetType().IsMoveIn();
+}
+
+bool HasCacheableMethods(const AidlInterface& interface) {
+  for (const auto& method : interface.GetMethods()) {
+    if (method->GetType().IsCacheable()) return true;
+  }
+  return false;
+}
+
+bool HasSingleFlightMethods(const AidlInterface& interface) {
+  for (const auto& method : interface.GetMethods()) {
+    if (method->GetType().IsSingleFlight()) return true;
+  }
+  return false;
+}
+
+bool HasBatchableMethods(const AidlInterface& interface) {
+  for (const auto& method : interface.GetMethods()) {
+    if (method->GetType().IsBatchable()) return true;
+  }
+  return false;
+}
+
+bool HasAsyncVariant(const AidlMethod& method) {
+  if (!method.IsUserDefined() || method.IsOneway()) return false;
+  for (const auto& a : method.GetArguments()) {
+    if (a->IsOut() || a->GetType().IsArrayView() || a->GetType().IsStringView()) return false;
+  }
+  return true;
+}
+
+bool HasAsyncVariants(const AidlInterface& interface) {
+  for (const auto& method : interface.GetMethods()) {
+    if (HasAsyncVariant(*method)) return true;
+  }
+  return false;
+}
+
+string AsyncMethodName(const AidlMethod& method) {
+  return method.GetName() + "Async";
+}
+
+size_t FixedSizeOf(const AidlTypeSpecifier& type, const AidlTypenames& typenames) {
+  const std::optional<AidlBuiltinKind> kind = typenames.GetBackingBuiltinKind(type);
+  return kind == AidlBuiltinKind::LONG || kind == AidlBuiltinKind::DOUBLE ? 8 : 4;
+}
+
+size_t FixedSizeOf(const AidlStructuredParcelable& parcel, const AidlTypenames& typenames) {
+  size_t size = 0;
+  for (const auto& field : parcel.GetFields()) {
+    size += FixedSizeOf(field->GetType(), typenames);
+  }
+  return size;
+}
+
+bool IsPmrContainer(const AidlTypeSpecifier& type) {
+  // A ::std::array of a fixed-size array holds its elements in place
+  if (type.IsFixedSizeArray()) return false;
+  return type.IsArray() || type.IsGeneric() || type.GetName() == "String";
+}
+
+bool UsesAllocator(const AidlTypeSpecifier& type, const AidlTypenames& typenames) {
+  if (IsPmrContainer(type)) return true;
+  const AidlDefinedType* defined_type = typenames.TryGetDefinedType(type.GetName());
+  return defined_type != nullptr && defined_type->IsPolymorphicAllocator();
+}
+
+string GenAllocatorConstructors(const AidlStructuredParcelable& parcel,
+                                const AidlTypenames& typenames, const string& clazz) {
+  std::vector<std::string> with_allocator;
+  std::vector<std::string> copies;
+  std::vector<std::string> moves;
+  for (const auto& field : parcel.GetFields()) {
+    const string& name = field->GetName();
+    if (UsesAllocator(field->GetType(), typenames)) {
+      // The default values of the arrays and the Strings are the same in both
+      // backends
+      const string value =
+          field->GetDefaultValue() ? field->ValueString(AidlConstantValueDecorator) + ", " : "";
+      with_allocator.push_back(name + "(" + value + "_aidl_allocator)");
+      copies.push_back(name + "(_aidl_other." + name + ", _aidl_allocator)");
+      moves.push_back(name + "(std::move(_aidl_other." + name + "), _aidl_allocator)");
+    } else {
+      copies.push_back(name + "(_aidl_other." + name + ")");
+      moves.push_back(name + "(std::move(_aidl_other." + name + "))");
+    }
+  }
+  // The parameters are unnamed where they are unused
+  const string allocator =
+      string("const allocator_type&") + (with_allocator.empty() ? "" : " _aidl_allocator");
+  const string other = parcel.GetFields().empty() ? "" : " _aidl_other";
+  const auto constructor = [&](const string& parameters, const std::vector<std::string>& inits) {
+    string code = clazz + "(" + parameters + ")";
+    if (!inits.empty()) code += "\n    : " + Join(inits, ",\n      ");
+    return code + " {}\n";
+  };
+  return "using allocator_type = ::std::pmr::polymorphic_allocator<char>;\n" + clazz +
+         "() = default;\n" + "explicit " + constructor(allocator, with_allocator) +
+         constructor("const " + clazz + "&" + other + ", " + allocator, copies) +
+         constructor(clazz + "&&" + other + ", " + allocator, moves);
+}
+
+string GenComparisonOperators(const AidlStructuredParcelable& parcel, const string& clazz) {
+  std::vector<std::string> names;
+  std::vector<std::string> rhs_names;
+  for (const auto& field : parcel.GetFields()) {
+    names.push_back(field->GetName());
+    rhs_names.push_back("rhs." + field->GetName());
+  }
+  std::ostringstream code;
+  for (const string op : {"!=", "<", "<=", "==", ">", ">="}) {
+    code << "inline bool operator" << op << "(const " << clazz << "& rhs) const {\n"
+         << "  return std::tie(" << Join(names, ", ") << ")" << op << "std::tie("
+         << Join(rhs_names, ", ") << ");\n"
+         << "}\n";
+  }
+  return code.str();
+}
+
+string DeltaBit(size_t index) {
+  return "(uint64_t{1} << " + std::to_string(index) + ")";
+}
+
+string GenDeltaMembers(const AidlStructuredParcelable& parcel, const string& clazz) {
+  const bool has_fields = !parcel.GetFields().empty();
+  std::ostringstream code;
+  code << "// The fields of " << clazz << " in values, bit i for the field i in the\n"
+       << "// order of their declaration\n"
+       << "uint64_t fields = 0;\n"
+       << clazz << " values;\n"
+       << "\n"
+       << "static Delta diff(const " << clazz << "&" << (has_fields ? " _aidl_old" : "")
+       << ", const " << clazz << "&" << (has_fields ? " _aidl_new" : "") << ") {\n"
+       << "  Delta _aidl_delta;\n";
+  const auto& fields = parcel.GetFields();
+  for (size_t i = 0; i < fields.size(); i++) {
+    const string& name = fields[i]->GetName();
+    code << "  if (_aidl_old." << name << " != _aidl_new." << name << ") {\n"
+         << "    _aidl_delta.fields |= " << DeltaBit(i) << ";\n"
+         << "    _aidl_delta.values." << name << " = _aidl_new." << name << ";\n"
+         << "  }\n";
+  }
+  code << "  return _aidl_delta;\n"
+       << "}\n"
+       << "static void apply(" << clazz << "*" << (has_fields ? " _aidl_base" : "")
+       << ", const Delta&" << (has_fields ? " _aidl_delta" : "") << ") {\n";
+  for (size_t i = 0; i < fields.size(); i++) {
+    const string& name = fields[i]->GetName();
+    code << "  if (_aidl_delta.fields & " << DeltaBit(i) << ") _aidl_base->" << name
+         << " = _aidl_delta.values." << name << ";\n";
+  }
+  code << "}\n";
+  return code.str();
+}
+
+string GenToString(const AidlStructuredParcelable& parcel) {
+  std::ostringstream code;
+  code << "void appendTo(std::string& _aidl_os) const {\n";
+  string literal = parcel.GetName() + "{";
+  for (const auto& field : parcel.GetFields()) {
+    literal += field->GetName() + ": ";
+    code << "  _aidl_os += \"" << literal << "\";\n"
+         << "  ::android::aidl::AppendTo(_aidl_os, " << field->GetName() << ");\n";
+    literal = ", ";
+  }
+  if (parcel.GetFields().empty()) {
+    code << "  _aidl_os += \"" << literal << "}\";\n";
+  } else {
+    code << "  _aidl_os += '}';\n";
+  }
+  code << "}\n"
+       << "std::string toString() const {\n"
+       << "  std::string _aidl_os;\n"
+       << "  appendTo(_aidl_os);\n"
+       << "  return _aidl_os;\n"
+       << "}\n";
+  return code.str();
+}
+
+string GenWireSchemaDefinition(const AidlDefinedType& type, const AidlTypenames& typenames,
+                               const string& clazz) {
+  std::ostringstream code;
+  code << "::std::string_view " << clazz << "::getWireSchema() {\n"
+       << "  __attribute__((section(\"aidl_wire_schema\"), used))\n"
+       << "  static const char _aidl_schema[] =\n"
+       << "      " << WireSchemaLiteral(WireSchemaOf(type, typenames), "\n      ") << ";\n"
+       << "  return ::std::string_view(_aidl_schema, sizeof(_aidl_schema) - 1);\n"
+       << "}\n";
+  return code.str();
+}
+
+string GenHashSpecialization(const AidlStructuredParcelable& parcel, const string& clazz) {
+  std::ostringstream code;
+  code << "template <>\n"
+       << "struct hash<" << clazz << "> {\n"
+       << "  size_t operator()(const " << clazz << "&"
+       << (parcel.GetFields().empty() ? "" : " _aidl_value") << ") const noexcept {\n"
+       << "    size_t _aidl_hash = 0;\n";
+  for (const auto& field : parcel.GetFields()) {
+    code << "    ::android::aidl::HashCombine(&_aidl_hash, ::android::aidl::HashOf(_aidl_value."
+         << field->GetName() << "));\n";
+  }
+  code << "    return _aidl_hash;\n"
+       << "  }\n"
+       << "};\n";
+  return code.str();
+}
+
+size_t FixedSizeArgumentsSize(const AidlMethod& method) {
+  // boolean, byte and char are written as 32 bits
+  static const std::map<string, size_t> kSizes = {
+      {"boolean", 4}, {"byte", 4}, {"char", 4}, {"int", 4},
+      {"long", 8},    {"float", 4}, {"double", 8},
+  };
+  if (method.GetArguments().size() < 2) return 0;
+  size_t size = 0;
+  for (const auto& arg : method.GetArguments()) {
+    const AidlTypeSpecifier& type = arg->GetType();
+    auto it = kSizes.find(type.GetName());
+    if (arg->IsOut() || type.IsArray() || it == kSizes.end()) return 0;
+    size += it->second;
+  }
+  return size;
+}
+
+namespace {
+
+// The operation of aidl/marshal.h for |type|, or "" if the parcel calls of
+// the backend have to marshal it
+string MarshalOpOf(const AidlTypeSpecifier& type) {
+  static const std::map<string, std::pair<string, string>> kOps = {
+      {"boolean", {"kBool", "kBoolVector"}},   {"byte", {"kByte", "kByteVector"}},
+      {"char", {"kChar", "kCharVector"}},      {"int", {"kInt32", "kInt32Vector"}},
+      {"long", {"kInt64", "kInt64Vector"}},    {"float", {"kFloat", "kFloatVector"}},
+      {"double", {"kDouble", "kDoubleVector"}},
+  };
+  if (type.IsNullable() || type.IsArrayView() || type.IsStringView() || type.IsSharedMemory() ||
+      type.IsFixedSizeArray() || type.IsGeneric()) {
+    return "";
+  }
+  if (type.GetName() == "String") {
+    if (type.IsArray()) return "";
+    return type.IsUtf8InCpp() ? "kUtf8String" : "kString";
+  }
+  auto it = kOps.find(type.GetName());
+  if (it == kOps.end()) return "";
+  return type.IsArray() ? it->second.second : it->second.first;
+}
+
+// The run of aidl/marshal.h that |op| can be a part of, or ""
+string MarshalRunOf(const string& op) {
+  if (op == "kInt32" || op == "kFloat") return "kRun32";
+  if (op == "kInt64" || op == "kDouble") return "kRun64";
+  return "";
+}
+
+// The operations of the request or of the |reply| of |method|, in the order
+// of their pointers in GenMarshalCall()
+std::vector<std::string> MarshalOps(const AidlMethod& method, bool reply) {
+  std::vector<std::string> ops;
+  if (!reply) {
+    for (const auto& a : method.GetArguments()) {
+      if (a->IsIn()) {
+        ops.push_back(MarshalOpOf(a->GetType()));
+      } else if (a->GetType().IsArray()) {
+        ops.push_back("kSize | " + MarshalOpOf(a->GetType()));
+      }
+    }
+    return ops;
+  }
+  if (method.GetType().GetName() != "void") {
+    ops.push_back(MarshalOpOf(method.GetType()));
+  }
+  for (const AidlArgument* a : method.GetOutArguments()) {
+    ops.push_back(MarshalOpOf(a->GetType()));
+  }
+  return ops;
+}
+
+// The program of |ops|, with the consecutive int32s and floats, and int64s and
+// doubles, in runs
+string MarshalProgram(const std::vector<std::string>& ops) {
+  std::vector<std::string> program;
+  for (size_t i = 0; i < ops.size();) {
+    const string run = MarshalRunOf(ops[i]);
+    size_t count = 1;
+    while (!run.empty() && i + count < ops.size() && count < 255 &&
+           MarshalRunOf(ops[i + count]) == run) {
+      count++;
+    }
+    if (count > 1) {
+      program.push_back(run);
+      program.push_back(std::to_string(count));
+    } else {
+      program.push_back(ops[i]);
+    }
+    i += count;
+  }
+  program.push_back("kEnd");
+  return "{" + Join(program, ", ") + "}";
+}
+
+string MarshalProgramName(const AidlMethod& method, bool reply) {
+  return method.GetName() + (reply ? "_reply" : "_request");
+}
+
+}  // namespace
+
+bool MarshalsWithTables(const AidlMethod& method, const Options& options) {
+  if (!options.MarshalWithTables() || !method.IsUserDefined() || method.GetType().IsBatchable()) {
+    return false;
+  }
+  if (method.GetType().GetName() != "void" && MarshalOpOf(method.GetType()).empty()) {
+    return false;
+  }
+  for (const auto& a : method.GetArguments()) {
+    if (MarshalOpOf(a->GetType()).empty()) return false;
+  }
+  return true;
+}
+
+bool HasMarshalTables(const AidlInterface& interface, const Options& options) {
+  for (const auto& method : interface.GetMethods()) {
+    if (MarshalsWithTables(*method, options)) return true;
+  }
+  return false;
+}
+
+string MarshalTablesNamespace(const AidlInterface& interface) {
+  return "_aidl_marshal_" + interface.GetName();
+}
+
+string GenMarshalTables(const AidlInterface& interface, const Options& options) {
+  string code;
+  CodeWriterPtr writer = CodeWriter::ForString(&code);
+  (*writer) << "namespace " << MarshalTablesNamespace(interface) << " {\n"
+            << "using namespace ::android::aidl::marshal;\n";
+  for (const auto& method : interface.GetMethods()) {
+    if (!MarshalsWithTables(*method, options)) continue;
+    for (bool reply : {false, true}) {
+      const std::vector<std::string> ops = MarshalOps(*method, reply);
+      if (ops.empty()) continue;
+      (*writer) << "constexpr uint8_t " << MarshalProgramName(*method, reply)
+                << "[] = " << MarshalProgram(ops) << ";\n";
+    }
+  }
+  (*writer) << "}  // namespace " << MarshalTablesNamespace(interface) << "\n";
+  writer->Close();
+  return code;
+}
+
+string GenMarshalCall(const AidlInterface& interface, const AidlMethod& method, bool reply,
+                      bool write, bool is_proxy, const string& parcel,
+                      const std::function<string(const AidlArgument&)>& var_name) {
+  if (MarshalOps(method, reply).empty()) return "";
+  // The proxies have pointers to the out arguments and to the return value,
+  // and the stubs have them all as locals
+  std::vector<std::string> args;
+  if (!reply) {
+    for (const auto& a : method.GetArguments()) {
+      if (!a->IsIn() && !a->GetType().IsArray()) continue;
+      args.push_back((is_proxy && a->IsOut() ? "" : "&") + var_name(*a));
+    }
+  } else {
+    if (method.GetType().GetName() != "void") {
+      args.push_back(is_proxy ? "_aidl_return" : "&_aidl_return");
+    }
+    for (const AidlArgument* a : method.GetOutArguments()) {
+      args.push_back((is_proxy ? "" : "&") + var_name(*a));
+    }
+  }
+  string code;
+  CodeWriterPtr writer = CodeWriter::ForString(&code);
+  (*writer) << "{\n";
+  writer->Indent();
+  (*writer) << (write ? "const void* const" : "void* const") << " _aidl_args[] = {"
+            << Join(args, ", ") << "};\n";
+  (*writer) << "_aidl_ret_status = ::android::aidl::marshal::" << (write ? "Write" : "Read")
+            << "(" << parcel << ", " << MarshalTablesNamespace(interface)
+            << "::" << MarshalProgramName(method, reply) << ", _aidl_args);\n";
+  writer->Dedent();
+  (*writer) << "}\n";
+  writer->Close();
+  return code;
+}
+
+const string GenTransactionNamesDecl(const AidlInterface& interface, const Options& options,
+                                     const string& firstCallTransaction) {
+  std::vector<const AidlMethod*> methods;
+  for (const auto& method : interface.GetMethods()) {
+    if (method->IsUserDefined() ||
+        (method->GetName() == kGetInterfaceVersion && options.Version() > 0) ||
+        (method->GetName() == kGetInterfaceHash && !options.Hash().empty())) {
+      methods.push_back(method.get());
+    }
+  }
+  std::stable_sort(methods.begin(), methods.end(), [](const AidlMethod* a, const AidlMethod* b) {
+    return a->GetId() < b->GetId();
+  });
+
+  string code;
+  CodeWriterPtr writer = CodeWriter::ForString(&code);
+  (*writer) << "struct TransactionName {\n"
+            << "  uint32_t code;\n"
+            << "  const char* name;\n"
+            << "};\n";
+  if (methods.empty()) {
+    (*writer) << "static constexpr const char* getTransactionName(uint32_t) { return nullptr; }\n";
+    writer->Close();
+    return code;
+  }
+  (*writer) << "static constexpr TransactionName kTransactionNames[] = {\n";
+  (*writer).Indent();
+  for (const AidlMethod* method : methods) {
+    (*writer) << "{" << firstCallTransaction << " + " << std::to_string(method->GetId()) << ", \""
+              << method->GetName() << "\"},\n";
+  }
+  (*writer).Dedent();
+  (*writer) << "};\n";
+  // The compilers turn the switch into a jump table or a few comparisons
+  (*writer) << "static constexpr const char* getTransactionName(uint32_t code) {\n";
+  (*writer).Indent();
+  (*writer) << "switch (code) {\n";
+  for (size_t i = 0; i < methods.size(); i++) {
+    (*writer) << "  case " << firstCallTransaction << " + " << std::to_string(methods[i]->GetId())
+              << ": return kTransactionNames[" << std::to_string(i) << "].name;\n";
+  }
+  (*writer) << "  default: return nullptr;\n"
+            << "}\n";
+  (*writer).Dedent();
+  (*writer) << "}\n";
+  writer->Close();
+  return code;
+}
+
+std::vector<const AidlMethod*> TransactionTable(const AidlInterface& interface,
+                                                const Options& options) {
+  std::vector<const AidlMethod*> methods;
+  int max_id = -1;
+  for (const auto& method : interface.GetMethods()) {
+    if (method->IsUserDefined()) {
+      methods.push_back(method.get());
+      max_id = std::max(max_id, method->GetId());
+    }
+  }
+  // Explicit transaction codes may leave gaps; a sparse table isn't worth it.
+  if (methods.size() <= options.onTransact_table_threshold_ ||
+      static_cast<size_t>(max_id) >= 2 * methods.size()) {
+    return {};
+  }
+  std::vector<const AidlMethod*> table(max_id + 1, nullptr);
+  for (const AidlMethod* method : methods) {
+    table[method->GetId()] = method;
+  }
+  return table;
+}
+
 std::string GenerateEnumValues(const AidlEnumDeclaration& enum_decl,
                                const std::vector<std::string>& enclosing_namespaces_of_enum_decl) {
   const auto fq_name =
@@ -376,6 +1028,51 @@ std::string GenerateEnumValues(const AidlEnumDeclaration& enum_decl,
   return code.str();
 }
 
+std::string GenerateEnumToString(const AidlEnumDeclaration& enum_decl,
+                                 const std::string& backing_type) {
+  const std::string& name = enum_decl.GetName();
+  std::ostringstream code;
+  code << "static constexpr std::string_view toStringView(" << name << " val) {\n";
+  code << "  switch(val) {\n";
+  std::set<std::string> unique_cases;
+  for (const auto& enumerator : enum_decl.GetEnumerators()) {
+    std::string c = enumerator->ValueString(enum_decl.GetBackingType(), AidlConstantValueDecorator);
+    // Only add a case if its value has not yet been used in the switch
+    // statement. C++ does not allow multiple cases with the same value, but
+    // enums does allow this. In this scenario, the first declared
+    // enumerator with the given value is printed.
+    if (unique_cases.count(c) == 0) {
+      unique_cases.insert(c);
+      code << "  case " << name << "::" << enumerator->GetName() << ":\n";
+      code << "    return \"" << enumerator->GetName() << "\";\n";
+    }
+  }
+  code << "  default:\n";
+  code << "    return {};\n";
+  code << "  }\n";
+  code << "}\n";
+  code << "\n";
+  code << "static inline std::string toString(" << name << " val) {\n";
+  code << "  const std::string_view name = toStringView(val);\n";
+  code << "  if (name.empty()) {\n";
+  code << "    return std::to_string(static_cast<" << backing_type << ">(val));\n";
+  code << "  }\n";
+  code << "  return std::string(name);\n";
+  code << "}\n";
+  code << "\n";
+  // Every enumerator is matched, including those that share another's value
+  code << "static constexpr bool fromString(std::string_view name, " << name << "* val) {\n";
+  for (const auto& enumerator : enum_decl.GetEnumerators()) {
+    code << "  if (name == \"" << enumerator->GetName() << "\") {\n";
+    code << "    *val = " << name << "::" << enumerator->GetName() << ";\n";
+    code << "    return true;\n";
+    code << "  }\n";
+  }
+  code << "  return false;\n";
+  code << "}\n";
+  return code.str();
+}
+
 }  // namespace cpp
 }  // namespace aidl
 }  // namespace android
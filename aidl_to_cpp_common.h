@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include <functional>
 #include <string>
 #include <type_traits>
 
@@ -56,6 +57,109 @@ const string GenLogAfterExecute(const string className, const AidlInterface& int
                                 const AidlMethod& method, const string& statusVarName,
                                 const string& returnVarName, bool isServer, bool isNdk);
 
+// The code around the call of a method and its transaction that logs it with
+// --log=binary. |inputSizeExpr| and |outputSizeExpr| evaluate to the sizes of
+// the request and the reply, or to 0 where the code does not know them.
+const string GenBinaryLogBeforeExecute();
+const string GenBinaryLogAfterExecute(const AidlInterface& interface, const AidlMethod& method,
+                                      const string& statusVarName, const string& addressExpr,
+                                      const string& inputSizeExpr, const string& outputSizeExpr,
+                                      bool isServer, bool isNdk);
+
+// The capture of the request of |method| in |dataVarName| by the stub with
+// --log=binary (see aidl/transaction_capture.h). |codeExpr| evaluates to the
+// transaction code of the method.
+const string GenCaptureRequest(const AidlInterface& interface, const AidlMethod& method,
+                               const string& codeExpr, const string& dataVarName, bool isNdk);
+
+// The counts of the transactions of |clazz| with --gen-stats: a table of its
+// user-defined methods, its static getTransactionStats() and the timer of the
+// call of |method|. |firstCallTransaction| names FIRST_CALL_TRANSACTION.
+const string GenStatsTable(const AidlInterface& interface, const string& clazz,
+                           const string& firstCallTransaction);
+const string GenStatsTimer(const AidlInterface& interface, const AidlMethod& method,
+                           const string& clazz);
+// With --gen-stats=sizes, the recording of the size of the request and of the
+// reply of |method|
+const string GenStatsRecordSizes(const AidlInterface& interface, const AidlMethod& method,
+                                 const string& clazz, const string& requestSizeExpr,
+                                 const string& replySizeExpr);
+
+// With --trace=perfetto, the slice over the transaction of |method| on |side|,
+// e.g. "cppServer", whose reply has |replySizeExpr| bytes and whose status is
+// |statusExpr| when it ends, and the start of its next |phase|
+const string GenPerfettoTransaction(const AidlInterface& interface, const AidlMethod& method,
+                                    const string& side, const string& code,
+                                    const string& replySizeExpr, const string& statusExpr);
+const string GenPerfettoPhase(const string& phase);
+const string GenPerfettoRequestBytes(const string& requestSizeExpr);
+
+// Whether an argument or a field of |defined_type| has @SharedMemory
+bool UsesSharedMemory(const AidlDefinedType& defined_type);
+// Whether an argument of |defined_type| has @ArrayView
+bool UsesArrayView(const AidlDefinedType& defined_type);
+// Whether an argument of |defined_type| has @StringView
+bool UsesStringView(const AidlDefinedType& defined_type);
+// Whether an argument, a return type or a field of |defined_type| is a T[N]
+bool UsesFixedSizeArrays(const AidlDefinedType& defined_type);
+// Whether |method| or its |interface| has @MoveIn
+bool MovesInArguments(const AidlInterface& interface, const AidlMethod& method);
+// Whether a method of |interface| has @Cacheable
+bool HasCacheableMethods(const AidlInterface& interface);
+// Whether a method of |interface| has @SingleFlight
+bool HasSingleFlightMethods(const AidlInterface& interface);
+// Whether a method of |interface| has @Batchable
+bool HasBatchableMethods(const AidlInterface& interface);
+// Whether |method| has an asynchronous variant with --gen-async: the blocking
+// methods whose arguments are all in, except those with @ArrayView, as the
+// views would not outlive the calls
+bool HasAsyncVariant(const AidlMethod& method);
+// Whether a method of |interface| has an asynchronous variant
+bool HasAsyncVariants(const AidlInterface& interface);
+// "getNameAsync", the asynchronous variant of |method|
+string AsyncMethodName(const AidlMethod& method);
+
+// The bytes that a field of a @FixedSize parcelable takes in a parcel, where
+// each field is an int32 except the longs and doubles, which are int64s
+size_t FixedSizeOf(const AidlTypeSpecifier& type, const AidlTypenames& typenames);
+// The bytes of the fields of a @FixedSize parcelable, after its size header
+size_t FixedSizeOf(const AidlStructuredParcelable& parcel, const AidlTypenames& typenames);
+
+// Whether a field of a @PolymorphicAllocator parcelable is held in a
+// ::std::pmr::vector or a ::std::pmr::string, which aidl/pmr_parcel.h and
+// aidl/pmr_ndk.h write and read
+bool IsPmrContainer(const AidlTypeSpecifier& type);
+// Whether a field of a @PolymorphicAllocator parcelable is constructed with the
+// allocator of the parcelable: its containers and @PolymorphicAllocator
+// parcelables
+bool UsesAllocator(const AidlTypeSpecifier& type, const AidlTypenames& typenames);
+// The allocator_type of |clazz|, the class of a @PolymorphicAllocator |parcel|,
+// and its constructors, including those that take an allocator for the
+// uses-allocator construction of the parcelables within ::std::pmr containers
+string GenAllocatorConstructors(const AidlStructuredParcelable& parcel,
+                                const AidlTypenames& typenames, const string& clazz);
+
+// The field-wise comparison operators of |clazz|, the class of |parcel|
+string GenComparisonOperators(const AidlStructuredParcelable& parcel, const string& clazz);
+// The mask of the field at |index| in the fields of the Delta of a @Delta
+// parcelable
+string DeltaBit(size_t index);
+// The members of the Delta of a @Delta |parcel|, whose class is |clazz|: the
+// fields that it has and their values, and the diff() and apply() between it
+// and two values of |clazz|
+string GenDeltaMembers(const AidlStructuredParcelable& parcel, const string& clazz);
+// The appendTo() of --parcelable-to-string, which appends |parcel| to the
+// string of the caller through aidl/to_string.h, and the toString() over it
+string GenToString(const AidlStructuredParcelable& parcel);
+// The definition of the static getWireSchema() of |clazz|, the class of
+// |type|, for --gen-wire-schema: the wire schema of |type| in the
+// "aidl_wire_schema" section of the library, and the accessor that returns it
+string GenWireSchemaDefinition(const AidlDefinedType& type, const AidlTypenames& typenames,
+                               const string& clazz);
+// The ::std::hash of |clazz|, the fully qualified class of a @Hashable
+// |parcel|, which combines the hashes of aidl/hash.h for its fields
+string GenHashSpecialization(const AidlStructuredParcelable& parcel, const string& clazz);
+
 template <typename T, typename = std::enable_if_t<std::is_copy_constructible_v<T>>>
 std::vector<T> Append(std::vector<T> as, const std::vector<T>& bs) {
   as.insert(as.end(), bs.begin(), bs.end());
@@ -70,9 +174,57 @@ std::vector<T> Append(std::vector<T>&& as, std::vector<T>&& bs) {
   return appended;
 }
 
+// The bytes that the arguments of |method| take in a request if there are
+// several and they are all 'in' primitives, or 0 otherwise. The stubs check
+// once that the request has that many bytes left, and then read the arguments
+// without checking the status of each read.
+size_t FixedSizeArgumentsSize(const AidlMethod& method);
+
+// With --marshal=tables, whether |method| marshals its request and reply with
+// the programs of aidl/marshal.h: the user-defined methods other than the
+// @Batchable ones, whose arguments and return are all primitives, Strings or
+// arrays of primitives, none of them @nullable, @ArrayView or @SharedMemory
+bool MarshalsWithTables(const AidlMethod& method, const Options& options);
+// Whether a method of |interface| does
+bool HasMarshalTables(const AidlInterface& interface, const Options& options);
+// "_aidl_marshal_IFoo", the namespace of the programs of |interface|
+string MarshalTablesNamespace(const AidlInterface& interface);
+// The namespace of the programs of the methods of |interface| that marshal
+// with tables, a "<method>_request" and a "<method>_reply" for each unless it
+// is empty
+string GenMarshalTables(const AidlInterface& interface, const Options& options);
+// The block that writes (|write|) or reads the request or the |reply| of
+// |method| in |parcel| with its program, which sets _aidl_ret_status, or "" if
+// the program is empty. |var_name| names the arguments, which the proxy
+// (|is_proxy|) has pointers to when they are out.
+string GenMarshalCall(const AidlInterface& interface, const AidlMethod& method, bool reply,
+                      bool write, bool is_proxy, const string& parcel,
+                      const std::function<string(const AidlArgument&)>& var_name);
+
+// With --transaction_names, the declarations of kTransactionNames, the
+// {code, name} of each transaction of |interface| sorted by code, and of the
+// constexpr getTransactionName(code) that looks a code up in it, or returns
+// nullptr. |firstCallTransaction| names FIRST_CALL_TRANSACTION.
+const string GenTransactionNamesDecl(const AidlInterface& interface, const Options& options,
+                                     const string& firstCallTransaction);
+
+// The user-defined methods of |interface| indexed by their transaction code
+// minus FIRST_CALL_TRANSACTION, with nullptr for unused codes, if onTransact
+// dispatches them with a table of per-method handlers. That is done for
+// interfaces with more than Options::onTransact_table_threshold_ methods
+// whose codes are dense enough; otherwise this is empty and onTransact keeps
+// its switch statement. The other transactions are switched on either way.
+std::vector<const AidlMethod*> TransactionTable(const AidlInterface& interface,
+                                                const Options& options);
+
 std::string GenerateEnumValues(const AidlEnumDeclaration& enum_decl,
                                const std::vector<std::string>& enclosing_namespaces_of_enum_decl);
 
+// toStringView(), toString() and fromString() of |enum_decl|, whose values
+// are |backing_type| in the generated code. Only toString() allocates.
+std::string GenerateEnumToString(const AidlEnumDeclaration& enum_decl,
+                                 const std::string& backing_type);
+
 }  // namespace cpp
 }  // namespace aidl
 }  // namespace android
@@ -17,10 +17,13 @@
 #include "aidl_to_java.h"
 #include "aidl_language.h"
 #include "aidl_typenames.h"
+#include "aidl_wire_schema.h"
 #include "logging.h"
 
 #include <android-base/strings.h>
 
+#include <algorithm>
+#include <cctype>
 #include <functional>
 #include <iostream>
 #include <map>
@@ -56,65 +59,65 @@ const string& JavaNameOf(const AidlTypeSpecifier& aidl, const AidlTypenames& typ
     // And instantiable type has to be either the type in List, Map, ParcelFileDescriptor or
     // user-defined type.
 
-    static map<string, string> instantiable_m = {
-        {"List", "java.util.ArrayList"},
-        {"Map", "java.util.HashMap"},
-        {"ParcelFileDescriptor", "android.os.ParcelFileDescriptor"},
+    static const AidlBuiltinTable<string> instantiable_m = {
+        {AidlBuiltinKind::LIST, false, "java.util.ArrayList"},
+        {AidlBuiltinKind::MAP, false, "java.util.HashMap"},
+        {AidlBuiltinKind::PARCEL_FILE_DESCRIPTOR, false, "android.os.ParcelFileDescriptor"},
     };
-    const string& aidl_name = aidl.GetName();
-
-    if (instantiable_m.find(aidl_name) != instantiable_m.end()) {
-      return instantiable_m[aidl_name];
+    if (const string* name = instantiable_m.Find(aidl.GetBuiltinKind(), false); name != nullptr) {
+      return *name;
     }
   }
 
-  // map from AIDL built-in type name to the corresponding Java type name
-  static map<string, string> m = {
-      {"void", "void"},
-      {"boolean", "boolean"},
-      {"byte", "byte"},
-      {"char", "char"},
-      {"int", "int"},
-      {"long", "long"},
-      {"float", "float"},
-      {"double", "double"},
-      {"String", "java.lang.String"},
-      {"List", "java.util.List"},
-      {"Map", "java.util.Map"},
-      {"IBinder", "android.os.IBinder"},
-      {"FileDescriptor", "java.io.FileDescriptor"},
-      {"CharSequence", "java.lang.CharSequence"},
-      {"ParcelFileDescriptor", "android.os.ParcelFileDescriptor"},
+  // map from AIDL built-in type to the corresponding Java type name
+  static const AidlBuiltinTable<string> m = {
+      {AidlBuiltinKind::VOID, false, "void"},
+      {AidlBuiltinKind::BOOLEAN, false, "boolean"},
+      {AidlBuiltinKind::BYTE, false, "byte"},
+      {AidlBuiltinKind::CHAR, false, "char"},
+      {AidlBuiltinKind::INT, false, "int"},
+      {AidlBuiltinKind::LONG, false, "long"},
+      {AidlBuiltinKind::FLOAT, false, "float"},
+      {AidlBuiltinKind::DOUBLE, false, "double"},
+      {AidlBuiltinKind::STRING, false, "java.lang.String"},
+      {AidlBuiltinKind::LIST, false, "java.util.List"},
+      {AidlBuiltinKind::MAP, false, "java.util.Map"},
+      {AidlBuiltinKind::IBINDER, false, "android.os.IBinder"},
+      {AidlBuiltinKind::FILE_DESCRIPTOR, false, "java.io.FileDescriptor"},
+      {AidlBuiltinKind::CHAR_SEQUENCE, false, "java.lang.CharSequence"},
+      {AidlBuiltinKind::PARCEL_FILE_DESCRIPTOR, false, "android.os.ParcelFileDescriptor"},
   };
 
   // map from primitive types to the corresponding boxing types
-  static map<string, string> boxing_types = {
-      {"void", "Void"},   {"boolean", "Boolean"}, {"byte", "Byte"},   {"char", "Character"},
-      {"int", "Integer"}, {"long", "Long"},       {"float", "Float"}, {"double", "Double"},
+  static const AidlBuiltinTable<string> boxing_types = {
+      {AidlBuiltinKind::VOID, false, "Void"},    {AidlBuiltinKind::BOOLEAN, false, "Boolean"},
+      {AidlBuiltinKind::BYTE, false, "Byte"},    {AidlBuiltinKind::CHAR, false, "Character"},
+      {AidlBuiltinKind::INT, false, "Integer"},  {AidlBuiltinKind::LONG, false, "Long"},
+      {AidlBuiltinKind::FLOAT, false, "Float"},  {AidlBuiltinKind::DOUBLE, false, "Double"},
   };
 
   // Enums in Java are represented by their backing type when
-  // referenced in parcelables, methods, etc.
+  // referenced in parcelables, methods, etc., and by its boxing type in a List
+  // or a Map.
   if (const AidlEnumDeclaration* enum_decl = typenames.GetEnumDeclaration(aidl);
       enum_decl != nullptr) {
-    const string& backing_type_name = enum_decl->GetBackingType().GetName();
-    CHECK(m.find(backing_type_name) != m.end());
-    CHECK(AidlTypenames::IsBuiltinTypename(backing_type_name));
-    return m[backing_type_name];
+    const string* backing_type_name =
+        (boxing ? boxing_types : m).Find(enum_decl->GetBackingType().GetBuiltinKind(), false);
+    CHECK(backing_type_name != nullptr);
+    return *backing_type_name;
   }
 
-  const string& aidl_name = aidl.GetName();
-  if (boxing && AidlTypenames::IsPrimitiveTypename(aidl_name)) {
+  if (boxing && AidlTypenames::IsPrimitiveTypename(aidl.GetName())) {
     // Every primitive type must have the corresponding boxing type
-    CHECK(boxing_types.find(aidl_name) != m.end());
-    return boxing_types[aidl_name];
+    const string* boxed = boxing_types.Find(aidl.GetBuiltinKind(), false);
+    CHECK(boxed != nullptr);
+    return *boxed;
   }
-  if (m.find(aidl_name) != m.end()) {
-    CHECK(AidlTypenames::IsBuiltinTypename(aidl_name));
-    return m[aidl_name];
+  if (const string* name = m.Find(aidl.GetBuiltinKind(), false); name != nullptr) {
+    return *name;
   } else {
     // 'foo.bar.IFoo' in AIDL maps to 'foo.bar.IFoo' in Java
-    return aidl_name;
+    return aidl.GetName();
   }
 }
 
@@ -137,46 +140,47 @@ string JavaSignatureOfInternal(
   return ret;
 }
 
-// Returns the name of the backing type for the specified type. Note: this
-// returns type names as used in AIDL, not a Java signature.
-// For enums, this is the enum's backing type.
-// For all other types, this is the type itself.
-string AidlBackingTypeName(const AidlTypeSpecifier& type, const AidlTypenames& typenames) {
-  string type_name;
-  if (const AidlEnumDeclaration* enum_decl = typenames.GetEnumDeclaration(type);
-      enum_decl != nullptr) {
-    type_name = enum_decl->GetBackingType().GetName();
-  } else {
-    type_name = type.GetName();
-  }
-  if (type.IsArray()) {
-    type_name += "[]";
-  }
-  return type_name;
-}
+// Writes code that marshals a built-in type.
+using ParcelMethod = void (*)(const CodeGeneratorContext&);
 
 }  // namespace
 
 string JavaSignatureOf(const AidlTypeSpecifier& aidl, const AidlTypenames& typenames) {
-  return JavaSignatureOfInternal(aidl, typenames, false, false);
+  return aidl.Memoized(AidlTypeSpecifier::Memo::JAVA_SIGNATURE, [&]() {
+    return JavaSignatureOfInternal(aidl, typenames, false, false);
+  });
+}
+
+string JavaBoxedSignatureOf(const AidlTypeSpecifier& aidl, const AidlTypenames& typenames) {
+  if (const AidlEnumDeclaration* enum_decl = typenames.GetEnumDeclaration(aidl);
+      enum_decl != nullptr && !aidl.IsArray()) {
+    return JavaSignatureOfInternal(enum_decl->GetBackingType(), typenames, false, false, true);
+  }
+  return JavaSignatureOfInternal(aidl, typenames, false, false, true);
 }
 
 string InstantiableJavaSignatureOf(const AidlTypeSpecifier& aidl, const AidlTypenames& typenames) {
-  return JavaSignatureOfInternal(aidl, typenames, true, true);
+  return aidl.Memoized(AidlTypeSpecifier::Memo::JAVA_INSTANTIABLE_SIGNATURE, [&]() {
+    return JavaSignatureOfInternal(aidl, typenames, true, true);
+  });
 }
 
 string DefaultJavaValueOf(const AidlTypeSpecifier& aidl, const AidlTypenames& typenames) {
-  static map<string, string> m = {
-      {"boolean", "false"}, {"byte", "0"},     {"char", R"('\u0000')"}, {"int", "0"},
-      {"long", "0L"},       {"float", "0.0f"}, {"double", "0.0d"},
+  static constexpr AidlBuiltinTable<const char*> m = {
+      {AidlBuiltinKind::BOOLEAN, false, "false"},
+      {AidlBuiltinKind::BYTE, false, "0"},
+      {AidlBuiltinKind::CHAR, false, R"('\u0000')"},
+      {AidlBuiltinKind::INT, false, "0"},
+      {AidlBuiltinKind::LONG, false, "0L"},
+      {AidlBuiltinKind::FLOAT, false, "0.0f"},
+      {AidlBuiltinKind::DOUBLE, false, "0.0d"},
   };
 
-  const string name = AidlBackingTypeName(aidl, typenames);
-  CHECK(name != "void");
+  const std::optional<AidlBuiltinKind> kind = typenames.GetBackingBuiltinKind(aidl);
+  CHECK(kind != AidlBuiltinKind::VOID);
 
-  if (!aidl.IsArray() && m.find(name) != m.end()) {
-    CHECK(AidlTypenames::IsBuiltinTypename(name));
-    return m[name];
+  if (const char* const* value = m.Find(kind, aidl.IsArray()); value != nullptr) {
+    return *value;
   } else {
     return "null";
   }
@@ -190,164 +194,449 @@ static string GetFlagFor(const CodeGeneratorContext& c) {
   }
 }
 
+// Writes a nullable Parcelable. This is the same as writeTypedObject, which
+// was introduced with SDK 23 and is only called with --java-compact, so that
+// the generated code is buildable with older SDK by default.
+static void WriteNullableParcelableFor(const CodeGeneratorContext& c) {
+  if (c.compact) {
+    c.writer << c.parcel << ".writeTypedObject(" << c.var << ", " << GetFlagFor(c) << ");\n";
+    return;
+  }
+  c.writer << "if ((" << c.var << "!=null)) {\n";
+  c.writer.Indent();
+  c.writer << c.parcel << ".writeInt(1);\n";
+  c.writer << c.var << ".writeToParcel(" << c.parcel << ", " << GetFlagFor(c) << ");\n";
+  c.writer.Dedent();
+  c.writer << "}\n";
+  c.writer << "else {\n";
+  c.writer.Indent();
+  c.writer << c.parcel << ".writeInt(0);\n";
+  c.writer.Dedent();
+  c.writer << "}\n";
+}
+
+// Reads a nullable Parcelable with |creator|. As above, this is the same as
+// readTypedObject, which needs the creator to be typed with the class, as
+// those of the generated parcelables and of ParcelFileDescriptor are.
+static void CreateNullableParcelableFor(const CodeGeneratorContext& c, const string& creator,
+                                        bool typed_creator) {
+  if (c.compact && typed_creator) {
+    c.writer << c.var << " = " << c.parcel << ".readTypedObject(" << creator << ");\n";
+    return;
+  }
+  c.writer << "if ((0!=" << c.parcel << ".readInt())) {\n";
+  c.writer.Indent();
+  c.writer << c.var << " = " << creator << ".createFromParcel(" << c.parcel << ");\n";
+  c.writer.Dedent();
+  c.writer << "}\n";
+  c.writer << "else {\n";
+  c.writer.Indent();
+  c.writer << c.var << " = null;\n";
+  c.writer.Dedent();
+  c.writer << "}\n";
+}
+
+string SetDataCapacityFor(const vector<pair<const AidlTypeSpecifier*, string>>& values,
+                          const AidlTypenames& typenames, const string& parcel) {
+  // Every element takes a whole int in a Parcel, except those of a byte[]
+  static constexpr AidlBuiltinTable<int> sizes{
+      {AidlBuiltinKind::BOOLEAN, false, 4}, {AidlBuiltinKind::BYTE, false, 4},
+      {AidlBuiltinKind::CHAR, false, 4},    {AidlBuiltinKind::INT, false, 4},
+      {AidlBuiltinKind::LONG, false, 8},    {AidlBuiltinKind::FLOAT, false, 4},
+      {AidlBuiltinKind::DOUBLE, false, 8},
+  };
+  vector<string> terms;
+  bool has_array = false;
+  for (const auto& [type, var] : values) {
+    const std::optional<AidlBuiltinKind> kind = typenames.GetBackingBuiltinKind(*type);
+    const int* size = sizes.Find(kind, false);
+    if (size == nullptr || type->IsGeneric() || type->IsSharedMemory()) continue;
+    if (!type->IsArray()) {
+      terms.push_back(std::to_string(*size));
+      continue;
+    }
+    has_array = true;
+    const string count = "((" + var + "==null) ? 0 : " + var + ".length)";
+    if (kind == AidlBuiltinKind::BYTE) {
+      terms.push_back("(4 + ((" + count + " + 3) & ~3))");
+    } else {
+      terms.push_back("(4 + " + count + " * " + std::to_string(*size) + ")");
+    }
+  }
+  if (!has_array) return "";
+  return parcel + ".setDataCapacity(" + parcel + ".dataPosition() + " + Join(terms, " + ") +
+         ");\n";
+}
+
+// The byte[]s with @SharedMemory(threshold=N) that are longer than N bytes
+// are written as a region of shared memory, in the layout that
+// aidl/shared_memory.h describes. A SharedMemory writes just its descriptor,
+// so the presence and the comm channel of a ParcelFileDescriptor come first.
+static void WriteSharedMemoryToParcelFor(const CodeGeneratorContext& c) {
+  c.writer << "if ((" << c.var << "!=null && " << c.var << ".length > "
+           << std::to_string(c.type.SharedMemoryThreshold()) << ")) {\n";
+  c.writer.Indent();
+  c.writer << "try (android.os.SharedMemory _aidl_region = android.os.SharedMemory.create(null, "
+           << c.var << ".length)) {\n";
+  c.writer.Indent();
+  c.writer << "java.nio.ByteBuffer _aidl_buffer = _aidl_region.mapReadWrite();\n";
+  c.writer << "_aidl_buffer.put(" << c.var << ");\n";
+  c.writer << "android.os.SharedMemory.unmap(_aidl_buffer);\n";
+  c.writer << "_aidl_region.setProtect(android.system.OsConstants.PROT_READ);\n";
+  c.writer << c.parcel << ".writeInt(1);\n";
+  c.writer << c.parcel << ".writeInt(" << c.var << ".length);\n";
+  c.writer << c.parcel << ".writeInt(1);\n";
+  c.writer << c.parcel << ".writeInt(0);\n";
+  c.writer << "_aidl_region.writeToParcel(" << c.parcel << ", 0);\n";
+  c.writer.Dedent();
+  c.writer << "}\n";
+  c.writer << "catch (android.system.ErrnoException _aidl_e) {\n";
+  c.writer.Indent();
+  c.writer << "throw new java.lang.IllegalStateException(_aidl_e);\n";
+  c.writer.Dedent();
+  c.writer << "}\n";
+  c.writer.Dedent();
+  c.writer << "}\n";
+  c.writer << "else {\n";
+  c.writer.Indent();
+  c.writer << c.parcel << ".writeInt(0);\n";
+  c.writer << c.parcel << ".writeByteArray(" << c.var << ");\n";
+  c.writer.Dedent();
+  c.writer << "}\n";
+}
+
+static void CreateSharedMemoryFromParcelFor(const CodeGeneratorContext& c) {
+  c.writer << "if ((0!=" << c.parcel << ".readInt())) {\n";
+  c.writer.Indent();
+  c.writer << "int _aidl_length = " << c.parcel << ".readInt();\n";
+  c.writer << "android.os.ParcelFileDescriptor _aidl_region = (0!=" << c.parcel
+           << ".readInt()) ? android.os.ParcelFileDescriptor.CREATOR.createFromParcel(" << c.parcel
+           << ") : null;\n";
+  c.writer << "if ((_aidl_region==null || _aidl_length < 0)) {\n";
+  c.writer.Indent();
+  c.writer << "throw new java.lang.IllegalArgumentException(\"Bad region of shared memory\");\n";
+  c.writer.Dedent();
+  c.writer << "}\n";
+  c.writer << "try (java.io.FileInputStream _aidl_stream = "
+           << "new android.os.ParcelFileDescriptor.AutoCloseInputStream(_aidl_region)) {\n";
+  c.writer.Indent();
+  // Read at an offset rather than mapped, since the sender may shrink the
+  // region meanwhile, and a mapping would fault past its new end. The offset
+  // of the descriptor is shared with the sender, which wrote the region.
+  c.writer << c.var << " = new byte[_aidl_length];\n";
+  c.writer << "java.nio.channels.FileChannel _aidl_channel = _aidl_stream.getChannel();\n";
+  c.writer << "for (int _aidl_offset = 0; _aidl_offset < _aidl_length;) {\n";
+  c.writer.Indent();
+  c.writer << "int _aidl_read = _aidl_channel.read(java.nio.ByteBuffer.wrap(" << c.var
+           << ", _aidl_offset, _aidl_length - _aidl_offset), _aidl_offset);\n";
+  c.writer << "if ((_aidl_read <= 0)) {\n";
+  c.writer.Indent();
+  c.writer << "throw new java.lang.IllegalArgumentException(\"Bad region of shared memory\");\n";
+  c.writer.Dedent();
+  c.writer << "}\n";
+  c.writer << "_aidl_offset += _aidl_read;\n";
+  c.writer.Dedent();
+  c.writer << "}\n";
+  c.writer.Dedent();
+  c.writer << "}\n";
+  c.writer << "catch (java.io.IOException _aidl_e) {\n";
+  c.writer.Indent();
+  c.writer << "throw new java.lang.IllegalArgumentException(_aidl_e);\n";
+  c.writer.Dedent();
+  c.writer << "}\n";
+  c.writer.Dedent();
+  c.writer << "}\n";
+  c.writer << "else {\n";
+  c.writer.Indent();
+  c.writer << c.var << " = " << c.parcel << ".createByteArray();\n";
+  c.writer.Dedent();
+  c.writer << "}\n";
+}
+
+// The name of a local variable that the code marshalling c.var declares, such
+// as an element of a List, which stays unique in the code of nested containers
+static string LocalVarFor(const CodeGeneratorContext& c, const string& suffix) {
+  string name = c.var;
+  for (char& ch : name) {
+    if (!isalnum(static_cast<unsigned char>(ch))) ch = '_';
+  }
+  if (!android::base::StartsWith(name, "_aidl_")) {
+    name = "_aidl_" + name.substr(std::min(name.find_first_not_of('_'), name.size()));
+  }
+  return name + "_" + suffix;
+}
+
+static CodeGeneratorContext ElementContextFor(const CodeGeneratorContext& c,
+                                              const AidlTypeSpecifier& type, const string& var) {
+  return CodeGeneratorContext{
+      c.writer,
+      c.typenames,
+      type,
+      c.parcel,
+      var,
+      c.is_return_value,
+      c.is_classloader_created,
+      c.filename,
+      c.compact,
+  };
+}
+
+// Returns the infix of the methods of Parcel that marshal a whole List of
+// |element|, "String", "Binder" or "Typed", and sets |creator| for the latter.
+// Returns "" when the elements are marshalled one at a time.
+static string BulkListMethodFor(const CodeGeneratorContext& c, const AidlTypeSpecifier& element,
+                                string* creator) {
+  if (element.IsArray()) return "";
+  if (element.GetName() == "String") return "String";
+  if (element.GetName() == "IBinder") return "Binder";
+  if (element.GetName() == "ParcelFileDescriptor") {
+    *creator = "android.os.ParcelFileDescriptor.CREATOR";
+    return "Typed";
+  }
+  const AidlDefinedType* t = c.typenames.TryGetDefinedType(element.GetName());
+  CHECK(t != nullptr) << "Unknown type: " << element.GetName() << endl;
+  if (t->AsParcelable() != nullptr || t->AsStructuredParcelable() != nullptr) {
+    *creator = JavaNameOf(element, c.typenames) + ".CREATOR";
+    return "Typed";
+  }
+  return "";
+}
+
+// Writes the size of a List or a Map, or -1 when it is null, then the code of
+// |write_elements|
+static void WriteContainerToParcelFor(const CodeGeneratorContext& c,
+                                      const function<void()>& write_elements) {
+  c.writer << "if ((" << c.var << "==null)) {\n";
+  c.writer.Indent();
+  c.writer << c.parcel << ".writeInt(-1);\n";
+  c.writer.Dedent();
+  c.writer << "}\n";
+  c.writer << "else {\n";
+  c.writer.Indent();
+  c.writer << c.parcel << ".writeInt(" << c.var << ".size());\n";
+  write_elements();
+  c.writer.Dedent();
+  c.writer << "}\n";
+}
+
+// Reads the |size| elements of a List or the entries of a Map into c.var
+static void ReadContainerElementsFor(const CodeGeneratorContext& c, const string& size) {
+  const string i = LocalVarFor(c, "i");
+  c.writer << "for (int " << i << " = 0; " << i << " < " << size << "; " << i << "++) {\n";
+  c.writer.Indent();
+  if (c.type.GetName() == "Map") {
+    const AidlTypeSpecifier& value = *c.type.GetTypeParameters().at(1);
+    const string k = LocalVarFor(c, "k");
+    const string v = LocalVarFor(c, "v");
+    c.writer << "String " << k << " = " << c.parcel << ".readString();\n";
+    c.writer << JavaBoxedSignatureOf(value, c.typenames) << " " << v << ";\n";
+    CreateFromParcelFor(ElementContextFor(c, value, v));
+    c.writer << c.var << ".put(" << k << ", " << v << ");\n";
+  } else {
+    const AidlTypeSpecifier& element = *c.type.GetTypeParameters().at(0);
+    const string e = LocalVarFor(c, "e");
+    c.writer << JavaBoxedSignatureOf(element, c.typenames) << " " << e << ";\n";
+    CreateFromParcelFor(ElementContextFor(c, element, e));
+    c.writer << c.var << ".add(" << e << ");\n";
+  }
+  c.writer.Dedent();
+  c.writer << "}\n";
+}
+
+// Creates the List or the Map of c.var with the capacity for its elements,
+// bounded by the data left in the parcel so that a corrupt size can not
+// allocate more memory than the elements that can follow
+static void CreateContainerFromParcelFor(const CodeGeneratorContext& c) {
+  const string size = LocalVarFor(c, "size");
+  c.writer << "{\n";
+  c.writer.Indent();
+  c.writer << "int " << size << " = " << c.parcel << ".readInt();\n";
+  c.writer << "if ((" << size << "<0)) {\n";
+  c.writer.Indent();
+  c.writer << c.var << " = null;\n";
+  c.writer.Dedent();
+  c.writer << "}\n";
+  c.writer << "else {\n";
+  c.writer.Indent();
+  if (c.type.GetName() == "Map") {
+    // An entry takes at least 8 bytes, and the HashMap holds its entries
+    // without a resize up to 3/4 of its capacity
+    c.writer << c.var << " = new java.util.HashMap<>((Math.min(" << size << ", " << c.parcel
+             << ".dataAvail() / 8) * 4 + 2) / 3);\n";
+  } else {
+    c.writer << c.var << " = new java.util.ArrayList<>(Math.min(" << size << ", " << c.parcel
+             << ".dataAvail() / 4));\n";
+  }
+  ReadContainerElementsFor(c, size);
+  c.writer.Dedent();
+  c.writer << "}\n";
+  c.writer.Dedent();
+  c.writer << "}\n";
+}
+
+// Reads the elements of a List or the entries of a Map into the existing c.var
+static void ReadContainerFromParcelFor(const CodeGeneratorContext& c) {
+  const string size = LocalVarFor(c, "size");
+  c.writer << "{\n";
+  c.writer.Indent();
+  c.writer << c.var << ".clear();\n";
+  c.writer << "int " << size << " = " << c.parcel << ".readInt();\n";
+  ReadContainerElementsFor(c, size);
+  c.writer.Dedent();
+  c.writer << "}\n";
+}
+
+// The check that a T[N] has its N elements, before it is written or once it
+// is created, since a Java array has no fixed length
+static void CheckFixedArrayLengthFor(const CodeGeneratorContext& c) {
+  const string size = std::to_string(c.type.FixedArraySize());
+  c.writer << "if ((" << c.var << "==null || " << c.var << ".length != " << size << ")) {\n";
+  c.writer.Indent();
+  c.writer << "throw new java.lang.IllegalArgumentException(\"" << c.type.ToString()
+           << " must have " << size << " elements\");\n";
+  c.writer.Dedent();
+  c.writer << "}\n";
+}
+
 bool WriteToParcelFor(const CodeGeneratorContext& c) {
-  static map<string, function<void(const CodeGeneratorContext&)>> method_map{
-      {"boolean",
+  if (c.type.IsSharedMemory()) {
+    WriteSharedMemoryToParcelFor(c);
+    return true;
+  }
+  if (c.type.IsFixedSizeArray()) {
+    CheckFixedArrayLengthFor(c);
+  }
+  static constexpr AidlBuiltinTable<ParcelMethod> method_map{
+{AidlBuiltinKind::BOOLEAN, false,
        [](const CodeGeneratorContext& c) {
          c.writer << c.parcel << ".writeInt(((" << c.var << ")?(1):(0)));\n";
        }},
-      {"boolean[]",
+{AidlBuiltinKind::BOOLEAN, true,
        [](const CodeGeneratorContext& c) {
          c.writer << c.parcel << ".writeBooleanArray(" << c.var << ");\n";
        }},
-      {"byte",
+{AidlBuiltinKind::BYTE, false,
        [](const CodeGeneratorContext& c) {
          c.writer << c.parcel << ".writeByte(" << c.var << ");\n";
        }},
-      {"byte[]",
+{AidlBuiltinKind::BYTE, true,
        [](const CodeGeneratorContext& c) {
          c.writer << c.parcel << ".writeByteArray(" << c.var << ");\n";
        }},
-      {"char",
+{AidlBuiltinKind::CHAR, false,
        [](const CodeGeneratorContext& c) {
          c.writer << c.parcel << ".writeInt(((int)" << c.var << "));\n";
        }},
-      {"char[]",
+{AidlBuiltinKind::CHAR, true,
        [](const CodeGeneratorContext& c) {
          c.writer << c.parcel << ".writeCharArray(" << c.var << ");\n";
        }},
-      {"int",
+{AidlBuiltinKind::INT, false,
        [](const CodeGeneratorContext& c) {
          c.writer << c.parcel << ".writeInt(" << c.var << ");\n";
        }},
-      {"int[]",
+{AidlBuiltinKind::INT, true,
        [](const CodeGeneratorContext& c) {
          c.writer << c.parcel << ".writeIntArray(" << c.var << ");\n";
        }},
-      {"long",
+{AidlBuiltinKind::LONG, false,
        [](const CodeGeneratorContext& c) {
          c.writer << c.parcel << ".writeLong(" << c.var << ");\n";
        }},
-      {"long[]",
+{AidlBuiltinKind::LONG, true,
        [](const CodeGeneratorContext& c) {
          c.writer << c.parcel << ".writeLongArray(" << c.var << ");\n";
        }},
-      {"float",
+{AidlBuiltinKind::FLOAT, false,
        [](const CodeGeneratorContext& c) {
          c.writer << c.parcel << ".writeFloat(" << c.var << ");\n";
        }},
-      {"float[]",
+{AidlBuiltinKind::FLOAT, true,
        [](const CodeGeneratorContext& c) {
          c.writer << c.parcel << ".writeFloatArray(" << c.var << ");\n";
        }},
-      {"double",
+{AidlBuiltinKind::DOUBLE, false,
        [](const CodeGeneratorContext& c) {
          c.writer << c.parcel << ".writeDouble(" << c.var << ");\n";
        }},
-      {"double[]",
+{AidlBuiltinKind::DOUBLE, true,
        [](const CodeGeneratorContext& c) {
          c.writer << c.parcel << ".writeDoubleArray(" << c.var << ");\n";
        }},
-      {"String",
+{AidlBuiltinKind::STRING, false,
        [](const CodeGeneratorContext& c) {
          c.writer << c.parcel << ".writeString(" << c.var << ");\n";
        }},
-      {"String[]",
+{AidlBuiltinKind::STRING, true,
        [](const CodeGeneratorContext& c) {
          c.writer << c.parcel << ".writeStringArray(" << c.var << ");\n";
        }},
-      {"List",
+{AidlBuiltinKind::LIST, false,
        [](const CodeGeneratorContext& c) {
          if (c.type.IsGeneric()) {
-           const string& contained_type = c.type.GetTypeParameters().at(0)->GetName();
-           if (AidlTypenames::IsBuiltinTypename(contained_type)) {
-             if (contained_type == "String") {
-               c.writer << c.parcel << ".writeStringList(" << c.var << ");\n";
-             } else if (contained_type == "IBinder") {
-               c.writer << c.parcel << ".writeBinderList(" << c.var << ");\n";
-             }
-           } else {
-             const AidlDefinedType* t = c.typenames.TryGetDefinedType(contained_type);
-             CHECK(t != nullptr) << "Unknown type: " << contained_type << endl;
-             if (t->AsParcelable() != nullptr) {
-               c.writer << c.parcel << ".writeTypedList(" << c.var << ");\n";
-             }
+           const AidlTypeSpecifier& element = *c.type.GetTypeParameters().at(0);
+           string creator;
+           const string bulk = BulkListMethodFor(c, element, &creator);
+           if (!bulk.empty()) {
+             c.writer << c.parcel << ".write" << bulk << "List(" << c.var << ");\n";
+             return;
            }
+           WriteContainerToParcelFor(c, [&]() {
+             const string e = LocalVarFor(c, "e");
+             c.writer << "for (" << JavaBoxedSignatureOf(element, c.typenames) << " " << e
+                      << " : " << c.var << ") {\n";
+             c.writer.Indent();
+             WriteToParcelFor(ElementContextFor(c, element, e));
+             c.writer.Dedent();
+             c.writer << "}\n";
+           });
          } else {
            c.writer << c.parcel << ".writeList(" << c.var << ");\n";
          }
        }},
-      {"Map",
+{AidlBuiltinKind::MAP, false,
        [](const CodeGeneratorContext& c) {
          if (c.type.IsGeneric()) {
-           c.writer << "if (" << c.var << " == null) {\n";
-           c.writer.Indent();
-           c.writer << c.parcel << ".writeInt(-1);\n";
-           c.writer.Dedent();
-           c.writer << "} else {\n";
-           c.writer.Indent();
-           c.writer << c.parcel << ".writeInt(" << c.var << ".size());\n";
-           c.writer << c.var << ".forEach((k, v) -> {\n";
-           c.writer.Indent();
-           c.writer << c.parcel << ".writeString(k);\n";
-
-           CodeGeneratorContext value_context{
-               c.writer,
-               c.typenames,
-               *c.type.GetTypeParameters()[1].get(),
-               c.parcel,
-               "v",
-               c.is_return_value,
-               c.is_classloader_created,
-               c.filename,
-           };
-           WriteToParcelFor(value_context);
-           c.writer.Dedent();
-           c.writer << "});\n";
-
-           c.writer.Dedent();
-           c.writer << "}\n";
+           const AidlTypeSpecifier& value = *c.type.GetTypeParameters().at(1);
+           WriteContainerToParcelFor(c, [&]() {
+             const string entry = LocalVarFor(c, "entry");
+             const string v = LocalVarFor(c, "v");
+             const string value_type = JavaBoxedSignatureOf(value, c.typenames);
+             c.writer << "for (java.util.Map.Entry<String, " << value_type << "> " << entry
+                      << " : " << c.var << ".entrySet()) {\n";
+             c.writer.Indent();
+             c.writer << c.parcel << ".writeString(" << entry << ".getKey());\n";
+             c.writer << value_type << " " << v << " = " << entry << ".getValue();\n";
+             WriteToParcelFor(ElementContextFor(c, value, v));
+             c.writer.Dedent();
+             c.writer << "}\n";
+           });
          } else {
            c.writer << c.parcel << ".writeMap(" << c.var << ");\n";
          }
        }},
-      {"IBinder",
+{AidlBuiltinKind::IBINDER, false,
        [](const CodeGeneratorContext& c) {
          c.writer << c.parcel << ".writeStrongBinder(" << c.var << ");\n";
        }},
-      {"IBinder[]",
+{AidlBuiltinKind::IBINDER, true,
        [](const CodeGeneratorContext& c) {
          c.writer << c.parcel << ".writeBinderArray(" << c.var << ");\n";
        }},
-      {"FileDescriptor",
+{AidlBuiltinKind::FILE_DESCRIPTOR, false,
        [](const CodeGeneratorContext& c) {
          c.writer << c.parcel << ".writeRawFileDescriptor(" << c.var << ");\n";
        }},
-      {"FileDescriptor[]",
+{AidlBuiltinKind::FILE_DESCRIPTOR, true,
        [](const CodeGeneratorContext& c) {
          c.writer << c.parcel << ".writeRawFileDescriptorArray(" << c.var << ");\n";
        }},
-      {"ParcelFileDescriptor",
-       [](const CodeGeneratorContext& c) {
-         // This is same as writeTypedObject which was introduced with SDK 23.
-         // Keeping below code so that the generated code is buildable with older SDK.
-         c.writer << "if ((" << c.var << "!=null)) {\n";
-         c.writer.Indent();
-         c.writer << c.parcel << ".writeInt(1);\n";
-         c.writer << c.var << ".writeToParcel(" << c.parcel << ", " << GetFlagFor(c) << ");\n";
-         c.writer.Dedent();
-         c.writer << "}\n";
-         c.writer << "else {\n";
-         c.writer.Indent();
-         c.writer << c.parcel << ".writeInt(0);\n";
-         c.writer.Dedent();
-         c.writer << "}\n";
-       }},
-      {"ParcelFileDescriptor[]",
+{AidlBuiltinKind::PARCEL_FILE_DESCRIPTOR, false, WriteNullableParcelableFor},
+{AidlBuiltinKind::PARCEL_FILE_DESCRIPTOR, true,
        [](const CodeGeneratorContext& c) {
          c.writer << c.parcel << ".writeTypedArray(" << c.var << ", " << GetFlagFor(c) << ");\n";
        }},
-      {"CharSequence",
+{AidlBuiltinKind::CHAR_SEQUENCE, false,
        [](const CodeGeneratorContext& c) {
          // TextUtils.writeToParcel does not accept null. So, we need to handle
          // the case here.
@@ -365,10 +654,10 @@ bool WriteToParcelFor(const CodeGeneratorContext& c) {
          c.writer << "}\n";
        }},
   };
-  const string type_name = AidlBackingTypeName(c.type, c.typenames);
-  const auto found = method_map.find(type_name);
-  if (found != method_map.end()) {
-    found->second(c);
+  const ParcelMethod* found =
+      method_map.Find(c.typenames.GetBackingBuiltinKind(c.type), c.type.IsArray());
+  if (found != nullptr) {
+    (*found)(c);
   } else {
     const AidlDefinedType* t = c.typenames.TryGetDefinedType(c.type.GetName());
     CHECK(t != nullptr) << "Unknown type: " << c.type.GetName() << endl;
@@ -383,19 +672,7 @@ bool WriteToParcelFor(const CodeGeneratorContext& c) {
       if (c.type.IsArray()) {
         c.writer << c.parcel << ".writeTypedArray(" << c.var << ", " << GetFlagFor(c) << ");\n";
       } else {
-        // This is same as writeTypedObject.
-        // Keeping below code just not to break tests.
-        c.writer << "if ((" << c.var << "!=null)) {\n";
-        c.writer.Indent();
-        c.writer << c.parcel << ".writeInt(1);\n";
-        c.writer << c.var << ".writeToParcel(" << c.parcel << ", " << GetFlagFor(c) << ");\n";
-        c.writer.Dedent();
-        c.writer << "}\n";
-        c.writer << "else {\n";
-        c.writer.Indent();
-        c.writer << c.parcel << ".writeInt(0);\n";
-        c.writer.Dedent();
-        c.writer << "}\n";
+        WriteNullableParcelableFor(c);
       }
     }
   }
@@ -415,169 +692,126 @@ static string EnsureAndGetClassloader(CodeGeneratorContext& c) {
 }
 
 bool CreateFromParcelFor(const CodeGeneratorContext& c) {
-  static map<string, function<void(const CodeGeneratorContext&)>> method_map{
-      {"boolean",
+  if (c.type.IsSharedMemory()) {
+    CreateSharedMemoryFromParcelFor(c);
+    return true;
+  }
+  static constexpr AidlBuiltinTable<ParcelMethod> method_map{
+{AidlBuiltinKind::BOOLEAN, false,
        [](const CodeGeneratorContext& c) {
          c.writer << c.var << " = (0!=" << c.parcel << ".readInt());\n";
        }},
-      {"boolean[]",
+{AidlBuiltinKind::BOOLEAN, true,
        [](const CodeGeneratorContext& c) {
          c.writer << c.var << " = " << c.parcel << ".createBooleanArray();\n";
        }},
-      {"byte",
+{AidlBuiltinKind::BYTE, false,
        [](const CodeGeneratorContext& c) {
          c.writer << c.var << " = " << c.parcel << ".readByte();\n";
        }},
-      {"byte[]",
+{AidlBuiltinKind::BYTE, true,
        [](const CodeGeneratorContext& c) {
          c.writer << c.var << " = " << c.parcel << ".createByteArray();\n";
        }},
-      {"char",
+{AidlBuiltinKind::CHAR, false,
        [](const CodeGeneratorContext& c) {
          c.writer << c.var << " = (char)" << c.parcel << ".readInt();\n";
        }},
-      {"char[]",
+{AidlBuiltinKind::CHAR, true,
        [](const CodeGeneratorContext& c) {
          c.writer << c.var << " = " << c.parcel << ".createCharArray();\n";
        }},
-      {"int",
+{AidlBuiltinKind::INT, false,
        [](const CodeGeneratorContext& c) {
          c.writer << c.var << " = " << c.parcel << ".readInt();\n";
        }},
-      {"int[]",
+{AidlBuiltinKind::INT, true,
        [](const CodeGeneratorContext& c) {
          c.writer << c.var << " = " << c.parcel << ".createIntArray();\n";
        }},
-      {"long",
+{AidlBuiltinKind::LONG, false,
        [](const CodeGeneratorContext& c) {
          c.writer << c.var << " = " << c.parcel << ".readLong();\n";
        }},
-      {"long[]",
+{AidlBuiltinKind::LONG, true,
        [](const CodeGeneratorContext& c) {
          c.writer << c.var << " = " << c.parcel << ".createLongArray();\n";
        }},
-      {"float",
+{AidlBuiltinKind::FLOAT, false,
        [](const CodeGeneratorContext& c) {
          c.writer << c.var << " = " << c.parcel << ".readFloat();\n";
        }},
-      {"float[]",
+{AidlBuiltinKind::FLOAT, true,
        [](const CodeGeneratorContext& c) {
          c.writer << c.var << " = " << c.parcel << ".createFloatArray();\n";
        }},
-      {"double",
+{AidlBuiltinKind::DOUBLE, false,
        [](const CodeGeneratorContext& c) {
          c.writer << c.var << " = " << c.parcel << ".readDouble();\n";
        }},
-      {"double[]",
+{AidlBuiltinKind::DOUBLE, true,
        [](const CodeGeneratorContext& c) {
          c.writer << c.var << " = " << c.parcel << ".createDoubleArray();\n";
        }},
-      {"String",
+{AidlBuiltinKind::STRING, false,
        [](const CodeGeneratorContext& c) {
          c.writer << c.var << " = " << c.parcel << ".readString();\n";
        }},
-      {"String[]",
+{AidlBuiltinKind::STRING, true,
        [](const CodeGeneratorContext& c) {
          c.writer << c.var << " = " << c.parcel << ".createStringArray();\n";
        }},
-      {"List",
+{AidlBuiltinKind::LIST, false,
        [](const CodeGeneratorContext& c) {
          if (c.type.IsGeneric()) {
-           const string& contained_type = c.type.GetTypeParameters().at(0)->GetName();
-           if (AidlTypenames::IsBuiltinTypename(contained_type)) {
-             if (contained_type == "String") {
-               c.writer << c.var << " = " << c.parcel << ".createStringArrayList();\n";
-             } else if (contained_type == "IBinder") {
-               c.writer << c.var << " = " << c.parcel << ".createBinderArrayList();\n";
-             }
+           string creator;
+           const string bulk = BulkListMethodFor(c, *c.type.GetTypeParameters().at(0), &creator);
+           if (!bulk.empty()) {
+             c.writer << c.var << " = " << c.parcel << ".create" << bulk << "ArrayList(" << creator
+                      << ");\n";
            } else {
-             const AidlDefinedType* t = c.typenames.TryGetDefinedType(contained_type);
-             CHECK(t != nullptr) << "Unknown type: " << contained_type << endl;
-             if (t->AsParcelable() != nullptr) {
-               c.writer << c.var << " = " << c.parcel << ".createTypedArrayList("
-                        << JavaNameOf(*(c.type.GetTypeParameters().at(0)), c.typenames)
-                        << ".CREATOR);\n";
-             }
+             CreateContainerFromParcelFor(c);
            }
          } else {
            const string classloader = EnsureAndGetClassloader(const_cast<CodeGeneratorContext&>(c));
            c.writer << c.var << " = " << c.parcel << ".readArrayList(" << classloader << ");\n";
          }
        }},
-      {"Map",
+{AidlBuiltinKind::MAP, false,
        [](const CodeGeneratorContext& c) {
          if (c.type.IsGeneric()) {
-           c.writer << "{\n";
-           c.writer.Indent();
-           c.writer << "int N = " << c.parcel << ".readInt();\n";
-           c.writer << c.var << " = N < 0 ? null : new java.util.HashMap<>();\n";
-
-           auto creator = JavaNameOf(*(c.type.GetTypeParameters().at(1)), c.typenames) + ".CREATOR";
-           c.writer << "java.util.stream.IntStream.range(0, N).forEach(i -> {\n";
-           c.writer.Indent();
-           c.writer << "String k = " << c.parcel << ".readString();\n";
-           c.writer << JavaNameOf(*(c.type.GetTypeParameters().at(1)), c.typenames) << " v;\n";
-           CodeGeneratorContext value_context{
-               c.writer,
-               c.typenames,
-               *c.type.GetTypeParameters()[1].get(),
-               c.parcel,
-               "v",
-               c.is_return_value,
-               c.is_classloader_created,
-               c.filename,
-           };
-           CreateFromParcelFor(value_context);
-           c.writer << c.var << ".put(k, v);\n";
-
-           c.writer.Dedent();
-           c.writer << "});\n";
-
-           c.writer.Dedent();
-           c.writer << "}\n";
+           CreateContainerFromParcelFor(c);
          } else {
            const string classloader = EnsureAndGetClassloader(const_cast<CodeGeneratorContext&>(c));
            c.writer << c.var << " = " << c.parcel << ".readHashMap(" << classloader << ");\n";
          }
        }},
-      {"IBinder",
+{AidlBuiltinKind::IBINDER, false,
        [](const CodeGeneratorContext& c) {
          c.writer << c.var << " = " << c.parcel << ".readStrongBinder();\n";
        }},
-      {"IBinder[]",
+{AidlBuiltinKind::IBINDER, true,
        [](const CodeGeneratorContext& c) {
          c.writer << c.var << " = " << c.parcel << ".createBinderArray();\n";
        }},
-      {"FileDescriptor",
+{AidlBuiltinKind::FILE_DESCRIPTOR, false,
        [](const CodeGeneratorContext& c) {
          c.writer << c.var << " = " << c.parcel << ".readRawFileDescriptor();\n";
        }},
-      {"FileDescriptor[]",
+{AidlBuiltinKind::FILE_DESCRIPTOR, true,
        [](const CodeGeneratorContext& c) {
          c.writer << c.var << " = " << c.parcel << ".createRawFileDescriptorArray();\n";
        }},
-      {"ParcelFileDescriptor",
+{AidlBuiltinKind::PARCEL_FILE_DESCRIPTOR, false,
        [](const CodeGeneratorContext& c) {
-         // This is same as readTypedObject which was introduced with SDK 23.
-         // Keeping below code so that the generated code is buildable with older SDK.
-         c.writer << "if ((0!=" << c.parcel << ".readInt())) {\n";
-         c.writer.Indent();
-         c.writer << c.var << " = " << "android.os.ParcelFileDescriptor.CREATOR.createFromParcel(" << c.parcel
-                  << ");\n";
-         c.writer.Dedent();
-         c.writer << "}\n";
-         c.writer << "else {\n";
-         c.writer.Indent();
-         c.writer << c.var << " = null;\n";
-         c.writer.Dedent();
-         c.writer << "}\n";
+         CreateNullableParcelableFor(c, "android.os.ParcelFileDescriptor.CREATOR", true);
        }},
-      {"ParcelFileDescriptor[]",
+{AidlBuiltinKind::PARCEL_FILE_DESCRIPTOR, true,
        [](const CodeGeneratorContext& c) {
          c.writer << c.var << " = " << c.parcel
                   << ".createTypedArray(android.os.ParcelFileDescriptor.CREATOR);\n";
        }},
-      {"CharSequence",
+{AidlBuiltinKind::CHAR_SEQUENCE, false,
        [](const CodeGeneratorContext& c) {
          // We have written 0 for null CharSequence.
          c.writer << "if (0!=" << c.parcel << ".readInt()) {\n";
@@ -593,9 +827,14 @@ bool CreateFromParcelFor(const CodeGeneratorContext& c) {
          c.writer << "}\n";
        }},
   };
-  const auto found = method_map.find(AidlBackingTypeName(c.type, c.typenames));
-  if (found != method_map.end()) {
-    found->second(c);
+  const ParcelMethod* found =
+      method_map.Find(c.typenames.GetBackingBuiltinKind(c.type), c.type.IsArray());
+  if (found != nullptr) {
+    (*found)(c);
+    // Only the primitives have fixed-size arrays
+    if (c.type.IsFixedSizeArray()) {
+      CheckFixedArrayLengthFor(c);
+    }
   } else {
     const AidlDefinedType* t = c.typenames.TryGetDefinedType(c.type.GetName());
     CHECK(t != nullptr) << "Unknown type: " << c.type.GetName() << endl;
@@ -609,19 +848,8 @@ bool CreateFromParcelFor(const CodeGeneratorContext& c) {
         c.writer << c.var << " = " << c.parcel << ".createTypedArray("
                  << JavaNameOf(c.type, c.typenames) << ".CREATOR);\n";
       } else {
-        // This is same as readTypedObject.
-        // Keeping below code just not to break unit tests.
-        c.writer << "if ((0!=" << c.parcel << ".readInt())) {\n";
-        c.writer.Indent();
-        c.writer << c.var << " = " << c.type.GetName() << ".CREATOR.createFromParcel(" << c.parcel
-                 << ");\n";
-        c.writer.Dedent();
-        c.writer << "}\n";
-        c.writer << "else {\n";
-        c.writer.Indent();
-        c.writer << c.var << " = null;\n";
-        c.writer.Dedent();
-        c.writer << "}\n";
+        CreateNullableParcelableFor(c, c.type.GetName() + ".CREATOR",
+                                    t->AsStructuredParcelable() != nullptr);
       }
     }
   }
@@ -629,104 +857,73 @@ bool CreateFromParcelFor(const CodeGeneratorContext& c) {
 }
 
 bool ReadFromParcelFor(const CodeGeneratorContext& c) {
-  static map<string, function<void(const CodeGeneratorContext&)>> method_map{
-      {"boolean[]",
+  static constexpr AidlBuiltinTable<ParcelMethod> method_map{
+{AidlBuiltinKind::BOOLEAN, true,
        [](const CodeGeneratorContext& c) {
          c.writer << c.parcel << ".readBooleanArray(" << c.var << ");\n";
        }},
-      {"byte[]",
+{AidlBuiltinKind::BYTE, true,
        [](const CodeGeneratorContext& c) {
          c.writer << c.parcel << ".readByteArray(" << c.var << ");\n";
        }},
-      {"char[]",
+{AidlBuiltinKind::CHAR, true,
        [](const CodeGeneratorContext& c) {
          c.writer << c.parcel << ".readCharArray(" << c.var << ");\n";
        }},
-      {"int[]",
+{AidlBuiltinKind::INT, true,
        [](const CodeGeneratorContext& c) {
          c.writer << c.parcel << ".readIntArray(" << c.var << ");\n";
        }},
-      {"long[]",
+{AidlBuiltinKind::LONG, true,
        [](const CodeGeneratorContext& c) {
          c.writer << c.parcel << ".readLongArray(" << c.var << ");\n";
        }},
-      {"float[]",
+{AidlBuiltinKind::FLOAT, true,
        [](const CodeGeneratorContext& c) {
          c.writer << c.parcel << ".readFloatArray(" << c.var << ");\n";
        }},
-      {"double[]",
+{AidlBuiltinKind::DOUBLE, true,
        [](const CodeGeneratorContext& c) {
          c.writer << c.parcel << ".readDoubleArray(" << c.var << ");\n";
        }},
-      {"String[]",
+{AidlBuiltinKind::STRING, true,
        [](const CodeGeneratorContext& c) {
          c.writer << c.parcel << ".readStringArray(" << c.var << ");\n";
        }},
-      {"List",
+{AidlBuiltinKind::LIST, false,
        [](const CodeGeneratorContext& c) {
          if (c.type.IsGeneric()) {
-           const string& contained_type = c.type.GetTypeParameters().at(0)->GetName();
-           if (AidlTypenames::IsBuiltinTypename(contained_type)) {
-             if (contained_type == "String") {
-               c.writer << c.parcel << ".readStringList(" << c.var << ");\n";
-             } else if (contained_type == "IBinder") {
-               c.writer << c.parcel << ".readBinderList(" << c.var << ");\n";
-             }
+           string creator;
+           const string bulk = BulkListMethodFor(c, *c.type.GetTypeParameters().at(0), &creator);
+           if (!bulk.empty()) {
+             c.writer << c.parcel << ".read" << bulk << "List(" << c.var
+                      << (creator.empty() ? "" : ", ") << creator << ");\n";
            } else {
-             const AidlDefinedType* t = c.typenames.TryGetDefinedType(contained_type);
-             CHECK(t != nullptr) << "Unknown type: " << contained_type << endl;
-             if (t->AsParcelable() != nullptr) {
-               c.writer << c.parcel << ".readTypedList(" << c.var << ", "
-                        << JavaNameOf(*(c.type.GetTypeParameters().at(0)), c.typenames)
-                        << ".CREATOR);\n";
-             }
+             ReadContainerFromParcelFor(c);
            }
          } else {
            const string classloader = EnsureAndGetClassloader(const_cast<CodeGeneratorContext&>(c));
            c.writer << c.parcel << ".readList(" << c.var << ", " << classloader << ");\n";
          }
        }},
-      {"Map",
+{AidlBuiltinKind::MAP, false,
        [](const CodeGeneratorContext& c) {
          if (c.type.IsGeneric()) {
-           c.writer << "if (" << c.var << " != null) " << c.var << ".clear();\n";
-           c.writer << "java.util.stream.IntStream.range(0, " << c.parcel
-                    << ".readInt()).forEach(i -> {\n";
-           c.writer.Indent();
-           c.writer << "String k = " << c.parcel << ".readString();\n";
-           c.writer << JavaNameOf(*(c.type.GetTypeParameters().at(1)), c.typenames) << " v;\n";
-           CodeGeneratorContext value_context{
-               c.writer,
-               c.typenames,
-               *c.type.GetTypeParameters()[1].get(),
-               c.parcel,
-               "v",
-               c.is_return_value,
-               c.is_classloader_created,
-               c.filename,
-           };
-           CreateFromParcelFor(value_context);
-           c.writer << c.var << ".put(k, v);\n";
-
-           c.writer.Dedent();
-           c.writer << "});\n";
-
-           c.writer.Dedent();
-           c.writer << "}\n";
+           ReadContainerFromParcelFor(c);
          } else {
            const string classloader = EnsureAndGetClassloader(const_cast<CodeGeneratorContext&>(c));
            c.writer << c.var << " = " << c.parcel << ".readHashMap(" << classloader << ");\n";
          }
        }},
-      {"IBinder[]",
+{AidlBuiltinKind::IBINDER, true,
        [](const CodeGeneratorContext& c) {
          c.writer << c.var << " = " << c.parcel << ".createBinderArray();\n";
        }},
-      {"FileDescriptor[]",
+{AidlBuiltinKind::FILE_DESCRIPTOR, true,
        [](const CodeGeneratorContext& c) {
          c.writer << c.var << " = " << c.parcel << ".createRawFileDescriptorArray();\n";
        }},
-      {"ParcelFileDescriptor",
+{AidlBuiltinKind::PARCEL_FILE_DESCRIPTOR, false,
        [](const CodeGeneratorContext& c) {
          c.writer << "if ((0!=" << c.parcel << ".readInt())) {\n";
          c.writer.Indent();
@@ -734,15 +931,16 @@ bool ReadFromParcelFor(const CodeGeneratorContext& c) {
          c.writer.Dedent();
          c.writer << "}\n";
        }},
-      {"ParcelFileDescriptor[]",
+{AidlBuiltinKind::PARCEL_FILE_DESCRIPTOR, true,
        [](const CodeGeneratorContext& c) {
          c.writer << c.parcel << ".readTypedArray(" << c.var
                   << ", android.os.ParcelFileDescriptor.CREATOR);\n";
        }},
   };
-  const auto& found = method_map.find(AidlBackingTypeName(c.type, c.typenames));
-  if (found != method_map.end()) {
-    found->second(c);
+  const ParcelMethod* found =
+      method_map.Find(c.typenames.GetBackingBuiltinKind(c.type), c.type.IsArray());
+  if (found != nullptr) {
+    (*found)(c);
   } else {
     const AidlDefinedType* t = c.typenames.TryGetDefinedType(c.type.GetName());
     CHECK(t != nullptr) << "Unknown type: " << c.type.GetName() << endl;
@@ -762,6 +960,16 @@ bool ReadFromParcelFor(const CodeGeneratorContext& c) {
   return true;
 }
 
+string WireSchemaMethod(const AidlDefinedType& type, const AidlTypenames& typenames) {
+  // Each char of the literal is a byte of the schema in ISO 8859-1
+  return "/** The wire schema of this type, see aidl/wire_schema.h */\n"
+         "public static byte[] getWireSchema() {\n"
+         "  return (" +
+         WireSchemaLiteral(WireSchemaOf(type, typenames), "\n      + ") +
+         ").getBytes(java.nio.charset.StandardCharsets.ISO_8859_1);\n"
+         "}\n";
+}
+
 }  // namespace java
 }  // namespace aidl
 }  // namespace android
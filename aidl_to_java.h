@@ -45,6 +45,10 @@ std::string ConstantValueDecorator(const AidlTypeSpecifier& type, const std::str
 // This includes generic type parameters with array modifiers.
 string JavaSignatureOf(const AidlTypeSpecifier& aidl, const AidlTypenames& typenames);
 
+// Returns the Java type signature of the AIDL type spec as a reference type,
+// where the primitives and the enums are boxed
+string JavaBoxedSignatureOf(const AidlTypeSpecifier& aidl, const AidlTypenames& typenames);
+
 // Returns the instantiable Jva type signature of the AIDL type spec
 // This includes generic type parameters, but excludes array modifiers.
 string InstantiableJavaSignatureOf(const AidlTypeSpecifier& aidl, const AidlTypenames& typenames);
@@ -86,11 +90,23 @@ struct CodeGeneratorContext {
 
   // for error message printing
   const string filename;
+
+  // Whether to call the helpers of Parcel for the common shapes rather than
+  // to inline them, as with --java-compact
+  const bool compact = false;
 };
 
 // Writes code fragment that writes a variable to the parcel.
 bool WriteToParcelFor(const CodeGeneratorContext& c);
 
+// Returns the statement that grows |parcel| once for the |values| that are
+// about to be written to it, with their names, or "" if none of them is an
+// array of primitives or enums, for which the parcel would grow repeatedly.
+// The sizes are exact for the primitives and come from the element count for
+// the arrays.
+string SetDataCapacityFor(const vector<pair<const AidlTypeSpecifier*, string>>& values,
+                          const AidlTypenames& typenames, const string& parcel);
+
 // Writes code fragment that reads data from the parcel into a variable. When
 // the variable type is array or List, the array or List is created.
 bool CreateFromParcelFor(const CodeGeneratorContext& c);
@@ -99,6 +115,10 @@ bool CreateFromParcelFor(const CodeGeneratorContext& c);
 // array or a List.
 bool ReadFromParcelFor(const CodeGeneratorContext& c);
 
+// The static getWireSchema() of --gen-wire-schema, which returns the wire
+// schema of |type| in the format of aidl/wire_schema.h
+string WireSchemaMethod(const AidlDefinedType& type, const AidlTypenames& typenames);
+
 }  // namespace java
 }  // namespace aidl
 }  // namespace android
@@ -21,6 +21,7 @@
 #include <android-base/strings.h>
 
 #include <functional>
+#include <map>
 
 using ::android::base::Join;
 
@@ -164,14 +165,15 @@ TypeInfo ParcelableTypeInfo(const AidlParcelable& type) {
 TypeInfo EnumDeclarationTypeInfo(const AidlEnumDeclaration& enum_decl) {
   const std::string clazz = NdkFullClassName(enum_decl, cpp::ClassNames::RAW);
 
-  static map<std::string, std::string> kAParcelTypeNameMap = {
-      {"byte", "Byte"},
-      {"int", "Int32"},
-      {"long", "Int64"},
+  static constexpr AidlBuiltinTable<const char*> kAParcelTypeNameMap = {
+      {AidlBuiltinKind::BYTE, false, "Byte"},
+      {AidlBuiltinKind::INT, false, "Int32"},
+      {AidlBuiltinKind::LONG, false, "Int64"},
   };
-  auto aparcel_name_it = kAParcelTypeNameMap.find(enum_decl.GetBackingType().GetName());
-  CHECK(aparcel_name_it != kAParcelTypeNameMap.end());
-  const std::string aparcel_name = aparcel_name_it->second;
+  const char* const* aparcel_name_it =
+      kAParcelTypeNameMap.Find(enum_decl.GetBackingType().GetBuiltinKind(), false);
+  CHECK(aparcel_name_it != nullptr);
+  const std::string aparcel_name = *aparcel_name_it;
 
   const std::string backing_type_name =
       NdkNameOf(AidlTypenames(), enum_decl.GetBackingType(), StorageMode::STACK);
@@ -231,96 +233,100 @@ TypeInfo EnumDeclarationTypeInfo(const AidlEnumDeclaration& enum_decl) {
   };
 }
 
-// map from AIDL built-in type name to the corresponding Ndk type info
-static map<std::string, TypeInfo> kNdkTypeInfoMap = {
-    {"void", TypeInfo{{"void", true, nullptr, nullptr}, nullptr, nullptr, nullptr}},
-    {"boolean", PrimitiveType("bool", "Bool")},
-    {"byte", PrimitiveType("int8_t", "Byte")},
-    {"char", PrimitiveType("char16_t", "Char")},
-    {"int", PrimitiveType("int32_t", "Int32")},
-    {"long", PrimitiveType("int64_t", "Int64")},
-    {"float", PrimitiveType("float", "Float")},
-    {"double", PrimitiveType("double", "Double")},
-    {"String",
-     TypeInfo{
-         .raw =
-             TypeInfo::Aspect{
-                 .cpp_name = "std::string",
-                 .value_is_cheap = false,
-                 .read_func = StandardRead("::ndk::AParcel_readString"),
-                 .write_func = StandardWrite("::ndk::AParcel_writeString"),
-             },
-         .array = std::shared_ptr<TypeInfo::Aspect>(new TypeInfo::Aspect{
-             .cpp_name = "std::vector<std::string>",
-             .value_is_cheap = false,
-             .read_func = StandardRead("::ndk::AParcel_readVector"),
-             .write_func = StandardWrite("::ndk::AParcel_writeVector"),
-         }),
-         .nullable = std::shared_ptr<TypeInfo::Aspect>(new TypeInfo::Aspect{
-             .cpp_name = "std::optional<std::string>",
-             .value_is_cheap = false,
-             .read_func = StandardRead("::ndk::AParcel_readString"),
-             .write_func = StandardWrite("::ndk::AParcel_writeString"),
-         }),
-         .nullable_array = std::shared_ptr<TypeInfo::Aspect>(new TypeInfo::Aspect{
-             .cpp_name = "std::optional<std::vector<std::optional<std::string>>>",
-             .value_is_cheap = false,
-             .read_func = StandardRead("::ndk::AParcel_readVector"),
-             .write_func = StandardWrite("::ndk::AParcel_writeVector"),
-         }),
-     }},
-    // TODO(b/136048684) {"Map", ""},
-    {"IBinder",
-     TypeInfo{
-         .raw =
-             TypeInfo::Aspect{
-                 .cpp_name = "::ndk::SpAIBinder",
-                 .value_is_cheap = false,
-                 .read_func = StandardRead("::ndk::AParcel_readRequiredStrongBinder"),
-                 .write_func = StandardRead("::ndk::AParcel_writeRequiredStrongBinder"),
-             },
-         .array = nullptr,
-         .nullable = std::shared_ptr<TypeInfo::Aspect>(new TypeInfo::Aspect{
-             .cpp_name = "::ndk::SpAIBinder",
-             .value_is_cheap = false,
-             .read_func = StandardRead("::ndk::AParcel_readNullableStrongBinder"),
-             .write_func = StandardRead("::ndk::AParcel_writeNullableStrongBinder"),
-         }),
-         .nullable_array = nullptr,
-     }},
-    {"ParcelFileDescriptor",
-     TypeInfo{
-         .raw =
-             TypeInfo::Aspect{
-                 .cpp_name = "::ndk::ScopedFileDescriptor",
-                 .value_is_cheap = false,
-                 .read_func = StandardRead("::ndk::AParcel_readRequiredParcelFileDescriptor"),
-                 .write_func = StandardRead("::ndk::AParcel_writeRequiredParcelFileDescriptor"),
-             },
-         .array = std::shared_ptr<TypeInfo::Aspect>(new TypeInfo::Aspect{
-             .cpp_name = "std::vector<::ndk::ScopedFileDescriptor>",
-             .value_is_cheap = false,
-             .read_func = StandardRead("::ndk::AParcel_readVector"),
-             .write_func = StandardWrite("::ndk::AParcel_writeVector"),
-         }),
-         .nullable = std::shared_ptr<TypeInfo::Aspect>(new TypeInfo::Aspect{
-             .cpp_name = "::ndk::ScopedFileDescriptor",
-             .value_is_cheap = false,
-             .read_func = StandardRead("::ndk::AParcel_readNullableParcelFileDescriptor"),
-             .write_func = StandardRead("::ndk::AParcel_writeNullableParcelFileDescriptor"),
-         }),
-         .nullable_array = nullptr,
-     }},
-};
+// map from AIDL built-in type to the corresponding Ndk type info. It holds
+// std::functions, so it can't be constexpr; it is made on first use so that
+// only compilations for the NDK pay for it.
+static const AidlBuiltinTable<TypeInfo>& NdkTypeInfoMap() {
+  static const AidlBuiltinTable<TypeInfo> kNdkTypeInfoMap = {
+      {AidlBuiltinKind::VOID, false,
+       TypeInfo{{"void", true, nullptr, nullptr}, nullptr, nullptr, nullptr}},
+      {AidlBuiltinKind::BOOLEAN, false, PrimitiveType("bool", "Bool")},
+      {AidlBuiltinKind::BYTE, false, PrimitiveType("int8_t", "Byte")},
+      {AidlBuiltinKind::CHAR, false, PrimitiveType("char16_t", "Char")},
+      {AidlBuiltinKind::INT, false, PrimitiveType("int32_t", "Int32")},
+      {AidlBuiltinKind::LONG, false, PrimitiveType("int64_t", "Int64")},
+      {AidlBuiltinKind::FLOAT, false, PrimitiveType("float", "Float")},
+      {AidlBuiltinKind::DOUBLE, false, PrimitiveType("double", "Double")},
+      {AidlBuiltinKind::STRING, false,
+       TypeInfo{
+           .raw =
+               TypeInfo::Aspect{
+                   .cpp_name = "std::string",
+                   .value_is_cheap = false,
+                   .read_func = StandardRead("::ndk::AParcel_readString"),
+                   .write_func = StandardWrite("::ndk::AParcel_writeString"),
+               },
+           .array = std::shared_ptr<TypeInfo::Aspect>(new TypeInfo::Aspect{
+               .cpp_name = "std::vector<std::string>",
+               .value_is_cheap = false,
+               .read_func = StandardRead("::ndk::AParcel_readVector"),
+               .write_func = StandardWrite("::ndk::AParcel_writeVector"),
+           }),
+           .nullable = std::shared_ptr<TypeInfo::Aspect>(new TypeInfo::Aspect{
+               .cpp_name = "std::optional<std::string>",
+               .value_is_cheap = false,
+               .read_func = StandardRead("::ndk::AParcel_readString"),
+               .write_func = StandardWrite("::ndk::AParcel_writeString"),
+           }),
+           .nullable_array = std::shared_ptr<TypeInfo::Aspect>(new TypeInfo::Aspect{
+               .cpp_name = "std::optional<std::vector<std::optional<std::string>>>",
+               .value_is_cheap = false,
+               .read_func = StandardRead("::ndk::AParcel_readVector"),
+               .write_func = StandardWrite("::ndk::AParcel_writeVector"),
+           }),
+       }},
+      // TODO(b/136048684) {"Map", ""},
+      {AidlBuiltinKind::IBINDER, false,
+       TypeInfo{
+           .raw =
+               TypeInfo::Aspect{
+                   .cpp_name = "::ndk::SpAIBinder",
+                   .value_is_cheap = false,
+                   .read_func = StandardRead("::ndk::AParcel_readRequiredStrongBinder"),
+                   .write_func = StandardRead("::ndk::AParcel_writeRequiredStrongBinder"),
+               },
+           .array = nullptr,
+           .nullable = std::shared_ptr<TypeInfo::Aspect>(new TypeInfo::Aspect{
+               .cpp_name = "::ndk::SpAIBinder",
+               .value_is_cheap = false,
+               .read_func = StandardRead("::ndk::AParcel_readNullableStrongBinder"),
+               .write_func = StandardRead("::ndk::AParcel_writeNullableStrongBinder"),
+           }),
+           .nullable_array = nullptr,
+       }},
+      {AidlBuiltinKind::PARCEL_FILE_DESCRIPTOR, false,
+       TypeInfo{
+           .raw =
+               TypeInfo::Aspect{
+                   .cpp_name = "::ndk::ScopedFileDescriptor",
+                   .value_is_cheap = false,
+                   .read_func = StandardRead("::ndk::AParcel_readRequiredParcelFileDescriptor"),
+                   .write_func = StandardRead("::ndk::AParcel_writeRequiredParcelFileDescriptor"),
+               },
+           .array = std::shared_ptr<TypeInfo::Aspect>(new TypeInfo::Aspect{
+               .cpp_name = "std::vector<::ndk::ScopedFileDescriptor>",
+               .value_is_cheap = false,
+               .read_func = StandardRead("::ndk::AParcel_readVector"),
+               .write_func = StandardWrite("::ndk::AParcel_writeVector"),
+           }),
+           .nullable = std::shared_ptr<TypeInfo::Aspect>(new TypeInfo::Aspect{
+               .cpp_name = "::ndk::ScopedFileDescriptor",
+               .value_is_cheap = false,
+               .read_func = StandardRead("::ndk::AParcel_readNullableParcelFileDescriptor"),
+               .write_func = StandardRead("::ndk::AParcel_writeNullableParcelFileDescriptor"),
+           }),
+           .nullable_array = nullptr,
+       }},
+  };
+  return kNdkTypeInfoMap;
+}
 
 static TypeInfo::Aspect GetTypeAspect(const AidlTypenames& types, const AidlTypeSpecifier& aidl) {
   CHECK(aidl.IsResolved()) << aidl.ToString();
   auto& aidl_name = aidl.GetName();
 
-  TypeInfo info;
-
   // TODO(b/136048684): For now, List<T> is converted to T[].(Both are using vector<T>)
-  if (aidl_name == "List") {
+  if (aidl.GetBuiltinKind() == AidlBuiltinKind::LIST) {
     AIDL_FATAL_IF(!aidl.IsGeneric(), aidl) << "List must be generic type.";
     AIDL_FATAL_IF(aidl.GetTypeParameters().size() != 1, aidl)
         << "List can accept only one type parameter.";
@@ -340,41 +346,53 @@ static TypeInfo::Aspect GetTypeAspect(const AidlTypenames& types, const AidlType
   // All generic types should be handled above.
   AIDL_FATAL_IF(aidl.IsGeneric(), aidl);
 
-  if (AidlTypenames::IsBuiltinTypename(aidl_name)) {
-    auto it = kNdkTypeInfoMap.find(aidl_name);
-    CHECK(it != kNdkTypeInfoMap.end());
-    info = it->second;
+  // Built-in types are looked up in place; only defined types make theirs.
+  const TypeInfo* info = nullptr;
+  TypeInfo defined_info;
+  if (aidl.GetBuiltinKind()) {
+    info = NdkTypeInfoMap().Find(aidl.GetBuiltinKind(), false);
+    CHECK(info != nullptr) << aidl_name;
   } else {
     const AidlDefinedType* type = types.TryGetDefinedType(aidl_name);
     AIDL_FATAL_IF(type == nullptr, aidl_name) << "Unrecognized type.";
 
     if (const AidlInterface* intf = type->AsInterface(); intf != nullptr) {
-      info = InterfaceTypeInfo(*intf);
+      defined_info = InterfaceTypeInfo(*intf);
     } else if (const AidlParcelable* parcelable = type->AsParcelable(); parcelable != nullptr) {
-      info = ParcelableTypeInfo(*parcelable);
+      defined_info = ParcelableTypeInfo(*parcelable);
     } else if (const AidlEnumDeclaration* enum_decl = type->AsEnumDeclaration();
                enum_decl != nullptr) {
-      info = EnumDeclarationTypeInfo(*enum_decl);
+      defined_info = EnumDeclarationTypeInfo(*enum_decl);
     } else {
       AIDL_FATAL(aidl_name) << "Unrecognized type";
     }
+    info = &defined_info;
   }
 
+  if (aidl.IsFixedSizeArray()) {
+    return TypeInfo::Aspect{
+        .cpp_name = "std::array<" + info->raw.cpp_name + ", " +
+                    std::to_string(aidl.FixedArraySize()) + ">",
+        .value_is_cheap = false,
+        .read_func = StandardRead("::android::aidl::ReadFixedArray"),
+        .write_func = StandardWrite("::android::aidl::WriteFixedArray"),
+    };
+  }
   if (aidl.IsArray()) {
     if (aidl.IsNullable()) {
-      AIDL_FATAL_IF(info.nullable_array == nullptr, aidl) << "Unsupported type in NDK Backend.";
-      return *info.nullable_array;
+      AIDL_FATAL_IF(info->nullable_array == nullptr, aidl) << "Unsupported type in NDK Backend.";
+      return *info->nullable_array;
     }
-    AIDL_FATAL_IF(info.array == nullptr, aidl) << "Unsupported type in NDK Backend.";
-    return *info.array;
+    AIDL_FATAL_IF(info->array == nullptr, aidl) << "Unsupported type in NDK Backend.";
+    return *info->array;
   }
 
   if (aidl.IsNullable()) {
-    AIDL_FATAL_IF(info.nullable == nullptr, aidl) << "Unsupported type in NDK Backend.";
-    return *info.nullable;
+    AIDL_FATAL_IF(info->nullable == nullptr, aidl) << "Unsupported type in NDK Backend.";
+    return *info->nullable;
   }
 
-  return info.raw;
+  return info->raw;
 }
 
 std::string NdkFullClassName(const AidlDefinedType& type, cpp::ClassNames name) {
@@ -387,42 +405,101 @@ std::string NdkFullClassName(const AidlDefinedType& type, cpp::ClassNames name)
 }
 
 std::string NdkNameOf(const AidlTypenames& types, const AidlTypeSpecifier& aidl, StorageMode mode) {
-  TypeInfo::Aspect aspect = GetTypeAspect(types, aidl);
-
+  AidlTypeSpecifier::Memo memo;
   switch (mode) {
     case StorageMode::STACK:
-      return aspect.cpp_name;
+      memo = AidlTypeSpecifier::Memo::NDK_STACK_NAME;
+      break;
     case StorageMode::ARGUMENT:
-      if (aspect.value_is_cheap) {
-        return aspect.cpp_name;
-      } else {
-        return "const " + aspect.cpp_name + "&";
-      }
+      memo = AidlTypeSpecifier::Memo::NDK_ARGUMENT_NAME;
+      break;
     case StorageMode::OUT_ARGUMENT:
-      return aspect.cpp_name + "*";
+      memo = AidlTypeSpecifier::Memo::NDK_OUT_ARGUMENT_NAME;
+      break;
     default:
       AIDL_FATAL(aidl.GetName()) << "Unrecognized mode type: " << static_cast<int>(mode);
   }
+
+  return aidl.Memoized(memo, [&]() -> std::string {
+    if (mode == StorageMode::ARGUMENT && aidl.IsArrayView()) {
+      // The elements of the arrays that have views
+      static const std::map<std::string, std::string> kElements{
+          {"byte", "int8_t"}, {"int", "int32_t"}, {"float", "float"}};
+      return "::android::aidl::ArrayView<" + kElements.at(aidl.GetName()) + ">";
+    }
+    if (mode == StorageMode::ARGUMENT && aidl.IsStringView()) {
+      return "std::string_view";
+    }
+    TypeInfo::Aspect aspect = GetTypeAspect(types, aidl);
+    if (mode == StorageMode::OUT_ARGUMENT) {
+      return aspect.cpp_name + "*";
+    }
+    if (mode == StorageMode::ARGUMENT && !aspect.value_is_cheap) {
+      return "const " + aspect.cpp_name + "&";
+    }
+    return aspect.cpp_name;
+  });
+}
+
+std::string NdkPmrNameOf(const AidlTypenames& types, const AidlTypeSpecifier& aidl) {
+  if ((!aidl.IsArray() && !aidl.IsGeneric()) || aidl.IsFixedSizeArray()) {
+    return aidl.GetName() == "String" ? "std::pmr::string"
+                                      : NdkNameOf(types, aidl, StorageMode::STACK);
+  }
+  const std::string& element_name = aidl.IsGeneric()
+                                        ? aidl.GetTypeParameters()[0]->GetUnresolvedName()
+                                        : aidl.GetUnresolvedName();
+  AidlTypeSpecifier element = AidlTypeSpecifier(AIDL_LOCATION_HERE, element_name,
+                                                false /* isArray */, nullptr /* type_params */,
+                                                aidl.GetComments());
+  if (!element.Resolve(types)) {
+    AIDL_FATAL(aidl) << "The element type is wrong.";
+  }
+  return "std::pmr::vector<" + NdkPmrNameOf(types, element) + ">";
 }
 
 void WriteToParcelFor(const CodeGeneratorContext& c) {
+  if (c.type.IsArrayView()) {
+    StandardWrite("::android::aidl::WriteArrayView")(c);
+    return;
+  }
+  if (c.type.IsStringView()) {
+    StandardWrite("::android::aidl::WriteStringView")(c);
+    return;
+  }
+  if (c.type.IsSharedMemory()) {
+    c.writer << "::android::aidl::shared_memory::WriteBytes(" << c.parcel << ", " << c.var << ", "
+             << std::to_string(c.type.SharedMemoryThreshold()) << ")";
+    return;
+  }
   TypeInfo::Aspect aspect = GetTypeAspect(c.types, c.type);
   aspect.write_func(c);
 }
 
 void ReadFromParcelFor(const CodeGeneratorContext& c) {
+  if (c.type.IsSharedMemory()) {
+    StandardRead("::android::aidl::shared_memory::ReadBytes")(c);
+    return;
+  }
   TypeInfo::Aspect aspect = GetTypeAspect(c.types, c.type);
   aspect.read_func(c);
 }
 
 std::string NdkArgList(
-    const AidlTypenames& types, const AidlMethod& method,
+    const AidlTypenames& types, const AidlInterface& interface, const AidlMethod& method,
     std::function<std::string(const std::string& type, const std::string& name, bool isOut)>
         formatter) {
+  const bool moves_in = cpp::MovesInArguments(interface, method);
   std::vector<std::string> method_arguments;
   for (const auto& a : method.GetArguments()) {
     StorageMode mode = a->IsOut() ? StorageMode::OUT_ARGUMENT : StorageMode::ARGUMENT;
     std::string type = NdkNameOf(types, a->GetType(), mode);
+    if (moves_in && mode == StorageMode::ARGUMENT && !a->GetType().IsArrayView() &&
+        !a->GetType().IsStringView() &&
+        !GetTypeAspect(types, a->GetType()).value_is_cheap) {
+      // With @MoveIn, 'const T&' becomes 'T&&'
+      type = GetTypeAspect(types, a->GetType()).cpp_name + "&&";
+    }
     std::string name = cpp::BuildVarName(*a);
     method_arguments.emplace_back(formatter(type, name, a->IsOut()));
   }
@@ -436,11 +513,11 @@ std::string NdkArgList(
   return Join(method_arguments, ", ");
 }
 
-std::string NdkMethodDecl(const AidlTypenames& types, const AidlMethod& method,
-                          const std::string& clazz) {
+std::string NdkMethodDecl(const AidlTypenames& types, const AidlInterface& interface,
+                          const AidlMethod& method, const std::string& clazz) {
   std::string class_prefix = clazz.empty() ? "" : (clazz + "::");
   return "::ndk::ScopedAStatus " + class_prefix + method.GetName() + "(" +
-         NdkArgList(types, method, FormatArgForDecl) + ")";
+         NdkArgList(types, interface, method, FormatArgForDecl) + ")";
 }
 
 }  // namespace ndk
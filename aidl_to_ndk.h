@@ -40,6 +40,10 @@ std::string NdkFullClassName(const AidlDefinedType& type, cpp::ClassNames name);
 // array modifiers.
 std::string NdkNameOf(const AidlTypenames& types, const AidlTypeSpecifier& aidl, StorageMode mode);
 
+// Returns the Ndk type name of a field of a @PolymorphicAllocator parcelable,
+// where the arrays, the Lists and the Strings are std::pmr types.
+std::string NdkPmrNameOf(const AidlTypenames& types, const AidlTypeSpecifier& aidl);
+
 struct CodeGeneratorContext {
   CodeWriter& writer;
 
@@ -53,9 +57,10 @@ struct CodeGeneratorContext {
 void WriteToParcelFor(const CodeGeneratorContext& c);
 void ReadFromParcelFor(const CodeGeneratorContext& c);
 
-// Returns argument list of a method where each arg is formatted by the fomatter
+// Returns argument list of a method where each arg is formatted by the fomatter.
+// The in arguments of methods with @MoveIn that are not cheap to copy are 'T&&'.
 std::string NdkArgList(
-    const AidlTypenames& types, const AidlMethod& method,
+    const AidlTypenames& types, const AidlInterface& interface, const AidlMethod& method,
     std::function<std::string(const std::string& type, const std::string& name, bool isOut)>
         formatter);
 
@@ -69,20 +74,21 @@ inline std::string FormatArgNameUnused(const std::string& type, const std::strin
   return type + " /*" + name + "*/";
 }
 
-inline std::string FormatArgForCall(const std::string& /*type*/, const std::string& name,
-                                    bool isOut) {
-  std::string reference_prefix = isOut ? "&" : "";
-  return reference_prefix + name;
+// Moves the arguments that are rvalue references along
+inline std::string FormatArgNameOnly(const std::string& type, const std::string& name,
+                                     bool /*isOut*/) {
+  const bool is_rvalue_reference = type.size() > 2 && type.compare(type.size() - 2, 2, "&&") == 0;
+  return is_rvalue_reference ? "std::move(" + name + ")" : name;
 }
 
-inline std::string FormatArgNameOnly(const std::string& /*type*/, const std::string& name,
-                                     bool /*isOut*/) {
-  return name;
+inline std::string FormatArgForCall(const std::string& type, const std::string& name,
+                                    bool isOut) {
+  return isOut ? "&" + name : FormatArgNameOnly(type, name, isOut);
 }
 
 // -> 'status (class::)name(type name, ...)' for a method
-std::string NdkMethodDecl(const AidlTypenames& types, const AidlMethod& method,
-                          const std::string& clazz = "");
+std::string NdkMethodDecl(const AidlTypenames& types, const AidlInterface& interface,
+                          const AidlMethod& method, const std::string& clazz = "");
 
 }  // namespace ndk
 }  // namespace aidl
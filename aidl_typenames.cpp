@@ -20,9 +20,9 @@
 
 #include <android-base/strings.h>
 
+#include <algorithm>
 #include <map>
 #include <memory>
-#include <set>
 #include <string>
 #include <utility>
 #include <vector>
@@ -30,9 +30,7 @@
 using android::base::Split;
 
 using std::make_pair;
-using std::map;
 using std::pair;
-using std::set;
 using std::string;
 using std::unique_ptr;
 using std::vector;
@@ -40,53 +38,108 @@ using std::vector;
 namespace android {
 namespace aidl {
 
-// The built-in AIDL types..
-static const set<string> kBuiltinTypes = {
-    "void", "boolean", "byte",           "char",         "int",
-    "long", "float",   "double",         "String",       "List",
-    "Map",  "IBinder", "FileDescriptor", "CharSequence", "ParcelFileDescriptor"};
+namespace {
 
-static const set<string> kPrimitiveTypes = {"void", "boolean", "byte",  "char",
-                                            "int",  "long",    "float", "double"};
+// The tables below are sorted arrays rather than sets and maps, so that they
+// are laid out at compile time instead of being built with heap allocations
+// by every aidl process.
+template <typename T, size_t N, typename KeyOf>
+constexpr bool IsSortedBy(const T (&entries)[N], KeyOf key_of) {
+  for (size_t i = 1; i < N; i++) {
+    if (!(key_of(entries[i - 1]) < key_of(entries[i]))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename T, size_t N, typename KeyOf>
+const T* FindSorted(const T (&entries)[N], std::string_view key, KeyOf key_of) {
+  auto it = std::lower_bound(std::begin(entries), std::end(entries), key,
+                             [&](const T& entry, std::string_view k) { return key_of(entry) < k; });
+  return it != std::end(entries) && key_of(*it) == key ? it : nullptr;
+}
+
+// Keys of the tables
+constexpr auto Self = [](std::string_view name) { return name; };
+constexpr auto NameOf = [](const auto& entry) { return entry.name; };
+
+struct BuiltinType {
+  std::string_view name;
+  AidlBuiltinKind kind;
+};
+
+// The built-in AIDL types, sorted by name
+constexpr BuiltinType kBuiltinTypes[] = {
+    {"CharSequence", AidlBuiltinKind::CHAR_SEQUENCE},
+    {"FileDescriptor", AidlBuiltinKind::FILE_DESCRIPTOR},
+    {"IBinder", AidlBuiltinKind::IBINDER},
+    {"List", AidlBuiltinKind::LIST},
+    {"Map", AidlBuiltinKind::MAP},
+    {"ParcelFileDescriptor", AidlBuiltinKind::PARCEL_FILE_DESCRIPTOR},
+    {"String", AidlBuiltinKind::STRING},
+    {"boolean", AidlBuiltinKind::BOOLEAN},
+    {"byte", AidlBuiltinKind::BYTE},
+    {"char", AidlBuiltinKind::CHAR},
+    {"double", AidlBuiltinKind::DOUBLE},
+    {"float", AidlBuiltinKind::FLOAT},
+    {"int", AidlBuiltinKind::INT},
+    {"long", AidlBuiltinKind::LONG},
+    {"void", AidlBuiltinKind::VOID},
+};
+static_assert(IsSortedBy(kBuiltinTypes, NameOf));
+
+struct JavaLikeType {
+  std::string_view name;
+  std::string_view aidl_name;
+};
 
 // Note: these types may look wrong because they look like Java
 // types, but they have long been supported from the time when Java
 // was the only target language of this compiler. They are added here for
 // backwards compatibility, but we internally treat them as List and Map,
 // respectively.
-static const map<string, string> kJavaLikeTypeToAidlType = {
+constexpr JavaLikeType kJavaLikeTypeToAidlType[] = {
+    {"android.os.ParcelFileDescriptor", "ParcelFileDescriptor"},
     {"java.util.List", "List"},
     {"java.util.Map", "Map"},
-    {"android.os.ParcelFileDescriptor", "ParcelFileDescriptor"},
 };
+static_assert(IsSortedBy(kJavaLikeTypeToAidlType, NameOf));
 
 // Package name and type name can't be one of these as they are keywords
 // in Java and C++. Using these names will eventually cause compilation error,
 // so checking this here is not a must have, but early detection of errors
 // is always better.
-static const set<string> kInvalidNames = {
+constexpr std::string_view kInvalidNames[] = {
     "break",  "case",   "catch", "char",     "class",  "continue", "default",
     "do",     "double", "else",  "enum",     "false",  "float",    "for",
     "goto",   "if",     "int",   "long",     "new",    "private",  "protected",
     "public", "return", "short", "static",   "switch", "this",     "throw",
     "true",   "try",    "void",  "volatile", "while"};
+static_assert(IsSortedBy(kInvalidNames, Self));
+
+// These known built-in types don't need to be imported
+constexpr std::string_view kIgnorableImports[] = {
+    "android.content.Context", "android.os.IBinder",    "android.os.IInterface",
+    "android.os.Parcel",       "android.os.Parcelable", "java.lang.CharSequence",
+    "java.lang.String"};
+static_assert(IsSortedBy(kIgnorableImports, Self));
 
-static bool IsValidName(const string& name) {
-  vector<string> pieces = Split(name, ".");
-  for (const auto& piece : pieces) {
-    if (kInvalidNames.find(piece) != kInvalidNames.end()) {
+bool IsValidName(std::string_view name) {
+  for (size_t begin = 0; begin <= name.size();) {
+    const size_t end = std::min(name.find('.', begin), name.size());
+    if (FindSorted(kInvalidNames, name.substr(begin, end - begin), Self) != nullptr) {
       return false;
     }
+    begin = end + 1;
   }
   return true;
 }
 
+}  // namespace
+
 bool AidlTypenames::IsIgnorableImport(const string& import) const {
-  static set<string> ignore_import = {
-      "android.os.IInterface",   "android.os.IBinder", "android.os.Parcelable", "android.os.Parcel",
-      "android.content.Context", "java.lang.String",   "java.lang.CharSequence"};
-  // these known built-in types don't need to be imported
-  const bool in_ignore_import = ignore_import.find(import) != ignore_import.end();
+  const bool in_ignore_import = FindSorted(kIgnorableImports, import, Self) != nullptr;
   // an already defined type doesn't need to be imported again unless it is from
   // the preprocessed file
   auto ret = TryGetDefinedTypeImpl(import);
@@ -94,68 +147,216 @@ bool AidlTypenames::IsIgnorableImport(const string& import) const {
   return in_ignore_import || defined_type_not_from_preprocessed;
 }
 
-bool AidlTypenames::AddDefinedType(unique_ptr<AidlDefinedType> type) {
-  const string name = type->GetCanonicalName();
-  if (defined_types_.find(name) != defined_types_.end()) {
+bool AidlTypenames::TypeTable::Add(unique_ptr<AidlDefinedType> type) {
+  string name = type->GetCanonicalName();
+  if (by_canonical_name_.count(name) > 0) {
     return false;
   }
+  const AidlDefinedType* added = type.get();
+  auto it = types_.emplace(std::move(name), std::move(type)).first;
+  by_canonical_name_.emplace(it->first, added);
+  auto [simple, inserted] = by_simple_name_.emplace(added->GetName(), it);
+  if (!inserted && it->first < simple->second->first) {
+    simple->second = it;
+  }
+  return true;
+}
+
+const AidlDefinedType* AidlTypenames::TypeTable::Find(std::string_view canonical_name) const {
+  auto found = by_canonical_name_.find(canonical_name);
+  return found != by_canonical_name_.end() ? found->second : nullptr;
+}
+
+const AidlDefinedType* AidlTypenames::TypeTable::FindBySimpleName(std::string_view name) const {
+  auto found = by_simple_name_.find(name);
+  return found != by_simple_name_.end() ? found->second->second.get() : nullptr;
+}
+
+void AidlTypenames::TypeTable::Clear() {
+  by_simple_name_.clear();
+  by_canonical_name_.clear();
+  types_.clear();
+}
+
+bool AidlTypenames::AddDefinedType(unique_ptr<AidlDefinedType> type) {
   if (!IsValidName(type->GetPackage()) || !IsValidName(type->GetName())) {
     return false;
   }
-  defined_types_.emplace(name, std::move(type));
-  return true;
+  return defined_types_.Add(std::move(type));
 }
 
 bool AidlTypenames::AddPreprocessedType(unique_ptr<AidlDefinedType> type) {
-  const string name = type->GetCanonicalName();
-  if (preprocessed_types_.find(name) != preprocessed_types_.end()) {
+  if (!IsValidName(type->GetPackage()) || !IsValidName(type->GetName())) {
     return false;
   }
-  if (!IsValidName(type->GetPackage()) || !IsValidName(type->GetName())) {
+  std::lock_guard<std::mutex> lock(preprocessed_mutex_);
+  if (pending_by_canonical_name_.count(type->GetCanonicalName()) > 0) {
+    return false;
+  }
+  return preprocessed_types_.Add(std::move(type));
+}
+
+bool AidlTypenames::AddPreprocessedDeclaration(PreprocessedKind kind,
+                                               std::string_view qualified_name,
+                                               const string& filename, int line) {
+  // Checked like AddPreprocessedType does, since the package and the name
+  // are the pieces of the qualified name.
+  if (!IsValidName(qualified_name)) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(preprocessed_mutex_);
+  if (preprocessed_types_.Find(qualified_name) != nullptr) {
     return false;
   }
-  preprocessed_types_.insert(make_pair(name, std::move(type)));
+  if (preprocessed_files_.empty() || preprocessed_files_.back() != filename) {
+    preprocessed_files_.push_back(filename);
+  }
+  PendingDeclaration pending{kind, qualified_name, preprocessed_files_.size() - 1, line};
+  if (!pending_by_canonical_name_.emplace(qualified_name, pending).second) {
+    return false;
+  }
+  const size_t dot = qualified_name.rfind('.');
+  const std::string_view name =
+      dot == std::string_view::npos ? qualified_name : qualified_name.substr(dot + 1);
+  pending_by_simple_name_[name].push_back(qualified_name);
   return true;
 }
 
+void AidlTypenames::Materialize(const PendingDeclaration& pending) const {
+  // Note that this logic is absolutely wrong.  Given a parcelable
+  // org.some.Foo.Bar, the class name is Foo.Bar, but this code will claim that
+  // the class is just Bar.  However, this was the way it was done in the past.
+  //
+  // See b/17415692
+  const string qualified_name(pending.qualified_name);
+  const size_t dot = qualified_name.rfind('.');
+  string class_name = qualified_name;
+  vector<string> package;
+  if (dot != string::npos) {
+    class_name = qualified_name.substr(dot + 1);
+    package = Split(qualified_name.substr(0, dot), ".");
+  }
+
+  // The nodes belong to these typenames, whatever arena the thread that
+  // looks them up is using.
+  AidlArena::Scope arena_scope(arena_.get());
+  AidlLocation::Point point = {pending.line, 0 /*column*/};
+  AidlLocation location(preprocessed_files_[pending.file], point, point);
+  unique_ptr<AidlDefinedType> type;
+  switch (pending.kind) {
+    case PreprocessedKind::PARCELABLE:
+      type.reset(new AidlParcelable(location, new AidlQualifiedName(location, class_name, ""),
+                                    package, "" /* comments */));
+      break;
+    case PreprocessedKind::STRUCTURED_PARCELABLE: {
+      std::vector<std::unique_ptr<AidlVariableDeclaration>> fields;
+      type.reset(new AidlStructuredParcelable(location,
+                                              new AidlQualifiedName(location, class_name, ""),
+                                              package, "" /* comments */, &fields));
+      break;
+    }
+    case PreprocessedKind::INTERFACE: {
+      // The interface takes the members.
+      auto members = new std::vector<std::unique_ptr<AidlMember>>();
+      type.reset(new AidlInterface(location, class_name, "", false, members, package));
+      break;
+    }
+  }
+  preprocessed_types_.Add(std::move(type));
+}
+
+void AidlTypenames::MaterializeCanonicalName(std::string_view canonical_name) const {
+  auto found = pending_by_canonical_name_.find(canonical_name);
+  if (found == pending_by_canonical_name_.end()) {
+    return;
+  }
+  const PendingDeclaration pending = found->second;
+  pending_by_canonical_name_.erase(found);
+  const size_t dot = pending.qualified_name.rfind('.');
+  auto simple = pending_by_simple_name_.find(dot == std::string_view::npos
+                                                 ? pending.qualified_name
+                                                 : pending.qualified_name.substr(dot + 1));
+  auto& names = simple->second;
+  names.erase(std::find(names.begin(), names.end(), pending.qualified_name));
+  if (names.empty()) {
+    pending_by_simple_name_.erase(simple);
+  }
+  Materialize(pending);
+}
+
+void AidlTypenames::MaterializeSimpleName(std::string_view name) const {
+  auto simple = pending_by_simple_name_.find(name);
+  if (simple == pending_by_simple_name_.end()) {
+    return;
+  }
+  // All of them, since the one with the smallest canonical name wins.
+  const vector<std::string_view> names = std::move(simple->second);
+  pending_by_simple_name_.erase(simple);
+  for (std::string_view canonical_name : names) {
+    auto found = pending_by_canonical_name_.find(canonical_name);
+    const PendingDeclaration pending = found->second;
+    pending_by_canonical_name_.erase(found);
+    Materialize(pending);
+  }
+}
+
+void AidlTypenames::MaterializeAll() const {
+  for (const auto& [canonical_name, pending] : pending_by_canonical_name_) {
+    Materialize(pending);
+  }
+  pending_by_canonical_name_.clear();
+  pending_by_simple_name_.clear();
+}
+
 bool AidlTypenames::IsBuiltinTypename(const string& type_name) {
-  return kBuiltinTypes.find(type_name) != kBuiltinTypes.end() ||
-      kJavaLikeTypeToAidlType.find(type_name) != kJavaLikeTypeToAidlType.end();
+  return GetBuiltinKind(type_name).has_value();
+}
+
+std::optional<AidlBuiltinKind> AidlTypenames::GetBuiltinKind(std::string_view type_name) {
+  if (auto found = FindSorted(kJavaLikeTypeToAidlType, type_name, NameOf); found != nullptr) {
+    type_name = found->aidl_name;
+  }
+  if (auto found = FindSorted(kBuiltinTypes, type_name, NameOf); found != nullptr) {
+    return found->kind;
+  }
+  return std::nullopt;
 }
 
 bool AidlTypenames::IsPrimitiveTypename(const string& type_name) {
-  return kPrimitiveTypes.find(type_name) != kPrimitiveTypes.end();
+  // The primitive types are the kinds up to DOUBLE, which have no Java-like names.
+  auto found = FindSorted(kBuiltinTypes, type_name, NameOf);
+  return found != nullptr && found->kind <= AidlBuiltinKind::DOUBLE;
 }
 
-const AidlDefinedType* AidlTypenames::TryGetDefinedType(const string& type_name) const {
+const AidlDefinedType* AidlTypenames::TryGetDefinedType(std::string_view type_name) const {
   return TryGetDefinedTypeImpl(type_name).type;
 }
 
 AidlTypenames::DefinedImplResult AidlTypenames::TryGetDefinedTypeImpl(
-    const string& type_name) const {
+    std::string_view type_name) const {
   // Do the exact match first.
-  auto found_def = defined_types_.find(type_name);
-  if (found_def != defined_types_.end()) {
-    return DefinedImplResult(found_def->second.get(), false);
+  if (auto type = defined_types_.Find(type_name); type != nullptr) {
+    return DefinedImplResult(type, false);
   }
 
-  auto found_prep = preprocessed_types_.find(type_name);
-  if (found_prep != preprocessed_types_.end()) {
-    return DefinedImplResult(found_prep->second.get(), true);
+  {
+    std::lock_guard<std::mutex> lock(preprocessed_mutex_);
+    MaterializeCanonicalName(type_name);
+    if (auto type = preprocessed_types_.Find(type_name); type != nullptr) {
+      return DefinedImplResult(type, true);
+    }
   }
 
   // Then match with the class name. Defined types has higher priority than
   // types from the preprocessed file.
-  for (auto it = defined_types_.begin(); it != defined_types_.end(); it++) {
-    if (it->second->GetName() == type_name) {
-      return DefinedImplResult(it->second.get(), false);
-    }
+  if (auto type = defined_types_.FindBySimpleName(type_name); type != nullptr) {
+    return DefinedImplResult(type, false);
   }
 
-  for (auto it = preprocessed_types_.begin(); it != preprocessed_types_.end(); it++) {
-    if (it->second->GetName() == type_name) {
-      return DefinedImplResult(it->second.get(), true);
-    }
+  std::lock_guard<std::mutex> lock(preprocessed_mutex_);
+  MaterializeSimpleName(type_name);
+  if (auto type = preprocessed_types_.FindBySimpleName(type_name); type != nullptr) {
+    return DefinedImplResult(type, true);
   }
 
   return DefinedImplResult(nullptr, false);
@@ -163,9 +364,8 @@ AidlTypenames::DefinedImplResult AidlTypenames::TryGetDefinedTypeImpl(
 
 pair<string, bool> AidlTypenames::ResolveTypename(const string& type_name) const {
   if (IsBuiltinTypename(type_name)) {
-    auto found = kJavaLikeTypeToAidlType.find(type_name);
-    if (found != kJavaLikeTypeToAidlType.end()) {
-      return make_pair(found->second, true);
+    if (auto found = FindSorted(kJavaLikeTypeToAidlType, type_name, NameOf); found != nullptr) {
+      return make_pair(string(found->aidl_name), true);
     }
     return make_pair(type_name, true);
   }
@@ -198,6 +398,17 @@ const AidlEnumDeclaration* AidlTypenames::GetEnumDeclaration(const AidlTypeSpeci
   return nullptr;
 }
 
+std::optional<AidlBuiltinKind> AidlTypenames::GetBackingBuiltinKind(
+    const AidlTypeSpecifier& type) const {
+  if (auto kind = type.GetBuiltinKind(); kind) {
+    return kind;
+  }
+  if (auto enum_decl = GetEnumDeclaration(type); enum_decl != nullptr) {
+    return enum_decl->GetBackingType().GetBuiltinKind();
+  }
+  return std::nullopt;
+}
+
 const AidlInterface* AidlTypenames::GetInterface(const AidlTypeSpecifier& type) const {
   if (auto defined_type = TryGetDefinedType(type.GetName()); defined_type != nullptr) {
     if (auto intf = defined_type->AsInterface(); intf != nullptr) {
@@ -208,17 +419,39 @@ const AidlInterface* AidlTypenames::GetInterface(const AidlTypeSpecifier& type)
 }
 
 void AidlTypenames::IterateTypes(const std::function<void(const AidlDefinedType&)>& body) const {
+  {
+    std::lock_guard<std::mutex> lock(preprocessed_mutex_);
+    MaterializeAll();
+  }
+  IterateLoadedTypes(body);
+}
+
+void AidlTypenames::IterateLoadedTypes(
+    const std::function<void(const AidlDefinedType&)>& body) const {
   for (const auto& kv : defined_types_) {
     body(*kv.second);
   }
-  for (const auto& kv : preprocessed_types_) {
-    body(*kv.second);
+  // The body may look up, and so make, other preprocessed types.
+  vector<const AidlDefinedType*> preprocessed;
+  {
+    std::lock_guard<std::mutex> lock(preprocessed_mutex_);
+    for (const auto& kv : preprocessed_types_) {
+      preprocessed.push_back(kv.second.get());
+    }
+  }
+  for (const AidlDefinedType* type : preprocessed) {
+    body(*type);
   }
 }
 
 void AidlTypenames::Reset() {
-  defined_types_.clear();
-  preprocessed_types_.clear();
+  defined_types_.Clear();
+  compiled_types_.clear();
+  std::lock_guard<std::mutex> lock(preprocessed_mutex_);
+  preprocessed_types_.Clear();
+  pending_by_canonical_name_.clear();
+  pending_by_simple_name_.clear();
+  preprocessed_files_.clear();
 }
 
 }  // namespace aidl
@@ -15,11 +15,19 @@
  */
 #pragma once
 
+#include "aidl_arena.h"
+
+#include <cstddef>
 #include <functional>
+#include <initializer_list>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <set>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -38,6 +46,66 @@ class AidlTypeSpecifier;
 namespace android {
 namespace aidl {
 
+// The built-in AIDL types. Type specifiers know theirs once they are
+// resolved, so backends look up how to handle them in tables indexed with
+// the kind (see AidlBuiltinTable) instead of by name.
+enum class AidlBuiltinKind {
+  VOID,
+  BOOLEAN,
+  BYTE,
+  CHAR,
+  INT,
+  LONG,
+  FLOAT,
+  DOUBLE,
+  STRING,
+  LIST,
+  MAP,
+  IBINDER,
+  FILE_DESCRIPTOR,
+  CHAR_SEQUENCE,
+  PARCEL_FILE_DESCRIPTOR,
+};
+constexpr size_t kAidlBuiltinKindCount = 15;
+
+// A table of values for the built-in types and arrays of them, indexed with
+// AidlBuiltinKind. Types that have no entry are absent from the table.
+template <typename T>
+class AidlBuiltinTable {
+ public:
+  struct Entry {
+    AidlBuiltinKind kind;
+    bool is_array;
+    T value;
+  };
+
+  constexpr AidlBuiltinTable(std::initializer_list<Entry> entries) {
+    for (const Entry& entry : entries) {
+      const size_t index = Index(entry.kind, entry.is_array);
+      values_[index] = entry.value;
+      present_[index] = true;
+    }
+  }
+
+  // Returns nullptr if there is no entry for the type, or if it isn't a
+  // built-in type at all.
+  constexpr const T* Find(std::optional<AidlBuiltinKind> kind, bool is_array) const {
+    if (!kind) {
+      return nullptr;
+    }
+    const size_t index = Index(*kind, is_array);
+    return present_[index] ? &values_[index] : nullptr;
+  }
+
+ private:
+  static constexpr size_t Index(AidlBuiltinKind kind, bool is_array) {
+    return static_cast<size_t>(kind) * 2 + (is_array ? 1 : 0);
+  }
+
+  T values_[kAidlBuiltinKindCount * 2] = {};
+  bool present_[kAidlBuiltinKindCount * 2] = {};
+};
+
 // AidlTypenames is a collection of AIDL types available to a compilation unit.
 //
 // Basic types (such as int, String, etc.) are added by default, while defined
@@ -55,20 +123,46 @@ class AidlTypenames final {
   void Reset();
   bool AddDefinedType(unique_ptr<AidlDefinedType> type);
   bool AddPreprocessedType(unique_ptr<AidlDefinedType> type);
+  // The kinds of the declarations of preprocessed files.
+  enum class PreprocessedKind { PARCELABLE, STRUCTURED_PARCELABLE, INTERFACE };
+  // Adds a type of a preprocessed file by its name only. The type is made
+  // when it is first looked up, with its location at |line| of |filename|.
+  // |qualified_name| must stay valid as long as this, e.g. by living in a
+  // buffer retained by Arena(). Returns false like AddPreprocessedType.
+  bool AddPreprocessedDeclaration(PreprocessedKind kind, std::string_view qualified_name,
+                                  const string& filename, int line);
   static bool IsBuiltinTypename(const string& type_name);
+  // Returns the kind of a built-in type name, also of the Java-like names
+  // like java.util.List, or nullopt for any other name.
+  static std::optional<AidlBuiltinKind> GetBuiltinKind(std::string_view type_name);
   static bool IsPrimitiveTypename(const string& type_name);
-  const AidlDefinedType* TryGetDefinedType(const string& type_name) const;
+  const AidlDefinedType* TryGetDefinedType(std::string_view type_name) const;
   pair<string, bool> ResolveTypename(const string& type_name) const;
   bool CanBeOutParameter(const AidlTypeSpecifier& type) const;
   bool IsIgnorableImport(const string& import) const;
   // Returns the AidlEnumDeclaration of the given type, or nullptr if the type
   // is not an AidlEnumDeclaration;
   const AidlEnumDeclaration* GetEnumDeclaration(const AidlTypeSpecifier& type) const;
+  // Returns the kind of a built-in type, or for an enum the kind of its
+  // backing type. Returns nullopt for other defined types.
+  std::optional<AidlBuiltinKind> GetBackingBuiltinKind(const AidlTypeSpecifier& type) const;
   // Returns the AidlInterface of the given type, or nullptr if the type
   // is not an AidlInterface;
   const AidlInterface* GetInterface(const AidlTypeSpecifier& type) const;
   // Iterates over all defined and then preprocessed types
   void IterateTypes(const std::function<void(const AidlDefinedType&)>& body) const;
+  // Like IterateTypes, but skips the preprocessed declarations that nothing
+  // has looked up yet. These are never enums.
+  void IterateLoadedTypes(const std::function<void(const AidlDefinedType&)>& body) const;
+  // The arena that parsers allocate the nodes of these types from.
+  const std::shared_ptr<AidlArena>& Arena() const { return arena_; }
+  // Marks |type| as defined by an input of the compilation rather than only
+  // imported, so that its code is generated with the same options.
+  void MarkCompiled(const AidlDefinedType* type) { compiled_types_.insert(type); }
+  // Whether |type| is defined by an input of the compilation. The code of the
+  // other types may have been generated with other options, or by an older
+  // compiler.
+  bool IsCompiled(const AidlDefinedType& type) const { return compiled_types_.count(&type) > 0; }
 
  private:
   struct DefinedImplResult {
@@ -77,9 +171,56 @@ class AidlTypenames final {
     const AidlDefinedType* type;
     const bool from_preprocessed;
   };
-  DefinedImplResult TryGetDefinedTypeImpl(const string& type_name) const;
-  map<string, unique_ptr<AidlDefinedType>> defined_types_;
-  map<string, unique_ptr<AidlDefinedType>> preprocessed_types_;
+  DefinedImplResult TryGetDefinedTypeImpl(std::string_view type_name) const;
+
+  // A preprocessed declaration whose type isn't made yet
+  struct PendingDeclaration {
+    PreprocessedKind kind;
+    std::string_view qualified_name;
+    size_t file;  // index into preprocessed_files_
+    int line;
+  };
+  // These make the pending types with the given canonical or simple name, or
+  // all of them. preprocessed_mutex_ must be held.
+  void MaterializeCanonicalName(std::string_view canonical_name) const;
+  void MaterializeSimpleName(std::string_view name) const;
+  void MaterializeAll() const;
+  void Materialize(const PendingDeclaration& pending) const;
+
+  // Types by canonical name. The ordered map owns the types and keeps
+  // IterateTypes deterministic; lookups go through the hashed indices, whose
+  // keys refer to the names owned by the map and by the types.
+  class TypeTable {
+   public:
+    bool Add(unique_ptr<AidlDefinedType> type);
+    const AidlDefinedType* Find(std::string_view canonical_name) const;
+    // Among the types with the given unqualified name, returns the one with
+    // the smallest canonical name.
+    const AidlDefinedType* FindBySimpleName(std::string_view name) const;
+    void Clear();
+
+    using Map = map<string, unique_ptr<AidlDefinedType>>;
+    Map::const_iterator begin() const { return types_.begin(); }
+    Map::const_iterator end() const { return types_.end(); }
+
+   private:
+    Map types_;
+    std::unordered_map<std::string_view, const AidlDefinedType*> by_canonical_name_;
+    std::unordered_map<std::string_view, Map::const_iterator> by_simple_name_;
+  };
+
+  // Declared first so that it is released after the types.
+  const std::shared_ptr<AidlArena> arena_ = std::make_shared<AidlArena>();
+  TypeTable defined_types_;
+
+  // Preprocessed types are made on lookups, which may come from several
+  // threads once the types are validated, so they are guarded by the mutex.
+  mutable std::mutex preprocessed_mutex_;
+  mutable TypeTable preprocessed_types_;
+  mutable std::unordered_map<std::string_view, PendingDeclaration> pending_by_canonical_name_;
+  mutable std::unordered_map<std::string_view, vector<std::string_view>> pending_by_simple_name_;
+  vector<string> preprocessed_files_;
+  std::set<const AidlDefinedType*> compiled_types_;
 };
 
 }  // namespace aidl
@@ -14,6 +14,8 @@
  * limitations under the License.
  */
 
+#include <algorithm>
+#include <map>
 #include <memory>
 #include <set>
 #include <string>
@@ -23,10 +25,18 @@
 #include <gtest/gtest.h>
 
 #include "aidl.h"
+#include "aidl/mapping_table.h"
+#include "aidl/wire_schema.h"
+#include "aidl_cache.h"
 #include "aidl_checkapi.h"
 #include "aidl_language.h"
+#include "aidl_precompile.h"
+#include "aidl_profile.h"
+#include "aidl_scandeps.h"
 #include "aidl_to_cpp.h"
 #include "aidl_to_java.h"
+#include "aidl_wire_schema.h"
+#include "code_writer.h"
 #include "options.h"
 #include "tests/fake_io_delegate.h"
 
@@ -323,6 +333,33 @@ TEST_F(AidlTest, ParsesUtf8Annotations) {
   }
 }
 
+TEST_F(AidlTest, AnnotationPredicatesTestOnlyTheirOwnAnnotation) {
+  auto parse_result = Parse("a/IFoo.aidl",
+                            "package a; interface IFoo {"
+                            "  @nullable @utf8InCpp String f(in @ArrayView byte[] b,"
+                            "                                in @SharedMemory(threshold=16) byte[] c);"
+                            "}",
+                            typenames_, Options::Language::CPP);
+  ASSERT_NE(nullptr, parse_result);
+  const AidlMethod& method = *parse_result->AsInterface()->GetMethods()[0];
+  EXPECT_TRUE(method.GetType().IsNullable());
+  EXPECT_TRUE(method.GetType().IsUtf8InCpp());
+  EXPECT_FALSE(method.GetType().IsArrayView());
+  EXPECT_FALSE(method.GetType().IsHide());
+  EXPECT_EQ(-1, method.GetType().SharedMemoryThreshold());
+
+  const AidlTypeSpecifier& view = method.GetArguments()[0]->GetType();
+  EXPECT_TRUE(view.IsArrayView());
+  EXPECT_FALSE(view.IsNullable());
+  // Copies keep the annotations
+  EXPECT_TRUE(view.ArrayBase().IsArrayView());
+
+  const AidlTypeSpecifier& shared = method.GetArguments()[1]->GetType();
+  EXPECT_TRUE(shared.IsSharedMemory());
+  EXPECT_FALSE(shared.IsArrayView());
+  EXPECT_EQ(16, shared.SharedMemoryThreshold());
+}
+
 TEST_F(AidlTest, VintfRequiresStructuredAndStability) {
   AidlError error;
   auto parse_result = Parse("IFoo.aidl", "@VintfStability interface IFoo {}", typenames_,
@@ -414,84 +451,2379 @@ TEST_F(AidlTest, WritesComments) {
   EXPECT_EQ("/* k */", interface->GetMethods()[2]->GetComments());
 }
 
-TEST_F(AidlTest, ParsesPreprocessedFile) {
-  string simple_content = "parcelable a.Foo;\ninterface b.IBar;";
-  io_delegate_.SetFileContents("path", simple_content);
-  EXPECT_FALSE(typenames_.ResolveTypename("a.Foo").second);
-  EXPECT_TRUE(parse_preprocessed_file(io_delegate_, "path", &typenames_));
-  EXPECT_TRUE(typenames_.ResolveTypename("a.Foo").second);
-  EXPECT_TRUE(typenames_.ResolveTypename("b.IBar").second);
+TEST_F(AidlTest, CommentsOutliveTheParser) {
+  io_delegate_.SetFileContents("a/IFoo.aidl",
+                               "package a;\n"
+                               "// line\n"
+                               "/* long\n"
+                               " * comment */// line after long\n"
+                               "interface IFoo { /** method */ void f(); }");
+  auto parser = Parser::Parse("a/IFoo.aidl", io_delegate_, typenames_);
+  ASSERT_NE(nullptr, parser);
+  parser.reset();
+  io_delegate_.SetFileContents("a/IFoo.aidl", "");
+
+  const AidlDefinedType* type = typenames_.TryGetDefinedType("a.IFoo");
+  ASSERT_NE(nullptr, type);
+  EXPECT_EQ("// line\n/* long\n * comment */// line after long\n", type->GetComments());
+  EXPECT_EQ("/** method */", type->AsInterface()->GetMethods()[0]->GetComments());
+}
+
+TEST_F(AidlTest, ParsesPreprocessedFile) {
+  string simple_content = "parcelable a.Foo;\ninterface b.IBar;";
+  io_delegate_.SetFileContents("path", simple_content);
+  EXPECT_FALSE(typenames_.ResolveTypename("a.Foo").second);
+  EXPECT_TRUE(parse_preprocessed_file(io_delegate_, "path", &typenames_));
+  EXPECT_TRUE(typenames_.ResolveTypename("a.Foo").second);
+  EXPECT_TRUE(typenames_.ResolveTypename("b.IBar").second);
+}
+
+TEST_F(AidlTest, ParsesPreprocessedFileWithWhitespace) {
+  string simple_content = "parcelable    a.Foo;\n  interface b.IBar  ;\t";
+  io_delegate_.SetFileContents("path", simple_content);
+
+  EXPECT_FALSE(typenames_.ResolveTypename("a.Foo").second);
+  EXPECT_TRUE(parse_preprocessed_file(io_delegate_, "path", &typenames_));
+  EXPECT_TRUE(typenames_.ResolveTypename("a.Foo").second);
+  EXPECT_TRUE(typenames_.ResolveTypename("b.IBar").second);
+}
+
+TEST_F(AidlTest, ResolvesSimpleNamesToTheFirstTypeInOrder) {
+  io_delegate_.SetFileContents("path", "parcelable z.Foo;\nparcelable b.Foo;\nparcelable a.Bar;");
+  EXPECT_TRUE(parse_preprocessed_file(io_delegate_, "path", &typenames_));
+  EXPECT_EQ("b.Foo", typenames_.ResolveTypename("Foo").first);
+
+  // Defined types win over preprocessed ones, whatever their names.
+  EXPECT_NE(nullptr, Parse("y/Foo.aidl", "package y; parcelable Foo { int a; }", typenames_,
+                           Options::Language::JAVA));
+  EXPECT_EQ("y.Foo", typenames_.ResolveTypename("Foo").first);
+  EXPECT_EQ("a.Bar", typenames_.ResolveTypename("Bar").first);
+
+  std::vector<std::string> names;
+  typenames_.IterateTypes(
+      [&](const AidlDefinedType& type) { names.push_back(type.GetCanonicalName()); });
+  EXPECT_EQ((std::vector<std::string>{"y.Foo", "a.Bar", "b.Foo", "z.Foo"}), names);
+}
+
+TEST_F(AidlTest, MakesPreprocessedTypesOnlyWhenLookedUp) {
+  io_delegate_.SetFileContents(
+      "path", "parcelable a.Foo;\ninterface b.IBar;\nstructured_parcelable c.Baz;\n");
+  EXPECT_TRUE(parse_preprocessed_file(io_delegate_, "path", &typenames_));
+  auto loaded_names = [&]() {
+    std::vector<std::string> names;
+    typenames_.IterateLoadedTypes(
+        [&](const AidlDefinedType& type) { names.push_back(type.GetCanonicalName()); });
+    return names;
+  };
+  EXPECT_EQ(std::vector<std::string>{}, loaded_names());
+
+  const AidlDefinedType* bar = typenames_.TryGetDefinedType("b.IBar");
+  ASSERT_NE(nullptr, bar);
+  EXPECT_NE(nullptr, bar->AsInterface());
+  EXPECT_EQ("IBar", bar->GetName());
+  EXPECT_EQ("b", bar->GetPackage());
+  EXPECT_EQ(bar, typenames_.TryGetDefinedType("IBar"));
+  EXPECT_EQ(std::vector<std::string>{"b.IBar"}, loaded_names());
+
+  std::vector<std::string> names;
+  typenames_.IterateTypes(
+      [&](const AidlDefinedType& type) { names.push_back(type.GetCanonicalName()); });
+  EXPECT_EQ((std::vector<std::string>{"a.Foo", "b.IBar", "c.Baz"}), names);
+  EXPECT_NE(nullptr, typenames_.TryGetDefinedType("c.Baz")->AsStructuredParcelable());
+}
+
+TEST_F(AidlTest, RejectsMalformedPreprocessedFile) {
+  io_delegate_.SetFileContents("path", "parcelable a.Foo;\nparcelable b.Bar c.Baz;\n");
+  EXPECT_FALSE(parse_preprocessed_file(io_delegate_, "path", &typenames_));
+  io_delegate_.SetFileContents("other", "parcelable a.Foo;\nenum b.Bar;\n");
+  EXPECT_FALSE(parse_preprocessed_file(io_delegate_, "other", &typenames_));
+}
+
+TEST_F(AidlTest, PreferImportToPreprocessed) {
+  io_delegate_.SetFileContents("preprocessed", "interface another.IBar;");
+  io_delegate_.SetFileContents("one/IBar.aidl", "package one; "
+                                                "interface IBar {}");
+  preprocessed_files_.push_back("preprocessed");
+  import_paths_.emplace("");
+  auto parse_result = Parse("p/IFoo.aidl", "package p; import one.IBar; interface IFoo {}",
+                            typenames_, Options::Language::JAVA);
+  EXPECT_NE(nullptr, parse_result);
+
+  // We expect to know about both kinds of IBar
+  EXPECT_TRUE(typenames_.ResolveTypename("one.IBar").second);
+  EXPECT_TRUE(typenames_.ResolveTypename("another.IBar").second);
+  // But if we request just "IBar" we should get our imported one.
+  AidlTypeSpecifier ambiguous_type(AIDL_LOCATION_HERE, "IBar", false, nullptr, "");
+  ambiguous_type.Resolve(typenames_);
+  EXPECT_EQ("one.IBar", ambiguous_type.GetName());
+}
+
+// Special case of PreferImportToPreprocessed. Imported type should be preferred
+// even when the preprocessed file already has the same type.
+TEST_F(AidlTest, B147918827) {
+  io_delegate_.SetFileContents("preprocessed", "interface another.IBar;\ninterface one.IBar;");
+  io_delegate_.SetFileContents("one/IBar.aidl",
+                               "package one; "
+                               "interface IBar {}");
+  preprocessed_files_.push_back("preprocessed");
+  import_paths_.emplace("");
+  auto parse_result = Parse("p/IFoo.aidl", "package p; import one.IBar; interface IFoo {}",
+                            typenames_, Options::Language::JAVA);
+  EXPECT_NE(nullptr, parse_result);
+
+  // We expect to know about both kinds of IBar
+  EXPECT_TRUE(typenames_.ResolveTypename("one.IBar").second);
+  EXPECT_TRUE(typenames_.ResolveTypename("another.IBar").second);
+  // But if we request just "IBar" we should get our imported one.
+  AidlTypeSpecifier ambiguous_type(AIDL_LOCATION_HERE, "IBar", false, nullptr, "");
+  ambiguous_type.Resolve(typenames_);
+  EXPECT_EQ("one.IBar", ambiguous_type.GetName());
+}
+
+TEST_F(AidlTest, WritePreprocessedFile) {
+  io_delegate_.SetFileContents("p/Outer.aidl",
+                               "package p; parcelable Outer.Inner;");
+  io_delegate_.SetFileContents("one/IBar.aidl", "package one; import p.Outer;"
+                                                "interface IBar {}");
+
+  vector<string> args {
+    "aidl",
+    "--preprocess",
+    "preprocessed",
+    "p/Outer.aidl",
+    "one/IBar.aidl"};
+  Options options = Options::From(args);
+  EXPECT_TRUE(::android::aidl::preprocess_aidl(options, io_delegate_));
+
+  string output;
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("preprocessed", &output));
+  EXPECT_EQ("parcelable p.Outer.Inner;\ninterface one.IBar;\n", output);
+}
+
+TEST_F(AidlTest, PreprocessesInParallelInTheOrderOfTheInputs) {
+  vector<string> args = {"aidl", "--preprocess", "preprocessed", "-j", "4"};
+  string expected;
+  for (int i = 0; i < 20; i++) {
+    const string name = "T" + std::to_string(i);
+    const string path = "p/" + name + ".aidl";
+    switch (i % 4) {
+      case 0:
+        io_delegate_.SetFileContents(path, "package p; interface " + name + " { void f(in " +
+                                               name + "[] a); }");
+        expected += "interface p." + name + ";\n";
+        break;
+      case 1:
+        io_delegate_.SetFileContents(path, "package p; parcelable " + name + " { int x = 1; }");
+        expected += "structured_parcelable p." + name + ";\n";
+        break;
+      case 2:
+        io_delegate_.SetFileContents(path, "package p; parcelable " + name + ";");
+        expected += "parcelable p." + name + ";\n";
+        break;
+      default:
+        io_delegate_.SetFileContents(path, "package p; enum " + name + " { A, B }");
+        expected += "enum p." + name + ";\n";
+    }
+    args.push_back(path);
+  }
+  Options options = Options::From(args);
+  ASSERT_TRUE(options.Ok());
+  EXPECT_TRUE(::android::aidl::preprocess_aidl(options, io_delegate_));
+  string output;
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("preprocessed", &output));
+  EXPECT_EQ(expected, output);
+
+  // The errors are those of the first input that fails, and nothing is written.
+  FakeIoDelegate broken;
+  broken.SetFileContents("p/T0.aidl", "package p; interface T0 {}");
+  broken.SetFileContents("p/T1.aidl", "package p; enum T1 { A, }}");
+  AddExpectedStderr("ERROR: p/T1.aidl:1.26-27: syntax error, unexpected '}'\n");
+  EXPECT_FALSE(::android::aidl::preprocess_aidl(
+      Options::From("aidl --preprocess preprocessed -j 2 p/T0.aidl p/T1.aidl p/T2.aidl"), broken));
+  EXPECT_FALSE(broken.GetWrittenContents("preprocessed", &output));
+}
+
+TEST_F(AidlTest, WritesTheBinaryTableOfTheTransactionCodes) {
+  io_delegate_.SetFileContents("p/IFoo.aidl",
+                               "package p;\n"
+                               "interface IFoo {\n"
+                               "  int get(String name);\n"
+                               "  oneway void ping();\n"
+                               "}\n");
+  io_delegate_.SetFileContents("p/IBar.aidl", "package p; interface IBar { void bar(); }");
+  Options options = Options::From(
+      "aidl --apimapping=mapping --apimapping-format=binary p/IFoo.aidl p/IBar.aidl");
+  ASSERT_TRUE(options.Ok()) << options.GetErrorMessage();
+  EXPECT_TRUE(::android::aidl::dump_mappings(options, io_delegate_));
+
+  string output;
+  ASSERT_TRUE(io_delegate_.GetWrittenContents("mapping", &output));
+  mapping_table::Table table(output.data(), output.size());
+  ASSERT_EQ(3u, table.size());
+  mapping_table::Method method;
+  ASSERT_TRUE(table.Find("p.IFoo", 1, &method));
+  EXPECT_EQ("get", method.name);
+  EXPECT_EQ("int get(java.lang.String)", method.signature);
+  EXPECT_FALSE(method.oneway);
+  ASSERT_TRUE(table.Find("p.IFoo", 2, &method));
+  EXPECT_TRUE(method.oneway);
+  ASSERT_TRUE(table.Find("p.IBar", 1, &method));
+  EXPECT_EQ("bar", method.name);
+  EXPECT_FALSE(table.Find("p.IBar", 2, &method));
+}
+
+TEST_F(AidlTest, PrecompiledModuleRoundTrip) {
+  io_delegate_.SetFileContents("p/IFoo.aidl",
+                               "package p;\n"
+                               "import p.Data;\n"
+                               "import p.Kind;\n"
+                               "/** Foo */\n"
+                               "interface IFoo {\n"
+                               "  const int SHIFTED = (1 << 3) | 1;\n"
+                               "  const String NAME = \"foo\";\n"
+                               "  oneway void send(in Data d, Kind k);\n"
+                               "  @nullable List<String> names(out int[] sizes);\n"
+                               "}\n");
+  io_delegate_.SetFileContents("p/Data.aidl",
+                               "package p;\n"
+                               "@Hide\n"
+                               "parcelable Data { int x = -5; char c = 'c'; float[] f = {1.0f}; }\n");
+  io_delegate_.SetFileContents("p/Kind.aidl",
+                               "package p;\n"
+                               "@Backing(type=\"int\")\n"
+                               "enum Kind { A = 3, B, }\n");
+  io_delegate_.SetFileContents("p/Native.aidl",
+                               "package p;\n"
+                               "parcelable Native cpp_header \"p/native.h\";\n");
+
+  Options options = Options::From(
+      "aidl --precompile module -I . p/IFoo.aidl p/Data.aidl p/Kind.aidl p/Native.aidl");
+  ASSERT_TRUE(options.Ok());
+  ASSERT_TRUE(::android::aidl::precompile_aidl(options, io_delegate_));
+  string module;
+  ASSERT_TRUE(io_delegate_.GetWrittenContents("module", &module));
+  io_delegate_.SetFileContents("module", module);
+
+  // The loaded types dump exactly like the parsed ones.
+  AidlTypenames parsed_typenames;
+  for (const string& file : options.InputFiles()) {
+    vector<AidlDefinedType*> types;
+    ASSERT_NE(AidlError::BAD_TYPE,
+              ::android::aidl::internals::load_and_validate_aidl(
+                  file, options, io_delegate_, &parsed_typenames, &types, nullptr));
+  }
+  vector<AidlDefinedType*> loaded;
+  ASSERT_TRUE(::android::aidl::load_precompiled_module(io_delegate_, "module", &typenames_,
+                                                        &loaded));
+  ASSERT_EQ(4u, loaded.size());
+  for (AidlDefinedType* type : loaded) {
+    if (AidlEnumDeclaration* enum_decl = type->AsEnumDeclaration(); enum_decl != nullptr) {
+      // This is done by load_and_validate_aidl for all known enums.
+      enum_decl->SetBackingType(
+          unique_ptr<const AidlTypeSpecifier>(enum_decl->BackingType(typenames_)));
+    }
+    const AidlDefinedType* parsed = parsed_typenames.TryGetDefinedType(type->GetCanonicalName());
+    ASSERT_NE(nullptr, parsed);
+    string parsed_dump, loaded_dump;
+    parsed->Dump(CodeWriter::ForString(&parsed_dump).get());
+    type->Dump(CodeWriter::ForString(&loaded_dump).get());
+    EXPECT_EQ(parsed_dump, loaded_dump);
+  }
+
+  // Code can be generated against the module alone.
+  io_delegate_.SetFileContents("q/IBar.aidl",
+                               "package q;\n"
+                               "import p.IFoo;\n"
+                               "import p.Kind;\n"
+                               "interface IBar { IFoo get(in p.Data d, in Kind k); }\n");
+  Options compile_options =
+      Options::From("aidl --lang=cpp --precompiled=module -d IBar.d -o out -h out q/IBar.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(compile_options, io_delegate_));
+  string dep_file;
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("IBar.d", &dep_file));
+  EXPECT_NE(string::npos, dep_file.find("module"));
+}
+
+TEST_F(AidlTest, RejectsMalformedPrecompiledModule) {
+  io_delegate_.SetFileContents("module", "AIDLMOD\1 not a module");
+  vector<AidlDefinedType*> loaded;
+  AddExpectedStderr("ERROR: module: malformed precompiled module header\n");
+  EXPECT_FALSE(::android::aidl::load_precompiled_module(io_delegate_, "module", &typenames_,
+                                                         &loaded));
+}
+
+TEST_F(AidlTest, DispatchesTransactionsOfLargeInterfacesWithATable) {
+  io_delegate_.SetFileContents("p/IFoo.aidl",
+                               "package p; interface IFoo {\n"
+                               "  void a() = 0; int b(int x) = 2; oneway void c() = 3;\n"
+                               "}");
+  string output;
+  Options cpp = Options::From("aidl --lang=cpp --version=1 -o out -h out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(cpp, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.cpp", &output));
+  const string case_of_b = "case ::android::IBinder::FIRST_CALL_TRANSACTION + 2 /* b */";
+  EXPECT_NE(string::npos, output.find(case_of_b));
+  EXPECT_EQ(string::npos, output.find("_aidl_handlers"));
+
+  // With more methods than the threshold, each one has a handler of its own,
+  // and the meta transactions are left to the switch statement.
+  cpp.onTransact_table_threshold_ = 2;
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(cpp, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.cpp", &output));
+  EXPECT_NE(string::npos, output.find("::android::status_t BnFoo::_aidl_onTransact_b("
+                                      "const ::android::Parcel& _aidl_data, "
+                                      "::android::Parcel* _aidl_reply) {\n"));
+  EXPECT_NE(string::npos, output.find("    &BnFoo::_aidl_onTransact_a,\n"
+                                      "    nullptr,\n"
+                                      "    &BnFoo::_aidl_onTransact_b,\n"
+                                      "    &BnFoo::_aidl_onTransact_c,\n"
+                                      "  };\n"));
+  EXPECT_NE(string::npos, output.find("_aidl_index < 4 && "));
+  EXPECT_EQ(string::npos, output.find(case_of_b));
+  EXPECT_NE(string::npos, output.find("case ::android::IBinder::FIRST_CALL_TRANSACTION + 16777214 "
+                                      "/* getInterfaceVersion */:"));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/BnFoo.h", &output));
+  EXPECT_NE(string::npos, output.find("private:\n  ::android::status_t _aidl_onTransact_a("));
+
+  Options ndk = Options::From("aidl --lang=ndk --version=1 -o out -h out p/IFoo.aidl");
+  ndk.onTransact_table_threshold_ = 2;
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(ndk, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.cpp", &output));
+  EXPECT_NE(string::npos, output.find("static binder_status_t _aidl_IFoo_onTransact_b("
+                                      "const std::shared_ptr<BnFoo>& _aidl_impl, "
+                                      "const AParcel* _aidl_in, AParcel* _aidl_out) {\n"));
+  EXPECT_NE(string::npos, output.find("    &_aidl_IFoo_onTransact_a,\n    nullptr,\n"));
+  EXPECT_EQ(string::npos, output.find("case (FIRST_CALL_TRANSACTION + 2 /*b*/)"));
+  EXPECT_NE(string::npos, output.find("case (FIRST_CALL_TRANSACTION + 16777214"));
+}
+
+TEST_F(AidlTest, LogsTransactionsToTheBinaryLog) {
+  io_delegate_.SetFileContents("p/IFoo.aidl", "package p; interface IFoo { int f(int x); }");
+  Options cpp = Options::From("aidl --lang=cpp --log=binary -o out -h out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(cpp, io_delegate_));
+  string output;
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.cpp", &output));
+  EXPECT_NE(string::npos, output.find("#include <aidl/binary_log.h>\n"));
+  EXPECT_NE(string::npos, output.find("const bool _log_binary = "
+                                      "::android::aidl::binary_log::Enabled();\n"));
+  EXPECT_NE(string::npos, output.find("      \"p.IFoo\",\n"
+                                      "      \"f\",\n"
+                                      "      static_cast<const void*>(this),\n"
+                                      "      0,\n"
+                                      "      ::android::aidl::binary_log::Side::PROXY,\n"));
+  EXPECT_NE(string::npos, output.find("      static_cast<uint32_t>(_aidl_data.dataSize()),\n"
+                                      "      static_cast<uint32_t>(_aidl_reply.dataSize()),\n"));
+  // Stubs log before they write the reply.
+  EXPECT_NE(string::npos, output.find("        static_cast<uint32_t>(_aidl_data.dataSize()),\n"
+                                      "        0,\n"));
+  EXPECT_EQ(string::npos, output.find("Json::Value"));
+
+  Options ndk = Options::From("aidl --lang=ndk --log=binary -o out -h out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(ndk, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.cpp", &output));
+  EXPECT_NE(string::npos, output.find("#include <aidl/binary_log.h>\n"));
+  EXPECT_NE(string::npos, output.find("AStatus_getExceptionCode(_aidl_status.get()),\n"));
+  EXPECT_NE(string::npos,
+            output.find("static_cast<uint32_t>(AParcel_getDataPosition(_aidl_in)),\n"));
+  EXPECT_EQ(string::npos, output.find("Json::Value"));
+}
+
+TEST_F(AidlTest, CapturesTheRequestsOfStubsForReplay) {
+  io_delegate_.SetFileContents("p/IFoo.aidl",
+                               "package p; interface IFoo { int f(int x); oneway void g(); }");
+  Options cpp = Options::From("aidl --lang=cpp --log=binary -o out -h out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(cpp, io_delegate_));
+  string output;
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.cpp", &output));
+  EXPECT_NE(string::npos, output.find("#include <aidl/transaction_capture.h>\n"));
+  EXPECT_NE(string::npos,
+            output.find("if (::android::aidl::capture::Enabled() && "
+                        "_aidl_data.objectsCount() == 0) {\n"
+                        "      ::android::aidl::capture::Capture(\"p.IFoo\", \"f\", "
+                        "::android::IBinder::FIRST_CALL_TRANSACTION + 0 /* f */, false, "
+                        "_aidl_data.data(), _aidl_data.dataSize());\n"));
+  EXPECT_NE(string::npos, output.find("::android::aidl::capture::Capture(\"p.IFoo\", \"g\", "
+                                      "::android::IBinder::FIRST_CALL_TRANSACTION + 1 /* g */, "
+                                      "true, "));
+
+  Options ndk = Options::From("aidl --lang=ndk --log=binary -o out -h out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(ndk, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.cpp", &output));
+  EXPECT_NE(string::npos, output.find("#include <aidl/transaction_capture_ndk.h>\n"));
+  EXPECT_NE(string::npos,
+            output.find("::android::aidl::capture::CaptureParcel(\"p.IFoo\", \"f\", "
+                        "(FIRST_CALL_TRANSACTION + 0 /*f*/), false, _aidl_in);\n"));
+
+  // Without --log=binary, nothing is captured.
+  Options plain = Options::From("aidl --lang=cpp -o out -h out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(plain, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.cpp", &output));
+  EXPECT_EQ(string::npos, output.find("capture"));
+}
+
+TEST_F(AidlTest, TracesTransactionsAsPerfettoTrackEvents) {
+  io_delegate_.SetFileContents("p/IFoo.aidl", "package p; interface IFoo { int f(int x); }");
+  Options cpp = Options::From("aidl --lang=cpp --trace=perfetto -o out -h out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(cpp, io_delegate_));
+  string output;
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.cpp", &output));
+  EXPECT_NE(string::npos, output.find("#include <aidl/trace_events.h>\n"));
+  EXPECT_NE(string::npos,
+            output.find("::android::aidl::trace_events::ScopedTransaction _aidl_perfetto("
+                        "\"IFoo::f::cppClient\", ::android::IBinder::FIRST_CALL_TRANSACTION + 0 "
+                        "/* f */, [&]() {\n"
+                        "    return ::android::aidl::trace_events::Reply{static_cast<size_t>("
+                        "_aidl_reply.dataSize()), _aidl_ret_status};\n"
+                        "  });\n"
+                        "  _aidl_perfetto.Phase(\"marshal\");\n"));
+  EXPECT_NE(string::npos, output.find("  _aidl_perfetto.SetRequestBytes(_aidl_data.dataSize());\n"
+                                      "  _aidl_perfetto.Phase(\"transact\");\n"));
+  // The server's slice starts before it reads the arguments.
+  const size_t server = output.find("\"IFoo::f::cppServer\"");
+  EXPECT_NE(string::npos, server);
+  EXPECT_LT(server, output.find("_aidl_data.readInt32(&in_x)"));
+  EXPECT_LT(output.find("_aidl_perfetto.Phase(\"execute\");\n", server),
+            output.find("f(in_x, &_aidl_return)", server));
+  EXPECT_EQ(string::npos, output.find("atrace_begin"));
+
+  Options ndk = Options::From("aidl --lang=ndk --trace=perfetto -o out -h out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(ndk, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.cpp", &output));
+  EXPECT_NE(string::npos,
+            output.find("\"IFoo::f::ndkServer\", (FIRST_CALL_TRANSACTION + 0 /*f*/)"));
+  EXPECT_NE(string::npos, output.find("\"IFoo::f::ndkClient\""));
+  // The transaction takes the request, so its size is taken before.
+  EXPECT_LT(output.find("_aidl_perfetto.SetRequestBytes(AParcel_getDataPosition(_aidl_in.get()));"),
+            output.find("AIBinder_transact("));
+}
+
+TEST_F(AidlTest, WritesTheTablesOfTheTransactionNamesInCppAndNdk) {
+  io_delegate_.SetFileContents("p/IFoo.aidl",
+                               "package p; interface IFoo { void g() = 3; int f(int x) = 1; }");
+  Options cpp = Options::From(
+      "aidl --lang=cpp --transaction_names --version=2 -o out -h out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(cpp, io_delegate_));
+  string output;
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/BnFoo.h", &output));
+  // Sorted by code, with the meta methods that are generated
+  EXPECT_NE(string::npos,
+            output.find("static constexpr TransactionName kTransactionNames[] = {\n"
+                        "    {::android::IBinder::FIRST_CALL_TRANSACTION + 1, \"f\"},\n"
+                        "    {::android::IBinder::FIRST_CALL_TRANSACTION + 3, \"g\"},\n"
+                        "    {::android::IBinder::FIRST_CALL_TRANSACTION + 16777214, "
+                        "\"getInterfaceVersion\"},\n"
+                        "  };\n"));
+  EXPECT_NE(string::npos,
+            output.find("      case ::android::IBinder::FIRST_CALL_TRANSACTION + 3: "
+                        "return kTransactionNames[1].name;\n"));
+  EXPECT_NE(string::npos, output.find("      default: return nullptr;\n"));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/BpFoo.h", &output));
+  EXPECT_EQ(string::npos, output.find("kTransactionNames"));
+
+  Options ndk = Options::From("aidl --lang=ndk --transaction_names -o out -h out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(ndk, io_delegate_));
+  for (const string header : {"out/aidl/p/BnFoo.h", "out/aidl/p/BpFoo.h"}) {
+    EXPECT_TRUE(io_delegate_.GetWrittenContents(header, &output));
+    EXPECT_NE(string::npos, output.find("    {FIRST_CALL_TRANSACTION + 1, \"f\"},\n"
+                                        "    {FIRST_CALL_TRANSACTION + 3, \"g\"},\n"
+                                        "  };\n"))
+        << header;
+    EXPECT_NE(string::npos, output.find("static constexpr const char* getTransactionName("
+                                        "uint32_t code) {\n"))
+        << header;
+  }
+}
+
+TEST_F(AidlTest, ChecksTheSizeOfFixedSizeArgumentsOnce) {
+  io_delegate_.SetFileContents("p/IFoo.aidl",
+                               "package p; interface IFoo {"
+                               "  void setParams(int a, long b, float c, boolean d);"
+                               "  void setName(int a, String name);"
+                               "  void setId(int a); }");
+  Options cpp = Options::From("aidl --lang=cpp -o out -h out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(cpp, io_delegate_));
+  string output;
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.cpp", &output));
+  EXPECT_NE(string::npos, output.find("    if (_aidl_data.dataAvail() >= 20) {\n"
+                                      "      in_a = _aidl_data.readInt32();\n"
+                                      "      in_b = _aidl_data.readInt64();\n"
+                                      "      in_c = _aidl_data.readFloat();\n"
+                                      "      in_d = _aidl_data.readBool();\n"
+                                      "    }\n"
+                                      "    else {\n"
+                                      "      _aidl_ret_status = _aidl_data.readInt32(&in_a);\n"));
+  // Only setParams has several arguments that are all primitives
+  EXPECT_EQ(output.find("dataAvail()"), output.rfind("dataAvail()"));
+
+  Options ndk = Options::From("aidl --lang=ndk -o out -h out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(ndk, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.cpp", &output));
+  EXPECT_NE(string::npos,
+            output.find("if (AParcel_getDataSize(_aidl_in) - AParcel_getDataPosition(_aidl_in) "
+                        ">= 20) {\n"
+                        "        (void)AParcel_readInt32(_aidl_in, &in_a);\n"
+                        "        (void)AParcel_readInt64(_aidl_in, &in_b);\n"));
+  EXPECT_EQ(output.find("AParcel_getDataSize(_aidl_in)"),
+            output.rfind("AParcel_getDataSize(_aidl_in)"));
+}
+
+TEST_F(AidlTest, CountsTheTransactionsOfEachMethod) {
+  io_delegate_.SetFileContents("p/IFoo.aidl",
+                               "package p; interface IFoo { int f(int x); oneway void g(); }");
+  Options cpp = Options::From("aidl --lang=cpp --gen-stats --version=2 -o out -h out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(cpp, io_delegate_));
+  string output;
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/BpFoo.h", &output));
+  EXPECT_NE(string::npos, output.find("#include <aidl/transaction_stats.h>\n"));
+  EXPECT_NE(string::npos,
+            output.find("static ::android::aidl::transaction_stats::Table getTransactionStats();"));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.cpp", &output));
+  // The meta methods are not counted.
+  EXPECT_NE(string::npos,
+            output.find("static ::android::aidl::transaction_stats::MethodStats "
+                        "_aidl_BpFoo_stats[] = {\n"
+                        "  {\"f\", ::android::IBinder::FIRST_CALL_TRANSACTION + 0},\n"
+                        "  {\"g\", ::android::IBinder::FIRST_CALL_TRANSACTION + 1},\n"
+                        "};\n"
+                        "::android::aidl::transaction_stats::Table BpFoo::getTransactionStats() {\n"
+                        "  return {_aidl_BpFoo_stats, 2};\n"
+                        "}\n"));
+  EXPECT_NE(string::npos, output.find("  ::android::aidl::transaction_stats::ScopedTimer "
+                                      "_aidl_stats_timer(&_aidl_BpFoo_stats[1]);\n"));
+  EXPECT_NE(string::npos, output.find("return {_aidl_BnFoo_stats, 2};\n"));
+  EXPECT_NE(string::npos, output.find("_aidl_stats_timer(&_aidl_BnFoo_stats[0]);\n"));
+
+  Options ndk = Options::From("aidl --lang=ndk --gen-stats -o out -h out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(ndk, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/aidl/p/BnFoo.h", &output));
+  EXPECT_NE(string::npos, output.find("#include <aidl/transaction_stats.h>\n"));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.cpp", &output));
+  // The stub's table is defined ahead of the transactions of onTransact.
+  const size_t table = output.find("{\"g\", FIRST_CALL_TRANSACTION + 1},\n");
+  EXPECT_NE(string::npos, table);
+  EXPECT_LT(table, output.find("_aidl_stats_timer(&_aidl_BnFoo_stats[1]);\n"));
+  EXPECT_NE(string::npos, output.find("_aidl_stats_timer(&_aidl_BpFoo_stats[0]);\n"));
+
+  Options java = Options::From("aidl --lang=java --gen-stats -o out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(java, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.java", &output));
+  EXPECT_NE(string::npos, output.find("public static final class TransactionStats"));
+  EXPECT_NE(string::npos, output.find("new TransactionStats(\"g\", TRANSACTION_g),\n"));
+  EXPECT_NE(string::npos, output.find("_aidl_stub_stats[0].record(System.nanoTime() - "
+                                      "_aidl_start);\n"));
+  EXPECT_NE(string::npos, output.find("_aidl_proxy_stats[1].record(System.nanoTime() - "
+                                      "_aidl_start);\n"));
+  EXPECT_NE(string::npos, output.find("public static TransactionStats[] "
+                                      "getProxyTransactionStats() {\n"));
+}
+
+TEST_F(AidlTest, CountsTheParcelSizesOfEachMethod) {
+  io_delegate_.SetFileContents("p/IFoo.aidl",
+                               "package p; interface IFoo { int f(int x); oneway void g(); }");
+  Options counts = Options::From("aidl --lang=cpp --gen-stats -o out -h out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(counts, io_delegate_));
+  string output;
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.cpp", &output));
+  EXPECT_EQ(string::npos, output.find("RecordSizes"));
+
+  Options cpp = Options::From("aidl --lang=cpp --gen-stats=sizes -o out -h out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(cpp, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.cpp", &output));
+  EXPECT_NE(string::npos, output.find("  _aidl_BpFoo_stats[0].RecordSizes(_aidl_data.dataSize(), "
+                                      "_aidl_reply.dataSize());\n"));
+  EXPECT_NE(string::npos, output.find("_aidl_BnFoo_stats[1].RecordSizes(_aidl_data.dataSize(), "
+                                      "_aidl_reply->dataSize());\n"));
+
+  Options ndk = Options::From("aidl --lang=ndk --gen-stats=sizes -o out -h out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(ndk, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.cpp", &output));
+  // The proxies take the size of the request before the transaction consumes it.
+  const size_t size =
+      output.find("_aidl_request_size = AParcel_getDataPosition(_aidl_in.get());\n");
+  EXPECT_NE(string::npos, size);
+  EXPECT_LT(size, output.find("_aidl_ret_status = AIBinder_transact(", size));
+  EXPECT_NE(string::npos, output.find("_aidl_BpFoo_stats[1].RecordSizes(_aidl_request_size, "));
+  EXPECT_NE(string::npos, output.find("_aidl_BnFoo_stats[0].RecordSizes("
+                                      "AParcel_getDataPosition(_aidl_in), "
+                                      "AParcel_getDataPosition(_aidl_out));\n"));
+
+  Options java = Options::From("aidl --lang=java --gen-stats=sizes -o out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(java, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.java", &output));
+  EXPECT_NE(string::npos, output.find("_aidl_stub_stats[0].recordSizes(data.dataSize(), "
+                                      "reply.dataSize());\n"));
+  EXPECT_NE(string::npos, output.find("_aidl_proxy_stats[1].recordSizes(_data.dataSize(), 0);\n"));
+  EXPECT_NE(string::npos, output.find("public long getMaxRequestBytes() {\n"));
+  EXPECT_NE(string::npos,
+            output.find("public static TransactionStats getTransactionStats(int transactionCode)"));
+}
+
+TEST_F(AidlTest, PresizesTheParcelsOfArrays) {
+  io_delegate_.SetFileContents("p/IFoo.aidl",
+                               "package p; interface IFoo {"
+                               " void f(int x, in long[] ys, in byte[] bytes); void g(int x); }");
+  io_delegate_.SetFileContents("p/Samples.aidl",
+                               "package p; parcelable Samples { int rate; float[] values; }");
+
+  Options cpp = Options::From("aidl --lang=cpp -o out -h out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(cpp, io_delegate_));
+  string output;
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.cpp", &output));
+  EXPECT_NE(string::npos,
+            output.find("_aidl_data.setDataCapacity(_aidl_data.dataPosition() + 4 + "
+                        "(4 + ys.size() * 8) + (4 + ((bytes.size() + 3) & ~size_t{3})));\n"));
+  // The methods without arrays let the parcel grow as usual.
+  EXPECT_EQ(output.find("setDataCapacity"), output.rfind("setDataCapacity"));
+
+  Options cpp_parcel = Options::From("aidl --lang=cpp -o out -h out p/Samples.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(cpp_parcel, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/Samples.cpp", &output));
+  EXPECT_NE(string::npos, output.find("_aidl_parcel->setDataCapacity(_aidl_parcel->dataPosition()"
+                                      " + 4 + (4 + values.size() * 4));\n"));
+
+  Options java = Options::From("aidl --lang=java -o out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(java, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.java", &output));
+  EXPECT_NE(string::npos, output.find("_data.setDataCapacity(_data.dataPosition() + 4 + "
+                                      "(4 + ((ys==null) ? 0 : ys.length) * 8) + "
+                                      "(4 + ((((bytes==null) ? 0 : bytes.length) + 3) & ~3)));\n"));
+  EXPECT_EQ(output.find("setDataCapacity"), output.rfind("setDataCapacity"));
+
+  Options java_parcel = Options::From("aidl --lang=java -o out p/Samples.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(java_parcel, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/Samples.java", &output));
+  EXPECT_NE(string::npos,
+            output.find("_aidl_parcel.setDataCapacity(_aidl_parcel.dataPosition() + 4 + "
+                        "(4 + ((values==null) ? 0 : values.length) * 4));\n"));
+}
+
+TEST_F(AidlTest, MarshalsFixedSizeParcelablesInOneBlock) {
+  io_delegate_.SetFileContents("p/Sample.aidl",
+                               "package p; @FixedSize parcelable Sample {"
+                               " long timestamp; boolean valid; float x; }");
+
+  Options cpp = Options::From("aidl --lang=cpp -o out -h out p/Sample.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(cpp, io_delegate_));
+  string output;
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/Sample.cpp", &output));
+  EXPECT_NE(string::npos, output.find("#include <cstring>\n"));
+  EXPECT_NE(string::npos,
+            output.find("  if (_aidl_parcelable_size >= sizeof(int32_t) + 16) {\n"
+                        "    const uint8_t* _aidl_block = static_cast<const uint8_t*>("
+                        "_aidl_parcel->readInplace(16));\n"
+                        "    if (_aidl_block == nullptr) return ::android::BAD_VALUE;\n"
+                        "    memcpy(&timestamp, _aidl_block + 0, 8);\n"
+                        "    int32_t _aidl_word;\n"
+                        "    memcpy(&_aidl_word, _aidl_block + 8, 4);\n"
+                        "    valid = _aidl_word != 0;\n"
+                        "    memcpy(&x, _aidl_block + 12, 4);\n"
+                        "    _aidl_parcel->setDataPosition(_aidl_start_pos + "
+                        "_aidl_parcelable_size);\n"
+                        "    return ::android::OK;\n"
+                        "  }\n"));
+  // The parcelables from older versions with fewer fields are still read.
+  EXPECT_NE(string::npos, output.find("_aidl_ret_status = _aidl_parcel->readInt64(&timestamp);\n"));
+  EXPECT_NE(string::npos,
+            output.find("  uint8_t* _aidl_block = static_cast<uint8_t*>("
+                        "_aidl_parcel->writeInplace(16));\n"
+                        "  if (_aidl_block == nullptr) return ::android::NO_MEMORY;\n"
+                        "  memcpy(_aidl_block + 0, &timestamp, 8);\n"
+                        "  int32_t _aidl_word;\n"
+                        "  _aidl_word = valid ? 1 : 0;\n"
+                        "  memcpy(_aidl_block + 8, &_aidl_word, 4);\n"
+                        "  memcpy(_aidl_block + 12, &x, 4);\n"));
+  EXPECT_EQ(string::npos, output.find("writeInt64(timestamp)"));
+
+  Options ndk = Options::From("aidl --lang=ndk -o out -h out p/Sample.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(ndk, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/Sample.cpp", &output));
+  const size_t fast_path = output.find(
+      "  if (_aidl_parcelable_size >= static_cast<int32_t>(sizeof(int32_t) + 16)) {\n"
+      "    _aidl_ret_status = AParcel_readInt64(parcel, &timestamp);\n");
+  EXPECT_NE(string::npos, fast_path);
+  EXPECT_EQ(string::npos,
+            output.substr(fast_path, output.find("  }\n", fast_path) - fast_path)
+                .find("AParcel_getDataPosition"));
+}
+
+TEST_F(AidlTest, RejectsFixedSizeParcelablesOfOtherTypes) {
+  io_delegate_.SetFileContents("p/T.aidl",
+                               "package p; @FixedSize parcelable T { int a; String s; }");
+  Options options = Options::From("aidl --lang=cpp -o out -h out p/T.aidl");
+  EXPECT_NE(0, ::android::aidl::compile_aidl(options, io_delegate_));
+  AddExpectedStderr(
+      "ERROR: p/T.aidl:1.51-53: A @FixedSize parcelable can only have fields of primitive and "
+      "enum types, but s is String.\n");
+}
+
+TEST_F(AidlTest, MarshalsHeaderlessParcelablesWithoutTheirSize) {
+  io_delegate_.SetFileContents("p/Point.aidl",
+                               "package p; @Headerless parcelable Point { int x; int y; }");
+  io_delegate_.SetFileContents("p/Stamp.aidl",
+                               "package p; @Headerless @FixedSize parcelable Stamp { long t; }");
+
+  Options cpp = Options::From("aidl --lang=cpp -o out -h out p/Point.aidl p/Stamp.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(cpp, io_delegate_));
+  string output;
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/Point.cpp", &output));
+  EXPECT_EQ(string::npos, output.find("_aidl_start_pos"));
+  EXPECT_EQ(string::npos, output.find("setDataPosition"));
+  EXPECT_NE(string::npos, output.find("  _aidl_ret_status = _aidl_parcel->readInt32(&x);\n"
+                                      "  if (((_aidl_ret_status) != (::android::OK))) {\n"
+                                      "    return _aidl_ret_status;\n"
+                                      "  }\n"
+                                      "  _aidl_ret_status = _aidl_parcel->readInt32(&y);\n"));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/Stamp.cpp", &output));
+  EXPECT_NE(string::npos,
+            output.find("  const uint8_t* _aidl_block = static_cast<const uint8_t*>("
+                        "_aidl_parcel->readInplace(8));\n"
+                        "  if (_aidl_block == nullptr) return ::android::BAD_VALUE;\n"
+                        "  memcpy(&t, _aidl_block + 0, 8);\n"
+                        "  return _aidl_ret_status;\n"));
+  EXPECT_EQ(string::npos, output.find("readInt64"));
+
+  Options ndk = Options::From("aidl --lang=ndk -o out -h out p/Point.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(ndk, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/Point.cpp", &output));
+  EXPECT_EQ(string::npos, output.find("_aidl_start_pos"));
+  EXPECT_EQ(string::npos, output.find("AParcel_setDataPosition"));
+
+  Options java = Options::From("aidl --lang=java --java-reuse -o out p/Point.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(java, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/Point.java", &output));
+  EXPECT_EQ(string::npos, output.find("_aidl_start_pos"));
+  EXPECT_EQ(string::npos, output.find("_aidl_resetFrom"));
+  EXPECT_NE(string::npos, output.find("    _aidl_parcel.writeInt(x);\n"
+                                      "    _aidl_parcel.writeInt(y);\n"
+                                      "  }\n"));
+  EXPECT_NE(string::npos, output.find("    x = _aidl_parcel.readInt();\n"
+                                      "    y = _aidl_parcel.readInt();\n"
+                                      "  }\n"));
+}
+
+TEST_F(AidlTest, RejectsHeaderlessParcelablesOfVersionedInterfaces) {
+  io_delegate_.SetFileContents("p/Point.aidl",
+                               "package p; @Headerless parcelable Point { int x; }");
+  Options options = Options::From("aidl --lang=cpp --structured --version 2 -o out -h out "
+                                  "p/Point.aidl");
+  EXPECT_NE(0, ::android::aidl::compile_aidl(options, io_delegate_));
+  AddExpectedStderr(
+      "ERROR: p/Point.aidl:1.34-40: A @Headerless parcelable cannot be compiled with --version "
+      "or --stability, since the other versions of a versioned parcelable need its size "
+      "header.\n");
+
+  io_delegate_.SetFileContents("p/IFoo.aidl", "package p; @Headerless interface IFoo { }");
+  Options interface = Options::From("aidl --lang=cpp -o out -h out p/IFoo.aidl");
+  EXPECT_NE(0, ::android::aidl::compile_aidl(interface, io_delegate_));
+  AddExpectedStderr(
+      "ERROR: p/IFoo.aidl:1.23-33: @Headerless can only be used on structured parcelables.\n");
+}
+
+TEST_F(AidlTest, HoldsContainersOfPolymorphicAllocatorParcelablesInPmrTypes) {
+  io_delegate_.SetFileContents("p/Bar.aidl",
+                               "package p; @PolymorphicAllocator parcelable Bar {"
+                               " int n; @utf8InCpp String s = \"bar\"; }");
+  io_delegate_.SetFileContents("p/Foo.aidl",
+                               "package p; import p.Bar; @PolymorphicAllocator parcelable Foo {"
+                               " int[] a = {1, 2}; @utf8InCpp List<String> names; Bar bar; }");
+
+  Options cpp = Options::From("aidl --lang=cpp -I . -o out -h out p/Foo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(cpp, io_delegate_));
+  string output;
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/Foo.h", &output));
+  EXPECT_NE(string::npos, output.find("#include <memory_resource>\n"));
+  EXPECT_NE(string::npos,
+            output.find("  using allocator_type = ::std::pmr::polymorphic_allocator<char>;\n"
+                        "  Foo() = default;\n"
+                        "  explicit Foo(const allocator_type& _aidl_allocator)\n"
+                        "      : a({1, 2}, _aidl_allocator),\n"
+                        "        names(_aidl_allocator),\n"
+                        "        bar(_aidl_allocator) {}\n"
+                        "  Foo(const Foo& _aidl_other, const allocator_type& _aidl_allocator)\n"
+                        "      : a(_aidl_other.a, _aidl_allocator),\n"));
+  EXPECT_NE(string::npos,
+            output.find("  ::std::pmr::vector<int32_t> a = ::std::pmr::vector<int32_t>({1, 2});\n"
+                        "  ::std::pmr::vector<::std::pmr::string> names;\n"
+                        "  ::p::Bar bar;\n"));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/Foo.cpp", &output));
+  EXPECT_NE(string::npos, output.find("#include <aidl/pmr_parcel.h>\n"));
+  EXPECT_NE(string::npos,
+            output.find("_aidl_ret_status = ::android::aidl::pmr::ReadFromParcel(_aidl_parcel, "
+                        "&names);\n"));
+  EXPECT_NE(string::npos,
+            output.find("_aidl_ret_status = ::android::aidl::pmr::WriteToParcel(_aidl_parcel, "
+                        "names);\n"));
+  // The parcelables read and write their own containers.
+  EXPECT_NE(string::npos, output.find("_aidl_ret_status = _aidl_parcel->readParcelable(&bar);\n"));
+
+  Options ndk = Options::From("aidl --lang=ndk -I . -o out -h out p/Foo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(ndk, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/aidl/p/Foo.h", &output));
+  EXPECT_NE(string::npos,
+            output.find("  explicit Foo(const allocator_type& _aidl_allocator)\n"
+                        "      : a({1, 2}, _aidl_allocator),\n"));
+  EXPECT_NE(string::npos,
+            output.find("  std::pmr::vector<int32_t> a = {1, 2};\n"
+                        "  std::pmr::vector<std::pmr::string> names;\n"
+                        "  ::aidl::p::Bar bar;\n"));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/Foo.cpp", &output));
+  EXPECT_NE(string::npos, output.find("#include <aidl/pmr_ndk.h>\n"));
+  EXPECT_NE(string::npos,
+            output.find("_aidl_ret_status = ::android::aidl::pmr::ReadFromParcel(parcel, &a);\n"));
+}
+
+TEST_F(AidlTest, RejectsPolymorphicAllocatorParcelablesOfOtherTypes) {
+  io_delegate_.SetFileContents(
+      "p/T.aidl", "package p; @PolymorphicAllocator parcelable T { int a; String s; }");
+  Options options = Options::From("aidl --lang=cpp -o out -h out p/T.aidl");
+  EXPECT_NE(0, ::android::aidl::compile_aidl(options, io_delegate_));
+  AddExpectedStderr(
+      "ERROR: p/T.aidl:1.62-64: A @PolymorphicAllocator parcelable can only have fields of "
+      "primitive, enum, @utf8InCpp String and structured parcelable types and of their arrays and "
+      "Lists, none of them @nullable, but s is String.\n");
+}
+
+TEST_F(AidlTest, ComparesAndHashesHashableParcelables) {
+  io_delegate_.SetFileContents("p/Key.aidl",
+                               "package p; @Hashable parcelable Key {"
+                               " int id; float weight; String[] tags; List<String> names; }");
+
+  Options cpp = Options::From("aidl --lang=cpp -o out -h out p/Key.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(cpp, io_delegate_));
+  string output;
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/Key.h", &output));
+  EXPECT_NE(string::npos, output.find("#include <aidl/hash.h>\n"));
+  EXPECT_NE(string::npos,
+            output.find("namespace std {\n"
+                        "\n"
+                        "template <>\n"
+                        "struct hash<::p::Key> {\n"
+                        "  size_t operator()(const ::p::Key& _aidl_value) const noexcept {\n"
+                        "    size_t _aidl_hash = 0;\n"
+                        "    ::android::aidl::HashCombine(&_aidl_hash, "
+                        "::android::aidl::HashOf(_aidl_value.id));\n"));
+
+  Options ndk = Options::From("aidl --lang=ndk -o out -h out p/Key.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(ndk, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/aidl/p/Key.h", &output));
+  EXPECT_NE(string::npos,
+            output.find("  inline bool operator<(const Key& rhs) const {\n"
+                        "    return std::tie(id, weight, tags, names)<"
+                        "std::tie(rhs.id, rhs.weight, rhs.tags, rhs.names);\n"
+                        "  }\n"));
+  EXPECT_NE(string::npos, output.find("struct hash<::aidl::p::Key> {\n"));
+
+  Options java = Options::From("aidl --lang=java -o out p/Key.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(java, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/Key.java", &output));
+  EXPECT_NE(string::npos,
+            output.find("    return id == _aidl_that.id\n"
+                        "        && Float.compare(weight, _aidl_that.weight) == 0\n"
+                        "        && java.util.Arrays.equals(tags, _aidl_that.tags)\n"
+                        "        && java.util.Objects.equals(names, _aidl_that.names);\n"));
+  EXPECT_NE(string::npos,
+            output.find("    int _aidl_hash = 1;\n"
+                        "    _aidl_hash = 31 * _aidl_hash + id;\n"
+                        "    _aidl_hash = 31 * _aidl_hash + Float.floatToIntBits(weight);\n"
+                        "    _aidl_hash = 31 * _aidl_hash + java.util.Arrays.hashCode(tags);\n"
+                        "    _aidl_hash = 31 * _aidl_hash + _aidl_hashCodeOf(names);\n"));
+}
+
+TEST_F(AidlTest, AppendsParcelablesToAString) {
+  io_delegate_.SetFileContents("p/Foo.aidl", "package p; parcelable Foo { int a; String[] b; }");
+  io_delegate_.SetFileContents("p/Empty.aidl", "package p; parcelable Empty {}");
+
+  Options cpp = Options::From("aidl --lang=cpp --parcelable-to-string -o out -h out p/Foo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(cpp, io_delegate_));
+  string output;
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/Foo.h", &output));
+  EXPECT_NE(string::npos, output.find("#include <aidl/to_string.h>\n"));
+  EXPECT_NE(string::npos, output.find("  void appendTo(std::string& _aidl_os) const {\n"
+                                      "    _aidl_os += \"Foo{a: \";\n"
+                                      "    ::android::aidl::AppendTo(_aidl_os, a);\n"
+                                      "    _aidl_os += \", b: \";\n"
+                                      "    ::android::aidl::AppendTo(_aidl_os, b);\n"
+                                      "    _aidl_os += '}';\n"
+                                      "  }\n"
+                                      "  std::string toString() const {\n"
+                                      "    std::string _aidl_os;\n"
+                                      "    appendTo(_aidl_os);\n"
+                                      "    return _aidl_os;\n"
+                                      "  }\n"));
+
+  Options ndk =
+      Options::From("aidl --lang=ndk --parcelable-to-string -o out -h out p/Empty.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(ndk, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/aidl/p/Empty.h", &output));
+  EXPECT_NE(string::npos, output.find("#include <aidl/to_string.h>\n"));
+  EXPECT_NE(string::npos, output.find("  void appendTo(std::string& _aidl_os) const {\n"
+                                      "    _aidl_os += \"Empty{}\";\n"
+                                      "  }\n"));
+
+  // Without the option, neither of them
+  Options plain = Options::From("aidl --lang=cpp -o out -h out p/Foo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(plain, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/Foo.h", &output));
+  EXPECT_EQ(string::npos, output.find("appendTo"));
+}
+
+TEST_F(AidlTest, RejectsHashableParcelablesOfOtherTypes) {
+  io_delegate_.SetFileContents("p/T.aidl",
+                               "package p; @Hashable parcelable T { int a; IBinder b; }");
+  Options options = Options::From("aidl --lang=cpp -o out -h out p/T.aidl");
+  EXPECT_NE(0, ::android::aidl::compile_aidl(options, io_delegate_));
+  AddExpectedStderr(
+      "ERROR: p/T.aidl:1.51-53: A @Hashable parcelable can only have fields of primitive, enum, "
+      "String and @Hashable parcelable types and of their arrays and Lists, none of them "
+      "@nullable, but b is IBinder.\n");
+}
+
+TEST_F(AidlTest, GeneratesTheDeltasOfDeltaParcelables) {
+  io_delegate_.SetFileContents("p/State.aidl",
+                               "package p; @Delta parcelable State { int a; String[] b; }");
+
+  Options cpp = Options::From("aidl --lang=cpp -o out -h out p/State.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(cpp, io_delegate_));
+  string output;
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/State.h", &output));
+  EXPECT_NE(string::npos, output.find("  class Delta;\n"));
+  EXPECT_NE(string::npos,
+            output.find("class State::Delta : public ::android::Parcelable {\n"
+                        "public:\n"
+                        "  // The fields of State in values, bit i for the field i in the\n"
+                        "  // order of their declaration\n"
+                        "  uint64_t fields = 0;\n"
+                        "  State values;\n"
+                        "\n"
+                        "  static Delta diff(const State& _aidl_old, const State& _aidl_new) {\n"
+                        "    Delta _aidl_delta;\n"
+                        "    if (_aidl_old.a != _aidl_new.a) {\n"
+                        "      _aidl_delta.fields |= (uint64_t{1} << 0);\n"
+                        "      _aidl_delta.values.a = _aidl_new.a;\n"
+                        "    }\n"));
+  EXPECT_NE(string::npos, output.find("    if (_aidl_delta.fields & (uint64_t{1} << 1)) "
+                                      "_aidl_base->b = _aidl_delta.values.b;\n"));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/State.cpp", &output));
+  EXPECT_NE(string::npos,
+            output.find("  if (fields & (uint64_t{1} << 1)) {\n"
+                        "    _aidl_ret_status = _aidl_parcel->writeString16Vector(values.b);\n"));
+
+  Options ndk = Options::From("aidl --lang=ndk -o out -h out p/State.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(ndk, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/aidl/p/State.h", &output));
+  // The Delta compares the fields
+  EXPECT_NE(string::npos, output.find("  inline bool operator!=(const State& rhs) const {\n"));
+  EXPECT_NE(string::npos, output.find("class State::Delta {\n"));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/State.cpp", &output));
+  EXPECT_NE(string::npos, output.find("  _aidl_ret_status = AParcel_readUint64(parcel, &fields);\n"));
+
+  Options java = Options::From("aidl --lang=java -o out p/State.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(java, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/State.java", &output));
+  EXPECT_NE(string::npos, output.find("  public boolean equals(Object _aidl_other) {\n"));
+  EXPECT_NE(string::npos,
+            output.find("    public static Delta diff(State _aidl_old, State _aidl_new) {\n"
+                        "      Delta _aidl_delta = new Delta();\n"
+                        "      if (!(_aidl_old.a == _aidl_new.a)) {\n"));
+  EXPECT_NE(string::npos, output.find("        if ((fields & (1L << 1)) != 0) {\n"
+                                      "          values.b = _aidl_parcel.createStringArray();\n"
+                                      "        }\n"));
+}
+
+TEST_F(AidlTest, RejectsDeltaParcelablesOfOtherTypes) {
+  io_delegate_.SetFileContents("p/T.aidl",
+                               "package p; @Delta parcelable T { int a; @nullable String b; }");
+  Options options = Options::From("aidl --lang=cpp -o out -h out p/T.aidl");
+  EXPECT_NE(0, ::android::aidl::compile_aidl(options, io_delegate_));
+  AddExpectedStderr(
+      "ERROR: p/T.aidl:1.57-59: A @Delta parcelable can only have fields of primitive, enum, "
+      "String and @Delta or @Hashable parcelable types and of their arrays and Lists, none of "
+      "them @nullable, but b is String.\n");
+
+  string fields;
+  for (int i = 0; i < 65; i++) fields += " int f" + std::to_string(i) + ";";
+  io_delegate_.SetFileContents("p/U.aidl", "package p; @Delta parcelable U {" + fields + " }");
+  Options too_many = Options::From("aidl --lang=cpp -o out -h out p/U.aidl");
+  EXPECT_NE(0, ::android::aidl::compile_aidl(too_many, io_delegate_));
+  AddExpectedStderr(
+      "ERROR: p/U.aidl:1.29-31: A @Delta parcelable can have at most 64 fields, but U has 65.\n");
+}
+
+TEST_F(AidlTest, EmbedsTheWireSchemasOfTypes) {
+  io_delegate_.SetFileContents("p/E.aidl", "package p; @Backing(type=\"byte\") enum E { A }");
+  io_delegate_.SetFileContents("p/P.aidl", "package p; parcelable P { @nullable String s; }");
+  import_paths_.emplace("");
+  const string contents =
+      "package p; import p.E; import p.P;"
+      " interface IFoo { oneway void f(int a, in List<String> b); E[] g(out P p); }";
+  const AidlDefinedType* iface =
+      Parse("p/IFoo.aidl", contents, typenames_, Options::Language::CPP);
+  ASSERT_NE(nullptr, iface);
+  const string schema = WireSchemaOf(*iface, typenames_);
+  EXPECT_EQ(string("AIDL\x01\x01\x06p.IFoo\x02"
+                   "\x01\x01\x01" "f" "\x00\x02"
+                   "\x01\x01" "a" "\x04"
+                   "\x01\x01" "b" "\x89\x01\x08"
+                   "\x02\x00\x01" "g" "\xb2\x03p.E\x01\x02\x01"
+                   "\x02\x01" "p" "\x11\x03p.P",
+                   50),
+            schema);
+  wire_schema::Schema parsed;
+  EXPECT_TRUE(wire_schema::Parse(schema, &parsed));
+
+  Options cpp =
+      Options::From("aidl --lang=cpp --gen-wire-schema -I. -o out -h out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(cpp, io_delegate_));
+  string output;
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.h", &output));
+  EXPECT_NE(string::npos, output.find("  static ::std::string_view getWireSchema();\n"));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.cpp", &output));
+  EXPECT_NE(string::npos,
+            output.find("::std::string_view IFoo::getWireSchema() {\n"
+                        "  __attribute__((section(\"aidl_wire_schema\"), used))\n"
+                        "  static const char _aidl_schema[] =\n"
+                        "      \"AIDL\\001\\001\\006p.IFoo\\002\\001\\001\\001f\\000\\002\\001"
+                        "\\001a\\004\\001\\001b\\211\\001\\010\\002\\000\\001g\\262\\003p.E"
+                        "\\001\\002\\001\\002\\001p\\021\\003p.P\";\n"
+                        "  return ::std::string_view(_aidl_schema, sizeof(_aidl_schema) - 1);\n"
+                        "}\n"));
+
+  Options ndk = Options::From("aidl --lang=ndk --gen-wire-schema -I. -o out -h out p/P.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(ndk, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/aidl/p/P.h", &output));
+  EXPECT_NE(string::npos, output.find("  static ::std::string_view getWireSchema();\n"));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/P.cpp", &output));
+  EXPECT_NE(string::npos,
+            output.find("  static const char _aidl_schema[] =\n"
+                        "      \"AIDL\\001\\002\\003p.P\\001\\001sH\";\n"));
+
+  Options java = Options::From("aidl --lang=java --gen-wire-schema -I. -o out p/P.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(java, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/P.java", &output));
+  EXPECT_NE(string::npos,
+            output.find("  public static byte[] getWireSchema() {\n"
+                        "    return (\"AIDL\\001\\002\\003p.P\\001\\001sH\")"
+                        ".getBytes(java.nio.charset.StandardCharsets.ISO_8859_1);\n"
+                        "  }\n"));
+}
+
+TEST_F(AidlTest, GeneratesTheTypesSharedByFrozenVersionsOnce) {
+  for (const string version : {"1", "2"}) {
+    const string dir = "api/" + version + "/p/";
+    io_delegate_.SetFileContents(dir + "E.aidl", "package p; enum E { A, B }");
+    io_delegate_.SetFileContents(dir + "Same.aidl", "package p; parcelable Same { p.E e; int a; }");
+    io_delegate_.SetFileContents(
+        dir + "Changed.aidl",
+        version == "1" ? "package p; parcelable Changed { int a; }"
+                       : "package p; parcelable Changed { int a; int b; }");
+    io_delegate_.SetFileContents(dir + "UsesChanged.aidl",
+                                 "package p; parcelable UsesChanged { p.Changed c; }");
+    io_delegate_.SetFileContents(dir + "IFoo.aidl", "package p; interface IFoo { void f(); }");
+  }
+  const string inputs =
+      " -Iapi/2 -o out -h out api/2/p/E.aidl api/2/p/Same.aidl api/2/p/Changed.aidl"
+      " api/2/p/UsesChanged.aidl api/2/p/IFoo.aidl";
+  const string placeholder =
+      "// This file is intentionally left blank as placeholder for deduplicated code.\n";
+
+  for (const string lang : {"cpp", "ndk"}) {
+    SCOPED_TRACE(lang);
+    Options versioned = Options::From("aidl --lang=" + lang + " --structured --version=2" +
+                                      " --dedup-with=api/1 --dedup-with=api/2" + inputs);
+    EXPECT_EQ(0, ::android::aidl::compile_aidl(versioned, io_delegate_));
+    string output;
+    EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/Same.cpp", &output));
+    EXPECT_EQ(placeholder, output);
+    EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/Same.h", &output));
+    EXPECT_NE(string::npos, output.find("class Same"));
+    for (const string type : {"Changed", "UsesChanged", "IFoo"}) {
+      EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/" + type + ".cpp", &output));
+      EXPECT_NE(placeholder, output) << type;
+    }
+
+    Options shared = Options::From("aidl --lang=" + lang + " --structured --dedup-shared" +
+                                   " --dedup-with=api/1 --dedup-with=api/2" + inputs);
+    EXPECT_EQ(0, ::android::aidl::compile_aidl(shared, io_delegate_));
+    EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/Same.cpp", &output));
+    EXPECT_NE(string::npos, output.find("Same::readFromParcel"));
+    for (const string type : {"Changed", "UsesChanged", "IFoo"}) {
+      EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/" + type + ".cpp", &output));
+      EXPECT_EQ(placeholder, output) << type;
+    }
+  }
+}
+
+TEST_F(AidlTest, MarshalsMethodsOfPrimitivesWithTables) {
+  io_delegate_.SetFileContents("p/IFoo.aidl",
+                               "package p; interface IFoo {"
+                               " int f(int a, float b, String c, out long[] d);"
+                               " void g(@nullable String s); }");
+  Options cpp = Options::From("aidl --lang=cpp --marshal=tables -I. -o out -h out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(cpp, io_delegate_));
+  string output;
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.cpp", &output));
+  EXPECT_NE(string::npos, output.find("#include <aidl/marshal_parcel.h>\n"));
+  EXPECT_NE(string::npos,
+            output.find("namespace _aidl_marshal_IFoo {\n"
+                        "using namespace ::android::aidl::marshal;\n"
+                        "constexpr uint8_t f_request[] = {kRun32, 2, kString, kSize | "
+                        "kInt64Vector, kEnd};\n"
+                        "constexpr uint8_t f_reply[] = {kInt32, kInt64Vector, kEnd};\n"
+                        "}  // namespace _aidl_marshal_IFoo\n"));
+  EXPECT_NE(string::npos,
+            output.find("    const void* const _aidl_args[] = {&a, &b, &c, d};\n"
+                        "    _aidl_ret_status = ::android::aidl::marshal::Write(&_aidl_data, "
+                        "_aidl_marshal_IFoo::f_request, _aidl_args);\n"));
+  EXPECT_NE(string::npos,
+            output.find("    void* const _aidl_args[] = {_aidl_return, d};\n"
+                        "    _aidl_ret_status = ::android::aidl::marshal::Read(_aidl_reply, "
+                        "_aidl_marshal_IFoo::f_reply, _aidl_args);\n"));
+  EXPECT_NE(string::npos,
+            output.find("      void* const _aidl_args[] = {&in_a, &in_b, &in_c, &out_d};\n"));
+  EXPECT_NE(string::npos,
+            output.find("      const void* const _aidl_args[] = {&_aidl_return, &out_d};\n"));
+  // The @nullable String keeps its calls
+  EXPECT_EQ(string::npos, output.find("g_request"));
+  EXPECT_NE(string::npos, output.find("_aidl_data.writeString16(s)"));
+
+  Options ndk = Options::From("aidl --lang=ndk --marshal=tables -I. -o out -h out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(ndk, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.cpp", &output));
+  EXPECT_NE(string::npos, output.find("#include <aidl/marshal_ndk.h>\n"));
+  EXPECT_NE(string::npos, output.find("constexpr uint8_t f_request[] = {kRun32, 2, kString, "
+                                      "kSize | kInt64Vector, kEnd};\n"));
+  EXPECT_NE(string::npos,
+            output.find("    const void* const _aidl_args[] = {&in_a, &in_b, &in_c, out_d};\n"
+                        "    _aidl_ret_status = ::android::aidl::marshal::Write(_aidl_in.get(), "
+                        "_aidl_marshal_IFoo::f_request, _aidl_args);\n"));
+  EXPECT_NE(string::npos,
+            output.find("_aidl_ret_status = ::android::aidl::marshal::Read(_aidl_in, "
+                        "_aidl_marshal_IFoo::f_request, _aidl_args);\n"));
+
+  Options code = Options::From("aidl --lang=cpp -I. -o out -h out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(code, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.cpp", &output));
+  EXPECT_EQ(string::npos, output.find("marshal"));
+}
+
+TEST_F(AidlTest, CachesTheResultsOfCacheableMethodsInTheProxies) {
+  io_delegate_.SetFileContents("p/IFoo.aidl",
+                               "package p; interface IFoo {"
+                               " @Cacheable String getName(int id, String tag); void reset(); }");
+
+  Options cpp = Options::From("aidl --lang=cpp -o out -h out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(cpp, io_delegate_));
+  string output;
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.h", &output));
+  EXPECT_NE(string::npos, output.find("  static ::android::aidl::CacheGeneration cacheGeneration;\n"
+                                      "  static void invalidateCaches() {\n"
+                                      "    cacheGeneration.Invalidate();\n"
+                                      "  }\n"));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/BpFoo.h", &output));
+  EXPECT_NE(string::npos,
+            output.find("  ::android::aidl::ResultCache<::std::tuple<int32_t, "
+                        "::android::String16>, ::android::String16> cached_getName_;\n"));
+  EXPECT_EQ(string::npos, output.find("cached_reset_"));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.cpp", &output));
+  EXPECT_NE(string::npos, output.find("::android::aidl::CacheGeneration IFoo::cacheGeneration;\n"));
+  EXPECT_NE(string::npos,
+            output.find("  const uint64_t _aidl_cache_generation = IFoo::cacheGeneration.Get();\n"
+                        "  if (cached_getName_.Get(_aidl_cache_generation, ::std::tie(id, tag), "
+                        "_aidl_return)) {\n"
+                        "    return ::android::binder::Status::ok();\n"
+                        "  }\n"));
+  EXPECT_NE(string::npos, output.find("  cached_getName_.Put(_aidl_cache_generation, "
+                                      "::std::tie(id, tag), *_aidl_return);\n"
+                                      "  _aidl_error:\n"));
+
+  Options ndk = Options::From("aidl --lang=ndk -o out -h out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(ndk, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/aidl/p/BpFoo.h", &output));
+  EXPECT_NE(string::npos,
+            output.find("  ::android::aidl::ResultCache<std::tuple<int32_t, std::string>, "
+                        "std::string> _aidl_cached_getName;\n"));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.cpp", &output));
+  EXPECT_NE(string::npos,
+            output.find("  if (_aidl_cached_getName.Get(_aidl_cache_generation, "
+                        "std::tie(in_id, in_tag), _aidl_return)) {\n"));
+  EXPECT_NE(string::npos, output.find("  _aidl_cached_getName.Put(_aidl_cache_generation, "
+                                      "std::tie(in_id, in_tag), *_aidl_return);\n"));
+
+  Options java = Options::From("aidl --lang=java -o out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(java, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.java", &output));
+  EXPECT_NE(string::npos, output.find("Stub.Proxy.sCacheGeneration.incrementAndGet();\n"));
+  EXPECT_NE(string::npos,
+            output.find("java.util.Arrays.<Object>asList(Stub.Proxy.sCacheGeneration.get(), id, "
+                        "tag);\n"));
+  EXPECT_NE(string::npos, output.find("mCachedGetName.put(_aidl_cacheKey, _result);\n"));
+}
+
+TEST_F(AidlTest, RejectsCacheableMethodsOfOtherTypes) {
+  io_delegate_.SetFileContents("p/IFoo.aidl",
+                               "package p; interface IFoo { @Cacheable int f(in int[] a); }");
+  Options options = Options::From("aidl --lang=cpp -o out -h out p/IFoo.aidl");
+  EXPECT_NE(0, ::android::aidl::compile_aidl(options, io_delegate_));
+  AddExpectedStderr(
+      "ERROR: p/IFoo.aidl:1.54-56: A @Cacheable method can only take in arguments of primitive, "
+      "enum and String types, but a is int[].\n");
+
+  io_delegate_.SetFileContents("p/IFoo.aidl",
+                               "package p; interface IFoo { @Cacheable oneway void f(int a); }");
+  EXPECT_NE(0, ::android::aidl::compile_aidl(options, io_delegate_));
+  AddExpectedStderr(
+      "ERROR: p/IFoo.aidl:1.51-53: A @Cacheable method has to return a value, but 'f' does "
+      "not.\n");
+}
+
+TEST_F(AidlTest, CoalescesTheConcurrentCallsOfSingleFlightMethodsInTheStubs) {
+  io_delegate_.SetFileContents("p/IFoo.aidl",
+                               "package p; interface IFoo {"
+                               " @SingleFlight String getName(int id, String tag);"
+                               " @SingleFlight void ping(); void reset(); }");
+
+  Options cpp = Options::From("aidl --lang=cpp -o out -h out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(cpp, io_delegate_));
+  string output;
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/BnFoo.h", &output));
+  EXPECT_NE(string::npos, output.find("#include <aidl/single_flight.h>\n"));
+  EXPECT_NE(string::npos,
+            output.find("  ::android::aidl::SingleFlight<::std::tuple<int32_t, "
+                        "::android::String16>, ::android::binder::Status, ::android::String16> "
+                        "_aidl_flight_getName;\n"
+                        "  ::android::aidl::SingleFlight<::std::tuple<>, "
+                        "::android::binder::Status> _aidl_flight_ping;\n"));
+  EXPECT_EQ(string::npos, output.find("_aidl_flight_reset"));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.cpp", &output));
+  EXPECT_NE(string::npos,
+            output.find("    ::android::binder::Status _aidl_status(_aidl_flight_getName.Do("
+                        "::std::tie(in_id, in_tag), &_aidl_return, [&]() { return getName(in_id, "
+                        "in_tag, &_aidl_return); }));\n"));
+  EXPECT_NE(string::npos, output.find("_aidl_flight_ping.Do(::std::tie(), nullptr, [&]() { "
+                                      "return ping(); })"));
+  EXPECT_NE(string::npos, output.find("::android::binder::Status _aidl_status(reset());\n"));
+
+  Options ndk = Options::From("aidl --lang=ndk -o out -h out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(ndk, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/aidl/p/BnFoo.h", &output));
+  EXPECT_NE(string::npos, output.find("#include <aidl/single_flight_ndk.h>\n"));
+  EXPECT_NE(string::npos,
+            output.find("  ::android::aidl::SingleFlight<std::tuple<int32_t, std::string>, "
+                        "::ndk::ScopedAStatus, std::string> _aidl_flight_getName;\n"));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.cpp", &output));
+  EXPECT_NE(string::npos,
+            output.find("::ndk::ScopedAStatus _aidl_status = _aidl_impl->_aidl_flight_getName.Do("
+                        "std::tie(in_id, in_tag), &_aidl_return, [&]() { return "
+                        "_aidl_impl->getName(in_id, in_tag, &_aidl_return); });\n"));
+
+  Options java = Options::From("aidl --lang=java -o out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(java, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.java", &output));
+  EXPECT_NE(string::npos,
+            output.find("java.lang.String _result = this._aidl_singleFlight_getName(_arg0, "
+                        "_arg1);\n"));
+  EXPECT_NE(string::npos, output.find("this._aidl_singleFlight_ping();\n"));
+  EXPECT_NE(string::npos,
+            output.find("    private java.lang.String _aidl_singleFlight_getName(final int id, "
+                        "final java.lang.String tag) throws android.os.RemoteException {\n"
+                        "      java.util.List<Object> _aidl_key = "
+                        "java.util.Arrays.<Object>asList(id, tag);\n"));
+  EXPECT_NE(string::npos, output.find("              return Stub.this.getName(id, tag);\n"));
+  EXPECT_NE(string::npos, output.find("_aidl_leader = mInFlightGetName.putIfAbsent(_aidl_key, "
+                                      "_aidl_flight);\n"));
+  EXPECT_NE(string::npos, output.find("              Stub.this.ping();\n"
+                                      "              return null;\n"));
+}
+
+TEST_F(AidlTest, RejectsSingleFlightMethodsOfOtherTypes) {
+  io_delegate_.SetFileContents("p/IFoo.aidl",
+                               "package p; interface IFoo { @SingleFlight int f(out int[] a); }");
+  Options options = Options::From("aidl --lang=cpp -o out -h out p/IFoo.aidl");
+  EXPECT_NE(0, ::android::aidl::compile_aidl(options, io_delegate_));
+  AddExpectedStderr(
+      "ERROR: p/IFoo.aidl:1.58-60: A @SingleFlight method can only take in arguments of "
+      "primitive, enum, String and @Hashable parcelable types, but a is out int[].\n");
+
+  io_delegate_.SetFileContents("p/IFoo.aidl",
+                               "package p; interface IFoo { @SingleFlight IBinder f(); }");
+  EXPECT_NE(0, ::android::aidl::compile_aidl(options, io_delegate_));
+  AddExpectedStderr(
+      "ERROR: p/IFoo.aidl:1.50-52: A @SingleFlight method can only return void or a value of a "
+      "primitive, enum, String or @Hashable parcelable type, but 'f' returns IBinder.\n");
+
+  io_delegate_.SetFileContents("p/IFoo.aidl",
+                               "package p; interface IFoo { @SingleFlight oneway void f(); }");
+  EXPECT_NE(0, ::android::aidl::compile_aidl(options, io_delegate_));
+  AddExpectedStderr(
+      "ERROR: p/IFoo.aidl:1.54-56: A @SingleFlight method has to have a reply, but 'f' is "
+      "oneway.\n");
+
+  io_delegate_.SetFileContents("p/IFoo.aidl", "package p; @SingleFlight interface IFoo { }");
+  EXPECT_NE(0, ::android::aidl::compile_aidl(options, io_delegate_));
+  AddExpectedStderr("ERROR: p/IFoo.aidl:1.25-35: @SingleFlight can only be used on methods.\n");
+}
+
+TEST_F(AidlTest, QueuesTheCallsOfBatchableMethodsInTheProxies) {
+  io_delegate_.SetFileContents("p/IFoo.aidl",
+                               "package p; interface IFoo {"
+                               " @Batchable oneway void log(int level); int get(); }");
+
+  Options cpp = Options::From("aidl --lang=cpp -o out -h out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(cpp, io_delegate_));
+  string output;
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.h", &output));
+  EXPECT_NE(string::npos, output.find("  virtual ::android::binder::Status flushBatchedCalls() {\n"
+                                      "    return ::android::binder::Status::ok();\n"
+                                      "  }\n"));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/BpFoo.h", &output));
+  EXPECT_NE(string::npos,
+            output.find("  virtual ~BpFoo();\n"
+                        "  ::android::binder::Status flushBatchedCalls() override;\n"));
+  EXPECT_NE(string::npos, output.find("  ::android::Parcel batch_;\n"));
+  EXPECT_NE(string::npos, output.find("#include <aidl/batch_timer.h>\n"));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.cpp", &output));
+  EXPECT_NE(string::npos, output.find("BpFoo::~BpFoo() {\n"
+                                      "  flushBatchedCalls();\n"
+                                      "}\n"));
+  // The first call schedules the flush of the batch, and each call checks
+  // its deadline.
+  EXPECT_NE(string::npos,
+            output.find("    ::android::aidl::BatchTimer::Default().Schedule(batch_deadline_, "
+                        "[_aidl_self = ::android::sp<BpFoo>(this)]() {\n"));
+  EXPECT_NE(string::npos,
+            output.find("  if (batch_calls_ >= 32 || batch_.dataSize() >= 65536 ||\n"
+                        "      ::android::aidl::BatchTimer::Clock::now() >= batch_deadline_) {\n"));
+  EXPECT_NE(string::npos,
+            output.find("  _aidl_ret_status = batch_.writeUint32("
+                        "::android::IBinder::FIRST_CALL_TRANSACTION + 0 /* log */);\n"));
+  EXPECT_NE(string::npos, output.find("remote()->transact(::android::IBinder::"
+                                      "FIRST_CALL_TRANSACTION + 16777212 /* batch */, batch_, "
+                                      "&_aidl_reply, ::android::IBinder::FLAG_ONEWAY);\n"));
+  EXPECT_NE(string::npos,
+            output.find("::android::binder::Status BpFoo::get(int32_t* _aidl_return) {\n"
+                        "  if (::android::binder::Status _aidl_flushed = "
+                        "flushBatchedCalls(); !_aidl_flushed.isOk()) {\n"));
+  EXPECT_NE(string::npos,
+            output.find("  case ::android::IBinder::FIRST_CALL_TRANSACTION + 16777212 "
+                        "/* batch */: {\n"
+                        "    if (!(_aidl_data.enforceInterface(_aidl_IFoo_token, 6))) {\n"));
+
+  Options ndk = Options::From("aidl --lang=ndk -o out -h out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(ndk, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/aidl/p/BpFoo.h", &output));
+  EXPECT_NE(string::npos, output.find("  ::ndk::ScopedAParcel _aidl_batch;\n"));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.cpp", &output));
+  EXPECT_NE(string::npos,
+            output.find("    ::android::aidl::BatchTimer::Default().Schedule("
+                        "_aidl_batch_deadline, [_aidl_self = ref<BpFoo>()]() {\n"));
+  EXPECT_NE(string::npos,
+            output.find("  _aidl_ret_status = AParcel_writeUint32(_aidl_batch.get(), "
+                        "(FIRST_CALL_TRANSACTION + 0 /*log*/));\n"));
+  EXPECT_NE(string::npos,
+            output.find("    case (FIRST_CALL_TRANSACTION + 16777212 /*batch*/): {\n"));
+
+  Options java = Options::From("aidl --lang=java -o out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(java, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.java", &output));
+  EXPECT_NE(string::npos, output.find("mBatch.writeInt(Stub.TRANSACTION_log);\n"));
+  EXPECT_NE(string::npos,
+            output.find("mRemote.transact(Stub.BATCH_TRANSACTION, _data, null, "
+                        "android.os.IBinder.FLAG_ONEWAY);\n"));
+  EXPECT_NE(string::npos, output.find("onBatchedTransact$log$(data, reply);\n"));
+  // The scheduled flush keeps a dropped proxy until its batch is sent.
+  EXPECT_NE(string::npos,
+            output.find("BatchTimer.sExecutor.schedule(new java.lang.Runnable() {\n"));
+  EXPECT_NE(string::npos,
+            output.find("|| android.os.SystemClock.uptimeMillis() >= mBatchDeadline) {\n"));
+  EXPECT_NE(string::npos, output.find("public void flushBatchedCalls() throws "
+                                      "android.os.RemoteException;\n"));
+}
+
+TEST_F(AidlTest, RejectsBatchableMethodsThatAreNotOneway) {
+  io_delegate_.SetFileContents("p/IFoo.aidl",
+                               "package p; interface IFoo { @Batchable void f(int a); }");
+  Options options = Options::From("aidl --lang=cpp -o out -h out p/IFoo.aidl");
+  EXPECT_NE(0, ::android::aidl::compile_aidl(options, io_delegate_));
+  AddExpectedStderr(
+      "ERROR: p/IFoo.aidl:1.44-46: @Batchable can only be used on oneway methods, but 'f' is "
+      "not oneway.\n");
+
+  io_delegate_.SetFileContents("p/IFoo.aidl",
+                               "package p; interface IFoo { @Batchable oneway void f(int a);"
+                               " void flushBatchedCalls(); }");
+  EXPECT_NE(0, ::android::aidl::compile_aidl(options, io_delegate_));
+  AddExpectedStderr(
+      "ERROR: p/IFoo.aidl:1.66-84: method flushBatchedCalls is reserved for the interfaces "
+      "with @Batchable methods.\n");
+}
+
+TEST_F(AidlTest, DefinesTheNdkClassOnFirstUse) {
+  io_delegate_.SetFileContents("p/IFoo.aidl", "package p; interface IFoo { void f(); }");
+  Options ndk = Options::From("aidl --lang=ndk -o out -h out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(ndk, io_delegate_));
+  string output;
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.cpp", &output));
+  EXPECT_NE(string::npos,
+            output.find("static AIBinder_Class* _g_aidl_IFoo_clazz() {\n"
+                        "  static AIBinder_Class* _aidl_clazz = ::ndk::ICInterface::defineClass("
+                        "IFoo::descriptor, _aidl_IFoo_onTransact);\n"
+                        "  return _aidl_clazz;\n"
+                        "}\n"));
+  EXPECT_NE(string::npos,
+            output.find("AIBinder_new(_g_aidl_IFoo_clazz(), static_cast<void*>(this))"));
+  EXPECT_NE(string::npos, output.find("AIBinder_associateClass(binder.get(), _g_aidl_IFoo_clazz())"));
+  EXPECT_NE(string::npos, output.find("const char* IFoo::descriptor = \"p.IFoo\";\n"));
+}
+
+TEST_F(AidlTest, WritesAndReadsTheOkStatusOfNdkRepliesDirectly) {
+  io_delegate_.SetFileContents("p/IFoo.aidl",
+                               "package p; interface IFoo { int f(); oneway void g(); }");
+  Options ndk = Options::From("aidl --lang=ndk -o out -h out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(ndk, io_delegate_));
+  string output;
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.cpp", &output));
+  EXPECT_NE(string::npos, output.find("#include <aidl/status_ndk.h>\n"));
+  EXPECT_EQ(string::npos, output.find("AParcel_writeStatusHeader"));
+  EXPECT_EQ(string::npos, output.find("AParcel_readStatusHeader"));
+  EXPECT_NE(string::npos,
+            output.find("_aidl_ret_status = ::android::aidl::WriteStatusHeader(_aidl_out, "
+                        "_aidl_status.get());\n"));
+  EXPECT_NE(string::npos,
+            output.find("_aidl_ret_status = ::android::aidl::ReadStatusHeader(_aidl_out.get(), "
+                        "&_aidl_status);\n"));
+  // Only once each, for f()
+  EXPECT_EQ(output.rfind("WriteStatusHeader("), output.find("WriteStatusHeader("));
+  EXPECT_EQ(output.rfind("ReadStatusHeader("), output.find("ReadStatusHeader("));
+}
+
+TEST_F(AidlTest, GeneratesLazyProxies) {
+  io_delegate_.SetFileContents("p/IFoo.aidl",
+                               "package p; interface IFoo { int get(in String key); }");
+
+  Options cpp = Options::From("aidl --lang=cpp --gen-lazy-proxy -o out -h out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(cpp, io_delegate_));
+  string output;
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.h", &output));
+  EXPECT_NE(string::npos,
+            output.find("class IFooLazy : public IFoo, public ::android::IBinder::DeathRecipient {\n"
+                        "public:\n"
+                        "  explicit IFooLazy(const ::android::String16& name);\n"));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.cpp", &output));
+  EXPECT_NE(string::npos, output.find("#include <binder/IServiceManager.h>\n"));
+  EXPECT_NE(string::npos, output.find("    service_ = ::android::waitForService<IFoo>(name_);\n"));
+  EXPECT_NE(string::npos,
+            output.find("::android::binder::Status IFooLazy::get(const ::android::String16& key, "
+                        "int32_t* _aidl_return) {\n"
+                        "  ::android::sp<IFoo> _aidl_service = getService();\n"
+                        "  if (_aidl_service == nullptr) {\n"
+                        "    return ::android::binder::Status::fromStatusT("
+                        "::android::NAME_NOT_FOUND);\n"
+                        "  }\n"
+                        "  return _aidl_service->get(key, _aidl_return);\n"
+                        "}\n"));
+
+  Options ndk = Options::From("aidl --lang=ndk --gen-lazy-proxy -o out -h out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(ndk, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/aidl/p/IFoo.h", &output));
+  EXPECT_NE(string::npos, output.find("class IFooLazy : public IFoo {\n"));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.cpp", &output));
+  EXPECT_NE(string::npos, output.find("AServiceManager_getService(name_.c_str())"));
+  EXPECT_NE(string::npos, output.find("  return _aidl_service->get(in_key, _aidl_return);\n"));
+
+  Options java = Options::From("aidl --lang=java --gen-lazy-proxy -o out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(java, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.java", &output));
+  EXPECT_NE(string::npos, output.find("public static class Lazy implements p.IFoo\n"));
+  EXPECT_NE(string::npos, output.find("android.os.ServiceManager.waitForService(mName);\n"));
+  EXPECT_NE(string::npos, output.find("return getService().get(key);\n"));
+
+  Options eager = Options::From("aidl --lang=java -o out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(eager, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.java", &output));
+  EXPECT_EQ(string::npos, output.find("class Lazy"));
+}
+
+TEST_F(AidlTest, CallsTheParcelHelpersInCompactJava) {
+  io_delegate_.SetFileContents("p/IFoo.aidl",
+                               "package p; import p.Bar; interface IFoo {"
+                               " Bar get(in Bar bar, out int[] values); }");
+  io_delegate_.SetFileContents("p/Bar.aidl", "package p; parcelable Bar { int x; }");
+
+  Options full = Options::From("aidl --lang=java -I . -o out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(full, io_delegate_));
+  string full_output;
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.java", &full_output));
+
+  Options compact = Options::From("aidl --lang=java --java-compact -I . -o out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(compact, io_delegate_));
+  string output;
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.java", &output));
+  EXPECT_NE(string::npos, output.find("_arg0 = data.readTypedObject(p.Bar.CREATOR);\n"));
+  EXPECT_NE(string::npos,
+            output.find("reply.writeTypedObject(_result, "
+                        "android.os.Parcelable.PARCELABLE_WRITE_RETURN_VALUE);\n"));
+  EXPECT_NE(string::npos, output.find("_data.writeTypedObject(bar, 0);\n"));
+  EXPECT_NE(string::npos, output.find("_data.writeInt(((values==null)?(-1):(values.length)));\n"));
+  EXPECT_NE(string::npos, output.find("_result = _reply.readTypedObject(p.Bar.CREATOR);\n"));
+  EXPECT_EQ(string::npos, output.find(".createFromParcel("));
+  // The generated code, and so the bytecode, of each method shrinks
+  EXPECT_LT(output.size(), full_output.size());
+}
+
+TEST_F(AidlTest, MarshalsTheElementsOfTypedMapsAndListsInJava) {
+  io_delegate_.SetFileContents("p/IFoo.aidl",
+                               "package p; import p.E; import p.IBar; interface IFoo {"
+                               " Map<String, E> get(in List<IBar> bars,"
+                               " inout Map<String, List<ParcelFileDescriptor> > fds); }");
+  io_delegate_.SetFileContents("p/E.aidl", "package p; @Backing(type=\"byte\") enum E { A }");
+  io_delegate_.SetFileContents("p/IBar.aidl", "package p; interface IBar {}");
+
+  Options options = Options::From("aidl --lang=java -I . -o out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(options, io_delegate_));
+  string output;
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.java", &output));
+  EXPECT_NE(string::npos, output.find("java.util.Map<java.lang.String,Byte> get("));
+  EXPECT_NE(string::npos, output.find("for (p.IBar _aidl_bars_e : bars) {\n"));
+  EXPECT_NE(string::npos,
+            output.find("_arg0 = new java.util.ArrayList<>(Math.min(_aidl_arg0_size, "
+                        "data.dataAvail() / 4));\n"));
+  EXPECT_NE(string::npos,
+            output.find("_aidl_arg0_e = p.IBar.Stub.asInterface(data.readStrongBinder());\n"));
+  EXPECT_NE(string::npos,
+            output.find("_arg1 = new java.util.HashMap<>((Math.min(_aidl_arg1_size, "
+                        "data.dataAvail() / 8) * 4 + 2) / 3);\n"));
+  EXPECT_NE(string::npos,
+            output.find("_aidl_arg1_v = "
+                        "data.createTypedArrayList(android.os.ParcelFileDescriptor.CREATOR);\n"));
+  EXPECT_NE(string::npos, output.find("fds.clear();\n"));
+  EXPECT_NE(string::npos, output.find("_aidl_result_v = _reply.readByte();\n"));
+  EXPECT_EQ(string::npos, output.find("readHashMap"));
+  EXPECT_EQ(string::npos, output.find("forEach"));
+}
+
+TEST_F(AidlTest, ReusesTheObjectsThatJavaParcelablesAndStubsRead) {
+  io_delegate_.SetFileContents("p/IFoo.aidl",
+                               "package p; import p.Bar; interface IFoo {"
+                               " void f(in Bar bar, inout Bar other); }");
+  io_delegate_.SetFileContents("p/Bar.aidl",
+                               "package p; parcelable Bar { int x; int[] values = {1, 2};"
+                               " List<String> names; }");
+
+  Options options =
+      Options::From("aidl --lang=java --java-reuse -I . -o out p/IFoo.aidl p/Bar.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(options, io_delegate_));
+  string bar;
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/Bar.java", &bar));
+  EXPECT_NE(string::npos, bar.find("_aidl_out.readFromParcel(_aidl_source, false);\n"));
+  EXPECT_NE(string::npos, bar.find("readFromParcel(_aidl_parcel, true);\n"));
+  EXPECT_NE(string::npos,
+            bar.find("if ((_aidl_reuse && values!=null && "
+                     "values.length==_aidl_peekInt(_aidl_parcel))) {\n"
+                     "        _aidl_parcel.readIntArray(values);\n"));
+  EXPECT_NE(string::npos,
+            bar.find("if ((_aidl_reuse && names!=null && _aidl_peekInt(_aidl_parcel)>=0)) {\n"
+                     "        _aidl_parcel.readStringList(names);\n"));
+  EXPECT_NE(string::npos, bar.find("if (_aidl_reuse) _aidl_resetFrom(1);\n"));
+  EXPECT_NE(string::npos, bar.find("if (_aidl_index <= 1) values = new int[]{1, 2};\n"));
+
+  string foo;
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.java", &foo));
+  EXPECT_NE(string::npos, foo.find("_arg0 = _aidl_recycled_p_Bar.getAndSet(null);\n"));
+  EXPECT_NE(string::npos, foo.find("_aidl_recycled_p_Bar.set(_arg0);\n"));
+  // The inout argument is returned to the client
+  EXPECT_EQ(string::npos, foo.find("_aidl_recycled_p_Bar.set(_arg1);\n"));
+  EXPECT_NE(string::npos, foo.find("public final void setRecycleInParcelables(boolean recycle)"));
+
+  Options plain = Options::From("aidl --lang=java -I . -o out p/IFoo.aidl p/Bar.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(plain, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.java", &foo));
+  EXPECT_EQ(string::npos, foo.find("_aidl_recycled"));
+}
+
+// The readFromParcel() of a parcelable that was generated without --java-reuse,
+// or by an older compiler, returns early on the shorter parcel of an older
+// sender and keeps the values of the previous call in the other fields. So
+// only the parcelables of the compilation are recycled or read into.
+TEST_F(AidlTest, ReusesOnlyTheParcelablesThatTheCompilationGenerates) {
+  io_delegate_.SetFileContents("p/IFoo.aidl",
+                               "package p; import p.Bar; import p.Old; interface IFoo {"
+                               " void f(in Bar bar); void g(in Old old); }");
+  io_delegate_.SetFileContents("p/Bar.aidl",
+                               "package p; import p.Old; parcelable Bar { int x; Old old; }");
+  io_delegate_.SetFileContents("p/Old.aidl", "package p; parcelable Old { int x; int y; }");
+
+  Options options =
+      Options::From("aidl --lang=java --java-reuse -I . -o out p/IFoo.aidl p/Bar.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(options, io_delegate_));
+  string foo;
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.java", &foo));
+  EXPECT_NE(string::npos, foo.find("_arg0 = _aidl_recycled_p_Bar.getAndSet(null);\n"));
+  EXPECT_EQ(string::npos, foo.find("_aidl_recycled_p_Old"));
+  EXPECT_NE(string::npos, foo.find("_arg0 = p.Old.CREATOR.createFromParcel(data);\n"));
+
+  // Bar reads a new Old rather than into the one it refers to
+  string bar;
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/Bar.java", &bar));
+  EXPECT_EQ(string::npos, bar.find("old.readFromParcel("));
+  EXPECT_NE(string::npos, bar.find("old = p.Old.CREATOR.createFromParcel(_aidl_parcel);\n"));
+
+  // Once Old is compiled with them, it resets the fields that were not sent.
+  Options all = Options::From(
+      "aidl --lang=java --java-reuse -I . -o out p/IFoo.aidl p/Bar.aidl p/Old.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(all, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.java", &foo));
+  EXPECT_NE(string::npos, foo.find("_arg0 = _aidl_recycled_p_Old.getAndSet(null);\n"));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/Bar.java", &bar));
+  EXPECT_NE(string::npos, bar.find("old.readFromParcel(_aidl_parcel);\n"));
+  string old;
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/Old.java", &old));
+  EXPECT_NE(string::npos, old.find("if (_aidl_reuse) _aidl_resetFrom(1);\n"));
+}
+
+TEST_F(AidlTest, WritesUnitySourcesThatIncludeTheGeneratedSources) {
+  io_delegate_.SetFileContents("p/IFoo.aidl", "package p; interface IFoo { void f(); }");
+  io_delegate_.SetFileContents("p/IBar.aidl", "package p; interface IBar { void f(); }");
+  io_delegate_.SetFileContents("p/Baz.aidl", "package p; parcelable Baz { int x; }");
+  io_delegate_.SetFileContents("p/E.aidl", "package p; enum E { A }");
+
+  Options options = Options::From(
+      "aidl --lang=cpp,ndk --unity-sources=2 -I . --out=cpp:out/cpp --out=ndk:out/ndk "
+      "--header_out=cpp:out/cpp --header_out=ndk:out/ndk p/IFoo.aidl p/IBar.aidl p/Baz.aidl "
+      "p/E.aidl");
+  ASSERT_TRUE(options.Ok()) << options.GetErrorMessage();
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(options, io_delegate_));
+  string output;
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/cpp/aidl_unity_0.cpp", &output));
+  EXPECT_EQ("#include \"p/IFoo.cpp\"\n", output);
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/cpp/aidl_unity_1.cpp", &output));
+  EXPECT_EQ("#include \"p/IBar.cpp\"\n#include \"p/Baz.cpp\"\n", output);
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/ndk/aidl_unity_1.cpp", &output));
+  EXPECT_EQ("#include \"p/IBar.cpp\"\n#include \"p/Baz.cpp\"\n", output);
+
+  // The static functions of the NDK sources of a package do not collide
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/ndk/p/IBar.cpp", &output));
+  EXPECT_NE(string::npos, output.find("static binder_status_t _aidl_IBar_onTransact("));
+  EXPECT_NE(string::npos, output.find("static AIBinder_Class* _g_aidl_IBar_clazz() {\n"));
+}
+
+TEST_F(AidlTest, IncludesForwardDeclarationsInTheInterfaceHeaders) {
+  io_delegate_.SetFileContents("p/IFoo.aidl",
+                               "package p; import p.Bar; import p.Color;"
+                               " interface IFoo { Color get(in Bar bar); }");
+  io_delegate_.SetFileContents("p/Bar.aidl", "package p; parcelable Bar { int x; }");
+  io_delegate_.SetFileContents("p/Color.aidl",
+                               "package p; @Backing(type=\"byte\") enum Color { RED }");
+
+  Options options = Options::From("aidl --lang=cpp --fwd-headers -I . -o out -h out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(options, io_delegate_));
+  string output;
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.h", &output));
+  EXPECT_NE(string::npos, output.find("#include <p/Bar_fwd.h>\n"));
+  EXPECT_NE(string::npos, output.find("#include <p/Color_fwd.h>\n"));
+  EXPECT_EQ(string::npos, output.find("#include <p/Bar.h>\n"));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/BpFoo.h", &output));
+  EXPECT_NE(string::npos, output.find("#include <p/Bar.h>\n"));
+  EXPECT_NE(string::npos, output.find("#include <p/Color.h>\n"));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/BnFoo.h", &output));
+  EXPECT_NE(string::npos, output.find("#include <p/Bar.h>\n"));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo_fwd.h", &output));
+  EXPECT_NE(string::npos, output.find("namespace p {\n\nclass IFoo;\n\n}  // namespace p\n"));
+
+  Options enum_options = Options::From("aidl --lang=cpp --fwd-headers -o out -h out p/Color.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(enum_options, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/Color_fwd.h", &output));
+  EXPECT_NE(string::npos, output.find("#ifndef AIDL_GENERATED_P_COLOR_FWD_H_\n"));
+  EXPECT_NE(string::npos, output.find("enum class Color : int8_t;\n"));
+
+  Options full = Options::From("aidl --lang=cpp -I . -o out -h out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(full, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.h", &output));
+  EXPECT_NE(string::npos, output.find("#include <p/Bar.h>\n"));
+  EXPECT_EQ(string::npos, output.find("_fwd.h"));
+}
+
+TEST_F(AidlTest, GeneratesAsynchronousVariantsOfTheBlockingMethods) {
+  io_delegate_.SetFileContents("p/IFoo.aidl",
+                               "package p; interface IFoo {"
+                               " String getName(int id, String tag); void ping();"
+                               " oneway void fire(); void fill(out int[] xs); }");
+
+  Options cpp = Options::From("aidl --lang=cpp --gen-async -o out -h out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(cpp, io_delegate_));
+  string output;
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.h", &output));
+  EXPECT_NE(string::npos, output.find("#include <aidl/async_executor.h>\n"));
+  EXPECT_NE(string::npos,
+            output.find("  ::std::future<::android::aidl::AsyncResult<::android::binder::Status, "
+                        "::android::String16>> getNameAsync(int32_t id, ::android::String16 "
+                        "tag);\n"
+                        "  ::std::future<::android::binder::Status> pingAsync();\n"
+                        "};"));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.cpp", &output));
+  EXPECT_NE(string::npos,
+            output.find("  ::android::sp<IFoo> _aidl_self = this;\n"
+                        "  return ::android::aidl::AsyncExecutor::Default().Submit(\n"
+                        "      [_aidl_self, id, tag = std::move(tag)]() mutable {\n"));
+  EXPECT_NE(string::npos, output.find("        _aidl_result.status = _aidl_self->getName(id, "
+                                      "tag, &_aidl_result.value);\n"));
+
+  Options ndk = Options::From("aidl --lang=ndk --gen-async -o out -h out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(ndk, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/aidl/p/IFoo.h", &output));
+  EXPECT_NE(string::npos,
+            output.find("  std::future<::android::aidl::AsyncResult<::ndk::ScopedAStatus, "
+                        "std::string>> getNameAsync(int32_t in_id, std::string in_tag);\n"
+                        "  std::future<::ndk::ScopedAStatus> pingAsync();\n"
+                        "private:\n"));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.cpp", &output));
+  EXPECT_NE(string::npos, output.find("  std::shared_ptr<IFoo> _aidl_self = ref<IFoo>();\n"));
+  EXPECT_NE(string::npos, output.find("        return _aidl_self->ping();\n"));
+
+  Options sync = Options::From("aidl --lang=cpp -o out -h out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(sync, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.h", &output));
+  EXPECT_EQ(string::npos, output.find("Async"));
+}
+
+TEST_F(AidlTest, PassesArrayViewsOfPrimitiveArrays) {
+  io_delegate_.SetFileContents("p/IFoo.aidl",
+                               "package p; interface IFoo {"
+                               " void f(in @ArrayView int[] samples, in int[] copies); }");
+
+  Options cpp = Options::From("aidl --lang=cpp -o out -h out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(cpp, io_delegate_));
+  string output;
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.h", &output));
+  EXPECT_NE(string::npos, output.find("#include <aidl/array_view_parcel.h>\n"));
+  EXPECT_NE(string::npos,
+            output.find("f(::android::aidl::ArrayView<int32_t> samples, "
+                        "const ::std::vector<int32_t>& copies) = 0;\n"));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.cpp", &output));
+  EXPECT_NE(string::npos,
+            output.find("_aidl_ret_status = ::android::aidl::WriteArrayView(&_aidl_data, "
+                        "samples);\n"));
+  // The stub points the view into the parcel instead of copying the array.
+  EXPECT_NE(string::npos, output.find("::android::aidl::ArrayView<int32_t> in_samples;\n"));
+  EXPECT_NE(string::npos,
+            output.find("_aidl_ret_status = ::android::aidl::ReadArrayView(&_aidl_data, "
+                        "&in_samples);\n"));
+  EXPECT_NE(string::npos, output.find("_aidl_data.readInt32Vector(&in_copies)"));
+
+  Options ndk = Options::From("aidl --lang=ndk -o out -h out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(ndk, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/aidl/p/IFoo.h", &output));
+  EXPECT_NE(string::npos, output.find("#include <aidl/array_view.h>\n"));
+  EXPECT_NE(string::npos,
+            output.find("f(::android::aidl::ArrayView<int32_t> in_samples, "
+                        "const std::vector<int32_t>& in_copies) = 0;\n"));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.cpp", &output));
+  EXPECT_NE(string::npos, output.find("#include <aidl/array_view_ndk.h>\n"));
+  EXPECT_NE(string::npos,
+            output.find("_aidl_ret_status = ::android::aidl::WriteArrayView(_aidl_in.get(), "
+                        "in_samples);\n"));
+  EXPECT_NE(string::npos, output.find("::ndk::AParcel_readVector(_aidl_in, &in_samples)"));
+
+  // Java passes arrays without copies already.
+  Options java = Options::From("aidl --lang=java -o out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(java, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.java", &output));
+  EXPECT_NE(string::npos, output.find("public void f(int[] samples, int[] copies)"));
+}
+
+TEST_F(AidlTest, RejectsArrayViewsOfOtherTypes) {
+  const vector<string> interfaces = {
+      "package p; interface IFoo { void f(in @ArrayView long[] b); }",
+      "package p; interface IFoo { void f(inout @ArrayView int[] b); }",
+      "package p; interface IFoo { @ArrayView int[] f(); }",
+  };
+  for (const string& interface : interfaces) {
+    io_delegate_.SetFileContents("p/IFoo.aidl", interface);
+    Options options = Options::From("aidl --lang=cpp -o out -h out p/IFoo.aidl");
+    EXPECT_NE(0, ::android::aidl::compile_aidl(options, io_delegate_)) << interface;
+  }
+  AddExpectedStderr(
+      "ERROR: p/IFoo.aidl:1.49-54: @ArrayView can only be used on byte[], int[] and float[] that "
+      "are not @nullable or @SharedMemory.\n");
+  AddExpectedStderr("ERROR: p/IFoo.aidl:1.58-60: @ArrayView can only be used on in arguments.\n");
+  AddExpectedStderr("ERROR: p/IFoo.aidl:1.45-47: @ArrayView can only be used on in arguments.\n");
+}
+
+TEST_F(AidlTest, HoldsFixedSizeArraysInStdArrays) {
+  io_delegate_.SetFileContents("p/IFoo.aidl",
+                               "package p; interface IFoo {"
+                               " int[4] f(in byte[3] key, in boolean[2] flags); }");
+  io_delegate_.SetFileContents("p/Data.aidl",
+                               "package p; parcelable Data {"
+                               " float[3] xyz; long[2] ids = {1, 2}; }");
+
+  Options cpp = Options::From("aidl --lang=cpp -o out -h out p/IFoo.aidl p/Data.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(cpp, io_delegate_));
+  string output;
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.h", &output));
+  EXPECT_NE(string::npos, output.find("#include <aidl/fixed_array_parcel.h>\n"));
+  EXPECT_NE(string::npos, output.find("#include <array>\n"));
+  EXPECT_NE(string::npos,
+            output.find("f(const ::std::array<uint8_t, 3>& key, const ::std::array<bool, 2>& "
+                        "flags, ::std::array<int32_t, 4>* _aidl_return) = 0;\n"));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.cpp", &output));
+  EXPECT_NE(string::npos,
+            output.find("_aidl_ret_status = ::android::aidl::WriteFixedArray(&_aidl_data, "
+                        "key);\n"));
+  EXPECT_NE(string::npos,
+            output.find("_aidl_ret_status = ::android::aidl::ReadFixedArray(&_aidl_reply, "
+                        "_aidl_return);\n"));
+  EXPECT_NE(string::npos, output.find("::std::array<uint8_t, 3> in_key;\n"));
+  EXPECT_NE(string::npos,
+            output.find("_aidl_ret_status = ::android::aidl::ReadFixedArray(&_aidl_data, "
+                        "&in_key);\n"));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/Data.h", &output));
+  EXPECT_NE(string::npos, output.find("::std::array<float, 3> xyz = {};\n"));
+  EXPECT_NE(string::npos,
+            output.find("::std::array<int64_t, 2> ids = ::std::array<int64_t, 2>({1L, 2L});\n"));
+
+  Options ndk = Options::From("aidl --lang=ndk -o out -h out p/IFoo.aidl p/Data.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(ndk, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/aidl/p/IFoo.h", &output));
+  EXPECT_NE(string::npos, output.find("#include <array>\n"));
+  EXPECT_NE(string::npos,
+            output.find("f(const std::array<int8_t, 3>& in_key, const std::array<bool, 2>& "
+                        "in_flags, std::array<int32_t, 4>* _aidl_return) = 0;\n"));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.cpp", &output));
+  EXPECT_NE(string::npos, output.find("#include <aidl/fixed_array_ndk.h>\n"));
+  EXPECT_NE(string::npos,
+            output.find("_aidl_ret_status = ::android::aidl::ReadFixedArray(_aidl_in, "
+                        "&in_key);\n"));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/aidl/p/Data.h", &output));
+  EXPECT_NE(string::npos, output.find("std::array<float, 3> xyz = {};\n"));
+
+  // Java holds them in arrays, whose lengths are checked on both sides.
+  Options java = Options::From("aidl --lang=java -o out p/IFoo.aidl p/Data.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(java, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.java", &output));
+  EXPECT_NE(string::npos, output.find("public int[] f(byte[] key, boolean[] flags)"));
+  EXPECT_NE(string::npos, output.find("if ((key==null || key.length != 3)) {\n"));
+  EXPECT_NE(string::npos, output.find("if ((_result==null || _result.length != 4)) {\n"));
+  EXPECT_NE(string::npos, output.find("throw new java.lang.IllegalArgumentException("
+                                      "\"int[4] must have 4 elements\");\n"));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/Data.java", &output));
+  EXPECT_NE(string::npos, output.find("public float[] xyz = new float[3];\n"));
+  EXPECT_NE(string::npos, output.find("public long[] ids = {1L, 2L};\n"));
+}
+
+TEST_F(AidlTest, RejectsFixedSizeArraysOfOtherTypes) {
+  const vector<string> interfaces = {
+      "package p; interface IFoo { void f(in String[2] names); }",
+      "package p; interface IFoo { void f(in @nullable int[2] ids); }",
+      "package p; interface IFoo { void f(out int[2] ids); }",
+      "package p; interface IFoo { void f(in int[0] ids); }",
+      "package p; interface IFoo { void f(in int[4097] ids); }",
+  };
+  for (const string& interface : interfaces) {
+    io_delegate_.SetFileContents("p/IFoo.aidl", interface);
+    Options options = Options::From("aidl --lang=cpp -o out -h out p/IFoo.aidl");
+    EXPECT_NE(0, ::android::aidl::compile_aidl(options, io_delegate_)) << interface;
+  }
+  io_delegate_.SetFileContents("p/Data.aidl", "package p; parcelable Data { int[3] k = {1, 2}; }");
+  Options options = Options::From("aidl --lang=cpp -o out -h out p/Data.aidl");
+  EXPECT_NE(0, ::android::aidl::compile_aidl(options, io_delegate_));
+
+  const string types_error =
+      ": Fixed-size arrays can only be of primitive types, and cannot be @nullable, "
+      "@SharedMemory or @ArrayView.\n";
+  AddExpectedStderr("ERROR: p/IFoo.aidl:1.38-45" + types_error);
+  AddExpectedStderr("ERROR: p/IFoo.aidl:1.48-52" + types_error);
+  AddExpectedStderr(
+      "ERROR: p/IFoo.aidl:1.46-50: Fixed-size arrays can only be used on in arguments.\n");
+  AddExpectedStderr(
+      "ERROR: p/IFoo.aidl:1.43-44: The size of a fixed-size array must be from 1 to 4096, not 0\n");
+  AddExpectedStderr(
+      "ERROR: p/IFoo.aidl:1.43-47: The size of a fixed-size array must be from 1 to 4096, not "
+      "4097\n");
+  AddExpectedStderr("ERROR: p/Data.aidl:1.40-42: A value of int[3] must have 3 elements, not 2\n");
+}
+
+TEST_F(AidlTest, ChecksTheSizeOfFixedSizeArraysInCheckAPI) {
+  Options options = Options::From("aidl --checkapi old new");
+  const string old_interface = "package p; interface IFoo{ void f(in int[2] a);}";
+  io_delegate_.SetFileContents("old/p/IFoo.aidl", old_interface);
+  io_delegate_.SetFileContents("new/p/IFoo.aidl", old_interface);
+  EXPECT_TRUE(::android::aidl::check_api(options, io_delegate_));
+
+  for (const char* type : {"int[3]", "int[]"}) {
+    io_delegate_.SetFileContents("new/p/IFoo.aidl",
+                                 "package p; interface IFoo{ void f(in " + string(type) + " a);}");
+    EXPECT_FALSE(::android::aidl::check_api(options, io_delegate_)) << type;
+    AddExpectedStderr(
+        "ERROR: old/p/IFoo.aidl:1.32-34: Removed or changed method: p.IFoo.f(int[2])\n");
+  }
+}
+
+TEST_F(AidlTest, PassesStringViewsOfUtf8Strings) {
+  io_delegate_.SetFileContents("p/IFoo.aidl",
+                               "package p; interface IFoo {"
+                               " void f(in @StringView @utf8InCpp String name,"
+                               " in @utf8InCpp String copy); }");
+
+  Options cpp = Options::From("aidl --lang=cpp -o out -h out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(cpp, io_delegate_));
+  string output;
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.h", &output));
+  EXPECT_NE(string::npos, output.find("#include <aidl/array_view_parcel.h>\n"));
+  EXPECT_NE(string::npos, output.find("#include <string_view>\n"));
+  EXPECT_NE(string::npos,
+            output.find("f(::std::string_view name, const ::std::string& copy) = 0;\n"));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.cpp", &output));
+  EXPECT_NE(string::npos,
+            output.find("_aidl_ret_status = ::android::aidl::WriteStringView(&_aidl_data, "
+                        "name);\n"));
+  EXPECT_NE(string::npos, output.find("_aidl_data.writeUtf8AsUtf16(copy)"));
+  // The stub reads the UTF-16 of the parcel into a string for the view.
+  EXPECT_NE(string::npos, output.find("::std::string in_name;\n"));
+  EXPECT_NE(string::npos, output.find("_aidl_data.readUtf8FromUtf16(&in_name)"));
+
+  Options ndk = Options::From("aidl --lang=ndk -o out -h out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(ndk, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/aidl/p/IFoo.h", &output));
+  EXPECT_NE(string::npos, output.find("#include <string_view>\n"));
+  EXPECT_NE(string::npos,
+            output.find("f(std::string_view in_name, const std::string& in_copy) = 0;\n"));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.cpp", &output));
+  EXPECT_NE(string::npos, output.find("#include <aidl/array_view_ndk.h>\n"));
+  EXPECT_NE(string::npos,
+            output.find("_aidl_ret_status = ::android::aidl::WriteStringView(_aidl_in.get(), "
+                        "in_name);\n"));
+  EXPECT_NE(string::npos, output.find("::ndk::AParcel_readString(_aidl_in, &in_name)"));
+
+  Options java = Options::From("aidl --lang=java -o out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(java, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.java", &output));
+  EXPECT_NE(string::npos,
+            output.find("public void f(java.lang.String name, java.lang.String copy)"));
+}
+
+TEST_F(AidlTest, RejectsStringViewsOfOtherTypes) {
+  const vector<string> interfaces = {
+      "package p; interface IFoo { void f(in @StringView String s); }",
+      "package p; interface IFoo { void f(in @StringView @utf8InCpp String[] s); }",
+      "package p; interface IFoo { void f(out @StringView @utf8InCpp String s); }",
+      "package p; interface IFoo { @StringView @utf8InCpp String f(); }",
+      "package p; interface IFoo { @Cacheable int f(in @StringView @utf8InCpp String s); }",
+  };
+  for (const string& interface : interfaces) {
+    io_delegate_.SetFileContents("p/IFoo.aidl", interface);
+    Options options = Options::From("aidl --lang=cpp -o out -h out p/IFoo.aidl");
+    EXPECT_NE(0, ::android::aidl::compile_aidl(options, io_delegate_)) << interface;
+  }
+  io_delegate_.SetFileContents("p/Foo.aidl",
+                               "package p; parcelable Foo { @StringView @utf8InCpp String s; }");
+  Options options = Options::From("aidl --lang=cpp -o out -h out p/Foo.aidl");
+  EXPECT_NE(0, ::android::aidl::compile_aidl(options, io_delegate_));
+}
+
+TEST_F(AidlTest, HoldsNullablesInOptionalWithTheOption) {
+  io_delegate_.SetFileContents("p/IFoo.aidl",
+                               "package p; interface IFoo {"
+                               " @nullable String f(in @nullable String[] s,"
+                               " in @nullable IBinder b); }");
+  io_delegate_.SetFileContents("p/Bar.aidl",
+                               "package p; parcelable Bar { @nullable int[] a; }");
+
+  Options cpp = Options::From("aidl --lang=cpp -o out -h out p/IFoo.aidl p/Bar.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(cpp, io_delegate_));
+  string output;
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.h", &output));
+  EXPECT_NE(string::npos, output.find("#include <memory>\n"));
+  EXPECT_NE(string::npos,
+            output.find("f(const ::std::unique_ptr<::std::vector<::std::unique_ptr<"
+                        "::android::String16>>>& s, const ::android::sp<::android::IBinder>& b, "
+                        "::std::unique_ptr<::android::String16>* _aidl_return) = 0;\n"));
+
+  Options optional =
+      Options::From("aidl --lang=cpp --nullable=optional -o out -h out p/IFoo.aidl p/Bar.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(optional, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.h", &output));
+  EXPECT_NE(string::npos, output.find("#include <optional>\n"));
+  EXPECT_EQ(string::npos, output.find("#include <memory>\n"));
+  EXPECT_NE(string::npos,
+            output.find("f(const ::std::optional<::std::vector<::std::optional<"
+                        "::android::String16>>>& s, const ::android::sp<::android::IBinder>& b, "
+                        "::std::optional<::android::String16>* _aidl_return) = 0;\n"));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.cpp", &output));
+  EXPECT_NE(string::npos, output.find("::std::optional<::android::String16> _aidl_return;\n"));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/Bar.h", &output));
+  EXPECT_NE(string::npos, output.find("::std::optional<::std::vector<int32_t>> a;\n"));
+}
+
+TEST_F(AidlTest, MovesInArgumentsWithMoveIn) {
+  io_delegate_.SetFileContents("p/IFoo.aidl",
+                               "package p; interface IFoo {"
+                               " @MoveIn void f(in String s, in int[] a, int n);"
+                               " void g(in String s); }");
+
+  Options cpp = Options::From("aidl --lang=cpp -o out -h out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(cpp, io_delegate_));
+  string output;
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.h", &output));
+  EXPECT_NE(string::npos, output.find("f(::android::String16&& s, ::std::vector<int32_t>&& a, "
+                                      "int32_t n) = 0;\n"));
+  EXPECT_NE(string::npos, output.find("g(const ::android::String16& s) = 0;\n"));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.cpp", &output));
+  EXPECT_NE(string::npos,
+            output.find("_aidl_status(f(std::move(in_s), std::move(in_a), in_n));\n"));
+  EXPECT_NE(string::npos, output.find("_aidl_status(g(in_s));\n"));
+  EXPECT_NE(string::npos,
+            output.find("return IFoo::getDefaultImpl()->f(std::move(s), std::move(a), n);\n"));
+
+  Options ndk = Options::From("aidl --lang=ndk -o out -h out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(ndk, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/aidl/p/IFoo.h", &output));
+  EXPECT_NE(string::npos, output.find("f(std::string&& in_s, std::vector<int32_t>&& in_a, "
+                                      "int32_t in_n) = 0;\n"));
+  EXPECT_NE(string::npos, output.find("g(const std::string& in_s) = 0;\n"));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.cpp", &output));
+  EXPECT_NE(string::npos,
+            output.find("_aidl_impl->f(std::move(in_s), std::move(in_a), in_n);\n"));
+  EXPECT_NE(string::npos, output.find("_aidl_impl->g(in_s);\n"));
+
+  // On an interface, @MoveIn applies to each of its methods.
+  io_delegate_.SetFileContents("p/IFoo.aidl",
+                               "package p; @MoveIn interface IFoo { void g(in String s); }");
+  Options cpp_interface = Options::From("aidl --lang=cpp -o out -h out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(cpp_interface, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.h", &output));
+  EXPECT_NE(string::npos, output.find("g(::android::String16&& s) = 0;\n"));
+}
+
+TEST_F(AidlTest, RejectsMoveInOnArgumentsAndParcelables) {
+  io_delegate_.SetFileContents("p/IFoo.aidl",
+                               "package p; interface IFoo { void f(in @MoveIn String s); }");
+  Options options = Options::From("aidl --lang=cpp -o out -h out p/IFoo.aidl");
+  EXPECT_NE(0, ::android::aidl::compile_aidl(options, io_delegate_));
+  io_delegate_.SetFileContents("p/Foo.aidl", "package p; parcelable Foo { @MoveIn String s; }");
+  Options parcelable = Options::From("aidl --lang=cpp -o out -h out p/Foo.aidl");
+  EXPECT_NE(0, ::android::aidl::compile_aidl(parcelable, io_delegate_));
+  AddExpectedStderr(
+      "ERROR: p/IFoo.aidl:1.53-55: @MoveIn can only be used on interfaces and methods.\n");
+  AddExpectedStderr(
+      "ERROR: p/Foo.aidl:1.43-45: @MoveIn can only be used on interfaces and methods.\n");
+}
+
+TEST_F(AidlTest, MovesLargeByteArraysIntoSharedMemory) {
+  io_delegate_.SetFileContents("p/IFoo.aidl",
+                               "package p; interface IFoo {"
+                               " void f(in @SharedMemory(threshold=4096) byte[] b, in byte[] c); }");
+  io_delegate_.SetFileContents("p/Blob.aidl",
+                               "package p; parcelable Blob { @SharedMemory byte[] bytes; }");
+
+  Options cpp = Options::From("aidl --lang=cpp -o out -h out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(cpp, io_delegate_));
+  string output;
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.h", &output));
+  EXPECT_NE(string::npos, output.find("#include <aidl/shared_memory_parcel.h>\n"));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.cpp", &output));
+  EXPECT_NE(string::npos,
+            output.find("_aidl_ret_status = ::android::aidl::shared_memory::WriteBytes("
+                        "&_aidl_data, b, 4096);\n"));
+  EXPECT_NE(string::npos,
+            output.find("_aidl_ret_status = ::android::aidl::shared_memory::ReadBytes("
+                        "&_aidl_data, &in_b);\n"));
+  // The arguments without the annotation stay inline.
+  EXPECT_NE(string::npos, output.find("_aidl_ret_status = _aidl_data.writeByteVector(c);\n"));
+
+  Options cpp_parcel = Options::From("aidl --lang=cpp -o out -h out p/Blob.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(cpp_parcel, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/Blob.cpp", &output));
+  EXPECT_NE(string::npos, output.find("::android::aidl::shared_memory::WriteBytes("
+                                      "_aidl_parcel, bytes, 65536);\n"));
+  EXPECT_NE(string::npos,
+            output.find("::android::aidl::shared_memory::ReadBytes(_aidl_parcel, &bytes);\n"));
+
+  Options ndk = Options::From("aidl --lang=ndk -o out -h out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(ndk, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.cpp", &output));
+  EXPECT_NE(string::npos, output.find("#include <aidl/shared_memory_ndk.h>\n"));
+  EXPECT_NE(string::npos, output.find("_aidl_ret_status = ::android::aidl::shared_memory::"
+                                      "WriteBytes(_aidl_in.get(), in_b, 4096);\n"));
+  EXPECT_NE(string::npos, output.find("_aidl_ret_status = ::android::aidl::shared_memory::"
+                                      "ReadBytes(_aidl_in, &in_b);\n"));
+
+  Options java = Options::From("aidl --lang=java -o out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(java, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.java", &output));
+  EXPECT_NE(string::npos, output.find("if ((b!=null && b.length > 4096)) {\n"));
+  EXPECT_NE(string::npos, output.find("_aidl_region.writeToParcel(_data, 0);\n"));
+  EXPECT_NE(string::npos, output.find("_arg0 = new byte[_aidl_length];\n"));
+  // The region is read, not mapped, in case the sender shrinks it.
+  EXPECT_NE(string::npos, output.find("_aidl_channel.read(java.nio.ByteBuffer.wrap(_arg0, "
+                                      "_aidl_offset, _aidl_length - _aidl_offset), "
+                                      "_aidl_offset);\n"));
+  EXPECT_EQ(string::npos, output.find(".map("));
+  EXPECT_NE(string::npos, output.find("_arg1 = data.createByteArray();\n"));
+}
+
+TEST_F(AidlTest, RejectsSharedMemoryOnAnythingButInByteArrays) {
+  const vector<string> interfaces = {
+      "package p; interface IFoo { void f(in @SharedMemory int[] b); }",
+      "package p; interface IFoo { void f(out @SharedMemory byte[] b); }",
+      "package p; interface IFoo { @SharedMemory byte[] f(); }",
+      "package p; interface IFoo { void f(in @SharedMemory(threshold=-1) byte[] b); }",
+  };
+  for (const string& interface : interfaces) {
+    io_delegate_.SetFileContents("p/IFoo.aidl", interface);
+    Options options = Options::From("aidl --lang=cpp -o out -h out p/IFoo.aidl");
+    EXPECT_NE(0, ::android::aidl::compile_aidl(options, io_delegate_)) << interface;
+  }
+  AddExpectedStderr(
+      "ERROR: p/IFoo.aidl:1.52-56: @SharedMemory can only be used on byte[] that is not "
+      "@nullable.\n");
+  AddExpectedStderr(
+      "ERROR: p/IFoo.aidl:1.60-62: @SharedMemory can only be used on in arguments and parcelable "
+      "fields.\n");
+  AddExpectedStderr(
+      "ERROR: p/IFoo.aidl:1.49-51: @SharedMemory can only be used on in arguments and parcelable "
+      "fields.\n");
+  AddExpectedStderr(
+      "ERROR: p/IFoo.aidl:1.66-71: The threshold of @SharedMemory cannot be negative.\n");
+}
+
+TEST_F(AidlTest, CachesTheInterfaceVersionAndHashOfNdkProxiesWithoutALock) {
+  io_delegate_.SetFileContents("p/IFoo.aidl", "package p; interface IFoo { void a(); }");
+  Options options =
+      Options::From("aidl --lang=ndk --version=3 --hash=abcdefg -o out -h out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(options, io_delegate_));
+  string output;
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/aidl/p/BpFoo.h", &output));
+  EXPECT_NE(string::npos, output.find("#include <atomic>\n"));
+  EXPECT_NE(string::npos, output.find("  std::atomic<int32_t> _aidl_cached_version{-1};\n"
+                                      "  std::atomic<int> _aidl_cached_hash_state{0};\n"
+                                      "  std::string _aidl_cached_hash;\n"));
+  EXPECT_EQ(string::npos, output.find("mutex"));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.cpp", &output));
+  EXPECT_NE(string::npos,
+            output.find("if (_aidl_cached_hash_state.load(std::memory_order_acquire) == 2) {\n"));
+  EXPECT_NE(string::npos,
+            output.find("_aidl_cached_version.store(*_aidl_return, std::memory_order_release);\n"));
+  EXPECT_EQ(string::npos, output.find("lock_guard"));
 }
 
-TEST_F(AidlTest, ParsesPreprocessedFileWithWhitespace) {
-  string simple_content = "parcelable    a.Foo;\n  interface b.IBar  ;\t";
-  io_delegate_.SetFileContents("path", simple_content);
+TEST_F(AidlTest, OutlinesTheColdMethodsOfATransactProfile) {
+  io_delegate_.SetFileContents("p/IFoo.aidl",
+                               "package p; interface IFoo {\n"
+                               "  void a(); void b(int x); void c(int x, int y); void d();\n"
+                               "}");
+  io_delegate_.SetFileContents("calls.txt",
+                               "# calls from traces\n"
+                               "p.IFoo#d 100\n"
+                               "IFoo#c 50\n"
+                               "\n"
+                               "p.IFoo#a 10\n"
+                               "q.IBar#b 999\n"
+                               "p.IFoo#gone 5\n");
+  Options options = Options::From(
+      "aidl --lang=java --transact_profile=calls.txt -d IFoo.d -o out p/IFoo.aidl");
+  options.onTransact_outline_threshold_ = 2;
+  options.onTransact_non_outline_count_ = 2;
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(options, io_delegate_));
+  string output;
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.java", &output));
+  // The hottest methods stay in onTransact, hottest first.
+  EXPECT_EQ(string::npos, output.find("onTransact$d$"));
+  EXPECT_EQ(string::npos, output.find("onTransact$c$"));
+  EXPECT_NE(string::npos, output.find("onTransact$a$"));
+  EXPECT_NE(string::npos, output.find("onTransact$b$"));
+  EXPECT_LT(output.find("case TRANSACTION_d:"), output.find("case TRANSACTION_c:"));
+  EXPECT_LT(output.find("case TRANSACTION_c:"), output.find("case TRANSACTION_a:"));
+  EXPECT_LT(output.find("case TRANSACTION_a:"), output.find("case TRANSACTION_b:"));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("IFoo.d", &output));
+  EXPECT_NE(string::npos, output.find("calls.txt"));
+
+  io_delegate_.SetFileContents("calls.txt", "p.IFoo d 100\n");
+  AddExpectedStderr("calls.txt:1 malformed transact profile line: 'p.IFoo d 100'\n");
+  EXPECT_NE(0, ::android::aidl::compile_aidl(options, io_delegate_));
 
-  EXPECT_FALSE(typenames_.ResolveTypename("a.Foo").second);
-  EXPECT_TRUE(parse_preprocessed_file(io_delegate_, "path", &typenames_));
-  EXPECT_TRUE(typenames_.ResolveTypename("a.Foo").second);
-  EXPECT_TRUE(typenames_.ResolveTypename("b.IBar").second);
+  EXPECT_FALSE(Options::From("aidl --lang=cpp --transact_profile=calls.txt -o out -h out "
+                             "p/IFoo.aidl")
+                   .Ok());
 }
 
-TEST_F(AidlTest, PreferImportToPreprocessed) {
-  io_delegate_.SetFileContents("preprocessed", "interface another.IBar;");
-  io_delegate_.SetFileContents("one/IBar.aidl", "package one; "
-                                                "interface IBar {}");
-  preprocessed_files_.push_back("preprocessed");
-  import_paths_.emplace("");
-  auto parse_result = Parse("p/IFoo.aidl", "package p; import one.IBar; interface IFoo {}",
-                            typenames_, Options::Language::JAVA);
-  EXPECT_NE(nullptr, parse_result);
+TEST_F(AidlTest, CompileSessionKeepsImportsBetweenJobs) {
+  io_delegate_.SetFileContents("src/p/IBase.aidl", "package p; interface IBase {}");
+  io_delegate_.SetFileContents("src/p/IFoo.aidl",
+                               "package p; import p.IBase; interface IFoo { IBase f(); }");
+  io_delegate_.SetFileContents("src/p/IBar.aidl",
+                               "package p; import p.IBase; interface IBar { IBase f(); }");
+  const string java = "aidl --lang=java -I src -o out ";
+  ::android::aidl::CompileSession session;
+
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(Options::From(java + "src/p/IFoo.aidl"),
+                                             io_delegate_, &session));
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(Options::From(java + "src/p/IBar.aidl"),
+                                             io_delegate_, &session));
+  EXPECT_EQ(1u, session.Reuses());
+  string output;
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IBar.java", &output));
+
+  // Compiling an input again, changing a file or changing the settings starts over.
+  session.Dependencies().Invalidate("src/p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(Options::From(java + "src/p/IFoo.aidl"),
+                                             io_delegate_, &session));
+  io_delegate_.SetFileContents("src/p/IBase.aidl", "package p; interface IBase { void g(); }");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(Options::From(java + "src/p/IBar.aidl"),
+                                             io_delegate_, &session));
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(
+                   Options::From("aidl --lang=java -I src -o out2 --version=2 src/p/IBase.aidl"),
+                   io_delegate_, &session));
+  EXPECT_EQ(1u, session.Reuses());
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out2/p/IBase.java", &output));
+  EXPECT_NE(string::npos, output.find("void g()"));
+}
 
-  // We expect to know about both kinds of IBar
-  EXPECT_TRUE(typenames_.ResolveTypename("one.IBar").second);
-  EXPECT_TRUE(typenames_.ResolveTypename("another.IBar").second);
-  // But if we request just "IBar" we should get our imported one.
-  AidlTypeSpecifier ambiguous_type(AIDL_LOCATION_HERE, "IBar", false, nullptr, "");
-  ambiguous_type.Resolve(typenames_);
-  EXPECT_EQ("one.IBar", ambiguous_type.GetName());
+TEST_F(AidlTest, SkimsTheBodiesOfImports) {
+  // The error in the body of the import goes unnoticed until it is compiled.
+  io_delegate_.SetFileContents("src/p/IBase.aidl",
+                               "package p;\n"
+                               "@VintfStability\n"
+                               "interface IBase {\n"
+                               "  // }\n"
+                               "  const String S = \"{\";\n"
+                               "  this isn't aidl;\n"
+                               "}\n");
+  io_delegate_.SetFileContents("src/p/Kind.aidl",
+                               "package p; @Backing(type=\"long\") enum Kind { A = 3, B }");
+  io_delegate_.SetFileContents(
+      "src/p/IFoo.aidl",
+      "package p; import p.IBase; import p.Kind; interface IFoo { IBase f(Kind k); }");
+  Options options = Options::From("aidl --lang=java -I src -o out src/p/IFoo.aidl");
+  vector<AidlDefinedType*> types;
+  ASSERT_EQ(AidlError::OK, ::android::aidl::internals::load_and_validate_aidl(
+                               "src/p/IFoo.aidl", options, io_delegate_, &typenames_, &types,
+                               nullptr));
+
+  const AidlDefinedType* base = typenames_.TryGetDefinedType("p.IBase");
+  ASSERT_NE(nullptr, base);
+  ASSERT_NE(nullptr, base->AsInterface());
+  EXPECT_TRUE(base->AsInterface()->GetMethods().empty());
+  EXPECT_TRUE(base->IsVintfStability());
+  const AidlDefinedType* kind = typenames_.TryGetDefinedType("p.Kind");
+  ASSERT_NE(nullptr, kind);
+  ASSERT_NE(nullptr, kind->AsEnumDeclaration());
+  EXPECT_EQ(2u, kind->AsEnumDeclaration()->GetEnumerators().size());
+  EXPECT_EQ("long", kind->AsEnumDeclaration()->GetBackingType().GetName());
+  EXPECT_EQ(1u, types[0]->AsInterface()->GetMethods().size());
+
+  EXPECT_NE(0, ::android::aidl::compile_aidl(
+                   Options::From("aidl --lang=java -I src -o out src/p/IBase.aidl"), io_delegate_));
 }
 
-// Special case of PreferImportToPreprocessed. Imported type should be preferred
-// even when the preprocessed file already has the same type.
-TEST_F(AidlTest, B147918827) {
-  io_delegate_.SetFileContents("preprocessed", "interface another.IBar;\ninterface one.IBar;");
-  io_delegate_.SetFileContents("one/IBar.aidl",
-                               "package one; "
-                               "interface IBar {}");
-  preprocessed_files_.push_back("preprocessed");
-  import_paths_.emplace("");
-  auto parse_result = Parse("p/IFoo.aidl", "package p; import one.IBar; interface IFoo {}",
-                            typenames_, Options::Language::JAVA);
-  EXPECT_NE(nullptr, parse_result);
+TEST_F(AidlTest, CompileSessionParsesSkimmedImportsWhole) {
+  io_delegate_.SetFileContents("src/p/IBase.aidl", "package p; interface IBase { void g(); }");
+  io_delegate_.SetFileContents("src/p/IFoo.aidl",
+                               "package p; import p.IBase; interface IFoo { IBase f(); }");
+  const string java = "aidl --lang=java -I src -o out ";
+  ::android::aidl::CompileSession session;
+
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(Options::From(java + "src/p/IFoo.aidl"),
+                                             io_delegate_, &session));
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(Options::From(java + "src/p/IBase.aidl"),
+                                             io_delegate_, &session));
+  EXPECT_EQ(0u, session.Reuses());
+  string output;
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IBase.java", &output));
+  EXPECT_NE(string::npos, output.find("void g()"));
+}
 
-  // We expect to know about both kinds of IBar
-  EXPECT_TRUE(typenames_.ResolveTypename("one.IBar").second);
-  EXPECT_TRUE(typenames_.ResolveTypename("another.IBar").second);
-  // But if we request just "IBar" we should get our imported one.
-  AidlTypeSpecifier ambiguous_type(AIDL_LOCATION_HERE, "IBar", false, nullptr, "");
-  ambiguous_type.Resolve(typenames_);
-  EXPECT_EQ("one.IBar", ambiguous_type.GetName());
+TEST_F(AidlTest, CompileSessionRegeneratesOnlyTheDependentsOfAChange) {
+  io_delegate_.SetFileContents("src/p/Point.aidl", "package p; parcelable Point { int x; }");
+  io_delegate_.SetFileContents("src/p/IFoo.aidl",
+                               "package p; import p.Point; interface IFoo { Point f(); }");
+  io_delegate_.SetFileContents("src/p/IBar.aidl", "package p; interface IBar { void g(); }");
+  const Options options = Options::From(
+      "aidl --lang=java -I src -o out src/p/Point.aidl src/p/IFoo.aidl src/p/IBar.aidl");
+  ::android::aidl::CompileSession session;
+
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(options, io_delegate_, &session));
+  EXPECT_TRUE(session.UpToDateInputs().empty());
+  EXPECT_EQ(3u, session.Dependencies().Size());
+  EXPECT_EQ((set<string>{"src/p/IFoo.aidl", "src/p/Point.aidl"}),
+            session.Dependencies().Dependents("src/p/Point.aidl"));
+  EXPECT_EQ((set<string>{"out/p/IFoo.java", "out/p/Point.java"}),
+            session.Dependencies().Outputs("src/p/Point.aidl"));
+
+  // Nothing has changed.
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(options, io_delegate_, &session));
+  EXPECT_EQ(3u, session.UpToDateInputs().size());
+
+  io_delegate_.SetFileContents("src/p/Point.aidl", "package p; parcelable Point { int y; }");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(options, io_delegate_, &session));
+  EXPECT_EQ(set<string>{"src/p/IBar.aidl"}, session.UpToDateInputs());
+  string output;
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/Point.java", &output));
+  EXPECT_NE(string::npos, output.find("public int y"));
+
+  // Other settings, or an output that was changed, make it stale as well.
+  const Options out2 = Options::From("aidl --lang=java -I src -o out2 src/p/IBar.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(out2, io_delegate_, &session));
+  EXPECT_TRUE(session.UpToDateInputs().empty());
+  EXPECT_FALSE(session.Dependencies().IsUpToDate("src/p/IBar.aidl", options, io_delegate_));
+  EXPECT_TRUE(session.Dependencies().IsUpToDate("src/p/IBar.aidl", out2, io_delegate_));
+  io_delegate_.RemovePath("out2/p/IBar.java");
+  EXPECT_FALSE(session.Dependencies().IsUpToDate("src/p/IBar.aidl", out2, io_delegate_));
 }
 
-TEST_F(AidlTest, WritePreprocessedFile) {
-  io_delegate_.SetFileContents("p/Outer.aidl",
-                               "package p; parcelable Outer.Inner;");
-  io_delegate_.SetFileContents("one/IBar.aidl", "package one; import p.Outer;"
-                                                "interface IBar {}");
+TEST_F(AidlTest, DependencyIndexInvalidatesTheTransitiveDependents) {
+  io_delegate_.SetFileContents("a.aidl", "a");
+  io_delegate_.SetFileContents("b.aidl", "b");
+  io_delegate_.SetFileContents("c.aidl", "c");
+  io_delegate_.SetFileContents("d.aidl", "d");
+  const Options options = Options::From("aidl --lang=java -o out a.aidl");
+  ::android::aidl::DependencyIndex index;
+  index.Record("a.aidl", options, {"b.aidl"}, {"out/a.java"}, io_delegate_);
+  index.Record("b.aidl", options, {"./c.aidl"}, {"out/b.java"}, io_delegate_);
+  index.Record("d.aidl", options, {}, {"out/d.java"}, io_delegate_);
+
+  EXPECT_EQ((set<string>{"a.aidl", "b.aidl"}), index.Dependents("c.aidl"));
+  EXPECT_EQ(set<string>{"a.aidl"}, index.Dependents("a.aidl"));
+  EXPECT_TRUE(index.Dependents("e.aidl").empty());
+  EXPECT_TRUE(index.IsUpToDate("a.aidl", options, io_delegate_));
+
+  // Through the import that it reads
+  io_delegate_.SetFileContents("b.aidl", "B");
+  EXPECT_FALSE(index.IsUpToDate("a.aidl", options, io_delegate_));
+  EXPECT_TRUE(index.IsUpToDate("d.aidl", options, io_delegate_));
+
+  EXPECT_EQ((set<string>{"out/a.java", "out/b.java"}), index.Invalidate("c.aidl"));
+  EXPECT_EQ(1u, index.Size());
+  EXPECT_TRUE(index.Dependents("c.aidl").empty());
+  EXPECT_EQ(set<string>{"out/d.java"}, index.Outputs("d.aidl"));
+}
 
-  vector<string> args {
-    "aidl",
-    "--preprocess",
-    "preprocessed",
-    "p/Outer.aidl",
-    "one/IBar.aidl"};
-  Options options = Options::From(args);
-  EXPECT_TRUE(::android::aidl::preprocess_aidl(options, io_delegate_));
+TEST_F(AidlTest, GeneratesSeveralLanguagesFromOneParse) {
+  io_delegate_.SetFileContents("src/p/IFoo.aidl", "package p; interface IFoo { void f(); }");
+  Options options = Options::From(
+      "aidl --lang=java,cpp,ndk -I src --out=java:out/java --out=cpp:out/cpp --out=ndk:out/ndk "
+      "-h cpp:out/cpp/include -h ndk:out/ndk/include -a src/p/IFoo.aidl");
+  ASSERT_TRUE(options.Ok()) << options.GetErrorMessage();
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(options, io_delegate_));
 
   string output;
-  EXPECT_TRUE(io_delegate_.GetWrittenContents("preprocessed", &output));
-  EXPECT_EQ("parcelable p.Outer.Inner;\ninterface one.IBar;\n", output);
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/java/p/IFoo.java", &output));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/java/p/IFoo.java.d", &output));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/cpp/p/IFoo.cpp", &output));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/cpp/include/p/IFoo.h", &output));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/ndk/p/IFoo.cpp", &output));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/ndk/include/aidl/p/IFoo.h", &output));
+}
+
+TEST_F(AidlTest, ChecksEveryLanguageOfOneParse) {
+  // FileDescriptor isn't supported by the NDK backend.
+  io_delegate_.SetFileContents("p/IFoo.aidl",
+                               "package p; interface IFoo { void f(in FileDescriptor fd); }");
+  Options options =
+      Options::From("aidl --lang=java,ndk -o out -h ndk:out/include p/IFoo.aidl");
+  ASSERT_TRUE(options.Ok()) << options.GetErrorMessage();
+  EXPECT_NE(0, ::android::aidl::compile_aidl(options, io_delegate_));
+  string output;
+  EXPECT_FALSE(io_delegate_.GetWrittenContents("out/p/IFoo.java", &output));
 }
 
 TEST_F(AidlTest, JavaParcelableOutput) {
@@ -659,6 +2991,99 @@ TEST_F(AidlTest, ParseNegativeConstHexValue) {
   EXPECT_EQ("-1", cpp_constants[0]->ValueString(cpp::ConstantValueDecorator));
 }
 
+TEST_F(AidlTest, FoldsConstantExpressionsForTheirType) {
+  auto parse_result = Parse("p/IFoo.aidl",
+                            "package p; interface IFoo {\n"
+                            "  const String S = \"a\" + \"b\";\n"
+                            "  const int I = (1 << 4) | 3;\n"
+                            "}\n",
+                            typenames_, Options::Language::CPP);
+  ASSERT_NE(nullptr, parse_result);
+  const auto& constants = parse_result->AsInterface()->GetConstantDeclarations();
+  ASSERT_EQ(2u, constants.size());
+  EXPECT_EQ("\"ab\"", constants[0]->ValueString(AidlConstantValueDecorator));
+  EXPECT_EQ("19", constants[1]->ValueString(AidlConstantValueDecorator));
+  EXPECT_EQ("19", constants[1]->ValueString(cpp::ConstantValueDecorator));
+
+  // Other types are still checked against the value.
+  AidlTypeSpecifier long_type(AIDL_LOCATION_HERE, "long", false, nullptr, "");
+  EXPECT_EQ("19", constants[1]->GetValue().ValueString(long_type, AidlConstantValueDecorator));
+  AidlTypeSpecifier string_type(AIDL_LOCATION_HERE, "String", false, nullptr, "");
+  AddExpectedStderr("ERROR: p/IFoo.aidl:3.16-25: Invalid type specifier for an int32 literal: "
+                    "String\n");
+  EXPECT_EQ("", constants[1]->GetValue().ValueString(string_type, AidlConstantValueDecorator));
+}
+
+TEST_F(AidlTest, MemoizesTheNamesOfResolvedTypes) {
+  auto parse_result = Parse("p/IFoo.aidl",
+                            "package p; interface IFoo { List<String> get(in int[] a); }",
+                            typenames_, Options::Language::CPP);
+  ASSERT_NE(nullptr, parse_result);
+  const AidlMethod& method = *parse_result->AsInterface()->GetMethods()[0];
+  const AidlTypeSpecifier& list_type = method.GetType();
+  for (int i = 0; i < 2; i++) {
+    EXPECT_EQ("List<String>", list_type.ToString());
+    EXPECT_EQ("::std::vector<::android::String16>", cpp::CppNameOf(list_type, typenames_));
+    EXPECT_EQ("readString16Vector", cpp::ParcelReadMethodOf(list_type, typenames_));
+  }
+
+  // A copy of the type makes its own names.
+  const AidlTypeSpecifier& array_type = method.GetArguments()[0]->GetType();
+  EXPECT_EQ("int[]", array_type.ToString());
+  EXPECT_EQ("int", array_type.ArrayBase().ToString());
+  EXPECT_EQ("int[]", array_type.ToString());
+
+  // Unresolved types aren't memoized, since resolving them changes their names.
+  AidlTypeSpecifier unresolved(AIDL_LOCATION_HERE, "IFoo", false, nullptr, "");
+  EXPECT_EQ("IFoo", unresolved.ToString());
+  ASSERT_TRUE(unresolved.Resolve(typenames_));
+  EXPECT_EQ("p.IFoo", unresolved.ToString());
+}
+
+TEST_F(AidlTest, ResolvesTheRepeatedNamesOfAFileAlike) {
+  import_paths_.emplace("");
+  io_delegate_.SetFileContents("p/Bar.aidl", "package p; parcelable Bar { int a; }");
+  auto parse_result = Parse("p/IFoo.aidl",
+                            "package p; import p.Bar; interface IFoo {"
+                            " Bar f(in Bar a, in Bar[] b, in List<Bar> c, in String d); }",
+                            typenames_, Options::Language::JAVA);
+  ASSERT_NE(nullptr, parse_result);
+  const AidlMethod& method = *parse_result->AsInterface()->GetMethods()[0];
+  const auto& args = method.GetArguments();
+  const vector<const AidlTypeSpecifier*> bars = {&method.GetType(), &args[0]->GetType(),
+                                                 &args[1]->GetType(),
+                                                 args[2]->GetType().GetTypeParameters()[0].get()};
+  for (const AidlTypeSpecifier* type : bars) {
+    EXPECT_EQ("p.Bar", type->GetName());
+    EXPECT_EQ((vector<string>{"p", "Bar"}), type->GetSplitName());
+    EXPECT_FALSE(type->GetBuiltinKind());
+  }
+  EXPECT_EQ(AidlBuiltinKind::STRING, args[3]->GetType().GetBuiltinKind());
+
+  // A name that doesn't resolve is reported at each of its uses.
+  AddExpectedStderr("ERROR: p/IBaz.aidl:1.28-32: Failed to resolve 'Baz'\n");
+  AddExpectedStderr("ERROR: p/IBaz.aidl:1.37-41: Failed to resolve 'Baz'\n");
+  EXPECT_EQ(nullptr, Parse("p/IBaz.aidl", "package p; interface IBaz { Baz f(in Baz a); }",
+                           typenames_, Options::Language::CPP));
+}
+
+TEST_F(AidlTest, LooksUpBuiltinTypesWithoutAllocating) {
+  const vector<string> names = {"int", "String", "java.util.List", "p.IFoo", "void", "Map"};
+  const uint64_t allocated_bytes = ThreadAllocatedBytes();
+  size_t builtins = 0;
+  size_t primitives = 0;
+  for (const string& name : names) {
+    builtins += AidlTypenames::IsBuiltinTypename(name) ? 1 : 0;
+    primitives += AidlTypenames::IsPrimitiveTypename(name) ? 1 : 0;
+  }
+  EXPECT_EQ(allocated_bytes, ThreadAllocatedBytes());
+  EXPECT_EQ(5u, builtins);
+  EXPECT_EQ(2u, primitives);
+  EXPECT_EQ(AidlBuiltinKind::LIST, AidlTypenames::GetBuiltinKind("java.util.List"));
+  EXPECT_EQ(std::nullopt, AidlTypenames::GetBuiltinKind("java.util.ArrayList"));
+  EXPECT_EQ(std::make_pair(string("Map"), true), typenames_.ResolveTypename("java.util.Map"));
+}
+
 TEST_F(AidlTest, UnderstandsNestedParcelables) {
   io_delegate_.SetFileContents(
       "p/Outer.aidl",
@@ -747,6 +3172,60 @@ TEST_F(AidlTest, WritesCorrectDependencyFileNinja) {
   EXPECT_EQ(actual_dep_file_contents, kExpectedNinjaDepFileContents);
 }
 
+TEST_F(AidlTest, WritesOneDependencyFileForMultipleInputs) {
+  Options options = Options::From(
+      "aidl --lang=java --ninja -d dep -I . -o out p/IFoo.aidl p/IBar.aidl");
+  ASSERT_TRUE(options.Ok());
+  io_delegate_.SetFileContents("p/IFoo.aidl",
+                               "package p; import p.IBar; import q.Data;"
+                               "interface IFoo { void foo(IBar bar, in Data data); }");
+  io_delegate_.SetFileContents("p/IBar.aidl",
+                               "package p; import q.Data; interface IBar { void bar(in Data d); }");
+  io_delegate_.SetFileContents("q/Data.aidl", "package q; parcelable Data { int x; }");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(options, io_delegate_));
+  string dep_file;
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("dep", &dep_file));
+  EXPECT_EQ(R"(out/p/IFoo.java \
+out/p/IBar.java : \
+  p/IFoo.aidl \
+  p/IBar.aidl \
+  ./q/Data.aidl
+)",
+            dep_file);
+}
+
+TEST_F(AidlTest, ScansNeededNamesWithoutParsing) {
+  EXPECT_EQ((vector<string>{"p.IBar", "q.Data", "r.Baz"}),
+            internals::scan_needed_names("package p; import p.IBar; import q.Data;\n"
+                                         "// import p.InComment;\n"
+                                         "/* q.InComment */ interface IFoo {\n"
+                                         "  const String S = \"s.InString\";\n"
+                                         "  const float F = 1.5f;\n"
+                                         "  void foo(in List<r.Baz> baz, in q.Data data);\n"
+                                         "  @nullable String bar(in String[] s);\n"
+                                         "}"));
+}
+
+TEST_F(AidlTest, ScansTransitiveDependencies) {
+  Options options = Options::From("aidl --scan-deps -d dep -I . p/IFoo.aidl p/IBar.aidl");
+  ASSERT_TRUE(options.Ok());
+  io_delegate_.SetFileContents("p/IFoo.aidl",
+                               "package p; import p.IBar;"
+                               "interface IFoo { void foo(IBar bar, in android.os.Bundle b); }");
+  io_delegate_.SetFileContents("p/IBar.aidl",
+                               "package p; interface IBar { void bar(in q.Data d); }");
+  io_delegate_.SetFileContents("q/Data.aidl",
+                               "package q; import q.Baz; parcelable Data { Baz baz; }");
+  io_delegate_.SetFileContents("q/Baz.aidl", "package q; parcelable Baz { int x; }");
+  EXPECT_TRUE(scan_deps(options, io_delegate_));
+  string dep_file;
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("dep", &dep_file));
+  EXPECT_EQ(
+      "p/IFoo.aidl : ./p/IBar.aidl ./q/Data.aidl ./q/Baz.aidl\n"
+      "p/IBar.aidl : ./q/Data.aidl ./q/Baz.aidl\n",
+      dep_file);
+}
+
 TEST_F(AidlTest, WritesTrivialDependencyFileForParcelableDeclaration) {
   // The SDK uses aidl to decide whether a .aidl file is a parcelable.  It does
   // this by calling aidl with every .aidl file it finds, then parsing the
@@ -939,6 +3418,305 @@ TEST_F(AidlTest, ApiDumpWithManualIdsOnlyOnSomeMethods) {
   EXPECT_FALSE(dump_api(options, io_delegate_));
 }
 
+TEST_F(AidlTest, HashApiMatchesSha1sumOfTheDump) {
+  // (find ./ -name "*.aidl" -print0 | LC_ALL=C sort -z | xargs -0 sha1sum && echo 3) |
+  //     sha1sum
+  io_delegate_.SetFileContents("api/p/IFoo.aidl", "a\n");
+  io_delegate_.SetFileContents("api/p/q/B.aidl", "b\n");
+  io_delegate_.SetFileContents("api/.hash", "e931a56dcf12d9ed7874b86d834a9d3850dfab64\n");
+  EXPECT_TRUE(hash_api(Options::From("aidl --hashapi=3 api/"), io_delegate_));
+
+  AddExpectedStderr(
+      "ERROR: api/.hash: The API dump has been modified: its hash at version 4 is "
+      "7613237d76c2096b5e1fb745ab0d8b12f85ca9a7, not e931a56dcf12d9ed7874b86d834a9d3850dfab64.\n");
+  EXPECT_FALSE(hash_api(Options::From("aidl --hashapi=4 api"), io_delegate_));
+}
+
+TEST_F(AidlTest, ApiDumpWritesItsHash) {
+  io_delegate_.SetFileContents("foo/bar/IFoo.aidl",
+                               "package foo.bar; interface IFoo { void foo(); }");
+  Options options =
+      Options::From("aidl --dumpapi --hashapi=latest-version -o dump foo/bar/IFoo.aidl");
+  ASSERT_TRUE(dump_api(options, io_delegate_));
+
+  string dump;
+  string hash;
+  ASSERT_TRUE(io_delegate_.GetWrittenContents("dump/foo/bar/IFoo.aidl", &dump));
+  ASSERT_TRUE(io_delegate_.GetWrittenContents("dump/.hash", &hash));
+  io_delegate_.SetFileContents("dump/foo/bar/IFoo.aidl", dump);
+  io_delegate_.SetFileContents("dump/.hash", hash);
+  EXPECT_TRUE(hash_api(Options::From("aidl --hashapi=latest-version dump"), io_delegate_));
+}
+
+TEST_F(AidlTest, ApiDumpRewritesOnlyTheChangedFilesWithAManifest) {
+  io_delegate_.SetFileContents("p/IFoo.aidl", "package p; interface IFoo { void foo(); }");
+  io_delegate_.SetFileContents("p/Bar.aidl", "package p; parcelable Bar { int x; }");
+  const string args = "aidl --dumpapi --hashapi=1 --api-manifest=dump.manifest -o dump ";
+  auto dump = [&](const string& inputs) {
+    if (!dump_api(Options::From(args + inputs), io_delegate_)) {
+      return false;
+    }
+    // Read back by the next dump
+    string manifest;
+    EXPECT_TRUE(io_delegate_.GetWrittenContents("dump.manifest", &manifest));
+    io_delegate_.SetFileContents("dump.manifest", manifest);
+    return true;
+  };
+  ASSERT_TRUE(dump("p/IFoo.aidl p/Bar.aidl"));
+  const std::optional<FileStamp> foo_stamp = io_delegate_.GetFileStamp("dump/p/IFoo.aidl");
+  const std::optional<FileStamp> bar_stamp = io_delegate_.GetFileStamp("dump/p/Bar.aidl");
+  ASSERT_TRUE(foo_stamp && bar_stamp);
+
+  io_delegate_.SetFileContents("p/Bar.aidl", "package p; parcelable Bar { int x; int y; }");
+  ASSERT_TRUE(dump("p/IFoo.aidl p/Bar.aidl"));
+  EXPECT_EQ(foo_stamp, io_delegate_.GetFileStamp("dump/p/IFoo.aidl"));
+  EXPECT_NE(bar_stamp, io_delegate_.GetFileStamp("dump/p/Bar.aidl"));
+  string hash;
+  ASSERT_TRUE(io_delegate_.GetWrittenContents("dump/.hash", &hash));
+
+  // The hash is that of the whole dump all the same
+  FakeIoDelegate full;
+  full.SetFileContents("p/IFoo.aidl", "package p; interface IFoo { void foo(); }");
+  full.SetFileContents("p/Bar.aidl", "package p; parcelable Bar { int x; int y; }");
+  ASSERT_TRUE(dump_api(Options::From("aidl --dumpapi --hashapi=1 -o dump p/IFoo.aidl p/Bar.aidl"),
+                       full));
+  string full_hash;
+  ASSERT_TRUE(full.GetWrittenContents("dump/.hash", &full_hash));
+  EXPECT_EQ(full_hash, hash);
+
+  // The files of removed types are removed
+  EXPECT_FALSE(io_delegate_.PathWasRemoved("dump/p/Bar.aidl"));
+  ASSERT_TRUE(dump("p/IFoo.aidl"));
+  EXPECT_TRUE(io_delegate_.PathWasRemoved("dump/p/Bar.aidl"));
+}
+
+TEST_F(AidlTest, HashApiRehashesOnlyTheChangedFilesWithAManifest) {
+  io_delegate_.SetFileContents("api/p/IFoo.aidl", "a\n");
+  io_delegate_.SetFileContents("api/p/q/B.aidl", "b\n");
+  io_delegate_.SetFileContents("api/.hash", "e931a56dcf12d9ed7874b86d834a9d3850dfab64\n");
+  Options options = Options::From("aidl --hashapi=3 --api-manifest=api.manifest api");
+  ASSERT_TRUE(options.Ok());
+  ASSERT_TRUE(hash_api(options, io_delegate_));
+  string manifest;
+  ASSERT_TRUE(io_delegate_.GetWrittenContents("api.manifest", &manifest));
+
+  // A file whose stamp is the same isn't read, so a wrong hash in the
+  // manifest shows.
+  const string hash_of_b = "89e6c98d92887913cadf06b2adb97f26cde4849b";
+  ASSERT_NE(string::npos, manifest.find(hash_of_b)) << manifest;
+  io_delegate_.SetFileContents(
+      "api.manifest", android::base::StringReplace(manifest, hash_of_b, string(40, '0'), false));
+  AddExpectedStderr(
+      "ERROR: api/.hash: The API dump has been modified: its hash at version 3 is "
+      "6e29ffb61d4927671d48debea177746f53ed021c, not e931a56dcf12d9ed7874b86d834a9d3850dfab64.\n");
+  EXPECT_FALSE(hash_api(options, io_delegate_));
+
+  // Once it is written, it's hashed again.
+  io_delegate_.SetFileContents("api/p/q/B.aidl", "b\n");
+  EXPECT_TRUE(hash_api(options, io_delegate_));
+}
+
+TEST_F(AidlTest, ProfileRecordsPhasesOfACompilation) {
+  io_delegate_.SetFileContents("p/IFoo.aidl", "package p; interface IFoo { void foo(); }");
+  Options options = Options::From("aidl --lang=java -o out p/IFoo.aidl");
+
+  string trace;
+  {
+    Profile profile;
+    ASSERT_EQ(0, ::android::aidl::compile_aidl(options, io_delegate_));
+    auto writer = CodeWriter::ForString(&trace);
+    profile.WriteTrace(writer.get());
+    writer->Close();
+  }
+  EXPECT_EQ(nullptr, Profile::Current());
+  EXPECT_EQ(0u, trace.find("{\"traceEvents\":["));
+  EXPECT_NE(string::npos, trace.find("{\"name\":\"parse\",\"ph\":\"X\""));
+  EXPECT_NE(string::npos, trace.find("\"file\":\"p/IFoo.aidl\""));
+  EXPECT_NE(string::npos, trace.find("{\"name\":\"load and validate\""));
+  EXPECT_NE(string::npos, trace.find("{\"name\":\"generate\""));
+  EXPECT_NE(string::npos, trace.find("\"file\":\"p.IFoo\""));
+}
+
+TEST_F(AidlTest, StatsCountTheNodesAndTheSizesOfACompilation) {
+  io_delegate_.SetFileContents("p/IFoo.aidl",
+                               "package p; interface IFoo { const int A = 1 + 2;"
+                               " void foo(in List<String> a, @nullable String b); }");
+  Options options = Options::From("aidl --lang=cpp,java --out=cpp:out/cpp --out=java:out/java "
+                                  "--header_out=cpp:out/cpp p/IFoo.aidl");
+
+  string json;
+  {
+    Stats stats;
+    EXPECT_EQ(&stats, Stats::Current());
+    ASSERT_EQ(0, ::android::aidl::compile_aidl(options, io_delegate_));
+    auto writer = CodeWriter::ForString(&json);
+    stats.WriteJson(writer.get());
+    writer->Close();
+  }
+  EXPECT_EQ(nullptr, Stats::Current());
+  EXPECT_NE(string::npos, json.find("\"AidlInterface\":{\"count\":1,")) << json;
+  EXPECT_NE(string::npos, json.find("\"AidlMethod\":{\"count\":1,")) << json;
+  EXPECT_NE(string::npos, json.find("\"AidlArgument\":{\"count\":2,")) << json;
+  // The return type, the constant, the two arguments and the String of the List
+  EXPECT_NE(string::npos, json.find("\"AidlTypeSpecifier\":{\"count\":5,")) << json;
+  EXPECT_NE(string::npos, json.find("\"AidlBinaryConstExpression\":{\"count\":1,")) << json;
+  EXPECT_NE(string::npos, json.find("\"AidlConstantValue\":{\"count\":2,")) << json;
+  EXPECT_NE(string::npos, json.find("\"AidlAnnotation\":{\"count\":1,")) << json;
+  const size_t source_size = io_delegate_.GetFileContents("p/IFoo.aidl")->size();
+  EXPECT_NE(string::npos, json.find("\"p/IFoo.aidl\":" + std::to_string(source_size))) << json;
+
+  // The outputs of each backend add up
+  string header;
+  string source;
+  string bp_header;
+  string bn_header;
+  string java;
+  ASSERT_TRUE(io_delegate_.GetWrittenContents("out/cpp/p/IFoo.h", &header));
+  ASSERT_TRUE(io_delegate_.GetWrittenContents("out/cpp/p/IFoo.cpp", &source));
+  ASSERT_TRUE(io_delegate_.GetWrittenContents("out/cpp/p/BpFoo.h", &bp_header));
+  ASSERT_TRUE(io_delegate_.GetWrittenContents("out/cpp/p/BnFoo.h", &bn_header));
+  ASSERT_TRUE(io_delegate_.GetWrittenContents("out/java/p/IFoo.java", &java));
+  EXPECT_NE(string::npos,
+            json.find("\"cpp\":" + std::to_string(header.size() + source.size() +
+                                                    bp_header.size() + bn_header.size())))
+      << json;
+  EXPECT_NE(string::npos, json.find("\"java\":" + std::to_string(java.size()))) << json;
+  EXPECT_NE(string::npos, json.find("{\"name\":\"load and validate\",\"peak_rss_bytes\":"))
+      << json;
+  EXPECT_NE(string::npos, json.find("{\"name\":\"generate\",\"peak_rss_bytes\":")) << json;
+}
+
+TEST_F(AidlTest, SizeReportCountsTheCodeOfEachMethodAndSection) {
+  io_delegate_.SetFileContents("p/IFoo.aidl",
+                               "package p; interface IFoo { int f(int x); oneway void g(); }");
+  io_delegate_.SetFileContents("p/P.aidl", "package p; parcelable P { int a; String b; }");
+  Options cpp = Options::From("aidl --lang=cpp --log -o out/cpp -h out/cpp p/IFoo.aidl p/P.aidl");
+  Options java = Options::From("aidl --lang=java -o out/java p/IFoo.aidl p/P.aidl");
+
+  string json;
+  {
+    SizeReport report;
+    EXPECT_EQ(&report, SizeReport::Current());
+    ASSERT_EQ(0, ::android::aidl::compile_aidl(cpp, io_delegate_));
+    ASSERT_EQ(0, ::android::aidl::compile_aidl(java, io_delegate_));
+    auto writer = CodeWriter::ForString(&json);
+    report.WriteJson(writer.get());
+    writer->Close();
+  }
+  EXPECT_EQ(nullptr, SizeReport::Current());
+  EXPECT_EQ(0u, json.find("{\"sizes\":[\n")) << json;
+  for (const char* section : {"proxy", "stub", "default_impl", "log"}) {
+    EXPECT_NE(string::npos, json.find("{\"backend\":\"cpp\",\"type\":\"p.IFoo\",\"method\":\"f\","
+                                      "\"section\":\"" + string(section) + "\",\"lines\":"))
+        << json;
+  }
+  for (const char* section : {"parcel_read", "parcel_write"}) {
+    EXPECT_NE(string::npos, json.find("{\"backend\":\"java\",\"type\":\"p.P\",\"section\":\"" +
+                                      string(section) + "\",\"lines\":"))
+        << json;
+  }
+  // Java doesn't log, and its sections are measured as they are written.
+  EXPECT_EQ(string::npos, json.find("{\"backend\":\"java\",\"type\":\"p.IFoo\",\"method\":\"f\","
+                                    "\"section\":\"log\""));
+  string source;
+  ASSERT_TRUE(io_delegate_.GetWrittenContents("out/java/p/IFoo.java", &source));
+  const size_t begin = source.find("        case TRANSACTION_f:\n");
+  const size_t end = source.find("        case TRANSACTION_g:\n");
+  ASSERT_NE(string::npos, begin);
+  ASSERT_NE(string::npos, end);
+  const string stub = source.substr(begin, end - begin);
+  EXPECT_NE(string::npos,
+            json.find(StringPrintf("{\"backend\":\"java\",\"type\":\"p.IFoo\",\"method\":\"f\","
+                                   "\"section\":\"stub\",\"lines\":%zu,\"bytes\":%zu}",
+                                   static_cast<size_t>(std::count(stub.begin(), stub.end(), '\n')),
+                                   stub.size())))
+      << json << stub;
+
+  EXPECT_FALSE(Options::From("aidl --lang=java --size-report=sizes.json --cache-dir=cache "
+                             "-o out p/IFoo.aidl")
+                   .Ok());
+}
+
+TEST_F(AidlTest, CacheDirRestoresTheOutputsOfAnUnchangedCompilation) {
+  const string args =
+      "aidl --lang=cpp -I . -d out/IFoo.d --cache-dir=cache -o out/cpp -h out/cpp p/IFoo.aidl";
+  Options options = Options::From(args);
+  ASSERT_TRUE(options.Ok());
+  auto set_inputs = [](FakeIoDelegate* io, const string& bar) {
+    io->SetFileContents("p/IFoo.aidl", "package p; import p.Bar; interface IFoo { Bar get(); }");
+    io->SetFileContents("p/Bar.aidl", bar);
+  };
+  // The cache that a compilation left behind, the files of which the next one
+  // reads back
+  auto cache_of = [](FakeIoDelegate* io) {
+    std::map<string, string> cache;
+    for (const string& path : io->ListOutputFiles()) {
+      if (android::base::StartsWith(path, "cache/")) {
+        io->GetWrittenContents(path, &cache[path]);
+      }
+    }
+    return cache;
+  };
+  set_inputs(&io_delegate_, "package p; parcelable Bar { int x; }");
+  ASSERT_EQ(0, ::android::aidl::compile_aidl(options, io_delegate_));
+  const std::map<string, string> cache = cache_of(&io_delegate_);
+  ASSERT_FALSE(cache.empty());
+  string header;
+  string deps;
+  ASSERT_TRUE(io_delegate_.GetWrittenContents("out/cpp/p/IFoo.h", &header));
+  ASSERT_TRUE(io_delegate_.GetWrittenContents("out/IFoo.d", &deps));
+
+  // The arguments that don't change the outputs don't change the key
+  EXPECT_EQ(internals::cache_key(options, io_delegate_),
+            internals::cache_key(Options::From(args + " -j 4"), io_delegate_));
+  EXPECT_NE(internals::cache_key(options, io_delegate_),
+            internals::cache_key(Options::From(args + " --structured"), io_delegate_));
+
+  // A hit restores the outputs and stores nothing
+  FakeIoDelegate hit;
+  set_inputs(&hit, "package p; parcelable Bar { int x; }");
+  for (const auto& [path, contents] : cache) {
+    hit.SetFileContents(path, contents);
+  }
+  ASSERT_EQ(0, ::android::aidl::compile_aidl(options, hit));
+  EXPECT_TRUE(cache_of(&hit).empty());
+  string restored;
+  EXPECT_TRUE(hit.GetWrittenContents("out/cpp/p/IFoo.h", &restored));
+  EXPECT_EQ(header, restored);
+  EXPECT_TRUE(hit.GetWrittenContents("out/IFoo.d", &restored));
+  EXPECT_EQ(deps, restored);
+
+  // A changed import misses, even though the key is the same
+  FakeIoDelegate miss;
+  set_inputs(&miss, "package p; parcelable Bar { long x; }");
+  for (const auto& [path, contents] : cache) {
+    miss.SetFileContents(path, contents);
+  }
+  EXPECT_EQ(internals::cache_key(options, io_delegate_), internals::cache_key(options, miss));
+  ASSERT_EQ(0, ::android::aidl::compile_aidl(options, miss));
+  EXPECT_FALSE(cache_of(&miss).empty());
+  EXPECT_TRUE(miss.GetWrittenContents("out/cpp/p/IFoo.h", &restored));
+
+  // --profile and --stats report on the compilation, so they bypass the cache.
+  for (const char* report : {" --profile=trace.json", " --stats=stats.json"}) {
+    FakeIoDelegate reported;
+    set_inputs(&reported, "package p; parcelable Bar { int x; }");
+    for (const auto& [path, contents] : cache) {
+      reported.SetFileContents(path, contents);
+    }
+    string trace;
+    {
+      android::aidl::Profile profile;
+      ASSERT_EQ(0, ::android::aidl::compile_aidl(Options::From(args + report), reported));
+      profile.WriteTrace(CodeWriter::ForString(&trace).get());
+    }
+    EXPECT_EQ(string::npos, trace.find("cache lookup")) << report;
+    EXPECT_NE(string::npos, trace.find("\"generate\"")) << report;
+    EXPECT_TRUE(reported.GetWrittenContents("out/cpp/p/IFoo.h", &restored)) << report;
+    EXPECT_EQ(header, restored);
+  }
+}
+
 TEST_F(AidlTest, CheckNumGenericTypeSecifier) {
   Options options = Options::From("aidl p/IFoo.aidl IFoo.java");
   io_delegate_.SetFileContents(options.InputFiles().front(),
@@ -1110,6 +3888,133 @@ TEST_F(AidlTest, MultipleInputFilesCpp) {
   }
 }
 
+TEST_F(AidlTest, MultipleInputFilesShareImports) {
+  Options options = Options::From(
+      "aidl --lang=java -o out -a -I . foo/bar/IFoo.aidl foo/bar/IBar.aidl");
+
+  io_delegate_.SetFileContents("foo/bar/Data.aidl",
+                               "package foo.bar;\n"
+                               "parcelable Data { int x; }\n");
+  io_delegate_.SetFileContents(options.InputFiles().at(0),
+                               "package foo.bar;\n"
+                               "import foo.bar.Data;\n"
+                               "interface IFoo { Data getData(); }\n");
+  io_delegate_.SetFileContents(options.InputFiles().at(1),
+                               "package foo.bar;\n"
+                               "import foo.bar.Data;\n"
+                               "import foo.bar.IFoo;\n"
+                               "interface IBar { IFoo getFoo(in Data data); }\n");
+
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(options, io_delegate_));
+
+  // Types parsed for the first input are still recorded as imports of the second one.
+  string dep_file;
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/foo/bar/IBar.java.d", &dep_file));
+  EXPECT_NE(string::npos, dep_file.find("./foo/bar/Data.aidl"));
+  EXPECT_NE(string::npos, dep_file.find("./foo/bar/IFoo.aidl"));
+}
+
+TEST_F(AidlTest, MultipleInputFilesInParallel) {
+  Options options = Options::From(
+      "aidl --lang=cpp -j 3 -o out -h out/include -I . foo/bar/IFoo.aidl foo/bar/Data.aidl "
+      "foo/bar/IBar.aidl");
+
+  io_delegate_.SetFileContents(options.InputFiles().at(0),
+                               "package foo.bar;\n"
+                               "import foo.bar.Data;\n"
+                               "interface IFoo { Data getData(); }\n");
+  io_delegate_.SetFileContents(options.InputFiles().at(1),
+                               "package foo.bar;\n"
+                               "import foo.bar.IFoo;\n"
+                               "parcelable Data { IFoo foo; }\n");
+  io_delegate_.SetFileContents(options.InputFiles().at(2),
+                               "package foo.bar;\n"
+                               "interface IBar { void ping(); }\n");
+
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(options, io_delegate_));
+
+  string content;
+  for (const auto file : {"out/foo/bar/IFoo.cpp", "out/foo/bar/Data.cpp", "out/foo/bar/IBar.cpp",
+                          "out/include/foo/bar/IFoo.h", "out/include/foo/bar/Data.h",
+                          "out/include/foo/bar/IBar.h"}) {
+    content.clear();
+    EXPECT_TRUE(io_delegate_.GetWrittenContents(file, &content));
+    EXPECT_FALSE(content.empty());
+  }
+}
+
+TEST_F(AidlTest, ValidatesMultipleInputFilesInParallel) {
+  Options options = Options::From(
+      "aidl --lang=cpp -j 3 -o out -h out/include -I . p/IFoo.aidl p/IBar.aidl p/IBaz.aidl");
+  io_delegate_.SetFileContents("p/IFoo.aidl", "package p; interface IFoo { void f(); }");
+  io_delegate_.SetFileContents("p/IBar.aidl",
+                               "package p; interface IBar { void f() = 1; void g() = 1; }");
+  io_delegate_.SetFileContents("p/IBaz.aidl",
+                               "package p; interface IBaz { void f() = 2; void g() = 2; }");
+
+  // Only the errors of the first input that fails are printed, as without -j
+  AddExpectedStderr(
+      "ERROR: p/IBar.aidl:1.47-49: Found duplicate method id (1) for method g\n");
+  EXPECT_NE(0, ::android::aidl::compile_aidl(options, io_delegate_));
+  string content;
+  EXPECT_FALSE(io_delegate_.GetWrittenContents("out/p/IFoo.cpp", &content));
+}
+
+TEST_F(AidlTest, BuffersTheLogMessagesOfParallelTasks) {
+  vector<std::ostringstream> diagnostics;
+  std::unique_ptr<std::atomic_bool[]> succeeded;
+  internals::run_tasks(
+      2, 2,
+      [](size_t i) {
+        ::AidlError::Logger(android::base::MAIN, android::base::ERROR, "aidl", "f.cpp", 1,
+                            i == 0 ? "first" : "second");
+        ::AidlError::ThreadOutput() << "task " << i << "\n";
+        return true;
+      },
+      &diagnostics, &succeeded);
+  EXPECT_EQ("aidl E f.cpp:1] first\ntask 0\n", diagnostics[0].str());
+  EXPECT_EQ("aidl E f.cpp:1] second\ntask 1\n", diagnostics[1].str());
+}
+
+TEST_F(AidlTest, ParsedFileCacheReusesParsers) {
+  ParsedFileCache cache(typenames_);
+  io_delegate_.SetFileContents("p/Data.aidl", "package p; parcelable Data { int x; }");
+
+  Parser* parser = cache.Parse("p/Data.aidl", io_delegate_);
+  ASSERT_NE(nullptr, parser);
+  EXPECT_EQ(1u, parser->GetDefinedTypes().size());
+  EXPECT_EQ(parser, cache.Parse("./p/Data.aidl", io_delegate_));
+  EXPECT_EQ(1u, cache.Hits());
+
+  // A file that failed to parse isn't parsed again either.
+  io_delegate_.SetFileContents("p/Bad.aidl", "package p; parcelable Bad {");
+  EXPECT_EQ(nullptr, cache.Parse("p/Bad.aidl", io_delegate_));
+  EXPECT_EQ(nullptr, cache.Parse("p/Bad.aidl", io_delegate_));
+  EXPECT_EQ(2u, cache.Hits());
+}
+
+TEST_F(AidlTest, ParsedNodesLiveInTheArenaOfTypenames) {
+  EXPECT_EQ(0u, typenames_.Arena()->BytesAllocated());
+  io_delegate_.SetFileContents("p/IFoo.aidl", "package p; interface IFoo { void f(int a); }");
+  auto parser = Parser::Parse("p/IFoo.aidl", io_delegate_, typenames_);
+  ASSERT_NE(nullptr, parser);
+  EXPECT_LT(0u, typenames_.Arena()->BytesAllocated());
+
+  // Nodes created outside of parsing come from the heap.
+  const size_t allocated = typenames_.Arena()->BytesAllocated();
+  unique_ptr<AidlTypeSpecifier> type(
+      new AidlTypeSpecifier(AIDL_LOCATION_HERE, "int", false, nullptr, ""));
+  EXPECT_EQ(allocated, typenames_.Arena()->BytesAllocated());
+}
+
+TEST_F(AidlTest, NormalizePath) {
+  using ::android::aidl::internals::NormalizePath;
+  EXPECT_EQ("foo/bar/IFoo.aidl", NormalizePath("./foo/bar/IFoo.aidl"));
+  EXPECT_EQ("foo/bar/IFoo.aidl", NormalizePath("foo//baz/../bar/./IFoo.aidl"));
+  EXPECT_EQ("/foo/IFoo.aidl", NormalizePath("/foo/IFoo.aidl"));
+  EXPECT_EQ("../foo/IFoo.aidl", NormalizePath("../foo/IFoo.aidl"));
+}
+
 TEST_F(AidlTest, ConflictWithMetaTransactions) {
   Options options = Options::From("aidl --lang=java -o place/for/output p/IFoo.aidl");
   // int getInterfaceVersion() is one of the meta transactions
@@ -1156,6 +4061,66 @@ TEST_F(AidlTest, SuccessOnIdenticalApiDumps) {
   EXPECT_TRUE(::android::aidl::check_api(options, io_delegate_));
 }
 
+TEST_F(AidlTest, FailsOnIdenticalApiDumpsThatAreInvalid) {
+  Options options = Options::From("aidl --checkapi old new");
+  io_delegate_.SetFileContents("old/p/IFoo.aidl", "package p; interface IFoo{ void foo(;}");
+  io_delegate_.SetFileContents("new/p/IFoo.aidl", "package p; interface IFoo{ void foo(;}");
+  AddExpectedStderr(
+      "ERROR: old/p/IFoo.aidl:1.37-38: syntax error, unexpected ';', expecting annotation or "
+      "identifier or cpp_header\n"
+      "ERROR: old/p/IFoo.aidl: Failed to read.\n");
+  EXPECT_FALSE(::android::aidl::check_api(options, io_delegate_));
+}
+
+TEST_F(AidlTest, SkipsUnchangedTypesInCheckAPI) {
+  Options options = Options::From("aidl --checkapi old new");
+  io_delegate_.SetFileContents("old/p/IFoo.aidl", "package p; interface IFoo{ void foo();}");
+  io_delegate_.SetFileContents("old/p/E.aidl", "package p; enum E { A, B }");
+  io_delegate_.SetFileContents("new/p/IFoo.aidl", "package p; interface IFoo{ void foo();}");
+  io_delegate_.SetFileContents("new/p/E.aidl", "package p; enum E { A, B, C }");
+  EXPECT_TRUE(::android::aidl::check_api(options, io_delegate_));
+
+  // An unchanged type doesn't hide a change in another one.
+  io_delegate_.SetFileContents("new/p/E.aidl", "package p; enum E { B, A }");
+  EXPECT_FALSE(::android::aidl::check_api(options, io_delegate_));
+}
+
+TEST_F(AidlTest, LoadsApiDumpsInParallelWithJobs) {
+  Options options = Options::From("aidl --checkapi -j 2 old new");
+  ASSERT_TRUE(options.Ok());
+  io_delegate_.SetFileContents("old/p/IFoo.aidl", "package p; interface IFoo{ void foo();}");
+  io_delegate_.SetFileContents("new/p/IFoo.aidl", "package p; interface IFoo{ void foo();}");
+  io_delegate_.SetFileContents("new/p/IBar.aidl", "package p; interface IBar{ void bar();}");
+  EXPECT_TRUE(::android::aidl::check_api(options, io_delegate_));
+
+  io_delegate_.SetFileContents("new/p/IFoo.aidl", "package p; interface IFoo{ void foo(int a);}");
+  AddExpectedStderr("ERROR: old/p/IFoo.aidl:1.32-36: Removed or changed method: p.IFoo.foo()\n");
+  EXPECT_FALSE(::android::aidl::check_api(options, io_delegate_));
+}
+
+TEST_F(AidlTest, ChecksEachApiDumpAgainstTheOneBeforeIt) {
+  Options options = Options::From("aidl --checkapi -j 2 1 2 3 current");
+  ASSERT_TRUE(options.Ok());
+  io_delegate_.SetFileContents("1/p/IFoo.aidl", "package p; interface IFoo{ void foo();}");
+  io_delegate_.SetFileContents("2/p/IFoo.aidl", "package p; interface IFoo{ void foo();}");
+  io_delegate_.SetFileContents("3/p/IFoo.aidl",
+                               "package p; interface IFoo{ void foo(); void bar();}");
+  io_delegate_.SetFileContents("current/p/IFoo.aidl",
+                               "package p; interface IFoo{ void foo(); void bar(); void baz();}");
+  EXPECT_TRUE(::android::aidl::check_api(options, io_delegate_));
+
+  // Every incompatible pair is reported, not only the first one.
+  io_delegate_.SetFileContents("2/p/IFoo.aidl", "package p; interface IFoo{ void foo(int a);}");
+  io_delegate_.SetFileContents("current/p/IFoo.aidl", "package p; interface IFoo{ void foo();}");
+  AddExpectedStderr("ERROR: 1/p/IFoo.aidl:1.32-36: Removed or changed method: p.IFoo.foo()\n");
+  AddExpectedStderr("ERROR: 2: Not backwards compatible with 1\n");
+  AddExpectedStderr("ERROR: 2/p/IFoo.aidl:1.32-36: Removed or changed method: p.IFoo.foo(int)\n");
+  AddExpectedStderr("ERROR: 3: Not backwards compatible with 2\n");
+  AddExpectedStderr("ERROR: 3/p/IFoo.aidl:1.44-48: Removed or changed method: p.IFoo.bar()\n");
+  AddExpectedStderr("ERROR: current: Not backwards compatible with 3\n");
+  EXPECT_FALSE(::android::aidl::check_api(options, io_delegate_));
+}
+
 class AidlTestCompatibleChanges : public AidlTest {
  protected:
   Options options_ = Options::From("aidl --checkapi old new");
@@ -1639,6 +4604,34 @@ TEST_F(AidlTest, FailOnAmbiguousImports) {
   EXPECT_NE(0, ::android::aidl::compile_aidl(options, io_delegate_));
 }
 
+TEST_F(AidlTest, ResolvesImportsFromNestedImportRoots) {
+  Options options = Options::From("aidl --lang=java -I ./dir -I dir/sub IFoo.aidl");
+  io_delegate_.SetFileContents("dir/sub/p/IBar.aidl", "package p; interface IBar{}");
+  io_delegate_.SetFileContents("dir/q/IBaz.aidl", "package q; interface IBaz{}");
+  io_delegate_.SetFileContents("IFoo.aidl", "import p.IBar; import q.IBaz; interface IFoo{}");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(options, io_delegate_));
+}
+
+TEST_F(AidlTest, ListsEachImportDirectoryOncePerInvocation) {
+  // Counts the listings of each directory
+  class CountingIoDelegate : public FakeIoDelegate {
+   public:
+    vector<string> ListDirectory(const string& dir) const override {
+      listings[dir]++;
+      return FakeIoDelegate::ListDirectory(dir);
+    }
+    mutable std::map<string, int> listings;
+  };
+  CountingIoDelegate io_delegate;
+  io_delegate.SetFileContents("dir/p/IBar.aidl", "package p; interface IBar{}");
+  io_delegate.SetFileContents("dir/p/IBaz.aidl", "package p; interface IBaz{}");
+  io_delegate.SetFileContents("a/IFoo.aidl", "package a; import p.IBar; interface IFoo{}");
+  io_delegate.SetFileContents("a/IQux.aidl", "package a; import p.IBaz; interface IQux{}");
+  Options options = Options::From("aidl --lang=java -I dir -o out a/IFoo.aidl a/IQux.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(options, io_delegate));
+  EXPECT_EQ(1, io_delegate.listings["dir/p"]);
+}
+
 class AidlOutputPathTest : public AidlTest {
  protected:
   void SetUp() override {
@@ -1735,5 +4728,76 @@ TEST_F(AidlTest, FailOnOutOfBoundsAutofilledEnum) {
   EXPECT_EQ(AidlError::BAD_TYPE, reported_error);
 }
 
+TEST_F(AidlTest, CopiesEnumArraysInOneGo) {
+  io_delegate_.SetFileContents("p/Kind.aidl",
+                               "package p; @Backing(type=\"int\") enum Kind { A, B, }");
+  io_delegate_.SetFileContents("p/IFoo.aidl",
+                               "package p; import p.Kind; interface IFoo {"
+                               " Kind[] f(in Kind[] in_kinds, out Kind[] kinds,"
+                               " in @nullable Kind[] maybe); }");
+  io_delegate_.SetFileContents("p/Foo.aidl",
+                               "package p; import p.Kind; parcelable Foo { Kind[] kinds; }");
+
+  Options cpp = Options::From("aidl --lang=cpp -I . -o out -h out p/IFoo.aidl p/Foo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(cpp, io_delegate_));
+  string output;
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.h", &output));
+  EXPECT_NE(string::npos, output.find("#include <aidl/enum_vector_parcel.h>\n"));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.cpp", &output));
+  // Rather than Parcel::writeEnumVector() and readEnumVector()
+  EXPECT_EQ(string::npos, output.find(".writeEnumVector("));
+  EXPECT_EQ(string::npos, output.find(".readEnumVector("));
+  EXPECT_NE(string::npos, output.find("::android::aidl::WriteEnumVector(&_aidl_data, in_kinds)"));
+  EXPECT_NE(string::npos, output.find("::android::aidl::WriteEnumVector(&_aidl_data, maybe)"));
+  EXPECT_NE(string::npos,
+            output.find("::android::aidl::ReadEnumVector(&_aidl_reply, _aidl_return)"));
+  EXPECT_NE(string::npos, output.find("::android::aidl::ReadEnumVector(&_aidl_reply, kinds)"));
+  EXPECT_NE(string::npos,
+            output.find("::android::aidl::ReadEnumVector(&_aidl_data, &in_in_kinds)"));
+  EXPECT_NE(string::npos,
+            output.find("::android::aidl::WriteEnumVector(_aidl_reply, _aidl_return)"));
+  EXPECT_NE(string::npos, output.find("::android::aidl::WriteEnumVector(_aidl_reply, out_kinds)"));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/Foo.cpp", &output));
+  EXPECT_NE(string::npos, output.find("::android::aidl::ReadEnumVector(_aidl_parcel, &kinds)"));
+  EXPECT_NE(string::npos, output.find("::android::aidl::WriteEnumVector(_aidl_parcel, kinds)"));
+
+  // The NDK and Java backends already read and write the arrays of the backing type
+  Options ndk = Options::From("aidl --lang=ndk -I . -o out -h out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(ndk, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.cpp", &output));
+  EXPECT_NE(string::npos, output.find("AParcel_writeInt32Array(_aidl_in.get(), "
+                                      "reinterpret_cast<const int32_t*>(in_in_kinds.data())"));
+  Options java = Options::From("aidl --lang=java -I . -o out p/IFoo.aidl");
+  EXPECT_EQ(0, ::android::aidl::compile_aidl(java, io_delegate_));
+  EXPECT_TRUE(io_delegate_.GetWrittenContents("out/p/IFoo.java", &output));
+  EXPECT_NE(string::npos, output.find("_data.writeIntArray(in_kinds);"));
+  EXPECT_NE(string::npos, output.find("_result = _reply.createIntArray();"));
+}
+
+TEST_F(AidlTest, ResolvesBuiltinKindOfTypes) {
+  EXPECT_EQ(AidlBuiltinKind::LIST, AidlTypenames::GetBuiltinKind("java.util.List"));
+  EXPECT_EQ(AidlBuiltinKind::PARCEL_FILE_DESCRIPTOR,
+            AidlTypenames::GetBuiltinKind("android.os.ParcelFileDescriptor"));
+  EXPECT_EQ(AidlBuiltinKind::INT, AidlTypenames::GetBuiltinKind("int"));
+  EXPECT_FALSE(AidlTypenames::GetBuiltinKind("p.Kind"));
+
+  import_paths_.emplace("");
+  io_delegate_.SetFileContents("p/Kind.aidl",
+                               "package p;\n"
+                               "@Backing(type=\"long\")\n"
+                               "enum Kind { A, B, }\n");
+  const AidlDefinedType* parse_result =
+      Parse("p/IFoo.aidl",
+            "package p; import p.Kind; interface IFoo { String[] f(in Kind k, in List<String> l); }",
+            typenames_, Options::Language::JAVA);
+  ASSERT_NE(nullptr, parse_result);
+  const AidlMethod& method = *parse_result->AsInterface()->GetMethods()[0];
+  EXPECT_EQ(AidlBuiltinKind::STRING, method.GetType().GetBuiltinKind());
+  EXPECT_FALSE(method.GetArguments()[0]->GetType().GetBuiltinKind());
+  EXPECT_EQ(AidlBuiltinKind::LONG,
+            typenames_.GetBackingBuiltinKind(method.GetArguments()[0]->GetType()));
+  EXPECT_EQ(AidlBuiltinKind::LIST, method.GetArguments()[1]->GetType().GetBuiltinKind());
+}
+
 }  // namespace aidl
 }  // namespace android
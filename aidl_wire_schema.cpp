@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "aidl_wire_schema.h"
+
+#include <stdint.h>
+
+#include <aidl/wire_schema.h>
+
+namespace android {
+namespace aidl {
+
+namespace ws = ::android::aidl::wire_schema;
+
+namespace {
+
+// FIRST_CALL_TRANSACTION, which the backends add to the ids of the methods
+constexpr uint64_t kFirstCallTransaction = 1;
+
+class Writer {
+ public:
+  explicit Writer(const AidlTypenames& typenames) : typenames_(typenames) {}
+
+  void Byte(uint8_t byte) { out_.push_back(static_cast<char>(byte)); }
+
+  void Varint(uint64_t value) {
+    while (value >= 0x80) {
+      Byte(static_cast<uint8_t>(value | 0x80));
+      value >>= 7;
+    }
+    Byte(static_cast<uint8_t>(value));
+  }
+
+  void String(const std::string& str) {
+    Varint(str.size());
+    out_ += str;
+  }
+
+  void Type(const AidlTypeSpecifier& type) {
+    uint8_t tag = 0;
+    const AidlDefinedType* defined = nullptr;
+    const AidlTypeSpecifier* backing_type = nullptr;
+    if (auto kind = type.GetBuiltinKind(); kind) {
+      tag = static_cast<uint8_t>(*kind);
+    } else {
+      defined = typenames_.TryGetDefinedType(type.GetName());
+      AIDL_FATAL_IF(defined == nullptr, type) << "Unresolved type " << type.GetName();
+      if (defined->AsInterface() != nullptr) {
+        tag = ws::kInterface;
+      } else if (auto enum_decl = defined->AsEnumDeclaration(); enum_decl != nullptr) {
+        tag = ws::kEnum;
+        backing_type = &enum_decl->GetBackingType();
+      } else if (defined->AsStructuredParcelable() != nullptr) {
+        tag = ws::kParcelable;
+      } else {
+        tag = ws::kUnstructuredParcelable;
+      }
+    }
+    if (type.IsArray()) tag |= ws::kArray;
+    if (type.IsNullable()) tag |= ws::kNullable;
+    const bool has_parameters = backing_type != nullptr || type.IsGeneric();
+    if (has_parameters) tag |= ws::kHasParameters;
+    Byte(tag);
+    if (defined != nullptr) String(defined->GetCanonicalName());
+    if (backing_type != nullptr) {
+      Byte(1);
+      Type(*backing_type);
+    } else if (has_parameters) {
+      const auto& parameters = type.GetTypeParameters();
+      Byte(static_cast<uint8_t>(parameters.size()));
+      for (const auto& parameter : parameters) {
+        Type(*parameter);
+      }
+    }
+  }
+
+  const std::string& Out() const { return out_; }
+
+ private:
+  const AidlTypenames& typenames_;
+  std::string out_;
+};
+
+}  // namespace
+
+std::string WireSchemaOf(const AidlDefinedType& type, const AidlTypenames& typenames) {
+  Writer writer(typenames);
+  for (char c : ws::kMagic) {
+    writer.Byte(static_cast<uint8_t>(c));
+  }
+  writer.Byte(ws::kVersion);
+  if (const AidlInterface* interface = type.AsInterface(); interface != nullptr) {
+    writer.Byte(static_cast<uint8_t>(ws::Kind::INTERFACE));
+    writer.String(type.GetCanonicalName());
+    // The methods of the meta-transactions are left to the backends
+    uint64_t count = 0;
+    for (const auto& method : interface->GetMethods()) {
+      if (method->IsUserDefined()) count++;
+    }
+    writer.Varint(count);
+    for (const auto& method : interface->GetMethods()) {
+      if (!method->IsUserDefined()) continue;
+      writer.Varint(kFirstCallTransaction + method->GetId());
+      writer.Byte(method->IsOneway() ? ws::kOneway : 0);
+      writer.String(method->GetName());
+      writer.Type(method->GetType());
+      writer.Varint(method->GetArguments().size());
+      for (const auto& arg : method->GetArguments()) {
+        writer.Byte(static_cast<uint8_t>(arg->GetDirection()));
+        writer.String(arg->GetName());
+        writer.Type(arg->GetType());
+      }
+    }
+  } else {
+    const AidlStructuredParcelable* parcel = type.AsStructuredParcelable();
+    AIDL_FATAL_IF(parcel == nullptr, type) << "No wire schema for " << type.GetCanonicalName();
+    writer.Byte(static_cast<uint8_t>(ws::Kind::PARCELABLE));
+    writer.String(type.GetCanonicalName());
+    writer.Varint(parcel->GetFields().size());
+    for (const auto& field : parcel->GetFields()) {
+      writer.String(field->GetName());
+      writer.Type(field->GetType());
+    }
+  }
+  return writer.Out();
+}
+
+std::string WireSchemaLiteral(const std::string& schema, const std::string& separator) {
+  std::string literal = "\"";
+  for (size_t i = 0; i < schema.size(); i++) {
+    if (i > 0 && i % 64 == 0) literal += "\"" + separator + "\"";
+    const unsigned char c = static_cast<unsigned char>(schema[i]);
+    if (c >= 0x20 && c < 0x7f && c != '"' && c != '\\' && c != '?') {
+      literal += static_cast<char>(c);
+    } else {
+      literal += {'\\', static_cast<char>('0' + (c >> 6)),
+                  static_cast<char>('0' + ((c >> 3) & 7)), static_cast<char>('0' + (c & 7))};
+    }
+  }
+  return literal + "\"";
+}
+
+}  // namespace aidl
+}  // namespace android
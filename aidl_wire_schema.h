@@ -0,0 +1,39 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "aidl_language.h"
+#include "aidl_typenames.h"
+
+namespace android {
+namespace aidl {
+
+// The wire schema of |type|, an interface or a structured parcelable, in the
+// format of aidl/wire_schema.h, for --gen-wire-schema. The types of |type|
+// must be resolved against |typenames|.
+std::string WireSchemaOf(const AidlDefinedType& type, const AidlTypenames& typenames);
+
+// |schema| as string literals of both C++ and Java, 64 bytes each, with
+// |separator| between them. The bytes other than the printable ones are octal
+// escapes, which end after three digits whatever follows them, unlike the
+// hexadecimal escapes of C++ and the Unicode escapes of Java.
+std::string WireSchemaLiteral(const std::string& schema, const std::string& separator);
+
+}  // namespace aidl
+}  // namespace android
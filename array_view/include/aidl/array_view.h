@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+// The read-only views of the byte[], int[] and float[] arguments annotated
+// with @ArrayView. A C++ stub points them right into the received parcel, so
+// they are only valid for the duration of the call. Proxies take them too, so
+// that callers can pass the arrays they already have without building vectors:
+//
+//   int32_t samples[512];
+//   foo->write(samples);  // or a std::vector<int32_t>, or ArrayView(data, size)
+
+#include <stddef.h>
+
+#include <vector>
+
+namespace android {
+namespace aidl {
+
+template <typename T>
+class ArrayView {
+ public:
+  constexpr ArrayView() = default;
+  constexpr ArrayView(const T* data, size_t size) : data_(data), size_(size) {}
+  ArrayView(const std::vector<T>& vector) : data_(vector.data()), size_(vector.size()) {}
+  template <size_t N>
+  constexpr ArrayView(const T (&array)[N]) : data_(array), size_(N) {}
+
+  constexpr const T* data() const { return data_; }
+  constexpr size_t size() const { return size_; }
+  constexpr bool empty() const { return size_ == 0; }
+  constexpr const T* begin() const { return data_; }
+  constexpr const T* end() const { return data_ + size_; }
+  constexpr const T& operator[](size_t i) const { return data_[i]; }
+
+  // A copy to keep beyond the call
+  std::vector<T> ToVector() const { return std::vector<T>(begin(), end()); }
+
+ private:
+  const T* data_ = nullptr;
+  size_t size_ = 0;
+};
+
+}  // namespace aidl
+}  // namespace android
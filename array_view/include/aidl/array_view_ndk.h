@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+// The @ArrayView arguments of the NDK backend, see aidl/array_view.h. AParcel
+// cannot point into its data, so the stubs still read the arrays into vectors,
+// and only the proxies write them from views. The same goes for the
+// @StringView arguments and strings.
+
+#include <stdint.h>
+
+#include <limits>
+#include <string_view>
+
+#include <aidl/array_view.h>
+#include <android/binder_parcel.h>
+
+namespace android {
+namespace aidl {
+
+inline binder_status_t WriteArrayView(AParcel* parcel, ArrayView<int8_t> view) {
+  if (view.size() > static_cast<size_t>(std::numeric_limits<int32_t>::max())) {
+    return STATUS_BAD_VALUE;
+  }
+  return AParcel_writeByteArray(parcel, view.data(), static_cast<int32_t>(view.size()));
+}
+
+inline binder_status_t WriteArrayView(AParcel* parcel, ArrayView<int32_t> view) {
+  if (view.size() > static_cast<size_t>(std::numeric_limits<int32_t>::max())) {
+    return STATUS_BAD_VALUE;
+  }
+  return AParcel_writeInt32Array(parcel, view.data(), static_cast<int32_t>(view.size()));
+}
+
+inline binder_status_t WriteArrayView(AParcel* parcel, ArrayView<float> view) {
+  if (view.size() > static_cast<size_t>(std::numeric_limits<int32_t>::max())) {
+    return STATUS_BAD_VALUE;
+  }
+  return AParcel_writeFloatArray(parcel, view.data(), static_cast<int32_t>(view.size()));
+}
+
+inline binder_status_t WriteStringView(AParcel* parcel, std::string_view view) {
+  if (view.size() > static_cast<size_t>(std::numeric_limits<int32_t>::max())) {
+    return STATUS_BAD_VALUE;
+  }
+  // A null string_view is empty, not a null String.
+  return AParcel_writeString(parcel, view.data() != nullptr ? view.data() : "",
+                             static_cast<int32_t>(view.size()));
+}
+
+}  // namespace aidl
+}  // namespace android
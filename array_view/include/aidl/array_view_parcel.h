@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+// The @ArrayView arguments of the C++ backend, see aidl/array_view.h. The
+// arrays are laid out as by Parcel::writeByteVector(), writeInt32Vector() and
+// writeFloatVector(): an int32 count followed by the elements, which are all
+// four bytes long except those of a byte[].
+//
+// The @StringView arguments too, which proxies convert from UTF-8 right into
+// the parcel as Parcel::writeUtf8AsUtf16() does. Stubs read them into
+// strings.
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <limits>
+#include <string_view>
+#include <type_traits>
+
+#include <aidl/array_view.h>
+#include <binder/Parcel.h>
+#include <utils/Unicode.h>
+
+namespace android {
+namespace aidl {
+
+template <typename T>
+status_t WriteArrayView(Parcel* parcel, ArrayView<T> view) {
+  static_assert(std::is_same_v<T, uint8_t> || sizeof(T) == sizeof(int32_t));
+  if (view.size() > static_cast<size_t>(std::numeric_limits<int32_t>::max()) / sizeof(T)) {
+    return BAD_VALUE;
+  }
+  status_t status = parcel->writeInt32(static_cast<int32_t>(view.size()));
+  if (status != OK) return status;
+  return parcel->write(view.data(), view.size() * sizeof(T));
+}
+
+inline status_t WriteStringView(Parcel* parcel, std::string_view view) {
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(view.data());
+  const ssize_t utf16_size = utf8_to_utf16_length(data, view.size());
+  if (utf16_size < 0 || utf16_size >= std::numeric_limits<int32_t>::max()) {
+    return BAD_VALUE;
+  }
+  status_t status = parcel->writeInt32(static_cast<int32_t>(utf16_size));
+  if (status != OK) return status;
+  // With the terminating NUL
+  void* utf16 = parcel->writeInplace((static_cast<size_t>(utf16_size) + 1) * sizeof(char16_t));
+  if (utf16 == nullptr) return NO_MEMORY;
+  utf8_to_utf16(data, view.size(), static_cast<char16_t*>(utf16),
+                static_cast<size_t>(utf16_size) + 1);
+  return OK;
+}
+
+// Points |view| at the elements in |parcel|, which must outlive it
+template <typename T>
+status_t ReadArrayView(const Parcel* parcel, ArrayView<T>* view) {
+  static_assert(std::is_same_v<T, uint8_t> || sizeof(T) == sizeof(int32_t));
+  int32_t size;
+  status_t status = parcel->readInt32(&size);
+  if (status != OK) return status;
+  if (size < 0) return UNEXPECTED_NULL;
+  if (static_cast<size_t>(size) > parcel->dataAvail() / sizeof(T)) return BAD_VALUE;
+  const void* data = parcel->readInplace(static_cast<size_t>(size) * sizeof(T));
+  if (data == nullptr) return BAD_VALUE;
+  *view = ArrayView<T>(static_cast<const T*>(data), static_cast<size_t>(size));
+  return OK;
+}
+
+}  // namespace aidl
+}  // namespace android
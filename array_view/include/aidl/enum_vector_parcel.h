@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+// The enum arrays of the C++ backend, which are copied to and from the parcel
+// in one go rather than by Parcel::writeEnumVector() and readEnumVector(),
+// which go through the elements one by one. An enum has the representation of
+// its backing type, so the arrays are laid out as by writeByteVector(),
+// writeInt32Vector() and writeInt64Vector(): an int32 count, which is -1 for a
+// null array, followed by the elements.
+
+#include <stdint.h>
+
+#include <limits>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <vector>
+
+#include <binder/Parcel.h>
+
+namespace android {
+namespace aidl {
+
+template <typename T>
+status_t WriteEnumVector(Parcel* parcel, const T* data, size_t size) {
+  static_assert(std::is_enum_v<T>);
+  if (size > static_cast<size_t>(std::numeric_limits<int32_t>::max()) / sizeof(T)) {
+    return BAD_VALUE;
+  }
+  status_t status = parcel->writeInt32(static_cast<int32_t>(size));
+  if (status != OK || size == 0) return status;
+  return parcel->write(data, size * sizeof(T));
+}
+
+template <typename T>
+status_t WriteEnumVector(Parcel* parcel, const std::vector<T>& values) {
+  return WriteEnumVector(parcel, values.data(), values.size());
+}
+
+template <typename T>
+status_t WriteEnumVector(Parcel* parcel, const std::optional<std::vector<T>>& values) {
+  if (!values) return parcel->writeInt32(-1);
+  return WriteEnumVector(parcel, *values);
+}
+
+template <typename T>
+status_t WriteEnumVector(Parcel* parcel, const std::unique_ptr<std::vector<T>>& values) {
+  if (!values) return parcel->writeInt32(-1);
+  return WriteEnumVector(parcel, *values);
+}
+
+// Reads the count of an array into |size|, which is -1 for a null array
+template <typename T>
+status_t ReadEnumVectorSize(const Parcel* parcel, int32_t* size) {
+  static_assert(std::is_enum_v<T>);
+  status_t status = parcel->readInt32(size);
+  if (status != OK) return status;
+  if (*size < -1) return BAD_VALUE;
+  // Rejects the counts that the parcel cannot hold before allocating for them
+  if (*size > 0 && static_cast<size_t>(*size) > parcel->dataAvail() / sizeof(T)) {
+    return BAD_VALUE;
+  }
+  return OK;
+}
+
+template <typename T>
+status_t ReadEnumVectorElements(const Parcel* parcel, int32_t size, std::vector<T>* values) {
+  values->resize(static_cast<size_t>(size));
+  if (size == 0) return OK;
+  return parcel->read(values->data(), values->size() * sizeof(T));
+}
+
+template <typename T>
+status_t ReadEnumVector(const Parcel* parcel, std::vector<T>* values) {
+  int32_t size;
+  status_t status = ReadEnumVectorSize<T>(parcel, &size);
+  if (status != OK) return status;
+  if (size < 0) return UNEXPECTED_NULL;
+  return ReadEnumVectorElements(parcel, size, values);
+}
+
+template <typename T>
+status_t ReadEnumVector(const Parcel* parcel, std::optional<std::vector<T>>* values) {
+  int32_t size;
+  status_t status = ReadEnumVectorSize<T>(parcel, &size);
+  if (status != OK) return status;
+  if (size < 0) {
+    values->reset();
+    return OK;
+  }
+  values->emplace();
+  return ReadEnumVectorElements(parcel, size, &**values);
+}
+
+template <typename T>
+status_t ReadEnumVector(const Parcel* parcel, std::unique_ptr<std::vector<T>>* values) {
+  int32_t size;
+  status_t status = ReadEnumVectorSize<T>(parcel, &size);
+  if (status != OK) return status;
+  if (size < 0) {
+    values->reset();
+    return OK;
+  }
+  *values = std::make_unique<std::vector<T>>();
+  return ReadEnumVectorElements(parcel, size, values->get());
+}
+
+}  // namespace aidl
+}  // namespace android
@@ -38,7 +38,7 @@ std::string AstNode::ToString() {
 LiteralDecl::LiteralDecl(const std::string& expression) : expression_(expression) {}
 
 void LiteralDecl::Write(CodeWriter* to) const {
-  to->Write("%s", expression_.c_str());
+  *to << expression_;
 }
 
 ClassDecl::ClassDecl(const std::string& name, const std::string& parent)
@@ -121,29 +121,28 @@ void Enum::AddValue(const string& key, const string& value) {
   fields_.emplace_back(key, value);
 }
 
-ArgList::ArgList(const std::string& single_argument)
-    : ArgList(vector<string>{single_argument}) {}
+ArgList::ArgList(const std::string& single_argument) : arguments_{single_argument} {}
 
-ArgList::ArgList(const std::vector<std::string>& arg_list) {
-  for (const auto& s : arg_list) {
-    arguments_.emplace_back(new LiteralExpression(s));
+ArgList::ArgList(const std::vector<std::string>& arg_list) : arguments_(arg_list) {}
+
+ArgList::ArgList(std::vector<std::unique_ptr<AstNode>> arg_list) {
+  arguments_.reserve(arg_list.size());
+  for (const auto& node : arg_list) {
+    arguments_.push_back(node->ToString());
   }
 }
 
-ArgList::ArgList(std::vector<std::unique_ptr<AstNode>> arg_list)
-    : arguments_(std::move(arg_list)) {}
-
 ArgList::ArgList(ArgList&& arg_list) noexcept : arguments_(std::move(arg_list.arguments_)) {}
 
 void ArgList::Write(CodeWriter* to) const {
-  to->Write("(");
+  *to << "(";
   bool is_first = true;
   for (const auto& s : arguments_) {
-    if (!is_first) { to->Write(", "); }
+    if (!is_first) { *to << ", "; }
     is_first = false;
-    s->Write(to);
+    *to << s;
   }
-  to->Write(")");
+  *to << ")";
 }
 
 ConstructorDecl::ConstructorDecl(
@@ -343,16 +342,20 @@ void SwitchStatement::Write(CodeWriter* to) const {
 
 
 Assignment::Assignment(const std::string& left, const std::string& right)
-    : Assignment(left, new LiteralExpression{right}) {}
+    : lhs_(left), rhs_literal_(right) {}
 
 Assignment::Assignment(const std::string& left, AstNode* right)
     : lhs_(left),
       rhs_(right) {}
 
 void Assignment::Write(CodeWriter* to) const {
-  to->Write("%s = ", lhs_.c_str());
-  rhs_->Write(to);
-  to->Write(";\n");
+  *to << lhs_ << " = ";
+  if (rhs_) {
+    rhs_->Write(to);
+  } else {
+    *to << rhs_literal_;
+  }
+  *to << ";\n";
 }
 
 MethodCall::MethodCall(const std::string& method_name,
@@ -390,12 +393,15 @@ Statement::Statement(unique_ptr<AstNode> expression)
 
 Statement::Statement(AstNode* expression) : expression_(expression) {}
 
-Statement::Statement(const string& expression)
-    : expression_(new LiteralExpression(expression)) {}
+Statement::Statement(const string& expression) : literal_(expression) {}
 
 void Statement::Write(CodeWriter* to) const {
-  expression_->Write(to);
-  to->Write(";\n");
+  if (expression_) {
+    expression_->Write(to);
+  } else {
+    *to << literal_;
+  }
+  *to << ";\n";
 }
 
 Comparison::Comparison(AstNode* lhs, const string& comparison, AstNode* rhs)
@@ -415,7 +421,7 @@ LiteralExpression::LiteralExpression(const std::string& expression)
     : expression_(expression) {}
 
 void LiteralExpression::Write(CodeWriter* to) const {
-  to->Write("%s", expression_.c_str());
+  *to << expression_;
 }
 
 CppNamespace::CppNamespace(const std::string& name,
@@ -475,6 +481,40 @@ CppSource::CppSource(const std::vector<std::string>& include_list,
                      std::vector<std::unique_ptr<Declaration>> declarations)
     : Document(include_list, std::move(declarations)) {}
 
+CppSourceWriter::CppSourceWriter(CodeWriter* to, const std::vector<std::string>& include_list,
+                                 const std::vector<std::string>& package)
+    : to_(to), package_(package) {
+  for (const auto& include : include_list) {
+    to->Write("#include <%s>\n", include.c_str());
+  }
+  *to << "\n";
+  for (const auto& name : package_) {
+    to->Write("namespace %s {\n\n", name.c_str());
+  }
+}
+
+void CppSourceWriter::Write(const Declaration& declaration) {
+  declaration.Write(to_);
+  EndDeclaration();
+}
+
+void CppSourceWriter::EndDeclaration() {
+  // Like CppNamespace, which separates its declarations.
+  if (!package_.empty()) {
+    *to_ << "\n";
+  }
+}
+
+void CppSourceWriter::Close() {
+  for (auto it = package_.crbegin(); it != package_.crend(); ++it) {
+    to_->Write("}  // namespace %s\n", it->c_str());
+    // The enclosing namespace separates this one from what follows.
+    if (it + 1 != package_.crend()) {
+      *to_ << "\n";
+    }
+  }
+}
+
 }  // namespace cpp
 }  // namespace aidl
 }  // namespace android
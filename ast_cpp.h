@@ -122,7 +122,9 @@ class ArgList : public AstNode {
   void Write(CodeWriter* to) const override;
 
  private:
-  std::vector<std::unique_ptr<AstNode>> arguments_;
+  // Arguments are kept as the code they stand for; nodes are rendered as the
+  // list is built instead of being kept around until it is written.
+  std::vector<std::string> arguments_;
 
   DISALLOW_COPY_AND_ASSIGN(ArgList);
 };  // class ArgList
@@ -298,7 +300,9 @@ class Assignment : public AstNode {
 
  private:
   const std::string lhs_;
+  // Either |rhs_| or, for a literal right hand side, |rhs_literal_|.
   std::unique_ptr<AstNode> rhs_;
+  const std::string rhs_literal_;
 
   DISALLOW_COPY_AND_ASSIGN(Assignment);
 };  // class Assignment
@@ -345,7 +349,9 @@ class Statement : public AstNode {
   void Write(CodeWriter* to) const override;
 
  private:
+  // Either |expression_| or, for a literal statement, |literal_|.
   std::unique_ptr<AstNode> expression_;
+  const std::string literal_;
 
   DISALLOW_COPY_AND_ASSIGN(Statement);
 };  // class Statement
@@ -429,6 +435,32 @@ class CppSource final : public Document {
   DISALLOW_COPY_AND_ASSIGN(CppSource);
 };  // class CppSource
 
+// Writes a source file one declaration at a time, laid out as a CppSource
+// whose declarations are nested in |package|. A declaration can be dropped
+// as soon as it has been written, so the file is never held in memory as a
+// whole.
+class CppSourceWriter {
+ public:
+  // Writes the includes and opens the namespaces.
+  CppSourceWriter(CodeWriter* to, const std::vector<std::string>& include_list,
+                  const std::vector<std::string>& package);
+
+  void Write(const Declaration& declaration);
+  // Ends a declaration that has been written to Writer() directly.
+  void EndDeclaration();
+
+  // Closes the namespaces.
+  void Close();
+
+  CodeWriter* Writer() const { return to_; }
+
+ private:
+  CodeWriter* const to_;
+  const std::vector<std::string> package_;
+
+  DISALLOW_COPY_AND_ASSIGN(CppSourceWriter);
+};  // class CppSourceWriter
+
 }  // namespace cpp
 }  // namespace aidl
 }  // namespace android
@@ -268,6 +268,27 @@ TEST_F(AstCppTests, ToString) {
   EXPECT_EQ(literal, written);
 }
 
+TEST_F(AstCppTests, CppSourceWriterLaysOutLikeCppSource) {
+  vector<unique_ptr<Declaration>> inner;
+  inner.emplace_back(new LiteralDecl("int a;\n"));
+  inner.emplace_back(new LiteralDecl("int b;\n"));
+  vector<unique_ptr<Declaration>> outer;
+  outer.emplace_back(new CppNamespace("test", std::move(inner)));
+  vector<unique_ptr<Declaration>> decls;
+  decls.emplace_back(new CppNamespace("android", std::move(outer)));
+  CppSource source({"string"}, std::move(decls));
+
+  string written;
+  CodeWriterPtr writer = CodeWriter::ForString(&written);
+  CppSourceWriter source_writer(writer.get(), {"string"}, {"android", "test"});
+  source_writer.Write(LiteralDecl("int a;\n"));
+  *source_writer.Writer() << "int b;\n";
+  source_writer.EndDeclaration();
+  source_writer.Close();
+  writer->Close();
+  EXPECT_EQ(source.ToString(), written);
+}
+
 }  // namespace cpp
 }  // namespace aidl
 }  // namespace android
@@ -65,7 +65,7 @@ void WriteModifiers(CodeWriter* to, int mod, int mask) {
   }
 }
 
-void WriteArgumentList(CodeWriter* to, const vector<std::shared_ptr<Expression>>& arguments) {
+void WriteArgumentList(CodeWriter* to, const vector<Expression*>& arguments) {
   size_t N = arguments.size();
   for (size_t i = 0; i < N; i++) {
     arguments[i]->Write(to);
@@ -75,7 +75,7 @@ void WriteArgumentList(CodeWriter* to, const vector<std::shared_ptr<Expression>>
   }
 }
 
-Field::Field(int m, std::shared_ptr<Variable> v) : ClassElement(), modifiers(m), variable(v) {}
+Field::Field(int m, Variable* v) : ClassElement(), modifiers(m), variable(v) {}
 
 void Field::Write(CodeWriter* to) const {
   if (this->comment.length() != 0) {
@@ -113,14 +113,14 @@ void Variable::WriteDeclaration(CodeWriter* to) const {
 
 void Variable::Write(CodeWriter* to) const { to->Write("%s", name.c_str()); }
 
-FieldVariable::FieldVariable(std::shared_ptr<Expression> o, const string& n)
+FieldVariable::FieldVariable(Expression* o, const string& n)
     : receiver(o), name(n) {}
 
 FieldVariable::FieldVariable(const string& c, const string& n) : receiver(c), name(n) {}
 
 void FieldVariable::Write(CodeWriter* to) const {
   visit(
-      overloaded{[&](std::shared_ptr<Expression> e) { e->Write(to); },
+      overloaded{[&](Expression* e) { e->Write(to); },
                  [&](const std::string& s) { to->Write("%s", s.c_str()); }, [](std::monostate) {}},
       this->receiver);
   to->Write(".%s", name.c_str());
@@ -143,25 +143,25 @@ void StatementBlock::Write(CodeWriter* to) const {
   to->Write("}\n");
 }
 
-void StatementBlock::Add(std::shared_ptr<Statement> statement) {
+void StatementBlock::Add(Statement* statement) {
   this->statements.push_back(statement);
 }
 
-void StatementBlock::Add(std::shared_ptr<Expression> expression) {
-  this->statements.push_back(std::make_shared<ExpressionStatement>(expression));
+void StatementBlock::Add(Expression* expression) {
+  this->statements.push_back(Make<ExpressionStatement>(expression));
 }
 
-ExpressionStatement::ExpressionStatement(std::shared_ptr<Expression> e) : expression(e) {}
+ExpressionStatement::ExpressionStatement(Expression* e) : expression(e) {}
 
 void ExpressionStatement::Write(CodeWriter* to) const {
   this->expression->Write(to);
   to->Write(";\n");
 }
 
-Assignment::Assignment(std::shared_ptr<Variable> l, std::shared_ptr<Expression> r)
+Assignment::Assignment(Variable* l, Expression* r)
     : lvalue(l), rvalue(r) {}
 
-Assignment::Assignment(std::shared_ptr<Variable> l, std::shared_ptr<Expression> r, string c)
+Assignment::Assignment(Variable* l, Expression* r, string c)
     : lvalue(l), rvalue(r), cast(c) {}
 
 void Assignment::Write(CodeWriter* to) const {
@@ -175,24 +175,23 @@ void Assignment::Write(CodeWriter* to) const {
 
 MethodCall::MethodCall(const string& n) : name(n) {}
 
-MethodCall::MethodCall(const string& n, const std::vector<std::shared_ptr<Expression>>& args)
+MethodCall::MethodCall(const string& n, const std::vector<Expression*>& args)
     : name(n), arguments(args) {}
 
-MethodCall::MethodCall(std::shared_ptr<Expression> o, const string& n) : receiver(o), name(n) {}
+MethodCall::MethodCall(Expression* o, const string& n) : receiver(o), name(n) {}
 
 MethodCall::MethodCall(const std::string& t, const string& n) : receiver(t), name(n) {}
 
-MethodCall::MethodCall(std::shared_ptr<Expression> o, const string& n,
-                       const std::vector<std::shared_ptr<Expression>>& args)
+MethodCall::MethodCall(Expression* o, const string& n, const std::vector<Expression*>& args)
     : receiver(o), name(n), arguments(args) {}
 
 MethodCall::MethodCall(const std::string& t, const string& n,
-                       const std::vector<std::shared_ptr<Expression>>& args)
+                       const std::vector<Expression*>& args)
     : receiver(t), name(n), arguments(args) {}
 
 void MethodCall::Write(CodeWriter* to) const {
   visit(
-      overloaded{[&](std::shared_ptr<Expression> e) {
+      overloaded{[&](Expression* e) {
                    e->Write(to);
                    to->Write(".");
                  },
@@ -203,8 +202,7 @@ void MethodCall::Write(CodeWriter* to) const {
   to->Write(")");
 }
 
-Comparison::Comparison(std::shared_ptr<Expression> l, const string& o,
-                       std::shared_ptr<Expression> r)
+Comparison::Comparison(Expression* l, const string& o, Expression* r)
     : lvalue(l), op(o), rvalue(r) {}
 
 void Comparison::Write(CodeWriter* to) const {
@@ -218,7 +216,7 @@ void Comparison::Write(CodeWriter* to) const {
 NewExpression::NewExpression(const std::string& n) : instantiableName(n) {}
 
 NewExpression::NewExpression(const std::string& n,
-                             const std::vector<std::shared_ptr<Expression>>& args)
+                             const std::vector<Expression*>& args)
     : instantiableName(n), arguments(args) {}
 
 void NewExpression::Write(CodeWriter* to) const {
@@ -227,7 +225,7 @@ void NewExpression::Write(CodeWriter* to) const {
   to->Write(")");
 }
 
-NewArrayExpression::NewArrayExpression(const std::string& t, std::shared_ptr<Expression> s)
+NewArrayExpression::NewArrayExpression(const std::string& t, Expression* s)
     : type(t), size(s) {}
 
 void NewArrayExpression::Write(CodeWriter* to) const {
@@ -236,7 +234,7 @@ void NewArrayExpression::Write(CodeWriter* to) const {
   to->Write("]");
 }
 
-Cast::Cast(const std::string& t, std::shared_ptr<Expression> e) : type(t), expression(e) {}
+Cast::Cast(const std::string& t, Expression* e) : type(t), expression(e) {}
 
 void Cast::Write(CodeWriter* to) const {
   to->Write("((%s)", this->type.c_str());
@@ -244,10 +242,10 @@ void Cast::Write(CodeWriter* to) const {
   to->Write(")");
 }
 
-VariableDeclaration::VariableDeclaration(std::shared_ptr<Variable> l, std::shared_ptr<Expression> r)
+VariableDeclaration::VariableDeclaration(Variable* l, Expression* r)
     : lvalue(l), rvalue(r) {}
 
-VariableDeclaration::VariableDeclaration(std::shared_ptr<Variable> l) : lvalue(l) {}
+VariableDeclaration::VariableDeclaration(Variable* l) : lvalue(l) {}
 
 void VariableDeclaration::Write(CodeWriter* to) const {
   this->lvalue->WriteDeclaration(to);
@@ -271,7 +269,7 @@ void IfStatement::Write(CodeWriter* to) const {
   }
 }
 
-ReturnStatement::ReturnStatement(std::shared_ptr<Expression> e) : expression(e) {}
+ReturnStatement::ReturnStatement(Expression* e) : expression(e) {}
 
 void ReturnStatement::Write(CodeWriter* to) const {
   to->Write("return ");
@@ -308,7 +306,7 @@ void Case::Write(CodeWriter* to) const {
   statements->Write(to);
 }
 
-SwitchStatement::SwitchStatement(std::shared_ptr<Expression> e) : expression(e) {}
+SwitchStatement::SwitchStatement(Expression* e) : expression(e) {}
 
 void SwitchStatement::Write(CodeWriter* to) const {
   to->Write("switch (");
@@ -432,10 +430,10 @@ void Class::Write(CodeWriter* to) const {
 
 Document::Document(const std::string& comment,
                    const std::string& package,
-                   std::unique_ptr<Class> clazz)
+                   Class* clazz)
     : comment_(comment),
       package_(package),
-      clazz_(std::move(clazz)) {
+      clazz_(clazz) {
 }
 
 void Document::Write(CodeWriter* to) const {
@@ -455,11 +453,20 @@ void Document::Write(CodeWriter* to) const {
   }
 }
 
-std::shared_ptr<Expression> NULL_VALUE = std::make_shared<LiteralExpression>("null");
-std::shared_ptr<Expression> THIS_VALUE = std::make_shared<LiteralExpression>("this");
-std::shared_ptr<Expression> SUPER_VALUE = std::make_shared<LiteralExpression>("super");
-std::shared_ptr<Expression> TRUE_VALUE = std::make_shared<LiteralExpression>("true");
-std::shared_ptr<Expression> FALSE_VALUE = std::make_shared<LiteralExpression>("false");
+namespace {
+// The shared values live for the whole program rather than in an arena.
+LiteralExpression kNullValue("null");
+LiteralExpression kThisValue("this");
+LiteralExpression kSuperValue("super");
+LiteralExpression kTrueValue("true");
+LiteralExpression kFalseValue("false");
+}  // namespace
+
+Expression* const NULL_VALUE = &kNullValue;
+Expression* const THIS_VALUE = &kThisValue;
+Expression* const SUPER_VALUE = &kSuperValue;
+Expression* const TRUE_VALUE = &kTrueValue;
+Expression* const FALSE_VALUE = &kFalseValue;
 }  // namespace java
 }  // namespace aidl
 }  // namespace android
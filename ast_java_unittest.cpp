@@ -35,8 +35,31 @@ final class TestClass extends SuperClass
 }
 )";
 
+struct CountedStatement : public Statement {
+  explicit CountedStatement(int* destroyed) : destroyed(destroyed) {}
+  ~CountedStatement() { ++*destroyed; }
+  void Write(CodeWriter* to) const override { to->Write("counted;\n"); }
+
+  int* destroyed;
+};
+
 }  // namespace
 
+TEST(AstJavaTests, NodesAreOwnedByTheArena) {
+  int destroyed = 0;
+  {
+    AidlArena arena;
+    AidlArena::Scope arena_scope(&arena);
+    StatementBlock* block = Make<StatementBlock>();
+    block->Add(Make<CountedStatement>(&destroyed));
+    block->Add(Make<CountedStatement>(&destroyed));
+    EXPECT_EQ("{\n  counted;\n  counted;\n}\n", block->ToString());
+    EXPECT_LT(0u, arena.BytesAllocated());
+    EXPECT_EQ(0, destroyed);
+  }
+  EXPECT_EQ(2, destroyed);
+}
+
 TEST(AstJavaTests, GeneratesClass) {
   Class a_class;
   a_class.comment = "// class comment";
@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+// The threads that the asynchronous variants of the methods, generated with
+// --gen-async, run their transactions on. A variant returns a future of the
+// status and the result of the blocking call, so that a thread can keep
+// several transactions in flight:
+//
+//   auto name = foo->getNameAsync(1);
+//   ...
+//   ::android::aidl::AsyncResult<::android::binder::Status, ::android::String16> result =
+//       name.get();
+//
+// The executor of a process starts up to kMaxThreads threads as the calls
+// need them, and counts the time that the calls wait for a thread and run in
+// the counters of --gen-stats.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "aidl/transaction_stats.h"
+
+namespace android {
+namespace aidl {
+
+// The status and the return value of an asynchronous call
+template <typename Status, typename T>
+struct AsyncResult {
+  Status status;
+  T value{};
+};
+
+class AsyncExecutor {
+ public:
+  static constexpr size_t kMaxThreads = 4;
+
+  explicit AsyncExecutor(size_t max_threads = kMaxThreads)
+      : max_threads_(max_threads > 0 ? max_threads : 1) {}
+  AsyncExecutor(const AsyncExecutor&) = delete;
+  AsyncExecutor& operator=(const AsyncExecutor&) = delete;
+
+  // Runs the calls that were submitted, then joins the threads
+  ~AsyncExecutor() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    ready_.notify_all();
+    for (std::thread& thread : threads_) {
+      thread.join();
+    }
+  }
+
+  // The executor of the process. It is never destroyed, so that the calls in
+  // flight do not outlive it while the process exits.
+  static AsyncExecutor& Default() {
+    static AsyncExecutor* executor = new AsyncExecutor();
+    return *executor;
+  }
+
+  // Runs |call| on a thread of the executor, and returns the future of its
+  // result. |call| may be move-only.
+  template <typename F>
+  std::future<std::invoke_result_t<std::decay_t<F>&>> Submit(F&& call) {
+    using R = std::invoke_result_t<std::decay_t<F>&>;
+    auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(call));
+    std::future<R> result = task->get_future();
+    Post([task]() { (*task)(); });
+    return result;
+  }
+
+  // Runs |task| on a thread of the executor. The tasks start in the order
+  // that they were posted in, and must not throw.
+  void Post(std::function<void()> task) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_.push_back(Task{std::move(task), transaction_stats::Now()});
+    if (queue_.size() > idle_threads_ && threads_.size() < max_threads_) {
+      threads_.emplace_back([this]() { Run(); });
+    } else {
+      ready_.notify_one();
+    }
+  }
+
+  // "wait", the time from the submission of the calls to their start, and
+  // "run", the time that they ran for
+  transaction_stats::Table GetStats() const { return transaction_stats::Table(stats_, 2); }
+
+  size_t GetThreadCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return threads_.size();
+  }
+
+ private:
+  struct Task {
+    std::function<void()> run;
+    int64_t submitted_ns;
+  };
+
+  void Run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      idle_threads_++;
+      ready_.wait(lock, [this]() { return stopping_ || !queue_.empty(); });
+      idle_threads_--;
+      if (queue_.empty()) return;
+      Task task = std::move(queue_.front());
+      queue_.pop_front();
+      lock.unlock();
+
+      const int64_t start_ns = transaction_stats::Now();
+      stats_[0].Record(start_ns - task.submitted_ns);
+      task.run();
+      stats_[1].Record(transaction_stats::Now() - start_ns);
+      lock.lock();
+    }
+  }
+
+  const size_t max_threads_;
+  mutable std::mutex mutex_;
+  std::condition_variable ready_;
+  std::deque<Task> queue_;
+  std::vector<std::thread> threads_;
+  size_t idle_threads_ = 0;
+  bool stopping_ = false;
+  transaction_stats::MethodStats stats_[2] = {{"wait", 0}, {"run", 1}};
+};
+
+}  // namespace aidl
+}  // namespace android
@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+// The flushes of the batches of @Batchable calls. A C++ or NDK proxy that
+// opens a batch schedules its flush on the timer of the process, so that the
+// calls of a batch that does not fill up are sent within kMaxDelay even if
+// the caller neither calls the interface again nor flushes it. The flush holds
+// a strong reference to the proxy until it runs, so a proxy with queued calls
+// is not destroyed before they are sent.
+//
+// The timer of a process is one thread, which it starts the first time a
+// flush is scheduled.
+
+#include <stddef.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace android {
+namespace aidl {
+
+class BatchTimer {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  // How long the calls of a batch wait at most before it is sent. It is the
+  // value of kMaxBatchDelayMs in the compiler, which the Java proxies use.
+  static constexpr std::chrono::milliseconds kMaxDelay{10};
+
+  BatchTimer() = default;
+  BatchTimer(const BatchTimer&) = delete;
+  BatchTimer& operator=(const BatchTimer&) = delete;
+
+  // Drops the flushes that have not run, then joins the thread
+  ~BatchTimer() {
+    std::multimap<Clock::time_point, std::function<void()>> dropped;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+      dropped.swap(flushes_);
+    }
+    changed_.notify_all();
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+  }
+
+  // The timer of the process. It is never destroyed, so that the flushes
+  // that are pending do not outlive it while the process exits.
+  static BatchTimer& Default() {
+    static BatchTimer* timer = new BatchTimer();
+    return *timer;
+  }
+
+  // Runs |flush| on the thread of the timer at |deadline|. The flushes run
+  // one at a time, in the order of their deadlines, and must not throw. They
+  // are called without the lock of the timer, so they may take the lock of a
+  // proxy that schedules flushes with its own lock held.
+  void Schedule(Clock::time_point deadline, std::function<void()> flush) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      flushes_.emplace(deadline, std::move(flush));
+      if (!thread_.joinable()) {
+        thread_ = std::thread([this]() { Run(); });
+      }
+    }
+    changed_.notify_one();
+  }
+
+  // The number of the flushes that have not run, for tests
+  size_t Pending() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return flushes_.size();
+  }
+
+ private:
+  void Run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+      if (flushes_.empty()) {
+        changed_.wait(lock);
+        continue;
+      }
+      auto next = flushes_.begin();
+      if (Clock::now() < next->first) {
+        changed_.wait_until(lock, next->first);
+        continue;
+      }
+      std::function<void()> flush = std::move(next->second);
+      flushes_.erase(next);
+      lock.unlock();
+      flush();
+      // The references that |flush| holds are released without the lock.
+      flush = nullptr;
+      lock.lock();
+    }
+  }
+
+  mutable std::mutex mutex_;
+  std::condition_variable changed_;
+  std::multimap<Clock::time_point, std::function<void()>> flushes_;
+  std::thread thread_;
+  bool stopping_ = false;
+};
+
+}  // namespace aidl
+}  // namespace android
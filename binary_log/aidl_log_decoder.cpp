@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Prints the transactions of dumps of the binary log (see aidl/binary_log.h)
+// as JSON objects, one per line, e.g.
+//
+//   adb pull /data/local/tmp/transactions.bin
+//   aidl_log_decoder transactions.bin
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "aidl/binary_log_decoder.h"
+
+using android::aidl::binary_log::Decode;
+using android::aidl::binary_log::Record;
+using android::aidl::binary_log::ToJson;
+using std::cerr;
+using std::endl;
+using std::string;
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    cerr << "usage: " << argv[0] << " DUMP..." << endl;
+    return 1;
+  }
+  for (int i = 1; i < argc; i++) {
+    std::ifstream in(argv[i], std::ios::binary);
+    std::stringstream contents;
+    contents << in.rdbuf();
+    std::vector<Record> records;
+    if (!in.is_open() || !Decode(contents.str(), &records)) {
+      cerr << argv[i] << ": not a dump of the binary log" << endl;
+      return 1;
+    }
+    for (const Record& record : records) {
+      std::cout << ToJson(record) << "\n";
+    }
+  }
+  return 0;
+}
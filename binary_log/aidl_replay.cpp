@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Sends the requests of a capture (see aidl/transaction_capture.h) to a
+// service again, with their original gaps scaled by --rate, and prints the
+// latencies of its methods, e.g.
+//
+//   adb push requests.cap /data/local/tmp
+//   adb shell aidl_replay --service=foo --rate=2 --threads=4 /data/local/tmp/requests.cap
+//
+// Only the requests of the interface of the service are sent. The service
+// can be of any backend, since they share the wire format.
+
+#include <getopt.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/parsedouble.h>
+#include <android-base/parseint.h>
+#include <binder/IBinder.h>
+#include <binder/IServiceManager.h>
+#include <binder/Parcel.h>
+#include <binder/ProcessState.h>
+#include <utils/String16.h>
+#include <utils/String8.h>
+
+#include "aidl/replay.h"
+#include "aidl/transaction_capture.h"
+
+using android::IBinder;
+using android::OK;
+using android::Parcel;
+using android::sp;
+using android::status_t;
+using android::String16;
+using android::String8;
+using android::aidl::capture::LatencyStats;
+using android::aidl::capture::Request;
+using android::aidl::capture::ScheduleOffsets;
+using std::cerr;
+using std::endl;
+using std::string;
+using std::vector;
+
+namespace {
+
+void Usage(const char* name) {
+  cerr << "usage: " << name << " --service=NAME [--rate=R] [--threads=N] [--repeat=N] CAPTURE\n"
+       << "  --rate=R     replay R times as fast as captured; 0 sends as fast as possible"
+       << " (default 1)\n"
+       << "  --threads=N  send from N threads, which share out the requests (default 1)\n"
+       << "  --repeat=N   send the requests N times (default 1)" << endl;
+}
+
+// Sends the requests of |indices| at their |offsets| after |start|; the
+// indices past the end of |requests| are of the repeats
+LatencyStats Replay(const sp<IBinder>& binder, const vector<Request>& requests,
+                    const vector<int64_t>& offsets, const vector<size_t>& indices,
+                    std::chrono::steady_clock::time_point start) {
+  LatencyStats stats;
+  for (size_t i : indices) {
+    std::this_thread::sleep_until(start + std::chrono::nanoseconds(offsets[i]));
+    const Request& request = requests[i % requests.size()];
+    Parcel data;
+    Parcel reply;
+    status_t status = data.setData(reinterpret_cast<const uint8_t*>(request.data.data()),
+                                   request.data.size());
+    const auto sent = std::chrono::steady_clock::now();
+    if (status == OK) {
+      status = binder->transact(request.code, data, &reply,
+                                request.oneway ? IBinder::FLAG_ONEWAY : 0);
+    }
+    const auto latency = std::chrono::steady_clock::now() - sent;
+    stats.Add(request.method_name,
+              std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count(),
+              status == OK);
+  }
+  return stats;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  string service;
+  double rate = 1;
+  unsigned threads = 1;
+  unsigned repeat = 1;
+  const struct option options[] = {
+      {"service", required_argument, nullptr, 's'},
+      {"rate", required_argument, nullptr, 'r'},
+      {"threads", required_argument, nullptr, 't'},
+      {"repeat", required_argument, nullptr, 'n'},
+      {nullptr, 0, nullptr, 0},
+  };
+  int c;
+  while ((c = getopt_long(argc, argv, "", options, nullptr)) != -1) {
+    bool ok = true;
+    switch (c) {
+      case 's':
+        service = optarg;
+        break;
+      case 'r':
+        ok = android::base::ParseDouble(optarg, &rate, 0.0);
+        break;
+      case 't':
+        ok = android::base::ParseUint(optarg, &threads, 1024u) && threads > 0;
+        break;
+      case 'n':
+        ok = android::base::ParseUint(optarg, &repeat) && repeat > 0;
+        break;
+      default:
+        ok = false;
+        break;
+    }
+    if (!ok) {
+      Usage(argv[0]);
+      return 1;
+    }
+  }
+  if (service.empty() || optind + 1 != argc) {
+    Usage(argv[0]);
+    return 1;
+  }
+
+  string dump;
+  vector<Request> captured;
+  if (!android::base::ReadFileToString(argv[optind], &dump) ||
+      !android::aidl::capture::Decode(dump, &captured)) {
+    cerr << argv[optind] << ": not a capture of requests" << endl;
+    return 1;
+  }
+
+  android::ProcessState::self()->startThreadPool();
+  const sp<IBinder> binder =
+      android::defaultServiceManager()->checkService(String16(service.c_str()));
+  if (binder == nullptr) {
+    cerr << service << ": no such service" << endl;
+    return 1;
+  }
+  const string descriptor = String8(binder->getInterfaceDescriptor()).c_str();
+
+  vector<Request> requests;
+  for (Request& request : captured) {
+    if (request.interface_name == descriptor) requests.push_back(std::move(request));
+  }
+  if (requests.empty()) {
+    cerr << argv[optind] << ": no requests of " << descriptor << endl;
+    return 1;
+  }
+  // A repeat starts as the previous one ends
+  const vector<int64_t> round_offsets = ScheduleOffsets(requests, rate);
+  vector<int64_t> offsets;
+  for (unsigned i = 0; i < repeat; i++) {
+    const int64_t base = offsets.empty() ? 0 : offsets.back();
+    for (int64_t offset : round_offsets) offsets.push_back(base + offset);
+  }
+
+  // The threads take the requests in turn, so that their order is kept
+  // across threads as long as the service keeps up
+  vector<vector<size_t>> indices(threads);
+  for (size_t i = 0; i < offsets.size(); i++) {
+    indices[i % threads].push_back(i);
+  }
+  vector<LatencyStats> stats(threads);
+  vector<std::thread> workers;
+  const auto start = std::chrono::steady_clock::now();
+  for (unsigned t = 0; t < threads; t++) {
+    workers.emplace_back(
+        [&, t] { stats[t] = Replay(binder, requests, offsets, indices[t], start); });
+  }
+  for (std::thread& worker : workers) worker.join();
+
+  LatencyStats total;
+  for (const LatencyStats& s : stats) total.Merge(s);
+  std::cout << total.Report();
+  return 0;
+}
@@ -0,0 +1,221 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+// The binary transaction log of the code generated with --log=binary. Each
+// transaction of a proxy or a stub appends a fixed-size record to a ring
+// buffer of the process, without a lock and without allocating. While the
+// log is disabled, a transaction costs a load and a branch.
+//
+// Dump() serializes the records, which aidl_log_decoder turns back into the
+// JSON objects of --log on a host:
+//
+//   ::android::aidl::binary_log::SetEnabled(true);
+//   ...
+//   WriteStringToFd(::android::aidl::binary_log::Dump(), fd);
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace android {
+namespace aidl {
+namespace binary_log {
+
+enum class Side : uint8_t { PROXY = 0, STUB = 1 };
+
+// A transaction as the generated code logs it. The names point to string
+// literals, which outlive the record.
+struct Transaction {
+  const char* interface_name;
+  const char* method_name;
+  const void* address;  // of the proxy or the stub
+  uint32_t method_id;
+  Side side;
+  int64_t start_ns;  // of the steady clock
+  int64_t end_ns;
+  int32_t exception_code;
+  int32_t transaction_error;
+  int32_t service_specific_error;
+  uint32_t input_size;   // bytes of the request, or 0 if unknown
+  uint32_t output_size;  // bytes of the reply, or 0 if unknown
+};
+
+// The latest kCapacity transactions. Writers claim a slot with a ticket and
+// mark it with a sequence number that is odd while they write it, so readers
+// skip the slots that are being written or that were reused meanwhile. It
+// needs static storage or value initialization, since its slots are only
+// zero-initialized.
+class RingBuffer {
+ public:
+  static constexpr size_t kCapacity = 4096;
+
+  void Append(const Transaction& t) {
+    const uint64_t ticket = next_.fetch_add(1, std::memory_order_relaxed);
+    Slot& slot = slots_[ticket % kCapacity];
+    slot.sequence.store(2 * ticket + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    uint64_t words[kWords];
+    Pack(t, words);
+    for (size_t i = 0; i < kWords; i++) {
+      slot.words[i].store(words[i], std::memory_order_relaxed);
+    }
+    slot.sequence.store(2 * ticket + 2, std::memory_order_release);
+  }
+
+  // The transactions that are completely written, oldest first.
+  std::vector<Transaction> Snapshot() const {
+    std::vector<Transaction> transactions;
+    const uint64_t end = next_.load(std::memory_order_acquire);
+    for (uint64_t ticket = end > kCapacity ? end - kCapacity : 0; ticket < end; ticket++) {
+      const Slot& slot = slots_[ticket % kCapacity];
+      if (slot.sequence.load(std::memory_order_acquire) != 2 * ticket + 2) continue;
+      uint64_t words[kWords];
+      for (size_t i = 0; i < kWords; i++) {
+        words[i] = slot.words[i].load(std::memory_order_relaxed);
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (slot.sequence.load(std::memory_order_relaxed) != 2 * ticket + 2) continue;
+      transactions.push_back(Unpack(words));
+    }
+    return transactions;
+  }
+
+ private:
+  static constexpr size_t kWords = 9;
+
+  // Trivially constructible, so that the buffer of the process stays in
+  // .bss until the log is used.
+  struct Slot {
+    std::atomic<uint64_t> sequence;
+    std::atomic<uint64_t> words[kWords];
+  };
+
+  static uint64_t Pair(uint32_t low, uint32_t high) {
+    return low | static_cast<uint64_t>(high) << 32;
+  }
+
+  static void Pack(const Transaction& t, uint64_t* words) {
+    words[0] = reinterpret_cast<uintptr_t>(t.interface_name);
+    words[1] = reinterpret_cast<uintptr_t>(t.method_name);
+    words[2] = reinterpret_cast<uintptr_t>(t.address);
+    words[3] = static_cast<uint64_t>(t.start_ns);
+    words[4] = static_cast<uint64_t>(t.end_ns);
+    words[5] = Pair(t.method_id, static_cast<uint32_t>(t.side));
+    words[6] = Pair(static_cast<uint32_t>(t.exception_code),
+                    static_cast<uint32_t>(t.transaction_error));
+    words[7] = Pair(static_cast<uint32_t>(t.service_specific_error), t.input_size);
+    words[8] = t.output_size;
+  }
+
+  static Transaction Unpack(const uint64_t* words) {
+    Transaction t;
+    t.interface_name = reinterpret_cast<const char*>(static_cast<uintptr_t>(words[0]));
+    t.method_name = reinterpret_cast<const char*>(static_cast<uintptr_t>(words[1]));
+    t.address = reinterpret_cast<const void*>(static_cast<uintptr_t>(words[2]));
+    t.start_ns = static_cast<int64_t>(words[3]);
+    t.end_ns = static_cast<int64_t>(words[4]);
+    t.method_id = static_cast<uint32_t>(words[5]);
+    t.side = static_cast<Side>(words[5] >> 32);
+    t.exception_code = static_cast<int32_t>(words[6]);
+    t.transaction_error = static_cast<int32_t>(words[6] >> 32);
+    t.service_specific_error = static_cast<int32_t>(words[7]);
+    t.input_size = static_cast<uint32_t>(words[7] >> 32);
+    t.output_size = static_cast<uint32_t>(words[8]);
+    return t;
+  }
+
+  std::atomic<uint64_t> next_;
+  Slot slots_[kCapacity];
+};
+
+inline std::atomic<bool> gEnabled{false};
+
+inline bool Enabled() {
+  return gEnabled.load(std::memory_order_relaxed);
+}
+
+inline void SetEnabled(bool enabled) {
+  gEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+// The ring buffer of the process
+inline RingBuffer& Buffer() {
+  static RingBuffer buffer;
+  return buffer;
+}
+
+inline int64_t Now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+inline void Log(const Transaction& t) {
+  Buffer().Append(t);
+}
+
+// The dump starts with kMagic, followed by the records in little endian:
+// the fields of Transaction in order, with the names as a 16-bit length and
+// their bytes and the address as 64 bits.
+constexpr char kMagic[] = "AIDLBLG1";
+constexpr size_t kMagicSize = sizeof(kMagic) - 1;
+
+inline void AppendLittleEndian(uint64_t value, size_t bytes, std::string* out) {
+  for (size_t i = 0; i < bytes; i++) {
+    out->push_back(static_cast<char>(value >> (8 * i)));
+  }
+}
+
+inline void AppendName(const char* name, std::string* out) {
+  const std::string_view view = name == nullptr ? "" : name;
+  const size_t size = view.size() < UINT16_MAX ? view.size() : UINT16_MAX;
+  AppendLittleEndian(size, 2, out);
+  out->append(view.data(), size);
+}
+
+inline std::string Encode(const std::vector<Transaction>& transactions) {
+  std::string out(kMagic, kMagicSize);
+  for (const Transaction& t : transactions) {
+    AppendName(t.interface_name, &out);
+    AppendName(t.method_name, &out);
+    AppendLittleEndian(reinterpret_cast<uintptr_t>(t.address), 8, &out);
+    AppendLittleEndian(t.method_id, 4, &out);
+    AppendLittleEndian(static_cast<uint8_t>(t.side), 1, &out);
+    AppendLittleEndian(static_cast<uint64_t>(t.start_ns), 8, &out);
+    AppendLittleEndian(static_cast<uint64_t>(t.end_ns), 8, &out);
+    AppendLittleEndian(static_cast<uint32_t>(t.exception_code), 4, &out);
+    AppendLittleEndian(static_cast<uint32_t>(t.transaction_error), 4, &out);
+    AppendLittleEndian(static_cast<uint32_t>(t.service_specific_error), 4, &out);
+    AppendLittleEndian(t.input_size, 4, &out);
+    AppendLittleEndian(t.output_size, 4, &out);
+  }
+  return out;
+}
+
+// The transactions in the ring buffer of the process, serialized
+inline std::string Dump() {
+  return Encode(Buffer().Snapshot());
+}
+
+}  // namespace binary_log
+}  // namespace aidl
+}  // namespace android
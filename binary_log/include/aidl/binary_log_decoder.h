@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+// Reads the dumps of aidl/binary_log.h back, e.g. on a host.
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "aidl/binary_log.h"
+
+namespace android {
+namespace aidl {
+namespace binary_log {
+
+// A transaction of a dump
+struct Record {
+  std::string interface_name;
+  std::string method_name;
+  uint64_t address;
+  uint32_t method_id;
+  Side side;
+  int64_t start_ns;
+  int64_t end_ns;
+  int32_t exception_code;
+  int32_t transaction_error;
+  int32_t service_specific_error;
+  uint32_t input_size;
+  uint32_t output_size;
+};
+
+class Reader {
+ public:
+  explicit Reader(const std::string& dump) : dump_(dump) {}
+
+  bool AtEnd() const { return pos_ == dump_.size(); }
+
+  bool Read(size_t bytes, uint64_t* value) {
+    if (dump_.size() - pos_ < bytes) return false;
+    *value = 0;
+    for (size_t i = 0; i < bytes; i++) {
+      *value |= static_cast<uint64_t>(static_cast<uint8_t>(dump_[pos_++])) << (8 * i);
+    }
+    return true;
+  }
+
+  template <typename T>
+  bool Read(size_t bytes, T* value) {
+    uint64_t v;
+    if (!Read(bytes, &v)) return false;
+    *value = static_cast<T>(v);
+    return true;
+  }
+
+  bool ReadName(std::string* name) {
+    uint64_t size;
+    if (!Read(2, &size) || dump_.size() - pos_ < size) return false;
+    name->assign(dump_, pos_, size);
+    pos_ += size;
+    return true;
+  }
+
+ private:
+  const std::string& dump_;
+  size_t pos_ = 0;
+};
+
+// The records of |dump|, or false if it is not a whole dump.
+inline bool Decode(const std::string& dump, std::vector<Record>* records) {
+  if (dump.compare(0, kMagicSize, kMagic) != 0) return false;
+  Reader reader(dump);
+  uint64_t magic;
+  reader.Read(kMagicSize, &magic);
+  while (!reader.AtEnd()) {
+    Record r;
+    const bool ok = reader.ReadName(&r.interface_name) && reader.ReadName(&r.method_name) &&
+                    reader.Read(8, &r.address) && reader.Read(4, &r.method_id) &&
+                    reader.Read(1, &r.side) && reader.Read(8, &r.start_ns) &&
+                    reader.Read(8, &r.end_ns) && reader.Read(4, &r.exception_code) &&
+                    reader.Read(4, &r.transaction_error) &&
+                    reader.Read(4, &r.service_specific_error) && reader.Read(4, &r.input_size) &&
+                    reader.Read(4, &r.output_size);
+    if (!ok) return false;
+    records->push_back(std::move(r));
+  }
+  return true;
+}
+
+inline std::string JsonString(const std::string& s) {
+  std::string json = "\"";
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      json += '\\';
+      json += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char escaped[8];
+      snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+      json += escaped;
+    } else {
+      json += c;
+    }
+  }
+  return json + "\"";
+}
+
+// |r| in the shape of the JSON objects of --log, without the values of the
+// arguments and the exception message, which the binary log leaves out. Its
+// sizes and method ID are added:
+//
+// {"duration_ms": 0.042, "interface_name": "foo.bar.IFoo", "method_name": "TestMethod",
+//  "method_id": 3, "proxy_address": "0x12345678", "input_size": 84, "output_size": 12,
+//  "binder_status": {"exception_code": 0, "transaction_error": 0,
+//                    "service_specific_error_code": 0}}
+inline std::string ToJson(const Record& r) {
+  char address[32];
+  snprintf(address, sizeof(address), "0x%llx", static_cast<unsigned long long>(r.address));
+  char duration[32];
+  snprintf(duration, sizeof(duration), "%.6f", (r.end_ns - r.start_ns) / 1e6);
+  std::string json = "{\"duration_ms\": " + std::string(duration);
+  json += ", \"interface_name\": " + JsonString(r.interface_name);
+  json += ", \"method_name\": " + JsonString(r.method_name);
+  json += ", \"method_id\": " + std::to_string(r.method_id);
+  json += r.side == Side::STUB ? ", \"stub_address\": " : ", \"proxy_address\": ";
+  json += JsonString(address);
+  json += ", \"input_size\": " + std::to_string(r.input_size);
+  json += ", \"output_size\": " + std::to_string(r.output_size);
+  json += ", \"binder_status\": {\"exception_code\": " + std::to_string(r.exception_code);
+  json += ", \"transaction_error\": " + std::to_string(r.transaction_error);
+  json += ", \"service_specific_error_code\": " + std::to_string(r.service_specific_error);
+  return json + "}}";
+}
+
+}  // namespace binary_log
+}  // namespace aidl
+}  // namespace android
@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+// The schedule and the statistics of aidl_replay, which sends the requests of
+// a capture (see aidl/transaction_capture.h) to a service again.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "aidl/transaction_capture.h"
+
+namespace android {
+namespace aidl {
+namespace capture {
+
+// When to send each of |requests|, in nanoseconds after the first one: the
+// gaps of the capture divided by |rate|, so that 2 replays twice as fast. A
+// rate of 0 sends the requests as fast as possible.
+inline std::vector<int64_t> ScheduleOffsets(const std::vector<Request>& requests, double rate) {
+  std::vector<int64_t> offsets(requests.size(), 0);
+  if (rate <= 0 || requests.empty()) return offsets;
+  const int64_t first = requests.front().time_ns;
+  for (size_t i = 0; i < requests.size(); i++) {
+    // The clock of the capture only moves forward, but a dump can be edited
+    const int64_t gap = std::max<int64_t>(requests[i].time_ns - first, 0);
+    offsets[i] = static_cast<int64_t>(static_cast<double>(gap) / rate);
+  }
+  return offsets;
+}
+
+// The latencies of the replayed requests, by method
+class LatencyStats {
+ public:
+  void Add(const std::string& method_name, int64_t latency_ns, bool ok) {
+    Method& m = methods_[method_name];
+    m.latencies_ns.push_back(latency_ns);
+    if (!ok) m.errors++;
+    sorted_ = false;
+  }
+
+  void Merge(const LatencyStats& other) {
+    for (const auto& [name, theirs] : other.methods_) {
+      Method& m = methods_[name];
+      m.latencies_ns.insert(m.latencies_ns.end(), theirs.latencies_ns.begin(),
+                            theirs.latencies_ns.end());
+      m.errors += theirs.errors;
+    }
+    sorted_ = false;
+  }
+
+  size_t Count(const std::string& method_name) const {
+    auto it = methods_.find(method_name);
+    return it == methods_.end() ? 0 : it->second.latencies_ns.size();
+  }
+
+  size_t Errors(const std::string& method_name) const {
+    auto it = methods_.find(method_name);
+    return it == methods_.end() ? 0 : it->second.errors;
+  }
+
+  // The latency that |percent| percent of the requests of the method do not
+  // exceed (the nearest rank), or 0 if it has none
+  int64_t Percentile(const std::string& method_name, double percent) {
+    auto it = methods_.find(method_name);
+    if (it == methods_.end() || it->second.latencies_ns.empty()) return 0;
+    Sort();
+    const std::vector<int64_t>& latencies = it->second.latencies_ns;
+    const double rank = std::ceil(percent / 100 * static_cast<double>(latencies.size()));
+    const size_t index = rank < 1 ? 0 : static_cast<size_t>(rank) - 1;
+    return latencies[std::min(index, latencies.size() - 1)];
+  }
+
+  // A line per method, in microseconds
+  std::string Report() {
+    std::ostringstream out;
+    out << "method count errors p50_us p90_us p99_us max_us\n";
+    for (const auto& entry : methods_) {
+      const std::string& name = entry.first;
+      out << name << " " << Count(name) << " " << Errors(name);
+      for (double percent : {50.0, 90.0, 99.0, 100.0}) {
+        out << " " << Percentile(name, percent) / 1000;
+      }
+      out << "\n";
+    }
+    return out.str();
+  }
+
+ private:
+  struct Method {
+    std::vector<int64_t> latencies_ns;
+    size_t errors = 0;
+  };
+
+  void Sort() {
+    if (sorted_) return;
+    for (auto& entry : methods_) {
+      std::sort(entry.second.latencies_ns.begin(), entry.second.latencies_ns.end());
+    }
+    sorted_ = true;
+  }
+
+  std::map<std::string, Method> methods_;
+  bool sorted_ = true;
+};
+
+}  // namespace capture
+}  // namespace aidl
+}  // namespace android
@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+// The requests that the stubs generated with --log=binary receive, captured
+// with their parcels so that aidl_replay can send them to a service again.
+// While the capture is disabled, a transaction costs a load and a branch.
+//
+//   ::android::aidl::capture::SetEnabled(true);
+//   ...
+//   WriteStringToFd(::android::aidl::capture::Dump(), fd);
+//
+// A parcel is only captured when it holds plain data: binders and file
+// descriptors cannot be sent again from another process. The parcels are
+// in the wire format that the C++, NDK and Java backends share, so the
+// requests can be replayed against a service of any of them.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "aidl/binary_log.h"
+
+namespace android {
+namespace aidl {
+namespace capture {
+
+// A request as a stub received it
+struct Request {
+  std::string interface_name;
+  std::string method_name;
+  uint32_t code;
+  bool oneway;
+  int64_t time_ns;   // of the steady clock, when the stub received it
+  std::string data;  // the bytes of the parcel, from its interface token on
+};
+
+// The captured requests, up to kMaxBytes of parcels; later requests are
+// dropped and counted until the requests are taken.
+class Recorder {
+ public:
+  static constexpr size_t kMaxBytes = 16 << 20;
+
+  void Add(Request request) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (bytes_ + request.data.size() > kMaxBytes) {
+      dropped_++;
+      return;
+    }
+    bytes_ += request.data.size();
+    requests_.push_back(std::move(request));
+  }
+
+  // The requests so far, oldest first, which are no longer kept
+  std::vector<Request> Take() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    bytes_ = 0;
+    dropped_ = 0;
+    return std::exchange(requests_, {});
+  }
+
+  size_t Dropped() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return dropped_;
+  }
+
+ private:
+  mutable std::mutex mutex_;
+  std::vector<Request> requests_;
+  size_t bytes_ = 0;
+  size_t dropped_ = 0;
+};
+
+inline std::atomic<bool> gEnabled{false};
+
+inline bool Enabled() {
+  return gEnabled.load(std::memory_order_relaxed);
+}
+
+inline void SetEnabled(bool enabled) {
+  gEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+// The requests of the process
+inline Recorder& Requests() {
+  static Recorder recorder;
+  return recorder;
+}
+
+inline void Capture(const char* interface_name, const char* method_name, uint32_t code,
+                    bool oneway, const void* data, size_t size) {
+  Requests().Add(Request{interface_name, method_name, code, oneway, binary_log::Now(),
+                         std::string(static_cast<const char*>(data), size)});
+}
+
+// The dump starts with kMagic, followed by the requests in little endian:
+// the names as in aidl/binary_log.h, the code, the oneway flag as a byte, the
+// time, and the parcel as a 32-bit size and its bytes.
+constexpr char kMagic[] = "AIDLCAP1";
+constexpr size_t kMagicSize = sizeof(kMagic) - 1;
+
+inline std::string Encode(const std::vector<Request>& requests) {
+  std::string out(kMagic, kMagicSize);
+  for (const Request& r : requests) {
+    binary_log::AppendName(r.interface_name.c_str(), &out);
+    binary_log::AppendName(r.method_name.c_str(), &out);
+    binary_log::AppendLittleEndian(r.code, 4, &out);
+    binary_log::AppendLittleEndian(r.oneway ? 1 : 0, 1, &out);
+    binary_log::AppendLittleEndian(static_cast<uint64_t>(r.time_ns), 8, &out);
+    binary_log::AppendLittleEndian(r.data.size(), 4, &out);
+    out += r.data;
+  }
+  return out;
+}
+
+// Takes the captured requests of the process into a dump
+inline std::string Dump() {
+  return Encode(Requests().Take());
+}
+
+// The requests of |dump|, or false if it is not a whole dump.
+inline bool Decode(const std::string& dump, std::vector<Request>* requests) {
+  if (dump.compare(0, kMagicSize, kMagic) != 0) return false;
+  size_t pos = kMagicSize;
+  auto read = [&](size_t bytes, uint64_t* value) {
+    if (dump.size() - pos < bytes) return false;
+    *value = 0;
+    for (size_t i = 0; i < bytes; i++) {
+      *value |= static_cast<uint64_t>(static_cast<uint8_t>(dump[pos++])) << (8 * i);
+    }
+    return true;
+  };
+  auto read_bytes = [&](size_t size_bytes, std::string* bytes) {
+    uint64_t size;
+    if (!read(size_bytes, &size) || dump.size() - pos < size) return false;
+    bytes->assign(dump, pos, size);
+    pos += size;
+    return true;
+  };
+  while (pos < dump.size()) {
+    Request r;
+    uint64_t code, oneway, time_ns;
+    const bool ok = read_bytes(2, &r.interface_name) && read_bytes(2, &r.method_name) &&
+                    read(4, &code) && read(1, &oneway) && read(8, &time_ns) &&
+                    read_bytes(4, &r.data);
+    if (!ok) return false;
+    r.code = static_cast<uint32_t>(code);
+    r.oneway = oneway != 0;
+    r.time_ns = static_cast<int64_t>(time_ns);
+    requests->push_back(std::move(r));
+  }
+  return true;
+}
+
+}  // namespace capture
+}  // namespace aidl
+}  // namespace android
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+// The capture of the requests of the NDK backend (see
+// aidl/transaction_capture.h). The NDK can only copy the bytes of a parcel
+// from API level 33 on; below it, nothing is captured.
+
+#include <stdint.h>
+
+#include <string>
+
+#include <android/binder_parcel.h>
+
+#include "aidl/transaction_capture.h"
+
+namespace android {
+namespace aidl {
+namespace capture {
+
+inline void CaptureParcel(const char* interface_name, const char* method_name, uint32_t code,
+                          bool oneway, const AParcel* parcel) {
+#if !defined(__ANDROID_API__) || __ANDROID_API__ >= 33
+  const int32_t size = AParcel_getDataSize(parcel);
+  if (size < 0) return;
+  std::string data(static_cast<size_t>(size), '\0');
+  // Fails for the parcels with binders or file descriptors, which are skipped
+  if (AParcel_marshal(parcel, reinterpret_cast<uint8_t*>(data.data()), 0, data.size()) !=
+      STATUS_OK) {
+    return;
+  }
+  Requests().Add(Request{interface_name, method_name, code, oneway, binary_log::Now(),
+                         std::move(data)});
+#else
+  (void)interface_name;
+  (void)method_name;
+  (void)code;
+  (void)oneway;
+  (void)parcel;
+#endif
+}
+
+}  // namespace capture
+}  // namespace aidl
+}  // namespace android
@@ -44,42 +44,76 @@ const (
 	langNdkPlatform           = "ndk_platform"
 
 	currentVersion = "current"
+
+	logFormatJson   = "json"
+	logFormatBinary = "binary"
+
+	traceFormatAtrace   = "atrace"
+	traceFormatPerfetto = "perfetto"
 )
 
 var (
 	pctx = android.NewPackageContext("android/aidl")
 
+	// The directory is cleaned when the list of sources changes, which changes the command, and
+	// not when one of them is edited: the generation rules leave the outputs that don't change
+	// alone, and restat them, so that ninja doesn't rebuild what depends on those.
 	aidlDirPrepareRule = pctx.StaticRule("aidlDirPrepareRule", blueprint.RuleParams{
 		Command: `rm -rf "${outDir}" && mkdir -p "${outDir}" && ` +
-			`touch ${out} # ${in}`,
+			`touch ${out} # ${srcs}`,
 		Description: "create ${out}",
-	}, "outDir")
+	}, "outDir", "srcs")
 
 	aidlCppRule = pctx.StaticRule("aidlCppRule", blueprint.RuleParams{
 		Command: `mkdir -p "${headerDir}" && ` +
-			`${aidlCmd} --lang=${lang} ${optionalFlags} --structured --ninja -d ${out}.d ` +
-			`-h ${headerDir} -o ${outDir} ${imports} ${in}`,
+			`${aidlCmd} --lang=${lang} ${optionalFlags} --structured --ninja --write-if-changed ` +
+			`-d ${out}.d -h ${headerDir} -o ${outDir} ${imports} ${in}`,
 		Depfile:     "${out}.d",
 		Deps:        blueprint.DepsGCC,
 		CommandDeps: []string{"${aidlCmd}"},
+		Restat:      true,
 		Description: "AIDL ${lang} ${in}",
 	}, "imports", "lang", "headerDir", "outDir", "optionalFlags")
 
 	aidlJavaRule = pctx.StaticRule("aidlJavaRule", blueprint.RuleParams{
-		Command: `${aidlCmd} --lang=java ${optionalFlags} --structured --ninja -d ${out}.d ` +
-			`-o ${outDir} ${imports} ${in}`,
+		Command: `${aidlCmd} --lang=java ${optionalFlags} --structured --ninja --write-if-changed ` +
+			`-d ${out}.d -o ${outDir} ${imports} ${in}`,
 		Depfile:     "${out}.d",
 		Deps:        blueprint.DepsGCC,
 		CommandDeps: []string{"${aidlCmd}"},
+		Restat:      true,
 		Description: "AIDL Java ${in}",
 	}, "imports", "outDir", "optionalFlags")
 
+	// The batch rules compile all sources of a module version in one aidl invocation.
+	aidlCppBatchRule = pctx.StaticRule("aidlCppBatchRule", blueprint.RuleParams{
+		Command: `mkdir -p "${headerDir}" && ` +
+			`${aidlCmd} --lang=${lang} ${optionalFlags} --structured --ninja --write-if-changed ` +
+			`-d ${depFile} -h ${headerDir} -o ${outDir} ${imports} ${in}`,
+		Depfile:     "${depFile}",
+		Deps:        blueprint.DepsGCC,
+		CommandDeps: []string{"${aidlCmd}"},
+		Restat:      true,
+		Description: "AIDL ${lang} ${in}",
+	}, "imports", "lang", "headerDir", "outDir", "depFile", "optionalFlags")
+
+	aidlJavaBatchRule = pctx.StaticRule("aidlJavaBatchRule", blueprint.RuleParams{
+		Command: `${aidlCmd} --lang=java ${optionalFlags} --structured --ninja --write-if-changed ` +
+			`-d ${depFile} -o ${outDir} ${imports} ${in}`,
+		Depfile:     "${depFile}",
+		Deps:        blueprint.DepsGCC,
+		CommandDeps: []string{"${aidlCmd}"},
+		Restat:      true,
+		Description: "AIDL Java ${in}",
+	}, "imports", "outDir", "depFile", "optionalFlags")
+
+	// The dump is updated in place, as long as its manifest tells which files it has.
 	aidlDumpApiRule = pctx.StaticRule("aidlDumpApiRule", blueprint.RuleParams{
-		Command: `rm -rf "${outDir}" && mkdir -p "${outDir}" && ` +
-			`${aidlCmd} --dumpapi --structured ${imports} ${optionalFlags} --out ${outDir} ${in} && ` +
-			`(cd ${outDir} && find ./ -name "*.aidl" -print0 | LC_ALL=C sort -z | xargs -0 sha1sum && echo ${latestVersion}) | sha1sum | cut -d " " -f 1 > ${hashFile} `,
+		Command: `(test -f "${manifest}" || rm -rf "${outDir}") && mkdir -p "${outDir}" && ` +
+			`${aidlCmd} --dumpapi --structured ${imports} ${optionalFlags} --hashapi=${latestVersion} ` +
+			`--api-manifest=${manifest} --out ${outDir} ${in}`,
 		CommandDeps: []string{"${aidlCmd}"},
-	}, "optionalFlags", "imports", "outDir", "hashFile", "latestVersion")
+	}, "optionalFlags", "imports", "outDir", "latestVersion", "manifest")
 
 	aidlMetadataRule = pctx.StaticRule("aidlMetadataRule", blueprint.RuleParams{
 		Command: `rm -f ${out} && { ` +
@@ -101,11 +135,11 @@ var (
 	}, "imports", "outDir")
 
 	aidlCheckApiRule = pctx.StaticRule("aidlCheckApiRule", blueprint.RuleParams{
-		Command: `(${aidlCmd} ${optionalFlags} --checkapi ${old} ${new} && touch ${out}) || ` +
+		Command: `(${aidlCmd} ${optionalFlags} --checkapi ${dumps} && touch ${out}) || ` +
 			`(cat ${messageFile} && exit 1)`,
 		CommandDeps: []string{"${aidlCmd}"},
-		Description: "AIDL CHECK API: ${new} against ${old}",
-	}, "optionalFlags", "old", "new", "messageFile")
+		Description: "AIDL CHECK API: ${dumps}",
+	}, "optionalFlags", "dumps", "messageFile")
 
 	aidlDiffApiRule = pctx.StaticRule("aidlDiffApiRule", blueprint.RuleParams{
 		Command: `if diff -r -B -I '//.*' -x '${hashFile}' '${old}' '${new}'; then touch '${out}'; else ` +
@@ -114,10 +148,11 @@ var (
 	}, "old", "new", "hashFile", "messageFile")
 
 	aidlVerifyHashRule = pctx.StaticRule("aidlVerifyHashRule", blueprint.RuleParams{
-		Command: `if [ $$(cd '${apiDir}' && { find ./ -name "*.aidl" -print0 | LC_ALL=C sort -z | xargs -0 sha1sum && echo ${version}; } | sha1sum | cut -d " " -f 1) = $$(read -r <'${hashFile}' hash extra; printf %s $$hash) ]; then ` +
+		Command: `if ${aidlCmd} --hashapi=${version} --api-manifest=${manifest} '${apiDir}'; then ` +
 			`touch ${out}; else cat '${messageFile}' && exit 1; fi`,
+		CommandDeps: []string{"${aidlCmd}"},
 		Description: "Verify ${apiDir} files have not been modified",
-	}, "apiDir", "version", "messageFile", "hashFile")
+	}, "apiDir", "version", "manifest", "messageFile")
 
 	joinJsonObjectsToArrayRule = pctx.StaticRule("joinJsonObjectsToArrayRule", blueprint.RuleParams{
 		Rspfile:        "$out.rsp",
@@ -219,9 +254,34 @@ type aidlGenProperties struct {
 	Lang      string // target language [java|cpp|ndk]
 	BaseName  string
 	GenLog    bool
+	LogFormat string
 	Version   string
 	GenTrace  bool
-	Unstable  *bool
+	// "atrace" or "perfetto", the track events of gen_trace in the C++ backends
+	TraceFormat string
+	GenStats    bool
+	GenSizes    bool
+	// Whether the types embed their wire schemas, see aidl/wire_schema.h
+	GenWireSchema bool
+	GenAsync      bool
+	GenLazy       bool
+	// Whether the C++ backends marshal with the programs of aidl/marshal.h
+	MarshalTables bool
+	// The API dumps of the frozen versions, which share the code of the types they all have the
+	// same, and whether that code is the one generated rather than all the rest
+	DedupDirs   []string
+	DedupShared bool
+	// Whether the C++ backend holds @nullable types in std::optional
+	NullableAsOptional bool
+	// Whether the C++ backend writes the _fwd.h headers
+	FwdHeaders bool
+	// The number of aidl_unity_<i>.cpp sources of a batch of C++ srcs
+	UnitySources int
+	// Whether the Java backend calls the helpers of Parcel
+	Compact bool
+	// Whether the Java parcelables and stubs reuse the objects that they read
+	Reuse    bool
+	Unstable *bool
 }
 
 type aidlGenRule struct {
@@ -274,19 +334,38 @@ func (g *aidlGenRule) GenerateAndroidBuildActions(ctx android.ModuleContext) {
 
 	g.genOutDir = android.PathForModuleGen(ctx)
 	g.genHeaderDir = android.PathForModuleGen(ctx, "include")
+	// All sources of a version are compiled by one aidl action. Sources that don't share a base
+	// directory, and so may not share a version hash, are compiled one by one.
+	aidlRoot := android.PathForModuleSrc(ctx, g.properties.AidlRoot)
+	baseDir := ""
 	for _, src := range srcs {
-		outFile, headers := g.generateBuildActionsForSingleAidl(ctx, src)
-		g.genOutputs = append(g.genOutputs, outFile)
+		srcBaseDir := getBaseDir(ctx, src, aidlRoot)
+		if baseDir == "" {
+			baseDir = srcBaseDir
+		} else if baseDir != srcBaseDir {
+			baseDir = ""
+			break
+		}
+	}
+	if len(srcs) > 1 && baseDir != "" {
+		outFiles, headers := g.generateBuildActionsForAidlBatch(ctx, srcs, baseDir)
+		g.genOutputs = append(g.genOutputs, outFiles...)
 		g.genHeaderDeps = append(g.genHeaderDeps, headers...)
+	} else {
+		for _, src := range srcs {
+			outFile, headers := g.generateBuildActionsForSingleAidl(ctx, src)
+			g.genOutputs = append(g.genOutputs, outFile)
+			g.genHeaderDeps = append(g.genHeaderDeps, headers...)
+		}
 	}
 
 	// This is to clean genOutDir before generating any file
 	ctx.ModuleBuild(pctx, android.ModuleBuildParams{
 		Rule:   aidlDirPrepareRule,
-		Inputs: srcs,
 		Output: genDirTimestamp,
 		Args: map[string]string{
 			"outDir": g.genOutDir.String(),
+			"srcs":   strings.Join(srcs.Strings(), " "),
 		},
 	})
 }
@@ -307,17 +386,9 @@ func getBaseDir(ctx android.ModuleContext, src android.Path, aidlRoot android.Pa
 	return baseDir
 }
 
-func (g *aidlGenRule) generateBuildActionsForSingleAidl(ctx android.ModuleContext, src android.Path) (android.WritablePath, android.Paths) {
-	baseDir := getBaseDir(ctx, src, android.PathForModuleSrc(ctx, g.properties.AidlRoot))
-
-	var ext string
-	if g.properties.Lang == langJava {
-		ext = "java"
-	} else {
-		ext = "cpp"
-	}
-	relPath, _ := filepath.Rel(baseDir, src.String())
-	outFile := android.PathForModuleGen(ctx, pathtools.ReplaceExtension(relPath, ext))
+// aidlFlags returns the flags and the implicit inputs of the aidl actions for the sources in
+// baseDir.
+func (g *aidlGenRule) aidlFlags(ctx android.ModuleContext, baseDir string) ([]string, android.Paths) {
 	implicits := g.implicitInputs
 
 	var optionalFlags []string
@@ -336,27 +407,77 @@ func (g *aidlGenRule) generateBuildActionsForSingleAidl(ctx android.ModuleContex
 		}
 		optionalFlags = append(optionalFlags, "--hash "+hash)
 	}
-	if g.properties.GenTrace {
+	if g.properties.GenTrace && g.properties.Lang != langJava && g.properties.Lang != langNdk &&
+		g.properties.TraceFormat == traceFormatPerfetto {
+		optionalFlags = append(optionalFlags, "--trace=perfetto")
+	} else if g.properties.GenTrace {
 		optionalFlags = append(optionalFlags, "-t")
 	}
+	if g.properties.GenStats && g.properties.GenSizes {
+		optionalFlags = append(optionalFlags, "--gen-stats=sizes")
+	} else if g.properties.GenStats {
+		optionalFlags = append(optionalFlags, "--gen-stats")
+	}
+	if g.properties.GenWireSchema {
+		optionalFlags = append(optionalFlags, "--gen-wire-schema")
+	}
 	if g.properties.Stability != nil {
 		optionalFlags = append(optionalFlags, "--stability", *g.properties.Stability)
 	}
+	if g.properties.Lang != langJava && g.properties.GenAsync {
+		optionalFlags = append(optionalFlags, "--gen-async")
+	}
+	if g.properties.GenLazy {
+		optionalFlags = append(optionalFlags, "--gen-lazy-proxy")
+	}
+	if g.properties.Lang != langJava && g.properties.MarshalTables {
+		optionalFlags = append(optionalFlags, "--marshal=tables")
+	}
+	if g.properties.Lang != langJava && len(g.properties.DedupDirs) > 0 {
+		for _, dir := range g.properties.DedupDirs {
+			dumpDir := android.PathForModuleSrc(ctx, dir)
+			optionalFlags = append(optionalFlags, "--dedup-with="+dumpDir.String())
+			implicits = append(implicits, ctx.Glob(filepath.Join(dumpDir.String(), "**/*.aidl"), nil)...)
+		}
+		if g.properties.DedupShared {
+			optionalFlags = append(optionalFlags, "--dedup-shared")
+		}
+	}
+	if g.properties.Lang == langCpp && g.properties.NullableAsOptional {
+		optionalFlags = append(optionalFlags, "--nullable=optional")
+	}
+	if g.properties.Lang == langCpp && g.properties.FwdHeaders {
+		optionalFlags = append(optionalFlags, "--fwd-headers")
+	}
+	if g.properties.Lang == langJava && g.properties.Compact {
+		optionalFlags = append(optionalFlags, "--java-compact")
+	}
+	if g.properties.Lang == langJava && g.properties.Reuse {
+		optionalFlags = append(optionalFlags, "--java-reuse")
+	}
+	if g.properties.Lang != langJava && g.properties.GenLog {
+		if g.properties.LogFormat == logFormatBinary {
+			optionalFlags = append(optionalFlags, "--log=binary")
+		} else {
+			optionalFlags = append(optionalFlags, "--log")
+		}
+	}
+	return optionalFlags, implicits
+}
 
-	var headers android.WritablePaths
+// aidlOutputs returns the file that aidl generates for src, and the headers for C++.
+func (g *aidlGenRule) aidlOutputs(ctx android.ModuleContext, src android.Path, baseDir string) (android.WritablePath, android.WritablePaths) {
+	var ext string
 	if g.properties.Lang == langJava {
-		ctx.ModuleBuild(pctx, android.ModuleBuildParams{
-			Rule:      aidlJavaRule,
-			Input:     src,
-			Implicits: implicits,
-			Output:    outFile,
-			Args: map[string]string{
-				"imports":       g.importFlags,
-				"outDir":        g.genOutDir.String(),
-				"optionalFlags": strings.Join(optionalFlags, " "),
-			},
-		})
+		ext = "java"
 	} else {
+		ext = "cpp"
+	}
+	relPath, _ := filepath.Rel(baseDir, src.String())
+	outFile := android.PathForModuleGen(ctx, pathtools.ReplaceExtension(relPath, ext))
+
+	var headers android.WritablePaths
+	if g.properties.Lang != langJava {
 		typeName := strings.TrimSuffix(filepath.Base(relPath), ".aidl")
 		packagePath := filepath.Dir(relPath)
 		baseName := typeName
@@ -379,16 +500,39 @@ func (g *aidlGenRule) generateBuildActionsForSingleAidl(ctx android.ModuleContex
 			"Bp"+baseName+".h"))
 		headers = append(headers, g.genHeaderDir.Join(ctx, prefix, packagePath,
 			"Bn"+baseName+".h"))
-
-		if g.properties.GenLog {
-			optionalFlags = append(optionalFlags, "--log")
+		if g.properties.Lang == langCpp && g.properties.FwdHeaders {
+			headers = append(headers, g.genHeaderDir.Join(ctx, prefix, packagePath,
+				typeName+"_fwd.h"))
 		}
+	}
+	return outFile, headers
+}
 
-		aidlLang := g.properties.Lang
-		if aidlLang == langNdkPlatform {
-			aidlLang = "ndk"
-		}
+func (g *aidlGenRule) aidlLang() string {
+	if g.properties.Lang == langNdkPlatform {
+		return "ndk"
+	}
+	return g.properties.Lang
+}
+
+func (g *aidlGenRule) generateBuildActionsForSingleAidl(ctx android.ModuleContext, src android.Path) (android.WritablePath, android.Paths) {
+	baseDir := getBaseDir(ctx, src, android.PathForModuleSrc(ctx, g.properties.AidlRoot))
+	outFile, headers := g.aidlOutputs(ctx, src, baseDir)
+	optionalFlags, implicits := g.aidlFlags(ctx, baseDir)
 
+	if g.properties.Lang == langJava {
+		ctx.ModuleBuild(pctx, android.ModuleBuildParams{
+			Rule:      aidlJavaRule,
+			Input:     src,
+			Implicits: implicits,
+			Output:    outFile,
+			Args: map[string]string{
+				"imports":       g.importFlags,
+				"outDir":        g.genOutDir.String(),
+				"optionalFlags": strings.Join(optionalFlags, " "),
+			},
+		})
+	} else {
 		ctx.ModuleBuild(pctx, android.ModuleBuildParams{
 			Rule:            aidlCppRule,
 			Input:           src,
@@ -397,7 +541,7 @@ func (g *aidlGenRule) generateBuildActionsForSingleAidl(ctx android.ModuleContex
 			ImplicitOutputs: headers,
 			Args: map[string]string{
 				"imports":       g.importFlags,
-				"lang":          aidlLang,
+				"lang":          g.aidlLang(),
 				"headerDir":     g.genHeaderDir.String(),
 				"outDir":        g.genOutDir.String(),
 				"optionalFlags": strings.Join(optionalFlags, " "),
@@ -408,6 +552,66 @@ func (g *aidlGenRule) generateBuildActionsForSingleAidl(ctx android.ModuleContex
 	return outFile, headers.Paths()
 }
 
+// generateBuildActionsForAidlBatch compiles all srcs, which are in baseDir, with a single aidl
+// action, so that the imports they share are parsed only once.
+func (g *aidlGenRule) generateBuildActionsForAidlBatch(ctx android.ModuleContext, srcs android.Paths, baseDir string) (android.WritablePaths, android.Paths) {
+	var outFiles android.WritablePaths
+	var headers android.WritablePaths
+	for _, src := range srcs {
+		outFile, srcHeaders := g.aidlOutputs(ctx, src, baseDir)
+		outFiles = append(outFiles, outFile)
+		headers = append(headers, srcHeaders...)
+	}
+	optionalFlags, implicits := g.aidlFlags(ctx, baseDir)
+	depFile := android.PathForModuleGen(ctx, "aidl.d")
+
+	// The library compiles the unity sources, which include the sources of the types
+	implicitOutputs := headers
+	if g.properties.Lang != langJava && g.properties.UnitySources > 0 {
+		optionalFlags = append(optionalFlags,
+			"--unity-sources="+strconv.Itoa(g.properties.UnitySources))
+		implicitOutputs = append(implicitOutputs, outFiles...)
+		outFiles = nil
+		for i := 0; i < g.properties.UnitySources; i++ {
+			outFiles = append(outFiles,
+				android.PathForModuleGen(ctx, "aidl_unity_"+strconv.Itoa(i)+".cpp"))
+		}
+	}
+
+	if g.properties.Lang == langJava {
+		ctx.ModuleBuild(pctx, android.ModuleBuildParams{
+			Rule:      aidlJavaBatchRule,
+			Inputs:    srcs,
+			Implicits: implicits,
+			Outputs:   outFiles,
+			Args: map[string]string{
+				"imports":       g.importFlags,
+				"outDir":        g.genOutDir.String(),
+				"depFile":       depFile.String(),
+				"optionalFlags": strings.Join(optionalFlags, " "),
+			},
+		})
+	} else {
+		ctx.ModuleBuild(pctx, android.ModuleBuildParams{
+			Rule:            aidlCppBatchRule,
+			Inputs:          srcs,
+			Implicits:       implicits,
+			Outputs:         outFiles,
+			ImplicitOutputs: implicitOutputs,
+			Args: map[string]string{
+				"imports":       g.importFlags,
+				"lang":          g.aidlLang(),
+				"headerDir":     g.genHeaderDir.String(),
+				"outDir":        g.genOutDir.String(),
+				"depFile":       depFile.String(),
+				"optionalFlags": strings.Join(optionalFlags, " "),
+			},
+		})
+	}
+
+	return outFiles, headers.Paths()
+}
+
 func (g *aidlGenRule) GeneratedSourceFiles() android.Paths {
 	return g.genOutputs.Paths()
 }
@@ -521,6 +725,8 @@ func (m *aidlApi) createApiDumpFromSource(ctx android.ModuleContext) apiDump {
 		apiFiles = append(apiFiles, outFile)
 	}
 	hashFile = android.PathForModuleOut(ctx, "dump", ".hash")
+	// Next to the dump rather than in it, so that it isn't copied when the dump is frozen
+	manifestFile := android.PathForModuleOut(ctx, "dump.manifest")
 	latestVersion := "latest-version"
 	if len(m.properties.Versions) >= 1 {
 		latestVersion = m.properties.Versions[len(m.properties.Versions)-1]
@@ -532,15 +738,16 @@ func (m *aidlApi) createApiDumpFromSource(ctx android.ModuleContext) apiDump {
 	}
 
 	ctx.ModuleBuild(pctx, android.ModuleBuildParams{
-		Rule:    aidlDumpApiRule,
-		Outputs: append(apiFiles, hashFile),
-		Inputs:  srcs,
+		Rule:           aidlDumpApiRule,
+		Outputs:        append(apiFiles, hashFile),
+		ImplicitOutput: manifestFile,
+		Inputs:         srcs,
 		Args: map[string]string{
 			"optionalFlags": strings.Join(optionalFlags, " "),
 			"imports":       strings.Join(wrap("-I", importPaths, ""), " "),
 			"outDir":        apiDir.String(),
-			"hashFile":      hashFile.String(),
 			"latestVersion": latestVersion,
+			"manifest":      manifestFile.String(),
 		},
 	})
 	return apiDump{apiDir, apiFiles.Paths(), android.OptionalPathForPath(hashFile)}
@@ -575,9 +782,10 @@ func (m *aidlApi) makeApiDumpAsVersion(ctx android.ModuleContext, dump apiDump,
 	return timestampFile
 }
 
-func (m *aidlApi) checkCompatibility(ctx android.ModuleContext, oldDump apiDump, newDump apiDump) android.WritablePath {
-	newVersion := newDump.dir.Base()
-	timestampFile := android.PathForModuleOut(ctx, "checkapi_"+newVersion+".timestamp")
+// Checks that each of the dumps is backwards compatible with the one before it, in a single
+// invocation that loads each dump once.
+func (m *aidlApi) checkCompatibility(ctx android.ModuleContext, dumps []apiDump) android.WritablePath {
+	timestampFile := android.PathForModuleOut(ctx, "checkapi_compatibility.timestamp")
 	messageFile := android.PathForSource(ctx, "system/tools/aidl/build/message_check_compatibility.txt")
 
 	var optionalFlags []string
@@ -586,8 +794,11 @@ func (m *aidlApi) checkCompatibility(ctx android.ModuleContext, oldDump apiDump,
 	}
 
 	var implicits android.Paths
-	implicits = append(implicits, oldDump.files...)
-	implicits = append(implicits, newDump.files...)
+	var dirs []string
+	for _, dump := range dumps {
+		implicits = append(implicits, dump.files...)
+		dirs = append(dirs, dump.dir.String())
+	}
 	implicits = append(implicits, messageFile)
 	ctx.ModuleBuild(pctx, android.ModuleBuildParams{
 		Rule:      aidlCheckApiRule,
@@ -595,8 +806,7 @@ func (m *aidlApi) checkCompatibility(ctx android.ModuleContext, oldDump apiDump,
 		Output:    timestampFile,
 		Args: map[string]string{
 			"optionalFlags": strings.Join(optionalFlags, " "),
-			"old":           oldDump.dir.String(),
-			"new":           newDump.dir.String(),
+			"dumps":         strings.Join(dirs, " "),
 			"messageFile":   messageFile.String(),
 		},
 	})
@@ -642,6 +852,7 @@ func (m *aidlApi) checkEquality(ctx android.ModuleContext, oldDump apiDump, newD
 func (m *aidlApi) checkIntegrity(ctx android.ModuleContext, dump apiDump) android.WritablePath {
 	version := dump.dir.Base()
 	timestampFile := android.PathForModuleOut(ctx, "checkhash_"+version+".timestamp")
+	manifestFile := android.PathForModuleOut(ctx, "checkhash_"+version+".manifest")
 	messageFile := android.PathForSource(ctx, "system/tools/aidl/build/message_check_integrity.txt")
 
 	i, _ := strconv.Atoi(version)
@@ -656,13 +867,14 @@ func (m *aidlApi) checkIntegrity(ctx android.ModuleContext, dump apiDump) androi
 	implicits = append(implicits, dump.hashFile.Path())
 	implicits = append(implicits, messageFile)
 	ctx.ModuleBuild(pctx, android.ModuleBuildParams{
-		Rule:      aidlVerifyHashRule,
-		Implicits: implicits,
-		Output:    timestampFile,
+		Rule:           aidlVerifyHashRule,
+		Implicits:      implicits,
+		Output:         timestampFile,
+		ImplicitOutput: manifestFile,
 		Args: map[string]string{
 			"apiDir":      dump.dir.String(),
 			"version":     version,
-			"hashFile":    dump.hashFile.Path().String(),
+			"manifest":    manifestFile.String(),
 			"messageFile": messageFile.String(),
 		},
 	})
@@ -726,11 +938,9 @@ func (m *aidlApi) GenerateAndroidBuildActions(ctx android.ModuleContext) {
 			checkHashTimestamp := m.checkIntegrity(ctx, dumps[i])
 			m.checkHashTimestamps = append(m.checkHashTimestamps, checkHashTimestamp)
 		}
-
-		if i == 0 {
-			continue
-		}
-		checked := m.checkCompatibility(ctx, dumps[i-1], dumps[i])
+	}
+	if len(dumps) > 1 {
+		checked := m.checkCompatibility(ctx, dumps)
 		m.checkApiTimestamps = append(m.checkApiTimestamps, checked)
 	}
 
@@ -774,6 +984,13 @@ type CommonBackendProperties struct {
 	Enabled        *bool
 	Apex_available []string
 
+	// Whether to generate a lazy proxy of each interface, which looks its
+	// service up on its first call rather than when it is created. The Java
+	// one uses the hidden android.os.ServiceManager, so it requires
+	// platform_apis.
+	// Default: false
+	Gen_lazy_proxy *bool
+
 	// The minimum version of the sdk that the compiled artifacts will run against
 	// For native modules, the property needs to be set when a module is a part of mainline modules(APEX).
 	// Forwarded to generated java/native module.
@@ -787,6 +1004,33 @@ type CommonNativeBackendProperties struct {
 	// Default: false
 	Gen_log *bool
 
+	// Format of the information that gen_log gathers: "json" hands each
+	// transaction to a callback as a Json::Value, "binary" appends a record to
+	// the ring buffer of aidl/binary_log.h, which aidl_log_decoder turns into
+	// JSON, without depending on libjsoncpp.
+	// Default: "json"
+	Log_format *string
+
+	// Whether to generate an asynchronous variant of each blocking method,
+	// which runs the call on the threads of aidl/async_executor.h and returns
+	// a future.
+	// Default: false
+	Gen_async *bool
+
+	// Whether the methods of primitives, Strings and arrays of primitives
+	// marshal their arguments with a program for the interpreter of
+	// aidl/marshal.h rather than with a call for each, which makes the
+	// generated code of the library smaller.
+	// Default: false
+	Marshal_tables *bool
+
+	// The number of sources that the library compiles, each of which includes
+	// the generated sources of some of the srcs, instead of one source per
+	// type. Applies when the srcs share a base directory and are compiled by
+	// a single aidl action.
+	// Default: 0, one source per type
+	Unity_sources *int64
+
 	// VNDK properties for correspdoning backend.
 	cc.VndkProperties
 }
@@ -804,6 +1048,35 @@ type aidlInterfaceProperties struct {
 	// Whether tracing should be added to the interface.
 	Gen_trace *bool
 
+	// How the cpp and ndk_platform backends trace the transactions of
+	// gen_trace: "atrace" (the default), the sections of ATRACE, or
+	// "perfetto", the track events of the "aidl" category of the Perfetto
+	// SDK, with the phases and the sizes of each transaction. The java and
+	// the unbundled ndk backends always use atrace.
+	Trace_format *string
+
+	// Whether the proxies and the stubs should count the transactions of each
+	// method, with a histogram of their latencies.
+	Gen_stats *bool
+
+	// Whether gen_stats also adds up the bytes of the requests and the replies
+	// of each method, and keeps their maxima, e.g. to find the methods that
+	// fill the binder buffers.
+	Gen_stats_sizes *bool
+
+	// Whether the interfaces and the structured parcelables of every backend
+	// embed their wire schemas, the codes, argument types and directions of
+	// the methods and the fields, for tools that decode the transactions of
+	// the library without its .aidl files.
+	Gen_wire_schema *bool
+
+	// Whether the cpp and ndk libraries of the frozen versions share the code
+	// of the structured parcelables that every version has the same, which is
+	// compiled once into a <name>-shared-<backend> library that they all link,
+	// instead of once per version. Applies with two or more versions.
+	// Default: false
+	Dedup_versions *bool
+
 	// Top level directories for includes.
 	// TODO(b/128940869): remove it if aidl_interface can depend on framework.aidl
 	Include_dirs []string
@@ -842,11 +1115,33 @@ type aidlInterfaceProperties struct {
 			// Whether to compile against platform APIs instead of
 			// an SDK.
 			Platform_apis *bool
+			// Whether the proxies and stubs marshal the nullable parcelables
+			// with the helpers of Parcel from SDK 23 instead of inline, which
+			// shrinks their bytecode without changing what they write.
+			// Default: false
+			Compact *bool
+			// Whether readFromParcel() of the parcelables reads into the arrays,
+			// Lists and Maps that they already have, and the stubs can recycle
+			// their in parcelable arguments with setRecycleInParcelables().
+			// Default: false
+			Reuse *bool
 		}
 		// Backend of the compiler generating code for C++ clients using
 		// libbinder (unstable C++ interface)
 		Cpp struct {
 			CommonNativeBackendProperties
+			// Whether the @nullable types other than IBinder are held in
+			// std::optional, as in the NDK backend, instead of in a heap
+			// allocated std::unique_ptr. Changes the signatures and fields
+			// of the generated code, so the users of the library opt in.
+			// Default: false
+			Nullable_as_optional *bool
+			// Whether to also generate the forward declarations of the types
+			// in Foo_fwd.h, and include them in IFoo.h rather than the
+			// definitions, which BpFoo.h and BnFoo.h still include. The
+			// clients of IFoo.h include the headers of the types that they use.
+			// Default: false
+			Gen_fwd_headers *bool
 		}
 		// Backend of the compiler generating code for C++ clients using
 		// libbinder_ndk (stable C interface to system's libbinder)
@@ -1180,29 +1475,95 @@ func addCppLibrary(mctx android.LoadHookContext, i *aidlInterface, version strin
 	}
 
 	var commonProperties *CommonNativeBackendProperties
+	var backendProperty string
 	if lang == langCpp {
 		commonProperties = &i.properties.Backend.Cpp.CommonNativeBackendProperties
+		backendProperty = "backend.cpp"
 	} else if lang == langNdk || lang == langNdkPlatform {
 		commonProperties = &i.properties.Backend.Ndk.CommonNativeBackendProperties
+		backendProperty = "backend.ndk"
 	}
 
 	genLog := proptools.Bool(commonProperties.Gen_log)
+	logFormat := proptools.StringDefault(commonProperties.Log_format, logFormatJson)
+	if logFormat != logFormatJson && logFormat != logFormatBinary {
+		mctx.PropertyErrorf(backendProperty+".log_format", "must be %q or %q, but got %q",
+			logFormatJson, logFormatBinary, logFormat)
+	}
+	genJsonLog := genLog && logFormat == logFormatJson
+	// For the arrays with @ArrayView and @SharedMemory, the fixed-size arrays,
+	// the parcelables with @Hashable and @PolymorphicAllocator and the methods
+	// with @Batchable, @Cacheable and @SingleFlight, which any .aidl file may have
+	headerLibDependency := []string{"libaidl-array-view-headers", "libaidl-batch-timer-headers",
+		"libaidl-fixed-array-headers", "libaidl-hash-headers", "libaidl-pmr-headers",
+		"libaidl-result-cache-headers", "libaidl-shared-memory-headers",
+		"libaidl-single-flight-headers"}
+	if lang == langNdk || lang == langNdkPlatform {
+		// For the status headers of the replies
+		headerLibDependency = append(headerLibDependency, "libaidl-status-headers")
+	}
+	if genLog && logFormat == logFormatBinary {
+		headerLibDependency = append(headerLibDependency, "libaidl-binary-log-headers")
+	}
 	genTrace := proptools.Bool(i.properties.Gen_trace)
-
+	traceFormat := proptools.StringDefault(i.properties.Trace_format, traceFormatAtrace)
+	if traceFormat != traceFormatAtrace && traceFormat != traceFormatPerfetto {
+		mctx.PropertyErrorf("trace_format", "must be %q or %q, but got %q",
+			traceFormatAtrace, traceFormatPerfetto, traceFormat)
+	}
+	genPerfetto := genTrace && traceFormat == traceFormatPerfetto && lang != langNdk
+	genStats := proptools.Bool(i.properties.Gen_stats)
+	if genStats {
+		headerLibDependency = append(headerLibDependency, "libaidl-transaction-stats-headers")
+	}
+	genAsync := proptools.Bool(commonProperties.Gen_async)
+	if genAsync {
+		headerLibDependency = append(headerLibDependency, "libaidl-async-executor-headers")
+	}
+	marshalTables := proptools.Bool(commonProperties.Marshal_tables)
+	if marshalTables {
+		headerLibDependency = append(headerLibDependency, "libaidl-marshal-headers")
+	}
+	// The frozen versions link the code that they share, which the latest one also compiles into
+	// its own library.
+	var dedupDirs []string
+	var dedupDependency []string
+	dedupLib := i.ModuleBase.Name() + "-shared-" + lang
+	if proptools.Bool(i.properties.Dedup_versions) && len(i.properties.Versions) >= 2 &&
+		!i.isCurrentVersion(mctx, version) {
+		for _, v := range i.properties.Versions {
+			dedupDirs = append(dedupDirs, filepath.Join(aidlApiDir, i.ModuleBase.Name(), v))
+		}
+		dedupDependency = []string{dedupLib}
+	}
+
+	genProperties := &aidlGenProperties{
+		Srcs:               srcs,
+		AidlRoot:           aidlRoot,
+		Imports:            concat(i.properties.Imports, []string{i.ModuleBase.Name()}),
+		Stability:          i.properties.Stability,
+		Lang:               lang,
+		BaseName:           i.ModuleBase.Name(),
+		GenLog:             genLog,
+		LogFormat:          logFormat,
+		Version:            version,
+		GenTrace:           genTrace,
+		TraceFormat:        traceFormat,
+		GenStats:           genStats,
+		GenSizes:           proptools.Bool(i.properties.Gen_stats_sizes),
+		GenWireSchema:      proptools.Bool(i.properties.Gen_wire_schema),
+		GenAsync:           genAsync,
+		GenLazy:            proptools.Bool(commonProperties.Gen_lazy_proxy),
+		MarshalTables:      marshalTables,
+		NullableAsOptional: proptools.Bool(i.properties.Backend.Cpp.Nullable_as_optional),
+		FwdHeaders:         proptools.Bool(i.properties.Backend.Cpp.Gen_fwd_headers),
+		UnitySources:       proptools.Int(commonProperties.Unity_sources),
+		DedupDirs:          dedupDirs,
+		Unstable:           i.properties.Unstable,
+	}
 	mctx.CreateModule(aidlGenFactory, &nameProperties{
 		Name: proptools.StringPtr(cppSourceGen),
-	}, &aidlGenProperties{
-		Srcs:      srcs,
-		AidlRoot:  aidlRoot,
-		Imports:   concat(i.properties.Imports, []string{i.ModuleBase.Name()}),
-		Stability: i.properties.Stability,
-		Lang:      lang,
-		BaseName:  i.ModuleBase.Name(),
-		GenLog:    genLog,
-		Version:   version,
-		GenTrace:  genTrace,
-		Unstable:  i.properties.Unstable,
-	})
+	}, genProperties)
 
 	importExportDependencies := wrap("", i.properties.Imports, "-"+lang)
 	var libJSONCppDependency []string
@@ -1216,17 +1577,19 @@ func addCppLibrary(mctx android.LoadHookContext, i *aidlInterface, version strin
 
 	if lang == langCpp {
 		importExportDependencies = append(importExportDependencies, "libbinder", "libutils")
-		if genLog {
+		if genJsonLog {
 			libJSONCppDependency = []string{"libjsoncpp"}
 		}
-		if genTrace {
+		if genPerfetto {
+			staticLibDependency = []string{"libaidl-trace-events"}
+		} else if genTrace {
 			importExportDependencies = append(importExportDependencies, "libcutils")
 		}
 		hostSupported = i.properties.Host_supported
 		minSdkVersion = i.properties.Backend.Cpp.Min_sdk_version
 	} else if lang == langNdk {
 		importExportDependencies = append(importExportDependencies, "libbinder_ndk")
-		if genLog {
+		if genJsonLog {
 			staticLibDependency = []string{"libjsoncpp_ndk"}
 		}
 		sdkVersion = proptools.StringPtr("current")
@@ -1234,9 +1597,12 @@ func addCppLibrary(mctx android.LoadHookContext, i *aidlInterface, version strin
 		minSdkVersion = i.properties.Backend.Ndk.Min_sdk_version
 	} else if lang == langNdkPlatform {
 		importExportDependencies = append(importExportDependencies, "libbinder_ndk")
-		if genLog {
+		if genJsonLog {
 			libJSONCppDependency = []string{"libjsoncpp"}
 		}
+		if genPerfetto {
+			staticLibDependency = []string{"libaidl-trace-events"}
+		}
 		hostSupported = i.properties.Host_supported
 		addCflags = append(addCflags, "-DBINDER_STABILITY_SUPPORT")
 		minSdkVersion = i.properties.Backend.Ndk.Min_sdk_version
@@ -1256,7 +1622,7 @@ func addCppLibrary(mctx android.LoadHookContext, i *aidlInterface, version strin
 		vendorAvailable = proptools.BoolPtr(false)
 	}
 
-	mctx.CreateModule(cc.LibraryFactory, &ccProperties{
+	libProperties := &ccProperties{
 		Name:                      proptools.StringPtr(cppModuleGen),
 		Vendor_available:          vendorAvailable,
 		Host_supported:            hostSupported,
@@ -1267,7 +1633,8 @@ func addCppLibrary(mctx android.LoadHookContext, i *aidlInterface, version strin
 		Static:                    staticLib{Whole_static_libs: libJSONCppDependency},
 		Shared:                    sharedLib{Shared_libs: libJSONCppDependency, Export_shared_lib_headers: libJSONCppDependency},
 		Static_libs:               staticLibDependency,
-		Shared_libs:               importExportDependencies,
+		Header_libs:               headerLibDependency,
+		Shared_libs:               concat(importExportDependencies, dedupDependency),
 		Export_shared_lib_headers: importExportDependencies,
 		Sdk_version:               sdkVersion,
 		Stl:                       stl,
@@ -1276,7 +1643,28 @@ func addCppLibrary(mctx android.LoadHookContext, i *aidlInterface, version strin
 		Stem:                      proptools.StringPtr(cppOutputGen),
 		Apex_available:            commonProperties.Apex_available,
 		Min_sdk_version:           minSdkVersion,
-	}, &i.properties.VndkProperties, &commonProperties.VndkProperties, &overrideVndkProperties)
+	}
+	mctx.CreateModule(cc.LibraryFactory, libProperties,
+		&i.properties.VndkProperties, &commonProperties.VndkProperties, &overrideVndkProperties)
+
+	if len(dedupDirs) > 0 && isLatest {
+		dedupGenProperties := *genProperties
+		dedupGenProperties.DedupShared = true
+		mctx.CreateModule(aidlGenFactory, &nameProperties{
+			Name: proptools.StringPtr(dedupLib + "-source"),
+		}, &dedupGenProperties)
+
+		// The headers are those of the versioned libraries.
+		dedupLibProperties := *libProperties
+		dedupLibProperties.Name = proptools.StringPtr(dedupLib)
+		dedupLibProperties.Generated_sources = []string{dedupLib + "-source"}
+		dedupLibProperties.Generated_headers = []string{dedupLib + "-source"}
+		dedupLibProperties.Export_generated_headers = nil
+		dedupLibProperties.Shared_libs = importExportDependencies
+		dedupLibProperties.Stem = proptools.StringPtr(dedupLib)
+		mctx.CreateModule(cc.LibraryFactory, &dedupLibProperties,
+			&i.properties.VndkProperties, &commonProperties.VndkProperties, &overrideVndkProperties)
+	}
 
 	return cppModuleGen
 }
@@ -1301,17 +1689,28 @@ func addJavaLibrary(mctx android.LoadHookContext, i *aidlInterface, version stri
 		sdkVersion = proptools.StringPtr("system_current")
 	}
 
+	genLazy := proptools.Bool(i.properties.Backend.Java.Gen_lazy_proxy)
+	if genLazy && !proptools.Bool(i.properties.Backend.Java.Platform_apis) {
+		mctx.PropertyErrorf("backend.java.gen_lazy_proxy", "requires platform_apis")
+	}
+
 	mctx.CreateModule(aidlGenFactory, &nameProperties{
 		Name: proptools.StringPtr(javaSourceGen),
 	}, &aidlGenProperties{
-		Srcs:      srcs,
-		AidlRoot:  aidlRoot,
-		Imports:   concat(i.properties.Imports, []string{i.ModuleBase.Name()}),
-		Stability: i.properties.Stability,
-		Lang:      langJava,
-		BaseName:  i.ModuleBase.Name(),
-		Version:   version,
-		Unstable:  i.properties.Unstable,
+		Srcs:          srcs,
+		AidlRoot:      aidlRoot,
+		Imports:       concat(i.properties.Imports, []string{i.ModuleBase.Name()}),
+		Stability:     i.properties.Stability,
+		Lang:          langJava,
+		BaseName:      i.ModuleBase.Name(),
+		Version:       version,
+		GenStats:      proptools.Bool(i.properties.Gen_stats),
+		GenSizes:      proptools.Bool(i.properties.Gen_stats_sizes),
+		GenWireSchema: proptools.Bool(i.properties.Gen_wire_schema),
+		GenLazy:       genLazy,
+		Compact:       proptools.Bool(i.properties.Backend.Java.Compact),
+		Reuse:         proptools.Bool(i.properties.Backend.Java.Reuse),
+		Unstable:      i.properties.Unstable,
 	})
 
 	mctx.CreateModule(java.LibraryFactory, &javaProperties{
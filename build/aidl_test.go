@@ -355,6 +355,140 @@ func TestCreatesModulesWithNoVersions(t *testing.T) {
 	assertModulesExists(t, ctx, "foo-java", "foo-cpp", "foo-ndk", "foo-ndk_platform")
 }
 
+func TestCompilesSourcesOfAVersionInOneAction(t *testing.T) {
+	ctx, _ := testAidl(t, `
+		aidl_interface {
+			name: "foo",
+			srcs: [
+				"IFoo.aidl",
+				"IBar.aidl",
+			],
+		}
+	`)
+
+	javaGen := ctx.ModuleForTests("foo-java-source", "").Rule("aidlJavaBatchRule")
+	if len(javaGen.Inputs) != 2 || len(javaGen.Outputs) != 2 {
+		t.Errorf("expected one action for IFoo.aidl and IBar.aidl, got %q -> %q",
+			javaGen.Inputs.Strings(), javaGen.Outputs.Strings())
+	}
+}
+
+func TestCleansTheGenDirOnlyWhenTheSourcesChange(t *testing.T) {
+	ctx, _ := testAidl(t, `
+		aidl_interface {
+			name: "foo",
+			srcs: [
+				"IFoo.aidl",
+			],
+		}
+	`)
+
+	// Editing a source must not remove the outputs that --write-if-changed leaves alone.
+	prepare := ctx.ModuleForTests("foo-java-source", "").Rule("aidlDirPrepareRule")
+	if len(prepare.Inputs) != 0 || !strings.Contains(prepare.Args["srcs"], "IFoo.aidl") {
+		t.Errorf("expected the sources in the command only, got %q and %q",
+			prepare.Inputs.Strings(), prepare.Args["srcs"])
+	}
+	gen := ctx.ModuleForTests("foo-java-source", "").Rule("aidlJavaRule")
+	if !strings.Contains(gen.RuleParams.Command, "--write-if-changed") || !gen.RuleParams.Restat {
+		t.Errorf("expected a restat rule with --write-if-changed, got %q", gen.RuleParams.Command)
+	}
+}
+
+func TestCompactJavaPassesTheFlag(t *testing.T) {
+	ctx, _ := testAidl(t, `
+		aidl_interface {
+			name: "foo",
+			srcs: [
+				"IFoo.aidl",
+			],
+			backend: {
+				java: {
+					compact: true,
+				},
+			},
+		}
+	`)
+
+	flags := ctx.ModuleForTests("foo-java-source", "").Rule("aidlJavaRule").Args["optionalFlags"]
+	if !strings.Contains(flags, "--java-compact") {
+		t.Errorf("unexpected flags %q", flags)
+	}
+}
+
+func TestJavaReusePassesTheFlag(t *testing.T) {
+	ctx, _ := testAidl(t, `
+		aidl_interface {
+			name: "foo",
+			srcs: [
+				"IFoo.aidl",
+			],
+			backend: {
+				java: {
+					reuse: true,
+				},
+			},
+		}
+	`)
+
+	flags := ctx.ModuleForTests("foo-java-source", "").Rule("aidlJavaRule").Args["optionalFlags"]
+	if !strings.Contains(flags, "--java-reuse") {
+		t.Errorf("unexpected flags %q", flags)
+	}
+}
+
+func TestGenWireSchemaPassesTheFlagToEveryBackend(t *testing.T) {
+	ctx, _ := testAidl(t, `
+		aidl_interface {
+			name: "foo",
+			srcs: [
+				"IFoo.aidl",
+			],
+			gen_wire_schema: true,
+		}
+	`)
+
+	for module, rule := range map[string]string{
+		"foo-cpp-source":  "aidlCppRule",
+		"foo-ndk-source":  "aidlCppRule",
+		"foo-java-source": "aidlJavaRule",
+	} {
+		flags := ctx.ModuleForTests(module, "").Rule(rule).Args["optionalFlags"]
+		if !strings.Contains(flags, "--gen-wire-schema") {
+			t.Errorf("%s: unexpected flags %q", module, flags)
+		}
+	}
+}
+
+func TestUnitySourcesReplaceTheSourcesOfTheTypes(t *testing.T) {
+	ctx, _ := testAidl(t, `
+		aidl_interface {
+			name: "foo",
+			srcs: [
+				"IFoo.aidl",
+				"IBar.aidl",
+			],
+			backend: {
+				ndk: {
+					unity_sources: 1,
+				},
+			},
+		}
+	`)
+
+	ndkGen := ctx.ModuleForTests("foo-ndk-source", "").Rule("aidlCppBatchRule")
+	if flags := ndkGen.Args["optionalFlags"]; !strings.Contains(flags, "--unity-sources=1") {
+		t.Errorf("unexpected flags %q", flags)
+	}
+	if len(ndkGen.Outputs) != 1 || filepath.Base(ndkGen.Outputs[0].String()) != "aidl_unity_0.cpp" {
+		t.Errorf("expected the unity source as the output, got %q", ndkGen.Outputs.Strings())
+	}
+	cppGen := ctx.ModuleForTests("foo-cpp-source", "").Rule("aidlCppBatchRule")
+	if len(cppGen.Outputs) != 2 {
+		t.Errorf("expected a source per type, got %q", cppGen.Outputs.Strings())
+	}
+}
+
 func TestCreatesModulesWithFrozenVersions(t *testing.T) {
 	// Each version should be under aidl_api/<name>/<ver>
 	testAidlError(t, `aidl_api/foo/1`, `
@@ -460,6 +594,35 @@ func TestNativeOutputIsAlwaysVersioned(t *testing.T) {
 	// skip ndk/ndk_platform since they follow the same rule with cpp
 }
 
+func TestChecksTheVersionsInOneActionWithManifests(t *testing.T) {
+	ctx, _ := testAidl(t, `
+		aidl_interface {
+			name: "foo",
+			srcs: [
+				"IFoo.aidl",
+			],
+			versions: [
+				"1", "2",
+			],
+		}
+	`, withFiles(map[string][]byte{
+		"aidl_api/foo/1/foo.1.aidl": nil,
+		"aidl_api/foo/1/.hash":      nil,
+		"aidl_api/foo/2/foo.2.aidl": nil,
+	}))
+
+	api := ctx.ModuleForTests("foo-api", "")
+	if dumps := strings.Fields(api.Rule("aidlCheckApiRule").Args["dumps"]); len(dumps) != 2 {
+		t.Errorf("expected the two versions to be checked at once, but got %v", dumps)
+	}
+	if manifest := api.Rule("aidlDumpApiRule").Args["manifest"]; !strings.HasSuffix(manifest, "/dump.manifest") {
+		t.Errorf("expected the dump to keep a manifest next to it, but got %q", manifest)
+	}
+	if manifest := api.Rule("aidlVerifyHashRule").Args["manifest"]; !strings.HasSuffix(manifest, "/checkhash_1.manifest") {
+		t.Errorf("expected the hash check to keep a manifest, but got %q", manifest)
+	}
+}
+
 func TestGenLogForNativeBackendRequiresJson(t *testing.T) {
 	testAidlError(t, `"foo-cpp" depends on .*"libjsoncpp"`, `
 		aidl_interface {
@@ -489,7 +652,374 @@ func TestGenLogForNativeBackendRequiresJson(t *testing.T) {
 		cc_library {
 			name: "libjsoncpp",
 		}
+		cc_library_headers {
+			name: "libaidl-array-view-headers",
+		}
+		cc_library_headers {
+			name: "libaidl-batch-timer-headers",
+		}
+		cc_library_headers {
+			name: "libaidl-fixed-array-headers",
+		}
+		cc_library_headers {
+			name: "libaidl-hash-headers",
+		}
+		cc_library_headers {
+			name: "libaidl-pmr-headers",
+		}
+		cc_library_headers {
+			name: "libaidl-result-cache-headers",
+		}
+		cc_library_headers {
+			name: "libaidl-shared-memory-headers",
+		}
+		cc_library_headers {
+			name: "libaidl-single-flight-headers",
+		}
+		cc_library_headers {
+			name: "libaidl-status-headers",
+		}
+	`)
+}
+
+func TestGenStatsRequiresTheTransactionStatsHeaders(t *testing.T) {
+	testAidlError(t, `"foo-cpp" depends on .*"libaidl-transaction-stats-headers"`, `
+		aidl_interface {
+			name: "foo",
+			srcs: [
+				"IFoo.aidl",
+			],
+			gen_stats: true,
+		}
+	`)
+	testAidl(t, `
+		aidl_interface {
+			name: "foo",
+			srcs: [
+				"IFoo.aidl",
+			],
+			gen_stats: true,
+		}
+		cc_library_headers {
+			name: "libaidl-transaction-stats-headers",
+		}
+	`)
+}
+
+func TestGenAsyncRequiresTheAsyncExecutorHeaders(t *testing.T) {
+	testAidlError(t, `"foo-ndk" depends on .*"libaidl-async-executor-headers"`, `
+		aidl_interface {
+			name: "foo",
+			srcs: [
+				"IFoo.aidl",
+			],
+			backend: {
+				ndk: {
+					gen_async: true,
+				},
+			},
+		}
 	`)
+	ctx, _ := testAidl(t, `
+		aidl_interface {
+			name: "foo",
+			srcs: [
+				"IFoo.aidl",
+			],
+			backend: {
+				ndk: {
+					gen_async: true,
+				},
+			},
+		}
+		cc_library_headers {
+			name: "libaidl-async-executor-headers",
+		}
+	`)
+
+	for module, expected := range map[string]bool{"foo-cpp-source": false, "foo-ndk-source": true} {
+		flags := ctx.ModuleForTests(module, "").Rule("aidlCppRule").Args["optionalFlags"]
+		if strings.Contains(flags, "--gen-async") != expected {
+			t.Errorf("%s: unexpected flags %q", module, flags)
+		}
+	}
+}
+
+func TestMarshalTablesRequireTheMarshalHeaders(t *testing.T) {
+	testAidlError(t, `"foo-cpp" depends on .*"libaidl-marshal-headers"`, `
+		aidl_interface {
+			name: "foo",
+			srcs: [
+				"IFoo.aidl",
+			],
+			backend: {
+				cpp: {
+					marshal_tables: true,
+				},
+			},
+		}
+	`)
+	ctx, _ := testAidl(t, `
+		aidl_interface {
+			name: "foo",
+			srcs: [
+				"IFoo.aidl",
+			],
+			backend: {
+				cpp: {
+					marshal_tables: true,
+				},
+			},
+		}
+		cc_library_headers {
+			name: "libaidl-marshal-headers",
+		}
+	`)
+
+	for module, expected := range map[string]bool{"foo-cpp-source": true, "foo-ndk-source": false} {
+		flags := ctx.ModuleForTests(module, "").Rule("aidlCppRule").Args["optionalFlags"]
+		if strings.Contains(flags, "--marshal=tables") != expected {
+			t.Errorf("%s: unexpected flags %q", module, flags)
+		}
+	}
+}
+
+func TestDedupVersionsSharesTheCodeOfTheFrozenVersions(t *testing.T) {
+	ctx, _ := testAidl(t, `
+		aidl_interface {
+			name: "foo",
+			srcs: [
+				"IFoo.aidl",
+			],
+			versions: [
+				"1", "2",
+			],
+			dedup_versions: true,
+		}
+	`, withFiles(map[string][]byte{
+		"aidl_api/foo/1/foo.1.aidl": nil,
+		"aidl_api/foo/2/foo.2.aidl": nil,
+	}))
+
+	for _, test := range []struct {
+		module string
+		dedup  bool
+		shared bool
+	}{
+		{"foo-V1-cpp-source", true, false},
+		{"foo-cpp-source", true, false},
+		{"foo-shared-cpp-source", true, true},
+		{"foo-V1-ndk-source", true, false},
+		{"foo-shared-ndk-source", true, true},
+		{"foo-unstable-cpp-source", false, false},
+	} {
+		flags := ctx.ModuleForTests(test.module, "").Rule("aidlCppRule").Args["optionalFlags"]
+		dedup := strings.Contains(flags, "/aidl_api/foo/1") && strings.Contains(flags, "/aidl_api/foo/2")
+		if dedup != test.dedup || strings.Contains(flags, "--dedup-shared") != test.shared {
+			t.Errorf("%s: unexpected flags %q", test.module, flags)
+		}
+	}
+	if flags := ctx.ModuleForTests("foo-V1-java-source", "").Rule("aidlJavaRule").Args["optionalFlags"]; strings.Contains(flags, "--dedup") {
+		t.Errorf("foo-V1-java-source: unexpected flags %q", flags)
+	}
+}
+
+func TestTraceFormatPerfettoRequiresTheTraceEvents(t *testing.T) {
+	bp := `
+		aidl_interface {
+			name: "foo",
+			srcs: [
+				"IFoo.aidl",
+			],
+			gen_trace: true,
+			trace_format: "perfetto",
+		}
+	`
+	testAidlError(t, `"foo-cpp" depends on .*"libaidl-trace-events"`, bp)
+	ctx, _ := testAidl(t, bp+`
+		cc_library_static {
+			name: "libaidl-trace-events",
+		}
+	`)
+
+	for module, expected := range map[string]string{
+		"foo-cpp-source":          "--trace=perfetto",
+		"foo-ndk_platform-source": "--trace=perfetto",
+		"foo-ndk-source":          "-t",
+		"foo-java-source":         "-t",
+	} {
+		rule := "aidlCppRule"
+		if module == "foo-java-source" {
+			rule = "aidlJavaRule"
+		}
+		flags := strings.Fields(ctx.ModuleForTests(module, "").Rule(rule).Args["optionalFlags"])
+		if !android.InList(expected, flags) {
+			t.Errorf("%s: expected %q in the flags %q", module, expected, flags)
+		}
+	}
+
+	testAidlError(t, `trace_format: must be "atrace" or "perfetto"`, `
+		aidl_interface {
+			name: "foo",
+			srcs: [
+				"IFoo.aidl",
+			],
+			gen_trace: true,
+			trace_format: "systrace",
+		}
+	`)
+}
+
+func TestGenLazyProxyIsPerBackend(t *testing.T) {
+	ctx, _ := testAidl(t, `
+		aidl_interface {
+			name: "foo",
+			srcs: [
+				"IFoo.aidl",
+			],
+			backend: {
+				cpp: {
+					gen_lazy_proxy: true,
+				},
+				java: {
+					gen_lazy_proxy: true,
+					platform_apis: true,
+				},
+			},
+		}
+	`)
+
+	for _, tc := range []struct {
+		module, rule string
+		expected     bool
+	}{
+		{"foo-cpp-source", "aidlCppRule", true},
+		{"foo-ndk-source", "aidlCppRule", false},
+		{"foo-java-source", "aidlJavaRule", true},
+	} {
+		flags := ctx.ModuleForTests(tc.module, "").Rule(tc.rule).Args["optionalFlags"]
+		if strings.Contains(flags, "--gen-lazy-proxy") != tc.expected {
+			t.Errorf("%s: unexpected flags %q", tc.module, flags)
+		}
+	}
+
+	testAidlError(t, `backend.java.gen_lazy_proxy: requires platform_apis`, `
+		aidl_interface {
+			name: "foo",
+			srcs: [
+				"IFoo.aidl",
+			],
+			backend: {
+				java: {
+					gen_lazy_proxy: true,
+				},
+			},
+		}
+	`)
+}
+
+func TestGenFwdHeadersAddsTheHeadersToTheCppOutputs(t *testing.T) {
+	ctx, _ := testAidl(t, `
+		aidl_interface {
+			name: "foo",
+			srcs: [
+				"IFoo.aidl",
+			],
+			backend: {
+				cpp: {
+					gen_fwd_headers: true,
+				},
+			},
+		}
+	`)
+
+	rule := ctx.ModuleForTests("foo-cpp-source", "").Rule("aidlCppRule")
+	if flags := rule.Args["optionalFlags"]; !strings.Contains(flags, "--fwd-headers") {
+		t.Errorf("unexpected flags %q", flags)
+	}
+	var headers []string
+	for _, header := range rule.ImplicitOutputs {
+		headers = append(headers, filepath.Base(header.String()))
+	}
+	if got, expected := strings.Join(headers, " "), "IFoo.h BpFoo.h BnFoo.h IFoo_fwd.h"; got != expected {
+		t.Errorf("expected headers %q, but got %q", expected, got)
+	}
+
+	ndk := ctx.ModuleForTests("foo-ndk-source", "").Rule("aidlCppRule")
+	if flags := ndk.Args["optionalFlags"]; strings.Contains(flags, "--fwd-headers") {
+		t.Errorf("unexpected ndk flags %q", flags)
+	}
+}
+
+func TestGenLogInBinaryRequiresTheBinaryLogHeaders(t *testing.T) {
+	testAidlError(t, `"foo-cpp" depends on .*"libaidl-binary-log-headers"`, `
+		aidl_interface {
+			name: "foo",
+			srcs: [
+				"IFoo.aidl",
+			],
+			backend: {
+				cpp: {
+					gen_log: true,
+					log_format: "binary",
+				},
+			},
+		}
+	`)
+	testAidl(t, `
+		aidl_interface {
+			name: "foo",
+			srcs: [
+				"IFoo.aidl",
+			],
+			backend: {
+				cpp: {
+					gen_log: true,
+					log_format: "binary",
+				},
+			},
+		}
+		cc_library_headers {
+			name: "libaidl-binary-log-headers",
+		}
+	`)
+	testAidlError(t, `log_format: must be "json" or "binary"`, `
+		aidl_interface {
+			name: "foo",
+			srcs: [
+				"IFoo.aidl",
+			],
+			backend: {
+				cpp: {
+					gen_log: true,
+					log_format: "xml",
+				},
+			},
+		}
+	`)
+}
+
+func TestNullableAsOptionalIsOnlyForTheCppBackend(t *testing.T) {
+	ctx, _ := testAidl(t, `
+		aidl_interface {
+			name: "foo",
+			srcs: [
+				"IFoo.aidl",
+			],
+			backend: {
+				cpp: {
+					nullable_as_optional: true,
+				},
+			},
+		}
+	`)
+
+	for module, expected := range map[string]bool{"foo-cpp-source": true, "foo-ndk-source": false} {
+		flags := ctx.ModuleForTests(module, "").Rule("aidlCppRule").Args["optionalFlags"]
+		if strings.Contains(flags, "--nullable=optional") != expected {
+			t.Errorf("%s: unexpected flags %q", module, flags)
+		}
+	}
 }
 
 func TestImports(t *testing.T) {
@@ -37,6 +37,7 @@ type ccProperties struct {
 	Static                    staticLib
 	Static_libs               []string
 	Shared_libs               []string
+	Header_libs               []string
 	Export_shared_lib_headers []string
 	Export_generated_headers  []string
 	Sdk_version               *string
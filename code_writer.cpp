@@ -14,13 +14,15 @@
  * limitations under the License.
  */
 #include "code_writer.h"
+#include "aidl_profile.h"
 
 #include <stdarg.h>
+#include <stdio.h>
 #include <fstream>
 #include <iostream>
 #include <sstream>
-#include <vector>
 
+#include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/stringprintf.h>
 
@@ -29,44 +31,86 @@ namespace aidl {
 
 CodeWriter::CodeWriter(std::unique_ptr<std::ostream> ostream) : ostream_(std::move(ostream)) {}
 
-std::string CodeWriter::ApplyIndent(const std::string& str) {
-  std::string output;
-  if (!start_of_line_ || str == "\n") {
-    output = str;
-  } else {
-    output = std::string(indent_level_ * 2, ' ') + str;
+namespace {
+// The buffer is written out whenever it grows beyond this size.
+constexpr size_t kFlushThreshold = 64 * 1024;
+}  // namespace
+
+CodeWriter::~CodeWriter() {
+  Flush();
+}
+
+void CodeWriter::Append(std::string_view text) {
+  const size_t buffered = buffer_.size();
+  // Empty lines are not indented.
+  while (!text.empty()) {
+    const size_t line_end = text.find('\n');
+    const size_t length = line_end == std::string_view::npos ? text.size() : line_end + 1;
+    const std::string_view line = text.substr(0, length);
+    if (start_of_line_ && line != "\n") {
+      buffer_.append(indent_level_ * 2, ' ');
+    }
+    buffer_.append(line);
+    start_of_line_ = line.back() == '\n';
+    if (start_of_line_) {
+      appended_lines_++;
+    }
+    text.remove_prefix(length);
+  }
+  appended_bytes_ += buffer_.size() - buffered;
+  if (buffer_.size() >= kFlushThreshold) {
+    Flush();
   }
-  start_of_line_ = !output.empty() && output.back() == '\n';
-  return output;
+}
+
+bool CodeWriter::Flush() {
+  if (ostream_ == nullptr) {
+    buffer_.clear();
+    return true;
+  }
+  if (!buffer_.empty()) {
+    ProfileScope profile_scope("write");
+    if (counts_as_output_) {
+      CountWrittenBytes(buffer_.size());
+    }
+    ostream_->write(buffer_.data(), buffer_.size());
+    buffer_.clear();
+  }
+  return !ostream_->fail();
 }
 
 bool CodeWriter::Write(const char* format, ...) {
+  // Most writes are short enough to be formatted on the stack.
+  char stack_buffer[256];
   va_list ap;
   va_start(ap, format);
-  std::string formatted;
-  android::base::StringAppendV(&formatted, format, ap);
+  va_list ap_copy;
+  va_copy(ap_copy, ap);
+  const int length = vsnprintf(stack_buffer, sizeof(stack_buffer), format, ap);
   va_end(ap);
-
-  // extract lines. empty line is preserved.
-  std::vector<std::string> lines;
-  size_t pos = 0;
-  while (pos < formatted.size()) {
-    size_t line_end = formatted.find('\n', pos);
-    if (line_end != std::string::npos) {
-      lines.push_back(formatted.substr(pos, (line_end - pos) + 1));
-      pos = line_end + 1;
-    } else {
-      lines.push_back(formatted.substr(pos));
-      break;
-    }
+  if (length < 0) {
+    va_end(ap_copy);
+    return false;
   }
-
-  std::string indented;
-  for (const auto& line : lines) {
-    indented.append(ApplyIndent(line));
+  if (static_cast<size_t>(length) < sizeof(stack_buffer)) {
+    Append(std::string_view(stack_buffer, length));
+  } else {
+    std::string formatted;
+    android::base::StringAppendV(&formatted, format, ap_copy);
+    Append(formatted);
   }
+  va_end(ap_copy);
+  return ostream_ == nullptr || !ostream_->fail();
+}
 
-  (*ostream_) << indented;
+bool CodeWriter::WriteBytes(const std::string& bytes) {
+  if (!Flush()) {
+    return false;
+  }
+  if (counts_as_output_) {
+    CountWrittenBytes(bytes.size());
+  }
+  ostream_->write(bytes.data(), bytes.size());
   return !ostream_->fail();
 }
 
@@ -80,6 +124,9 @@ void CodeWriter::Dedent() {
 }
 
 bool CodeWriter::Close() {
+  if (!Flush()) {
+    return false;
+  }
   if (ostream_.get()->rdbuf() != std::cout.rdbuf()) {
     // if the steam is for file (not stdout), do the close.
     static_cast<std::fstream*>(ostream_.get())->close();
@@ -89,12 +136,17 @@ bool CodeWriter::Close() {
 }
 
 CodeWriter& CodeWriter::operator<<(const char* s) {
-  Write("%s", s);
+  Append(s);
   return *this;
 }
 
 CodeWriter& CodeWriter::operator<<(const std::string& str) {
-  Write("%s", str.c_str());
+  Append(str);
+  return *this;
+}
+
+CodeWriter& CodeWriter::operator<<(std::string_view str) {
+  Append(str);
   return *this;
 }
 
@@ -109,6 +161,51 @@ CodeWriterPtr CodeWriter::ForFile(const std::string& filename) {
   return CodeWriterPtr(new CodeWriter(std::move(stream)));
 }
 
+CodeWriterPtr CodeWriter::ForFileIfChanged(const std::string& filename) {
+  if (filename == "-") {
+    return ForFile(filename);
+  }
+  class FileIfChangedCodeWriter : public CodeWriter {
+   public:
+    explicit FileIfChangedCodeWriter(const std::string& filename)
+        : CodeWriter(std::unique_ptr<std::ostream>(new std::stringstream())), filename_(filename) {}
+    ~FileIfChangedCodeWriter() override { Close(); }
+    bool Close() override {
+      if (closed_) {
+        return ok_;
+      }
+      closed_ = true;
+      Flush();
+      const std::string contents = static_cast<std::stringstream*>(ostream_.get())->str();
+      std::string existing;
+      if (android::base::ReadFileToString(filename_, &existing) && existing == contents) {
+        return ok_;
+      }
+      // Readers of the file never see it half written.
+      const std::string temp = filename_ + ".tmp";
+      if (!android::base::WriteStringToFile(contents, temp)) {
+        ok_ = false;
+        return ok_;
+      }
+#ifdef _WIN32
+      // rename() doesn't replace an existing file on Windows.
+      remove(filename_.c_str());
+#endif
+      if (rename(temp.c_str(), filename_.c_str()) != 0) {
+        remove(temp.c_str());
+        ok_ = false;
+      }
+      return ok_;
+    }
+
+   private:
+    const std::string filename_;
+    bool closed_ = false;
+    bool ok_ = true;
+  };
+  return CodeWriterPtr(new FileIfChangedCodeWriter(filename));
+}
+
 CodeWriterPtr CodeWriter::ForString(std::string* buf) {
   // This class is defined inside this static function of CodeWriter
   // in order to have access to private constructor and private member
@@ -121,6 +218,7 @@ CodeWriterPtr CodeWriter::ForString(std::string* buf) {
     bool Close() override {
       // extract whats written to the stringstream to the external buffer.
       // we are sure that ostream_ is indeed stringstream.
+      Flush();
       *buf_ = static_cast<std::stringstream*>(ostream_.get())->str();
       return true;
     }
@@ -19,7 +19,9 @@
 #include <memory>
 #include <ostream>
 #include <string>
+#include <string_view>
 
+#include <stdint.h>
 #include <stdio.h>
 
 #include <android-base/macros.h>
@@ -35,6 +37,11 @@ class CodeWriter {
   // Get a CodeWriter that writes to a file. When filename is "-",
   // it is written to stdout.
   static CodeWriterPtr ForFile(const std::string& filename);
+  // Get a CodeWriter that writes to a file only if its contents change, so
+  // that an unchanged file keeps its timestamp. The output is buffered, and
+  // the file is replaced atomically when Close() is called or the CodeWriter
+  // is deleted.
+  static CodeWriterPtr ForFileIfChanged(const std::string& filename);
   // Get a CodeWriter that writes to a string buffer.
   // The buffer gets updated only after Close() is called or the CodeWriter
   // is deleted -- much like a real file.
@@ -42,21 +49,43 @@ class CodeWriter {
   // Write a formatted string to this writer in the usual printf sense.
   // Returns false on error.
   virtual bool Write(const char* format, ...) __attribute__((format(printf, 2, 3)));
+  // Write raw bytes, which may contain NULs, without any formatting or
+  // indentation. Returns false on error.
+  virtual bool WriteBytes(const std::string& bytes);
   void Indent();
   void Dedent();
+  // Count the bytes written by this writer as an output of the compiler
+  // (see ThreadWrittenBytes() and --stats). IoDelegate does this for the
+  // files it opens, unlike for the strings that generators build.
+  void CountAsOutput() { counts_as_output_ = true; }
+  // The bytes and the lines appended to this writer so far, with their
+  // indentation (see SizeScope and --size-report).
+  uint64_t AppendedBytes() const { return appended_bytes_; }
+  uint64_t AppendedLines() const { return appended_lines_; }
   virtual bool Close();
-  virtual ~CodeWriter() = default;
+  virtual ~CodeWriter();
   CodeWriter() = default;
 
   CodeWriter& operator<<(const char* s);
   CodeWriter& operator<<(const std::string& str);
+  CodeWriter& operator<<(std::string_view str);
+
+ protected:
+  // Writes what is buffered to the stream. Returns false on error.
+  bool Flush();
 
  private:
   CodeWriter(std::unique_ptr<std::ostream> ostream);
-  std::string ApplyIndent(const std::string& str);
+  // Appends |text| to the buffer, indenting each line that it starts.
+  void Append(std::string_view text);
   const std::unique_ptr<std::ostream> ostream_;
+  // Output that hasn't been written to ostream_ yet.
+  std::string buffer_;
   int indent_level_ {0};
   bool start_of_line_ {true};
+  bool counts_as_output_ {false};
+  uint64_t appended_bytes_ {0};
+  uint64_t appended_lines_ {0};
 };
 
 }  // namespace aidl
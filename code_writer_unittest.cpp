@@ -44,5 +44,46 @@ TEST(CodeWriterTest, AppendOperatorCascade) {
   EXPECT_EQ(str, "Write this and that");
 }
 
+TEST(CodeWriterTest, IndentsEveryLineButEmptyOnes) {
+  string str;
+  CodeWriterPtr ptr = CodeWriter::ForString(&str);
+  CodeWriter& writer = *ptr;
+  writer << "a {\n";
+  writer.Indent();
+  writer << std::string_view("b;\n\nc") << "d;\n";
+  writer.Write("%s%d;\n", string(300, 'e').c_str(), 1);
+  writer.Dedent();
+  writer << "}\n";
+  writer.Close();
+  EXPECT_EQ("a {\n  b;\n\n  cd;\n  " + string(300, 'e') + "1;\n}\n", str);
+}
+
+TEST(CodeWriterTest, CountsTheAppendedBytesAndLines) {
+  string str;
+  CodeWriterPtr ptr = CodeWriter::ForString(&str);
+  CodeWriter& writer = *ptr;
+  writer << "a {\n";
+  writer.Indent();
+  writer << "b;\n\nc";
+  EXPECT_EQ(3u, writer.AppendedLines());
+  writer << "d;\n";
+  writer.Dedent();
+  writer << "}\n";
+  writer.Close();
+  EXPECT_EQ(str.size(), writer.AppendedBytes());
+  EXPECT_EQ(5u, writer.AppendedLines());
+}
+
+TEST(CodeWriterTest, WritesOutputLargerThanItsBuffer) {
+  string str;
+  CodeWriterPtr ptr = CodeWriter::ForString(&str);
+  const string line(99, 'x');
+  for (int i = 0; i < 10000; i++) {
+    *ptr << line << "\n";
+  }
+  ptr->Close();
+  EXPECT_EQ(10000u * 100u, str.size());
+}
+
 }  // namespace aidl
 }  // namespace android
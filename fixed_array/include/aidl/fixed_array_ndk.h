@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+// The fixed-size arrays T[N] of the NDK backend, see aidl/fixed_array_parcel.h.
+// The arrays are written by the AParcel_write*Array() of their elements, and
+// read by their AParcel_read*Array() into the ::std::array itself, whose
+// allocator rejects a count other than N instead of allocating.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <array>
+#include <type_traits>
+
+#include <android/binder_parcel.h>
+#include <android/binder_status.h>
+
+namespace android {
+namespace aidl {
+
+namespace fixed_array_internal {
+
+template <typename T, size_t N>
+struct FixedArrayRead {
+  std::array<T, N>* values;
+  // Why the allocator rejected the array, if it did
+  binder_status_t status = STATUS_OK;
+};
+
+template <typename T, size_t N>
+bool CheckFixedArraySize(FixedArrayRead<T, N>* read, int32_t length) {
+  if (length == static_cast<int32_t>(N)) return true;
+  read->status = length < 0 ? STATUS_UNEXPECTED_NULL : STATUS_BAD_VALUE;
+  return false;
+}
+
+template <typename T, size_t N>
+bool AllocateFixedArray(void* data, int32_t length, T** buffer) {
+  auto* read = static_cast<FixedArrayRead<T, N>*>(data);
+  if (!CheckFixedArraySize(read, length)) return false;
+  *buffer = read->values->data();
+  return true;
+}
+
+template <size_t N>
+bool AllocateFixedBoolArray(void* data, int32_t length) {
+  return CheckFixedArraySize(static_cast<FixedArrayRead<bool, N>*>(data), length);
+}
+
+template <size_t N>
+void SetFixedBoolArray(void* data, size_t index, bool value) {
+  (*static_cast<FixedArrayRead<bool, N>*>(data)->values)[index] = value;
+}
+
+template <size_t N>
+bool GetFixedBoolArray(const void* data, size_t index) {
+  return (*static_cast<const std::array<bool, N>*>(data))[index];
+}
+
+inline binder_status_t WriteArray(AParcel* parcel, const int8_t* data, int32_t length) {
+  return AParcel_writeByteArray(parcel, data, length);
+}
+inline binder_status_t WriteArray(AParcel* parcel, const char16_t* data, int32_t length) {
+  return AParcel_writeCharArray(parcel, data, length);
+}
+inline binder_status_t WriteArray(AParcel* parcel, const int32_t* data, int32_t length) {
+  return AParcel_writeInt32Array(parcel, data, length);
+}
+inline binder_status_t WriteArray(AParcel* parcel, const int64_t* data, int32_t length) {
+  return AParcel_writeInt64Array(parcel, data, length);
+}
+inline binder_status_t WriteArray(AParcel* parcel, const float* data, int32_t length) {
+  return AParcel_writeFloatArray(parcel, data, length);
+}
+inline binder_status_t WriteArray(AParcel* parcel, const double* data, int32_t length) {
+  return AParcel_writeDoubleArray(parcel, data, length);
+}
+
+template <size_t N>
+binder_status_t ReadArray(const AParcel* parcel, FixedArrayRead<int8_t, N>* read) {
+  return AParcel_readByteArray(parcel, read, AllocateFixedArray<int8_t, N>);
+}
+template <size_t N>
+binder_status_t ReadArray(const AParcel* parcel, FixedArrayRead<char16_t, N>* read) {
+  return AParcel_readCharArray(parcel, read, AllocateFixedArray<char16_t, N>);
+}
+template <size_t N>
+binder_status_t ReadArray(const AParcel* parcel, FixedArrayRead<int32_t, N>* read) {
+  return AParcel_readInt32Array(parcel, read, AllocateFixedArray<int32_t, N>);
+}
+template <size_t N>
+binder_status_t ReadArray(const AParcel* parcel, FixedArrayRead<int64_t, N>* read) {
+  return AParcel_readInt64Array(parcel, read, AllocateFixedArray<int64_t, N>);
+}
+template <size_t N>
+binder_status_t ReadArray(const AParcel* parcel, FixedArrayRead<float, N>* read) {
+  return AParcel_readFloatArray(parcel, read, AllocateFixedArray<float, N>);
+}
+template <size_t N>
+binder_status_t ReadArray(const AParcel* parcel, FixedArrayRead<double, N>* read) {
+  return AParcel_readDoubleArray(parcel, read, AllocateFixedArray<double, N>);
+}
+template <size_t N>
+binder_status_t ReadArray(const AParcel* parcel, FixedArrayRead<bool, N>* read) {
+  return AParcel_readBoolArray(parcel, read, AllocateFixedBoolArray<N>, SetFixedBoolArray<N>);
+}
+
+}  // namespace fixed_array_internal
+
+template <typename T, size_t N>
+binder_status_t WriteFixedArray(AParcel* parcel, const std::array<T, N>& values) {
+  static_assert(N > 0 && N <= INT32_MAX);
+  if constexpr (std::is_same_v<T, bool>) {
+    return AParcel_writeBoolArray(parcel, &values, static_cast<int32_t>(N),
+                                  fixed_array_internal::GetFixedBoolArray<N>);
+  } else {
+    return fixed_array_internal::WriteArray(parcel, values.data(), static_cast<int32_t>(N));
+  }
+}
+
+template <typename T, size_t N>
+binder_status_t ReadFixedArray(const AParcel* parcel, std::array<T, N>* values) {
+  fixed_array_internal::FixedArrayRead<T, N> read{values};
+  binder_status_t status = fixed_array_internal::ReadArray(parcel, &read);
+  return read.status != STATUS_OK ? read.status : status;
+}
+
+}  // namespace aidl
+}  // namespace android
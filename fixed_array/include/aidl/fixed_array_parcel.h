@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+// The fixed-size arrays T[N] of the C++ backend, which are held in a
+// ::std::array<T, N>. They are laid out as the arrays T[] are, an int32 count
+// followed by the elements, so the other backends and the older versions read
+// them as arrays. The elements that the parcel holds as they are in memory are
+// copied in one go into the parcel and out of it, with no allocation, and a
+// count other than N is rejected.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <array>
+#include <type_traits>
+
+#include <binder/Parcel.h>
+
+namespace android {
+namespace aidl {
+
+namespace fixed_array_internal {
+
+// Whether a Parcel holds the elements of type T as they are in memory: the
+// bytes padded as a whole, and the numbers of 4 and 8 bytes. The booleans and
+// the chars take an int32 each.
+template <typename T>
+constexpr bool kIsCopied = !std::is_same_v<T, bool> && !std::is_same_v<T, char16_t>;
+
+}  // namespace fixed_array_internal
+
+template <typename T, size_t N>
+status_t WriteFixedArray(Parcel* parcel, const std::array<T, N>& values) {
+  static_assert(N > 0 && N <= INT32_MAX / sizeof(T));
+  status_t status = parcel->writeInt32(static_cast<int32_t>(N));
+  if (status != OK) return status;
+  if constexpr (fixed_array_internal::kIsCopied<T>) {
+    return parcel->write(values.data(), N * sizeof(T));
+  } else {
+    for (const T& value : values) {
+      status = parcel->writeInt32(static_cast<int32_t>(value));
+      if (status != OK) return status;
+    }
+    return OK;
+  }
+}
+
+template <typename T, size_t N>
+status_t ReadFixedArray(const Parcel* parcel, std::array<T, N>* values) {
+  int32_t size;
+  status_t status = parcel->readInt32(&size);
+  if (status != OK) return status;
+  if (size < 0) return UNEXPECTED_NULL;
+  if (static_cast<size_t>(size) != N) return BAD_VALUE;
+  if constexpr (fixed_array_internal::kIsCopied<T>) {
+    return parcel->read(values->data(), N * sizeof(T));
+  } else {
+    for (T& value : *values) {
+      int32_t element;
+      status = parcel->readInt32(&element);
+      if (status != OK) return status;
+      if constexpr (std::is_same_v<T, bool>) {
+        value = element != 0;
+      } else {
+        value = static_cast<T>(element);
+      }
+    }
+    return OK;
+  }
+}
+
+}  // namespace aidl
+}  // namespace android
@@ -19,6 +19,8 @@
 
 #include <sstream>
 
+#include <android-base/strings.h>
+
 namespace android {
 namespace aidl {
 namespace mappings {
@@ -50,6 +52,33 @@ SignatureMap generate_mappings(const AidlDefinedType* defined_type,
   return mappings;
 }
 
+std::vector<TransactionMapping> generate_transaction_mappings(const AidlDefinedType* defined_type,
+                                                              const AidlTypenames& typenames) {
+  const AidlInterface* interface = defined_type->AsInterface();
+  std::vector<TransactionMapping> mappings;
+  if (interface == nullptr) {
+    return mappings;
+  }
+  for (const auto& method : interface->GetMethods()) {
+    std::vector<std::string> arguments;
+    for (const auto& arg : method->GetArguments()) {
+      arguments.push_back(java::JavaSignatureOf(arg->GetType(), typenames));
+    }
+    const std::string joined = android::base::Join(arguments, ",");
+    // IBinder::FIRST_CALL_TRANSACTION is 1
+    mappings.push_back(TransactionMapping{
+        interface->GetCanonicalName(),
+        static_cast<uint32_t>(1 + method->GetId()),
+        method->GetName(),
+        java::JavaSignatureOf(method->GetType(), typenames) + " " + method->GetName() + "(" +
+            joined + ")",
+        joined,
+        method->IsOneway(),
+    });
+  }
+  return mappings;
+}
+
 }  // namespace mappings
 }  // namespace aidl
 }  // namespace android
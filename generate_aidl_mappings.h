@@ -16,8 +16,12 @@
 
 #pragma once
 
+#include <stdint.h>
+
 #include <string>
 #include <unordered_map>
+#include <vector>
+
 #include "aidl_language.h"
 
 namespace android {
@@ -27,6 +31,20 @@ namespace mappings {
 using SignatureMap = std::unordered_map<std::string, std::string>;
 
 SignatureMap generate_mappings(const AidlDefinedType* iface, const AidlTypenames& typenames);
+
+// A method of an interface in the binary table of --apimapping-format=binary
+struct TransactionMapping {
+  std::string descriptor;
+  uint32_t code;
+  std::string name;
+  std::string signature;
+  std::string arguments;
+  bool oneway;
+};
+
+// The transactions of the methods of |iface|, if it is an interface
+std::vector<TransactionMapping> generate_transaction_mappings(const AidlDefinedType* iface,
+                                                              const AidlTypenames& typenames);
 }  // namespace mappings
 }  // namespace aidl
 }  // namespace android
@@ -17,6 +17,7 @@
 #include "generate_cpp.h"
 #include "aidl.h"
 
+#include <algorithm>
 #include <cctype>
 #include <cstring>
 #include <memory>
@@ -27,6 +28,7 @@
 #include <android-base/stringprintf.h>
 
 #include "aidl_language.h"
+#include "aidl_profile.h"
 #include "aidl_to_cpp.h"
 #include "ast_cpp.h"
 #include "code_writer.h"
@@ -69,6 +71,107 @@ const char kString16Header[] = "utils/String16.h";
 const char kTraceHeader[] = "utils/Trace.h";
 const char kStrongPointerHeader[] = "utils/StrongPointer.h";
 const char kAndroidBaseMacrosHeader[] = "android-base/macros.h";
+const char kGetTransactionStatsDecl[] =
+    "static ::android::aidl::transaction_stats::Table getTransactionStats();\n";
+const char kSharedMemoryNamespace[] = "::android::aidl::shared_memory::";
+const char kBatchTimer[] = "::android::aidl::BatchTimer::";
+const char kCacheGenerationVarName[] = "_aidl_cache_generation";
+const char kBatchVarName[] = "batch_";
+
+// The member of a proxy that keeps the results of a @Cacheable method
+string CacheVarName(const AidlMethod& method) {
+  return "cached_" + method.GetName() + "_";
+}
+
+// The member of a stub that keeps the calls in flight of a @SingleFlight method
+string FlightVarName(const AidlMethod& method) {
+  return "_aidl_flight_" + method.GetName();
+}
+
+// The code of the transaction that carries the calls of the @Batchable methods
+string BatchTransactionId() {
+  return StringPrintf("::android::IBinder::FIRST_CALL_TRANSACTION + %d /* batch */",
+                      kBatchTransactionId);
+}
+
+bool IsEnumArray(const AidlTypeSpecifier& type, const AidlTypenames& typenames) {
+  return type.IsArray() && typenames.GetEnumDeclaration(type) != nullptr;
+}
+
+// The calls that write |var| of |type| to and read it from |parcel|, which is
+// a ::android::Parcel* if |is_pointer|. The byte[]s with @SharedMemory go
+// through aidl/shared_memory_parcel.h, and the arrays with @ArrayView and the
+// Strings written from a @StringView through aidl/array_view_parcel.h.
+// Enum arrays are copied in one go by aidl/enum_vector_parcel.h, and the
+// fixed-size arrays by aidl/fixed_array_parcel.h.
+MethodCall* ParcelWriteCall(const AidlTypeSpecifier& type, const AidlTypenames& typenames,
+                            const string& parcel, bool is_pointer, const string& var) {
+  if (type.IsArrayView()) {
+    return new MethodCall("::android::aidl::WriteArrayView",
+                          ArgList(vector<string>{(is_pointer ? "" : "&") + parcel, var}));
+  }
+  if (type.IsStringView()) {
+    return new MethodCall("::android::aidl::WriteStringView",
+                          ArgList(vector<string>{(is_pointer ? "" : "&") + parcel, var}));
+  }
+  if (IsEnumArray(type, typenames)) {
+    return new MethodCall("::android::aidl::WriteEnumVector",
+                          ArgList(vector<string>{(is_pointer ? "" : "&") + parcel, var}));
+  }
+  if (type.IsFixedSizeArray()) {
+    return new MethodCall("::android::aidl::WriteFixedArray",
+                          ArgList(vector<string>{(is_pointer ? "" : "&") + parcel, var}));
+  }
+  if (type.IsSharedMemory()) {
+    return new MethodCall(string(kSharedMemoryNamespace) + "WriteBytes",
+                          ArgList(vector<string>{(is_pointer ? "" : "&") + parcel, var,
+                                                 std::to_string(type.SharedMemoryThreshold())}));
+  }
+  return new MethodCall(
+      parcel + (is_pointer ? "->" : ".") + ParcelWriteMethodOf(type, typenames),
+      ParcelWriteCastOf(type, typenames, var));
+}
+
+// The call that grows |parcel| once for the |values| that are about to be
+// written to it, with their names, or "" if none of them is an array that
+// ParcelSizeOf() can size, for which the Parcel would grow repeatedly
+string SetDataCapacityFor(
+    const vector<std::pair<const AidlTypeSpecifier*, string>>& values,
+    const AidlTypenames& typenames, const string& parcel, bool is_pointer) {
+  vector<string> sizes;
+  bool has_array = false;
+  for (const auto& [type, var] : values) {
+    const string size = ParcelSizeOf(*type, typenames, var);
+    if (size.empty()) continue;
+    sizes.push_back(size);
+    has_array = has_array || type->IsArray();
+  }
+  if (!has_array) return "";
+  const string access = parcel + (is_pointer ? "->" : ".");
+  return access + "setDataCapacity(" + access + "dataPosition() + " + Join(sizes, " + ") + ")";
+}
+
+MethodCall* ParcelReadCall(const AidlTypeSpecifier& type, const AidlTypenames& typenames,
+                           const string& parcel, bool is_pointer, const string& var_ptr) {
+  if (type.IsArrayView()) {
+    return new MethodCall("::android::aidl::ReadArrayView",
+                          ArgList(vector<string>{(is_pointer ? "" : "&") + parcel, var_ptr}));
+  }
+  if (IsEnumArray(type, typenames)) {
+    return new MethodCall("::android::aidl::ReadEnumVector",
+                          ArgList(vector<string>{(is_pointer ? "" : "&") + parcel, var_ptr}));
+  }
+  if (type.IsFixedSizeArray()) {
+    return new MethodCall("::android::aidl::ReadFixedArray",
+                          ArgList(vector<string>{(is_pointer ? "" : "&") + parcel, var_ptr}));
+  }
+  if (type.IsSharedMemory()) {
+    return new MethodCall(string(kSharedMemoryNamespace) + "ReadBytes",
+                          ArgList(vector<string>{(is_pointer ? "" : "&") + parcel, var_ptr}));
+  }
+  return new MethodCall(parcel + (is_pointer ? "->" : ".") + ParcelReadMethodOf(type, typenames),
+                        ParcelReadCastOf(type, typenames, var_ptr));
+}
 
 unique_ptr<AstNode> BreakOnStatusNotOk() {
   IfStatement* ret = new IfStatement(new Comparison(
@@ -93,8 +196,52 @@ unique_ptr<AstNode> ReturnOnStatusNotOk() {
   return unique_ptr<AstNode>(ret);
 }
 
-ArgList BuildArgList(const AidlTypenames& typenames, const AidlMethod& method, bool for_declaration,
+// Adds the code that logs |method| to |b|, and to the size report if any
+void AddLogLiteral(StatementBlock* b, const AidlInterface& interface, const AidlMethod& method,
+                   const string& code) {
+  if (SizeReport* report = SizeReport::Current(); report != nullptr) {
+    report->Add("cpp", interface, &method, "log", code);
+  }
+  b->AddLiteral(code, false /* no semicolon */);
+}
+
+// Adds the code of |node| to |section| of the size report, if any
+void AddSize(const AidlDefinedType& type, const AidlMethod* method, const char* section,
+             const AstNode& node) {
+  SizeReport* report = SizeReport::Current();
+  if (report == nullptr) {
+    return;
+  }
+  string code;
+  CodeWriterPtr writer = CodeWriter::ForString(&code);
+  node.Write(writer.get());
+  writer->Close();
+  report->Add("cpp", type, method, section, code);
+}
+
+// Whether the in argument |a| is passed by reference rather than by value
+bool IsPassedByReference(const AidlArgument& a, const AidlTypenames& typenames) {
+  if (a.IsOut()) {
+    return false;
+  }
+  const auto definedType = typenames.TryGetDefinedType(a.GetType().GetName());
+
+  const bool isEnum = definedType && definedType->AsEnumDeclaration() != nullptr;
+  const bool isPrimitive = AidlTypenames::IsPrimitiveTypename(a.GetType().GetName());
+
+  // We pass in parameters that are not primitives by const reference.
+  // Arrays of primitives are not primitives, but their views are cheap.
+  return (!(isPrimitive || isEnum || IsNonCopyableType(a.GetType(), typenames)) ||
+          a.GetType().IsArray()) &&
+         !a.GetType().IsArrayView() && !a.GetType().IsStringView();
+}
+
+ArgList BuildArgList(const AidlTypenames& typenames, const AidlInterface& interface,
+                     const AidlMethod& method, const Options& options, bool for_declaration,
                      bool type_name_only = false) {
+  // With @MoveIn, the arguments passed by reference are rvalue references
+  // which the server moves its locals into.
+  const bool moves_in = MovesInArguments(interface, method);
   // Build up the argument list for the server method call.
   vector<string> method_arguments;
   for (const unique_ptr<AidlArgument>& a : method.GetArguments()) {
@@ -104,24 +251,16 @@ ArgList BuildArgList(const AidlTypenames& typenames, const AidlMethod& method, b
     // it beyond the scope of the call. unique_fd is a thin wrapper for an
     // int (fd) so passing by value is not expensive.
     const bool nonCopyable = IsNonCopyableType(a->GetType(), typenames);
+    const bool byReference = IsPassedByReference(*a, typenames);
     if (for_declaration) {
       // Method declarations need typenames, pointers to out params, and variable
       // names that match the .aidl specification.
-      literal = CppNameOf(a->GetType(), typenames);
+      literal = CppNameOf(a->GetType(), typenames, options);
 
       if (a->IsOut()) {
         literal = literal + "*";
-      } else {
-        const auto definedType = typenames.TryGetDefinedType(a->GetType().GetName());
-
-        const bool isEnum = definedType && definedType->AsEnumDeclaration() != nullptr;
-        const bool isPrimitive = AidlTypenames::IsPrimitiveTypename(a->GetType().GetName());
-
-        // We pass in parameters that are not primitives by const reference.
-        // Arrays of primitives are not primitives.
-        if (!(isPrimitive || isEnum || nonCopyable) || a->GetType().IsArray()) {
-          literal = "const " + literal + "&";
-        }
+      } else if (byReference) {
+        literal = moves_in ? literal + "&&" : "const " + literal + "&";
       }
       if (!type_name_only) {
         literal += " " + a->GetName();
@@ -130,7 +269,7 @@ ArgList BuildArgList(const AidlTypenames& typenames, const AidlMethod& method, b
       std::string varName = BuildVarName(*a);
       if (a->IsOut()) {
         literal = "&" + varName;
-      } else if (nonCopyable) {
+      } else if (nonCopyable || (byReference && moves_in)) {
         literal = "std::move(" + varName + ")";
       } else {
         literal = varName;
@@ -142,7 +281,7 @@ ArgList BuildArgList(const AidlTypenames& typenames, const AidlMethod& method, b
   if (method.GetType().GetName() != "void") {
     string literal;
     if (for_declaration) {
-      literal = CppNameOf(method.GetType(), typenames) + "*";
+      literal = CppNameOf(method.GetType(), typenames, options) + "*";
       if (!type_name_only) {
         literal += " " + string(kReturnVarName);
       }
@@ -155,7 +294,8 @@ ArgList BuildArgList(const AidlTypenames& typenames, const AidlMethod& method, b
   return ArgList(method_arguments);
 }
 
-unique_ptr<Declaration> BuildMethodDecl(const AidlMethod& method, const AidlTypenames& typenames,
+unique_ptr<Declaration> BuildMethodDecl(const AidlInterface& interface, const AidlMethod& method,
+                                        const AidlTypenames& typenames, const Options& options,
                                         bool for_interface) {
   uint32_t modifiers = 0;
   if (for_interface) {
@@ -166,8 +306,10 @@ unique_ptr<Declaration> BuildMethodDecl(const AidlMethod& method, const AidlType
   }
 
   return unique_ptr<Declaration>{
-      new MethodDecl{kBinderStatusLiteral, method.GetName(),
-                     BuildArgList(typenames, method, true /* for method decl */), modifiers}};
+      new MethodDecl{
+          kBinderStatusLiteral, method.GetName(),
+          BuildArgList(typenames, interface, method, options, true /* for method decl */),
+          modifiers}};
 }
 
 unique_ptr<Declaration> BuildMetaMethodDecl(const AidlMethod& method, const AidlTypenames&,
@@ -221,14 +363,52 @@ std::vector<unique_ptr<Declaration>> NestInNamespaces(unique_ptr<Declaration> de
   return NestInNamespaces(std::move(decls), package);
 }
 
-bool DeclareLocalVariable(const AidlArgument& a, StatementBlock* b,
-                          const AidlTypenames& typenamespaces) {
-  string type = CppNameOf(a.GetType(), typenamespaces);
+// The type of the local variable that a stub reads |a| into
+string LocalVariableType(const AidlArgument& a, const AidlTypenames& typenames,
+                         const Options& options) {
+  // A @StringView is read into a string, since the parcel holds UTF-16.
+  return a.GetType().IsStringView() ? "::std::string" : CppNameOf(a.GetType(), typenames, options);
+}
 
-  b->AddLiteral(type + " " + BuildVarName(a));
+bool DeclareLocalVariable(const AidlArgument& a, StatementBlock* b,
+                          const AidlTypenames& typenamespaces, const Options& options) {
+  b->AddLiteral(LocalVariableType(a, typenamespaces, options) + " " + BuildVarName(a));
   return true;
 }
 
+// pkg/Foo_fwd.h, the header of the forward declaration of Foo
+string FwdHeaderFile(const AidlDefinedType& defined_type, bool use_os_sep = true) {
+  const string header = HeaderFile(defined_type, ClassNames::RAW, use_os_sep);
+  return header.substr(0, header.size() - strlen(".h")) + "_fwd.h";
+}
+
+// The interfaces, structured parcelables and enums that the methods of
+// |interface| take or return. With --fwd-headers, IFoo.h only declares them.
+vector<const AidlDefinedType*> MethodTypes(const AidlTypenames& typenames,
+                                           const AidlInterface& interface) {
+  vector<const AidlDefinedType*> types;
+  auto add = [&](const AidlTypeSpecifier& raw_type) {
+    const AidlTypeSpecifier& type =
+        raw_type.IsGeneric() ? *raw_type.GetTypeParameters().at(0) : raw_type;
+    const AidlDefinedType* defined_type = typenames.TryGetDefinedType(type.GetName());
+    if (defined_type == nullptr ||
+        (defined_type->AsParcelable() != nullptr &&
+         defined_type->AsStructuredParcelable() == nullptr)) {
+      return;
+    }
+    if (std::find(types.begin(), types.end(), defined_type) == types.end()) {
+      types.push_back(defined_type);
+    }
+  };
+  for (const auto& method : interface.GetMethods()) {
+    for (const auto& argument : method->GetArguments()) {
+      add(argument->GetType());
+    }
+    add(method->GetType());
+  }
+  return types;
+}
+
 string BuildHeaderGuard(const AidlDefinedType& defined_type, ClassNames header_type) {
   string class_name = ClassName(defined_type, header_type);
   for (size_t i = 1; i < class_name.size(); ++i) {
@@ -254,10 +434,37 @@ unique_ptr<Declaration> DefineClientTransaction(const AidlTypenames& typenames,
   const string i_name = ClassName(interface, ClassNames::INTERFACE);
   const string bp_name = ClassName(interface, ClassNames::CLIENT);
   unique_ptr<MethodImpl> ret{
-      new MethodImpl{kBinderStatusLiteral, bp_name, method.GetName(),
-                     ArgList{BuildArgList(typenames, method, true /* for method decl */)}}};
+      new MethodImpl{
+          kBinderStatusLiteral, bp_name, method.GetName(),
+          BuildArgList(typenames, interface, method, options, true /* for method decl */)}};
   StatementBlock* b = ret->GetStatementBlock();
 
+  // A @Cacheable method returns the result that it already has for its in
+  // arguments, unless the interface has invalidated its caches since.
+  vector<string> cache_key;
+  if (method.GetType().IsCacheable()) {
+    for (const auto& a : method.GetArguments()) {
+      cache_key.push_back(a->GetName());
+    }
+    b->AddLiteral(StringPrintf("const uint64_t %s = %s::cacheGeneration.Get()",
+                               kCacheGenerationVarName, i_name.c_str()));
+    b->AddLiteral(StringPrintf("if (%s.Get(%s, ::std::tie(%s), %s)) {\n"
+                               "  return ::android::binder::Status::ok();\n"
+                               "}\n",
+                               CacheVarName(method).c_str(), kCacheGenerationVarName,
+                               Join(cache_key, ", ").c_str(), kReturnVarName),
+                  false /* no semicolon */);
+  }
+
+  // The queued calls of the @Batchable methods go before this one.
+  if (HasBatchableMethods(interface)) {
+    b->AddLiteral(StringPrintf("if (%s _aidl_flushed = %s(); !_aidl_flushed.isOk()) {\n"
+                               "  return _aidl_flushed;\n"
+                               "}\n",
+                               kBinderStatusLiteral, kFlushBatchedCalls.c_str()),
+                  false /* no semicolon */);
+  }
+
   // Declare parcels to hold our query and the response.
   b->AddLiteral(StringPrintf("%s %s", kAndroidParcelLiteral, kDataVarName));
   // Even if we're oneway, the transact method still takes a parcel.
@@ -275,10 +482,24 @@ unique_ptr<Declaration> DefineClientTransaction(const AidlTypenames& typenames,
                                kTraceVarName, interface.GetName().c_str(),
                                method.GetName().c_str()));
   }
+  if (options.GenPerfettoTraces()) {
+    b->AddLiteral(GenPerfettoTransaction(interface, method, "cppClient",
+                                         GetTransactionIdFor(method),
+                                         kReplyVarName + string(".dataSize()"),
+                                         kAndroidStatusVarName),
+                  false /* no semicolon */);
+    b->AddLiteral(GenPerfettoPhase("marshal"), false /* no semicolon */);
+  }
 
   if (options.GenLog()) {
-    b->AddLiteral(GenLogBeforeExecute(bp_name, method, false /* isServer */, false /* isNdk */),
-                  false /* no semicolon */);
+    AddLogLiteral(b, interface, method,
+                  GenLogBeforeExecute(bp_name, method, false /* isServer */, false /* isNdk */));
+  }
+  if (options.GenBinaryLog()) {
+    AddLogLiteral(b, interface, method, GenBinaryLogBeforeExecute());
+  }
+  if (options.GenStats()) {
+    b->AddLiteral(GenStatsTimer(interface, method, bp_name), false /* no semicolon */);
   }
 
   // Add the name of the interface we're hoping to call.
@@ -289,28 +510,47 @@ unique_ptr<Declaration> DefineClientTransaction(const AidlTypenames& typenames,
                      "getInterfaceDescriptor()")));
   b->AddStatement(GotoErrorOnBadStatus());
 
-  for (const auto& a: method.GetArguments()) {
-    const string var_name = ((a->IsOut()) ? "*" : "") + a->GetName();
+  vector<std::pair<const AidlTypeSpecifier*, string>> in_args;
+  for (const auto& a : method.GetInArguments()) {
+    in_args.emplace_back(&a->GetType(), a->IsOut() ? "(*" + a->GetName() + ")" : a->GetName());
+  }
+  if (const string hint = SetDataCapacityFor(in_args, typenames, kDataVarName, false);
+      !hint.empty()) {
+    b->AddLiteral(hint);
+  }
 
-    if (a->IsIn()) {
-      // Serialization looks roughly like:
-      //     _aidl_ret_status = _aidl_data.WriteInt32(in_param_name);
-      //     if (_aidl_ret_status != ::android::OK) { goto error; }
-      const string& method = ParcelWriteMethodOf(a->GetType(), typenames);
-      b->AddStatement(
-          new Assignment(kAndroidStatusVarName,
-                         new MethodCall(StringPrintf("%s.%s", kDataVarName, method.c_str()),
-                                        ParcelWriteCastOf(a->GetType(), typenames, var_name))));
-      b->AddStatement(GotoErrorOnBadStatus());
-    } else if (a->IsOut() && a->GetType().IsArray()) {
-      // Special case, the length of the out array is written into the parcel.
-      //     _aidl_ret_status = _aidl_data.writeVectorSize(&out_param_name);
-      //     if (_aidl_ret_status != ::android::OK) { goto error; }
-      b->AddStatement(new Assignment(
-          kAndroidStatusVarName,
-          new MethodCall(StringPrintf("%s.writeVectorSize", kDataVarName), var_name)));
+  const bool with_tables = MarshalsWithTables(method, options);
+  const auto arg_name = [](const AidlArgument& a) { return a.GetName(); };
+  if (with_tables) {
+    if (const string write = GenMarshalCall(interface, method, false /* request */,
+                                            true /* write */, true /* is_proxy */,
+                                            "&" + string(kDataVarName), arg_name);
+        !write.empty()) {
+      b->AddLiteral(write, false /* no semicolon */);
       b->AddStatement(GotoErrorOnBadStatus());
     }
+  } else {
+    for (const auto& a : method.GetArguments()) {
+      const string var_name = ((a->IsOut()) ? "*" : "") + a->GetName();
+
+      if (a->IsIn()) {
+        // Serialization looks roughly like:
+        //     _aidl_ret_status = _aidl_data.WriteInt32(in_param_name);
+        //     if (_aidl_ret_status != ::android::OK) { goto error; }
+        b->AddStatement(new Assignment(
+            kAndroidStatusVarName,
+            ParcelWriteCall(a->GetType(), typenames, kDataVarName, false, var_name)));
+        b->AddStatement(GotoErrorOnBadStatus());
+      } else if (a->IsOut() && a->GetType().IsArray()) {
+        // Special case, the length of the out array is written into the parcel.
+        //     _aidl_ret_status = _aidl_data.writeVectorSize(&out_param_name);
+        //     if (_aidl_ret_status != ::android::OK) { goto error; }
+        b->AddStatement(new Assignment(
+            kAndroidStatusVarName,
+            new MethodCall(StringPrintf("%s.writeVectorSize", kDataVarName), var_name)));
+        b->AddStatement(GotoErrorOnBadStatus());
+      }
+    }
   }
 
   // Invoke the transaction on the remote binder and confirm status.
@@ -323,16 +563,26 @@ unique_ptr<Declaration> DefineClientTransaction(const AidlTypenames& typenames,
     args.push_back("::android::IBinder::FLAG_ONEWAY");
   }
 
+  if (options.GenPerfettoTraces()) {
+    b->AddLiteral(GenPerfettoRequestBytes(kDataVarName + string(".dataSize()")),
+                  false /* no semicolon */);
+    b->AddLiteral(GenPerfettoPhase("transact"), false /* no semicolon */);
+  }
   b->AddStatement(new Assignment(
       kAndroidStatusVarName,
       new MethodCall("remote()->transact",
                      ArgList(args))));
+  if (options.GenPerfettoTraces()) {
+    b->AddLiteral(GenPerfettoPhase("unmarshal"), false /* no semicolon */);
+  }
 
   // If the method is not implemented in the remote side, try to call the
   // default implementation, if provided.
+  const bool moves_in = MovesInArguments(interface, method);
   vector<string> arg_names;
   for (const auto& a : method.GetArguments()) {
-    if (IsNonCopyableType(a->GetType(), typenames)) {
+    if (IsNonCopyableType(a->GetType(), typenames) ||
+        (moves_in && IsPassedByReference(*a, typenames))) {
       arg_names.emplace_back(StringPrintf("std::move(%s)", a->GetName().c_str()));
     } else {
       arg_names.emplace_back(a->GetName());
@@ -370,27 +620,40 @@ unique_ptr<Declaration> DefineClientTransaction(const AidlTypenames& typenames,
   // Type checking should guarantee that nothing below emits code until "return
   // status" if we are a oneway method, so no more fear of accessing reply.
 
+  if (with_tables) {
+    if (const string read = GenMarshalCall(interface, method, true /* reply */,
+                                           false /* read */, true /* is_proxy */,
+                                           kReplyVarName, arg_name);
+        !read.empty()) {
+      b->AddLiteral(read, false /* no semicolon */);
+      b->AddStatement(GotoErrorOnBadStatus());
+    }
+  }
+
   // If the method is expected to return something, read it first by convention.
-  if (method.GetType().GetName() != "void") {
-    const string& method_call = ParcelReadMethodOf(method.GetType(), typenames);
-    b->AddStatement(new Assignment(
-        kAndroidStatusVarName,
-        new MethodCall(StringPrintf("%s.%s", kReplyVarName, method_call.c_str()),
-                       ParcelReadCastOf(method.GetType(), typenames, kReturnVarName))));
+  if (method.GetType().GetName() != "void" && !with_tables) {
+    b->AddStatement(new Assignment(kAndroidStatusVarName,
+                                   ParcelReadCall(method.GetType(), typenames, kReplyVarName,
+                                                  false /* is_pointer */, kReturnVarName)));
     b->AddStatement(GotoErrorOnBadStatus());
   }
 
-  for (const AidlArgument* a : method.GetOutArguments()) {
-    // Deserialization looks roughly like:
-    //     _aidl_ret_status = _aidl_reply.ReadInt32(out_param_name);
-    //     if (_aidl_status != ::android::OK) { goto _aidl_error; }
-    string method = ParcelReadMethodOf(a->GetType(), typenames);
+  if (!with_tables) {
+    for (const AidlArgument* a : method.GetOutArguments()) {
+      // Deserialization looks roughly like:
+      //     _aidl_ret_status = _aidl_reply.ReadInt32(out_param_name);
+      //     if (_aidl_status != ::android::OK) { goto _aidl_error; }
+      b->AddStatement(new Assignment(kAndroidStatusVarName,
+                                     ParcelReadCall(a->GetType(), typenames, kReplyVarName,
+                                                    false /* is_pointer */, a->GetName())));
+      b->AddStatement(GotoErrorOnBadStatus());
+    }
+  }
 
-    b->AddStatement(
-        new Assignment(kAndroidStatusVarName,
-                       new MethodCall(StringPrintf("%s.%s", kReplyVarName, method.c_str()),
-                                      ParcelReadCastOf(a->GetType(), typenames, a->GetName()))));
-    b->AddStatement(GotoErrorOnBadStatus());
+  if (method.GetType().IsCacheable()) {
+    b->AddLiteral(StringPrintf("%s.Put(%s, ::std::tie(%s), *%s)", CacheVarName(method).c_str(),
+                               kCacheGenerationVarName, Join(cache_key, ", ").c_str(),
+                               kReturnVarName));
   }
 
   // If we've gotten to here, one of two things is true:
@@ -404,8 +667,22 @@ unique_ptr<Declaration> DefineClientTransaction(const AidlTypenames& typenames,
                    kAndroidStatusVarName));
 
   if (options.GenLog()) {
-    b->AddLiteral(GenLogAfterExecute(bp_name, interface, method, kStatusVarName, kReturnVarName,
-                                     false /* isServer */, false /* isNdk */),
+    AddLogLiteral(b, interface, method,
+                  GenLogAfterExecute(bp_name, interface, method, kStatusVarName, kReturnVarName,
+                                     false /* isServer */, false /* isNdk */));
+  }
+  if (options.GenBinaryLog()) {
+    AddLogLiteral(b, interface, method,
+                  GenBinaryLogAfterExecute(interface, method, kStatusVarName,
+                                           "static_cast<const void*>(this)",
+                                           kDataVarName + string(".dataSize()"),
+                                           kReplyVarName + string(".dataSize()"),
+                                           false /* isServer */, false /* isNdk */));
+  }
+  if (options.GenParcelSizes()) {
+    b->AddLiteral(GenStatsRecordSizes(interface, method, bp_name,
+                                      kDataVarName + string(".dataSize()"),
+                                      kReplyVarName + string(".dataSize()")),
                   false /* no semicolon */);
   }
 
@@ -414,6 +691,117 @@ unique_ptr<Declaration> DefineClientTransaction(const AidlTypenames& typenames,
   return unique_ptr<Declaration>(ret.release());
 }
 
+// A @Batchable method appends its call to the batch of the proxy, which is
+// sent once it is full, old or flushed: the interface token and the number of
+// the calls, followed by the code and the in arguments of each call.
+unique_ptr<Declaration> DefineClientBatchedTransaction(const AidlTypenames& typenames,
+                                                       const AidlInterface& interface,
+                                                       const AidlMethod& method,
+                                                       const Options& options) {
+  const string bp_name = ClassName(interface, ClassNames::CLIENT);
+  unique_ptr<MethodImpl> ret{
+      new MethodImpl{kBinderStatusLiteral, bp_name, method.GetName(),
+                     BuildArgList(typenames, interface, method, options, true /* for decl */)}};
+  StatementBlock* b = ret->GetStatementBlock();
+
+  b->AddLiteral("std::lock_guard<std::mutex> _aidl_lock(batch_mutex_)");
+  b->AddLiteral(StringPrintf("const size_t _aidl_start = %s.dataSize()", kBatchVarName));
+  b->AddLiteral(StringPrintf("%s %s = %s", kAndroidStatusLiteral, kAndroidStatusVarName,
+                             kAndroidStatusOk));
+
+  IfStatement* first_call = new IfStatement(new LiteralExpression("batch_calls_ == 0"));
+  b->AddStatement(first_call);
+  first_call->OnTrue()->AddStatement(new Assignment(
+      kAndroidStatusVarName,
+      new MethodCall(StringPrintf("%s.writeInterfaceToken", kBatchVarName),
+                     "getInterfaceDescriptor()")));
+  first_call->OnTrue()->AddStatement(GotoErrorOnBadStatus());
+  // The number of the calls is filled in when the batch is sent
+  first_call->OnTrue()->AddLiteral(
+      StringPrintf("batch_count_position_ = %s.dataPosition()", kBatchVarName));
+  first_call->OnTrue()->AddStatement(new Assignment(
+      kAndroidStatusVarName, new MethodCall(StringPrintf("%s.writeInt32", kBatchVarName), "0")));
+  first_call->OnTrue()->AddStatement(GotoErrorOnBadStatus());
+
+  b->AddStatement(new Assignment(
+      kAndroidStatusVarName,
+      new MethodCall(StringPrintf("%s.writeUint32", kBatchVarName),
+                     GetTransactionIdFor(method))));
+  b->AddStatement(GotoErrorOnBadStatus());
+  for (const auto& a : method.GetArguments()) {
+    b->AddStatement(new Assignment(
+        kAndroidStatusVarName,
+        ParcelWriteCall(a->GetType(), typenames, kBatchVarName, false, a->GetName())));
+    b->AddStatement(GotoErrorOnBadStatus());
+  }
+  b->AddLiteral("++batch_calls_");
+  // The first call of a batch schedules its flush, which keeps the proxy
+  // alive until then. A flush that runs after the batch was sent finds the
+  // deadline of the next batch ahead, and leaves it.
+  b->AddLiteral(StringPrintf(
+                    "if (batch_calls_ == 1) {\n"
+                    "  batch_deadline_ = %sClock::now() + %skMaxDelay;\n"
+                    "  %sDefault().Schedule(batch_deadline_, [_aidl_self = "
+                    "::android::sp<%s>(this)]() {\n"
+                    "    std::lock_guard<std::mutex> _aidl_lock(_aidl_self->batch_mutex_);\n"
+                    "    if (%sClock::now() >= _aidl_self->batch_deadline_) {\n"
+                    "      _aidl_self->flushBatchLocked();\n"
+                    "    }\n"
+                    "  });\n"
+                    "}\n",
+                    kBatchTimer, kBatchTimer, kBatchTimer, bp_name.c_str(), kBatchTimer),
+                false /* no semicolon */);
+  b->AddLiteral(StringPrintf("if (batch_calls_ >= %d || %s.dataSize() >= %d ||\n"
+                             "    %sClock::now() >= batch_deadline_) {\n"
+                             "  %s = flushBatchLocked();\n"
+                             "}\n",
+                             kMaxBatchedCalls, kBatchVarName, kMaxBatchBytes, kBatchTimer,
+                             kAndroidStatusVarName),
+                false /* no semicolon */);
+  b->AddLiteral(StringPrintf("return %s::fromStatusT(%s)", kBinderStatusLiteral,
+                             kAndroidStatusVarName));
+
+  // A call that could not be written is dropped from the batch.
+  b->AddLiteral(StringPrintf("%s:\n", kErrorLabel), false /* no semicolon */);
+  b->AddLiteral(StringPrintf("%s.setDataSize(_aidl_start)", kBatchVarName));
+  b->AddLiteral(StringPrintf("%s.setDataPosition(_aidl_start)", kBatchVarName));
+  b->AddLiteral(StringPrintf("return %s::fromStatusT(%s)", kBinderStatusLiteral,
+                             kAndroidStatusVarName));
+  return unique_ptr<Declaration>(ret.release());
+}
+
+// The proxy of an interface with @Batchable methods sends its batch when it
+// is flushed, before each other call, once its first call has waited for
+// BatchTimer::kMaxDelay and when it is destroyed.
+string DefineClientBatchFlush(const AidlInterface& interface) {
+  const string bp_name = ClassName(interface, ClassNames::CLIENT);
+  std::ostringstream code;
+  code << bp_name << "::~" << bp_name << "() {\n"
+       << "  " << kFlushBatchedCalls << "();\n"
+       << "}\n"
+       << kBinderStatusLiteral << " " << bp_name << "::" << kFlushBatchedCalls << "() {\n"
+       << "  std::lock_guard<std::mutex> _aidl_lock(batch_mutex_);\n"
+       << "  return " << kBinderStatusLiteral << "::fromStatusT(flushBatchLocked());\n"
+       << "}\n"
+       << kAndroidStatusLiteral << " " << bp_name << "::flushBatchLocked() {\n"
+       << "  if (batch_calls_ == 0) {\n"
+       << "    return " << kAndroidStatusOk << ";\n"
+       << "  }\n"
+       << "  const size_t _aidl_end = " << kBatchVarName << ".dataPosition();\n"
+       << "  " << kBatchVarName << ".setDataPosition(batch_count_position_);\n"
+       << "  " << kBatchVarName << ".writeInt32(batch_calls_);\n"
+       << "  " << kBatchVarName << ".setDataPosition(_aidl_end);\n"
+       << "  " << kAndroidParcelLiteral << " " << kReplyVarName << ";\n"
+       << "  " << kAndroidStatusLiteral << " " << kAndroidStatusVarName
+       << " = remote()->transact(" << BatchTransactionId() << ", " << kBatchVarName << ", &"
+       << kReplyVarName << ", ::android::IBinder::FLAG_ONEWAY);\n"
+       << "  " << kBatchVarName << ".freeData();\n"
+       << "  batch_calls_ = 0;\n"
+       << "  return " << kAndroidStatusVarName << ";\n"
+       << "}\n";
+  return code.str();
+}
+
 unique_ptr<Declaration> DefineClientMetaTransaction(const AidlTypenames& /* typenames */,
                                                     const AidlInterface& interface,
                                                     const AidlMethod& method,
@@ -422,13 +810,12 @@ unique_ptr<Declaration> DefineClientMetaTransaction(const AidlTypenames& /* type
   if (method.GetName() == kGetInterfaceVersion && options.Version() > 0) {
     const string iface = ClassName(interface, ClassNames::INTERFACE);
     const string proxy = ClassName(interface, ClassNames::CLIENT);
-    // Note: race condition can happen here, but no locking is required
-    // because 1) writing an interger is atomic and 2) this transaction
-    // will always return the same value, i.e., competing threads will
-    // give write the same value to cached_version_.
+    // Competing first calls all store the same value, so it is published
+    // without a lock, and later calls only load it.
     std::ostringstream code;
     code << "int32_t " << proxy << "::" << kGetInterfaceVersion << "() {\n"
-         << "  if (cached_version_ == -1) {\n"
+         << "  int32_t _aidl_version = cached_version_.load(std::memory_order_acquire);\n"
+         << "  if (_aidl_version == -1) {\n"
          << "    ::android::Parcel data;\n"
          << "    ::android::Parcel reply;\n"
          << "    data.writeInterfaceToken(getInterfaceDescriptor());\n"
@@ -438,11 +825,12 @@ unique_ptr<Declaration> DefineClientMetaTransaction(const AidlTypenames& /* type
          << "      ::android::binder::Status _aidl_status;\n"
          << "      err = _aidl_status.readFromParcel(reply);\n"
          << "      if (err == ::android::OK && _aidl_status.isOk()) {\n"
-         << "        cached_version_ = reply.readInt32();\n"
+         << "        _aidl_version = reply.readInt32();\n"
+         << "        cached_version_.store(_aidl_version, std::memory_order_release);\n"
          << "      }\n"
          << "    }\n"
          << "  }\n"
-         << "  return cached_version_;\n"
+         << "  return _aidl_version;\n"
          << "}\n";
     return unique_ptr<Declaration>(new LiteralDecl(code.str()));
   }
@@ -450,23 +838,33 @@ unique_ptr<Declaration> DefineClientMetaTransaction(const AidlTypenames& /* type
     const string iface = ClassName(interface, ClassNames::INTERFACE);
     const string proxy = ClassName(interface, ClassNames::CLIENT);
     std::ostringstream code;
+    // The first call that gets the hash publishes it: it claims the cache,
+    // fills it and marks it published. Competing first calls return their own
+    // copies, so no call waits for another.
     code << "std::string " << proxy << "::" << kGetInterfaceHash << "() {\n"
-         << "  std::lock_guard<std::mutex> lockGuard(cached_hash_mutex_);\n"
-         << "  if (cached_hash_ == \"-1\") {\n"
-         << "    ::android::Parcel data;\n"
-         << "    ::android::Parcel reply;\n"
-         << "    data.writeInterfaceToken(getInterfaceDescriptor());\n"
-         << "    ::android::status_t err = remote()->transact(" << GetTransactionIdFor(method)
+         << "  if (cached_hash_state_.load(std::memory_order_acquire) == 2) {\n"
+         << "    return cached_hash_;\n"
+         << "  }\n"
+         << "  std::string _aidl_hash = \"-1\";\n"
+         << "  ::android::Parcel data;\n"
+         << "  ::android::Parcel reply;\n"
+         << "  data.writeInterfaceToken(getInterfaceDescriptor());\n"
+         << "  ::android::status_t err = remote()->transact(" << GetTransactionIdFor(method)
          << ", data, &reply);\n"
-         << "    if (err == ::android::OK) {\n"
-         << "      ::android::binder::Status _aidl_status;\n"
-         << "      err = _aidl_status.readFromParcel(reply);\n"
-         << "      if (err == ::android::OK && _aidl_status.isOk()) {\n"
-         << "        reply.readUtf8FromUtf16(&cached_hash_);\n"
+         << "  if (err == ::android::OK) {\n"
+         << "    ::android::binder::Status _aidl_status;\n"
+         << "    err = _aidl_status.readFromParcel(reply);\n"
+         << "    if (err == ::android::OK && _aidl_status.isOk()) {\n"
+         << "      reply.readUtf8FromUtf16(&_aidl_hash);\n"
+         << "      int _aidl_unset = 0;\n"
+         << "      if (cached_hash_state_.compare_exchange_strong(_aidl_unset, 1,\n"
+         << "                                                     std::memory_order_acquire)) {\n"
+         << "        cached_hash_ = _aidl_hash;\n"
+         << "        cached_hash_state_.store(2, std::memory_order_release);\n"
          << "      }\n"
          << "    }\n"
          << "  }\n"
-         << "  return cached_hash_;\n"
+         << "  return _aidl_hash;\n"
          << "}\n";
     return unique_ptr<Declaration>(new LiteralDecl(code.str()));
   }
@@ -475,8 +873,8 @@ unique_ptr<Declaration> DefineClientMetaTransaction(const AidlTypenames& /* type
 
 }  // namespace
 
-unique_ptr<Document> BuildClientSource(const AidlTypenames& typenames,
-                                       const AidlInterface& interface, const Options& options) {
+bool WriteClientSource(const AidlTypenames& typenames, const AidlInterface& interface,
+                       const Options& options, CodeWriter* to) {
   vector<string> include_list = {
       HeaderFile(interface, ClassNames::CLIENT, false),
       kParcelHeader,
@@ -487,16 +885,21 @@ unique_ptr<Document> BuildClientSource(const AidlTypenames& typenames,
     include_list.emplace_back("functional");
     include_list.emplace_back("json/value.h");
   }
-  vector<unique_ptr<Declaration>> file_decls;
+  if (options.GenBinaryLog()) {
+    include_list.emplace_back("aidl/binary_log.h");
+  }
+  if (options.GenPerfettoTraces()) {
+    include_list.emplace_back("aidl/trace_events.h");
+  }
+  CppSourceWriter source(to, include_list, interface.GetSplitPackage());
 
   // The constructor just passes the IBinder instance up to the super
   // class.
   const string i_name = ClassName(interface, ClassNames::INTERFACE);
-  file_decls.push_back(unique_ptr<Declaration>{new ConstructorImpl{
+  source.Write(ConstructorImpl{
       ClassName(interface, ClassNames::CLIENT),
-      ArgList{StringPrintf("const ::android::sp<::android::IBinder>& %s",
-                           kImplVarName)},
-      { "BpInterface<" + i_name + ">(" + kImplVarName + ")" }}});
+      ArgList{StringPrintf("const ::android::sp<::android::IBinder>& %s", kImplVarName)},
+      {"BpInterface<" + i_name + ">(" + kImplVarName + ")"}});
 
   if (options.GenLog()) {
     string code;
@@ -505,74 +908,148 @@ unique_ptr<Document> BuildClientSource(const AidlTypenames& typenames,
     (*writer) << "std::function<void(const Json::Value&)> "
               << ClassName(interface, ClassNames::CLIENT) << "::logFunc;\n";
     writer->Close();
-    file_decls.push_back(unique_ptr<Declaration>(new LiteralDecl(code)));
+    source.Write(LiteralDecl(code));
+  }
+  if (options.GenStats()) {
+    source.Write(LiteralDecl(GenStatsTable(interface, ClassName(interface, ClassNames::CLIENT),
+                                           "::android::IBinder::FIRST_CALL_TRANSACTION")));
   }
 
-  // Clients define a method per transaction.
+  // Clients define a method per transaction, which is written out before
+  // the next one is built.
+  if (HasBatchableMethods(interface)) {
+    source.Write(LiteralDecl(DefineClientBatchFlush(interface)));
+  }
   for (const auto& method : interface.GetMethods()) {
     unique_ptr<Declaration> m;
-    if (method->IsUserDefined()) {
+    if (method->GetType().IsBatchable()) {
+      m = DefineClientBatchedTransaction(typenames, interface, *method, options);
+    } else if (method->IsUserDefined()) {
       m = DefineClientTransaction(typenames, interface, *method, options);
     } else {
       m = DefineClientMetaTransaction(typenames, interface, *method, options);
     }
-    if (!m) { return nullptr; }
-    file_decls.push_back(std::move(m));
+    if (!m) { return false; }
+    SizeScope size(*to, "cpp", interface, method.get(), "proxy");
+    source.Write(*m);
   }
-  return unique_ptr<Document>{new CppSource{
-      include_list,
-      NestInNamespaces(std::move(file_decls), interface.GetSplitPackage())}};
+  source.Close();
+  return true;
 }
 
 namespace {
 
+// The interface token of |interface|, which the stubs compare with the token
+// of each request. It is encoded once in the source, so that the checks do
+// not build a String16 from getInterfaceDescriptor() on each transaction.
+string InterfaceTokenVarName(const AidlInterface& interface) {
+  return "_aidl_" + ClassName(interface, ClassNames::INTERFACE) + "_token";
+}
+
+string InterfaceTokenDecl(const AidlInterface& interface) {
+  return "static constexpr char16_t " + InterfaceTokenVarName(interface) + "[] = u\"" +
+         interface.GetCanonicalName() + "\";\n";
+}
+
+// The check of the interface token of a request, which compares the lengths
+// of the tokens before their characters
+string CheckInterfaceToken(const AidlInterface& interface) {
+  return StringPrintf("%s.enforceInterface(%s, %zu)", kDataVarName,
+                      InterfaceTokenVarName(interface).c_str(),
+                      interface.GetCanonicalName().size());
+}
+
+// A call in a batch of @Batchable calls is read after the interface token of
+// the batch, so |in_batch| leaves out the check of the token.
 bool HandleServerTransaction(const AidlTypenames& typenames, const AidlInterface& interface,
-                             const AidlMethod& method, const Options& options, StatementBlock* b) {
+                             const AidlMethod& method, const Options& options, bool in_batch,
+                             StatementBlock* b) {
+  if (options.GenPerfettoTraces()) {
+    b->AddLiteral(GenPerfettoTransaction(interface, method, "cppServer",
+                                         GetTransactionIdFor(method),
+                                         kReplyVarName + string("->dataSize()"),
+                                         kAndroidStatusVarName),
+                  false);
+    b->AddLiteral(GenPerfettoPhase("unmarshal"), false);
+  }
+
   // Declare all the parameters now.  In the common case, we expect no errors
   // in serialization.
   for (const unique_ptr<AidlArgument>& a : method.GetArguments()) {
-    if (!DeclareLocalVariable(*a, b, typenames)) {
+    if (!DeclareLocalVariable(*a, b, typenames, options)) {
       return false;
     }
   }
 
   // Declare a variable to hold the return value.
   if (method.GetType().GetName() != "void") {
-    string type = CppNameOf(method.GetType(), typenames);
+    string type = CppNameOf(method.GetType(), typenames, options);
     b->AddLiteral(StringPrintf("%s %s", type.c_str(), kReturnVarName));
   }
 
   // Check that the client is calling the correct interface.
-  IfStatement* interface_check = new IfStatement(
-      new MethodCall(StringPrintf("%s.checkInterface",
-                                  kDataVarName), "this"),
-      true /* invert the check */);
-  b->AddStatement(interface_check);
-  interface_check->OnTrue()->AddStatement(
-      new Assignment(kAndroidStatusVarName, "::android::BAD_TYPE"));
-  interface_check->OnTrue()->AddLiteral("break");
+  if (!in_batch) {
+    IfStatement* interface_check =
+        new IfStatement(new LiteralExpression(CheckInterfaceToken(interface)),
+                        true /* invert the check */);
+    b->AddStatement(interface_check);
+    interface_check->OnTrue()->AddStatement(
+        new Assignment(kAndroidStatusVarName, "::android::BAD_TYPE"));
+    interface_check->OnTrue()->AddLiteral("break");
+  }
+
+  // Arguments of a known size are read without a check of each read once
+  // the request is known to hold them, and with the checks otherwise:
+  //     if (_aidl_data.dataAvail() >= 12) {
+  //       in_x = _aidl_data.readInt32();
+  //       in_y = _aidl_data.readInt64();
+  //     } else { ... }
+  // With --marshal=tables, a program reads them all instead.
+  const bool with_tables = MarshalsWithTables(method, options);
+  const auto var_name = [](const AidlArgument& a) { return BuildVarName(a); };
+  if (with_tables) {
+    if (const string read = GenMarshalCall(interface, method, false /* request */,
+                                           false /* read */, false /* is_proxy */, kDataVarName,
+                                           var_name);
+        !read.empty()) {
+      b->AddLiteral(read, false);
+      b->AddStatement(BreakOnStatusNotOk());
+    }
+  }
+  StatementBlock* reads = b;
+  if (const size_t size = with_tables ? 0 : FixedSizeArgumentsSize(method); size > 0) {
+    IfStatement* fast_path = new IfStatement(
+        new LiteralExpression(StringPrintf("%s.dataAvail() >= %zu", kDataVarName, size)));
+    b->AddStatement(fast_path);
+    for (const auto& a : method.GetArguments()) {
+      fast_path->OnTrue()->AddLiteral(StringPrintf(
+          "%s = %s.%s()", BuildVarName(*a).c_str(), kDataVarName,
+          ParcelReadMethodOf(a->GetType(), typenames).c_str()));
+    }
+    reads = fast_path->OnFalse();
+  }
 
   // Deserialize each "in" parameter to the transaction.
-  for (const auto& a: method.GetArguments()) {
-    // Deserialization looks roughly like:
-    //     _aidl_ret_status = _aidl_data.ReadInt32(&in_param_name);
-    //     if (_aidl_ret_status != ::android::OK) { break; }
-    const string& var_name = "&" + BuildVarName(*a);
-    if (a->IsIn()) {
-      const string& readMethod = ParcelReadMethodOf(a->GetType(), typenames);
-      b->AddStatement(
-          new Assignment{kAndroidStatusVarName,
-                         new MethodCall{string(kDataVarName) + "." + readMethod,
-                                        ParcelReadCastOf(a->GetType(), typenames, var_name)}});
-      b->AddStatement(BreakOnStatusNotOk());
-    } else if (a->IsOut() && a->GetType().IsArray()) {
-      // Special case, the length of the out array is written into the parcel.
-      //     _aidl_ret_status = _aidl_data.resizeOutVector(&out_param_name);
+  if (!with_tables) {
+    for (const auto& a : method.GetArguments()) {
+      // Deserialization looks roughly like:
+      //     _aidl_ret_status = _aidl_data.ReadInt32(&in_param_name);
       //     if (_aidl_ret_status != ::android::OK) { break; }
-      b->AddStatement(
-          new Assignment{kAndroidStatusVarName,
-                         new MethodCall{string(kDataVarName) + ".resizeOutVector", var_name}});
-      b->AddStatement(BreakOnStatusNotOk());
+      const string& var_name = "&" + BuildVarName(*a);
+      if (a->IsIn()) {
+        reads->AddStatement(new Assignment{
+            kAndroidStatusVarName,
+            ParcelReadCall(a->GetType(), typenames, kDataVarName, false, var_name)});
+        reads->AddStatement(BreakOnStatusNotOk());
+      } else if (a->IsOut() && a->GetType().IsArray()) {
+        // Special case, the length of the out array is written into the parcel.
+        //     _aidl_ret_status = _aidl_data.resizeOutVector(&out_param_name);
+        //     if (_aidl_ret_status != ::android::OK) { break; }
+        b->AddStatement(
+            new Assignment{kAndroidStatusVarName,
+                           new MethodCall{string(kDataVarName) + ".resizeOutVector", var_name}});
+        b->AddStatement(BreakOnStatusNotOk());
+      }
     }
   }
 
@@ -585,13 +1062,47 @@ bool HandleServerTransaction(const AidlTypenames& typenames, const AidlInterface
   }
   const string bn_name = ClassName(interface, ClassNames::SERVER);
   if (options.GenLog()) {
-    b->AddLiteral(GenLogBeforeExecute(bn_name, method, true /* isServer */, false /* isNdk */),
-                  false);
+    AddLogLiteral(b, interface, method,
+                  GenLogBeforeExecute(bn_name, method, true /* isServer */, false /* isNdk */));
+  }
+  if (options.GenBinaryLog()) {
+    AddLogLiteral(b, interface, method,
+                  GenCaptureRequest(interface, method, GetTransactionIdFor(method), kDataVarName,
+                                    false /* isNdk */));
+    AddLogLiteral(b, interface, method, GenBinaryLogBeforeExecute());
+  }
+  if (options.GenStats()) {
+    // The timer runs until the reply is written.
+    b->AddLiteral(GenStatsTimer(interface, method, bn_name), false);
+  }
+  if (options.GenPerfettoTraces()) {
+    b->AddLiteral(GenPerfettoRequestBytes(kDataVarName + string(".dataSize()")), false);
+    b->AddLiteral(GenPerfettoPhase("execute"), false);
   }
   // Call the actual method.  This is implemented by the subclass.
   vector<unique_ptr<AstNode>> status_args;
   status_args.emplace_back(new MethodCall(
-      method.GetName(), BuildArgList(typenames, method, false /* not for method decl */)));
+      method.GetName(),
+      BuildArgList(typenames, interface, method, options, false /* not for method decl */)));
+  if (method.GetType().IsSingleFlight()) {
+    // Unless a call with equal in arguments is under way, whose status and
+    // result are copied instead:
+    //     _aidl_flight_m.Do(::std::tie(in_x), &_aidl_return, [&]() { return m(...); })
+    vector<string> key;
+    for (const auto& a : method.GetArguments()) {
+      key.push_back(BuildVarName(*a));
+    }
+    string call;
+    CodeWriterPtr writer = CodeWriter::ForString(&call);
+    status_args.back()->Write(writer.get());
+    writer->Close();
+    status_args.back().reset(new LiteralExpression(StringPrintf(
+        "%s.Do(::std::tie(%s), %s, [&]() { return %s; })", FlightVarName(method).c_str(),
+        Join(key, ", ").c_str(),
+        method.GetType().GetName() != "void" ? ("&" + string(kReturnVarName)).c_str()
+                                             : "nullptr",
+        call.c_str())));
+  }
   b->AddStatement(new Statement(new MethodCall(
       StringPrintf("%s %s", kBinderStatusLiteral, kStatusVarName),
       ArgList(std::move(status_args)))));
@@ -600,11 +1111,22 @@ bool HandleServerTransaction(const AidlTypenames& typenames, const AidlInterface
     b->AddStatement(new Statement(new MethodCall("atrace_end",
                                                  "ATRACE_TAG_AIDL")));
   }
+  if (options.GenPerfettoTraces()) {
+    b->AddLiteral(GenPerfettoPhase("marshal"), false);
+  }
 
   if (options.GenLog()) {
-    b->AddLiteral(GenLogAfterExecute(bn_name, interface, method, kStatusVarName, kReturnVarName,
-                                     true /* isServer */, false /* isNdk */),
-                  false);
+    AddLogLiteral(b, interface, method,
+                  GenLogAfterExecute(bn_name, interface, method, kStatusVarName, kReturnVarName,
+                                     true /* isServer */, false /* isNdk */));
+  }
+  if (options.GenBinaryLog()) {
+    // The reply is only written after this.
+    AddLogLiteral(b, interface, method,
+                  GenBinaryLogAfterExecute(interface, method, kStatusVarName,
+                                           "static_cast<const void*>(this)",
+                                           kDataVarName + string(".dataSize()"), "0",
+                                           true /* isServer */, false /* isNdk */));
   }
 
   // Write exceptions during transaction handling to parcel.
@@ -619,32 +1141,57 @@ bool HandleServerTransaction(const AidlTypenames& typenames, const AidlInterface
     exception_check->OnTrue()->AddLiteral("break");
   }
 
+  if (with_tables && !method.IsOneway()) {
+    if (const string write = GenMarshalCall(interface, method, true /* reply */,
+                                            true /* write */, false /* is_proxy */,
+                                            kReplyVarName, var_name);
+        !write.empty()) {
+      b->AddLiteral(write, false);
+      b->AddStatement(BreakOnStatusNotOk());
+    }
+  }
+
   // If we have a return value, write it first.
-  if (method.GetType().GetName() != "void") {
-    string writeMethod =
-        string(kReplyVarName) + "->" + ParcelWriteMethodOf(method.GetType(), typenames);
-    b->AddStatement(new Assignment(
-        kAndroidStatusVarName,
-        new MethodCall(writeMethod,
-                       ParcelWriteCastOf(method.GetType(), typenames, kReturnVarName))));
+  if (method.GetType().GetName() != "void" && !with_tables) {
+    b->AddStatement(new Assignment(kAndroidStatusVarName,
+                                   ParcelWriteCall(method.GetType(), typenames, kReplyVarName,
+                                                   true /* is_pointer */, kReturnVarName)));
     b->AddStatement(BreakOnStatusNotOk());
   }
   // Write each out parameter to the reply parcel.
-  for (const AidlArgument* a : method.GetOutArguments()) {
-    // Serialization looks roughly like:
-    //     _aidl_ret_status = data.WriteInt32(out_param_name);
-    //     if (_aidl_ret_status != ::android::OK) { break; }
-    const string& writeMethod = ParcelWriteMethodOf(a->GetType(), typenames);
-    b->AddStatement(new Assignment(
-        kAndroidStatusVarName,
-        new MethodCall(string(kReplyVarName) + "->" + writeMethod,
-                       ParcelWriteCastOf(a->GetType(), typenames, BuildVarName(*a)))));
-    b->AddStatement(BreakOnStatusNotOk());
+  if (!with_tables) {
+    for (const AidlArgument* a : method.GetOutArguments()) {
+      // Serialization looks roughly like:
+      //     _aidl_ret_status = data.WriteInt32(out_param_name);
+      //     if (_aidl_ret_status != ::android::OK) { break; }
+      b->AddStatement(new Assignment(kAndroidStatusVarName,
+                                     ParcelWriteCall(a->GetType(), typenames, kReplyVarName,
+                                                     true /* is_pointer */, BuildVarName(*a))));
+      b->AddStatement(BreakOnStatusNotOk());
+    }
+  }
+
+  if (options.GenParcelSizes()) {
+    b->AddLiteral(GenStatsRecordSizes(interface, method, bn_name,
+                                      kDataVarName + string(".dataSize()"),
+                                      kReplyVarName + string("->dataSize()")),
+                  false);
   }
 
   return true;
 }
 
+// The name and arguments of the method that handles |method| in a table of
+// transaction handlers
+string TransactionHandlerName(const AidlMethod& method) {
+  return "_aidl_onTransact_" + method.GetName();
+}
+
+ArgList TransactionHandlerArgs() {
+  return ArgList{{StringPrintf("const %s& %s", kAndroidParcelLiteral, kDataVarName),
+                  StringPrintf("%s* %s", kAndroidParcelLiteral, kReplyVarName)}};
+}
+
 bool HandleServerMetaTransaction(const AidlTypenames&, const AidlInterface& interface,
                                  const AidlMethod& method, const Options& options,
                                  StatementBlock* b) {
@@ -652,7 +1199,7 @@ bool HandleServerMetaTransaction(const AidlTypenames&, const AidlInterface& inte
 
   if (method.GetName() == kGetInterfaceVersion && options.Version() > 0) {
     std::ostringstream code;
-    code << "_aidl_data.checkInterface(this);\n"
+    code << CheckInterfaceToken(interface) << ";\n"
          << "_aidl_reply->writeNoException();\n"
          << "_aidl_reply->writeInt32(" << ClassName(interface, ClassNames::INTERFACE)
          << "::VERSION)";
@@ -661,7 +1208,7 @@ bool HandleServerMetaTransaction(const AidlTypenames&, const AidlInterface& inte
   }
   if (method.GetName() == kGetInterfaceHash && !options.Hash().empty()) {
     std::ostringstream code;
-    code << "_aidl_data.checkInterface(this);\n"
+    code << CheckInterfaceToken(interface) << ";\n"
          << "_aidl_reply->writeNoException();\n"
          << "_aidl_reply->writeUtf8AsUtf16(" << ClassName(interface, ClassNames::INTERFACE)
          << "::HASH)";
@@ -673,8 +1220,8 @@ bool HandleServerMetaTransaction(const AidlTypenames&, const AidlInterface& inte
 
 }  // namespace
 
-unique_ptr<Document> BuildServerSource(const AidlTypenames& typenames,
-                                       const AidlInterface& interface, const Options& options) {
+bool WriteServerSource(const AidlTypenames& typenames, const AidlInterface& interface,
+                       const Options& options, CodeWriter* to) {
   const string bn_name = ClassName(interface, ClassNames::SERVER);
   vector<string> include_list{
       HeaderFile(interface, ClassNames::SERVER, false),
@@ -686,91 +1233,213 @@ unique_ptr<Document> BuildServerSource(const AidlTypenames& typenames,
     include_list.emplace_back("functional");
     include_list.emplace_back("json/value.h");
   }
+  if (options.GenBinaryLog()) {
+    include_list.emplace_back("aidl/binary_log.h");
+    include_list.emplace_back("aidl/transaction_capture.h");
+  }
+  if (options.GenPerfettoTraces()) {
+    include_list.emplace_back("aidl/trace_events.h");
+  }
 
-  unique_ptr<ConstructorImpl> constructor{
-      new ConstructorImpl{ClassName(interface, ClassNames::SERVER), ArgList{}, {}}};
+  CppSourceWriter source(to, include_list, interface.GetSplitPackage());
 
+  ConstructorImpl constructor{ClassName(interface, ClassNames::SERVER), ArgList{}, {}};
   if (interface.IsVintfStability()) {
-    constructor->GetStatementBlock()->AddLiteral("::android::internal::Stability::markVintf(this)");
+    constructor.GetStatementBlock()->AddLiteral("::android::internal::Stability::markVintf(this)");
   } else {
-    constructor->GetStatementBlock()->AddLiteral(
+    constructor.GetStatementBlock()->AddLiteral(
         "::android::internal::Stability::markCompilationUnit(this)");
   }
+  source.Write(constructor);
+  source.Write(LiteralDecl(InterfaceTokenDecl(interface)));
+  if (options.GenStats()) {
+    source.Write(LiteralDecl(
+        GenStatsTable(interface, bn_name, "::android::IBinder::FIRST_CALL_TRANSACTION")));
+  }
 
-  unique_ptr<MethodImpl> on_transact{new MethodImpl{
-      kAndroidStatusLiteral, bn_name, "onTransact",
-      ArgList{{StringPrintf("uint32_t %s", kCodeVarName),
-               StringPrintf("const %s& %s", kAndroidParcelLiteral,
-                            kDataVarName),
-               StringPrintf("%s* %s", kAndroidParcelLiteral, kReplyVarName),
-               StringPrintf("uint32_t %s", kFlagsVarName)}}
-      }};
+  // With a table of handlers, each user-defined transaction is handled by a
+  // method of its own, which breaks out of its body as a case would.
+  const vector<const AidlMethod*> table = TransactionTable(interface, options);
+  for (const AidlMethod* method : table) {
+    if (method == nullptr) continue;
+    StatementBlock b;
+    if (!HandleServerTransaction(typenames, interface, *method, options, false, &b)) {
+      return false;
+    }
+    SizeScope size(*to, "cpp", interface, method, "stub");
+    to->Write("%s %s::%s", kAndroidStatusLiteral, bn_name.c_str(),
+              TransactionHandlerName(*method).c_str());
+    TransactionHandlerArgs().Write(to);
+    *to << " {\n";
+    to->Indent();
+    to->Write("%s %s = %s;\n", kAndroidStatusLiteral, kAndroidStatusVarName, kAndroidStatusOk);
+    *to << "do {\n";
+    to->Indent();
+    b.Write(to);
+    to->Dedent();
+    *to << "} while (false);\n";
+    to->Write("return %s;\n", kAndroidStatusVarName);
+    to->Dedent();
+    *to << "}\n";
+    source.EndDeclaration();
+  }
+
+  // onTransact is written by hand around its switch statement, so that the
+  // case of a transaction can be dropped once it has been written.
+  to->Write("%s %s::onTransact", kAndroidStatusLiteral, bn_name.c_str());
+  ArgList{{StringPrintf("uint32_t %s", kCodeVarName),
+           StringPrintf("const %s& %s", kAndroidParcelLiteral, kDataVarName),
+           StringPrintf("%s* %s", kAndroidParcelLiteral, kReplyVarName),
+           StringPrintf("uint32_t %s", kFlagsVarName)}}
+      .Write(to);
+  *to << " {\n";
+  to->Indent();
 
   // Declare the status_t variable
-  on_transact->GetStatementBlock()->AddLiteral(
-      StringPrintf("%s %s = %s", kAndroidStatusLiteral, kAndroidStatusVarName,
-                   kAndroidStatusOk));
-
-  // Add the all important switch statement, but retain a pointer to it.
-  SwitchStatement* s = new SwitchStatement{kCodeVarName};
-  on_transact->GetStatementBlock()->AddStatement(s);
+  to->Write("%s %s = %s;\n", kAndroidStatusLiteral, kAndroidStatusVarName, kAndroidStatusOk);
+
+  if (!table.empty()) {
+    to->Write("using _aidl_handler = %s (%s::*)", kAndroidStatusLiteral, bn_name.c_str());
+    TransactionHandlerArgs().Write(to);
+    *to << ";\n";
+    *to << "static constexpr _aidl_handler _aidl_handlers[] = {\n";
+    to->Indent();
+    for (const AidlMethod* method : table) {
+      if (method == nullptr) {
+        *to << "nullptr,\n";
+      } else {
+        to->Write("&%s::%s,\n", bn_name.c_str(), TransactionHandlerName(*method).c_str());
+      }
+    }
+    to->Dedent();
+    *to << "};\n";
+    to->Write("if (const uint32_t _aidl_index = %s - ::android::IBinder::FIRST_CALL_TRANSACTION;\n",
+              kCodeVarName);
+    to->Write("    _aidl_index < %zu && _aidl_handlers[_aidl_index] != nullptr) {\n",
+              table.size());
+    to->Indent();
+    to->Write("%s = (this->*_aidl_handlers[_aidl_index])(%s, %s);\n", kAndroidStatusVarName,
+              kDataVarName, kReplyVarName);
+    to->Dedent();
+    *to << "} else {\n";
+    to->Indent();
+  }
 
   // The switch statement has a case statement for each transaction code.
+  to->Write("switch (%s) {\n", kCodeVarName);
+  std::set<string> case_values;
   for (const auto& method : interface.GetMethods()) {
-    StatementBlock* b = s->AddCase(GetTransactionIdFor(*method));
-    if (!b) { return nullptr; }
+    if (!table.empty() && method->IsUserDefined()) {
+      continue;  // handled by the table
+    }
+    const string case_value = GetTransactionIdFor(*method);
+    if (!case_values.insert(case_value).second) {
+      LOG(ERROR) << "internal error: duplicate switch case labels";
+      return false;
+    }
 
+    StatementBlock b;
     bool success = false;
     if (method->IsUserDefined()) {
-      success = HandleServerTransaction(typenames, interface, *method, options, b);
+      success = HandleServerTransaction(typenames, interface, *method, options, false, &b);
     } else {
-      success = HandleServerMetaTransaction(typenames, interface, *method, options, b);
+      success = HandleServerMetaTransaction(typenames, interface, *method, options, &b);
     }
     if (!success) {
-      return nullptr;
+      return false;
     }
+    SizeScope size(*to, "cpp", interface, method.get(), "stub");
+    to->Write("case %s:\n", case_value.c_str());
+    b.Write(to);
+    *to << "break;\n";
+  }
+
+  // A batch of @Batchable calls is handled call by call, until one fails.
+  if (HasBatchableMethods(interface)) {
+    to->Write("case %s: {\n", BatchTransactionId().c_str());
+    to->Indent();
+    to->Write("if (!(%s)) {\n", CheckInterfaceToken(interface).c_str());
+    to->Write("  %s = ::android::BAD_TYPE;\n", kAndroidStatusVarName);
+    *to << "  break;\n"
+        << "}\n"
+        << "int32_t _aidl_batch_calls = 0;\n";
+    to->Write("%s = %s.readInt32(&_aidl_batch_calls);\n", kAndroidStatusVarName,
+              kDataVarName);
+    to->Write("for (int32_t _aidl_i = 0; %s == %s && _aidl_i < _aidl_batch_calls; ++_aidl_i) {\n",
+              kAndroidStatusVarName, kAndroidStatusOk);
+    to->Indent();
+    *to << "uint32_t _aidl_batch_code = 0;\n";
+    to->Write("%s = %s.readUint32(&_aidl_batch_code);\n", kAndroidStatusVarName,
+              kDataVarName);
+    to->Write("if (%s != %s) break;\n", kAndroidStatusVarName, kAndroidStatusOk);
+    *to << "switch (_aidl_batch_code) {\n";
+    for (const auto& method : interface.GetMethods()) {
+      if (!method->GetType().IsBatchable()) continue;
+      StatementBlock b;
+      if (!HandleServerTransaction(typenames, interface, *method, options, true, &b)) {
+        return false;
+      }
+      to->Write("case %s:\n", GetTransactionIdFor(*method).c_str());
+      b.Write(to);
+      *to << "break;\n";
+    }
+    *to << "default:\n";
+    to->Write("  %s = ::android::BAD_VALUE;\n", kAndroidStatusVarName);
+    *to << "  break;\n"
+        << "}\n";
+    to->Dedent();
+    *to << "}\n";
+    to->Dedent();
+    *to << "} break;\n";
   }
 
   // The switch statement has a default case which defers to the super class.
   // The superclass handles a few pre-defined transactions.
-  StatementBlock* b = s->AddCase("");
-  b->AddLiteral(StringPrintf(
+  StatementBlock b;
+  b.AddLiteral(StringPrintf(
                 "%s = ::android::BBinder::onTransact(%s, %s, "
                 "%s, %s)", kAndroidStatusVarName, kCodeVarName,
                 kDataVarName, kReplyVarName, kFlagsVarName));
+  *to << "default:\n";
+  b.Write(to);
+  *to << "break;\n";
+  *to << "}\n";
+  if (!table.empty()) {
+    to->Dedent();
+    *to << "}\n";
+  }
 
   // If we saw a null reference, we can map that to an appropriate exception.
-  IfStatement* null_check = new IfStatement(
+  IfStatement null_check(
       new LiteralExpression(string(kAndroidStatusVarName) +
                             " == ::android::UNEXPECTED_NULL"));
-  on_transact->GetStatementBlock()->AddStatement(null_check);
-  null_check->OnTrue()->AddStatement(new Assignment(
+  null_check.OnTrue()->AddStatement(new Assignment(
       kAndroidStatusVarName,
       StringPrintf("%s::fromExceptionCode(%s::EX_NULL_POINTER)"
                    ".writeToParcel(%s)",
                    kBinderStatusLiteral, kBinderStatusLiteral,
                    kReplyVarName)));
+  null_check.Write(to);
 
   // Finally, the server's onTransact method just returns a status code.
-  on_transact->GetStatementBlock()->AddLiteral(
-      StringPrintf("return %s", kAndroidStatusVarName));
-  vector<unique_ptr<Declaration>> decls;
-  decls.push_back(std::move(constructor));
-  decls.push_back(std::move(on_transact));
+  to->Write("return %s;\n", kAndroidStatusVarName);
+  to->Dedent();
+  *to << "}\n";
+  source.EndDeclaration();
 
   if (options.Version() > 0) {
     std::ostringstream code;
     code << "int32_t " << bn_name << "::" << kGetInterfaceVersion << "() {\n"
          << "  return " << ClassName(interface, ClassNames::INTERFACE) << "::VERSION;\n"
          << "}\n";
-    decls.emplace_back(new LiteralDecl(code.str()));
+    source.Write(LiteralDecl(code.str()));
   }
   if (!options.Hash().empty()) {
     std::ostringstream code;
     code << "std::string " << bn_name << "::" << kGetInterfaceHash << "() {\n"
          << "  return " << ClassName(interface, ClassNames::INTERFACE) << "::HASH;\n"
          << "}\n";
-    decls.emplace_back(new LiteralDecl(code.str()));
+    source.Write(LiteralDecl(code.str()));
   }
 
   if (options.GenLog()) {
@@ -780,50 +1449,250 @@ unique_ptr<Document> BuildServerSource(const AidlTypenames& typenames,
     (*writer) << "std::function<void(const Json::Value&)> "
               << ClassName(interface, ClassNames::SERVER) << "::logFunc;\n";
     writer->Close();
-    decls.push_back(unique_ptr<Declaration>(new LiteralDecl(code)));
+    source.Write(LiteralDecl(code));
   }
-  return unique_ptr<Document>{
-      new CppSource{include_list, NestInNamespaces(std::move(decls), interface.GetSplitPackage())}};
+  source.Close();
+  return true;
 }
 
-unique_ptr<Document> BuildInterfaceSource(const AidlTypenames& typenames,
-                                          const AidlInterface& interface,
-                                          [[maybe_unused]] const Options& options) {
+// The future of the asynchronous variant of |method|: the status of its
+// call, with the return value unless it is void
+string AsyncFutureType(const AidlMethod& method, const AidlTypenames& typenames,
+                       const Options& options) {
+  if (method.GetType().GetName() == "void") {
+    return StringPrintf("::std::future<%s>", kBinderStatusLiteral);
+  }
+  return StringPrintf("::std::future<::android::aidl::AsyncResult<%s, %s>>", kBinderStatusLiteral,
+                      CppNameOf(method.GetType(), typenames, options).c_str());
+}
+
+// The asynchronous variant of |method| takes its arguments by value, so that
+// they live until its call runs on the executor
+ArgList AsyncArgList(const AidlMethod& method, const AidlTypenames& typenames,
+                     const Options& options) {
+  vector<string> arguments;
+  for (const auto& a : method.GetArguments()) {
+    arguments.push_back(CppNameOf(a->GetType(), typenames, options) + " " + a->GetName());
+  }
+  return ArgList(arguments);
+}
+
+// The asynchronous variant of |method| runs the blocking call on the threads
+// of the executor of the process, holding a reference to the interface and
+// its arguments until then.
+string DefineAsyncMethod(const AidlTypenames& typenames, const AidlInterface& interface,
+                         const AidlMethod& method, const Options& options) {
+  const string i_name = ClassName(interface, ClassNames::INTERFACE);
+  const bool moves_in = MovesInArguments(interface, method);
+  vector<string> captures{"_aidl_self"};
+  vector<string> call_arguments;
+  for (const auto& a : method.GetArguments()) {
+    const bool nonCopyable = IsNonCopyableType(a->GetType(), typenames);
+    const bool byReference = IsPassedByReference(*a, typenames);
+    const string& name = a->GetName();
+    captures.push_back(nonCopyable || byReference ? name + " = std::move(" + name + ")" : name);
+    call_arguments.push_back(nonCopyable || (byReference && moves_in) ? "std::move(" + name + ")"
+                                                                      : name);
+  }
+
+  std::ostringstream code;
+  code << AsyncFutureType(method, typenames, options) << " " << i_name
+       << "::" << AsyncMethodName(method) << AsyncArgList(method, typenames, options).ToString()
+       << " {\n"
+       << "  ::android::sp<" << i_name << "> _aidl_self = this;\n"
+       << "  return ::android::aidl::AsyncExecutor::Default().Submit(\n"
+       << "      [" << Join(captures, ", ") << "]() mutable {\n";
+  if (method.GetType().GetName() == "void") {
+    code << "        return _aidl_self->" << method.GetName() << "(" << Join(call_arguments, ", ")
+         << ");\n";
+  } else {
+    call_arguments.push_back("&_aidl_result.value");
+    code << "        ::android::aidl::AsyncResult<" << kBinderStatusLiteral << ", "
+         << CppNameOf(method.GetType(), typenames, options) << "> _aidl_result;\n"
+         << "        _aidl_result.status = _aidl_self->" << method.GetName() << "("
+         << Join(call_arguments, ", ") << ");\n"
+         << "        return _aidl_result;\n";
+  }
+  code << "      });\n"
+       << "}\n";
+  return code.str();
+}
+
+// The class of the lazy proxies of |interface|, which look their service up
+// on their first call and again on the first call after it died
+string LazyClassName(const AidlInterface& interface) {
+  return ClassName(interface, ClassNames::INTERFACE) + "Lazy";
+}
+
+unique_ptr<Declaration> BuildLazyClassDecl(const AidlTypenames& typenames,
+                                           const AidlInterface& interface,
+                                           const Options& options) {
+  const string i_name = ClassName(interface, ClassNames::INTERFACE);
+  const string lazy_name = LazyClassName(interface);
+  vector<unique_ptr<Declaration>> public_decls;
+  public_decls.emplace_back(new LiteralDecl(
+      StringPrintf("explicit %s(const ::android::String16& name);\n", lazy_name.c_str())));
+  for (const auto& method : interface.GetMethods()) {
+    if (method->IsUserDefined()) {
+      public_decls.push_back(BuildMethodDecl(interface, *method, typenames, options, false));
+    } else if (auto decl = BuildMetaMethodDecl(*method, typenames, options, false)) {
+      public_decls.push_back(std::move(decl));
+    }
+  }
+  if (HasBatchableMethods(interface)) {
+    public_decls.emplace_back(new LiteralDecl(
+        StringPrintf("%s %s() override;\n", kBinderStatusLiteral, kFlushBatchedCalls.c_str())));
+  }
+  public_decls.emplace_back(
+      new LiteralDecl("void binderDied(const ::android::wp<::android::IBinder>& who) override;\n"));
+
+  vector<unique_ptr<Declaration>> private_decls;
+  private_decls.emplace_back(new LiteralDecl("::android::IBinder* onAsBinder() override;\n"));
+  private_decls.emplace_back(
+      new LiteralDecl(StringPrintf("::android::sp<%s> getService();\n", i_name.c_str())));
+  private_decls.emplace_back(new LiteralDecl("const ::android::String16 name_;\n"));
+  private_decls.emplace_back(new LiteralDecl("std::mutex mutex_;\n"));
+  private_decls.emplace_back(
+      new LiteralDecl(StringPrintf("::android::sp<%s> service_;\n", i_name.c_str())));
+  return unique_ptr<Declaration>{
+      new ClassDecl{lazy_name, i_name + ", public ::android::IBinder::DeathRecipient",
+                    std::move(public_decls), std::move(private_decls)}};
+}
+
+// A lazy proxy waits for its service on its first call, and forgets it when
+// it dies. The calls fail with NAME_NOT_FOUND while there is no service.
+string DefineLazyClass(const AidlTypenames& typenames, const AidlInterface& interface,
+                       const Options& options) {
+  const string i_name = ClassName(interface, ClassNames::INTERFACE);
+  const string lazy_name = LazyClassName(interface);
+  std::ostringstream code;
+  code << lazy_name << "::" << lazy_name << "(const ::android::String16& name) : name_(name) {}\n"
+       << "::android::sp<" << i_name << "> " << lazy_name << "::getService() {\n"
+       << "  std::lock_guard<std::mutex> _aidl_lock(mutex_);\n"
+       << "  if (service_ == nullptr) {\n"
+       << "    service_ = ::android::waitForService<" << i_name << ">(name_);\n"
+       << "    if (service_ != nullptr) {\n"
+       << "      ::android::IInterface::asBinder(service_)->linkToDeath(\n"
+       << "          ::android::sp<::android::IBinder::DeathRecipient>(this));\n"
+       << "    }\n"
+       << "  }\n"
+       << "  return service_;\n"
+       << "}\n"
+       << "void " << lazy_name << "::binderDied(const ::android::wp<::android::IBinder>&) {\n"
+       << "  std::lock_guard<std::mutex> _aidl_lock(mutex_);\n"
+       << "  service_ = nullptr;\n"
+       << "}\n"
+       << "::android::IBinder* " << lazy_name << "::onAsBinder() {\n"
+       << "  return ::android::IInterface::asBinder(getService()).get();\n"
+       << "}\n";
+
+  const string get_service = "  ::android::sp<" + i_name + "> _aidl_service = getService();\n";
+  for (const auto& method : interface.GetMethods()) {
+    if (!method->IsUserDefined()) {
+      if (method->GetName() == kGetInterfaceVersion && options.Version() > 0) {
+        code << "int32_t " << lazy_name << "::" << kGetInterfaceVersion << "() {\n"
+             << get_service << "  return _aidl_service != nullptr ? _aidl_service->"
+             << kGetInterfaceVersion << "() : -1;\n"
+             << "}\n";
+      }
+      if (method->GetName() == kGetInterfaceHash && !options.Hash().empty()) {
+        code << "std::string " << lazy_name << "::" << kGetInterfaceHash << "() {\n"
+             << get_service << "  return _aidl_service != nullptr ? _aidl_service->"
+             << kGetInterfaceHash << "() : \"\";\n"
+             << "}\n";
+      }
+      continue;
+    }
+    const bool moves_in = MovesInArguments(interface, *method);
+    vector<string> call_arguments;
+    for (const auto& a : method->GetArguments()) {
+      const bool moved = !a->IsOut() && (IsNonCopyableType(a->GetType(), typenames) ||
+                                         (IsPassedByReference(*a, typenames) && moves_in));
+      call_arguments.push_back(moved ? "std::move(" + a->GetName() + ")" : a->GetName());
+    }
+    if (method->GetType().GetName() != "void") {
+      call_arguments.push_back(kReturnVarName);
+    }
+    code << kBinderStatusLiteral << " " << lazy_name << "::" << method->GetName()
+         << BuildArgList(typenames, interface, *method, options, true).ToString() << " {\n"
+         << get_service << "  if (_aidl_service == nullptr) {\n"
+         << "    return " << kBinderStatusLiteral << "::fromStatusT(::android::NAME_NOT_FOUND);\n"
+         << "  }\n"
+         << "  return _aidl_service->" << method->GetName() << "(" << Join(call_arguments, ", ")
+         << ");\n"
+         << "}\n";
+  }
+  if (HasBatchableMethods(interface)) {
+    code << kBinderStatusLiteral << " " << lazy_name << "::" << kFlushBatchedCalls << "() {\n"
+         << get_service << "  if (_aidl_service == nullptr) {\n"
+         << "    return " << kBinderStatusLiteral << "::fromStatusT(::android::NAME_NOT_FOUND);\n"
+         << "  }\n"
+         << "  return _aidl_service->" << kFlushBatchedCalls << "();\n"
+         << "}\n";
+  }
+  return code.str();
+}
+
+bool WriteInterfaceSource(const AidlTypenames& typenames, const AidlInterface& interface,
+                          const Options& options, CodeWriter* to) {
   vector<string> include_list{
       HeaderFile(interface, ClassNames::RAW, false),
       HeaderFile(interface, ClassNames::CLIENT, false),
   };
+  if (options.GenLazyProxy()) {
+    include_list.push_back("binder/IServiceManager.h");
+  }
+  if (HasMarshalTables(interface, options)) {
+    include_list.push_back("aidl/marshal_parcel.h");
+  }
 
   string fq_name = ClassName(interface, ClassNames::INTERFACE);
   if (!interface.GetPackage().empty()) {
     fq_name = interface.GetPackage() + "." + fq_name;
   }
 
-  vector<unique_ptr<Declaration>> decls;
+  CppSourceWriter source(to, include_list, interface.GetSplitPackage());
 
-  unique_ptr<MacroDecl> meta_if{new MacroDecl{
+  source.Write(MacroDecl{
       "DO_NOT_DIRECTLY_USE_ME_IMPLEMENT_META_INTERFACE",
-      ArgList{vector<string>{ClassName(interface, ClassNames::BASE), '"' + fq_name + '"'}}}};
-  decls.push_back(std::move(meta_if));
+      ArgList{vector<string>{ClassName(interface, ClassNames::BASE), '"' + fq_name + '"'}}});
 
   for (const auto& constant : interface.GetConstantDeclarations()) {
     const AidlConstantValue& value = constant->GetValue();
     if (value.GetType() != AidlConstantValue::Type::STRING) continue;
 
     std::string cppType = CppNameOf(constant->GetType(), typenames);
-    unique_ptr<MethodImpl> getter(new MethodImpl("const " + cppType + "&",
-                                                 ClassName(interface, ClassNames::INTERFACE),
-                                                 constant->GetName(), {}));
-    getter->GetStatementBlock()->AddLiteral(
+    MethodImpl getter("const " + cppType + "&", ClassName(interface, ClassNames::INTERFACE),
+                      constant->GetName(), {});
+    getter.GetStatementBlock()->AddLiteral(
         StringPrintf("static const %s value(%s)", cppType.c_str(),
                      constant->ValueString(ConstantValueDecorator).c_str()));
-    getter->GetStatementBlock()->AddLiteral("return value");
-    decls.push_back(std::move(getter));
+    getter.GetStatementBlock()->AddLiteral("return value");
+    source.Write(getter);
   }
-
-  return unique_ptr<Document>{new CppSource{
-      include_list,
-      NestInNamespaces(std::move(decls), interface.GetSplitPackage())}};
+  if (HasMarshalTables(interface, options)) {
+    source.Write(LiteralDecl(GenMarshalTables(interface, options)));
+  }
+  if (options.GenWireSchema()) {
+    source.Write(LiteralDecl(GenWireSchemaDefinition(interface, typenames,
+                                                     ClassName(interface, ClassNames::INTERFACE))));
+  }
+  if (HasCacheableMethods(interface)) {
+    source.Write(LiteralDecl("::android::aidl::CacheGeneration " +
+                             ClassName(interface, ClassNames::INTERFACE) + "::cacheGeneration;\n"));
+  }
+  if (options.GenAsync()) {
+    for (const auto& method : interface.GetMethods()) {
+      if (HasAsyncVariant(*method)) {
+        source.Write(LiteralDecl(DefineAsyncMethod(typenames, interface, *method, options)));
+      }
+    }
+  }
+  if (options.GenLazyProxy()) {
+    source.Write(LiteralDecl(DefineLazyClass(typenames, interface, options)));
+  }
+  source.Close();
+  return true;
 }
 
 unique_ptr<Document> BuildClientHeader(const AidlTypenames& typenames,
@@ -833,6 +1702,12 @@ unique_ptr<Document> BuildClientHeader(const AidlTypenames& typenames,
 
   vector<string> includes = {kIBinderHeader, kIInterfaceHeader, "utils/Errors.h",
                              HeaderFile(interface, ClassNames::RAW, false)};
+  if (options.GenFwdHeaders()) {
+    // The proxies marshal the types that IFoo.h only declares
+    for (const AidlDefinedType* type : MethodTypes(typenames, interface)) {
+      includes.push_back(HeaderFile(*type, ClassNames::RAW, false));
+    }
+  }
 
   unique_ptr<ConstructorDecl> constructor{new ConstructorDecl{
       bp_name,
@@ -840,18 +1715,24 @@ unique_ptr<Document> BuildClientHeader(const AidlTypenames& typenames,
                            kImplVarName)},
       ConstructorDecl::IS_EXPLICIT
   }};
-  unique_ptr<ConstructorDecl> destructor{new ConstructorDecl{
-      "~" + bp_name,
-      ArgList{},
-      ConstructorDecl::IS_VIRTUAL | ConstructorDecl::IS_DEFAULT}};
+  // The destructor of a proxy with @Batchable methods sends the queued calls
+  const uint32_t destructor_modifiers =
+      HasBatchableMethods(interface) ? ConstructorDecl::IS_VIRTUAL
+                                     : ConstructorDecl::IS_VIRTUAL | ConstructorDecl::IS_DEFAULT;
+  unique_ptr<ConstructorDecl> destructor{
+      new ConstructorDecl{"~" + bp_name, ArgList{}, destructor_modifiers}};
 
   vector<unique_ptr<Declaration>> publics;
   publics.push_back(std::move(constructor));
   publics.push_back(std::move(destructor));
+  if (HasBatchableMethods(interface)) {
+    publics.emplace_back(new LiteralDecl(StringPrintf("%s %s() override;\n", kBinderStatusLiteral,
+                                                      kFlushBatchedCalls.c_str())));
+  }
 
   for (const auto& method: interface.GetMethods()) {
     if (method->IsUserDefined()) {
-      publics.push_back(BuildMethodDecl(*method, typenames, false));
+      publics.push_back(BuildMethodDecl(interface, *method, typenames, options, false));
     } else {
       publics.push_back(BuildMetaMethodDecl(*method, typenames, options, false));
     }
@@ -860,19 +1741,60 @@ unique_ptr<Document> BuildClientHeader(const AidlTypenames& typenames,
   if (options.GenLog()) {
     includes.emplace_back("chrono");      // for std::chrono::steady_clock
     includes.emplace_back("functional");  // for std::function
-    includes.emplace_back("json/value.h");
+    // logFunc only needs the declaration of Json::Value
+    includes.emplace_back(options.GenFwdHeaders() ? "json/forwards.h" : "json/value.h");
     publics.emplace_back(
         new LiteralDecl{"static std::function<void(const Json::Value&)> logFunc;\n"});
   }
+  if (options.GenStats()) {
+    includes.emplace_back("aidl/transaction_stats.h");
+    publics.emplace_back(new LiteralDecl{kGetTransactionStatsDecl});
+  }
 
   vector<unique_ptr<Declaration>> privates;
 
+  if (options.Version() > 0 || !options.Hash().empty()) {
+    includes.emplace_back("atomic");
+  }
   if (options.Version() > 0) {
-    privates.emplace_back(new LiteralDecl("int32_t cached_version_ = -1;\n"));
+    privates.emplace_back(new LiteralDecl("std::atomic<int32_t> cached_version_{-1};\n"));
   }
   if (!options.Hash().empty()) {
-    privates.emplace_back(new LiteralDecl("std::string cached_hash_ = \"-1\";\n"));
-    privates.emplace_back(new LiteralDecl("std::mutex cached_hash_mutex_;\n"));
+    // 0 while unset, 1 while cached_hash_ is being filled and 2 once it is published
+    privates.emplace_back(new LiteralDecl("std::atomic<int> cached_hash_state_{0};\n"));
+    privates.emplace_back(new LiteralDecl("std::string cached_hash_;\n"));
+  }
+
+  if (HasCacheableMethods(interface)) {
+    includes.emplace_back("aidl/result_cache.h");
+    includes.emplace_back("tuple");
+    for (const auto& method : interface.GetMethods()) {
+      if (!method->GetType().IsCacheable()) continue;
+      vector<string> key_types;
+      for (const auto& a : method->GetArguments()) {
+        key_types.push_back(CppNameOf(a->GetType(), typenames));
+      }
+      privates.emplace_back(new LiteralDecl(
+          StringPrintf("::android::aidl::ResultCache<::std::tuple<%s>, %s> %s;\n",
+                       Join(key_types, ", ").c_str(),
+                       CppNameOf(method->GetType(), typenames).c_str(),
+                       CacheVarName(*method).c_str())));
+    }
+  }
+
+  if (HasBatchableMethods(interface)) {
+    // The queued calls of the @Batchable methods, which share one transaction
+    includes.emplace_back("mutex");
+    includes.emplace_back(kParcelHeader);
+    includes.emplace_back("aidl/batch_timer.h");
+    privates.emplace_back(new LiteralDecl(
+        StringPrintf("%s flushBatchLocked();\n"
+                     "std::mutex batch_mutex_;\n"
+                     "%s %s;\n"
+                     "int32_t batch_calls_ = 0;\n"
+                     "size_t batch_count_position_ = 0;\n"
+                     "%sClock::time_point batch_deadline_;\n",
+                     kAndroidStatusLiteral, kAndroidParcelLiteral, kBatchVarName, kBatchTimer)));
   }
 
   unique_ptr<ClassDecl> bp_class{new ClassDecl{
@@ -887,7 +1809,7 @@ unique_ptr<Document> BuildClientHeader(const AidlTypenames& typenames,
                     NestInNamespaces(std::move(bp_class), interface.GetSplitPackage())}};
 }
 
-unique_ptr<Document> BuildServerHeader(const AidlTypenames& /* typenames */,
+unique_ptr<Document> BuildServerHeader(const AidlTypenames& typenames,
                                        const AidlInterface& interface, const Options& options) {
   const string i_name = ClassName(interface, ClassNames::INTERFACE);
   const string bn_name = ClassName(interface, ClassNames::SERVER);
@@ -905,11 +1827,25 @@ unique_ptr<Document> BuildServerHeader(const AidlTypenames& /* typenames */,
       MethodDecl::IS_OVERRIDE
   }};
   vector<string> includes = {"binder/IInterface.h", HeaderFile(interface, ClassNames::RAW, false)};
+  if (options.GenFwdHeaders()) {
+    // The services implement the methods with the types that IFoo.h only declares
+    for (const AidlDefinedType* type : MethodTypes(typenames, interface)) {
+      includes.push_back(HeaderFile(*type, ClassNames::RAW, false));
+    }
+  }
 
   vector<unique_ptr<Declaration>> publics;
   publics.push_back(std::move(constructor));
   publics.push_back(std::move(on_transact));
 
+  vector<unique_ptr<Declaration>> privates;
+  for (const AidlMethod* method : TransactionTable(interface, options)) {
+    if (method != nullptr) {
+      privates.emplace_back(new MethodDecl{kAndroidStatusLiteral, TransactionHandlerName(*method),
+                                           TransactionHandlerArgs()});
+    }
+  }
+
   if (options.Version() > 0) {
     std::ostringstream code;
     code << "int32_t " << kGetInterfaceVersion << "() final override;\n";
@@ -924,15 +1860,42 @@ unique_ptr<Document> BuildServerHeader(const AidlTypenames& /* typenames */,
   if (options.GenLog()) {
     includes.emplace_back("chrono");      // for std::chrono::steady_clock
     includes.emplace_back("functional");  // for std::function
-    includes.emplace_back("json/value.h");
+    // logFunc only needs the declaration of Json::Value
+    includes.emplace_back(options.GenFwdHeaders() ? "json/forwards.h" : "json/value.h");
     publics.emplace_back(
         new LiteralDecl{"static std::function<void(const Json::Value&)> logFunc;\n"});
   }
+  if (options.GenStats()) {
+    includes.emplace_back("aidl/transaction_stats.h");
+    publics.emplace_back(new LiteralDecl{kGetTransactionStatsDecl});
+  }
+  if (options.GenTransactionNames()) {
+    publics.emplace_back(new LiteralDecl{GenTransactionNamesDecl(
+        interface, options, "::android::IBinder::FIRST_CALL_TRANSACTION")});
+  }
+  if (HasSingleFlightMethods(interface)) {
+    includes.emplace_back("aidl/single_flight.h");
+    includes.emplace_back("tuple");
+    for (const auto& method : interface.GetMethods()) {
+      if (!method->GetType().IsSingleFlight()) continue;
+      vector<string> params;
+      for (const auto& a : method->GetArguments()) {
+        params.push_back(LocalVariableType(*a, typenames, options));
+      }
+      params = {"::std::tuple<" + Join(params, ", ") + ">", kBinderStatusLiteral};
+      if (method->GetType().GetName() != "void") {
+        params.push_back(CppNameOf(method->GetType(), typenames, options));
+      }
+      privates.emplace_back(new LiteralDecl(StringPrintf("::android::aidl::SingleFlight<%s> %s;\n",
+                                                         Join(params, ", ").c_str(),
+                                                         FlightVarName(*method).c_str())));
+    }
+  }
   unique_ptr<ClassDecl> bn_class{
       new ClassDecl{bn_name,
                     "::android::BnInterface<" + i_name + ">",
                     std::move(publics),
-                    {}
+                    std::move(privates)
       }};
 
   return unique_ptr<Document>{
@@ -946,10 +1909,18 @@ unique_ptr<Document> BuildInterfaceHeader(const AidlTypenames& typenames,
 
   for (const auto& method : interface.GetMethods()) {
     for (const auto& argument : method->GetArguments()) {
-      AddHeaders(argument->GetType(), typenames, includes);
+      AddHeaders(argument->GetType(), typenames, options, includes);
     }
 
-    AddHeaders(method->GetType(), typenames, includes);
+    AddHeaders(method->GetType(), typenames, options, includes);
+  }
+  if (options.GenFwdHeaders()) {
+    // The methods take the classes by reference or pointer, and the enums
+    // are complete once they are declared with their backing types.
+    for (const AidlDefinedType* type : MethodTypes(typenames, interface)) {
+      includes.erase(HeaderFile(*type, ClassNames::RAW, false));
+      includes.insert(FwdHeaderFile(*type, false));
+    }
   }
 
   const string i_name = ClassName(interface, ClassNames::INTERFACE);
@@ -971,6 +1942,31 @@ unique_ptr<Document> BuildInterfaceHeader(const AidlTypenames& typenames,
     if_class->AddPublic(unique_ptr<Declaration>(new LiteralDecl(code.str())));
   }
 
+  if (options.GenWireSchema()) {
+    includes.insert("string_view");
+    if_class->AddPublic(
+        std::make_unique<LiteralDecl>("static ::std::string_view getWireSchema();\n"));
+  }
+
+  if (HasCacheableMethods(interface)) {
+    // The proxies only return the results that they cached in the current
+    // generation, which invalidateCaches() ends.
+    includes.insert("aidl/result_cache.h");
+    if_class->AddPublic(unique_ptr<Declaration>(
+        new LiteralDecl("static ::android::aidl::CacheGeneration cacheGeneration;\n"
+                        "static void invalidateCaches() {\n"
+                        "  cacheGeneration.Invalidate();\n"
+                        "}\n")));
+  }
+  if (HasBatchableMethods(interface)) {
+    // Sends the calls of the @Batchable methods that the proxy has queued
+    if_class->AddPublic(unique_ptr<Declaration>(new LiteralDecl(
+        StringPrintf("virtual %s %s() {\n"
+                     "  return %s::ok();\n"
+                     "}\n",
+                     kBinderStatusLiteral, kFlushBatchedCalls.c_str(), kBinderStatusLiteral))));
+  }
+
   std::vector<std::unique_ptr<Declaration>> string_constants;
   unique_ptr<Enum> int_constant_enum{new Enum{"", "int32_t", false}};
   for (const auto& constant : interface.GetConstantDeclarations()) {
@@ -1015,12 +2011,24 @@ unique_ptr<Document> BuildInterfaceHeader(const AidlTypenames& typenames,
     for (const auto& method : interface.GetMethods()) {
       if (method->IsUserDefined()) {
         // Each method gets an enum entry and pure virtual declaration.
-        if_class->AddPublic(BuildMethodDecl(*method, typenames, true));
+        if_class->AddPublic(BuildMethodDecl(interface, *method, typenames, options, true));
       } else {
         if_class->AddPublic(BuildMetaMethodDecl(*method, typenames, options, true));
       }
     }
   }
+  if (options.GenAsync() && HasAsyncVariants(interface)) {
+    includes.insert("future");
+    includes.insert("aidl/async_executor.h");
+  }
+  if (options.GenAsync()) {
+    for (const auto& method : interface.GetMethods()) {
+      if (!HasAsyncVariant(*method)) continue;
+      if_class->AddPublic(unique_ptr<Declaration>{
+          new MethodDecl{AsyncFutureType(*method, typenames, options), AsyncMethodName(*method),
+                         AsyncArgList(*method, typenames, options)}});
+    }
+  }
 
   // Implement the default impl class.
   vector<unique_ptr<Declaration>> method_decls;
@@ -1039,10 +2047,12 @@ unique_ptr<Document> BuildInterfaceHeader(const AidlTypenames& typenames,
     if (method->IsUserDefined()) {
       std::ostringstream code;
       code << "::android::binder::Status " << method->GetName()
-           << BuildArgList(typenames, *method, true, true).ToString() << " override {\n"
+           << BuildArgList(typenames, interface, *method, options, true, true).ToString()
+           << " override {\n"
            << "  return ::android::binder::Status::fromStatusT(::android::UNKNOWN_TRANSACTION);\n"
            << "}\n";
       method_decls.emplace_back(new LiteralDecl(code.str()));
+      AddSize(interface, method.get(), "default_impl", *method_decls.back());
     } else {
       if (method->GetName() == kGetInterfaceVersion && options.Version() > 0) {
         std::ostringstream code;
@@ -1065,6 +2075,11 @@ unique_ptr<Document> BuildInterfaceHeader(const AidlTypenames& typenames,
   decls.emplace_back(std::move(if_class));
   decls.emplace_back(new ClassDecl{
       ClassName(interface, ClassNames::DEFAULT_IMPL), i_name, std::move(method_decls), {}});
+  if (options.GenLazyProxy()) {
+    includes.insert("mutex");
+    includes.insert(kString16Header);
+    decls.push_back(BuildLazyClassDecl(typenames, interface, options));
+  }
 
   return unique_ptr<Document>{
       new CppHeader{BuildHeaderGuard(interface, ClassNames::INTERFACE),
@@ -1074,39 +2089,37 @@ unique_ptr<Document> BuildInterfaceHeader(const AidlTypenames& typenames,
 
 std::unique_ptr<Document> BuildParcelHeader(const AidlTypenames& typenames,
                                             const AidlStructuredParcelable& parcel,
-                                            const Options&) {
+                                            const Options& options) {
   unique_ptr<ClassDecl> parcel_class{new ClassDecl{parcel.GetName(), "::android::Parcelable"}};
 
   set<string> includes = {kStatusHeader, kParcelHeader};
   includes.insert("tuple");
   for (const auto& variable : parcel.GetFields()) {
-    AddHeaders(variable->GetType(), typenames, includes);
+    AddHeaders(variable->GetType(), typenames, options, includes);
+  }
+  const bool is_pmr = parcel.IsPolymorphicAllocator();
+  if (is_pmr) {
+    includes.insert({"memory_resource", "string", "utility", "vector"});
+    parcel_class->AddPublic(std::unique_ptr<LiteralDecl>(
+        new LiteralDecl(GenAllocatorConstructors(parcel, typenames, parcel.GetName()))));
   }
 
-  set<string> operators = {"<", ">", "==", ">=", "<=", "!="};
-  for (const auto& op : operators) {
-    std::ostringstream operator_code;
-    std::vector<std::string> variable_name;
-    std::vector<std::string> rhs_variable_name;
-    for (const auto& variable : parcel.GetFields()) {
-      variable_name.push_back(variable->GetName());
-      rhs_variable_name.push_back("rhs." + variable->GetName());
-    }
-
-    operator_code << "inline bool operator" << op << "(const " << parcel.GetName()
-                  << "& rhs) const {\n"
-                  << "  return "
-                  << "std::tie(" << Join(variable_name, ", ") << ")" << op << "std::tie("
-                  << Join(rhs_variable_name, ", ") << ")"
-                  << ";\n"
-                  << "}\n";
-
-    parcel_class->AddPublic(std::unique_ptr<LiteralDecl>(new LiteralDecl(operator_code.str())));
+  parcel_class->AddPublic(std::unique_ptr<LiteralDecl>(
+      new LiteralDecl(GenComparisonOperators(parcel, parcel.GetName()))));
+  if (options.GenParcelableToString()) {
+    includes.insert({"aidl/to_string.h", "string"});
+    parcel_class->AddPublic(std::make_unique<LiteralDecl>(GenToString(parcel)));
+  }
+  if (options.GenWireSchema()) {
+    includes.insert("string_view");
+    parcel_class->AddPublic(
+        std::make_unique<LiteralDecl>("static ::std::string_view getWireSchema();\n"));
   }
   for (const auto& variable : parcel.GetFields()) {
 
     std::ostringstream out;
-    std::string cppType = CppNameOf(variable->GetType(), typenames);
+    std::string cppType = is_pmr ? CppPmrNameOf(variable->GetType(), typenames)
+                                 : CppNameOf(variable->GetType(), typenames, options);
     out << cppType.c_str() << " " << variable->GetName().c_str();
     if (variable->GetDefaultValue()) {
       out << " = " << cppType.c_str() << "(" << variable->ValueString(ConstantValueDecorator)
@@ -1119,7 +2132,7 @@ std::unique_ptr<Document> BuildParcelHeader(const AidlTypenames& typenames,
         }
       }
     } else if (AidlTypenames::IsPrimitiveTypename(variable->GetType().GetName()) &&
-               !variable->GetType().IsArray()) {
+               (!variable->GetType().IsArray() || variable->GetType().IsFixedSizeArray())) {
       out << " = {}";
     }
     out << ";\n";
@@ -1136,13 +2149,188 @@ std::unique_ptr<Document> BuildParcelHeader(const AidlTypenames& typenames,
       MethodDecl::IS_OVERRIDE | MethodDecl::IS_CONST | MethodDecl::IS_FINAL));
   parcel_class->AddPublic(std::move(write));
 
+  vector<unique_ptr<Declaration>> parcel_decls;
+  unique_ptr<ClassDecl> delta_class;
+  if (parcel.IsDelta()) {
+    parcel_class->AddPublic(std::make_unique<LiteralDecl>("class Delta;\n"));
+    delta_class.reset(new ClassDecl{parcel.GetName() + "::Delta", "::android::Parcelable"});
+    delta_class->AddPublic(
+        std::make_unique<LiteralDecl>(GenDeltaMembers(parcel, parcel.GetName())));
+    delta_class->AddPublic(std::make_unique<MethodDecl>(
+        kAndroidStatusLiteral, "readFromParcel", ArgList("const ::android::Parcel* _aidl_parcel"),
+        MethodDecl::IS_OVERRIDE | MethodDecl::IS_FINAL));
+    delta_class->AddPublic(std::make_unique<MethodDecl>(
+        kAndroidStatusLiteral, "writeToParcel", ArgList("::android::Parcel* _aidl_parcel"),
+        MethodDecl::IS_OVERRIDE | MethodDecl::IS_CONST | MethodDecl::IS_FINAL));
+  }
+  parcel_decls.push_back(std::move(parcel_class));
+  if (delta_class) parcel_decls.push_back(std::move(delta_class));
+
+  vector<unique_ptr<Declaration>> hash_decls;
+  if (parcel.IsHashable()) {
+    includes.insert("aidl/hash.h");
+    const string qualified_name =
+        "::" + Join(android::base::Split(parcel.GetCanonicalName(), "."), "::");
+    hash_decls.push_back(
+        std::make_unique<LiteralDecl>(GenHashSpecialization(parcel, qualified_name)));
+  }
+
   return unique_ptr<Document>{new CppHeader{
       BuildHeaderGuard(parcel, ClassNames::RAW), vector<string>(includes.begin(), includes.end()),
-      NestInNamespaces(std::move(parcel_class), parcel.GetSplitPackage())}};
+      Append(NestInNamespaces(std::move(parcel_decls), parcel.GetSplitPackage()),
+             NestInNamespaces(std::move(hash_decls), {"std"}))}};
+}
+// Indents each of the lines of |code| by one level
+string IndentLines(const string& code) {
+  string indented;
+  for (const string& line : android::base::Split(code, "\n")) {
+    if (!line.empty()) indented += "  " + line + "\n";
+  }
+  return indented;
 }
+
+// The reads of the fields of a @FixedSize parcelable from the block of
+// _aidl_block_size bytes at _aidl_block, in the layout of ParcelReadCall(),
+// or their writes into it. The fields that a Parcel widens to an int32 go
+// through _aidl_word.
+string FixedSizeCopies(const AidlStructuredParcelable& parcel, const AidlTypenames& typenames,
+                       bool is_read) {
+  std::ostringstream code;
+  bool has_word = false;
+  size_t offset = 0;
+  for (const auto& variable : parcel.GetFields()) {
+    const AidlTypeSpecifier& type = variable->GetType();
+    const string& name = variable->GetName();
+    const size_t size = FixedSizeOf(type, typenames);
+    const string at = "_aidl_block + " + std::to_string(offset);
+    const std::optional<AidlBuiltinKind> kind = typenames.GetBackingBuiltinKind(type);
+    if (kind == AidlBuiltinKind::BOOLEAN || kind == AidlBuiltinKind::BYTE ||
+        kind == AidlBuiltinKind::CHAR) {
+      if (!has_word) {
+        code << "int32_t _aidl_word;\n";
+        has_word = true;
+      }
+      const bool is_enum = typenames.GetEnumDeclaration(type) != nullptr;
+      if (is_read) {
+        string value = "_aidl_word != 0";
+        if (kind == AidlBuiltinKind::BYTE) {
+          value = "static_cast<int8_t>(_aidl_word)";
+          if (is_enum) value = "static_cast<" + CppNameOf(type, typenames) + ">(" + value + ")";
+        } else if (kind == AidlBuiltinKind::CHAR) {
+          value = "static_cast<char16_t>(_aidl_word)";
+        }
+        code << "memcpy(&_aidl_word, " << at << ", 4);\n";
+        code << name << " = " << value << ";\n";
+      } else {
+        string value = name;
+        if (kind == AidlBuiltinKind::BOOLEAN) {
+          value = name + " ? 1 : 0";
+        } else if (is_enum) {
+          value = "static_cast<int8_t>(" + name + ")";
+        }
+        code << "_aidl_word = " << value << ";\n";
+        code << "memcpy(" << at << ", &_aidl_word, 4);\n";
+      }
+    } else if (is_read) {
+      code << "memcpy(&" << name << ", " << at << ", " << size << ");\n";
+    } else {
+      code << "memcpy(" << at << ", &" << name << ", " << size << ");\n";
+    }
+    offset += size;
+  }
+  return code.str();
+}
+
+// The read of |variable| of |parcel| from _aidl_parcel into |var|, where the
+// containers of a @PolymorphicAllocator parcelable go through aidl/pmr_parcel.h
+MethodCall* FieldReadCall(const AidlStructuredParcelable& parcel,
+                          const AidlVariableDeclaration& variable, const AidlTypenames& typenames,
+                          const string& var) {
+  if (parcel.IsPolymorphicAllocator() && IsPmrContainer(variable.GetType())) {
+    return new MethodCall("::android::aidl::pmr::ReadFromParcel",
+                          ArgList(vector<string>{"_aidl_parcel", "&" + var}));
+  }
+  return ParcelReadCall(variable.GetType(), typenames, "_aidl_parcel", true, "&" + var);
+}
+
+// The write of |variable| of |parcel| into _aidl_parcel, see FieldReadCall()
+MethodCall* FieldWriteCall(const AidlStructuredParcelable& parcel,
+                           const AidlVariableDeclaration& variable, const AidlTypenames& typenames,
+                           const string& var) {
+  if (parcel.IsPolymorphicAllocator() && IsPmrContainer(variable.GetType())) {
+    return new MethodCall("::android::aidl::pmr::WriteToParcel",
+                          ArgList(vector<string>{"_aidl_parcel", var}));
+  }
+  return ParcelWriteCall(variable.GetType(), typenames, "_aidl_parcel", true, var);
+}
+
+// The readFromParcel() and writeToParcel() of the Delta of a @Delta |parcel|,
+// which are those of a parcelable of an int64 of the fields that it has and
+// of the values of those fields only
+vector<unique_ptr<Declaration>> BuildDeltaSource(const AidlTypenames& typenames,
+                                                 const AidlStructuredParcelable& parcel) {
+  const string clazz = parcel.GetName() + "::Delta";
+  const auto& fields = parcel.GetFields();
+
+  unique_ptr<MethodImpl> read{new MethodImpl{kAndroidStatusLiteral, clazz, "readFromParcel",
+                                             ArgList("const ::android::Parcel* _aidl_parcel")}};
+  StatementBlock* read_block = read->GetStatementBlock();
+  read_block->AddLiteral(
+      "size_t _aidl_start_pos = _aidl_parcel->dataPosition();\n"
+      "int32_t _aidl_parcelable_raw_size = _aidl_parcel->readInt32();\n"
+      "if (_aidl_parcelable_raw_size < 0) return ::android::BAD_VALUE;\n"
+      "size_t _aidl_parcelable_size = static_cast<size_t>(_aidl_parcelable_raw_size);\n",
+      false /* add_semicolon */);
+  read_block->AddLiteral(StringPrintf("%s %s = _aidl_parcel->readUint64(&fields)",
+                                      kAndroidStatusLiteral, kAndroidStatusVarName));
+  read_block->AddStatement(ReturnOnStatusNotOk());
+  for (size_t i = 0; i < fields.size(); i++) {
+    IfStatement* present = new IfStatement(new LiteralExpression("fields & " + DeltaBit(i)));
+    present->OnTrue()->AddStatement(new Assignment(
+        kAndroidStatusVarName,
+        FieldReadCall(parcel, *fields[i], typenames, "values." + fields[i]->GetName())));
+    present->OnTrue()->AddStatement(ReturnOnStatusNotOk());
+    read_block->AddStatement(present);
+  }
+  read_block->AddLiteral(
+      "_aidl_parcel->setDataPosition(_aidl_start_pos + _aidl_parcelable_size);\n"
+      "return ::android::OK;\n",
+      false /* add_semicolon */);
+
+  unique_ptr<MethodImpl> write{new MethodImpl{kAndroidStatusLiteral, clazz, "writeToParcel",
+                                              ArgList("::android::Parcel* _aidl_parcel"),
+                                              true /*const*/}};
+  StatementBlock* write_block = write->GetStatementBlock();
+  write_block->AddLiteral(
+      "auto _aidl_start_pos = _aidl_parcel->dataPosition();\n"
+      "_aidl_parcel->writeInt32(0)");
+  write_block->AddLiteral(StringPrintf("%s %s = _aidl_parcel->writeUint64(fields)",
+                                       kAndroidStatusLiteral, kAndroidStatusVarName));
+  write_block->AddStatement(ReturnOnStatusNotOk());
+  for (size_t i = 0; i < fields.size(); i++) {
+    IfStatement* present = new IfStatement(new LiteralExpression("fields & " + DeltaBit(i)));
+    present->OnTrue()->AddStatement(new Assignment(
+        kAndroidStatusVarName,
+        FieldWriteCall(parcel, *fields[i], typenames, "values." + fields[i]->GetName())));
+    present->OnTrue()->AddStatement(ReturnOnStatusNotOk());
+    write_block->AddStatement(present);
+  }
+  write_block->AddLiteral(
+      "auto _aidl_end_pos = _aidl_parcel->dataPosition();\n"
+      "_aidl_parcel->setDataPosition(_aidl_start_pos);\n"
+      "_aidl_parcel->writeInt32(_aidl_end_pos - _aidl_start_pos);\n"
+      "_aidl_parcel->setDataPosition(_aidl_end_pos)");
+  write_block->AddLiteral(StringPrintf("return %s", kAndroidStatusVarName));
+
+  vector<unique_ptr<Declaration>> decls;
+  decls.push_back(std::move(read));
+  decls.push_back(std::move(write));
+  return decls;
+}
+
 std::unique_ptr<Document> BuildParcelSource(const AidlTypenames& typenames,
                                             const AidlStructuredParcelable& parcel,
-                                            const Options&) {
+                                            const Options& options) {
   unique_ptr<MethodImpl> read{new MethodImpl{kAndroidStatusLiteral, parcel.GetName(),
                                              "readFromParcel",
                                              ArgList("const ::android::Parcel* _aidl_parcel")}};
@@ -1150,26 +2338,56 @@ std::unique_ptr<Document> BuildParcelSource(const AidlTypenames& typenames,
   read_block->AddLiteral(
       StringPrintf("%s %s = %s", kAndroidStatusLiteral, kAndroidStatusVarName, kAndroidStatusOk));
 
-  read_block->AddLiteral(
-      "size_t _aidl_start_pos = _aidl_parcel->dataPosition();\n"
-      "int32_t _aidl_parcelable_raw_size = _aidl_parcel->readInt32();\n"
-      "if (_aidl_parcelable_raw_size < 0) return ::android::BAD_VALUE;\n"
-      "size_t _aidl_parcelable_size = static_cast<size_t>(_aidl_parcelable_raw_size);\n");
-
-  for (const auto& variable : parcel.GetFields()) {
-    string method = ParcelReadMethodOf(variable->GetType(), typenames);
-
-    read_block->AddStatement(new Assignment(
-        kAndroidStatusVarName, new MethodCall(StringPrintf("_aidl_parcel->%s", method.c_str()),
-                                              ParcelReadCastOf(variable->GetType(), typenames,
-                                                               "&" + variable->GetName()))));
-    read_block->AddStatement(ReturnOnStatusNotOk());
-    read_block->AddLiteral(StringPrintf(
-        "if (_aidl_parcel->dataPosition() - _aidl_start_pos >= _aidl_parcelable_size) {\n"
-        "  _aidl_parcel->setDataPosition(_aidl_start_pos + _aidl_parcelable_size);\n"
-        "  return %s;\n"
-        "}",
-        kAndroidStatusVarName));
+  // A @Headerless parcelable is written by the same build that reads it, so
+  // it has neither the size header nor the fields of other versions to skip
+  const bool is_headerless = parcel.IsHeaderless();
+  if (!is_headerless) {
+    read_block->AddLiteral(
+        "size_t _aidl_start_pos = _aidl_parcel->dataPosition();\n"
+        "int32_t _aidl_parcelable_raw_size = _aidl_parcel->readInt32();\n"
+        "if (_aidl_parcelable_raw_size < 0) return ::android::BAD_VALUE;\n"
+        "size_t _aidl_parcelable_size = static_cast<size_t>(_aidl_parcelable_raw_size);\n");
+  }
+
+  const size_t fixed_size = parcel.IsFixedSize() ? FixedSizeOf(parcel, typenames) : 0;
+  if (fixed_size > 0 && is_headerless) {
+    read_block->AddLiteral(
+        "const uint8_t* _aidl_block = static_cast<const uint8_t*>(_aidl_parcel->readInplace(" +
+            std::to_string(fixed_size) + "));\n" +
+            "if (_aidl_block == nullptr) return ::android::BAD_VALUE;\n" +
+            FixedSizeCopies(parcel, typenames, true /* is_read */),
+        false /* add_semicolon */);
+  } else if (fixed_size > 0) {
+    // All the fields at once, unless the parcelable is from an older version
+    // with fewer fields, which the reads of each field below handle
+    const string block_size = std::to_string(fixed_size);
+    read_block->AddLiteral(
+        "if (_aidl_parcelable_size >= sizeof(int32_t) + " + block_size + ") {\n" +
+            IndentLines("const uint8_t* _aidl_block = static_cast<const uint8_t*>("
+                   "_aidl_parcel->readInplace(" +
+                   block_size + "));\n" +
+                   "if (_aidl_block == nullptr) return ::android::BAD_VALUE;\n" +
+                   FixedSizeCopies(parcel, typenames, true /* is_read */) +
+                   "_aidl_parcel->setDataPosition(_aidl_start_pos + _aidl_parcelable_size);\n"
+                   "return ::android::OK;\n") +
+            "}\n",
+        false /* add_semicolon */);
+  }
+
+  // The block above has read all the fields of a @FixedSize @Headerless one
+  if (fixed_size == 0 || !is_headerless) {
+    for (const auto& variable : parcel.GetFields()) {
+      read_block->AddStatement(new Assignment(
+          kAndroidStatusVarName, FieldReadCall(parcel, *variable, typenames, variable->GetName())));
+      read_block->AddStatement(ReturnOnStatusNotOk());
+      if (is_headerless) continue;
+      read_block->AddLiteral(StringPrintf(
+          "if (_aidl_parcel->dataPosition() - _aidl_start_pos >= _aidl_parcelable_size) {\n"
+          "  _aidl_parcel->setDataPosition(_aidl_start_pos + _aidl_parcelable_size);\n"
+          "  return %s;\n"
+          "}",
+          kAndroidStatusVarName));
+    }
   }
   read_block->AddLiteral(StringPrintf("return %s", kAndroidStatusVarName));
 
@@ -1180,64 +2398,73 @@ std::unique_ptr<Document> BuildParcelSource(const AidlTypenames& typenames,
   write_block->AddLiteral(
       StringPrintf("%s %s = %s", kAndroidStatusLiteral, kAndroidStatusVarName, kAndroidStatusOk));
 
-  write_block->AddLiteral(
-      "auto _aidl_start_pos = _aidl_parcel->dataPosition();\n"
-      "_aidl_parcel->writeInt32(0);");
-
+  if (!is_headerless) {
+    write_block->AddLiteral(
+        "auto _aidl_start_pos = _aidl_parcel->dataPosition();\n"
+        "_aidl_parcel->writeInt32(0);");
+  }
+  vector<std::pair<const AidlTypeSpecifier*, string>> fields;
   for (const auto& variable : parcel.GetFields()) {
-    string method = ParcelWriteMethodOf(variable->GetType(), typenames);
-    write_block->AddStatement(new Assignment(
-        kAndroidStatusVarName,
-        new MethodCall(StringPrintf("_aidl_parcel->%s", method.c_str()),
-                       ParcelWriteCastOf(variable->GetType(), typenames, variable->GetName()))));
-    write_block->AddStatement(ReturnOnStatusNotOk());
+    fields.emplace_back(&variable->GetType(), variable->GetName());
+  }
+  if (const string hint = SetDataCapacityFor(fields, typenames, "_aidl_parcel", true);
+      !hint.empty()) {
+    write_block->AddLiteral(hint);
   }
 
-  write_block->AddLiteral(
-      "auto _aidl_end_pos = _aidl_parcel->dataPosition();\n"
-      "_aidl_parcel->setDataPosition(_aidl_start_pos);\n"
-      "_aidl_parcel->writeInt32(_aidl_end_pos - _aidl_start_pos);\n"
-      "_aidl_parcel->setDataPosition(_aidl_end_pos);");
+  if (fixed_size > 0) {
+    write_block->AddLiteral(
+        "uint8_t* _aidl_block = static_cast<uint8_t*>(_aidl_parcel->writeInplace(" +
+            std::to_string(fixed_size) + "));\n" +
+            "if (_aidl_block == nullptr) return ::android::NO_MEMORY;\n" +
+            FixedSizeCopies(parcel, typenames, false /* is_read */),
+        false /* add_semicolon */);
+  } else {
+    for (const auto& variable : parcel.GetFields()) {
+      write_block->AddStatement(
+          new Assignment(kAndroidStatusVarName,
+                         FieldWriteCall(parcel, *variable, typenames, variable->GetName())));
+      write_block->AddStatement(ReturnOnStatusNotOk());
+    }
+  }
+
+  if (!is_headerless) {
+    write_block->AddLiteral(
+        "auto _aidl_end_pos = _aidl_parcel->dataPosition();\n"
+        "_aidl_parcel->setDataPosition(_aidl_start_pos);\n"
+        "_aidl_parcel->writeInt32(_aidl_end_pos - _aidl_start_pos);\n"
+        "_aidl_parcel->setDataPosition(_aidl_end_pos);");
+  }
   write_block->AddLiteral(StringPrintf("return %s", kAndroidStatusVarName));
 
+  AddSize(parcel, nullptr, "parcel_read", *read);
+  AddSize(parcel, nullptr, "parcel_write", *write);
+
   vector<unique_ptr<Declaration>> file_decls;
   file_decls.push_back(std::move(read));
   file_decls.push_back(std::move(write));
+  if (parcel.IsDelta()) {
+    for (auto& decl : BuildDeltaSource(typenames, parcel)) file_decls.push_back(std::move(decl));
+  }
+  if (options.GenWireSchema()) {
+    file_decls.push_back(std::make_unique<LiteralDecl>(
+        GenWireSchemaDefinition(parcel, typenames, parcel.GetName())));
+  }
 
   set<string> includes = {};
   AddHeaders(parcel, includes);
+  if (fixed_size > 0) {
+    includes.insert("cstring");
+  }
+  if (parcel.IsPolymorphicAllocator()) {
+    includes.insert("aidl/pmr_parcel.h");
+  }
 
   return unique_ptr<Document>{
       new CppSource{vector<string>(includes.begin(), includes.end()),
                     NestInNamespaces(std::move(file_decls), parcel.GetSplitPackage())}};
 }
 
-std::string GenerateEnumToString(const AidlTypenames& typenames,
-                                 const AidlEnumDeclaration& enum_decl) {
-  std::ostringstream code;
-  code << "static inline std::string toString(" << enum_decl.GetName() << " val) {\n";
-  code << "  switch(val) {\n";
-  std::set<std::string> unique_cases;
-  for (const auto& enumerator : enum_decl.GetEnumerators()) {
-    std::string c = enumerator->ValueString(enum_decl.GetBackingType(), ConstantValueDecorator);
-    // Only add a case if its value has not yet been used in the switch
-    // statement. C++ does not allow multiple cases with the same value, but
-    // enums does allow this. In this scenario, the first declared
-    // enumerator with the given value is printed.
-    if (unique_cases.count(c) == 0) {
-      unique_cases.insert(c);
-      code << "  case " << enum_decl.GetName() << "::" << enumerator->GetName() << ":\n";
-      code << "    return \"" << enumerator->GetName() << "\";\n";
-    }
-  }
-  code << "  default:\n";
-  code << "    return std::to_string(static_cast<"
-       << CppNameOf(enum_decl.GetBackingType(), typenames) << ">(val));\n";
-  code << "  }\n";
-  code << "}\n";
-  return code.str();
-}
-
 std::unique_ptr<Document> BuildEnumHeader(const AidlTypenames& typenames,
                                           const AidlEnumDeclaration& enum_decl) {
   std::unique_ptr<Enum> generated_enum{
@@ -1252,12 +2479,14 @@ std::unique_ptr<Document> BuildEnumHeader(const AidlTypenames& typenames,
       "array",
       "binder/Enums.h",
       "string",
+      "string_view",
   };
   AddHeaders(enum_decl.GetBackingType(), typenames, includes);
 
   std::vector<std::unique_ptr<Declaration>> decls1;
   decls1.push_back(std::move(generated_enum));
-  decls1.push_back(std::make_unique<LiteralDecl>(GenerateEnumToString(typenames, enum_decl)));
+  decls1.push_back(std::make_unique<LiteralDecl>(
+      GenerateEnumToString(enum_decl, CppNameOf(enum_decl.GetBackingType(), typenames))));
 
   std::vector<std::unique_ptr<Declaration>> decls2;
   decls2.push_back(std::make_unique<LiteralDecl>(GenerateEnumValues(enum_decl, {""})));
@@ -1269,6 +2498,50 @@ std::unique_ptr<Document> BuildEnumHeader(const AidlTypenames& typenames,
                            NestInNamespaces(std::move(decls2), {"android", "internal"}))}};
 }
 
+std::unique_ptr<Document> BuildFwdHeader(const AidlTypenames& typenames,
+                                         const AidlDefinedType& defined_type) {
+  set<string> includes;
+  vector<unique_ptr<Declaration>> decls;
+  const AidlEnumDeclaration* enum_decl = defined_type.AsEnumDeclaration();
+  if (enum_decl != nullptr) {
+    AddHeaders(enum_decl->GetBackingType(), typenames, includes);
+    decls.emplace_back(new LiteralDecl(
+        StringPrintf("enum class %s : %s;\n", enum_decl->GetName().c_str(),
+                     CppNameOf(enum_decl->GetBackingType(), typenames).c_str())));
+  } else if (defined_type.AsParcelable() != nullptr &&
+             defined_type.AsStructuredParcelable() == nullptr) {
+    // An unstructured parcelable is declared in its own header
+    const string cpp_header = defined_type.AsParcelable()->GetCppHeader();
+    if (!cpp_header.empty()) {
+      includes.insert(cpp_header);
+    }
+  } else {
+    decls.emplace_back(new LiteralDecl("class " + defined_type.GetName() + ";\n"));
+  }
+
+  string include_guard = BuildHeaderGuard(defined_type, ClassNames::RAW);
+  include_guard.insert(include_guard.size() - strlen("_H_"), "_FWD");
+  return unique_ptr<Document>{
+      new CppHeader{include_guard, vector<string>(includes.begin(), includes.end()),
+                    decls.empty() ? std::move(decls)
+                                  : NestInNamespaces(std::move(decls),
+                                                     defined_type.GetSplitPackage())}};
+}
+
+bool WriteFwdHeader(const Options& options, const AidlTypenames& typenames,
+                    const AidlDefinedType& defined_type, const IoDelegate& io_delegate) {
+  const string header_path = options.OutputHeaderDir() + FwdHeaderFile(defined_type);
+  unique_ptr<CodeWriter> code_writer(io_delegate.GetCodeWriter(header_path));
+  BuildFwdHeader(typenames, defined_type)->Write(code_writer.get());
+
+  const bool success = code_writer->Close();
+  if (!success) {
+    io_delegate.RemovePath(header_path);
+  }
+
+  return success;
+}
+
 bool WriteHeader(const Options& options, const AidlTypenames& typenames,
                  const AidlInterface& interface, const IoDelegate& io_delegate,
                  ClassNames header_type) {
@@ -1308,29 +2581,34 @@ bool WriteHeader(const Options& options, const AidlTypenames& typenames,
 
 using namespace internals;
 
+static void WriteDedupPlaceholder(const string& output_file, const IoDelegate& io_delegate) {
+  CodeWriterPtr source_writer = io_delegate.GetCodeWriter(output_file);
+  *source_writer
+      << "// This file is intentionally left blank as placeholder for deduplicated code.\n";
+  CHECK(source_writer->Close());
+}
+
 bool GenerateCppInterface(const string& output_file, const Options& options,
                           const AidlTypenames& typenames, const AidlInterface& interface,
-                          const IoDelegate& io_delegate) {
-  auto interface_src = BuildInterfaceSource(typenames, interface, options);
-  auto client_src = BuildClientSource(typenames, interface, options);
-  auto server_src = BuildServerSource(typenames, interface, options);
-
-  if (!interface_src || !client_src || !server_src) {
-    return false;
-  }
-
+                          const IoDelegate& io_delegate, bool with_source) {
   if (!WriteHeader(options, typenames, interface, io_delegate, ClassNames::INTERFACE) ||
       !WriteHeader(options, typenames, interface, io_delegate, ClassNames::CLIENT) ||
       !WriteHeader(options, typenames, interface, io_delegate, ClassNames::SERVER)) {
     return false;
   }
+  if (!with_source) {
+    WriteDedupPlaceholder(output_file, io_delegate);
+    return true;
+  }
 
+  // The sources are written as they are generated, so a failure leaves the
+  // output incomplete and it is removed.
   unique_ptr<CodeWriter> writer = io_delegate.GetCodeWriter(output_file);
-  interface_src->Write(writer.get());
-  client_src->Write(writer.get());
-  server_src->Write(writer.get());
+  const bool generated = WriteInterfaceSource(typenames, interface, options, writer.get()) &&
+                         WriteClientSource(typenames, interface, options, writer.get()) &&
+                         WriteServerSource(typenames, interface, options, writer.get());
 
-  const bool success = writer->Close();
+  const bool success = writer->Close() && generated;
   if (!success) {
     io_delegate.RemovePath(output_file);
   }
@@ -1340,11 +2618,11 @@ bool GenerateCppInterface(const string& output_file, const Options& options,
 
 bool GenerateCppParcel(const string& output_file, const Options& options,
                        const AidlTypenames& typenames, const AidlStructuredParcelable& parcelable,
-                       const IoDelegate& io_delegate) {
+                       const IoDelegate& io_delegate, bool with_source) {
   auto header = BuildParcelHeader(typenames, parcelable, options);
-  auto source = BuildParcelSource(typenames, parcelable, options);
+  auto source = with_source ? BuildParcelSource(typenames, parcelable, options) : nullptr;
 
-  if (!header || !source) {
+  if (!header || (with_source && !source)) {
     return false;
   }
 
@@ -1363,6 +2641,10 @@ bool GenerateCppParcel(const string& output_file, const Options& options,
   bn_writer->Write("#error TODO(b/111362593) parcelables do not have bn classes");
   CHECK(bn_writer->Close());
 
+  if (!with_source) {
+    WriteDedupPlaceholder(output_file, io_delegate);
+    return true;
+  }
   unique_ptr<CodeWriter> source_writer = io_delegate.GetCodeWriter(output_file);
   source->Write(source_writer.get());
   CHECK(source_writer->Close());
@@ -1424,10 +2706,16 @@ bool GenerateCppEnumDeclaration(const std::string& filename, const Options& opti
 }
 
 bool GenerateCpp(const string& output_file, const Options& options, const AidlTypenames& typenames,
-                 const AidlDefinedType& defined_type, const IoDelegate& io_delegate) {
+                 const AidlDefinedType& defined_type, const IoDelegate& io_delegate,
+                 bool with_source) {
+  if (options.GenFwdHeaders() && !WriteFwdHeader(options, typenames, defined_type, io_delegate)) {
+    return false;
+  }
+
   const AidlStructuredParcelable* parcelable = defined_type.AsStructuredParcelable();
   if (parcelable != nullptr) {
-    return GenerateCppParcel(output_file, options, typenames, *parcelable, io_delegate);
+    return GenerateCppParcel(output_file, options, typenames, *parcelable, io_delegate,
+                             with_source);
   }
 
   const AidlParcelable* parcelable_decl = defined_type.AsParcelable();
@@ -1442,7 +2730,8 @@ bool GenerateCpp(const string& output_file, const Options& options, const AidlTy
 
   const AidlInterface* interface = defined_type.AsInterface();
   if (interface != nullptr) {
-    return GenerateCppInterface(output_file, options, typenames, *interface, io_delegate);
+    return GenerateCppInterface(output_file, options, typenames, *interface, io_delegate,
+                                with_source);
   }
 
   CHECK(false) << "Unrecognized type sent for cpp generation.";
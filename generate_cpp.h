@@ -29,19 +29,22 @@ namespace android {
 namespace aidl {
 namespace cpp {
 
+// Without |with_source|, the headers are generated and the source is a
+// placeholder, its code being in the library of another compilation.
 bool GenerateCpp(const string& output_file, const Options& options, const AidlTypenames& typenames,
-                 const AidlDefinedType& parsed_doc, const IoDelegate& io_delegate);
+                 const AidlDefinedType& parsed_doc, const IoDelegate& io_delegate,
+                 bool with_source);
 
 namespace internals {
-std::unique_ptr<Document> BuildClientSource(const AidlTypenames& typenames,
-                                            const AidlInterface& parsed_doc,
-                                            const Options& options);
-std::unique_ptr<Document> BuildServerSource(const AidlTypenames& typenames,
-                                            const AidlInterface& parsed_doc,
-                                            const Options& options);
-std::unique_ptr<Document> BuildInterfaceSource(const AidlTypenames& typenames,
-                                               const AidlInterface& parsed_doc,
-                                               const Options& options);
+// The sources of an interface are written as they are generated, one
+// declaration at a time. They return false on internal errors, leaving
+// |to| incomplete.
+bool WriteClientSource(const AidlTypenames& typenames, const AidlInterface& parsed_doc,
+                       const Options& options, CodeWriter* to);
+bool WriteServerSource(const AidlTypenames& typenames, const AidlInterface& parsed_doc,
+                       const Options& options, CodeWriter* to);
+bool WriteInterfaceSource(const AidlTypenames& typenames, const AidlInterface& parsed_doc,
+                          const Options& options, CodeWriter* to);
 std::unique_ptr<Document> BuildClientHeader(const AidlTypenames& typenames,
                                             const AidlInterface& parsed_doc,
                                             const Options& options);
@@ -109,6 +109,7 @@ BpComplexTypeInterface::BpComplexTypeInterface(const ::android::sp<::android::IB
   if (((_aidl_ret_status) != (::android::OK))) {
     goto _aidl_error;
   }
+  _aidl_data.setDataCapacity(_aidl_data.dataPosition() + (4 + (goes_in ? goes_in->size() : 0) * 4) + (4 + (*goes_in_and_out).size() * 8));
   _aidl_ret_status = _aidl_data.writeInt32Vector(goes_in);
   if (((_aidl_ret_status) != (::android::OK))) {
     goto _aidl_error;
@@ -425,6 +426,7 @@ BpComplexTypeInterface::BpComplexTypeInterface(const ::android::sp<::android::IB
   if (((_aidl_ret_status) != (::android::OK))) {
     goto _aidl_error;
   }
+  _aidl_data.setDataCapacity(_aidl_data.dataPosition() + (4 + (goes_in ? goes_in->size() : 0) * 4) + (4 + (*goes_in_and_out).size() * 8));
   _aidl_ret_status = _aidl_data.writeInt32Vector(goes_in);
   if (((_aidl_ret_status) != (::android::OK))) {
     goto _aidl_error;
@@ -763,6 +765,8 @@ BnComplexTypeInterface::BnComplexTypeInterface()
   ::android::internal::Stability::markCompilationUnit(this);
 }
 
+static constexpr char16_t _aidl_IComplexTypeInterface_token[] = u"android.os.IComplexTypeInterface";
+
 ::android::status_t BnComplexTypeInterface::onTransact(uint32_t _aidl_code, const ::android::Parcel& _aidl_data, ::android::Parcel* _aidl_reply, uint32_t _aidl_flags) {
   ::android::status_t _aidl_ret_status = ::android::OK;
   switch (_aidl_code) {
@@ -772,7 +776,7 @@ BnComplexTypeInterface::BnComplexTypeInterface()
     ::std::vector<double> in_goes_in_and_out;
     ::std::vector<bool> out_goes_out;
     ::std::vector<int32_t> _aidl_return;
-    if (!(_aidl_data.checkInterface(this))) {
+    if (!(_aidl_data.enforceInterface(_aidl_IComplexTypeInterface_token, 32))) {
       _aidl_ret_status = ::android::BAD_TYPE;
       break;
     }
@@ -813,7 +817,7 @@ BnComplexTypeInterface::BnComplexTypeInterface()
   case ::android::IBinder::FIRST_CALL_TRANSACTION + 1 /* Piff */:
   {
     int32_t in_times;
-    if (!(_aidl_data.checkInterface(this))) {
+    if (!(_aidl_data.enforceInterface(_aidl_IComplexTypeInterface_token, 32))) {
       _aidl_ret_status = ::android::BAD_TYPE;
       break;
     }
@@ -828,7 +832,7 @@ BnComplexTypeInterface::BnComplexTypeInterface()
   {
     ::android::sp<::foo::IFooType> in_f;
     ::android::sp<::foo::IFooType> _aidl_return;
-    if (!(_aidl_data.checkInterface(this))) {
+    if (!(_aidl_data.enforceInterface(_aidl_IComplexTypeInterface_token, 32))) {
       _aidl_ret_status = ::android::BAD_TYPE;
       break;
     }
@@ -853,7 +857,7 @@ BnComplexTypeInterface::BnComplexTypeInterface()
   case ::android::IBinder::FIRST_CALL_TRANSACTION + 3 /* NullableBinder */:
   {
     ::android::sp<::foo::IFooType> _aidl_return;
-    if (!(_aidl_data.checkInterface(this))) {
+    if (!(_aidl_data.enforceInterface(_aidl_IComplexTypeInterface_token, 32))) {
       _aidl_ret_status = ::android::BAD_TYPE;
       break;
     }
@@ -876,7 +880,7 @@ BnComplexTypeInterface::BnComplexTypeInterface()
     ::std::vector<::android::String16> in_input;
     ::std::vector<::android::String16> out_output;
     ::std::vector<::android::String16> _aidl_return;
-    if (!(_aidl_data.checkInterface(this))) {
+    if (!(_aidl_data.enforceInterface(_aidl_IComplexTypeInterface_token, 32))) {
       _aidl_ret_status = ::android::BAD_TYPE;
       break;
     }
@@ -907,7 +911,7 @@ BnComplexTypeInterface::BnComplexTypeInterface()
     ::std::vector<::android::sp<::android::IBinder>> in_input;
     ::std::vector<::android::sp<::android::IBinder>> out_output;
     ::std::vector<::android::sp<::android::IBinder>> _aidl_return;
-    if (!(_aidl_data.checkInterface(this))) {
+    if (!(_aidl_data.enforceInterface(_aidl_IComplexTypeInterface_token, 32))) {
       _aidl_ret_status = ::android::BAD_TYPE;
       break;
     }
@@ -937,7 +941,7 @@ BnComplexTypeInterface::BnComplexTypeInterface()
   {
     ::android::base::unique_fd in_f;
     ::android::base::unique_fd _aidl_return;
-    if (!(_aidl_data.checkInterface(this))) {
+    if (!(_aidl_data.enforceInterface(_aidl_IComplexTypeInterface_token, 32))) {
       _aidl_ret_status = ::android::BAD_TYPE;
       break;
     }
@@ -963,7 +967,7 @@ BnComplexTypeInterface::BnComplexTypeInterface()
   {
     ::std::vector<::android::base::unique_fd> in_f;
     ::std::vector<::android::base::unique_fd> _aidl_return;
-    if (!(_aidl_data.checkInterface(this))) {
+    if (!(_aidl_data.enforceInterface(_aidl_IComplexTypeInterface_token, 32))) {
       _aidl_ret_status = ::android::BAD_TYPE;
       break;
     }
@@ -1016,6 +1020,8 @@ BnComplexTypeInterface::BnComplexTypeInterface()
   ::android::internal::Stability::markCompilationUnit(this);
 }
 
+static constexpr char16_t _aidl_IComplexTypeInterface_token[] = u"android.os.IComplexTypeInterface";
+
 ::android::status_t BnComplexTypeInterface::onTransact(uint32_t _aidl_code, const ::android::Parcel& _aidl_data, ::android::Parcel* _aidl_reply, uint32_t _aidl_flags) {
   ::android::status_t _aidl_ret_status = ::android::OK;
   switch (_aidl_code) {
@@ -1025,7 +1031,7 @@ BnComplexTypeInterface::BnComplexTypeInterface()
     ::std::vector<double> in_goes_in_and_out;
     ::std::vector<bool> out_goes_out;
     ::std::vector<int32_t> _aidl_return;
-    if (!(_aidl_data.checkInterface(this))) {
+    if (!(_aidl_data.enforceInterface(_aidl_IComplexTypeInterface_token, 32))) {
       _aidl_ret_status = ::android::BAD_TYPE;
       break;
     }
@@ -1068,7 +1074,7 @@ BnComplexTypeInterface::BnComplexTypeInterface()
   case ::android::IBinder::FIRST_CALL_TRANSACTION + 1 /* Piff */:
   {
     int32_t in_times;
-    if (!(_aidl_data.checkInterface(this))) {
+    if (!(_aidl_data.enforceInterface(_aidl_IComplexTypeInterface_token, 32))) {
       _aidl_ret_status = ::android::BAD_TYPE;
       break;
     }
@@ -1085,7 +1091,7 @@ BnComplexTypeInterface::BnComplexTypeInterface()
   {
     ::android::sp<::foo::IFooType> in_f;
     ::android::sp<::foo::IFooType> _aidl_return;
-    if (!(_aidl_data.checkInterface(this))) {
+    if (!(_aidl_data.enforceInterface(_aidl_IComplexTypeInterface_token, 32))) {
       _aidl_ret_status = ::android::BAD_TYPE;
       break;
     }
@@ -1112,7 +1118,7 @@ BnComplexTypeInterface::BnComplexTypeInterface()
   case ::android::IBinder::FIRST_CALL_TRANSACTION + 3 /* NullableBinder */:
   {
     ::android::sp<::foo::IFooType> _aidl_return;
-    if (!(_aidl_data.checkInterface(this))) {
+    if (!(_aidl_data.enforceInterface(_aidl_IComplexTypeInterface_token, 32))) {
       _aidl_ret_status = ::android::BAD_TYPE;
       break;
     }
@@ -1137,7 +1143,7 @@ BnComplexTypeInterface::BnComplexTypeInterface()
     ::std::vector<::android::String16> in_input;
     ::std::vector<::android::String16> out_output;
     ::std::vector<::android::String16> _aidl_return;
-    if (!(_aidl_data.checkInterface(this))) {
+    if (!(_aidl_data.enforceInterface(_aidl_IComplexTypeInterface_token, 32))) {
       _aidl_ret_status = ::android::BAD_TYPE;
       break;
     }
@@ -1170,7 +1176,7 @@ BnComplexTypeInterface::BnComplexTypeInterface()
     ::std::vector<::android::sp<::android::IBinder>> in_input;
     ::std::vector<::android::sp<::android::IBinder>> out_output;
     ::std::vector<::android::sp<::android::IBinder>> _aidl_return;
-    if (!(_aidl_data.checkInterface(this))) {
+    if (!(_aidl_data.enforceInterface(_aidl_IComplexTypeInterface_token, 32))) {
       _aidl_ret_status = ::android::BAD_TYPE;
       break;
     }
@@ -1202,7 +1208,7 @@ BnComplexTypeInterface::BnComplexTypeInterface()
   {
     ::android::base::unique_fd in_f;
     ::android::base::unique_fd _aidl_return;
-    if (!(_aidl_data.checkInterface(this))) {
+    if (!(_aidl_data.enforceInterface(_aidl_IComplexTypeInterface_token, 32))) {
       _aidl_ret_status = ::android::BAD_TYPE;
       break;
     }
@@ -1230,7 +1236,7 @@ BnComplexTypeInterface::BnComplexTypeInterface()
   {
     ::std::vector<::android::base::unique_fd> in_f;
     ::std::vector<::android::base::unique_fd> _aidl_return;
-    if (!(_aidl_data.checkInterface(this))) {
+    if (!(_aidl_data.enforceInterface(_aidl_IComplexTypeInterface_token, 32))) {
       _aidl_ret_status = ::android::BAD_TYPE;
       break;
     }
@@ -1382,6 +1388,7 @@ const char kExpectedEnumHeaderOutput[] =
 #include <binder/Enums.h>
 #include <cstdint>
 #include <string>
+#include <string_view>
 
 namespace android {
 
@@ -1400,7 +1407,7 @@ enum class TestEnum : int8_t {
   TEN = 10,
 };
 
-static inline std::string toString(TestEnum val) {
+static constexpr std::string_view toStringView(TestEnum val) {
   switch(val) {
   case TestEnum::ZERO:
     return "ZERO";
@@ -1423,8 +1430,60 @@ static inline std::string toString(TestEnum val) {
   case TestEnum::TEN:
     return "TEN";
   default:
+    return {};
+  }
+}
+
+static inline std::string toString(TestEnum val) {
+  const std::string_view name = toStringView(val);
+  if (name.empty()) {
     return std::to_string(static_cast<int8_t>(val));
   }
+  return std::string(name);
+}
+
+static constexpr bool fromString(std::string_view name, TestEnum* val) {
+  if (name == "ZERO") {
+    *val = TestEnum::ZERO;
+    return true;
+  }
+  if (name == "ONE") {
+    *val = TestEnum::ONE;
+    return true;
+  }
+  if (name == "THREE") {
+    *val = TestEnum::THREE;
+    return true;
+  }
+  if (name == "FOUR") {
+    *val = TestEnum::FOUR;
+    return true;
+  }
+  if (name == "FIVE") {
+    *val = TestEnum::FIVE;
+    return true;
+  }
+  if (name == "SIX") {
+    *val = TestEnum::SIX;
+    return true;
+  }
+  if (name == "SEVEN") {
+    *val = TestEnum::SEVEN;
+    return true;
+  }
+  if (name == "EIGHT") {
+    *val = TestEnum::EIGHT;
+    return true;
+  }
+  if (name == "NINE") {
+    *val = TestEnum::NINE;
+    return true;
+  }
+  if (name == "TEN") {
+    *val = TestEnum::TEN;
+    return true;
+  }
+  return false;
 }
 
 }  // namespace os
@@ -1475,6 +1534,7 @@ const char kExpectedEnumWithBackingTypeHeaderOutput[] =
 #include <binder/Enums.h>
 #include <cstdint>
 #include <string>
+#include <string_view>
 
 namespace android {
 
@@ -1485,15 +1545,35 @@ enum class TestEnum : int64_t {
   BAR = 2L,
 };
 
-static inline std::string toString(TestEnum val) {
+static constexpr std::string_view toStringView(TestEnum val) {
   switch(val) {
   case TestEnum::FOO:
     return "FOO";
   case TestEnum::BAR:
     return "BAR";
   default:
+    return {};
+  }
+}
+
+static inline std::string toString(TestEnum val) {
+  const std::string_view name = toStringView(val);
+  if (name.empty()) {
     return std::to_string(static_cast<int64_t>(val));
   }
+  return std::string(name);
+}
+
+static constexpr bool fromString(std::string_view name, TestEnum* val) {
+  if (name == "FOO") {
+    *val = TestEnum::FOO;
+    return true;
+  }
+  if (name == "BAR") {
+    *val = TestEnum::BAR;
+    return true;
+  }
+  return false;
 }
 
 }  // namespace os
@@ -1570,7 +1650,20 @@ class ASTTest : public ::testing::Test {
   void Compare(Document* doc, const char* expected) {
     string output;
     doc->Write(CodeWriter::ForString(&output).get());
+    Compare(output, expected);
+  }
+
+  template <typename WriteSource>
+  void CompareSource(WriteSource write_source, const AidlInterface& interface,
+                     const char* expected) {
+    string output;
+    CodeWriterPtr writer = CodeWriter::ForString(&output);
+    ASSERT_TRUE(write_source(typenames_, interface, options_, writer.get()));
+    writer->Close();
+    Compare(output, expected);
+  }
 
+  void Compare(const string& output, const char* expected) {
     if (expected == output) {
       return; // Success
     }
@@ -1605,8 +1698,7 @@ TEST_F(ComplexTypeInterfaceASTTest, GeneratesClientHeader) {
 TEST_F(ComplexTypeInterfaceASTTest, GeneratesClientSource) {
   AidlInterface* interface = ParseSingleInterface();
   ASSERT_NE(interface, nullptr);
-  unique_ptr<Document> doc = internals::BuildClientSource(typenames_, *interface, options_);
-  Compare(doc.get(), kExpectedComplexTypeClientSourceOutput);
+  CompareSource(internals::WriteClientSource, *interface, kExpectedComplexTypeClientSourceOutput);
 }
 
 TEST_F(ComplexTypeInterfaceASTTest, GeneratesServerHeader) {
@@ -1619,8 +1711,7 @@ TEST_F(ComplexTypeInterfaceASTTest, GeneratesServerHeader) {
 TEST_F(ComplexTypeInterfaceASTTest, GeneratesServerSource) {
   AidlInterface* interface = ParseSingleInterface();
   ASSERT_NE(interface, nullptr);
-  unique_ptr<Document> doc = internals::BuildServerSource(typenames_, *interface, options_);
-  Compare(doc.get(), kExpectedComplexTypeServerSourceOutput);
+  CompareSource(internals::WriteServerSource, *interface, kExpectedComplexTypeServerSourceOutput);
 }
 
 TEST_F(ComplexTypeInterfaceASTTest, GeneratesInterfaceHeader) {
@@ -1633,8 +1724,7 @@ TEST_F(ComplexTypeInterfaceASTTest, GeneratesInterfaceHeader) {
 TEST_F(ComplexTypeInterfaceASTTest, GeneratesInterfaceSource) {
   AidlInterface* interface = ParseSingleInterface();
   ASSERT_NE(interface, nullptr);
-  unique_ptr<Document> doc = internals::BuildInterfaceSource(typenames_, *interface, options_);
-  Compare(doc.get(), kExpectedComplexTypeInterfaceSourceOutput);
+  CompareSource(internals::WriteInterfaceSource, *interface, kExpectedComplexTypeInterfaceSourceOutput);
 }
 
 class ComplexTypeInterfaceASTTestWithTrace : public ASTTest {
@@ -1649,15 +1739,13 @@ class ComplexTypeInterfaceASTTestWithTrace : public ASTTest {
 TEST_F(ComplexTypeInterfaceASTTestWithTrace, GeneratesClientSource) {
   AidlInterface* interface = ParseSingleInterface();
   ASSERT_NE(interface, nullptr);
-  unique_ptr<Document> doc = internals::BuildClientSource(typenames_, *interface, options_);
-  Compare(doc.get(), kExpectedComplexTypeClientWithTraceSourceOutput);
+  CompareSource(internals::WriteClientSource, *interface, kExpectedComplexTypeClientWithTraceSourceOutput);
 }
 
 TEST_F(ComplexTypeInterfaceASTTestWithTrace, GeneratesServerSource) {
   AidlInterface* interface = ParseSingleInterface();
   ASSERT_NE(interface, nullptr);
-  unique_ptr<Document> doc = internals::BuildServerSource(typenames_, *interface, options_);
-  Compare(doc.get(), kExpectedComplexTypeServerWithTraceSourceOutput);
+  CompareSource(internals::WriteServerSource, *interface, kExpectedComplexTypeServerWithTraceSourceOutput);
 }
 
 namespace test_io_handling {
@@ -1680,7 +1768,8 @@ TEST_F(IoErrorHandlingTest, GenerateCorrectlyAbsentErrors) {
   // Confirm that this is working correctly without I/O problems.
   AidlInterface* interface = ParseSingleInterface();
   ASSERT_NE(interface, nullptr);
-  ASSERT_TRUE(GenerateCpp(options_.OutputFile(), options_, typenames_, *interface, io_delegate_));
+  ASSERT_TRUE(GenerateCpp(options_.OutputFile(), options_, typenames_, *interface, io_delegate_,
+                          true /* with_source */));
 }
 
 TEST_F(IoErrorHandlingTest, HandlesBadHeaderWrite) {
@@ -1693,7 +1782,8 @@ TEST_F(IoErrorHandlingTest, HandlesBadHeaderWrite) {
       StringPrintf("%s%c%s", kHeaderDir, OS_PATH_SEPARATOR,
                    kInterfaceHeaderRelPath);
   io_delegate_.AddBrokenFilePath(header_path);
-  ASSERT_FALSE(GenerateCpp(options_.OutputFile(), options_, typenames_, *interface, io_delegate_));
+  ASSERT_FALSE(GenerateCpp(options_.OutputFile(), options_, typenames_, *interface, io_delegate_,
+                           true /* with_source */));
   // We should never attempt to write the C++ file if we fail writing headers.
   ASSERT_FALSE(io_delegate_.GetWrittenContents(kOutputPath, nullptr));
   // We should remove partial results.
@@ -1707,7 +1797,8 @@ TEST_F(IoErrorHandlingTest, HandlesBadCppWrite) {
 
   // Simulate issues closing the cpp file.
   io_delegate_.AddBrokenFilePath(kOutputPath);
-  ASSERT_FALSE(GenerateCpp(options_.OutputFile(), options_, typenames_, *interface, io_delegate_));
+  ASSERT_FALSE(GenerateCpp(options_.OutputFile(), options_, typenames_, *interface, io_delegate_,
+                           true /* with_source */));
   // We should remove partial results.
   ASSERT_TRUE(io_delegate_.PathWasRemoved(kOutputPath));
 }
@@ -19,16 +19,21 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <algorithm>
 #include <map>
 #include <memory>
 #include <sstream>
 
+#include <android-base/parseint.h>
 #include <android-base/stringprintf.h>
+#include <android-base/strings.h>
 
+#include "aidl_profile.h"
 #include "aidl_to_java.h"
 #include "code_writer.h"
 #include "logging.h"
 
+using android::base::StringPrintf;
 using std::unique_ptr;
 using ::android::aidl::java::Variable;
 using std::string;
@@ -37,13 +42,59 @@ namespace android {
 namespace aidl {
 namespace java {
 
+bool read_transact_profile(const AidlInterface& iface, const Options& options,
+                           const IoDelegate& io_delegate, TransactProfile* profile) {
+  const string& filename = options.TransactProfileFile();
+  if (filename.empty()) {
+    return true;
+  }
+  std::unique_ptr<string> contents = io_delegate.GetFileContents(filename);
+  if (contents == nullptr) {
+    LOG(ERROR) << "Could not read transact profile: " << filename;
+    return false;
+  }
+  int lineno = 0;
+  for (const string& raw_line : android::base::Split(*contents, "\n")) {
+    lineno++;
+    const string line = android::base::Trim(raw_line);
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    const size_t hash = line.find('#');
+    const size_t space = line.find_first_of(" \t");
+    uint64_t calls = 0;
+    if (hash == string::npos || space == string::npos || hash > space ||
+        !android::base::ParseUint(android::base::Trim(line.substr(space)), &calls)) {
+      LOG(ERROR) << filename << ':' << lineno << " malformed transact profile line: '" << line
+                 << "'";
+      return false;
+    }
+    const string interface_name = line.substr(0, hash);
+    if (interface_name == iface.GetCanonicalName() || interface_name == iface.GetName()) {
+      (*profile)[line.substr(hash + 1, space - hash - 1)] += calls;
+    }
+  }
+  // Keep only the methods that the interface has
+  for (auto it = profile->begin(); it != profile->end();) {
+    const auto& methods = iface.GetMethods();
+    const bool known = std::any_of(methods.begin(), methods.end(),
+                                   [&](const auto& m) { return m->GetName() == it->first; });
+    it = known ? std::next(it) : profile->erase(it);
+  }
+  return true;
+}
+
 bool generate_java_interface(const string& filename, const AidlInterface* iface,
                              const AidlTypenames& typenames, const IoDelegate& io_delegate,
                              const Options& options) {
-  auto cl = generate_binder_interface_class(iface, typenames, options);
+  TransactProfile profile;
+  if (!read_transact_profile(*iface, options, io_delegate, &profile)) {
+    return false;
+  }
+  auto cl = generate_binder_interface_class(iface, typenames, options, profile);
 
   std::unique_ptr<Document> document =
-      std::make_unique<Document>("" /* no comment */, iface->GetPackage(), std::move(cl));
+      std::make_unique<Document>("" /* no comment */, iface->GetPackage(), cl);
 
   CodeWriterPtr code_writer = io_delegate.GetCodeWriter(filename);
   document->Write(code_writer.get());
@@ -52,11 +103,12 @@ bool generate_java_interface(const string& filename, const AidlInterface* iface,
 }
 
 bool generate_java_parcel(const std::string& filename, const AidlStructuredParcelable* parcel,
-                          const AidlTypenames& typenames, const IoDelegate& io_delegate) {
-  auto cl = generate_parcel_class(parcel, typenames);
+                          const AidlTypenames& typenames, const IoDelegate& io_delegate,
+                          const Options& options) {
+  auto cl = generate_parcel_class(parcel, typenames, options);
 
   std::unique_ptr<Document> document =
-      std::make_unique<Document>("" /* no comment */, parcel->GetPackage(), std::move(cl));
+      std::make_unique<Document>("" /* no comment */, parcel->GetPackage(), cl);
 
   CodeWriterPtr code_writer = io_delegate.GetCodeWriter(filename);
   document->Write(code_writer.get());
@@ -75,9 +127,13 @@ bool generate_java_enum_declaration(const std::string& filename,
 bool generate_java(const std::string& filename, const AidlDefinedType* defined_type,
                    const AidlTypenames& typenames, const IoDelegate& io_delegate,
                    const Options& options) {
+  // Owns the nodes of the file, which are all dropped once it is written.
+  AidlArena arena;
+  AidlArena::Scope arena_scope(&arena);
+
   if (const AidlStructuredParcelable* parcelable = defined_type->AsStructuredParcelable();
       parcelable != nullptr) {
-    return generate_java_parcel(filename, parcelable, typenames, io_delegate);
+    return generate_java_parcel(filename, parcelable, typenames, io_delegate, options);
   }
 
   if (const AidlEnumDeclaration* enum_decl = defined_type->AsEnumDeclaration();
@@ -93,9 +149,295 @@ bool generate_java(const std::string& filename, const AidlDefinedType* defined_t
   return false;
 }
 
-std::unique_ptr<android::aidl::java::Class> generate_parcel_class(
-    const AidlStructuredParcelable* parcel, const AidlTypenames& typenames) {
-  auto parcel_class = std::make_unique<Class>();
+// Whether the |field| of |lhs| and that of |rhs| are equal, as equals() of a
+// @Hashable parcelable compares them
+static std::string generate_field_equals(const AidlVariableDeclaration& field,
+                                         const AidlTypenames& typenames, const std::string& lhs,
+                                         const std::string& rhs) {
+  const std::string type = JavaSignatureOf(field.GetType(), typenames);
+  const std::string a = lhs + field.GetName();
+  const std::string b = rhs + field.GetName();
+  if (type == "float" || type == "double") {
+    return (type == "float" ? "Float" : "Double") + (".compare(" + a + ", " + b + ") == 0");
+  }
+  if (AidlTypenames::IsPrimitiveTypename(type)) {
+    return a + " == " + b;
+  }
+  if (field.GetType().IsArray()) {
+    return "java.util.Arrays.equals(" + a + ", " + b + ")";
+  }
+  return "java.util.Objects.equals(" + a + ", " + b + ")";
+}
+
+// The field-wise equals() and hashCode() of a @Hashable parcelable, which hash
+// the fields as their boxed types and java.util.Arrays do, without allocating
+static std::string generate_equals_and_hash_code(const AidlStructuredParcelable& parcel,
+                                                 const AidlTypenames& typenames) {
+  std::vector<std::string> equals;
+  std::ostringstream hash;
+  bool has_list = false;
+  for (const auto& field : parcel.GetFields()) {
+    const std::string& name = field->GetName();
+    const std::string type = JavaSignatureOf(field->GetType(), typenames);
+    equals.push_back(generate_field_equals(*field, typenames, "", "_aidl_that."));
+    std::string value;
+    if (type == "float" || type == "double") {
+      value = type == "float" ? "Float.floatToIntBits(" + name + ")"
+                              : "(int) (Double.doubleToLongBits(" + name +
+                                    ") ^ (Double.doubleToLongBits(" + name + ") >>> 32))";
+    } else if (AidlTypenames::IsPrimitiveTypename(type)) {
+      if (type == "boolean") {
+        value = "(" + name + " ? 1231 : 1237)";
+      } else if (type == "long") {
+        value = "(int) (" + name + " ^ (" + name + " >>> 32))";
+      } else {
+        value = name;
+      }
+    } else if (field->GetType().IsArray()) {
+      value = "java.util.Arrays.hashCode(" + name + ")";
+    } else if (field->GetType().GetName() == "List") {
+      value = "_aidl_hashCodeOf(" + name + ")";
+      has_list = true;
+    } else {
+      value = "java.util.Objects.hashCode(" + name + ")";
+    }
+    hash << "  _aidl_hash = 31 * _aidl_hash + " << value << ";\n";
+  }
+
+  std::ostringstream out;
+  out << "@Override\n"
+      << "public boolean equals(Object _aidl_other) {\n"
+      << "  if (this == _aidl_other) return true;\n"
+      << "  if (!(_aidl_other instanceof " << parcel.GetName() << ")) return false;\n";
+  if (equals.empty()) {
+    out << "  return true;\n";
+  } else {
+    out << "  " << parcel.GetName() << " _aidl_that = (" << parcel.GetName()
+        << ") _aidl_other;\n"
+        << "  return " << android::base::Join(equals, "\n      && ") << ";\n";
+  }
+  out << "}\n"
+      << "@Override\n"
+      << "public int hashCode() {\n"
+      << "  int _aidl_hash = 1;\n"
+      << hash.str() << "  return _aidl_hash;\n"
+      << "}\n";
+  if (has_list) {
+    // List.hashCode() iterates with an Iterator
+    out << "private static int _aidl_hashCodeOf(java.util.List<?> _aidl_list) {\n"
+        << "  if (_aidl_list == null) return 0;\n"
+        << "  int _aidl_hash = 1;\n"
+        << "  for (int _aidl_i = 0; _aidl_i < _aidl_list.size(); _aidl_i++) {\n"
+        << "    _aidl_hash = 31 * _aidl_hash\n"
+        << "        + java.util.Objects.hashCode(_aidl_list.get(_aidl_i));\n"
+        << "  }\n"
+        << "  return _aidl_hash;\n"
+        << "}\n";
+  }
+  return out.str();
+}
+
+// With --java-reuse, the condition on which readFromParcel() reads |field| into
+// the array, the List, the Map or the parcelable that it already refers to,
+// given the first int of the field in the parcel. Empty when it always
+// replaces the field. A parcelable is only read into when this compilation
+// generates it too, since the readFromParcel() of another one may leave the
+// fields that an older sender did not write as they were.
+static std::string reuse_condition_for(const AidlVariableDeclaration& field,
+                                       const AidlTypenames& typenames) {
+  const AidlTypeSpecifier& type = field.GetType();
+  const std::string peek = "_aidl_peekInt(_aidl_parcel)";
+  if (type.IsArray()) {
+    // The arrays of binders and file descriptors are always created again
+    const std::optional<AidlBuiltinKind> kind = typenames.GetBackingBuiltinKind(type);
+    if (kind == AidlBuiltinKind::IBINDER || kind == AidlBuiltinKind::FILE_DESCRIPTOR) {
+      return "";
+    }
+    // A T[N] read into the array that it refers to is not checked again
+    if (type.IsFixedSizeArray()) {
+      return field.GetName() + ".length==" + peek + " && " + peek +
+             "==" + std::to_string(type.FixedArraySize());
+    }
+    return field.GetName() + ".length==" + peek;
+  }
+  if (type.IsGeneric()) {
+    return peek + ">=0";
+  }
+  const AidlDefinedType* t = typenames.TryGetDefinedType(type.GetName());
+  if (t != nullptr && t->AsStructuredParcelable() != nullptr && typenames.IsCompiled(*t)) {
+    return peek + "!=0";
+  }
+  return "";
+}
+
+// The value that |field| starts with in a new instance
+static std::string initial_value_of(const AidlVariableDeclaration& field,
+                                    const AidlTypenames& typenames) {
+  if (!field.GetDefaultValue()) {
+    // A T[N] starts with its N elements, as the C++ ::std::array does
+    if (field.GetType().IsFixedSizeArray()) {
+      const std::string signature = JavaSignatureOf(field.GetType(), typenames);
+      return "new " + signature.substr(0, signature.size() - 2) + "[" +
+             std::to_string(field.GetType().FixedArraySize()) + "]";
+    }
+    return DefaultJavaValueOf(field.GetType(), typenames);
+  }
+  const std::string value = field.ValueString(ConstantValueDecorator);
+  if (field.GetType().IsArray()) {
+    return "new " + JavaSignatureOf(field.GetType(), typenames) + value;
+  }
+  return value;
+}
+
+// The Delta of a @Delta parcelable: the fields that changed between two of its
+// values, which it reads and writes as an int64 of their bits followed by the
+// values of those fields only
+static Class* generate_delta_class(const AidlStructuredParcelable& parcel,
+                                   const AidlTypenames& typenames) {
+  const std::string& name = parcel.GetName();
+  const auto& fields = parcel.GetFields();
+  auto delta_class = Make<Class>();
+  delta_class->comment = "/** The fields of " + name +
+                         " that changed between two of its values, see diff() and apply() */";
+  delta_class->modifiers = PUBLIC | STATIC | FINAL;
+  delta_class->what = Class::CLASS;
+  delta_class->type = "Delta";
+  delta_class->interfaces.push_back("android.os.Parcelable");
+
+  std::ostringstream out;
+  out << "/** The fields of " << name << " in values, bit i for the field i in their order */\n"
+      << "public long fields = 0L;\n"
+      << "public final " << name << " values = new " << name << "();\n";
+  delta_class->elements.push_back(Make<LiteralClassElement>(out.str()));
+
+  out.str("");
+  out << "public static final android.os.Parcelable.Creator<Delta> CREATOR = "
+      << "new android.os.Parcelable.Creator<Delta>() {\n"
+      << "  @Override\n"
+      << "  public Delta createFromParcel(android.os.Parcel _aidl_source) {\n"
+      << "    Delta _aidl_out = new Delta();\n"
+      << "    _aidl_out.readFromParcel(_aidl_source);\n"
+      << "    return _aidl_out;\n"
+      << "  }\n"
+      << "  @Override\n"
+      << "  public Delta[] newArray(int _aidl_size) {\n"
+      << "    return new Delta[_aidl_size];\n"
+      << "  }\n"
+      << "};\n";
+  delta_class->elements.push_back(Make<LiteralClassElement>(out.str()));
+
+  out.str("");
+  out << "public static Delta diff(" << name << " _aidl_old, " << name << " _aidl_new) {\n"
+      << "  Delta _aidl_delta = new Delta();\n";
+  for (size_t i = 0; i < fields.size(); i++) {
+    const std::string& field = fields[i]->GetName();
+    out << "  if (!(" << generate_field_equals(*fields[i], typenames, "_aidl_old.", "_aidl_new.")
+        << ")) {\n"
+        << "    _aidl_delta.fields |= 1L << " << i << ";\n"
+        << "    _aidl_delta.values." << field << " = _aidl_new." << field << ";\n"
+        << "  }\n";
+  }
+  out << "  return _aidl_delta;\n"
+      << "}\n"
+      << "public static void apply(" << name << " _aidl_base, Delta _aidl_delta) {\n";
+  for (size_t i = 0; i < fields.size(); i++) {
+    const std::string& field = fields[i]->GetName();
+    out << "  if ((_aidl_delta.fields & (1L << " << i << ")) != 0) _aidl_base." << field
+        << " = _aidl_delta.values." << field << ";\n";
+  }
+  out << "}\n";
+  delta_class->elements.push_back(Make<LiteralClassElement>(out.str()));
+
+  string code;
+  CodeWriterPtr writer = CodeWriter::ForString(&code);
+  (*writer) << "@Override\n"
+            << "public final void writeToParcel(android.os.Parcel _aidl_parcel, "
+            << "int _aidl_flag) {\n";
+  writer->Indent();
+  (*writer) << "int _aidl_start_pos = _aidl_parcel.dataPosition();\n"
+            << "_aidl_parcel.writeInt(0);\n"
+            << "_aidl_parcel.writeLong(fields);\n";
+  for (size_t i = 0; i < fields.size(); i++) {
+    (*writer) << "if ((fields & (1L << " << std::to_string(i) << ")) != 0) {\n";
+    writer->Indent();
+    CodeGeneratorContext context{
+        .writer = *(writer.get()),
+        .typenames = typenames,
+        .type = fields[i]->GetType(),
+        .parcel = "_aidl_parcel",
+        .var = "values." + fields[i]->GetName(),
+        .is_return_value = false,
+    };
+    WriteToParcelFor(context);
+    writer->Dedent();
+    (*writer) << "}\n";
+  }
+  (*writer) << "int _aidl_end_pos = _aidl_parcel.dataPosition();\n"
+            << "_aidl_parcel.setDataPosition(_aidl_start_pos);\n"
+            << "_aidl_parcel.writeInt(_aidl_end_pos - _aidl_start_pos);\n"
+            << "_aidl_parcel.setDataPosition(_aidl_end_pos);\n";
+  writer->Dedent();
+  (*writer) << "}\n";
+
+  (*writer) << "public final void readFromParcel(android.os.Parcel _aidl_parcel) {\n";
+  writer->Indent();
+  (*writer) << "int _aidl_start_pos = _aidl_parcel.dataPosition();\n"
+            << "int _aidl_parcelable_size = _aidl_parcel.readInt();\n"
+            << "if (_aidl_parcelable_size < 0) return;\n"
+            << "try {\n";
+  writer->Indent();
+  (*writer) << "fields = _aidl_parcel.readLong();\n";
+  bool is_classloader_created = false;
+  for (size_t i = 0; i < fields.size(); i++) {
+    (*writer) << "if ((fields & (1L << " << std::to_string(i) << ")) != 0) {\n";
+    writer->Indent();
+    CodeGeneratorContext context{
+        .writer = *(writer.get()),
+        .typenames = typenames,
+        .type = fields[i]->GetType(),
+        .parcel = "_aidl_parcel",
+        .var = "values." + fields[i]->GetName(),
+        .is_classloader_created = &is_classloader_created,
+    };
+    CreateFromParcelFor(context);
+    writer->Dedent();
+    (*writer) << "}\n";
+  }
+  writer->Dedent();
+  (*writer) << "} finally {\n"
+            << "  _aidl_parcel.setDataPosition(_aidl_start_pos + _aidl_parcelable_size);\n"
+            << "}\n";
+  writer->Dedent();
+  (*writer) << "}\n";
+  (*writer) << "@Override\n"
+            << "public int describeContents() {\n"
+            << "  return 0;\n"
+            << "}\n";
+  writer->Close();
+  delta_class->elements.push_back(Make<LiteralClassElement>(code));
+  return delta_class;
+}
+
+void add_size(const AidlDefinedType& type, const AidlMethod* method, const char* section,
+              const AstNode& node, int indent) {
+  SizeReport* report = SizeReport::Current();
+  if (report == nullptr) {
+    return;
+  }
+  string code;
+  CodeWriterPtr writer = CodeWriter::ForString(&code);
+  for (int i = 0; i < indent; i++) {
+    writer->Indent();
+  }
+  node.Write(writer.get());
+  writer->Close();
+  report->Add("java", type, method, section, code);
+}
+
+android::aidl::java::Class* generate_parcel_class(
+    const AidlStructuredParcelable* parcel, const AidlTypenames& typenames,
+    const Options& options) {
+  auto parcel_class = Make<Class>();
   parcel_class->comment = parcel->GetComments();
   parcel_class->modifiers = PUBLIC;
   parcel_class->what = Class::CLASS;
@@ -113,9 +455,11 @@ std::unique_ptr<android::aidl::java::Class> generate_parcel_class(
         << variable->GetName();
     if (variable->GetDefaultValue()) {
       out << " = " << variable->ValueString(ConstantValueDecorator);
+    } else if (variable->GetType().IsFixedSizeArray()) {
+      out << " = " << initial_value_of(*variable, typenames);
     }
     out << ";\n";
-    parcel_class->elements.push_back(std::make_shared<LiteralClassElement>(out.str()));
+    parcel_class->elements.push_back(Make<LiteralClassElement>(out.str()));
   }
 
   std::ostringstream out;
@@ -125,7 +469,9 @@ std::unique_ptr<android::aidl::java::Class> generate_parcel_class(
   out << "  public " << parcel->GetName()
       << " createFromParcel(android.os.Parcel _aidl_source) {\n";
   out << "    " << parcel->GetName() << " _aidl_out = new " << parcel->GetName() << "();\n";
-  out << "    _aidl_out.readFromParcel(_aidl_source);\n";
+  // A new instance has nothing to reuse
+  out << "    _aidl_out.readFromParcel(_aidl_source" << (options.JavaReuse() ? ", false" : "")
+      << ");\n";
   out << "    return _aidl_out;\n";
   out << "  }\n";
   out << "  @Override\n";
@@ -133,23 +479,36 @@ std::unique_ptr<android::aidl::java::Class> generate_parcel_class(
   out << "    return new " << parcel->GetName() << "[_aidl_size];\n";
   out << "  }\n";
   out << "};\n";
-  parcel_class->elements.push_back(std::make_shared<LiteralClassElement>(out.str()));
+  parcel_class->elements.push_back(Make<LiteralClassElement>(out.str()));
 
-  auto flag_variable = std::make_shared<Variable>("int", "_aidl_flag");
-  auto parcel_variable = std::make_shared<Variable>("android.os.Parcel", "_aidl_parcel");
+  auto flag_variable = Make<Variable>("int", "_aidl_flag");
+  auto parcel_variable = Make<Variable>("android.os.Parcel", "_aidl_parcel");
 
-  auto write_method = std::make_shared<Method>();
+  auto write_method = Make<Method>();
   write_method->modifiers = PUBLIC | OVERRIDE | FINAL;
   write_method->returnType = "void";
   write_method->name = "writeToParcel";
   write_method->parameters.push_back(parcel_variable);
   write_method->parameters.push_back(flag_variable);
-  write_method->statements = std::make_shared<StatementBlock>();
-
-  out.str("");
-  out << "int _aidl_start_pos = _aidl_parcel.dataPosition();\n"
-      << "_aidl_parcel.writeInt(0);\n";
-  write_method->statements->Add(std::make_shared<LiteralStatement>(out.str()));
+  write_method->statements = Make<StatementBlock>();
+
+  // A @Headerless parcelable is read by the same build that writes it, so it
+  // needs no size header to skip the fields of other versions by
+  const bool is_headerless = parcel->IsHeaderless();
+  if (!is_headerless) {
+    out.str("");
+    out << "int _aidl_start_pos = _aidl_parcel.dataPosition();\n"
+        << "_aidl_parcel.writeInt(0);\n";
+    write_method->statements->Add(Make<LiteralStatement>(out.str()));
+  }
+  std::vector<std::pair<const AidlTypeSpecifier*, std::string>> fields;
+  for (const auto& field : parcel->GetFields()) {
+    fields.emplace_back(&field->GetType(), field->GetName());
+  }
+  if (const std::string hint = SetDataCapacityFor(fields, typenames, parcel_variable->name);
+      !hint.empty()) {
+    write_method->statements->Add(Make<LiteralStatement>(hint));
+  }
 
   for (const auto& field : parcel->GetFields()) {
     string code;
@@ -164,42 +523,72 @@ std::unique_ptr<android::aidl::java::Class> generate_parcel_class(
     };
     WriteToParcelFor(context);
     writer->Close();
-    write_method->statements->Add(std::make_shared<LiteralStatement>(code));
+    write_method->statements->Add(Make<LiteralStatement>(code));
   }
 
-  out.str("");
-  out << "int _aidl_end_pos = _aidl_parcel.dataPosition();\n"
-      << "_aidl_parcel.setDataPosition(_aidl_start_pos);\n"
-      << "_aidl_parcel.writeInt(_aidl_end_pos - _aidl_start_pos);\n"
-      << "_aidl_parcel.setDataPosition(_aidl_end_pos);\n";
+  if (!is_headerless) {
+    out.str("");
+    out << "int _aidl_end_pos = _aidl_parcel.dataPosition();\n"
+        << "_aidl_parcel.setDataPosition(_aidl_start_pos);\n"
+        << "_aidl_parcel.writeInt(_aidl_end_pos - _aidl_start_pos);\n"
+        << "_aidl_parcel.setDataPosition(_aidl_end_pos);\n";
 
-  write_method->statements->Add(std::make_shared<LiteralStatement>(out.str()));
+    write_method->statements->Add(Make<LiteralStatement>(out.str()));
+  }
 
   parcel_class->elements.push_back(write_method);
 
-  auto read_method = std::make_shared<Method>();
+  const bool reuse = options.JavaReuse();
+  if (reuse) {
+    auto read_fresh_method = Make<Method>();
+    read_fresh_method->modifiers = PUBLIC | FINAL;
+    read_fresh_method->returnType = "void";
+    read_fresh_method->name = "readFromParcel";
+    read_fresh_method->parameters.push_back(parcel_variable);
+    read_fresh_method->statements = Make<StatementBlock>();
+    read_fresh_method->statements->Add(
+        Make<LiteralStatement>("readFromParcel(_aidl_parcel, true);\n"));
+    parcel_class->elements.push_back(read_fresh_method);
+  }
+
+  auto read_method = Make<Method>();
   read_method->modifiers = PUBLIC | FINAL;
   read_method->returnType = "void";
   read_method->name = "readFromParcel";
   read_method->parameters.push_back(parcel_variable);
-  read_method->statements = std::make_shared<StatementBlock>();
+  if (reuse) {
+    read_method->comment =
+        "/**\n"
+        " * Reads the fields of this object from _aidl_parcel. With _aidl_reuse, into\n"
+        " * the arrays of the same length, the Lists, the Maps and the parcelables\n"
+        " * that they refer to, rather than new ones, and sets the fields that an\n"
+        " * older sender did not write back to their initial values.\n"
+        " */";
+    read_method->parameters.push_back(Make<Variable>("boolean", "_aidl_reuse"));
+  }
+  read_method->statements = Make<StatementBlock>();
 
-  out.str("");
-  out << "int _aidl_start_pos = _aidl_parcel.dataPosition();\n"
-      << "int _aidl_parcelable_size = _aidl_parcel.readInt();\n"
-      << "if (_aidl_parcelable_size < 0) return;\n"
-      << "try {\n";
+  if (!is_headerless) {
+    out.str("");
+    out << "int _aidl_start_pos = _aidl_parcel.dataPosition();\n"
+        << "int _aidl_parcelable_size = _aidl_parcel.readInt();\n"
+        << "if (_aidl_parcelable_size < 0) return;\n"
+        << "try {\n";
 
-  read_method->statements->Add(std::make_shared<LiteralStatement>(out.str()));
+    read_method->statements->Add(Make<LiteralStatement>(out.str()));
+  }
 
   out.str("");
   out << "  if (_aidl_parcel.dataPosition() - _aidl_start_pos >= _aidl_parcelable_size) return;\n";
 
-  std::shared_ptr<LiteralStatement> sizeCheck = nullptr;
+  LiteralStatement* sizeCheck = nullptr;
   // keep this across different fields in order to create the classloader
   // at most once.
   bool is_classloader_created = false;
-  for (const auto& field : parcel->GetFields()) {
+  bool peeks = false;
+  const auto& fields_to_read = parcel->GetFields();
+  for (size_t i = 0; i < fields_to_read.size(); i++) {
+    const auto& field = fields_to_read[i];
     string code;
     CodeWriterPtr writer = CodeWriter::ForString(&code);
     CodeGeneratorContext context{
@@ -210,31 +599,95 @@ std::unique_ptr<android::aidl::java::Class> generate_parcel_class(
         .var = field->GetName(),
         .is_classloader_created = &is_classloader_created,
     };
-    context.writer.Indent();
-    CreateFromParcelFor(context);
+    if (!is_headerless) context.writer.Indent();
+    const string condition = reuse ? reuse_condition_for(*field, typenames) : "";
+    if (!condition.empty()) {
+      peeks = true;
+      (*writer) << "if ((_aidl_reuse && " << field->GetName() << "!=null && " << condition
+                << ")) {\n";
+      writer->Indent();
+      ReadFromParcelFor(context);
+      writer->Dedent();
+      (*writer) << "}\n";
+      (*writer) << "else {\n";
+      writer->Indent();
+      CreateFromParcelFor(context);
+      writer->Dedent();
+      (*writer) << "}\n";
+    } else {
+      CreateFromParcelFor(context);
+    }
     writer->Close();
-    read_method->statements->Add(std::make_shared<LiteralStatement>(code));
-    if (!sizeCheck) sizeCheck = std::make_shared<LiteralStatement>(out.str());
+    read_method->statements->Add(Make<LiteralStatement>(code));
+    if (is_headerless) continue;
+    if (reuse && i + 1 < fields_to_read.size()) {
+      read_method->statements->Add(Make<LiteralStatement>(StringPrintf(
+          "  if (_aidl_parcel.dataPosition() - _aidl_start_pos >= _aidl_parcelable_size) {\n"
+          "    if (_aidl_reuse) _aidl_resetFrom(%zu);\n"
+          "    return;\n"
+          "  }\n",
+          i + 1)));
+      continue;
+    }
+    if (!sizeCheck) sizeCheck = Make<LiteralStatement>(out.str());
     read_method->statements->Add(sizeCheck);
   }
 
-  out.str("");
-  out << "} finally {\n"
-      << "  _aidl_parcel.setDataPosition(_aidl_start_pos + _aidl_parcelable_size);\n"
-      << "}\n";
+  if (!is_headerless) {
+    out.str("");
+    out << "} finally {\n"
+        << "  _aidl_parcel.setDataPosition(_aidl_start_pos + _aidl_parcelable_size);\n"
+        << "}\n";
 
-  read_method->statements->Add(std::make_shared<LiteralStatement>(out.str()));
+    read_method->statements->Add(Make<LiteralStatement>(out.str()));
+  }
 
   parcel_class->elements.push_back(read_method);
+  add_size(*parcel, nullptr, "parcel_write", *write_method, 1);
+  add_size(*parcel, nullptr, "parcel_read", *read_method, 1);
+
+  if (peeks) {
+    parcel_class->elements.push_back(Make<LiteralClassElement>(
+        "private static int _aidl_peekInt(android.os.Parcel _aidl_parcel) {\n"
+        "  int _aidl_pos = _aidl_parcel.dataPosition();\n"
+        "  int _aidl_value = _aidl_parcel.readInt();\n"
+        "  _aidl_parcel.setDataPosition(_aidl_pos);\n"
+        "  return _aidl_value;\n"
+        "}\n"));
+  }
+  if (reuse && !is_headerless && fields_to_read.size() > 1) {
+    out.str("");
+    out << "/** Sets the fields from the one at _aidl_index on to their initial values */\n"
+        << "private void _aidl_resetFrom(int _aidl_index) {\n";
+    for (size_t i = 1; i < fields_to_read.size(); i++) {
+      out << "  if (_aidl_index <= " << i << ") " << fields_to_read[i]->GetName() << " = "
+          << initial_value_of(*fields_to_read[i], typenames) << ";\n";
+    }
+    out << "}\n";
+    parcel_class->elements.push_back(Make<LiteralClassElement>(out.str()));
+  }
 
-  auto describe_contents_method = std::make_shared<Method>();
+  auto describe_contents_method = Make<Method>();
   describe_contents_method->modifiers = PUBLIC | OVERRIDE;
   describe_contents_method->returnType = "int";
   describe_contents_method->name = "describeContents";
-  describe_contents_method->statements = std::make_shared<StatementBlock>();
-  describe_contents_method->statements->Add(std::make_shared<LiteralStatement>("return 0;\n"));
+  describe_contents_method->statements = Make<StatementBlock>();
+  describe_contents_method->statements->Add(Make<LiteralStatement>("return 0;\n"));
   parcel_class->elements.push_back(describe_contents_method);
 
+  // The Delta of a @Delta parcelable compares the fields as @Hashable does
+  if (parcel->IsHashable() || parcel->IsDelta()) {
+    parcel_class->elements.push_back(
+        Make<LiteralClassElement>(generate_equals_and_hash_code(*parcel, typenames)));
+  }
+  if (parcel->IsDelta()) {
+    parcel_class->elements.push_back(generate_delta_class(*parcel, typenames));
+  }
+  if (options.GenWireSchema()) {
+    parcel_class->elements.push_back(
+        Make<LiteralClassElement>(WireSchemaMethod(*parcel, typenames)));
+  }
+
   return parcel_class;
 }
 
@@ -21,6 +21,7 @@
 #include "io_delegate.h"
 #include "options.h"
 
+#include <map>
 #include <string>
 
 namespace android {
@@ -31,17 +32,34 @@ bool generate_java(const std::string& filename, const AidlDefinedType* iface,
                    const AidlTypenames& typenames, const IoDelegate& io_delegate,
                    const Options& options);
 
-std::unique_ptr<android::aidl::java::Class> generate_binder_interface_class(
-    const AidlInterface* iface, const AidlTypenames& typenames, const Options& options);
+// The calls of the methods of an interface, by method name
+using TransactProfile = std::map<std::string, uint64_t>;
 
-std::unique_ptr<android::aidl::java::Class> generate_parcel_class(
-    const AidlStructuredParcelable* parcel, const AidlTypenames& typenames);
+// Reads the calls of the methods of |iface| from Options::TransactProfileFile(),
+// if there is one. Each of its lines is "INTERFACE#METHOD CALLS", where
+// INTERFACE is a qualified or a simple name. Empty lines and lines starting
+// with '#' are skipped, and so are methods that |iface| doesn't have.
+bool read_transact_profile(const AidlInterface& iface, const Options& options,
+                           const IoDelegate& io_delegate, TransactProfile* profile);
+
+android::aidl::java::Class* generate_binder_interface_class(
+    const AidlInterface* iface, const AidlTypenames& typenames, const Options& options,
+    const TransactProfile& profile = TransactProfile());
+
+android::aidl::java::Class* generate_parcel_class(
+    const AidlStructuredParcelable* parcel, const AidlTypenames& typenames,
+    const Options& options);
 
 void generate_enum(const CodeWriterPtr& code_writer, const AidlEnumDeclaration* enum_decl,
                    const AidlTypenames& typenames);
 
 std::vector<std::string> generate_java_annotations(const AidlAnnotatable& a);
 
+// Adds the code of |node|, as written |indent| levels deep, to |section| of
+// the size report, if any (see SizeReport).
+void add_size(const AidlDefinedType& type, const AidlMethod* method, const char* section,
+              const AstNode& node, int indent);
+
 }  // namespace java
 }  // namespace aidl
 }  // namespace android
@@ -25,6 +25,7 @@
 #include <string.h>
 
 #include <algorithm>
+#include <map>
 #include <unordered_set>
 #include <utility>
 #include <vector>
@@ -49,18 +50,18 @@ class VariableFactory {
   using Variable = ::android::aidl::java::Variable;
 
   explicit VariableFactory(const std::string& base) : base_(base), index_(0) {}
-  std::shared_ptr<Variable> Get(const AidlTypeSpecifier& type, const AidlTypenames& typenames) {
-    auto v = std::make_shared<Variable>(JavaSignatureOf(type, typenames),
+  Variable* Get(const AidlTypeSpecifier& type, const AidlTypenames& typenames) {
+    auto v = Make<Variable>(JavaSignatureOf(type, typenames),
                                         StringPrintf("%s%d", base_.c_str(), index_));
     vars_.push_back(v);
     index_++;
     return v;
   }
 
-  std::shared_ptr<Variable> Get(int index) { return vars_[index]; }
+  Variable* Get(int index) { return vars_[index]; }
 
  private:
-  std::vector<std::shared_ptr<Variable>> vars_;
+  std::vector<Variable*> vars_;
   std::string base_;
   int index_;
 
@@ -73,13 +74,13 @@ class StubClass : public Class {
   StubClass(const AidlInterface* interfaceType, const Options& options);
   ~StubClass() override = default;
 
-  std::shared_ptr<Variable> transact_code;
-  std::shared_ptr<Variable> transact_data;
-  std::shared_ptr<Variable> transact_reply;
-  std::shared_ptr<Variable> transact_flags;
-  std::shared_ptr<SwitchStatement> transact_switch;
-  std::shared_ptr<StatementBlock> transact_statements;
-  std::shared_ptr<SwitchStatement> code_to_method_name_switch;
+  Variable* transact_code;
+  Variable* transact_data;
+  Variable* transact_reply;
+  Variable* transact_flags;
+  SwitchStatement* transact_switch;
+  StatementBlock* transact_statements;
+  SwitchStatement* code_to_method_name_switch;
 
   // Where onTransact cases should be generated as separate methods.
   bool transact_outline;
@@ -87,16 +88,22 @@ class StubClass : public Class {
   std::unordered_set<const AidlMethod*> outline_methods;
   // Number of all methods.
   size_t all_method_count;
+  // Calls of the methods whose cases are ordered by them, from a profile.
+  std::unordered_map<const AidlMethod*, uint64_t> case_calls;
+  // The cases of the methods in case_calls, which finish() moves in front of
+  // the cases of the other methods, which start at method_cases_begin.
+  std::vector<std::pair<uint64_t, Case*>> hot_cases;
+  size_t method_cases_begin = 0;
 
   // Finish generation. This will add a default case to the switch.
   void finish();
 
-  std::shared_ptr<Expression> get_transact_descriptor(const AidlMethod* method);
+  Expression* get_transact_descriptor(const AidlMethod* method);
 
  private:
   void make_as_interface(const AidlInterface* interfaceType);
 
-  std::shared_ptr<Variable> transact_descriptor;
+  Variable* transact_descriptor;
   const Options& options_;
 
   DISALLOW_COPY_AND_ASSIGN(StubClass);
@@ -116,8 +123,8 @@ StubClass::StubClass(const AidlInterface* interfaceType, const Options& options)
   this->interfaces.push_back(interfaceType->GetCanonicalName());
 
   // descriptor
-  auto descriptor = std::make_shared<Field>(
-      STATIC | FINAL | PRIVATE, std::make_shared<Variable>("java.lang.String", "DESCRIPTOR"));
+  auto descriptor = Make<Field>(
+      STATIC | FINAL | PRIVATE, Make<Variable>("java.lang.String", "DESCRIPTOR"));
   if (options.IsStructured()) {
     // mangle the interface name at build time and demangle it at runtime, to avoid
     // being renamed by jarjar. See b/153843174
@@ -130,21 +137,21 @@ StubClass::StubClass(const AidlInterface* interfaceType, const Options& options)
   this->elements.push_back(descriptor);
 
   // ctor
-  auto ctor = std::make_shared<Method>();
+  auto ctor = Make<Method>();
   ctor->modifiers = PUBLIC;
   ctor->comment =
       "/** Construct the stub at attach it to the "
       "interface. */";
   ctor->name = "Stub";
-  ctor->statements = std::make_shared<StatementBlock>();
+  ctor->statements = Make<StatementBlock>();
   if (interfaceType->IsVintfStability()) {
-    auto stability = std::make_shared<LiteralStatement>("this.markVintfStability();\n");
+    auto stability = Make<LiteralStatement>("this.markVintfStability();\n");
     ctor->statements->Add(stability);
   }
-  auto attach = std::make_shared<MethodCall>(
+  auto attach = Make<MethodCall>(
       THIS_VALUE, "attachInterface",
-      std::vector<std::shared_ptr<Expression>>{THIS_VALUE,
-                                               std::make_shared<LiteralExpression>("DESCRIPTOR")});
+      std::vector<Expression*>{THIS_VALUE,
+                                               Make<LiteralExpression>("DESCRIPTOR")});
   ctor->statements->Add(attach);
   this->elements.push_back(ctor);
 
@@ -152,49 +159,49 @@ StubClass::StubClass(const AidlInterface* interfaceType, const Options& options)
   make_as_interface(interfaceType);
 
   // asBinder
-  auto asBinder = std::make_shared<Method>();
+  auto asBinder = Make<Method>();
   asBinder->modifiers = PUBLIC | OVERRIDE;
   asBinder->returnType = "android.os.IBinder";
   asBinder->name = "asBinder";
-  asBinder->statements = std::make_shared<StatementBlock>();
-  asBinder->statements->Add(std::make_shared<ReturnStatement>(THIS_VALUE));
+  asBinder->statements = Make<StatementBlock>();
+  asBinder->statements->Add(Make<ReturnStatement>(THIS_VALUE));
   this->elements.push_back(asBinder);
 
   if (options_.GenTransactionNames()) {
     // getDefaultTransactionName
-    auto getDefaultTransactionName = std::make_shared<Method>();
+    auto getDefaultTransactionName = Make<Method>();
     getDefaultTransactionName->comment = "/** @hide */";
     getDefaultTransactionName->modifiers = PUBLIC | STATIC;
     getDefaultTransactionName->returnType = "java.lang.String";
     getDefaultTransactionName->name = "getDefaultTransactionName";
-    auto code = std::make_shared<Variable>("int", "transactionCode");
+    auto code = Make<Variable>("int", "transactionCode");
     getDefaultTransactionName->parameters.push_back(code);
-    getDefaultTransactionName->statements = std::make_shared<StatementBlock>();
-    this->code_to_method_name_switch = std::make_shared<SwitchStatement>(code);
+    getDefaultTransactionName->statements = Make<StatementBlock>();
+    this->code_to_method_name_switch = Make<SwitchStatement>(code);
     getDefaultTransactionName->statements->Add(this->code_to_method_name_switch);
     this->elements.push_back(getDefaultTransactionName);
 
     // getTransactionName
-    auto getTransactionName = std::make_shared<Method>();
+    auto getTransactionName = Make<Method>();
     getTransactionName->comment = "/** @hide */";
     getTransactionName->modifiers = PUBLIC;
     getTransactionName->returnType = "java.lang.String";
     getTransactionName->name = "getTransactionName";
-    auto code2 = std::make_shared<Variable>("int", "transactionCode");
+    auto code2 = Make<Variable>("int", "transactionCode");
     getTransactionName->parameters.push_back(code2);
-    getTransactionName->statements = std::make_shared<StatementBlock>();
-    getTransactionName->statements->Add(std::make_shared<ReturnStatement>(
-        std::make_shared<MethodCall>(THIS_VALUE, "getDefaultTransactionName",
-                                     std::vector<std::shared_ptr<Expression>>{code2})));
+    getTransactionName->statements = Make<StatementBlock>();
+    getTransactionName->statements->Add(Make<ReturnStatement>(
+        Make<MethodCall>(THIS_VALUE, "getDefaultTransactionName",
+                                     std::vector<Expression*>{code2})));
     this->elements.push_back(getTransactionName);
   }
 
   // onTransact
-  this->transact_code = std::make_shared<Variable>("int", "code");
-  this->transact_data = std::make_shared<Variable>("android.os.Parcel", "data");
-  this->transact_reply = std::make_shared<Variable>("android.os.Parcel", "reply");
-  this->transact_flags = std::make_shared<Variable>("int", "flags");
-  auto onTransact = std::make_shared<Method>();
+  this->transact_code = Make<Variable>("int", "code");
+  this->transact_data = Make<Variable>("android.os.Parcel", "data");
+  this->transact_reply = Make<Variable>("android.os.Parcel", "reply");
+  this->transact_flags = Make<Variable>("int", "flags");
+  auto onTransact = Make<Method>();
   onTransact->modifiers = PUBLIC | OVERRIDE;
   onTransact->returnType = "boolean";
   onTransact->name = "onTransact";
@@ -202,21 +209,40 @@ StubClass::StubClass(const AidlInterface* interfaceType, const Options& options)
   onTransact->parameters.push_back(this->transact_data);
   onTransact->parameters.push_back(this->transact_reply);
   onTransact->parameters.push_back(this->transact_flags);
-  onTransact->statements = std::make_shared<StatementBlock>();
+  onTransact->statements = Make<StatementBlock>();
   transact_statements = onTransact->statements;
   onTransact->exceptions.push_back("android.os.RemoteException");
   this->elements.push_back(onTransact);
-  this->transact_switch = std::make_shared<SwitchStatement>(this->transact_code);
+  this->transact_switch = Make<SwitchStatement>(this->transact_code);
 }
 
 void StubClass::finish() {
-  auto default_case = std::make_shared<Case>();
+  // The hot cases go first among those of the methods, hottest first.
+  if (!hot_cases.empty()) {
+    std::stable_sort(hot_cases.begin(), hot_cases.end(),
+                     [](const auto& a, const auto& b) { return a.first > b.first; });
+    std::unordered_set<const Case*> hot;
+    std::vector<Case*> cases(transact_switch->cases.begin(),
+                             transact_switch->cases.begin() + method_cases_begin);
+    for (const auto& [calls, c] : hot_cases) {
+      hot.insert(c);
+      cases.push_back(c);
+    }
+    for (size_t i = method_cases_begin; i < transact_switch->cases.size(); i++) {
+      if (hot.count(transact_switch->cases[i]) == 0) {
+        cases.push_back(transact_switch->cases[i]);
+      }
+    }
+    transact_switch->cases = std::move(cases);
+  }
 
-  auto superCall = std::make_shared<MethodCall>(
+  auto default_case = Make<Case>();
+
+  auto superCall = Make<MethodCall>(
       SUPER_VALUE, "onTransact",
-      std::vector<std::shared_ptr<Expression>>{this->transact_code, this->transact_data,
+      std::vector<Expression*>{this->transact_code, this->transact_data,
                                                this->transact_reply, this->transact_flags});
-  default_case->statements->Add(std::make_shared<ReturnStatement>(superCall));
+  default_case->statements->Add(Make<ReturnStatement>(superCall));
   transact_switch->cases.push_back(default_case);
 
   transact_statements->Add(this->transact_switch);
@@ -226,8 +252,8 @@ void StubClass::finish() {
     // Some transaction codes are common, e.g. INTERFACE_TRANSACTION or DUMP_TRANSACTION.
     // Common transaction codes will not be resolved to a string by getTransactionName. The method
     // will return NULL in this case.
-    auto code_switch_default_case = std::make_shared<Case>();
-    code_switch_default_case->statements->Add(std::make_shared<ReturnStatement>(NULL_VALUE));
+    auto code_switch_default_case = Make<Case>();
+    code_switch_default_case->statements->Add(Make<ReturnStatement>(NULL_VALUE));
     this->code_to_method_name_switch->cases.push_back(code_switch_default_case);
   }
 }
@@ -235,18 +261,18 @@ void StubClass::finish() {
 // The the expression for the interface's descriptor to be used when
 // generating code for the given method. Null is acceptable for method
 // and stands for synthetic cases.
-std::shared_ptr<Expression> StubClass::get_transact_descriptor(const AidlMethod* method) {
+Expression* StubClass::get_transact_descriptor(const AidlMethod* method) {
   if (transact_outline) {
     if (method != nullptr) {
       // When outlining, each outlined method needs its own literal.
       if (outline_methods.count(method) != 0) {
-        return std::make_shared<LiteralExpression>("DESCRIPTOR");
+        return Make<LiteralExpression>("DESCRIPTOR");
       }
     } else {
       // Synthetic case. A small number is assumed. Use its own descriptor
       // if there are only synthetic cases.
       if (outline_methods.size() == all_method_count) {
-        return std::make_shared<LiteralExpression>("DESCRIPTOR");
+        return Make<LiteralExpression>("DESCRIPTOR");
       }
     }
   }
@@ -254,17 +280,17 @@ std::shared_ptr<Expression> StubClass::get_transact_descriptor(const AidlMethod*
   // When not outlining, store the descriptor literal into a local variable, in
   // an effort to save const-string instructions in each switch case.
   if (transact_descriptor == nullptr) {
-    transact_descriptor = std::make_shared<Variable>("java.lang.String", "descriptor");
-    transact_statements->Add(std::make_shared<VariableDeclaration>(
-        transact_descriptor, std::make_shared<LiteralExpression>("DESCRIPTOR")));
+    transact_descriptor = Make<Variable>("java.lang.String", "descriptor");
+    transact_statements->Add(Make<VariableDeclaration>(
+        transact_descriptor, Make<LiteralExpression>("DESCRIPTOR")));
   }
   return transact_descriptor;
 }
 
 void StubClass::make_as_interface(const AidlInterface* interfaceType) {
-  auto obj = std::make_shared<Variable>("android.os.IBinder", "obj");
+  auto obj = Make<Variable>("android.os.IBinder", "obj");
 
-  auto m = std::make_shared<Method>();
+  auto m = Make<Method>();
   m->comment = "/**\n * Cast an IBinder object into an ";
   m->comment += interfaceType->GetCanonicalName();
   m->comment += " interface,\n";
@@ -273,19 +299,19 @@ void StubClass::make_as_interface(const AidlInterface* interfaceType) {
   m->returnType = interfaceType->GetCanonicalName();
   m->name = "asInterface";
   m->parameters.push_back(obj);
-  m->statements = std::make_shared<StatementBlock>();
+  m->statements = Make<StatementBlock>();
 
-  auto ifstatement = std::make_shared<IfStatement>();
-  ifstatement->expression = std::make_shared<Comparison>(obj, "==", NULL_VALUE);
-  ifstatement->statements = std::make_shared<StatementBlock>();
-  ifstatement->statements->Add(std::make_shared<ReturnStatement>(NULL_VALUE));
+  auto ifstatement = Make<IfStatement>();
+  ifstatement->expression = Make<Comparison>(obj, "==", NULL_VALUE);
+  ifstatement->statements = Make<StatementBlock>();
+  ifstatement->statements->Add(Make<ReturnStatement>(NULL_VALUE));
   m->statements->Add(ifstatement);
 
   // IInterface iin = obj.queryLocalInterface(DESCRIPTOR)
-  auto queryLocalInterface = std::make_shared<MethodCall>(obj, "queryLocalInterface");
-  queryLocalInterface->arguments.push_back(std::make_shared<LiteralExpression>("DESCRIPTOR"));
-  auto iin = std::make_shared<Variable>("android.os.IInterface", "iin");
-  auto iinVd = std::make_shared<VariableDeclaration>(iin, queryLocalInterface);
+  auto queryLocalInterface = Make<MethodCall>(obj, "queryLocalInterface");
+  queryLocalInterface->arguments.push_back(Make<LiteralExpression>("DESCRIPTOR"));
+  auto iin = Make<Variable>("android.os.IInterface", "iin");
+  auto iinVd = Make<VariableDeclaration>(iin, queryLocalInterface);
   m->statements->Add(iinVd);
 
   // Ensure the instance type of the local object is as expected.
@@ -294,19 +320,19 @@ void StubClass::make_as_interface(const AidlInterface* interfaceType) {
 
   // if (iin != null && iin instanceof <interfaceType>) return (<interfaceType>)
   // iin;
-  auto iinNotNull = std::make_shared<Comparison>(iin, "!=", NULL_VALUE);
-  auto instOfCheck = std::make_shared<Comparison>(
-      iin, " instanceof ", std::make_shared<LiteralExpression>(interfaceType->GetCanonicalName()));
-  auto instOfStatement = std::make_shared<IfStatement>();
-  instOfStatement->expression = std::make_shared<Comparison>(iinNotNull, "&&", instOfCheck);
-  instOfStatement->statements = std::make_shared<StatementBlock>();
-  instOfStatement->statements->Add(std::make_shared<ReturnStatement>(
-      std::make_shared<Cast>(interfaceType->GetCanonicalName(), iin)));
+  auto iinNotNull = Make<Comparison>(iin, "!=", NULL_VALUE);
+  auto instOfCheck = Make<Comparison>(
+      iin, " instanceof ", Make<LiteralExpression>(interfaceType->GetCanonicalName()));
+  auto instOfStatement = Make<IfStatement>();
+  instOfStatement->expression = Make<Comparison>(iinNotNull, "&&", instOfCheck);
+  instOfStatement->statements = Make<StatementBlock>();
+  instOfStatement->statements->Add(Make<ReturnStatement>(
+      Make<Cast>(interfaceType->GetCanonicalName(), iin)));
   m->statements->Add(instOfStatement);
 
-  auto ne = std::make_shared<NewExpression>(interfaceType->GetCanonicalName() + ".Stub.Proxy");
+  auto ne = Make<NewExpression>(interfaceType->GetCanonicalName() + ".Stub.Proxy");
   ne->arguments.push_back(obj);
-  m->statements->Add(std::make_shared<ReturnStatement>(ne));
+  m->statements->Add(Make<ReturnStatement>(ne));
 
   this->elements.push_back(m);
 }
@@ -317,7 +343,7 @@ class ProxyClass : public Class {
   ProxyClass(const AidlInterface* interfaceType, const Options& options);
   ~ProxyClass() override;
 
-  std::shared_ptr<Variable> mRemote;
+  Variable* mRemote;
 };
 
 ProxyClass::ProxyClass(const AidlInterface* interfaceType, const Options& options) : Class() {
@@ -327,36 +353,38 @@ ProxyClass::ProxyClass(const AidlInterface* interfaceType, const Options& option
   this->interfaces.push_back(interfaceType->GetCanonicalName());
 
   // IBinder mRemote
-  mRemote = std::make_shared<Variable>("android.os.IBinder", "mRemote");
-  this->elements.push_back(std::make_shared<Field>(PRIVATE, mRemote));
+  mRemote = Make<Variable>("android.os.IBinder", "mRemote");
+  this->elements.push_back(Make<Field>(PRIVATE, mRemote));
 
   // Proxy()
-  auto remote = std::make_shared<Variable>("android.os.IBinder", "remote");
-  auto ctor = std::make_shared<Method>();
+  auto remote = Make<Variable>("android.os.IBinder", "remote");
+  auto ctor = Make<Method>();
   ctor->name = "Proxy";
-  ctor->statements = std::make_shared<StatementBlock>();
+  ctor->statements = Make<StatementBlock>();
   ctor->parameters.push_back(remote);
-  ctor->statements->Add(std::make_shared<Assignment>(mRemote, remote));
+  ctor->statements->Add(Make<Assignment>(mRemote, remote));
   this->elements.push_back(ctor);
 
+  // The version and the hash of the remote never change, so the proxy reads
+  // them without a lock, and at worst asks for them twice at first
   if (options.Version() > 0) {
     std::ostringstream code;
-    code << "private int mCachedVersion = -1;\n";
-    this->elements.emplace_back(std::make_shared<LiteralClassElement>(code.str()));
+    code << "private volatile int mCachedVersion = -1;\n";
+    this->elements.emplace_back(Make<LiteralClassElement>(code.str()));
   }
   if (!options.Hash().empty()) {
     std::ostringstream code;
-    code << "private String mCachedHash = \"-1\";\n";
-    this->elements.emplace_back(std::make_shared<LiteralClassElement>(code.str()));
+    code << "private volatile String mCachedHash = \"-1\";\n";
+    this->elements.emplace_back(Make<LiteralClassElement>(code.str()));
   }
 
   // IBinder asBinder()
-  auto asBinder = std::make_shared<Method>();
+  auto asBinder = Make<Method>();
   asBinder->modifiers = PUBLIC | OVERRIDE;
   asBinder->returnType = "android.os.IBinder";
   asBinder->name = "asBinder";
-  asBinder->statements = std::make_shared<StatementBlock>();
-  asBinder->statements->Add(std::make_shared<ReturnStatement>(mRemote));
+  asBinder->statements = Make<StatementBlock>();
+  asBinder->statements->Add(Make<ReturnStatement>(mRemote));
   this->elements.push_back(asBinder);
 }
 
@@ -364,25 +392,26 @@ ProxyClass::~ProxyClass() {}
 
 // =================================================
 static void generate_new_array(const AidlTypeSpecifier& type, const AidlTypenames& typenames,
-                               std::shared_ptr<StatementBlock> addTo, std::shared_ptr<Variable> v,
-                               std::shared_ptr<Variable> parcel) {
-  auto len = std::make_shared<Variable>("int", v->name + "_length");
+                               StatementBlock* addTo, Variable* v,
+                               Variable* parcel) {
+  auto len = Make<Variable>("int", v->name + "_length");
   addTo->Add(
-      std::make_shared<VariableDeclaration>(len, std::make_shared<MethodCall>(parcel, "readInt")));
-  auto lencheck = std::make_shared<IfStatement>();
+      Make<VariableDeclaration>(len, Make<MethodCall>(parcel, "readInt")));
+  auto lencheck = Make<IfStatement>();
   lencheck->expression =
-      std::make_shared<Comparison>(len, "<", std::make_shared<LiteralExpression>("0"));
-  lencheck->statements->Add(std::make_shared<Assignment>(v, NULL_VALUE));
-  lencheck->elseif = std::make_shared<IfStatement>();
-  lencheck->elseif->statements->Add(std::make_shared<Assignment>(
-      v, std::make_shared<NewArrayExpression>(InstantiableJavaSignatureOf(type, typenames), len)));
+      Make<Comparison>(len, "<", Make<LiteralExpression>("0"));
+  lencheck->statements->Add(Make<Assignment>(v, NULL_VALUE));
+  lencheck->elseif = Make<IfStatement>();
+  lencheck->elseif->statements->Add(Make<Assignment>(
+      v, Make<NewArrayExpression>(InstantiableJavaSignatureOf(type, typenames), len)));
   addTo->Add(lencheck);
 }
 
 static void generate_write_to_parcel(const AidlTypeSpecifier& type,
-                                     std::shared_ptr<StatementBlock> addTo,
-                                     std::shared_ptr<Variable> v, std::shared_ptr<Variable> parcel,
-                                     bool is_return_value, const AidlTypenames& typenames) {
+                                     StatementBlock* addTo,
+                                     Variable* v, Variable* parcel,
+                                     bool is_return_value, const AidlTypenames& typenames,
+                                     const Options& options) {
   string code;
   CodeWriterPtr writer = CodeWriter::ForString(&code);
   CodeGeneratorContext context{
@@ -392,27 +421,27 @@ static void generate_write_to_parcel(const AidlTypeSpecifier& type,
       .parcel = parcel->name,
       .var = v->name,
       .is_return_value = is_return_value,
+      .compact = options.JavaCompact(),
   };
   WriteToParcelFor(context);
   writer->Close();
-  addTo->Add(std::make_shared<LiteralStatement>(code));
+  addTo->Add(Make<LiteralStatement>(code));
 }
 
 static void generate_int_constant(Class* interface, const std::string& name,
                                   const std::string& value) {
   auto code = StringPrintf("public static final int %s = %s;\n", name.c_str(), value.c_str());
-  interface->elements.push_back(std::make_shared<LiteralClassElement>(code));
+  interface->elements.push_back(Make<LiteralClassElement>(code));
 }
 
 static void generate_string_constant(Class* interface, const std::string& name,
                                      const std::string& value) {
   auto code = StringPrintf("public static final String %s = %s;\n", name.c_str(), value.c_str());
-  interface->elements.push_back(std::make_shared<LiteralClassElement>(code));
+  interface->elements.push_back(Make<LiteralClassElement>(code));
 }
 
-static std::shared_ptr<Method> generate_interface_method(const AidlMethod& method,
-                                                         const AidlTypenames& typenames) {
-  auto decl = std::make_shared<Method>();
+static Method* generate_interface_method(const AidlMethod& method, const AidlTypenames& typenames) {
+  auto decl = Make<Method>();
   decl->comment = method.GetComments();
   decl->modifiers = PUBLIC;
   decl->returnType = JavaSignatureOf(method.GetType(), typenames);
@@ -421,7 +450,7 @@ static std::shared_ptr<Method> generate_interface_method(const AidlMethod& metho
 
   for (const std::unique_ptr<AidlArgument>& arg : method.GetArguments()) {
     decl->parameters.push_back(
-        std::make_shared<Variable>(JavaSignatureOf(arg->GetType(), typenames), arg->GetName()));
+        Make<Variable>(JavaSignatureOf(arg->GetType(), typenames), arg->GetName()));
   }
 
   decl->exceptions.push_back("android.os.RemoteException");
@@ -429,20 +458,127 @@ static std::shared_ptr<Method> generate_interface_method(const AidlMethod& metho
   return decl;
 }
 
+// The index of |method| in the tables of TransactionStats with --gen-stats,
+// which hold the user-defined methods in the order of their declarations
+static size_t stats_index(const AidlInterface& iface, const AidlMethod& method) {
+  size_t index = 0;
+  for (const auto& m : iface.GetMethods()) {
+    if (m.get() == &method) break;
+    if (m->IsUserDefined()) index++;
+  }
+  return index;
+}
+
+// With --java-reuse, the field of the Stub that keeps an instance of the type
+// of the in parcelable |arg| for the next call, or "" when the stubs read |arg|
+// into a new instance. Only the parcelables that this compilation generates
+// are recycled: their readFromParcel() resets the fields that an older client
+// did not write, but that of an imported one may keep the values of the
+// previous call.
+static string recycled_field_for(const AidlArgument& arg, const AidlTypenames& typenames,
+                                 const Options& options) {
+  if (!options.JavaReuse() || arg.GetDirection() != AidlArgument::IN_DIR ||
+      arg.GetType().IsArray()) {
+    return "";
+  }
+  const AidlDefinedType* t = typenames.TryGetDefinedType(arg.GetType().GetName());
+  if (t == nullptr || t->AsStructuredParcelable() == nullptr || !typenames.IsCompiled(*t)) {
+    return "";
+  }
+  string name = "_aidl_recycled_" + t->GetCanonicalName();
+  std::replace(name.begin(), name.end(), '.', '_');
+  return name;
+}
+
+// Adds the method of the stub that calls the @SingleFlight |method| unless a
+// call with equal in arguments is under way, whose result or exception it
+// returns instead, and returns its name. The calls are told apart by a List of
+// their arguments, which compare with equals().
+static string generate_single_flight(const AidlMethod& method, const AidlTypenames& typenames,
+                                     StubClass* stubClass) {
+  const string name = "_aidl_singleFlight_" + method.GetName();
+  string flights = "mInFlight" + method.GetName();
+  flights[9] = toupper(flights[9]);
+  const bool is_void = method.GetType().GetName() == "void";
+  const string result_type = is_void ? "Void" : JavaBoxedSignatureOf(method.GetType(), typenames);
+  const string task_type = "java.util.concurrent.FutureTask<" + result_type + ">";
+  vector<string> params;
+  vector<string> args;
+  for (const auto& arg : method.GetArguments()) {
+    params.push_back("final " + JavaSignatureOf(arg->GetType(), typenames) + " " + arg->GetName());
+    args.push_back(arg->GetName());
+  }
+  const string call = "Stub.this." + method.GetName() + "(" + Join(args, ", ") + ");\n";
+
+  std::ostringstream code;
+  code << "private final java.util.concurrent.ConcurrentHashMap<java.util.List<Object>, "
+       << task_type << "> " << flights << " =\n"
+       << "    new java.util.concurrent.ConcurrentHashMap<>();\n"
+       << "private " << (is_void ? "void" : JavaSignatureOf(method.GetType(), typenames)) << " "
+       << name << "(" << Join(params, ", ") << ") throws android.os.RemoteException {\n"
+       << "  java.util.List<Object> _aidl_key = java.util.Arrays.<Object>asList("
+       << Join(args, ", ") << ");\n"
+       << "  " << task_type << " _aidl_flight = new " << task_type << "(\n"
+       << "      new java.util.concurrent.Callable<" << result_type << ">() {\n"
+       << "        @Override public " << result_type << " call() throws Exception {\n"
+       << (is_void ? "          " + call + "          return null;\n" : "          return " + call)
+       << "        }\n"
+       << "      });\n"
+       << "  " << task_type << " _aidl_leader = " << flights
+       << ".putIfAbsent(_aidl_key, _aidl_flight);\n"
+       << "  if (_aidl_leader == null) {\n"
+       << "    _aidl_leader = _aidl_flight;\n"
+       << "    try {\n"
+       << "      _aidl_flight.run();\n"
+       << "    } finally {\n"
+       << "      " << flights << ".remove(_aidl_key, _aidl_flight);\n"
+       << "    }\n"
+       << "  }\n"
+       << "  try {\n"
+       << "    " << (is_void ? "" : "return ") << "_aidl_leader.get();\n"
+       << "  } catch (java.util.concurrent.ExecutionException _aidl_e) {\n"
+       << "    Throwable _aidl_cause = _aidl_e.getCause();\n"
+       << "    if (_aidl_cause instanceof android.os.RemoteException) {\n"
+       << "      throw (android.os.RemoteException) _aidl_cause;\n"
+       << "    }\n"
+       << "    if (_aidl_cause instanceof RuntimeException) {\n"
+       << "      throw (RuntimeException) _aidl_cause;\n"
+       << "    }\n"
+       << "    if (_aidl_cause instanceof Error) {\n"
+       << "      throw (Error) _aidl_cause;\n"
+       << "    }\n"
+       << "    throw new IllegalStateException(_aidl_cause);\n"
+       << "  } catch (InterruptedException _aidl_e) {\n"
+       << "    Thread.currentThread().interrupt();\n"
+       << "    throw new IllegalStateException(_aidl_e);\n"
+       << "  }\n"
+       << "}\n";
+  stubClass->elements.push_back(Make<LiteralClassElement>(code.str()));
+  return name;
+}
+
+// A call in a batch of @Batchable calls is read after the interface token of
+// the batch, so |in_batch| leaves out the check of the token.
 static void generate_stub_code(const AidlInterface& iface, const AidlMethod& method, bool oneway,
-                               std::shared_ptr<Variable> transact_data,
-                               std::shared_ptr<Variable> transact_reply,
+                               Variable* transact_data,
+                               Variable* transact_reply,
                                const AidlTypenames& typenames,
-                               std::shared_ptr<StatementBlock> statements,
-                               std::shared_ptr<StubClass> stubClass, const Options& options) {
-  std::shared_ptr<TryStatement> tryStatement;
-  std::shared_ptr<FinallyStatement> finallyStatement;
-  auto realCall = std::make_shared<MethodCall>(THIS_VALUE, method.GetName());
+                               StatementBlock* statements,
+                               StubClass* stubClass, const Options& options,
+                               bool in_batch = false) {
+  TryStatement* tryStatement;
+  FinallyStatement* finallyStatement;
+  auto realCall = Make<MethodCall>(THIS_VALUE, method.GetName());
+  if (method.GetType().IsSingleFlight()) {
+    realCall->name = generate_single_flight(method, typenames, stubClass);
+  }
 
   // interface token validation is the very first thing we do
-  statements->Add(std::make_shared<MethodCall>(
-      transact_data, "enforceInterface",
-      std::vector<std::shared_ptr<Expression>>{stubClass->get_transact_descriptor(&method)}));
+  if (!in_batch) {
+    statements->Add(Make<MethodCall>(
+        transact_data, "enforceInterface",
+        std::vector<Expression*>{stubClass->get_transact_descriptor(&method)}));
+  }
 
   // args
   VariableFactory stubArgs("_arg");
@@ -451,11 +587,28 @@ static void generate_stub_code(const AidlInterface& iface, const AidlMethod& met
     // at most once.
     bool is_classloader_created = false;
     for (const std::unique_ptr<AidlArgument>& arg : method.GetArguments()) {
-      std::shared_ptr<Variable> v = stubArgs.Get(arg->GetType(), typenames);
-
-      statements->Add(std::make_shared<VariableDeclaration>(v));
-
-      if (arg->GetDirection() & AidlArgument::IN_DIR) {
+      Variable* v = stubArgs.Get(arg->GetType(), typenames);
+
+      statements->Add(Make<VariableDeclaration>(v));
+
+      if (const string recycled = recycled_field_for(*arg, typenames, options);
+          !recycled.empty()) {
+        // The instance of the previous call, once the implementation opted in
+        statements->Add(Make<LiteralStatement>(StringPrintf(
+            "if ((0!=%s.readInt())) {\n"
+            "  %s = %s.getAndSet(null);\n"
+            "  if ((%s==null)) {\n"
+            "    %s = new %s();\n"
+            "  }\n"
+            "  %s.readFromParcel(%s);\n"
+            "}\n"
+            "else {\n"
+            "  %s = null;\n"
+            "}\n",
+            transact_data->name.c_str(), v->name.c_str(), recycled.c_str(), v->name.c_str(),
+            v->name.c_str(), JavaSignatureOf(arg->GetType(), typenames).c_str(),
+            v->name.c_str(), transact_data->name.c_str(), v->name.c_str())));
+      } else if (arg->GetDirection() & AidlArgument::IN_DIR) {
         string code;
         CodeWriterPtr writer = CodeWriter::ForString(&code);
         CodeGeneratorContext context{.writer = *(writer.get()),
@@ -463,14 +616,15 @@ static void generate_stub_code(const AidlInterface& iface, const AidlMethod& met
                                      .type = arg->GetType(),
                                      .parcel = transact_data->name,
                                      .var = v->name,
-                                     .is_classloader_created = &is_classloader_created};
+                                     .is_classloader_created = &is_classloader_created,
+                                     .compact = options.JavaCompact()};
         CreateFromParcelFor(context);
         writer->Close();
-        statements->Add(std::make_shared<LiteralStatement>(code));
+        statements->Add(Make<LiteralStatement>(code));
       } else {
         if (!arg->GetType().IsArray()) {
-          statements->Add(std::make_shared<Assignment>(
-              v, std::make_shared<NewExpression>(
+          statements->Add(Make<Assignment>(
+              v, Make<NewExpression>(
                      InstantiableJavaSignatureOf(arg->GetType(), typenames))));
         } else {
           generate_new_array(arg->GetType(), typenames, statements, v, transact_data);
@@ -483,20 +637,25 @@ static void generate_stub_code(const AidlInterface& iface, const AidlMethod& met
 
   if (options.GenTraces()) {
     // try and finally, but only when generating trace code
-    tryStatement = std::make_shared<TryStatement>();
-    finallyStatement = std::make_shared<FinallyStatement>();
-
-    tryStatement->statements->Add(std::make_shared<MethodCall>(
-        std::make_shared<LiteralExpression>("android.os.Trace"), "traceBegin",
-        std::vector<std::shared_ptr<Expression>>{
-            std::make_shared<LiteralExpression>("android.os.Trace.TRACE_TAG_AIDL"),
-            std::make_shared<StringLiteralExpression>(iface.GetName() + "::" + method.GetName() +
+    tryStatement = Make<TryStatement>();
+    finallyStatement = Make<FinallyStatement>();
+
+    tryStatement->statements->Add(Make<MethodCall>(
+        Make<LiteralExpression>("android.os.Trace"), "traceBegin",
+        std::vector<Expression*>{
+            Make<LiteralExpression>("android.os.Trace.TRACE_TAG_AIDL"),
+            Make<StringLiteralExpression>(iface.GetName() + "::" + method.GetName() +
                                                       "::server")}));
 
-    finallyStatement->statements->Add(std::make_shared<MethodCall>(
-        std::make_shared<LiteralExpression>("android.os.Trace"), "traceEnd",
-        std::vector<std::shared_ptr<Expression>>{
-            std::make_shared<LiteralExpression>("android.os.Trace.TRACE_TAG_AIDL")}));
+    finallyStatement->statements->Add(Make<MethodCall>(
+        Make<LiteralExpression>("android.os.Trace"), "traceEnd",
+        std::vector<Expression*>{
+            Make<LiteralExpression>("android.os.Trace.TRACE_TAG_AIDL")}));
+  }
+
+  if (options.GenStats()) {
+    // The time until the reply is written
+    statements->Add(Make<LiteralStatement>("long _aidl_start = System.nanoTime();\n"));
   }
 
   // the real call
@@ -511,74 +670,98 @@ static void generate_stub_code(const AidlInterface& iface, const AidlMethod& met
 
     if (!oneway) {
       // report that there were no exceptions
-      auto ex = std::make_shared<MethodCall>(transact_reply, "writeNoException");
+      auto ex = Make<MethodCall>(transact_reply, "writeNoException");
       statements->Add(ex);
     }
   } else {
     auto _result =
-        std::make_shared<Variable>(JavaSignatureOf(method.GetType(), typenames), "_result");
+        Make<Variable>(JavaSignatureOf(method.GetType(), typenames), "_result");
     if (options.GenTraces()) {
-      statements->Add(std::make_shared<VariableDeclaration>(_result));
+      statements->Add(Make<VariableDeclaration>(_result));
       statements->Add(tryStatement);
-      tryStatement->statements->Add(std::make_shared<Assignment>(_result, realCall));
+      tryStatement->statements->Add(Make<Assignment>(_result, realCall));
       statements->Add(finallyStatement);
     } else {
-      statements->Add(std::make_shared<VariableDeclaration>(_result, realCall));
+      statements->Add(Make<VariableDeclaration>(_result, realCall));
     }
 
     if (!oneway) {
       // report that there were no exceptions
-      auto ex = std::make_shared<MethodCall>(transact_reply, "writeNoException");
+      auto ex = Make<MethodCall>(transact_reply, "writeNoException");
       statements->Add(ex);
     }
 
     // marshall the return value
     generate_write_to_parcel(method.GetType(), statements, _result, transact_reply, true,
-                             typenames);
+                             typenames, options);
   }
 
   // out parameters
   int i = 0;
   for (const std::unique_ptr<AidlArgument>& arg : method.GetArguments()) {
-    std::shared_ptr<Variable> v = stubArgs.Get(i++);
+    Variable* v = stubArgs.Get(i++);
 
     if (arg->GetDirection() & AidlArgument::OUT_DIR) {
-      generate_write_to_parcel(arg->GetType(), statements, v, transact_reply, true, typenames);
+      generate_write_to_parcel(arg->GetType(), statements, v, transact_reply, true, typenames,
+                               options);
+    }
+    if (const string recycled = recycled_field_for(*arg, typenames, options);
+        !recycled.empty()) {
+      statements->Add(Make<LiteralStatement>(
+          StringPrintf("if ((mRecycleInParcelables && %s!=null)) {\n"
+                       "  %s.set(%s);\n"
+                       "}\n",
+                       v->name.c_str(), recycled.c_str(), v->name.c_str())));
     }
   }
 
+  if (options.GenStats()) {
+    statements->Add(Make<LiteralStatement>(
+        StringPrintf("_aidl_stub_stats[%zu].record(System.nanoTime() - _aidl_start);\n",
+                     stats_index(iface, method))));
+  }
+  if (options.GenParcelSizes()) {
+    statements->Add(Make<LiteralStatement>(
+        StringPrintf("_aidl_stub_stats[%zu].recordSizes(%s.dataSize(), %s.dataSize());\n",
+                     stats_index(iface, method), transact_data->name.c_str(),
+                     transact_reply->name.c_str())));
+  }
+
   // return true
-  statements->Add(std::make_shared<ReturnStatement>(TRUE_VALUE));
+  statements->Add(Make<ReturnStatement>(TRUE_VALUE));
 }
 
 static void generate_stub_case(const AidlInterface& iface, const AidlMethod& method,
                                const std::string& transactCodeName, bool oneway,
-                               std::shared_ptr<StubClass> stubClass, const AidlTypenames& typenames,
+                               StubClass* stubClass, const AidlTypenames& typenames,
                                const Options& options) {
-  auto c = std::make_shared<Case>(transactCodeName);
+  auto c = Make<Case>(transactCodeName);
 
   generate_stub_code(iface, method, oneway, stubClass->transact_data, stubClass->transact_reply,
                      typenames, c->statements, stubClass, options);
 
   stubClass->transact_switch->cases.push_back(c);
+  if (auto it = stubClass->case_calls.find(&method); it != stubClass->case_calls.end()) {
+    stubClass->hot_cases.emplace_back(it->second, c);
+  }
 }
 
 static void generate_stub_case_outline(const AidlInterface& iface, const AidlMethod& method,
                                        const std::string& transactCodeName, bool oneway,
-                                       std::shared_ptr<StubClass> stubClass,
+                                       StubClass* stubClass,
                                        const AidlTypenames& typenames, const Options& options) {
   std::string outline_name = "onTransact$" + method.GetName() + "$";
   // Generate an "outlined" method with the actual code.
   {
-    auto transact_data = std::make_shared<Variable>("android.os.Parcel", "data");
-    auto transact_reply = std::make_shared<Variable>("android.os.Parcel", "reply");
-    auto onTransact_case = std::make_shared<Method>();
+    auto transact_data = Make<Variable>("android.os.Parcel", "data");
+    auto transact_reply = Make<Variable>("android.os.Parcel", "reply");
+    auto onTransact_case = Make<Method>();
     onTransact_case->modifiers = PRIVATE;
     onTransact_case->returnType = "boolean";
     onTransact_case->name = outline_name;
     onTransact_case->parameters.push_back(transact_data);
     onTransact_case->parameters.push_back(transact_reply);
-    onTransact_case->statements = std::make_shared<StatementBlock>();
+    onTransact_case->statements = Make<StatementBlock>();
     onTransact_case->exceptions.push_back("android.os.RemoteException");
     stubClass->elements.push_back(onTransact_case);
 
@@ -588,103 +771,344 @@ static void generate_stub_case_outline(const AidlInterface& iface, const AidlMet
 
   // Generate the case dispatch.
   {
-    auto c = std::make_shared<Case>(transactCodeName);
+    auto c = Make<Case>(transactCodeName);
 
     auto helper_call =
-        std::make_shared<MethodCall>(THIS_VALUE, outline_name,
-                                     std::vector<std::shared_ptr<Expression>>{
+        Make<MethodCall>(THIS_VALUE, outline_name,
+                                     std::vector<Expression*>{
                                          stubClass->transact_data, stubClass->transact_reply});
-    c->statements->Add(std::make_shared<ReturnStatement>(helper_call));
+    c->statements->Add(Make<ReturnStatement>(helper_call));
 
     stubClass->transact_switch->cases.push_back(c);
   }
 }
 
-static std::shared_ptr<Method> generate_proxy_method(
+// The batch of an interface with @Batchable methods is handled call by call,
+// each in a method of its own.
+static void generate_stub_batch_case(const AidlInterface& iface, StubClass* stubClass,
+                                     const AidlTypenames& typenames, const Options& options) {
+  auto c = Make<Case>("BATCH_TRANSACTION");
+  c->statements->Add(Make<MethodCall>(
+      stubClass->transact_data, "enforceInterface",
+      std::vector<Expression*>{stubClass->get_transact_descriptor(nullptr)}));
+
+  std::ostringstream code;
+  code << "int _aidl_calls = data.readInt();\n"
+       << "for (int _aidl_i = 0; _aidl_i < _aidl_calls; _aidl_i++) {\n"
+       << "  switch (data.readInt()) {\n";
+  for (const auto& method : iface.GetMethods()) {
+    if (!method->GetType().IsBatchable()) continue;
+    const string name = "onBatchedTransact$" + method->GetName() + "$";
+    auto transact_data = Make<Variable>("android.os.Parcel", "data");
+    auto transact_reply = Make<Variable>("android.os.Parcel", "reply");
+    auto handler = Make<Method>();
+    handler->modifiers = PRIVATE;
+    handler->returnType = "boolean";
+    handler->name = name;
+    handler->parameters.push_back(transact_data);
+    handler->parameters.push_back(transact_reply);
+    handler->statements = Make<StatementBlock>();
+    handler->exceptions.push_back("android.os.RemoteException");
+    stubClass->elements.push_back(handler);
+    generate_stub_code(iface, *method, true /* oneway */, transact_data, transact_reply,
+                       typenames, handler->statements, stubClass, options, true /* in_batch */);
+
+    code << "    case TRANSACTION_" << method->GetName() << ":\n"
+         << "      " << name << "(data, reply);\n"
+         << "      break;\n";
+  }
+  code << "    default:\n"
+       << "      return false;\n"
+       << "  }\n"
+       << "}\n"
+       << "return true;\n";
+  c->statements->Add(Make<LiteralStatement>(code.str()));
+  stubClass->transact_switch->cases.push_back(c);
+}
+
+// A @Batchable method appends its call to the batch of the proxy, which is
+// sent once it is full, old or flushed: the number of the calls after the
+// interface token, followed by the code and the in arguments of each call.
+static Method* generate_batched_proxy_method(const AidlMethod& method,
+                                             const std::string& transactCodeName,
+                                             const AidlTypenames& typenames,
+                                             const Options& options) {
+  auto proxy = Make<Method>();
+  proxy->comment = method.GetComments();
+  proxy->modifiers = PUBLIC | OVERRIDE;
+  proxy->returnType = "void";
+  proxy->name = method.GetName();
+  proxy->statements = Make<StatementBlock>();
+  for (const std::unique_ptr<AidlArgument>& arg : method.GetArguments()) {
+    proxy->parameters.push_back(
+        Make<Variable>(JavaSignatureOf(arg->GetType(), typenames), arg->GetName()));
+  }
+  proxy->exceptions.push_back("android.os.RemoteException");
+
+  string code;
+  CodeWriterPtr writer = CodeWriter::ForString(&code);
+  (*writer) << "synchronized (mBatchLock) {\n";
+  writer->Indent();
+  (*writer) << "if (mBatch == null) {\n"
+            << "  mBatch = android.os.Parcel.obtain();\n"
+            << "  mBatch.writeInterfaceToken(DESCRIPTOR);\n"
+            << "  // The number of the calls is filled in when the batch is sent\n"
+            << "  mBatchCountPosition = mBatch.dataPosition();\n"
+            << "  mBatch.writeInt(0);\n"
+            << "}\n"
+            << "int _aidl_start = mBatch.dataPosition();\n"
+            << "boolean _aidl_written = false;\n"
+            << "try {\n";
+  writer->Indent();
+  (*writer) << "mBatch.writeInt(Stub." << transactCodeName << ");\n";
+  for (const std::unique_ptr<AidlArgument>& arg : method.GetArguments()) {
+    CodeGeneratorContext context{
+        .writer = *(writer.get()),
+        .typenames = typenames,
+        .type = arg->GetType(),
+        .parcel = "mBatch",
+        .var = arg->GetName(),
+        .is_return_value = false,
+        .compact = options.JavaCompact(),
+    };
+    WriteToParcelFor(context);
+  }
+  (*writer) << "_aidl_written = true;\n";
+  writer->Dedent();
+  // A call that could not be written is dropped from the batch.
+  (*writer) << "} finally {\n"
+            << "  if (!_aidl_written) {\n"
+            << "    mBatch.setDataSize(_aidl_start);\n"
+            << "    mBatch.setDataPosition(_aidl_start);\n"
+            << "  }\n"
+            << "}\n"
+            << "mBatchCalls++;\n"
+            << "if (mBatchCalls == 1) {\n"
+            << "  mBatchDeadline = android.os.SystemClock.uptimeMillis() + "
+            << std::to_string(kMaxBatchDelayMs) << ";\n"
+            << "  BatchTimer.sExecutor.schedule(new java.lang.Runnable() {\n"
+            << "    @Override\n"
+            << "    public void run() {\n"
+            << "      flushDueBatch();\n"
+            << "    }\n"
+            << "  }, " << std::to_string(kMaxBatchDelayMs)
+            << ", java.util.concurrent.TimeUnit.MILLISECONDS);\n"
+            << "}\n"
+            << "if (mBatchCalls >= " << std::to_string(kMaxBatchedCalls)
+            << " || mBatch.dataSize() >= " << std::to_string(kMaxBatchBytes)
+            << "\n"
+            << "    || android.os.SystemClock.uptimeMillis() >= mBatchDeadline) {\n"
+            << "  " << kFlushBatchedCalls << "();\n"
+            << "}\n";
+  writer->Dedent();
+  (*writer) << "}\n";
+  writer->Close();
+  proxy->statements->Add(Make<LiteralStatement>(code));
+  return proxy;
+}
+
+// The proxy of an interface with @Batchable methods sends its batch when it
+// is flushed, before each other call and once its first call has waited for
+// kMaxBatchDelayMs. The first call schedules the flush on a thread that the
+// proxies of the interface share, and the scheduled flush keeps the proxy
+// reachable until then, so that the batch of a dropped proxy is still sent
+// and its Parcel recycled.
+static void generate_proxy_batch(ProxyClass* proxyClass) {
+  std::ostringstream code;
+  code << "private final Object mBatchLock = new Object();\n"
+       << "private android.os.Parcel mBatch;\n"
+       << "private int mBatchCalls = 0;\n"
+       << "private int mBatchCountPosition = 0;\n"
+       << "private long mBatchDeadline = 0;\n"
+       << "private static final class BatchTimer {\n"
+       << "  static final java.util.concurrent.ScheduledExecutorService sExecutor =\n"
+       << "      java.util.concurrent.Executors.newSingleThreadScheduledExecutor(\n"
+       << "          new java.util.concurrent.ThreadFactory() {\n"
+       << "            @Override\n"
+       << "            public java.lang.Thread newThread(java.lang.Runnable r) {\n"
+       << "              java.lang.Thread t = new java.lang.Thread(r, \"aidl-batch\");\n"
+       << "              t.setDaemon(true);\n"
+       << "              return t;\n"
+       << "            }\n"
+       << "          });\n"
+       << "}\n"
+       << "// Sends the batch unless it was sent and a newer one opened meanwhile\n"
+       << "private void flushDueBatch() {\n"
+       << "  synchronized (mBatchLock) {\n"
+       << "    if (android.os.SystemClock.uptimeMillis() < mBatchDeadline) {\n"
+       << "      return;\n"
+       << "    }\n"
+       << "    try {\n"
+       << "      " << kFlushBatchedCalls << "();\n"
+       << "    } catch (android.os.RemoteException e) {\n"
+       << "      // Nobody waits for the oneway calls of the batch.\n"
+       << "    }\n"
+       << "  }\n"
+       << "}\n"
+       << "@Override\n"
+       << "public void " << kFlushBatchedCalls << "() throws android.os.RemoteException {\n"
+       << "  synchronized (mBatchLock) {\n"
+       << "    if (mBatchCalls == 0) {\n"
+       << "      return;\n"
+       << "    }\n"
+       << "    android.os.Parcel _data = mBatch;\n"
+       << "    int _aidl_end = _data.dataPosition();\n"
+       << "    _data.setDataPosition(mBatchCountPosition);\n"
+       << "    _data.writeInt(mBatchCalls);\n"
+       << "    _data.setDataPosition(_aidl_end);\n"
+       << "    mBatch = null;\n"
+       << "    mBatchCalls = 0;\n"
+       << "    try {\n"
+       << "      mRemote.transact(Stub.BATCH_TRANSACTION, _data, null, "
+          "android.os.IBinder.FLAG_ONEWAY);\n"
+       << "    } finally {\n"
+       << "      _data.recycle();\n"
+       << "    }\n"
+       << "  }\n"
+       << "}\n";
+  proxyClass->elements.push_back(Make<LiteralClassElement>(code.str()));
+}
+
+static Method* generate_proxy_method(
     const AidlInterface& iface, const AidlMethod& method, const std::string& transactCodeName,
-    bool oneway, std::shared_ptr<ProxyClass> proxyClass, const AidlTypenames& typenames,
+    bool oneway, ProxyClass* proxyClass, const AidlTypenames& typenames,
     const Options& options) {
-  auto proxy = std::make_shared<Method>();
+  auto proxy = Make<Method>();
   proxy->comment = method.GetComments();
   proxy->modifiers = PUBLIC | OVERRIDE;
   proxy->returnType = JavaSignatureOf(method.GetType(), typenames);
   proxy->name = method.GetName();
-  proxy->statements = std::make_shared<StatementBlock>();
+  proxy->statements = Make<StatementBlock>();
   for (const std::unique_ptr<AidlArgument>& arg : method.GetArguments()) {
     proxy->parameters.push_back(
-        std::make_shared<Variable>(JavaSignatureOf(arg->GetType(), typenames), arg->GetName()));
+        Make<Variable>(JavaSignatureOf(arg->GetType(), typenames), arg->GetName()));
   }
   proxy->exceptions.push_back("android.os.RemoteException");
 
+  // A @Cacheable method returns the result that it already has for its in
+  // arguments in the current generation of the caches, which is in the key.
+  string cache;
+  if (method.GetType().IsCacheable()) {
+    cache = "mCached" + method.GetName();
+    cache[7] = toupper(cache[7]);
+    const string result_type = JavaBoxedSignatureOf(method.GetType(), typenames);
+    proxyClass->elements.push_back(Make<LiteralClassElement>(
+        StringPrintf("private final java.util.HashMap<java.util.List<Object>, %s> %s = "
+                     "new java.util.HashMap<>();\n",
+                     result_type.c_str(), cache.c_str())));
+    vector<string> key{"Stub.Proxy.sCacheGeneration.get()"};
+    for (const auto& arg : method.GetArguments()) {
+      key.push_back(arg->GetName());
+    }
+    proxy->statements->Add(Make<LiteralStatement>(
+        StringPrintf("java.util.List<Object> _aidl_cacheKey =\n"
+                     "    java.util.Arrays.<Object>asList(%s);\n"
+                     "synchronized (%s) {\n"
+                     "  %s _aidl_cached = %s.get(_aidl_cacheKey);\n"
+                     "  if (_aidl_cached != null) {\n"
+                     "    return _aidl_cached;\n"
+                     "  }\n"
+                     "}\n",
+                     Join(key, ", ").c_str(), cache.c_str(), result_type.c_str(),
+                     cache.c_str())));
+  }
+
+  // The queued calls of the @Batchable methods go before this one.
+  const auto& methods = iface.GetMethods();
+  if (std::any_of(methods.begin(), methods.end(),
+                  [](const auto& m) { return m->GetType().IsBatchable(); })) {
+    proxy->statements->Add(Make<LiteralStatement>(kFlushBatchedCalls + "();\n"));
+  }
+
   // the parcels
-  auto _data = std::make_shared<Variable>("android.os.Parcel", "_data");
-  proxy->statements->Add(std::make_shared<VariableDeclaration>(
-      _data, std::make_shared<MethodCall>("android.os.Parcel", "obtain")));
-  std::shared_ptr<Variable> _reply = nullptr;
+  auto _data = Make<Variable>("android.os.Parcel", "_data");
+  proxy->statements->Add(Make<VariableDeclaration>(
+      _data, Make<MethodCall>("android.os.Parcel", "obtain")));
+  Variable* _reply = nullptr;
   if (!oneway) {
-    _reply = std::make_shared<Variable>("android.os.Parcel", "_reply");
-    proxy->statements->Add(std::make_shared<VariableDeclaration>(
-        _reply, std::make_shared<MethodCall>("android.os.Parcel", "obtain")));
+    _reply = Make<Variable>("android.os.Parcel", "_reply");
+    proxy->statements->Add(Make<VariableDeclaration>(
+        _reply, Make<MethodCall>("android.os.Parcel", "obtain")));
   }
 
   // the return value
-  std::shared_ptr<Variable> _result = nullptr;
+  Variable* _result = nullptr;
   if (method.GetType().GetName() != "void") {
-    _result = std::make_shared<Variable>(*proxy->returnType, "_result");
-    proxy->statements->Add(std::make_shared<VariableDeclaration>(_result));
+    _result = Make<Variable>(*proxy->returnType, "_result");
+    proxy->statements->Add(Make<VariableDeclaration>(_result));
+  }
+
+  if (options.GenStats()) {
+    // Recorded in the finally block, so that the calls that fail are counted as well
+    proxy->statements->Add(Make<LiteralStatement>("long _aidl_start = System.nanoTime();\n"));
   }
 
   // try and finally
-  auto tryStatement = std::make_shared<TryStatement>();
+  auto tryStatement = Make<TryStatement>();
   proxy->statements->Add(tryStatement);
-  auto finallyStatement = std::make_shared<FinallyStatement>();
+  auto finallyStatement = Make<FinallyStatement>();
   proxy->statements->Add(finallyStatement);
 
   if (options.GenTraces()) {
-    tryStatement->statements->Add(std::make_shared<MethodCall>(
-        std::make_shared<LiteralExpression>("android.os.Trace"), "traceBegin",
-        std::vector<std::shared_ptr<Expression>>{
-            std::make_shared<LiteralExpression>("android.os.Trace.TRACE_TAG_AIDL"),
-            std::make_shared<StringLiteralExpression>(iface.GetName() + "::" + method.GetName() +
+    tryStatement->statements->Add(Make<MethodCall>(
+        Make<LiteralExpression>("android.os.Trace"), "traceBegin",
+        std::vector<Expression*>{
+            Make<LiteralExpression>("android.os.Trace.TRACE_TAG_AIDL"),
+            Make<StringLiteralExpression>(iface.GetName() + "::" + method.GetName() +
                                                       "::client")}));
   }
 
   // the interface identifier token: the DESCRIPTOR constant, marshalled as a
   // string
-  tryStatement->statements->Add(std::make_shared<MethodCall>(
+  tryStatement->statements->Add(Make<MethodCall>(
       _data, "writeInterfaceToken",
-      std::vector<std::shared_ptr<Expression>>{std::make_shared<LiteralExpression>("DESCRIPTOR")}));
+      std::vector<Expression*>{Make<LiteralExpression>("DESCRIPTOR")}));
+
+  std::vector<std::pair<const AidlTypeSpecifier*, std::string>> in_args;
+  for (const AidlArgument* arg : method.GetInArguments()) {
+    in_args.emplace_back(&arg->GetType(), arg->GetName());
+  }
+  if (const std::string hint = SetDataCapacityFor(in_args, typenames, _data->name);
+      !hint.empty()) {
+    tryStatement->statements->Add(Make<LiteralStatement>(hint));
+  }
 
   // the parameters
   for (const std::unique_ptr<AidlArgument>& arg : method.GetArguments()) {
-    auto v = std::make_shared<Variable>(JavaSignatureOf(arg->GetType(), typenames), arg->GetName());
+    auto v = Make<Variable>(JavaSignatureOf(arg->GetType(), typenames), arg->GetName());
     AidlArgument::Direction dir = arg->GetDirection();
-    if (dir == AidlArgument::OUT_DIR && arg->GetType().IsArray()) {
-      auto checklen = std::make_shared<IfStatement>();
-      checklen->expression = std::make_shared<Comparison>(v, "==", NULL_VALUE);
-      checklen->statements->Add(std::make_shared<MethodCall>(
+    if (dir == AidlArgument::OUT_DIR && arg->GetType().IsArray() && options.JavaCompact()) {
+      // One call of writeInt rather than one in each branch
+      tryStatement->statements->Add(Make<MethodCall>(
+          _data, "writeInt",
+          std::vector<Expression*>{Make<LiteralExpression>(
+              "((" + v->name + "==null)?(-1):(" + v->name + ".length))")}));
+    } else if (dir == AidlArgument::OUT_DIR && arg->GetType().IsArray()) {
+      auto checklen = Make<IfStatement>();
+      checklen->expression = Make<Comparison>(v, "==", NULL_VALUE);
+      checklen->statements->Add(Make<MethodCall>(
           _data, "writeInt",
-          std::vector<std::shared_ptr<Expression>>{std::make_shared<LiteralExpression>("-1")}));
-      checklen->elseif = std::make_shared<IfStatement>();
-      checklen->elseif->statements->Add(std::make_shared<MethodCall>(
+          std::vector<Expression*>{Make<LiteralExpression>("-1")}));
+      checklen->elseif = Make<IfStatement>();
+      checklen->elseif->statements->Add(Make<MethodCall>(
           _data, "writeInt",
-          std::vector<std::shared_ptr<Expression>>{std::make_shared<FieldVariable>(v, "length")}));
+          std::vector<Expression*>{Make<FieldVariable>(v, "length")}));
       tryStatement->statements->Add(checklen);
     } else if (dir & AidlArgument::IN_DIR) {
       generate_write_to_parcel(arg->GetType(), tryStatement->statements, v, _data, false,
-                               typenames);
+                               typenames, options);
     }
   }
 
   // the transact call
-  auto call = std::make_shared<MethodCall>(
+  auto call = Make<MethodCall>(
       proxyClass->mRemote, "transact",
-      std::vector<std::shared_ptr<Expression>>{
-          std::make_shared<LiteralExpression>("Stub." + transactCodeName), _data,
+      std::vector<Expression*>{
+          Make<LiteralExpression>("Stub." + transactCodeName), _data,
           _reply ? _reply : NULL_VALUE,
-          std::make_shared<LiteralExpression>(oneway ? "android.os.IBinder.FLAG_ONEWAY" : "0")});
-  auto _status = std::make_shared<Variable>("boolean", "_status");
-  tryStatement->statements->Add(std::make_shared<VariableDeclaration>(_status, call));
+          Make<LiteralExpression>(oneway ? "android.os.IBinder.FLAG_ONEWAY" : "0")});
+  auto _status = Make<Variable>("boolean", "_status");
+  tryStatement->statements->Add(Make<VariableDeclaration>(_status, call));
 
   // If the transaction returns false, which means UNKNOWN_TRANSACTION, fall
   // back to the local method in the default impl, if set before.
@@ -693,7 +1117,7 @@ static std::shared_ptr<Method> generate_proxy_method(
     arg_names.emplace_back(arg->GetName());
   }
   bool has_return_type = method.GetType().GetName() != "void";
-  tryStatement->statements->Add(std::make_shared<LiteralStatement>(
+  tryStatement->statements->Add(Make<LiteralStatement>(
       android::base::StringPrintf(has_return_type ? "if (!_status && getDefaultImpl() != null) {\n"
                                                     "  return getDefaultImpl().%s(%s);\n"
                                                     "}\n"
@@ -705,7 +1129,7 @@ static std::shared_ptr<Method> generate_proxy_method(
 
   // throw back exceptions.
   if (_reply) {
-    auto ex = std::make_shared<MethodCall>(_reply, "readException");
+    auto ex = Make<MethodCall>(_reply, "readException");
     tryStatement->statements->Add(ex);
   }
 
@@ -722,10 +1146,11 @@ static std::shared_ptr<Method> generate_proxy_method(
                                    .type = method.GetType(),
                                    .parcel = _reply->name,
                                    .var = _result->name,
-                                   .is_classloader_created = &is_classloader_created};
+                                   .is_classloader_created = &is_classloader_created,
+                                   .compact = options.JavaCompact()};
       CreateFromParcelFor(context);
       writer->Close();
-      tryStatement->statements->Add(std::make_shared<LiteralStatement>(code));
+      tryStatement->statements->Add(Make<LiteralStatement>(code));
     }
 
     // the out/inout parameters
@@ -741,31 +1166,55 @@ static std::shared_ptr<Method> generate_proxy_method(
                                      .is_classloader_created = &is_classloader_created};
         ReadFromParcelFor(context);
         writer->Close();
-        tryStatement->statements->Add(std::make_shared<LiteralStatement>(code));
+        tryStatement->statements->Add(Make<LiteralStatement>(code));
       }
     }
-
-    finallyStatement->statements->Add(std::make_shared<MethodCall>(_reply, "recycle"));
   }
-  finallyStatement->statements->Add(std::make_shared<MethodCall>(_data, "recycle"));
+  if (!cache.empty()) {
+    // The results of the earlier generations are never looked up again, and
+    // go when the cache starts over
+    tryStatement->statements->Add(Make<LiteralStatement>(
+        StringPrintf("synchronized (%s) {\n"
+                     "  if (%s.size() >= 64) {\n"
+                     "    %s.clear();\n"
+                     "  }\n"
+                     "  %s.put(_aidl_cacheKey, _result);\n"
+                     "}\n",
+                     cache.c_str(), cache.c_str(), cache.c_str(), cache.c_str())));
+  }
+  if (options.GenParcelSizes()) {
+    // Before the parcels are recycled
+    finallyStatement->statements->Add(Make<LiteralStatement>(
+        StringPrintf("_aidl_proxy_stats[%zu].recordSizes(_data.dataSize(), %s);\n",
+                     stats_index(iface, method), _reply ? "_reply.dataSize()" : "0")));
+  }
+  if (_reply != nullptr) {
+    finallyStatement->statements->Add(Make<MethodCall>(_reply, "recycle"));
+  }
+  finallyStatement->statements->Add(Make<MethodCall>(_data, "recycle"));
 
   if (options.GenTraces()) {
-    finallyStatement->statements->Add(std::make_shared<MethodCall>(
-        std::make_shared<LiteralExpression>("android.os.Trace"), "traceEnd",
-        std::vector<std::shared_ptr<Expression>>{
-            std::make_shared<LiteralExpression>("android.os.Trace.TRACE_TAG_AIDL")}));
+    finallyStatement->statements->Add(Make<MethodCall>(
+        Make<LiteralExpression>("android.os.Trace"), "traceEnd",
+        std::vector<Expression*>{
+            Make<LiteralExpression>("android.os.Trace.TRACE_TAG_AIDL")}));
+  }
+  if (options.GenStats()) {
+    finallyStatement->statements->Add(Make<LiteralStatement>(
+        StringPrintf("_aidl_proxy_stats[%zu].record(System.nanoTime() - _aidl_start);\n",
+                     stats_index(iface, method))));
   }
 
   if (_result != nullptr) {
-    proxy->statements->Add(std::make_shared<ReturnStatement>(_result));
+    proxy->statements->Add(Make<ReturnStatement>(_result));
   }
 
   return proxy;
 }
 
 static void generate_methods(const AidlInterface& iface, const AidlMethod& method, Class* interface,
-                             std::shared_ptr<StubClass> stubClass,
-                             std::shared_ptr<ProxyClass> proxyClass, int index,
+                             StubClass* stubClass,
+                             ProxyClass* proxyClass, int index,
                              const AidlTypenames& typenames, const Options& options) {
   const bool oneway = method.IsOneway();
 
@@ -774,21 +1223,20 @@ static void generate_methods(const AidlInterface& iface, const AidlMethod& metho
   transactCodeName += method.GetName();
 
   auto transactCode =
-      std::make_shared<Field>(STATIC | FINAL, std::make_shared<Variable>("int", transactCodeName));
+      Make<Field>(STATIC | FINAL, Make<Variable>("int", transactCodeName));
   transactCode->value =
       StringPrintf("(android.os.IBinder.FIRST_CALL_TRANSACTION + %d)", index);
   stubClass->elements.push_back(transactCode);
 
   // getTransactionName
   if (options.GenTransactionNames()) {
-    auto c = std::make_shared<Case>(transactCodeName);
-    c->statements->Add(std::make_shared<ReturnStatement>(
-        std::make_shared<StringLiteralExpression>(method.GetName())));
+    auto c = Make<Case>(transactCodeName);
+    c->statements->Add(Make<ReturnStatement>(Make<StringLiteralExpression>(method.GetName())));
     stubClass->code_to_method_name_switch->cases.push_back(c);
   }
 
   // == the declaration in the interface ===================================
-  std::shared_ptr<ClassElement> decl;
+  ClassElement* decl;
   if (method.IsUserDefined()) {
     decl = generate_interface_method(method, typenames);
   } else {
@@ -796,18 +1244,20 @@ static void generate_methods(const AidlInterface& iface, const AidlMethod& metho
       std::ostringstream code;
       code << "public int " << kGetInterfaceVersion << "() "
            << "throws android.os.RemoteException;\n";
-      decl = std::make_shared<LiteralClassElement>(code.str());
+      decl = Make<LiteralClassElement>(code.str());
     }
     if (method.GetName() == kGetInterfaceHash && !options.Hash().empty()) {
       std::ostringstream code;
       code << "public String " << kGetInterfaceHash << "() "
            << "throws android.os.RemoteException;\n";
-      decl = std::make_shared<LiteralClassElement>(code.str());
+      decl = Make<LiteralClassElement>(code.str());
     }
   }
   interface->elements.push_back(decl);
 
   // == the stub method ====================================================
+  const size_t stub_cases = stubClass->transact_switch->cases.size();
+  const size_t stub_elements = stubClass->elements.size();
   if (method.IsUserDefined()) {
     bool outline_stub =
         stubClass->transact_outline && stubClass->outline_methods.count(&method) != 0;
@@ -819,30 +1269,41 @@ static void generate_methods(const AidlInterface& iface, const AidlMethod& metho
     }
   } else {
     if (method.GetName() == kGetInterfaceVersion && options.Version() > 0) {
-      auto c = std::make_shared<Case>(transactCodeName);
+      auto c = Make<Case>(transactCodeName);
       std::ostringstream code;
       code << "data.enforceInterface(descriptor);\n"
            << "reply.writeNoException();\n"
            << "reply.writeInt(" << kGetInterfaceVersion << "());\n"
            << "return true;\n";
-      c->statements->Add(std::make_shared<LiteralStatement>(code.str()));
+      c->statements->Add(Make<LiteralStatement>(code.str()));
       stubClass->transact_switch->cases.push_back(c);
     }
     if (method.GetName() == kGetInterfaceHash && !options.Hash().empty()) {
-      auto c = std::make_shared<Case>(transactCodeName);
+      auto c = Make<Case>(transactCodeName);
       std::ostringstream code;
       code << "data.enforceInterface(descriptor);\n"
            << "reply.writeNoException();\n"
            << "reply.writeString(" << kGetInterfaceHash << "());\n"
            << "return true;\n";
-      c->statements->Add(std::make_shared<LiteralStatement>(code.str()));
+      c->statements->Add(Make<LiteralStatement>(code.str()));
       stubClass->transact_switch->cases.push_back(c);
     }
   }
 
+  // The cases are written in the switch of onTransact() in Stub, and the
+  // outlined methods in Stub
+  for (size_t i = stub_cases; i < stubClass->transact_switch->cases.size(); i++) {
+    add_size(iface, &method, "stub", *stubClass->transact_switch->cases[i], 4);
+  }
+  for (size_t i = stub_elements; i < stubClass->elements.size(); i++) {
+    add_size(iface, &method, "stub", *stubClass->elements[i], 2);
+  }
+
   // == the proxy method ===================================================
-  std::shared_ptr<ClassElement> proxy = nullptr;
-  if (method.IsUserDefined()) {
+  ClassElement* proxy = nullptr;
+  if (method.GetType().IsBatchable()) {
+    proxy = generate_batched_proxy_method(method, transactCodeName, typenames, options);
+  } else if (method.IsUserDefined()) {
     proxy = generate_proxy_method(iface, method, transactCodeName, oneway, proxyClass, typenames,
                                   options);
 
@@ -853,7 +1314,8 @@ static void generate_methods(const AidlInterface& iface, const AidlMethod& metho
            << "public int " << kGetInterfaceVersion << "()"
            << " throws "
            << "android.os.RemoteException {\n"
-           << "  if (mCachedVersion == -1) {\n"
+           << "  int _aidl_version = mCachedVersion;\n"
+           << "  if (_aidl_version == -1) {\n"
            << "    android.os.Parcel data = android.os.Parcel.obtain();\n"
            << "    android.os.Parcel reply = android.os.Parcel.obtain();\n"
            << "    try {\n"
@@ -866,23 +1328,25 @@ static void generate_methods(const AidlInterface& iface, const AidlMethod& metho
            << "        }\n"
            << "      }\n"
            << "      reply.readException();\n"
-           << "      mCachedVersion = reply.readInt();\n"
+           << "      _aidl_version = reply.readInt();\n"
+           << "      mCachedVersion = _aidl_version;\n"
            << "    } finally {\n"
            << "      reply.recycle();\n"
            << "      data.recycle();\n"
            << "    }\n"
            << "  }\n"
-           << "  return mCachedVersion;\n"
+           << "  return _aidl_version;\n"
            << "}\n";
-      proxy = std::make_shared<LiteralClassElement>(code.str());
+      proxy = Make<LiteralClassElement>(code.str());
     }
     if (method.GetName() == kGetInterfaceHash && !options.Hash().empty()) {
       std::ostringstream code;
       code << "@Override\n"
-           << "public synchronized String " << kGetInterfaceHash << "()"
+           << "public String " << kGetInterfaceHash << "()"
            << " throws "
            << "android.os.RemoteException {\n"
-           << "  if (\"-1\".equals(mCachedHash)) {\n"
+           << "  String _aidl_hash = mCachedHash;\n"
+           << "  if (\"-1\".equals(_aidl_hash)) {\n"
            << "    android.os.Parcel data = android.os.Parcel.obtain();\n"
            << "    android.os.Parcel reply = android.os.Parcel.obtain();\n"
            << "    try {\n"
@@ -895,40 +1359,41 @@ static void generate_methods(const AidlInterface& iface, const AidlMethod& metho
            << "        }\n"
            << "      }\n"
            << "      reply.readException();\n"
-           << "      mCachedHash = reply.readString();\n"
+           << "      _aidl_hash = reply.readString();\n"
+           << "      mCachedHash = _aidl_hash;\n"
            << "    } finally {\n"
            << "      reply.recycle();\n"
            << "      data.recycle();\n"
            << "    }\n"
            << "  }\n"
-           << "  return mCachedHash;\n"
+           << "  return _aidl_hash;\n"
            << "}\n";
-      proxy = std::make_shared<LiteralClassElement>(code.str());
+      proxy = Make<LiteralClassElement>(code.str());
     }
   }
   if (proxy != nullptr) {
     proxyClass->elements.push_back(proxy);
+    add_size(iface, &method, "proxy", *proxy, 3);
   }
 }
 
-static void generate_interface_descriptors(std::shared_ptr<StubClass> stub,
-                                           std::shared_ptr<ProxyClass> proxy) {
+static void generate_interface_descriptors(StubClass* stub, ProxyClass* proxy) {
   // the interface descriptor transaction handler
-  auto c = std::make_shared<Case>("INTERFACE_TRANSACTION");
-  c->statements->Add(std::make_shared<MethodCall>(
+  auto c = Make<Case>("INTERFACE_TRANSACTION");
+  c->statements->Add(Make<MethodCall>(
       stub->transact_reply, "writeString",
-      std::vector<std::shared_ptr<Expression>>{stub->get_transact_descriptor(nullptr)}));
-  c->statements->Add(std::make_shared<ReturnStatement>(TRUE_VALUE));
+      std::vector<Expression*>{stub->get_transact_descriptor(nullptr)}));
+  c->statements->Add(Make<ReturnStatement>(TRUE_VALUE));
   stub->transact_switch->cases.push_back(c);
 
   // and the proxy-side method returning the descriptor directly
-  auto getDesc = std::make_shared<Method>();
+  auto getDesc = Make<Method>();
   getDesc->modifiers = PUBLIC;
   getDesc->returnType = "java.lang.String";
   getDesc->name = "getInterfaceDescriptor";
-  getDesc->statements = std::make_shared<StatementBlock>();
+  getDesc->statements = Make<StatementBlock>();
   getDesc->statements->Add(
-      std::make_shared<ReturnStatement>(std::make_shared<LiteralExpression>("DESCRIPTOR")));
+      Make<ReturnStatement>(Make<LiteralExpression>("DESCRIPTOR")));
   proxy->elements.push_back(getDesc);
 }
 
@@ -941,11 +1406,27 @@ static void generate_interface_descriptors(std::shared_ptr<StubClass> stub,
 // (so that more "complex" methods come later), and the first non_outline_count
 // number of methods not outlined (are kept in the onTransact() method).
 //
+// With a profile, the cases of the methods in it are ordered by their calls
+// instead, and only the first non_outline_count of those are kept when
+// outlining; methods that aren't in the profile are taken to be cold.
+//
 // Requirements: non_outline_count <= outline_threshold.
 static void compute_outline_methods(const AidlInterface* iface,
-                                    const std::shared_ptr<StubClass> stub, size_t outline_threshold,
-                                    size_t non_outline_count) {
+                                    StubClass* stub, size_t outline_threshold,
+                                    size_t non_outline_count, const TransactProfile& profile) {
   CHECK_LE(non_outline_count, outline_threshold);
+  // The user-defined methods in the profile, hottest first
+  std::vector<const AidlMethod*> hot_methods;
+  for (const std::unique_ptr<AidlMethod>& ptr : iface->GetMethods()) {
+    if (auto it = profile.find(ptr->GetName()); it != profile.end() && ptr->IsUserDefined()) {
+      hot_methods.push_back(ptr.get());
+    }
+  }
+  std::stable_sort(hot_methods.begin(), hot_methods.end(),
+                   [&](const AidlMethod* m1, const AidlMethod* m2) {
+                     return profile.at(m1->GetName()) > profile.at(m2->GetName());
+                   });
+
   // We'll outline (create sub methods) if there are more than min_methods
   // cases.
   stub->transact_outline = iface->GetMethods().size() > outline_threshold;
@@ -957,44 +1438,205 @@ static void compute_outline_methods(const AidlInterface* iface,
       methods.push_back(ptr.get());
     }
 
-    std::stable_sort(
-        methods.begin(),
-        methods.end(),
-        [](const AidlMethod* m1, const AidlMethod* m2) {
-          return m1->GetArguments().size() < m2->GetArguments().size();
-        });
+    if (hot_methods.empty()) {
+      std::stable_sort(
+          methods.begin(),
+          methods.end(),
+          [](const AidlMethod* m1, const AidlMethod* m2) {
+            return m1->GetArguments().size() < m2->GetArguments().size();
+          });
+    } else {
+      if (hot_methods.size() > non_outline_count) {
+        hot_methods.resize(non_outline_count);
+      }
+      non_outline_count = hot_methods.size();
+      const std::unordered_set<const AidlMethod*> hot(hot_methods.begin(), hot_methods.end());
+      std::stable_partition(methods.begin(), methods.end(),
+                            [&](const AidlMethod* m) { return hot.count(m) != 0; });
+    }
 
     stub->outline_methods.insert(methods.begin() + non_outline_count,
                                  methods.end());
   }
+  for (const AidlMethod* method : hot_methods) {
+    stub->case_calls[method] = profile.at(method->GetName());
+  }
+}
+
+// The counts of the transactions of the methods of |iface| with --gen-stats,
+// kept by its proxies and by its stubs in two static tables of the Stub
+static void generate_transaction_stats(const AidlInterface& iface, StubClass* stub) {
+  stub->elements.emplace_back(Make<LiteralClassElement>(
+      "/**\n"
+      " * The transactions of a method: their count, their total latency and a\n"
+      " * histogram of their latencies, whose bucket i counts the latencies from\n"
+      " * 2^i up to 2^(i + 1) nanoseconds. With --gen-stats=sizes, the bytes of\n"
+      " * their requests and replies as well.\n"
+      " */\n"
+      "public static final class TransactionStats {\n"
+      "  public static final int BUCKETS = 40;\n"
+      "  private static final int CALLS = 0;\n"
+      "  private static final int TOTAL_NANOS = 1;\n"
+      "  private static final int REQUEST_BYTES = 2;\n"
+      "  private static final int REPLY_BYTES = 3;\n"
+      "  private static final int MAX_REQUEST_BYTES = 4;\n"
+      "  private static final int MAX_REPLY_BYTES = 5;\n"
+      "  private static final int FIRST_BUCKET = 6;\n"
+      "  public final String methodName;\n"
+      "  public final int code;\n"
+      "  private final java.util.concurrent.atomic.AtomicLongArray mCounts =\n"
+      "      new java.util.concurrent.atomic.AtomicLongArray(FIRST_BUCKET + BUCKETS);\n"
+      "  private TransactionStats(String methodName, int code) {\n"
+      "    this.methodName = methodName;\n"
+      "    this.code = code;\n"
+      "  }\n"
+      "  private void record(long nanos) {\n"
+      "    if (nanos < 0) nanos = 0;\n"
+      "    int bucket = nanos <= 1 ? 0 : 63 - Long.numberOfLeadingZeros(nanos);\n"
+      "    mCounts.getAndIncrement(CALLS);\n"
+      "    mCounts.getAndAdd(TOTAL_NANOS, nanos);\n"
+      "    mCounts.getAndIncrement(FIRST_BUCKET + Math.min(bucket, BUCKETS - 1));\n"
+      "  }\n"
+      "  private void recordSizes(int request, int reply) {\n"
+      "    mCounts.getAndAdd(REQUEST_BYTES, request);\n"
+      "    mCounts.getAndAdd(REPLY_BYTES, reply);\n"
+      "    storeMax(MAX_REQUEST_BYTES, request);\n"
+      "    storeMax(MAX_REPLY_BYTES, reply);\n"
+      "  }\n"
+      "  private void storeMax(int i, long value) {\n"
+      "    long current = mCounts.get(i);\n"
+      "    while (current < value && !mCounts.compareAndSet(i, current, value)) {\n"
+      "      current = mCounts.get(i);\n"
+      "    }\n"
+      "  }\n"
+      "  public long getCalls() {\n"
+      "    return mCounts.get(CALLS);\n"
+      "  }\n"
+      "  public long getTotalNanos() {\n"
+      "    return mCounts.get(TOTAL_NANOS);\n"
+      "  }\n"
+      "  public long getBucket(int i) {\n"
+      "    return mCounts.get(FIRST_BUCKET + i);\n"
+      "  }\n"
+      "  public long getRequestBytes() {\n"
+      "    return mCounts.get(REQUEST_BYTES);\n"
+      "  }\n"
+      "  public long getReplyBytes() {\n"
+      "    return mCounts.get(REPLY_BYTES);\n"
+      "  }\n"
+      "  public long getMaxRequestBytes() {\n"
+      "    return mCounts.get(MAX_REQUEST_BYTES);\n"
+      "  }\n"
+      "  public long getMaxReplyBytes() {\n"
+      "    return mCounts.get(MAX_REPLY_BYTES);\n"
+      "  }\n"
+      "}\n"));
+
+  std::ostringstream table;
+  for (const auto& m : iface.GetMethods()) {
+    if (m->IsUserDefined()) {
+      table << "  new TransactionStats(\"" << m->GetName() << "\", TRANSACTION_" << m->GetName()
+            << "),\n";
+    }
+  }
+  for (const string side : {"stub", "proxy"}) {
+    stub->elements.emplace_back(Make<LiteralClassElement>(
+        "private static final TransactionStats[] _aidl_" + side + "_stats = {\n" + table.str() +
+        "};\n"));
+  }
+  stub->elements.emplace_back(Make<LiteralClassElement>(
+      "/** The transactions served by the stubs, in the order of the methods */\n"
+      "public static TransactionStats[] getTransactionStats() {\n"
+      "  return _aidl_stub_stats.clone();\n"
+      "}\n"));
+  stub->elements.emplace_back(Make<LiteralClassElement>(
+      "/** The transactions made by the proxies, in the order of the methods */\n"
+      "public static TransactionStats[] getProxyTransactionStats() {\n"
+      "  return _aidl_proxy_stats.clone();\n"
+      "}\n"));
+  stub->elements.emplace_back(Make<LiteralClassElement>(
+      "/** The transactions with the code |transactionCode| served by the stubs, or null */\n"
+      "public static TransactionStats getTransactionStats(int transactionCode) {\n"
+      "  return findTransactionStats(_aidl_stub_stats, transactionCode);\n"
+      "}\n"));
+  stub->elements.emplace_back(Make<LiteralClassElement>(
+      "/** The transactions with the code |transactionCode| made by the proxies, or null */\n"
+      "public static TransactionStats getProxyTransactionStats(int transactionCode) {\n"
+      "  return findTransactionStats(_aidl_proxy_stats, transactionCode);\n"
+      "}\n"));
+  stub->elements.emplace_back(Make<LiteralClassElement>(
+      "private static TransactionStats findTransactionStats(TransactionStats[] table, int code) {\n"
+      "  for (TransactionStats stats : table) {\n"
+      "    if (stats.code == code) return stats;\n"
+      "  }\n"
+      "  return null;\n"
+      "}\n"));
 }
 
-static shared_ptr<ClassElement> generate_default_impl_method(const AidlMethod& method,
+// The instances of the in parcelable arguments that the stubs read the next
+// calls into with --java-reuse, one of each type, once the implementation opts
+// in with setRecycleInParcelables()
+static void generate_recycled_parcelables(const AidlInterface& iface, StubClass* stub,
+                                          const AidlTypenames& typenames,
+                                          const Options& options) {
+  std::map<string, string> recycled_types;
+  for (const auto& m : iface.GetMethods()) {
+    for (const auto& arg : m->GetArguments()) {
+      if (const string recycled = recycled_field_for(*arg, typenames, options);
+          !recycled.empty()) {
+        recycled_types[recycled] = JavaSignatureOf(arg->GetType(), typenames);
+      }
+    }
+  }
+  if (recycled_types.empty()) {
+    return;
+  }
+  stub->elements.emplace_back(
+      Make<LiteralClassElement>("private volatile boolean mRecycleInParcelables = false;\n"));
+  stub->elements.emplace_back(Make<LiteralClassElement>(
+      "/**\n"
+      " * Has the stub read the in parcelable arguments of the methods into the\n"
+      " * instances of the previous calls rather than into new ones. The methods\n"
+      " * must then not keep these arguments, or what they refer to, once they\n"
+      " * return.\n"
+      " */\n"
+      "public final void setRecycleInParcelables(boolean recycle) {\n"
+      "  mRecycleInParcelables = recycle;\n"
+      "}\n"));
+  for (const auto& [field, type] : recycled_types) {
+    stub->elements.emplace_back(Make<LiteralClassElement>(
+        StringPrintf("private final java.util.concurrent.atomic.AtomicReference<%s> %s =\n"
+                     "    new java.util.concurrent.atomic.AtomicReference<>();\n",
+                     type.c_str(), field.c_str())));
+  }
+}
+
+static ClassElement* generate_default_impl_method(const AidlMethod& method,
                                                              const AidlTypenames& typenames) {
-  auto default_method = std::make_shared<Method>();
+  auto default_method = Make<Method>();
   default_method->comment = method.GetComments();
   default_method->modifiers = PUBLIC | OVERRIDE;
   default_method->returnType = JavaSignatureOf(method.GetType(), typenames);
   default_method->name = method.GetName();
-  default_method->statements = std::make_shared<StatementBlock>();
+  default_method->statements = Make<StatementBlock>();
   for (const auto& arg : method.GetArguments()) {
     default_method->parameters.push_back(
-        std::make_shared<Variable>(JavaSignatureOf(arg->GetType(), typenames), arg->GetName()));
+        Make<Variable>(JavaSignatureOf(arg->GetType(), typenames), arg->GetName()));
   }
   default_method->exceptions.push_back("android.os.RemoteException");
 
   if (method.GetType().GetName() != "void") {
     const string& defaultValue = DefaultJavaValueOf(method.GetType(), typenames);
     default_method->statements->Add(
-        std::make_shared<LiteralStatement>(StringPrintf("return %s;\n", defaultValue.c_str())));
+        Make<LiteralStatement>(StringPrintf("return %s;\n", defaultValue.c_str())));
   }
   return default_method;
 }
 
-static shared_ptr<Class> generate_default_impl_class(const AidlInterface& iface,
+static Class* generate_default_impl_class(const AidlInterface& iface,
                                                      const AidlTypenames& typenames,
                                                      const Options& options) {
-  auto default_class = std::make_shared<Class>();
+  auto default_class = Make<Class>();
   default_class->comment = "/** Default implementation for " + iface.GetName() + ". */";
   default_class->modifiers = PUBLIC | STATIC;
   default_class->what = Class::CLASS;
@@ -1004,6 +1646,7 @@ static shared_ptr<Class> generate_default_impl_class(const AidlInterface& iface,
   for (const auto& m : iface.GetMethods()) {
     if (m->IsUserDefined()) {
       default_class->elements.emplace_back(generate_default_impl_method(*m.get(), typenames));
+      add_size(iface, m.get(), "default_impl", *default_class->elements.back(), 2);
     } else {
       // These are called only when the remote side does not implement these
       // methods, which is normally impossible, because these methods are
@@ -1017,7 +1660,7 @@ static shared_ptr<Class> generate_default_impl_class(const AidlInterface& iface,
              << "public int " << kGetInterfaceVersion << "() {\n"
              << "  return 0;\n"
              << "}\n";
-        default_class->elements.emplace_back(std::make_shared<LiteralClassElement>(code.str()));
+        default_class->elements.emplace_back(Make<LiteralClassElement>(code.str()));
       }
       if (m->GetName() == kGetInterfaceHash && !options.Hash().empty()) {
         std::ostringstream code;
@@ -1025,13 +1668,22 @@ static shared_ptr<Class> generate_default_impl_class(const AidlInterface& iface,
              << "public String " << kGetInterfaceHash << "() {\n"
              << "  return \"\";\n"
              << "}\n";
-        default_class->elements.emplace_back(std::make_shared<LiteralClassElement>(code.str()));
+        default_class->elements.emplace_back(Make<LiteralClassElement>(code.str()));
       }
     }
   }
 
+  const auto& methods = iface.GetMethods();
+  if (std::any_of(methods.begin(), methods.end(),
+                  [](const auto& m) { return m->GetType().IsBatchable(); })) {
+    default_class->elements.emplace_back(Make<LiteralClassElement>(
+        "@Override\n"
+        "public void " + kFlushBatchedCalls + "() {\n"
+        "}\n"));
+  }
+
   default_class->elements.emplace_back(
-      std::make_shared<LiteralClassElement>("@Override\n"
+      Make<LiteralClassElement>("@Override\n"
                                             "public android.os.IBinder asBinder() {\n"
                                             "  return null;\n"
                                             "}\n"));
@@ -1039,11 +1691,100 @@ static shared_ptr<Class> generate_default_impl_class(const AidlInterface& iface,
   return default_class;
 }
 
-std::unique_ptr<Class> generate_binder_interface_class(const AidlInterface* iface,
+// A lazy proxy waits for its service on its first call, and forgets it when
+// it dies.
+static Class* generate_lazy_proxy_class(const AidlInterface& iface,
+                                        const AidlTypenames& typenames) {
+  const string i_name = iface.GetCanonicalName();
+  auto lazy_class = Make<Class>();
+  lazy_class->comment =
+      "/**\n"
+      " * A proxy of the service registered as a name, which it looks up on its\n"
+      " * first call rather than when it is created, and again after the service died.\n"
+      " */";
+  lazy_class->modifiers = PUBLIC | STATIC;
+  lazy_class->what = Class::CLASS;
+  lazy_class->type = i_name + ".Lazy";
+  lazy_class->interfaces.emplace_back(i_name);
+
+  lazy_class->elements.emplace_back(Make<LiteralClassElement>(StringPrintf(
+      "private final String mName;\n"
+      "private %s mService;\n"
+      "private final android.os.IBinder.DeathRecipient mDeathRecipient =\n"
+      "    new android.os.IBinder.DeathRecipient() {\n"
+      "      @Override\n"
+      "      public void binderDied() {\n"
+      "        synchronized (Lazy.this) {\n"
+      "          mService = null;\n"
+      "        }\n"
+      "      }\n"
+      "    };\n"
+      "public Lazy(String name) {\n"
+      "  mName = name;\n"
+      "}\n"
+      "private synchronized %s getService() throws android.os.RemoteException {\n"
+      "  if (mService == null) {\n"
+      "    android.os.IBinder binder = android.os.ServiceManager.waitForService(mName);\n"
+      "    if (binder == null) {\n"
+      "      throw new android.os.RemoteException(\"No service \" + mName);\n"
+      "    }\n"
+      "    binder.linkToDeath(mDeathRecipient, 0);\n"
+      "    mService = Stub.asInterface(binder);\n"
+      "  }\n"
+      "  return mService;\n"
+      "}\n",
+      i_name.c_str(), i_name.c_str())));
+
+  for (const auto& m : iface.GetMethods()) {
+    vector<string> arguments;
+    for (const auto& arg : m->GetArguments()) {
+      arguments.push_back(arg->GetName());
+    }
+    auto method = Make<Method>();
+    method->comment = m->GetComments();
+    method->modifiers = PUBLIC | OVERRIDE;
+    method->returnType = JavaSignatureOf(m->GetType(), typenames);
+    method->name = m->GetName();
+    method->statements = Make<StatementBlock>();
+    for (const auto& arg : m->GetArguments()) {
+      method->parameters.push_back(
+          Make<Variable>(JavaSignatureOf(arg->GetType(), typenames), arg->GetName()));
+    }
+    method->exceptions.push_back("android.os.RemoteException");
+    method->statements->Add(Make<LiteralStatement>(
+        StringPrintf("%sgetService().%s(%s);\n", m->GetType().GetName() != "void" ? "return " : "",
+                     m->GetName().c_str(), Join(arguments, ", ").c_str())));
+    lazy_class->elements.emplace_back(method);
+  }
+
+  const auto& methods = iface.GetMethods();
+  if (std::any_of(methods.begin(), methods.end(),
+                  [](const auto& m) { return m->GetType().IsBatchable(); })) {
+    lazy_class->elements.emplace_back(Make<LiteralClassElement>(
+        "@Override\n"
+        "public void " + kFlushBatchedCalls + "() throws android.os.RemoteException {\n"
+        "  getService()." + kFlushBatchedCalls + "();\n"
+        "}\n"));
+  }
+
+  lazy_class->elements.emplace_back(
+      Make<LiteralClassElement>("@Override\n"
+                                "public android.os.IBinder asBinder() {\n"
+                                "  try {\n"
+                                "    return getService().asBinder();\n"
+                                "  } catch (android.os.RemoteException e) {\n"
+                                "    return null;\n"
+                                "  }\n"
+                                "}\n"));
+  return lazy_class;
+}
+
+Class* generate_binder_interface_class(const AidlInterface* iface,
                                                        const AidlTypenames& typenames,
-                                                       const Options& options) {
+                                                       const Options& options,
+                                                       const TransactProfile& profile) {
   // the interface class
-  auto interface = std::make_unique<Class>();
+  auto interface = Make<Class>();
   interface->comment = iface->GetComments();
   interface->modifiers = PUBLIC;
   interface->what = Class::INTERFACE;
@@ -1060,29 +1801,37 @@ std::unique_ptr<Class> generate_binder_interface_class(const AidlInterface* ifac
          << " * that the remote object is implementing.\n"
          << " */\n"
          << "public static final int VERSION = " << options.Version() << ";\n";
-    interface->elements.emplace_back(std::make_shared<LiteralClassElement>(code.str()));
+    interface->elements.emplace_back(Make<LiteralClassElement>(code.str()));
   }
   if (!options.Hash().empty()) {
     std::ostringstream code;
     code << "public static final String HASH = \"" << options.Hash() << "\";\n";
-    interface->elements.emplace_back(std::make_shared<LiteralClassElement>(code.str()));
+    interface->elements.emplace_back(Make<LiteralClassElement>(code.str()));
+  }
+  if (options.GenWireSchema()) {
+    interface->elements.emplace_back(
+        Make<LiteralClassElement>(WireSchemaMethod(*iface, typenames)));
   }
 
   // the default impl class
   auto default_impl = generate_default_impl_class(*iface, typenames, options);
   interface->elements.emplace_back(default_impl);
+  if (options.GenLazyProxy()) {
+    interface->elements.emplace_back(generate_lazy_proxy_class(*iface, typenames));
+  }
 
   // the stub inner class
-  auto stub = std::make_shared<StubClass>(iface, options);
+  auto stub = Make<StubClass>(iface, options);
   interface->elements.push_back(stub);
 
   compute_outline_methods(iface,
                           stub,
                           options.onTransact_outline_threshold_,
-                          options.onTransact_non_outline_count_);
+                          options.onTransact_non_outline_count_,
+                          profile);
 
   // the proxy inner class
-  auto proxy = std::make_shared<ProxyClass>(iface, options);
+  auto proxy = Make<ProxyClass>(iface, options);
   stub->elements.push_back(proxy);
 
   // stub and proxy support for getInterfaceDescriptor()
@@ -1094,18 +1843,18 @@ std::unique_ptr<Class> generate_binder_interface_class(const AidlInterface* ifac
     auto comment = constant->GetType().GetComments();
     if (comment.length() != 0) {
       auto code = StringPrintf("%s\n", comment.c_str());
-      interface->elements.push_back(std::make_shared<LiteralClassElement>(code));
+      interface->elements.push_back(Make<LiteralClassElement>(code));
     }
     switch (value.GetType()) {
       case AidlConstantValue::Type::STRING: {
-        generate_string_constant(interface.get(), constant->GetName(),
+        generate_string_constant(interface, constant->GetName(),
                                  constant->ValueString(ConstantValueDecorator));
         break;
       }
       case AidlConstantValue::Type::BOOLEAN:  // fall-through
       case AidlConstantValue::Type::INT8:     // fall-through
       case AidlConstantValue::Type::INT32: {
-        generate_int_constant(interface.get(), constant->GetName(),
+        generate_int_constant(interface, constant->GetName(),
                               constant->ValueString(ConstantValueDecorator));
         break;
       }
@@ -1117,9 +1866,35 @@ std::unique_ptr<Class> generate_binder_interface_class(const AidlInterface* ifac
 
   // all the declared methods of the interface
 
+  stub->method_cases_begin = stub->transact_switch->cases.size();
   for (const auto& item : iface->GetMethods()) {
-    generate_methods(*iface, *item, interface.get(), stub, proxy, item->GetId(), typenames,
-                     options);
+    generate_methods(*iface, *item, interface, stub, proxy, item->GetId(), typenames, options);
+  }
+
+  // The calls of the @Batchable methods, which the proxies queue and send
+  // together in one transaction
+  const auto& methods = iface->GetMethods();
+  if (std::any_of(methods.begin(), methods.end(),
+                  [](const auto& m) { return m->GetType().IsBatchable(); })) {
+    interface->elements.emplace_back(Make<LiteralClassElement>(
+        "/** Sends the calls of the @Batchable methods that the proxy has queued. */\n"
+        "public void " + kFlushBatchedCalls + "() throws android.os.RemoteException;\n"));
+    stub->elements.emplace_back(Make<LiteralClassElement>(StringPrintf(
+        "static final int BATCH_TRANSACTION = "
+        "(android.os.IBinder.FIRST_CALL_TRANSACTION + %d);\n",
+        kBatchTransactionId)));
+    stub->elements.emplace_back(Make<LiteralClassElement>(
+        "@Override\n"
+        "public void " + kFlushBatchedCalls + "() {\n"
+        "}\n"));
+    generate_stub_batch_case(*iface, stub, typenames, options);
+    generate_proxy_batch(proxy);
+  }
+  if (options.GenStats()) {
+    generate_transaction_stats(*iface, stub);
+  }
+  if (options.JavaReuse()) {
+    generate_recycled_parcelables(*iface, stub, typenames, options);
   }
 
   // additional static methods for the default impl set/get to the
@@ -1129,7 +1904,7 @@ std::unique_ptr<Class> generate_binder_interface_class(const AidlInterface* ifac
   // TODO(b/111417145) make this conditional depending on the Java language
   // version requested
   const string i_name = iface->GetCanonicalName();
-  stub->elements.emplace_back(std::make_shared<LiteralClassElement>(
+  stub->elements.emplace_back(Make<LiteralClassElement>(
       StringPrintf("public static boolean setDefaultImpl(%s impl) {\n"
                    "  // Only one user of this interface can use this function\n"
                    "  // at a time. This is a heuristic to detect if two different\n"
@@ -1145,16 +1920,29 @@ std::unique_ptr<Class> generate_binder_interface_class(const AidlInterface* ifac
                    "}\n",
                    i_name.c_str())));
   stub->elements.emplace_back(
-      std::make_shared<LiteralClassElement>(StringPrintf("public static %s getDefaultImpl() {\n"
+      Make<LiteralClassElement>(StringPrintf("public static %s getDefaultImpl() {\n"
                                                          "  return Stub.Proxy.sDefaultImpl;\n"
                                                          "}\n",
                                                          i_name.c_str())));
 
   // the static field is defined in the proxy class, not in the interface class
   // because all fields in an interface class are by default final.
-  proxy->elements.emplace_back(std::make_shared<LiteralClassElement>(
+  proxy->elements.emplace_back(Make<LiteralClassElement>(
       StringPrintf("public static %s sDefaultImpl;\n", i_name.c_str())));
 
+  // The proxies only return the results of the @Cacheable methods that they
+  // cached in the current generation, which invalidateCaches() ends.
+  if (std::any_of(methods.begin(), methods.end(),
+                  [](const auto& m) { return m->GetType().IsCacheable(); })) {
+    stub->elements.emplace_back(
+        Make<LiteralClassElement>("public static void invalidateCaches() {\n"
+                                  "  Stub.Proxy.sCacheGeneration.incrementAndGet();\n"
+                                  "}\n"));
+    proxy->elements.emplace_back(Make<LiteralClassElement>(
+        "static final java.util.concurrent.atomic.AtomicLong sCacheGeneration =\n"
+        "    new java.util.concurrent.atomic.AtomicLong();\n"));
+  }
+
   stub->finish();
 
   return interface;
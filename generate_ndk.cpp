@@ -18,29 +18,44 @@
 
 #include "aidl.h"
 #include "aidl_language.h"
+#include "aidl_profile.h"
 #include "aidl_to_cpp_common.h"
 #include "aidl_to_ndk.h"
 
 #include <android-base/logging.h>
+#include <android-base/strings.h>
+
+#include <optional>
 
 namespace android {
 namespace aidl {
 namespace ndk {
 
-static constexpr const char* kClazz = "_g_aidl_clazz";
 static constexpr const char* kDescriptor = "descriptor";
 static constexpr const char* kVersion = "version";
 static constexpr const char* kHash = "hash";
 static constexpr const char* kCachedVersion = "_aidl_cached_version";
 static constexpr const char* kCachedHash = "_aidl_cached_hash";
-static constexpr const char* kCachedHashMutex = "_aidl_cached_hash_mutex";
+static constexpr const char* kCachedHashState = "_aidl_cached_hash_state";
+static constexpr const char* kCacheGeneration = "_aidl_cache_generation";
+static constexpr const char* kBatchTimer = "::android::aidl::BatchTimer::";
+static constexpr const char* kGetTransactionStatsDecl =
+    "static ::android::aidl::transaction_stats::Table getTransactionStats();\n";
 
 using namespace internals;
 using cpp::ClassNames;
 
+static void GenerateNdkDedupPlaceholder(const string& output_file,
+                                        const IoDelegate& io_delegate) {
+  CodeWriterPtr code_writer = io_delegate.GetCodeWriter(output_file);
+  *code_writer
+      << "// This file is intentionally left blank as placeholder for deduplicated code.\n";
+  CHECK(code_writer->Close());
+}
+
 void GenerateNdkInterface(const string& output_file, const Options& options,
                           const AidlTypenames& types, const AidlInterface& defined_type,
-                          const IoDelegate& io_delegate) {
+                          const IoDelegate& io_delegate, bool with_source) {
   const string i_header = options.OutputHeaderDir() + NdkHeaderFile(defined_type, ClassNames::RAW);
   unique_ptr<CodeWriter> i_writer(io_delegate.GetCodeWriter(i_header));
   GenerateInterfaceHeader(*i_writer, types, defined_type, options);
@@ -58,6 +73,10 @@ void GenerateNdkInterface(const string& output_file, const Options& options,
   GenerateServerHeader(*bn_writer, types, defined_type, options);
   CHECK(bn_writer->Close());
 
+  if (!with_source) {
+    GenerateNdkDedupPlaceholder(output_file, io_delegate);
+    return;
+  }
   unique_ptr<CodeWriter> source_writer = io_delegate.GetCodeWriter(output_file);
   GenerateSource(*source_writer, types, defined_type, options);
   CHECK(source_writer->Close());
@@ -65,7 +84,7 @@ void GenerateNdkInterface(const string& output_file, const Options& options,
 
 void GenerateNdkParcel(const string& output_file, const Options& options,
                        const AidlTypenames& types, const AidlStructuredParcelable& defined_type,
-                       const IoDelegate& io_delegate) {
+                       const IoDelegate& io_delegate, bool with_source) {
   const string header_path =
       options.OutputHeaderDir() + NdkHeaderFile(defined_type, ClassNames::RAW);
   unique_ptr<CodeWriter> header_writer(io_delegate.GetCodeWriter(header_path));
@@ -84,6 +103,10 @@ void GenerateNdkParcel(const string& output_file, const Options& options,
   *bn_writer << "#error TODO(b/111362593) defined_types do not have bn classes\n";
   CHECK(bn_writer->Close());
 
+  if (!with_source) {
+    GenerateNdkDedupPlaceholder(output_file, io_delegate);
+    return;
+  }
   unique_ptr<CodeWriter> source_writer = io_delegate.GetCodeWriter(output_file);
   GenerateParcelSource(*source_writer, types, defined_type, options);
   CHECK(source_writer->Close());
@@ -124,10 +147,11 @@ void GenerateNdkEnumDeclaration(const string& output_file, const Options& option
 }
 
 void GenerateNdk(const string& output_file, const Options& options, const AidlTypenames& types,
-                 const AidlDefinedType& defined_type, const IoDelegate& io_delegate) {
+                 const AidlDefinedType& defined_type, const IoDelegate& io_delegate,
+                 bool with_source) {
   if (const AidlStructuredParcelable* parcelable = defined_type.AsStructuredParcelable();
       parcelable != nullptr) {
-    GenerateNdkParcel(output_file, options, types, *parcelable, io_delegate);
+    GenerateNdkParcel(output_file, options, types, *parcelable, io_delegate, with_source);
     return;
   }
 
@@ -144,7 +168,7 @@ void GenerateNdk(const string& output_file, const Options& options, const AidlTy
   }
 
   if (const AidlInterface* interface = defined_type.AsInterface(); interface != nullptr) {
-    GenerateNdkInterface(output_file, options, types, *interface, io_delegate);
+    GenerateNdkInterface(output_file, options, types, *interface, io_delegate, with_source);
     return;
   }
 
@@ -173,6 +197,9 @@ static void StatusCheckReturn(CodeWriter& out) {
 
 static void GenerateHeaderIncludes(CodeWriter& out, const AidlTypenames& types,
                                    const AidlDefinedType& defined_type) {
+  if (cpp::UsesFixedSizeArrays(defined_type)) {
+    out << "#include <array>\n";
+  }
   out << "#include <cstdint>\n";
   out << "#include <memory>\n";
   out << "#include <optional>\n";
@@ -181,6 +208,12 @@ static void GenerateHeaderIncludes(CodeWriter& out, const AidlTypenames& types,
   out << "#ifdef BINDER_STABILITY_SUPPORT\n";
   out << "#include <android/binder_stability.h>\n";
   out << "#endif  // BINDER_STABILITY_SUPPORT\n";
+  if (cpp::UsesArrayView(defined_type)) {
+    out << "#include <aidl/array_view.h>\n";
+  }
+  if (cpp::UsesStringView(defined_type)) {
+    out << "#include <string_view>\n";
+  }
 
   types.IterateTypes([&](const AidlDefinedType& other_defined_type) {
     if (&other_defined_type == &defined_type) return;
@@ -202,8 +235,23 @@ static void GenerateHeaderIncludes(CodeWriter& out, const AidlTypenames& types,
   });
 }
 static void GenerateSourceIncludes(CodeWriter& out, const AidlTypenames& types,
-                                   const AidlDefinedType& /*defined_type*/) {
+                                   const AidlDefinedType& defined_type) {
   out << "#include <android/binder_parcel_utils.h>\n";
+  if (cpp::UsesSharedMemory(defined_type)) {
+    out << "#include <aidl/shared_memory_ndk.h>\n";
+  }
+  if (cpp::UsesArrayView(defined_type) || cpp::UsesStringView(defined_type)) {
+    out << "#include <aidl/array_view_ndk.h>\n";
+  }
+  if (cpp::UsesFixedSizeArrays(defined_type)) {
+    out << "#include <aidl/fixed_array_ndk.h>\n";
+  }
+  if (defined_type.IsPolymorphicAllocator()) {
+    out << "#include <aidl/pmr_ndk.h>\n";
+  }
+  if (defined_type.AsInterface() != nullptr) {
+    out << "#include <aidl/status_ndk.h>\n";
+  }
 
   types.IterateTypes([&](const AidlDefinedType& a_defined_type) {
     if (a_defined_type.AsInterface() != nullptr) {
@@ -274,9 +322,32 @@ static void GenerateConstantDefinitions(CodeWriter& out, const AidlInterface& in
 void GenerateSource(CodeWriter& out, const AidlTypenames& types, const AidlInterface& defined_type,
                     const Options& options) {
   GenerateSourceIncludes(out, types, defined_type);
+  if (options.GenBinaryLog()) {
+    out << "#include <aidl/binary_log.h>\n";
+    out << "#include <aidl/transaction_capture_ndk.h>\n";
+  }
+  if (options.GenPerfettoTraces()) {
+    out << "#include <aidl/trace_events.h>\n";
+  }
+  if (options.GenLazyProxy()) {
+    out << "#include <android/binder_manager.h>\n";
+  }
+  if (cpp::HasMarshalTables(defined_type, options)) {
+    out << "#include <aidl/marshal_ndk.h>\n";
+  }
   out << "\n";
 
   EnterNdkNamespace(out, defined_type);
+  if (cpp::HasMarshalTables(defined_type, options)) {
+    out << cpp::GenMarshalTables(defined_type, options);
+  }
+  if (options.GenStats()) {
+    // Ahead of the transactions that count into them
+    for (ClassNames name : {ClassNames::SERVER, ClassNames::CLIENT}) {
+      out << cpp::GenStatsTable(defined_type, ClassName(defined_type, name),
+                                "FIRST_CALL_TRANSACTION");
+    }
+  }
   GenerateClassSource(out, types, defined_type, options);
   GenerateClientSource(out, types, defined_type, options);
   GenerateServerSource(out, types, defined_type, options);
@@ -288,20 +359,162 @@ static std::string MethodId(const AidlMethod& m) {
   return "(FIRST_CALL_TRANSACTION + " + std::to_string(m.GetId()) + " /*" + m.GetName() + "*/)";
 }
 
+// The member of a proxy that keeps the results of a @Cacheable method
+static std::string CacheVarName(const AidlMethod& m) {
+  return "_aidl_cached_" + m.GetName();
+}
+
+// The member of a stub that keeps the calls in flight of a @SingleFlight method
+static std::string FlightVarName(const AidlMethod& m) {
+  return "_aidl_flight_" + m.GetName();
+}
+
+// The code of the transaction that carries the calls of the @Batchable methods
+static std::string BatchTransactionId() {
+  return "(FIRST_CALL_TRANSACTION + " + std::to_string(kBatchTransactionId) + " /*batch*/)";
+}
+
+// A @Batchable method appends its call to the batch of the proxy, which is
+// sent once it is full, old or flushed: the number of the calls after the
+// interface token, followed by the code and the in arguments of each call.
+static void GenerateClientBatchedMethodDefinition(CodeWriter& out, const AidlTypenames& types,
+                                                  const AidlInterface& defined_type,
+                                                  const AidlMethod& method) {
+  const std::string clazz = ClassName(defined_type, ClassNames::CLIENT);
+
+  out << NdkMethodDecl(types, defined_type, method, clazz) << " {\n";
+  out.Indent();
+  out << "std::lock_guard<std::mutex> _aidl_lock(_aidl_batch_mutex);\n";
+  out << "binder_status_t _aidl_ret_status = STATUS_OK;\n";
+  out << "int32_t _aidl_start = 0;\n";
+  out << "if (_aidl_batch_calls == 0) {\n";
+  out.Indent();
+  out << "_aidl_batch.reset();\n";
+  out << "_aidl_ret_status = AIBinder_prepareTransaction(asBinder().get(), "
+         "_aidl_batch.getR());\n";
+  StatusCheckGoto(out);
+  // The number of the calls is filled in when the batch is sent
+  out << "_aidl_batch_count_position = AParcel_getDataPosition(_aidl_batch.get());\n";
+  out << "_aidl_ret_status = AParcel_writeInt32(_aidl_batch.get(), 0);\n";
+  StatusCheckGoto(out);
+  out.Dedent();
+  out << "}\n";
+  out << "_aidl_start = AParcel_getDataPosition(_aidl_batch.get());\n";
+  out << "_aidl_ret_status = AParcel_writeUint32(_aidl_batch.get(), " << MethodId(method)
+      << ");\n";
+  StatusCheckGoto(out);
+  for (const auto& arg : method.GetArguments()) {
+    out << "_aidl_ret_status = ";
+    WriteToParcelFor({out, types, arg->GetType(), "_aidl_batch.get()", cpp::BuildVarName(*arg)});
+    out << ";\n";
+    StatusCheckGoto(out);
+  }
+  out << "++_aidl_batch_calls;\n";
+  // The first call of a batch schedules its flush, which keeps the proxy
+  // alive until then. A flush that runs after the batch was sent finds the
+  // deadline of the next batch ahead, and leaves it.
+  out << "if (_aidl_batch_calls == 1) {\n";
+  out.Indent();
+  out << "_aidl_batch_deadline = " << kBatchTimer << "Clock::now() + " << kBatchTimer
+      << "kMaxDelay;\n";
+  out << kBatchTimer << "Default().Schedule(_aidl_batch_deadline, [_aidl_self = ref<" << clazz
+      << ">()]() {\n";
+  out << "  std::lock_guard<std::mutex> _aidl_lock(_aidl_self->_aidl_batch_mutex);\n";
+  out << "  if (" << kBatchTimer << "Clock::now() >= _aidl_self->_aidl_batch_deadline) {\n";
+  out << "    _aidl_self->flushBatchLocked();\n";
+  out << "  }\n";
+  out << "});\n";
+  out.Dedent();
+  out << "}\n";
+  out << "if (_aidl_batch_calls >= " << std::to_string(kMaxBatchedCalls)
+      << " || AParcel_getDataPosition(_aidl_batch.get()) >= " << std::to_string(kMaxBatchBytes)
+      << " ||\n";
+  out << "    " << kBatchTimer << "Clock::now() >= _aidl_batch_deadline) {\n";
+  out << "  _aidl_ret_status = flushBatchLocked();\n";
+  out << "}\n";
+  out << "return ::ndk::ScopedAStatus(AStatus_fromStatus(_aidl_ret_status));\n";
+  // A call that could not be written is dropped from the batch, and the
+  // server reads no further than the number of the calls.
+  out << "_aidl_error:\n";
+  out << "if (_aidl_batch_calls > 0) AParcel_setDataPosition(_aidl_batch.get(), _aidl_start);\n";
+  out << "return ::ndk::ScopedAStatus(AStatus_fromStatus(_aidl_ret_status));\n";
+  out.Dedent();
+  out << "}\n";
+}
+
+// The proxy of an interface with @Batchable methods sends its batch when it
+// is flushed, before each other call, once its first call has waited for
+// BatchTimer::kMaxDelay and when it is destroyed.
+static void GenerateClientBatchFlush(CodeWriter& out, const AidlInterface& defined_type) {
+  const std::string clazz = ClassName(defined_type, ClassNames::CLIENT);
+
+  out << "::ndk::ScopedAStatus " << clazz << "::" << kFlushBatchedCalls << "() {\n";
+  out.Indent();
+  out << "std::lock_guard<std::mutex> _aidl_lock(_aidl_batch_mutex);\n";
+  out << "return ::ndk::ScopedAStatus(AStatus_fromStatus(flushBatchLocked()));\n";
+  out.Dedent();
+  out << "}\n";
+  out << "binder_status_t " << clazz << "::flushBatchLocked() {\n";
+  out.Indent();
+  out << "if (_aidl_batch_calls == 0) return STATUS_OK;\n";
+  out << "const int32_t _aidl_end = AParcel_getDataPosition(_aidl_batch.get());\n";
+  out << "AParcel_setDataPosition(_aidl_batch.get(), _aidl_batch_count_position);\n";
+  out << "AParcel_writeInt32(_aidl_batch.get(), _aidl_batch_calls);\n";
+  out << "AParcel_setDataPosition(_aidl_batch.get(), _aidl_end);\n";
+  out << "_aidl_batch_calls = 0;\n";
+  out << "::ndk::ScopedAParcel _aidl_out;\n";
+  // The transaction takes the batch.
+  out << "return AIBinder_transact(\n";
+  out.Indent();
+  out << "asBinder().get(),\n";
+  out << BatchTransactionId() << ",\n";
+  out << "_aidl_batch.getR(),\n";
+  out << "_aidl_out.getR(),\n";
+  out << "FLAG_ONEWAY\n";
+  out << "#ifdef BINDER_STABILITY_SUPPORT\n";
+  out << "| FLAG_PRIVATE_LOCAL\n";
+  out << "#endif  // BINDER_STABILITY_SUPPORT\n";
+  out << ");\n";
+  out.Dedent();
+  out.Dedent();
+  out << "}\n";
+}
+
 static void GenerateClientMethodDefinition(CodeWriter& out, const AidlTypenames& types,
                                            const AidlInterface& defined_type,
                                            const AidlMethod& method,
                                            const Options& options) {
   const std::string clazz = ClassName(defined_type, ClassNames::CLIENT);
 
-  out << NdkMethodDecl(types, method, clazz) << " {\n";
+  out << NdkMethodDecl(types, defined_type, method, clazz) << " {\n";
   out.Indent();
   out << "binder_status_t _aidl_ret_status = STATUS_OK;\n";
   out << "::ndk::ScopedAStatus _aidl_status;\n";
 
+  std::vector<std::string> cache_key;
+  if (method.GetType().IsCacheable()) {
+    for (const auto& arg : method.GetArguments()) {
+      cache_key.push_back(cpp::BuildVarName(*arg));
+    }
+    out << "const uint64_t " << kCacheGeneration << " = "
+        << ClassName(defined_type, ClassNames::INTERFACE) << "::cacheGeneration.Get();\n";
+    out << "if (" << CacheVarName(method) << ".Get(" << kCacheGeneration << ", std::tie("
+        << android::base::Join(cache_key, ", ") << "), _aidl_return)) {\n";
+    out.Indent();
+    out << "_aidl_status.set(AStatus_fromStatus(_aidl_ret_status));\n"
+        << "return _aidl_status;\n";
+    out.Dedent();
+    out << "}\n";
+  }
+  // The queued calls of the @Batchable methods go before this one.
+  if (method.IsUserDefined() && cpp::HasBatchableMethods(defined_type)) {
+    out << "if (::ndk::ScopedAStatus _aidl_flushed = " << kFlushBatchedCalls << "();\n"
+        << "    !AStatus_isOk(_aidl_flushed.get())) {\n";
+    out << "  return _aidl_flushed;\n";
+    out << "}\n";
+  }
   if (method.GetName() == kGetInterfaceHash && !options.Hash().empty()) {
-    out << "const std::lock_guard<std::mutex> lock(" << kCachedHashMutex << ");\n";
-    out << "if (" << kCachedHash << " != \"-1\") {\n";
+    out << "if (" << kCachedHashState << ".load(std::memory_order_acquire) == 2) {\n";
     out.Indent();
     out << "*_aidl_return = " << kCachedHash << ";\n"
         << "_aidl_status.set(AStatus_fromStatus(_aidl_ret_status));\n"
@@ -309,10 +522,10 @@ static void GenerateClientMethodDefinition(CodeWriter& out, const AidlTypenames&
     out.Dedent();
     out << "}\n";
   } else if (method.GetName() == kGetInterfaceVersion && options.Version() > 0) {
-    out << "if (" << kCachedVersion << " != -1) {\n";
+    out << "*_aidl_return = " << kCachedVersion << ".load(std::memory_order_acquire);\n";
+    out << "if (*_aidl_return != -1) {\n";
     out.Indent();
-    out << "*_aidl_return = " << kCachedVersion << ";\n"
-        << "_aidl_status.set(AStatus_fromStatus(_aidl_ret_status));\n"
+    out << "_aidl_status.set(AStatus_fromStatus(_aidl_ret_status));\n"
         << "return _aidl_status;\n";
     out.Dedent();
     out << "}\n";
@@ -320,28 +533,67 @@ static void GenerateClientMethodDefinition(CodeWriter& out, const AidlTypenames&
   out << "::ndk::ScopedAParcel _aidl_in;\n";
   out << "::ndk::ScopedAParcel _aidl_out;\n";
   out << "\n";
+  if (options.GenPerfettoTraces()) {
+    out << cpp::GenPerfettoTransaction(
+        defined_type, method, "ndkClient", MethodId(method),
+        "_aidl_out.get() == nullptr ? 0 : AParcel_getDataPosition(_aidl_out.get())",
+        "_aidl_ret_status");
+    out << cpp::GenPerfettoPhase("marshal");
+  }
 
   if (options.GenLog()) {
+    SizeScope size(out, "ndk", defined_type, &method, "log");
     out << cpp::GenLogBeforeExecute(ClassName(defined_type, ClassNames::CLIENT), method,
                                     false /* isServer */, true /* isNdk */);
   }
+  if (options.GenBinaryLog()) {
+    SizeScope size(out, "ndk", defined_type, &method, "log");
+    out << cpp::GenBinaryLogBeforeExecute();
+  }
+  if (options.GenStats()) {
+    out << cpp::GenStatsTimer(defined_type, method, ClassName(defined_type, ClassNames::CLIENT));
+  }
+  if (options.GenParcelSizes()) {
+    // The request is handed over to the transaction, so its size is taken before.
+    out << "int32_t _aidl_request_size = 0;\n";
+  }
 
   out << "_aidl_ret_status = AIBinder_prepareTransaction(asBinder().get(), _aidl_in.getR());\n";
   StatusCheckGoto(out);
 
-  for (const auto& arg : method.GetArguments()) {
-    const std::string var_name = cpp::BuildVarName(*arg);
-
-    if (arg->IsIn()) {
-      out << "_aidl_ret_status = ";
-      const std::string prefix = (arg->IsOut() ? "*" : "");
-      WriteToParcelFor({out, types, arg->GetType(), "_aidl_in.get()", prefix + var_name});
-      out << ";\n";
+  const bool with_tables = cpp::MarshalsWithTables(method, options);
+  const auto var_name_of = [](const AidlArgument& arg) { return cpp::BuildVarName(arg); };
+  if (with_tables) {
+    if (const std::string write =
+            cpp::GenMarshalCall(defined_type, method, false /* request */, true /* write */,
+                                true /* is_proxy */, "_aidl_in.get()", var_name_of);
+        !write.empty()) {
+      out << write;
       StatusCheckGoto(out);
-    } else if (arg->IsOut() && arg->GetType().IsArray()) {
-      out << "_aidl_ret_status = ::ndk::AParcel_writeVectorSize(_aidl_in.get(), *" << var_name
-          << ");\n";
     }
+  } else {
+    for (const auto& arg : method.GetArguments()) {
+      const std::string var_name = cpp::BuildVarName(*arg);
+
+      if (arg->IsIn()) {
+        out << "_aidl_ret_status = ";
+        const std::string prefix = (arg->IsOut() ? "*" : "");
+        WriteToParcelFor({out, types, arg->GetType(), "_aidl_in.get()", prefix + var_name});
+        out << ";\n";
+        StatusCheckGoto(out);
+      } else if (arg->IsOut() && arg->GetType().IsArray()) {
+        out << "_aidl_ret_status = ::ndk::AParcel_writeVectorSize(_aidl_in.get(), *" << var_name
+            << ");\n";
+      }
+    }
+  }
+  if (options.GenParcelSizes()) {
+    out << "_aidl_request_size = AParcel_getDataPosition(_aidl_in.get());\n";
+  }
+  if (options.GenPerfettoTraces()) {
+    // The transaction takes the request, so its size is taken before.
+    out << cpp::GenPerfettoRequestBytes("AParcel_getDataPosition(_aidl_in.get())");
+    out << cpp::GenPerfettoPhase("transact");
   }
   out << "_aidl_ret_status = AIBinder_transact(\n";
   out.Indent();
@@ -356,6 +608,10 @@ static void GenerateClientMethodDefinition(CodeWriter& out, const AidlTypenames&
   out << ");\n";
   out.Dedent();
 
+  if (options.GenPerfettoTraces()) {
+    out << cpp::GenPerfettoPhase("unmarshal");
+  }
+
   // If the method is not implmented in the server side but the client has
   // provided the default implementation, call it instead of failing hard.
   const std::string iface = ClassName(defined_type, ClassNames::INTERFACE);
@@ -363,54 +619,102 @@ static void GenerateClientMethodDefinition(CodeWriter& out, const AidlTypenames&
   out << iface << "::getDefaultImpl()) {\n";
   out.Indent();
   out << "return " << iface << "::getDefaultImpl()->" << method.GetName() << "(";
-  out << NdkArgList(types, method, FormatArgNameOnly) << ");\n";
+  out << NdkArgList(types, defined_type, method, FormatArgNameOnly) << ");\n";
   out.Dedent();
   out << "}\n";
 
   StatusCheckGoto(out);
 
   if (!method.IsOneway()) {
-    out << "_aidl_ret_status = AParcel_readStatusHeader(_aidl_out.get(), _aidl_status.getR());\n";
+    out << "_aidl_ret_status = "
+        << "::android::aidl::ReadStatusHeader(_aidl_out.get(), &_aidl_status);\n";
     StatusCheckGoto(out);
 
     out << "if (!AStatus_isOk(_aidl_status.get())) return _aidl_status;\n\n";
   }
 
-  if (method.GetType().GetName() != "void") {
+  if (with_tables) {
+    if (const std::string read =
+            cpp::GenMarshalCall(defined_type, method, true /* reply */, false /* read */,
+                                true /* is_proxy */, "_aidl_out.get()", var_name_of);
+        !read.empty()) {
+      out << read;
+      StatusCheckGoto(out);
+    }
+  } else if (method.GetType().GetName() != "void") {
     out << "_aidl_ret_status = ";
     ReadFromParcelFor({out, types, method.GetType(), "_aidl_out.get()", "_aidl_return"});
     out << ";\n";
     StatusCheckGoto(out);
     if (method.GetName() == kGetInterfaceHash && !options.Hash().empty()) {
+      // Claims the cache, fills it and marks it published. Competing first
+      // calls keep their own copies.
+      out << "{\n";
+      out.Indent();
+      out << "int _aidl_unset = 0;\n";
+      out << "if (" << kCachedHashState << ".compare_exchange_strong(_aidl_unset, 1, "
+          << "std::memory_order_acquire)) {\n";
+      out.Indent();
       out << kCachedHash << " = *_aidl_return;\n";
+      out << kCachedHashState << ".store(2, std::memory_order_release);\n";
+      out.Dedent();
+      out << "}\n";
+      out.Dedent();
+      out << "}\n";
     } else if (method.GetName() == kGetInterfaceVersion && options.Version() > 0) {
-      out << kCachedVersion << " = *_aidl_return;\n";
+      out << kCachedVersion << ".store(*_aidl_return, std::memory_order_release);\n";
     }
   }
-  for (const AidlArgument* arg : method.GetOutArguments()) {
-    out << "_aidl_ret_status = ";
-    ReadFromParcelFor({out, types, arg->GetType(), "_aidl_out.get()", cpp::BuildVarName(*arg)});
-    out << ";\n";
-    StatusCheckGoto(out);
+  if (!with_tables) {
+    for (const AidlArgument* arg : method.GetOutArguments()) {
+      out << "_aidl_ret_status = ";
+      ReadFromParcelFor({out, types, arg->GetType(), "_aidl_out.get()", cpp::BuildVarName(*arg)});
+      out << ";\n";
+      StatusCheckGoto(out);
+    }
+  }
+  if (method.GetType().IsCacheable()) {
+    out << CacheVarName(method) << ".Put(" << kCacheGeneration << ", std::tie("
+        << android::base::Join(cache_key, ", ") << "), *_aidl_return);\n";
   }
 
   out << "_aidl_error:\n";
   out << "_aidl_status.set(AStatus_fromStatus(_aidl_ret_status));\n";
   if (options.GenLog()) {
+    SizeScope size(out, "ndk", defined_type, &method, "log");
     out << cpp::GenLogAfterExecute(ClassName(defined_type, ClassNames::CLIENT), defined_type,
                                    method, "_aidl_status", "_aidl_return", false /* isServer */,
                                    true /* isNdk */);
   }
+  if (options.GenBinaryLog()) {
+    SizeScope size(out, "ndk", defined_type, &method, "log");
+    // The transaction took the request, and the reply is read up to its end
+    // unless it failed.
+    out << cpp::GenBinaryLogAfterExecute(
+        defined_type, method, "_aidl_status", "static_cast<const void*>(this)", "0",
+        "_aidl_out.get() == nullptr ? 0 : AParcel_getDataPosition(_aidl_out.get())",
+        false /* isServer */, true /* isNdk */);
+  }
+  if (options.GenParcelSizes()) {
+    out << cpp::GenStatsRecordSizes(
+        defined_type, method, ClassName(defined_type, ClassNames::CLIENT), "_aidl_request_size",
+        "_aidl_out.get() == nullptr ? 0 : AParcel_getDataPosition(_aidl_out.get())");
+  }
   out << "return _aidl_status;\n";
   out.Dedent();
   out << "}\n";
 }
 
-static void GenerateServerCaseDefinition(CodeWriter& out, const AidlTypenames& types,
-                                         const AidlInterface& defined_type,
-                                         const AidlMethod& method, const Options& options) {
-  out << "case " << MethodId(method) << ": {\n";
-  out.Indent();
+// Writes the handling of a transaction for |method|, which breaks out of the
+// enclosing case or loop once it is done or fails.
+static void GenerateServerTransaction(CodeWriter& out, const AidlTypenames& types,
+                                      const AidlInterface& defined_type, const AidlMethod& method,
+                                      const Options& options) {
+  if (options.GenPerfettoTraces()) {
+    out << cpp::GenPerfettoTransaction(defined_type, method, "ndkServer", MethodId(method),
+                                       "AParcel_getDataPosition(_aidl_out)", "_aidl_ret_status");
+    out << cpp::GenPerfettoPhase("unmarshal");
+  }
   for (const auto& arg : method.GetArguments()) {
     out << NdkNameOf(types, arg->GetType(), StorageMode::STACK) << " " << cpp::BuildVarName(*arg)
         << ";\n";
@@ -420,65 +724,245 @@ static void GenerateServerCaseDefinition(CodeWriter& out, const AidlTypenames& t
   }
   out << "\n";
 
-  for (const auto& arg : method.GetArguments()) {
-    const std::string var_name = cpp::BuildVarName(*arg);
-
-    if (arg->IsIn()) {
-      out << "_aidl_ret_status = ";
-      ReadFromParcelFor({out, types, arg->GetType(), "_aidl_in", "&" + var_name});
-      out << ";\n";
+  // Arguments of a known size are read without a check of each read once
+  // the request is known to hold them, and with the checks otherwise.
+  // With --marshal=tables, a program reads them all instead.
+  const bool with_tables = cpp::MarshalsWithTables(method, options);
+  const auto var_name_of = [](const AidlArgument& arg) { return cpp::BuildVarName(arg); };
+  const size_t fixed_size = with_tables ? 0 : cpp::FixedSizeArgumentsSize(method);
+  if (with_tables) {
+    if (const std::string read =
+            cpp::GenMarshalCall(defined_type, method, false /* request */, false /* read */,
+                                false /* is_proxy */, "_aidl_in", var_name_of);
+        !read.empty()) {
+      out << read;
       StatusCheckBreak(out);
-    } else if (arg->IsOut() && arg->GetType().IsArray()) {
-      out << "_aidl_ret_status = ::ndk::AParcel_resizeVector(_aidl_in, &" << var_name << ");\n";
     }
+  } else if (fixed_size > 0) {
+    out << "if (AParcel_getDataSize(_aidl_in) - AParcel_getDataPosition(_aidl_in) >= "
+        << std::to_string(fixed_size) << ") {\n";
+    out.Indent();
+    for (const auto& arg : method.GetArguments()) {
+      out << "(void)";
+      ReadFromParcelFor({out, types, arg->GetType(), "_aidl_in", "&" + cpp::BuildVarName(*arg)});
+      out << ";\n";
+    }
+    out.Dedent();
+    out << "} else {\n";
+    out.Indent();
+  }
+  if (!with_tables) {
+    for (const auto& arg : method.GetArguments()) {
+      const std::string var_name = cpp::BuildVarName(*arg);
+
+      if (arg->IsIn()) {
+        out << "_aidl_ret_status = ";
+        ReadFromParcelFor({out, types, arg->GetType(), "_aidl_in", "&" + var_name});
+        out << ";\n";
+        StatusCheckBreak(out);
+      } else if (arg->IsOut() && arg->GetType().IsArray()) {
+        out << "_aidl_ret_status = ::ndk::AParcel_resizeVector(_aidl_in, &" << var_name << ");\n";
+      }
+    }
+  }
+  if (fixed_size > 0) {
+    out.Dedent();
+    out << "}\n";
   }
   if (options.GenLog()) {
+    SizeScope size(out, "ndk", defined_type, &method, "log");
     out << cpp::GenLogBeforeExecute(ClassName(defined_type, ClassNames::SERVER), method,
                                     true /* isServer */, true /* isNdk */);
   }
-  out << "::ndk::ScopedAStatus _aidl_status = _aidl_impl->" << method.GetName() << "("
-      << NdkArgList(types, method, FormatArgForCall) << ");\n";
+  if (options.GenBinaryLog()) {
+    SizeScope size(out, "ndk", defined_type, &method, "log");
+    out << cpp::GenCaptureRequest(defined_type, method, MethodId(method), "_aidl_in",
+                                  true /* isNdk */);
+    out << cpp::GenBinaryLogBeforeExecute();
+  }
+  if (options.GenStats()) {
+    // The timer runs until the reply is written.
+    out << cpp::GenStatsTimer(defined_type, method, ClassName(defined_type, ClassNames::SERVER));
+  }
+  if (options.GenPerfettoTraces()) {
+    out << cpp::GenPerfettoRequestBytes("AParcel_getDataPosition(_aidl_in)");
+    out << cpp::GenPerfettoPhase("execute");
+  }
+  const std::string call = "_aidl_impl->" + method.GetName() + "(" +
+                           NdkArgList(types, defined_type, method, FormatArgForCall) + ")";
+  if (method.GetType().IsSingleFlight()) {
+    // Unless a call with equal in arguments is under way, whose status and
+    // result are copied instead
+    std::vector<std::string> key;
+    for (const auto& arg : method.GetArguments()) {
+      key.push_back(cpp::BuildVarName(*arg));
+    }
+    out << "::ndk::ScopedAStatus _aidl_status = _aidl_impl->" << FlightVarName(method)
+        << ".Do(std::tie(" << android::base::Join(key, ", ") << "), "
+        << (method.GetType().GetName() != "void" ? "&_aidl_return" : "nullptr")
+        << ", [&]() { return " << call << "; });\n";
+  } else {
+    out << "::ndk::ScopedAStatus _aidl_status = " << call << ";\n";
+  }
+  if (options.GenPerfettoTraces()) {
+    out << cpp::GenPerfettoPhase("marshal");
+  }
 
   if (options.GenLog()) {
+    SizeScope size(out, "ndk", defined_type, &method, "log");
     out << cpp::GenLogAfterExecute(ClassName(defined_type, ClassNames::SERVER), defined_type,
                                    method, "_aidl_status", "_aidl_return", true /* isServer */,
                                    true /* isNdk */);
   }
+  if (options.GenBinaryLog()) {
+    SizeScope size(out, "ndk", defined_type, &method, "log");
+    // The arguments are read to the end of the request, and the reply is only
+    // written after this.
+    out << cpp::GenBinaryLogAfterExecute(
+        defined_type, method, "_aidl_status", "static_cast<const void*>(_aidl_impl.get())",
+        "AParcel_getDataPosition(_aidl_in)", "0", true /* isServer */, true /* isNdk */);
+  }
   if (method.IsOneway()) {
     // For a oneway transaction, the kernel will have already returned a result. This is for the
     // in-process case when a oneway transaction is parceled/unparceled in the same process.
     out << "_aidl_ret_status = STATUS_OK;\n";
   } else {
-    out << "_aidl_ret_status = AParcel_writeStatusHeader(_aidl_out, _aidl_status.get());\n";
+    out << "_aidl_ret_status = "
+        << "::android::aidl::WriteStatusHeader(_aidl_out, _aidl_status.get());\n";
     StatusCheckBreak(out);
 
     out << "if (!AStatus_isOk(_aidl_status.get())) break;\n\n";
 
-    if (method.GetType().GetName() != "void") {
-      out << "_aidl_ret_status = ";
-      WriteToParcelFor({out, types, method.GetType(), "_aidl_out", "_aidl_return"});
-      out << ";\n";
-      StatusCheckBreak(out);
+    if (with_tables) {
+      if (const std::string write =
+              cpp::GenMarshalCall(defined_type, method, true /* reply */, true /* write */,
+                                  false /* is_proxy */, "_aidl_out", var_name_of);
+          !write.empty()) {
+        out << write;
+        StatusCheckBreak(out);
+      }
+    } else {
+      if (method.GetType().GetName() != "void") {
+        out << "_aidl_ret_status = ";
+        WriteToParcelFor({out, types, method.GetType(), "_aidl_out", "_aidl_return"});
+        out << ";\n";
+        StatusCheckBreak(out);
+      }
+      for (const AidlArgument* arg : method.GetOutArguments()) {
+        out << "_aidl_ret_status = ";
+        WriteToParcelFor({out, types, arg->GetType(), "_aidl_out", cpp::BuildVarName(*arg)});
+        out << ";\n";
+        StatusCheckBreak(out);
+      }
     }
-    for (const AidlArgument* arg : method.GetOutArguments()) {
-      out << "_aidl_ret_status = ";
-      WriteToParcelFor({out, types, arg->GetType(), "_aidl_out", cpp::BuildVarName(*arg)});
-      out << ";\n";
-      StatusCheckBreak(out);
+  }
+  if (options.GenParcelSizes()) {
+    out << cpp::GenStatsRecordSizes(defined_type, method,
+                                    ClassName(defined_type, ClassNames::SERVER),
+                                    "AParcel_getDataPosition(_aidl_in)",
+                                    "AParcel_getDataPosition(_aidl_out)");
+  }
+  out << "break;\n";
+}
+
+static void GenerateServerCaseDefinition(CodeWriter& out, const AidlTypenames& types,
+                                         const AidlInterface& defined_type,
+                                         const AidlMethod& method, const Options& options) {
+  SizeScope size(out, "ndk", defined_type, &method, "stub");
+  out << "case " << MethodId(method) << ": {\n";
+  out.Indent();
+  GenerateServerTransaction(out, types, defined_type, method, options);
+  out.Dedent();
+  out << "}\n";
+}
+
+// A batch of @Batchable calls is handled call by call, until one fails. The
+// interface token of the batch has been checked before.
+static void GenerateServerBatchCase(CodeWriter& out, const AidlTypenames& types,
+                                    const AidlInterface& defined_type, const Options& options) {
+  out << "case " << BatchTransactionId() << ": {\n";
+  out.Indent();
+  out << "int32_t _aidl_batch_calls = 0;\n";
+  out << "_aidl_ret_status = AParcel_readInt32(_aidl_in, &_aidl_batch_calls);\n";
+  out << "for (int32_t _aidl_i = 0; _aidl_ret_status == STATUS_OK && _aidl_i < _aidl_batch_calls; "
+         "++_aidl_i) {\n";
+  out.Indent();
+  out << "uint32_t _aidl_batch_code = 0;\n";
+  out << "_aidl_ret_status = AParcel_readUint32(_aidl_in, &_aidl_batch_code);\n";
+  StatusCheckBreak(out);
+  out << "switch (_aidl_batch_code) {\n";
+  out.Indent();
+  for (const auto& method : defined_type.GetMethods()) {
+    if (method->GetType().IsBatchable()) {
+      GenerateServerCaseDefinition(out, types, defined_type, *method, options);
     }
   }
+  out << "default:\n";
+  out << "  _aidl_ret_status = STATUS_BAD_VALUE;\n";
+  out << "  break;\n";
+  out.Dedent();
+  out << "}\n";
+  out.Dedent();
+  out << "}\n";
   out << "break;\n";
   out.Dedent();
   out << "}\n";
 }
 
+// The static functions of the sources are named after their interfaces, so
+// that the sources of a package can be compiled in one unity source.
+static std::string ClazzName(const AidlInterface& defined_type) {
+  return "_g_aidl_" + ClassName(defined_type, ClassNames::INTERFACE) + "_clazz";
+}
+
+static std::string OnTransactName(const AidlInterface& defined_type) {
+  return "_aidl_" + ClassName(defined_type, ClassNames::INTERFACE) + "_onTransact";
+}
+
+static std::string TransactionHandlerName(const AidlInterface& defined_type,
+                                          const AidlMethod& method) {
+  return OnTransactName(defined_type) + "_" + method.GetName();
+}
+
+static std::string TransactionHandlerArgs(const AidlInterface& defined_type) {
+  return "(const std::shared_ptr<" + ClassName(defined_type, ClassNames::SERVER) +
+         ">& _aidl_impl, const AParcel* _aidl_in, AParcel* _aidl_out)";
+}
+
+// Writes the function that handles |method| in a table of transaction handlers
+static void GenerateServerTransactionHandler(CodeWriter& out, const AidlTypenames& types,
+                                             const AidlInterface& defined_type,
+                                             const AidlMethod& method, const Options& options) {
+  SizeScope size(out, "ndk", defined_type, &method, "stub");
+  out << "static binder_status_t " << TransactionHandlerName(defined_type, method)
+      << TransactionHandlerArgs(defined_type) << " {\n";
+  out.Indent();
+  out << "(void)_aidl_in;\n";
+  out << "(void)_aidl_out;\n";
+  out << "binder_status_t _aidl_ret_status = STATUS_UNKNOWN_TRANSACTION;\n";
+  out << "do {\n";
+  out.Indent();
+  GenerateServerTransaction(out, types, defined_type, method, options);
+  out.Dedent();
+  out << "} while (false);\n";
+  out << "return _aidl_ret_status;\n";
+  out.Dedent();
+  out << "}\n\n";
+}
+
 void GenerateClassSource(CodeWriter& out, const AidlTypenames& types,
                          const AidlInterface& defined_type, const Options& options) {
   const std::string clazz = ClassName(defined_type, ClassNames::INTERFACE);
   const std::string bn_clazz = ClassName(defined_type, ClassNames::SERVER);
 
-  out << "static binder_status_t "
-      << "_aidl_onTransact"
+  const std::vector<const AidlMethod*> table = cpp::TransactionTable(defined_type, options);
+  for (const AidlMethod* method : table) {
+    if (method != nullptr) {
+      GenerateServerTransactionHandler(out, types, defined_type, *method, options);
+    }
+  }
+
+  out << "static binder_status_t " << OnTransactName(defined_type)
       << "(AIBinder* _aidl_binder, transaction_code_t _aidl_code, const AParcel* _aidl_in, "
          "AParcel* _aidl_out) {\n";
   out.Indent();
@@ -490,13 +974,50 @@ void GenerateClassSource(CodeWriter& out, const AidlTypenames& types,
     // AIBinder_Class object which is associated with this class.
     out << "std::shared_ptr<" << bn_clazz << "> _aidl_impl = std::static_pointer_cast<" << bn_clazz
         << ">(::ndk::ICInterface::asInterface(_aidl_binder));\n";
-    out << "switch (_aidl_code) {\n";
-    out.Indent();
+    std::vector<const AidlMethod*> cases;
     for (const auto& method : defined_type.GetMethods()) {
-      GenerateServerCaseDefinition(out, types, defined_type, *method, options);
+      if (table.empty() || !method->IsUserDefined()) {
+        cases.push_back(method.get());
+      }
+    }
+    const bool has_cases = !cases.empty() || cpp::HasBatchableMethods(defined_type);
+    if (!table.empty()) {
+      out << "using _aidl_handler = binder_status_t (*)" << TransactionHandlerArgs(defined_type)
+          << ";\n";
+      out << "static constexpr _aidl_handler _aidl_handlers[] = {\n";
+      out.Indent();
+      for (const AidlMethod* method : table) {
+        out << (method != nullptr ? "&" + TransactionHandlerName(defined_type, *method)
+                                  : "nullptr")
+            << ",\n";
+      }
+      out.Dedent();
+      out << "};\n";
+      out << "if (const transaction_code_t _aidl_index = _aidl_code - FIRST_CALL_TRANSACTION;\n"
+          << "    _aidl_index < " << std::to_string(table.size())
+          << " && _aidl_handlers[_aidl_index] != nullptr) {\n";
+      out.Indent();
+      out << "_aidl_ret_status = _aidl_handlers[_aidl_index](_aidl_impl, _aidl_in, _aidl_out);\n";
+      out.Dedent();
+      out << (has_cases ? "} else {\n" : "}\n");
+      out.Indent();
+    }
+    if (has_cases) {
+      out << "switch (_aidl_code) {\n";
+      out.Indent();
+      for (const AidlMethod* method : cases) {
+        GenerateServerCaseDefinition(out, types, defined_type, *method, options);
+      }
+      if (cpp::HasBatchableMethods(defined_type)) {
+        GenerateServerBatchCase(out, types, defined_type, options);
+      }
+      out.Dedent();
+      out << "}\n";
+    }
+    if (!table.empty()) {
+      out.Dedent();
+      if (has_cases) out << "}\n";
     }
-    out.Dedent();
-    out << "}\n";
   } else {
     out << "(void)_aidl_binder;\n";
     out << "(void)_aidl_code;\n";
@@ -505,21 +1026,43 @@ void GenerateClassSource(CodeWriter& out, const AidlTypenames& types,
   out.Dedent();
   out << "}\n\n";
 
-  out << "static AIBinder_Class* " << kClazz << " = ::ndk::ICInterface::defineClass(" << clazz
-      << "::" << kDescriptor << ", _aidl_onTransact);\n\n";
+  // The class is defined on its first use rather than by a static initializer,
+  // so that loading a library costs nothing for the interfaces that the
+  // process does not use.
+  out << "static AIBinder_Class* " << ClazzName(defined_type) << "() {\n";
+  out.Indent();
+  out << "static AIBinder_Class* _aidl_clazz = ::ndk::ICInterface::defineClass(" << clazz
+      << "::" << kDescriptor << ", " << OnTransactName(defined_type) << ");\n";
+  out << "return _aidl_clazz;\n";
+  out.Dedent();
+  out << "}\n\n";
 }
 void GenerateClientSource(CodeWriter& out, const AidlTypenames& types,
                           const AidlInterface& defined_type, const Options& options) {
   const std::string clazz = ClassName(defined_type, ClassNames::CLIENT);
 
   out << clazz << "::" << clazz << "(const ::ndk::SpAIBinder& binder) : BpCInterface(binder) {}\n";
-  out << clazz << "::~" << clazz << "() {}\n";
+  if (cpp::HasBatchableMethods(defined_type)) {
+    out << clazz << "::~" << clazz << "() {\n";
+    out << "  " << kFlushBatchedCalls << "();\n";
+    out << "}\n";
+  } else {
+    out << clazz << "::~" << clazz << "() {}\n";
+  }
   if (options.GenLog()) {
     out << "std::function<void(const Json::Value&)> " << clazz << "::logFunc;\n";
   }
   out << "\n";
+  if (cpp::HasBatchableMethods(defined_type)) {
+    GenerateClientBatchFlush(out, defined_type);
+  }
   for (const auto& method : defined_type.GetMethods()) {
-    GenerateClientMethodDefinition(out, types, defined_type, *method, options);
+    if (method->GetType().IsBatchable()) {
+      GenerateClientBatchedMethodDefinition(out, types, defined_type, *method);
+    } else {
+      SizeScope size(out, "ndk", defined_type, method.get(), "proxy");
+      GenerateClientMethodDefinition(out, types, defined_type, *method, options);
+    }
   }
 }
 void GenerateServerSource(CodeWriter& out, const AidlTypenames& types,
@@ -535,7 +1078,8 @@ void GenerateServerSource(CodeWriter& out, const AidlTypenames& types,
   }
   out << "::ndk::SpAIBinder " << clazz << "::createBinder() {\n";
   out.Indent();
-  out << "AIBinder* binder = AIBinder_new(" << kClazz << ", static_cast<void*>(this));\n";
+  out << "AIBinder* binder = AIBinder_new(" << ClazzName(defined_type)
+      << "(), static_cast<void*>(this));\n";
 
   out << "#ifdef BINDER_STABILITY_SUPPORT\n";
   if (defined_type.IsVintfStability()) {
@@ -555,7 +1099,7 @@ void GenerateServerSource(CodeWriter& out, const AidlTypenames& types,
       continue;
     }
     if (method->GetName() == kGetInterfaceVersion && options.Version() > 0) {
-      out << NdkMethodDecl(types, *method, clazz) << " {\n";
+      out << NdkMethodDecl(types, defined_type, *method, clazz) << " {\n";
       out.Indent();
       out << "*_aidl_return = " << iface << "::" << kVersion << ";\n";
       out << "return ::ndk::ScopedAStatus(AStatus_newOk());\n";
@@ -563,7 +1107,7 @@ void GenerateServerSource(CodeWriter& out, const AidlTypenames& types,
       out << "}\n";
     }
     if (method->GetName() == kGetInterfaceHash && !options.Hash().empty()) {
-      out << NdkMethodDecl(types, *method, clazz) << " {\n";
+      out << NdkMethodDecl(types, defined_type, *method, clazz) << " {\n";
       out.Indent();
       out << "*_aidl_return = " << iface << "::" << kHash << ";\n";
       out << "return ::ndk::ScopedAStatus(AStatus_newOk());\n";
@@ -572,6 +1116,155 @@ void GenerateServerSource(CodeWriter& out, const AidlTypenames& types,
     }
   }
 }
+// The future of the asynchronous variant of |method|: the status of its
+// call, with the return value unless it is void
+static std::string AsyncFutureType(const AidlTypenames& types, const AidlMethod& method) {
+  if (method.GetType().GetName() == "void") {
+    return "std::future<::ndk::ScopedAStatus>";
+  }
+  return "std::future<::android::aidl::AsyncResult<::ndk::ScopedAStatus, " +
+         NdkNameOf(types, method.GetType(), StorageMode::STACK) + ">>";
+}
+
+// The asynchronous variant of |method| takes its arguments by value, so that
+// they live until its call runs on the executor
+static std::string AsyncArgList(const AidlTypenames& types, const AidlMethod& method) {
+  std::vector<std::string> arguments;
+  for (const auto& a : method.GetArguments()) {
+    arguments.push_back(NdkNameOf(types, a->GetType(), StorageMode::STACK) + " " +
+                        cpp::BuildVarName(*a));
+  }
+  return android::base::Join(arguments, ", ");
+}
+
+static std::string AsyncMethodDecl(const AidlTypenames& types, const AidlMethod& method,
+                                   const std::string& clazz = "") {
+  return AsyncFutureType(types, method) + " " + (clazz.empty() ? "" : clazz + "::") +
+         cpp::AsyncMethodName(method) + "(" + AsyncArgList(types, method) + ")";
+}
+
+// The asynchronous variant of |method| runs the blocking call on the threads
+// of the executor of the process, holding a reference to the interface and
+// its arguments until then.
+static void GenerateAsyncMethodDefinition(CodeWriter& out, const AidlTypenames& types,
+                                          const AidlInterface& defined_type,
+                                          const AidlMethod& method) {
+  const std::string clazz = ClassName(defined_type, ClassNames::INTERFACE);
+  std::vector<std::string> captures{"_aidl_self"};
+  for (const auto& a : method.GetArguments()) {
+    const std::string name = cpp::BuildVarName(*a);
+    const bool is_cheap = NdkNameOf(types, a->GetType(), StorageMode::ARGUMENT) ==
+                          NdkNameOf(types, a->GetType(), StorageMode::STACK);
+    captures.push_back(is_cheap ? name : name + " = std::move(" + name + ")");
+  }
+  const std::string call_arguments = NdkArgList(
+      types, defined_type, method,
+      [](const std::string& type, const std::string& name, bool isOut) {
+        return isOut ? std::string("&_aidl_result.value") : FormatArgNameOnly(type, name, isOut);
+      });
+
+  out << AsyncMethodDecl(types, method, clazz) << " {\n";
+  out.Indent();
+  out << "std::shared_ptr<" << clazz << "> _aidl_self = ref<" << clazz << ">();\n";
+  out << "return ::android::aidl::AsyncExecutor::Default().Submit(\n";
+  out << "    [" << android::base::Join(captures, ", ") << "]() mutable {\n";
+  out.Indent();
+  out.Indent();
+  out.Indent();
+  if (method.GetType().GetName() == "void") {
+    out << "return _aidl_self->" << method.GetName() << "(" << call_arguments << ");\n";
+  } else {
+    out << "::android::aidl::AsyncResult<::ndk::ScopedAStatus, "
+        << NdkNameOf(types, method.GetType(), StorageMode::STACK) << "> _aidl_result;\n";
+    out << "_aidl_result.status = _aidl_self->" << method.GetName() << "(" << call_arguments
+        << ");\n";
+    out << "return _aidl_result;\n";
+  }
+  out.Dedent();
+  out.Dedent();
+  out.Dedent();
+  out << "    });\n";
+  out.Dedent();
+  out << "}\n";
+}
+
+// A lazy proxy gets its service on its first call, and forgets it when it
+// dies. The calls fail with STATUS_NAME_NOT_FOUND while there is no service.
+static void GenerateLazyClassDefinition(CodeWriter& out, const AidlTypenames& types,
+                                        const AidlInterface& defined_type) {
+  const std::string clazz = ClassName(defined_type, ClassNames::INTERFACE);
+  const std::string lazy_clazz = clazz + "Lazy";
+
+  out << lazy_clazz << "::" << lazy_clazz << "(const std::string& name)\n"
+      << "    : name_(name), death_recipient_(AIBinder_DeathRecipient_new(onBinderDied)) {}\n";
+  out << lazy_clazz << "::~" << lazy_clazz << "() {\n";
+  out.Indent();
+  out << "if (service_ != nullptr) {\n";
+  out << "  AIBinder_unlinkToDeath(service_->asBinder().get(), death_recipient_.get(), this);\n";
+  out << "}\n";
+  out.Dedent();
+  out << "}\n";
+  out << "std::shared_ptr<" << clazz << "> " << lazy_clazz << "::getService() {\n";
+  out.Indent();
+  out << "std::lock_guard<std::mutex> _aidl_lock(mutex_);\n";
+  out << "if (service_ == nullptr) {\n";
+  out.Indent();
+  out << "::ndk::SpAIBinder _aidl_binder(AServiceManager_getService(name_.c_str()));\n";
+  out << "if (_aidl_binder.get() != nullptr) {\n";
+  out << "  service_ = " << clazz << "::fromBinder(_aidl_binder);\n";
+  out << "}\n";
+  out << "if (service_ != nullptr) {\n";
+  out << "  AIBinder_linkToDeath(_aidl_binder.get(), death_recipient_.get(), this);\n";
+  out << "}\n";
+  out.Dedent();
+  out << "}\n";
+  out << "return service_;\n";
+  out.Dedent();
+  out << "}\n";
+  out << "void " << lazy_clazz << "::onBinderDied(void* cookie) {\n";
+  out.Indent();
+  out << lazy_clazz << "* _aidl_self = static_cast<" << lazy_clazz << "*>(cookie);\n";
+  out << "std::lock_guard<std::mutex> _aidl_lock(_aidl_self->mutex_);\n";
+  out << "_aidl_self->service_ = nullptr;\n";
+  out.Dedent();
+  out << "}\n";
+
+  for (const auto& method : defined_type.GetMethods()) {
+    out << NdkMethodDecl(types, defined_type, *method, lazy_clazz) << " {\n";
+    out.Indent();
+    out << "std::shared_ptr<" << clazz << "> _aidl_service = getService();\n";
+    out << "if (_aidl_service == nullptr) {\n";
+    out << "  return ::ndk::ScopedAStatus(AStatus_fromStatus(STATUS_NAME_NOT_FOUND));\n";
+    out << "}\n";
+    out << "return _aidl_service->" << method->GetName() << "("
+        << NdkArgList(types, defined_type, *method, FormatArgNameOnly) << ");\n";
+    out.Dedent();
+    out << "}\n";
+  }
+  if (cpp::HasBatchableMethods(defined_type)) {
+    out << "::ndk::ScopedAStatus " << lazy_clazz << "::" << kFlushBatchedCalls << "() {\n";
+    out.Indent();
+    out << "std::shared_ptr<" << clazz << "> _aidl_service = getService();\n";
+    out << "if (_aidl_service == nullptr) {\n";
+    out << "  return ::ndk::ScopedAStatus(AStatus_fromStatus(STATUS_NAME_NOT_FOUND));\n";
+    out << "}\n";
+    out << "return _aidl_service->" << kFlushBatchedCalls << "();\n";
+    out.Dedent();
+    out << "}\n";
+  }
+  out << "::ndk::SpAIBinder " << lazy_clazz << "::asBinder() {\n";
+  out.Indent();
+  out << "std::shared_ptr<" << clazz << "> _aidl_service = getService();\n";
+  out << "return _aidl_service != nullptr ? _aidl_service->asBinder() : ::ndk::SpAIBinder();\n";
+  out.Dedent();
+  out << "}\n";
+  out << "bool " << lazy_clazz << "::isRemote() {\n";
+  out.Indent();
+  out << "return true;\n";
+  out.Dedent();
+  out << "}\n";
+}
+
 void GenerateInterfaceSource(CodeWriter& out, const AidlTypenames& types,
                              const AidlInterface& defined_type, const Options& options) {
   const std::string clazz = ClassName(defined_type, ClassNames::INTERFACE);
@@ -589,7 +1282,8 @@ void GenerateInterfaceSource(CodeWriter& out, const AidlTypenames& types,
   out << "std::shared_ptr<" << clazz << "> " << clazz
       << "::fromBinder(const ::ndk::SpAIBinder& binder) {\n";
   out.Indent();
-  out << "if (!AIBinder_associateClass(binder.get(), " << kClazz << ")) { return nullptr; }\n";
+  out << "if (!AIBinder_associateClass(binder.get(), " << ClazzName(defined_type)
+      << "())) { return nullptr; }\n";
   out << "std::shared_ptr<::ndk::ICInterface> interface = "
          "::ndk::ICInterface::asInterface(binder.get());\n";
   out << "if (interface) {\n";
@@ -646,13 +1340,27 @@ void GenerateInterfaceSource(CodeWriter& out, const AidlTypenames& types,
 
   // definition for the static field default_impl
   out << "std::shared_ptr<" << clazz << "> " << clazz << "::default_impl = nullptr;\n";
+  if (cpp::HasCacheableMethods(defined_type)) {
+    out << "::android::aidl::CacheGeneration " << clazz << "::cacheGeneration;\n";
+  }
+  if (options.GenWireSchema()) {
+    out << cpp::GenWireSchemaDefinition(defined_type, types, clazz);
+  }
+  if (options.GenAsync()) {
+    for (const auto& method : defined_type.GetMethods()) {
+      if (cpp::HasAsyncVariant(*method)) {
+        GenerateAsyncMethodDefinition(out, types, defined_type, *method);
+      }
+    }
+  }
 
   // default implementation for the <Name>Default class members
   const std::string defaultClazz = clazz + "Default";
   for (const auto& method : defined_type.GetMethods()) {
     if (method->IsUserDefined()) {
+      SizeScope size(out, "ndk", defined_type, method.get(), "default_impl");
       out << "::ndk::ScopedAStatus " << defaultClazz << "::" << method->GetName() << "("
-          << NdkArgList(types, *method, FormatArgNameUnused) << ") {\n";
+          << NdkArgList(types, defined_type, *method, FormatArgNameUnused) << ") {\n";
       out.Indent();
       out << "::ndk::ScopedAStatus _aidl_status;\n";
       out << "_aidl_status.set(AStatus_fromStatus(STATUS_UNKNOWN_TRANSACTION));\n";
@@ -692,6 +1400,10 @@ void GenerateInterfaceSource(CodeWriter& out, const AidlTypenames& types,
   out << "return false;\n";
   out.Dedent();
   out << "}\n";
+
+  if (options.GenLazyProxy()) {
+    GenerateLazyClassDefinition(out, types, defined_type);
+  }
 }
 
 void GenerateClientHeader(CodeWriter& out, const AidlTypenames& types,
@@ -703,12 +1415,26 @@ void GenerateClientHeader(CodeWriter& out, const AidlTypenames& types,
       << "\"\n";
   out << "\n";
   out << "#include <android/binder_ibinder.h>\n";
+  if (options.Version() > 0 || !options.Hash().empty()) {
+    out << "#include <atomic>\n";
+  }
   if (options.GenLog()) {
     out << "#include <json/value.h>\n";
     out << "#include <functional>\n";
     out << "#include <chrono>\n";
     out << "#include <sstream>\n";
   }
+  if (options.GenStats()) {
+    out << "#include <aidl/transaction_stats.h>\n";
+  }
+  if (cpp::HasCacheableMethods(defined_type)) {
+    out << "#include <aidl/result_cache.h>\n";
+    out << "#include <tuple>\n";
+  }
+  if (cpp::HasBatchableMethods(defined_type)) {
+    out << "#include <aidl/batch_timer.h>\n";
+    out << "#include <mutex>\n";
+  }
   out << "\n";
   EnterNdkNamespace(out, defined_type);
   out << "class " << clazz << " : public ::ndk::BpCInterface<"
@@ -719,20 +1445,47 @@ void GenerateClientHeader(CodeWriter& out, const AidlTypenames& types,
   out << "virtual ~" << clazz << "();\n";
   out << "\n";
   for (const auto& method : defined_type.GetMethods()) {
-    out << NdkMethodDecl(types, *method) << " override;\n";
+    out << NdkMethodDecl(types, defined_type, *method) << " override;\n";
+  }
+  if (cpp::HasBatchableMethods(defined_type)) {
+    // The queued calls of the @Batchable methods, which share one transaction
+    out << "::ndk::ScopedAStatus " << kFlushBatchedCalls << "() override;\n";
+    out << "binder_status_t flushBatchLocked();\n";
+    out << "std::mutex _aidl_batch_mutex;\n";
+    out << "::ndk::ScopedAParcel _aidl_batch;\n";
+    out << "int32_t _aidl_batch_calls = 0;\n";
+    out << "int32_t _aidl_batch_count_position = 0;\n";
+    out << kBatchTimer << "Clock::time_point _aidl_batch_deadline;\n";
   }
 
   if (options.Version() > 0) {
-    out << "int32_t " << kCachedVersion << " = -1;\n";
+    out << "std::atomic<int32_t> " << kCachedVersion << "{-1};\n";
   }
 
   if (!options.Hash().empty()) {
-    out << "std::string " << kCachedHash << " = \"-1\";\n";
-    out << "std::mutex " << kCachedHashMutex << ";\n";
+    // 0 while unset, 1 while the hash is being filled and 2 once it is published
+    out << "std::atomic<int> " << kCachedHashState << "{0};\n";
+    out << "std::string " << kCachedHash << ";\n";
+  }
+  for (const auto& method : defined_type.GetMethods()) {
+    if (!method->GetType().IsCacheable()) continue;
+    std::vector<std::string> key_types;
+    for (const auto& arg : method->GetArguments()) {
+      key_types.push_back(NdkNameOf(types, arg->GetType(), StorageMode::STACK));
+    }
+    out << "::android::aidl::ResultCache<std::tuple<" << android::base::Join(key_types, ", ")
+        << ">, " << NdkNameOf(types, method->GetType(), StorageMode::STACK) << "> "
+        << CacheVarName(*method) << ";\n";
   }
   if (options.GenLog()) {
     out << "static std::function<void(const Json::Value&)> logFunc;\n";
   }
+  if (options.GenStats()) {
+    out << kGetTransactionStatsDecl;
+  }
+  if (options.GenTransactionNames()) {
+    out << cpp::GenTransactionNamesDecl(defined_type, options, "FIRST_CALL_TRANSACTION");
+  }
   out.Dedent();
   out << "};\n";
   LeaveNdkNamespace(out, defined_type);
@@ -747,6 +1500,13 @@ void GenerateServerHeader(CodeWriter& out, const AidlTypenames& types,
       << "\"\n";
   out << "\n";
   out << "#include <android/binder_ibinder.h>\n";
+  if (options.GenStats()) {
+    out << "#include <aidl/transaction_stats.h>\n";
+  }
+  if (cpp::HasSingleFlightMethods(defined_type)) {
+    out << "#include <aidl/single_flight_ndk.h>\n";
+    out << "#include <tuple>\n";
+  }
   out << "\n";
   EnterNdkNamespace(out, defined_type);
   out << "class " << clazz << " : public ::ndk::BnCInterface<" << iface << "> {\n";
@@ -761,9 +1521,9 @@ void GenerateServerHeader(CodeWriter& out, const AidlTypenames& types,
       continue;
     }
     if (method->GetName() == kGetInterfaceVersion && options.Version() > 0) {
-      out << NdkMethodDecl(types, *method) << " final override;\n";
+      out << NdkMethodDecl(types, defined_type, *method) << " final override;\n";
     } else if (method->GetName() == kGetInterfaceHash && !options.Hash().empty()) {
-      out << NdkMethodDecl(types, *method) << " final override;\n";
+      out << NdkMethodDecl(types, defined_type, *method) << " final override;\n";
     } else {
       AIDL_FATAL(defined_type) << "Meta method '" << method->GetName() << "' is unimplemented.";
     }
@@ -771,6 +1531,26 @@ void GenerateServerHeader(CodeWriter& out, const AidlTypenames& types,
   if (options.GenLog()) {
     out << "static std::function<void(const Json::Value&)> logFunc;\n";
   }
+  if (options.GenStats()) {
+    out << kGetTransactionStatsDecl;
+  }
+  if (options.GenTransactionNames()) {
+    out << cpp::GenTransactionNamesDecl(defined_type, options, "FIRST_CALL_TRANSACTION");
+  }
+  // The calls in flight, public since the onTransact of the stub is not a member
+  for (const auto& method : defined_type.GetMethods()) {
+    if (!method->GetType().IsSingleFlight()) continue;
+    std::vector<std::string> key_types;
+    for (const auto& arg : method->GetArguments()) {
+      key_types.push_back(NdkNameOf(types, arg->GetType(), StorageMode::STACK));
+    }
+    out << "::android::aidl::SingleFlight<std::tuple<" << android::base::Join(key_types, ", ")
+        << ">, ::ndk::ScopedAStatus";
+    if (method->GetType().GetName() != "void") {
+      out << ", " << NdkNameOf(types, method->GetType(), StorageMode::STACK);
+    }
+    out << "> " << FlightVarName(*method) << ";\n";
+  }
   out.Dedent();
   out << "protected:\n";
   out.Indent();
@@ -788,6 +1568,19 @@ void GenerateInterfaceHeader(CodeWriter& out, const AidlTypenames& types,
 
   out << "#pragma once\n\n";
   out << "#include <android/binder_interface_utils.h>\n";
+  if (cpp::HasCacheableMethods(defined_type)) {
+    out << "#include <aidl/result_cache.h>\n";
+  }
+  if (options.GenAsync() && cpp::HasAsyncVariants(defined_type)) {
+    out << "#include <aidl/async_executor.h>\n";
+    out << "#include <future>\n";
+  }
+  if (options.GenLazyProxy()) {
+    out << "#include <mutex>\n";
+  }
+  if (options.GenWireSchema()) {
+    out << "#include <string_view>\n";
+  }
   if (options.GenLog()) {
     out << "#include <json/value.h>\n";
     out << "#include <functional>\n";
@@ -827,8 +1620,29 @@ void GenerateInterfaceHeader(CodeWriter& out, const AidlTypenames& types,
   out << "\n";
   out << "static const std::shared_ptr<" << clazz << ">& getDefaultImpl();";
   out << "\n";
+  if (options.GenWireSchema()) {
+    out << "static ::std::string_view getWireSchema();\n";
+  }
+  if (cpp::HasCacheableMethods(defined_type)) {
+    // The proxies only return the results that they cached in the current
+    // generation, which invalidateCaches() ends.
+    out << "static ::android::aidl::CacheGeneration cacheGeneration;\n";
+    out << "static void invalidateCaches() { cacheGeneration.Invalidate(); }\n";
+  }
+  if (cpp::HasBatchableMethods(defined_type)) {
+    // Sends the calls of the @Batchable methods that the proxy has queued
+    out << "virtual ::ndk::ScopedAStatus " << kFlushBatchedCalls
+        << "() { return ::ndk::ScopedAStatus::ok(); }\n";
+  }
   for (const auto& method : defined_type.GetMethods()) {
-    out << "virtual " << NdkMethodDecl(types, *method) << " = 0;\n";
+    out << "virtual " << NdkMethodDecl(types, defined_type, *method) << " = 0;\n";
+  }
+  if (options.GenAsync()) {
+    for (const auto& method : defined_type.GetMethods()) {
+      if (cpp::HasAsyncVariant(*method)) {
+        out << AsyncMethodDecl(types, *method) << ";\n";
+      }
+    }
   }
   out.Dedent();
   out << "private:\n";
@@ -844,11 +1658,11 @@ void GenerateInterfaceHeader(CodeWriter& out, const AidlTypenames& types,
   out.Indent();
   for (const auto& method : defined_type.GetMethods()) {
     if (method->IsUserDefined()) {
-      out << NdkMethodDecl(types, *method) << " override;\n";
+      out << NdkMethodDecl(types, defined_type, *method) << " override;\n";
     } else if (method->GetName() == kGetInterfaceVersion && options.Version() > 0) {
-      out << NdkMethodDecl(types, *method) << " override;\n";
+      out << NdkMethodDecl(types, defined_type, *method) << " override;\n";
     } else if (method->GetName() == kGetInterfaceHash && !options.Hash().empty()) {
-      out << NdkMethodDecl(types, *method) << " override;\n";
+      out << NdkMethodDecl(types, defined_type, *method) << " override;\n";
     }
   }
   out << "::ndk::SpAIBinder asBinder() override;\n";
@@ -856,11 +1670,40 @@ void GenerateInterfaceHeader(CodeWriter& out, const AidlTypenames& types,
   out.Dedent();
   out << "};\n";
 
+  if (options.GenLazyProxy()) {
+    // Create with ::ndk::SharedRefBase::make<IFooLazy>(name)
+    const std::string lazyClazz = clazz + "Lazy";
+    out << "class " << lazyClazz << " : public " << clazz << " {\n";
+    out << "public:\n";
+    out.Indent();
+    out << "explicit " << lazyClazz << "(const std::string& name);\n";
+    out << "~" << lazyClazz << "();\n";
+    for (const auto& method : defined_type.GetMethods()) {
+      out << NdkMethodDecl(types, defined_type, *method) << " override;\n";
+    }
+    if (cpp::HasBatchableMethods(defined_type)) {
+      out << "::ndk::ScopedAStatus " << kFlushBatchedCalls << "() override;\n";
+    }
+    out << "::ndk::SpAIBinder asBinder() override;\n";
+    out << "bool isRemote() override;\n";
+    out.Dedent();
+    out << "private:\n";
+    out.Indent();
+    out << "std::shared_ptr<" << clazz << "> getService();\n";
+    out << "static void onBinderDied(void* cookie);\n";
+    out << "const std::string name_;\n";
+    out << "std::mutex mutex_;\n";
+    out << "std::shared_ptr<" << clazz << "> service_;\n";
+    out << "::ndk::ScopedAIBinder_DeathRecipient death_recipient_;\n";
+    out.Dedent();
+    out << "};\n";
+  }
+
   LeaveNdkNamespace(out, defined_type);
 }
 void GenerateParcelHeader(CodeWriter& out, const AidlTypenames& types,
                           const AidlStructuredParcelable& defined_type,
-                          const Options& /*options*/) {
+                          const Options& options) {
   const std::string clazz = ClassName(defined_type, ClassNames::RAW);
 
   out << "#pragma once\n";
@@ -868,6 +1711,24 @@ void GenerateParcelHeader(CodeWriter& out, const AidlTypenames& types,
   out << "\n";
 
   GenerateHeaderIncludes(out, types, defined_type);
+  const bool is_pmr = defined_type.IsPolymorphicAllocator();
+  if (is_pmr) {
+    out << "#include <memory_resource>\n";
+    out << "#include <utility>\n";
+  }
+  if (defined_type.IsHashable() || defined_type.IsDelta()) {
+    out << "#include <tuple>\n";
+  }
+  if (defined_type.IsHashable()) {
+    out << "#include <aidl/hash.h>\n";
+  }
+  if (options.GenParcelableToString()) {
+    out << "#include <string>\n";
+    out << "#include <aidl/to_string.h>\n";
+  }
+  if (options.GenWireSchema()) {
+    out << "#include <string_view>\n";
+  }
 
   EnterNdkNamespace(out, defined_type);
   out << "class " << clazz << " {\n";
@@ -875,8 +1736,14 @@ void GenerateParcelHeader(CodeWriter& out, const AidlTypenames& types,
   out.Indent();
   out << "static const char* descriptor;\n";
   out << "\n";
+  if (is_pmr) {
+    out << cpp::GenAllocatorConstructors(defined_type, types, clazz);
+    out << "\n";
+  }
   for (const auto& variable : defined_type.GetFields()) {
-    out << NdkNameOf(types, variable->GetType(), StorageMode::STACK) << " " << variable->GetName();
+    out << (is_pmr ? NdkPmrNameOf(types, variable->GetType())
+                   : NdkNameOf(types, variable->GetType(), StorageMode::STACK))
+        << " " << variable->GetName();
     if (variable->GetDefaultValue()) {
       out << " = " << variable->ValueString(ConstantValueDecorator);
     } else if (auto type = types.TryGetDefinedType(variable->GetType().GetName()); type) {
@@ -887,7 +1754,7 @@ void GenerateParcelHeader(CodeWriter& out, const AidlTypenames& types,
         }
       }
     } else if (AidlTypenames::IsPrimitiveTypename(variable->GetType().GetName()) &&
-               !variable->GetType().IsArray()) {
+               (!variable->GetType().IsArray() || variable->GetType().IsFixedSizeArray())) {
       out << " = {}";
     }
     out << ";\n";
@@ -895,23 +1762,78 @@ void GenerateParcelHeader(CodeWriter& out, const AidlTypenames& types,
   out << "\n";
   out << "binder_status_t readFromParcel(const AParcel* parcel);\n";
   out << "binder_status_t writeToParcel(AParcel* parcel) const;\n";
+  // The Delta of a @Delta parcelable compares the fields as @Hashable does
+  if (defined_type.IsHashable() || defined_type.IsDelta()) {
+    out << "\n";
+    out << cpp::GenComparisonOperators(defined_type, clazz);
+  }
+  if (options.GenParcelableToString()) {
+    out << "\n";
+    out << cpp::GenToString(defined_type);
+  }
+  if (options.GenWireSchema()) {
+    out << "static ::std::string_view getWireSchema();\n";
+  }
+  if (defined_type.IsDelta()) {
+    out << "\n";
+    out << "class Delta;\n";
+  }
   out.Dedent();
   out << "};\n";
+  if (defined_type.IsDelta()) {
+    out << "class " << clazz << "::Delta {\n";
+    out << "public:\n";
+    out.Indent();
+    out << "static const char* descriptor;\n";
+    out << "\n";
+    out << cpp::GenDeltaMembers(defined_type, clazz);
+    out << "\n";
+    out << "binder_status_t readFromParcel(const AParcel* parcel);\n";
+    out << "binder_status_t writeToParcel(AParcel* parcel) const;\n";
+    out.Dedent();
+    out << "};\n";
+  }
   LeaveNdkNamespace(out, defined_type);
+  if (defined_type.IsHashable()) {
+    out << "namespace std {\n";
+    out << cpp::GenHashSpecialization(defined_type,
+                                      NdkFullClassName(defined_type, cpp::ClassNames::RAW));
+    out << "}  // namespace std\n";
+  }
+}
+// The read of |variable| of |parcelable| from parcel into |var|, where the
+// containers of a @PolymorphicAllocator parcelable go through aidl/pmr_ndk.h
+static void ReadFieldFromParcel(CodeWriter& out, const AidlTypenames& types,
+                                const AidlStructuredParcelable& parcelable,
+                                const AidlVariableDeclaration& variable, const std::string& var) {
+  if (parcelable.IsPolymorphicAllocator() && cpp::IsPmrContainer(variable.GetType())) {
+    out << "::android::aidl::pmr::ReadFromParcel(parcel, &" << var << ")";
+    return;
+  }
+  ReadFromParcelFor({out, types, variable.GetType(), "parcel", "&" + var});
 }
-void GenerateParcelSource(CodeWriter& out, const AidlTypenames& types,
-                          const AidlStructuredParcelable& defined_type,
-                          const Options& /*options*/) {
-  const std::string clazz = ClassName(defined_type, ClassNames::RAW);
 
-  out << "#include \"" << NdkHeaderFile(defined_type, ClassNames::RAW, false /*use_os_sep*/)
-      << "\"\n";
-  out << "\n";
-  GenerateSourceIncludes(out, types, defined_type);
-  out << "\n";
-  EnterNdkNamespace(out, defined_type);
+// The write of |variable| of |parcelable| into parcel, see ReadFieldFromParcel()
+static void WriteFieldToParcel(CodeWriter& out, const AidlTypenames& types,
+                               const AidlStructuredParcelable& parcelable,
+                               const AidlVariableDeclaration& variable, const std::string& var) {
+  if (parcelable.IsPolymorphicAllocator() && cpp::IsPmrContainer(variable.GetType())) {
+    out << "::android::aidl::pmr::WriteToParcel(parcel, " << var << ")";
+    return;
+  }
+  WriteToParcelFor({out, types, variable.GetType(), "parcel", var});
+}
+
+// The readFromParcel() and writeToParcel() of the Delta of a @Delta parcelable,
+// which are those of a parcelable of an int64 of the fields that it has and of
+// the values of those fields only
+static void GenerateDeltaSource(CodeWriter& out, const AidlTypenames& types,
+                                const AidlStructuredParcelable& defined_type) {
+  const std::string clazz = ClassName(defined_type, ClassNames::RAW) + "::Delta";
+  const auto& fields = defined_type.GetFields();
+
   out << "const char* " << clazz << "::" << kDescriptor << " = \""
-      << defined_type.GetCanonicalName() << "\";\n";
+      << defined_type.GetCanonicalName() << ".Delta\";\n";
   out << "\n";
 
   out << "binder_status_t " << clazz << "::readFromParcel(const AParcel* parcel) {\n";
@@ -921,16 +1843,17 @@ void GenerateParcelSource(CodeWriter& out, const AidlTypenames& types,
   out << "binder_status_t _aidl_ret_status = AParcel_readInt32(parcel, &_aidl_parcelable_size);\n";
   out << "if (_aidl_parcelable_size < 0) return STATUS_BAD_VALUE;\n";
   StatusCheckReturn(out);
-
-  for (const auto& variable : defined_type.GetFields()) {
+  out << "_aidl_ret_status = AParcel_readUint64(parcel, &fields);\n";
+  StatusCheckReturn(out);
+  for (size_t i = 0; i < fields.size(); i++) {
+    out << "if (fields & " << cpp::DeltaBit(i) << ") {\n";
+    out.Indent();
     out << "_aidl_ret_status = ";
-    ReadFromParcelFor({out, types, variable->GetType(), "parcel", "&" + variable->GetName()});
+    ReadFieldFromParcel(out, types, defined_type, *fields[i], "values." + fields[i]->GetName());
     out << ";\n";
     StatusCheckReturn(out);
-    out << "if (AParcel_getDataPosition(parcel) - _aidl_start_pos >= _aidl_parcelable_size) {\n"
-        << "  AParcel_setDataPosition(parcel, _aidl_start_pos + _aidl_parcelable_size);\n"
-        << "  return _aidl_ret_status;\n"
-        << "}\n";
+    out.Dedent();
+    out << "}\n";
   }
   out << "AParcel_setDataPosition(parcel, _aidl_start_pos + _aidl_parcelable_size);\n"
       << "return _aidl_ret_status;\n";
@@ -940,53 +1863,145 @@ void GenerateParcelSource(CodeWriter& out, const AidlTypenames& types,
   out << "binder_status_t " << clazz << "::writeToParcel(AParcel* parcel) const {\n";
   out.Indent();
   out << "binder_status_t _aidl_ret_status;\n";
-
   out << "size_t _aidl_start_pos = AParcel_getDataPosition(parcel);\n";
   out << "_aidl_ret_status = AParcel_writeInt32(parcel, 0);\n";
   StatusCheckReturn(out);
-
-  for (const auto& variable : defined_type.GetFields()) {
+  out << "_aidl_ret_status = AParcel_writeUint64(parcel, fields);\n";
+  StatusCheckReturn(out);
+  for (size_t i = 0; i < fields.size(); i++) {
+    out << "if (fields & " << cpp::DeltaBit(i) << ") {\n";
+    out.Indent();
     out << "_aidl_ret_status = ";
-    WriteToParcelFor({out, types, variable->GetType(), "parcel", variable->GetName()});
+    WriteFieldToParcel(out, types, defined_type, *fields[i], "values." + fields[i]->GetName());
     out << ";\n";
     StatusCheckReturn(out);
+    out.Dedent();
+    out << "}\n";
   }
   out << "size_t _aidl_end_pos = AParcel_getDataPosition(parcel);\n";
   out << "AParcel_setDataPosition(parcel, _aidl_start_pos);\n";
   out << "AParcel_writeInt32(parcel, _aidl_end_pos - _aidl_start_pos);\n";
   out << "AParcel_setDataPosition(parcel, _aidl_end_pos);\n";
-
   out << "return _aidl_ret_status;\n";
   out.Dedent();
   out << "}\n";
   out << "\n";
-  LeaveNdkNamespace(out, defined_type);
 }
 
-std::string GenerateEnumToString(const AidlTypenames& typenames,
-                                 const AidlEnumDeclaration& enum_decl) {
-  std::ostringstream code;
-  code << "static inline std::string toString(" << enum_decl.GetName() << " val) {\n";
-  code << "  switch(val) {\n";
-  std::set<std::string> unique_cases;
-  for (const auto& enumerator : enum_decl.GetEnumerators()) {
-    std::string c = enumerator->ValueString(enum_decl.GetBackingType(), ConstantValueDecorator);
-    // Only add a case if its value has not yet been used in the switch
-    // statement. C++ does not allow multiple cases with the same value, but
-    // enums does allow this. In this scenario, the first declared
-    // enumerator with the given value is printed.
-    if (unique_cases.count(c) == 0) {
-      unique_cases.insert(c);
-      code << "  case " << enum_decl.GetName() << "::" << enumerator->GetName() << ":\n";
-      code << "    return \"" << enumerator->GetName() << "\";\n";
+// The body of readFromParcel() from the size header on, which tells where
+// the fields of the version that wrote the parcelable end
+static void GenerateSizedReadFromParcel(CodeWriter& out, const AidlTypenames& types,
+                                        const AidlStructuredParcelable& defined_type) {
+  out << "int32_t _aidl_parcelable_size;\n";
+  out << "int32_t _aidl_start_pos = AParcel_getDataPosition(parcel);\n";
+  out << "binder_status_t _aidl_ret_status = AParcel_readInt32(parcel, &_aidl_parcelable_size);\n";
+  out << "if (_aidl_parcelable_size < 0) return STATUS_BAD_VALUE;\n";
+  StatusCheckReturn(out);
+
+  if (defined_type.IsFixedSize() && !defined_type.GetFields().empty()) {
+    // AParcel has no bulk reads, but all the fields are there unless the
+    // parcelable is from an older version with fewer fields, which the reads
+    // of each field below handle
+    out << "if (_aidl_parcelable_size >= static_cast<int32_t>(sizeof(int32_t) + "
+        << std::to_string(cpp::FixedSizeOf(defined_type, types)) << ")) {\n";
+    out.Indent();
+    for (const auto& variable : defined_type.GetFields()) {
+      out << "_aidl_ret_status = ";
+      ReadFieldFromParcel(out, types, defined_type, *variable, variable->GetName());
+      out << ";\n";
+      StatusCheckReturn(out);
+    }
+    out << "AParcel_setDataPosition(parcel, _aidl_start_pos + _aidl_parcelable_size);\n"
+        << "return _aidl_ret_status;\n";
+    out.Dedent();
+    out << "}\n";
+  }
+  for (const auto& variable : defined_type.GetFields()) {
+    out << "_aidl_ret_status = ";
+    ReadFieldFromParcel(out, types, defined_type, *variable, variable->GetName());
+    out << ";\n";
+    StatusCheckReturn(out);
+    out << "if (AParcel_getDataPosition(parcel) - _aidl_start_pos >= _aidl_parcelable_size) {\n"
+        << "  AParcel_setDataPosition(parcel, _aidl_start_pos + _aidl_parcelable_size);\n"
+        << "  return _aidl_ret_status;\n"
+        << "}\n";
+  }
+  out << "AParcel_setDataPosition(parcel, _aidl_start_pos + _aidl_parcelable_size);\n"
+      << "return _aidl_ret_status;\n";
+}
+
+void GenerateParcelSource(CodeWriter& out, const AidlTypenames& types,
+                          const AidlStructuredParcelable& defined_type,
+                          const Options& options) {
+  const std::string clazz = ClassName(defined_type, ClassNames::RAW);
+
+  out << "#include \"" << NdkHeaderFile(defined_type, ClassNames::RAW, false /*use_os_sep*/)
+      << "\"\n";
+  out << "\n";
+  GenerateSourceIncludes(out, types, defined_type);
+  out << "\n";
+  EnterNdkNamespace(out, defined_type);
+  out << "const char* " << clazz << "::" << kDescriptor << " = \""
+      << defined_type.GetCanonicalName() << "\";\n";
+  out << "\n";
+
+  // The sections of the size report, one after the other
+  std::optional<SizeScope> size(std::in_place, out, "ndk", defined_type, nullptr, "parcel_read");
+  out << "binder_status_t " << clazz << "::readFromParcel(const AParcel* parcel) {\n";
+  out.Indent();
+  if (defined_type.IsHeaderless()) {
+    // Written by the same build, with neither the size header nor the fields
+    // of other versions to skip
+    out << "binder_status_t _aidl_ret_status = STATUS_OK;\n";
+    for (const auto& variable : defined_type.GetFields()) {
+      out << "_aidl_ret_status = ";
+      ReadFieldFromParcel(out, types, defined_type, *variable, variable->GetName());
+      out << ";\n";
+      StatusCheckReturn(out);
     }
+    out << "return _aidl_ret_status;\n";
+  } else {
+    GenerateSizedReadFromParcel(out, types, defined_type);
   }
-  code << "  default:\n";
-  code << "    return std::to_string(static_cast<"
-       << NdkNameOf(typenames, enum_decl.GetBackingType(), StorageMode::STACK) << ">(val));\n";
-  code << "  }\n";
-  code << "}\n";
-  return code.str();
+  out.Dedent();
+  out << "}\n";
+
+  size.emplace(out, "ndk", defined_type, nullptr, "parcel_write");
+  out << "binder_status_t " << clazz << "::writeToParcel(AParcel* parcel) const {\n";
+  out.Indent();
+  out << "binder_status_t _aidl_ret_status = STATUS_OK;\n";
+
+  if (!defined_type.IsHeaderless()) {
+    out << "size_t _aidl_start_pos = AParcel_getDataPosition(parcel);\n";
+    out << "_aidl_ret_status = AParcel_writeInt32(parcel, 0);\n";
+    StatusCheckReturn(out);
+  }
+
+  for (const auto& variable : defined_type.GetFields()) {
+    out << "_aidl_ret_status = ";
+    WriteFieldToParcel(out, types, defined_type, *variable, variable->GetName());
+    out << ";\n";
+    StatusCheckReturn(out);
+  }
+  if (!defined_type.IsHeaderless()) {
+    out << "size_t _aidl_end_pos = AParcel_getDataPosition(parcel);\n";
+    out << "AParcel_setDataPosition(parcel, _aidl_start_pos);\n";
+    out << "AParcel_writeInt32(parcel, _aidl_end_pos - _aidl_start_pos);\n";
+    out << "AParcel_setDataPosition(parcel, _aidl_end_pos);\n";
+  }
+
+  out << "return _aidl_ret_status;\n";
+  out.Dedent();
+  out << "}\n";
+  size.reset();
+  out << "\n";
+  if (defined_type.IsDelta()) {
+    GenerateDeltaSource(out, types, defined_type);
+  }
+  if (options.GenWireSchema()) {
+    out << cpp::GenWireSchemaDefinition(defined_type, types, clazz);
+  }
+  LeaveNdkNamespace(out, defined_type);
 }
 
 void GenerateEnumHeader(CodeWriter& out, const AidlTypenames& types,
@@ -997,6 +2012,7 @@ void GenerateEnumHeader(CodeWriter& out, const AidlTypenames& types,
   GenerateHeaderIncludes(out, types, enum_decl);
   // enum specific headers
   out << "#include <array>\n";
+  out << "#include <string_view>\n";
   out << "#include <android/binder_enums.h>\n";
 
   EnterNdkNamespace(out, enum_decl);
@@ -1010,7 +2026,8 @@ void GenerateEnumHeader(CodeWriter& out, const AidlTypenames& types,
   out.Dedent();
   out << "};\n";
   out << "\n";
-  out << GenerateEnumToString(types, enum_decl);
+  out << cpp::GenerateEnumToString(
+      enum_decl, NdkNameOf(types, enum_decl.GetBackingType(), StorageMode::STACK));
   LeaveNdkNamespace(out, enum_decl);
 
   out << "namespace ndk {\n";
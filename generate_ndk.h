@@ -26,8 +26,11 @@ namespace android {
 namespace aidl {
 namespace ndk {
 
+// Without |with_source|, the headers are generated and the source is a
+// placeholder, its code being in the library of another compilation.
 void GenerateNdk(const string& output_file, const Options& options, const AidlTypenames& types,
-                 const AidlDefinedType& defined_type, const IoDelegate& io_delegate);
+                 const AidlDefinedType& defined_type, const IoDelegate& io_delegate,
+                 bool with_source);
 
 namespace internals {
 void GenerateSource(CodeWriter& out, const AidlTypenames& types, const AidlInterface& defined_type,
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+// The hashes of the fields of the parcelables with @Hashable, which the C++
+// and NDK backends combine in their ::std::hash specializations. None of them
+// allocates: the Strings are hashed through views of their characters.
+
+#include <stddef.h>
+
+#include <array>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace android {
+namespace aidl {
+
+// Whether T is an ::android::String16, which has its characters at string()
+template <typename T, typename = void>
+constexpr bool kIsString16 = false;
+template <typename T>
+constexpr bool kIsString16<T, std::void_t<decltype(std::declval<const T&>().string()),
+                                          decltype(std::declval<const T&>().size())>> =
+    std::is_same_v<decltype(std::declval<const T&>().string()), const char16_t*>;
+
+// Mixes |value| into |seed|, as boost::hash_combine does
+inline void HashCombine(size_t* seed, size_t value) {
+  *seed ^= value + 0x9e3779b9 + (*seed << 6) + (*seed >> 2);
+}
+
+// The hash of a field, from the ::std::hash of its primitives, enums and
+// parcelables
+template <typename T>
+size_t HashOf(const T& value);
+template <typename Char, typename Traits, typename Allocator>
+size_t HashOf(const std::basic_string<Char, Traits, Allocator>& value);
+template <typename T, typename Allocator>
+size_t HashOf(const std::vector<T, Allocator>& values);
+template <typename T, size_t N>
+size_t HashOf(const std::array<T, N>& values);
+
+template <typename T>
+size_t HashOf(const T& value) {
+  if constexpr (kIsString16<T>) {
+    return std::hash<std::u16string_view>{}(std::u16string_view(value.string(), value.size()));
+  } else {
+    return std::hash<T>{}(value);
+  }
+}
+
+template <typename Char, typename Traits, typename Allocator>
+size_t HashOf(const std::basic_string<Char, Traits, Allocator>& value) {
+  return std::hash<std::basic_string_view<Char, Traits>>{}(value);
+}
+
+// The size of an array or a List, followed by its elements in order
+template <typename T, typename Allocator>
+size_t HashOf(const std::vector<T, Allocator>& values) {
+  size_t hash = values.size();
+  for (const T& value : values) HashCombine(&hash, HashOf(value));
+  return hash;
+}
+
+// A fixed-size array hashes as an array of its N elements
+template <typename T, size_t N>
+size_t HashOf(const std::array<T, N>& values) {
+  size_t hash = N;
+  for (const T& value : values) HashCombine(&hash, HashOf(value));
+  return hash;
+}
+
+}  // namespace aidl
+}  // namespace android
@@ -16,6 +16,7 @@
 
 #include "import_resolver.h"
 #include "aidl_language.h"
+#include "aidl_profile.h"
 
 #include <algorithm>
 
@@ -35,9 +36,22 @@ using std::vector;
 namespace android {
 namespace aidl {
 
+bool ImportIndex::HasFile(const IoDelegate& io_delegate, const string& dir, const string& name) {
+  auto it = dirs_.find(dir);
+  if (it == dirs_.end()) {
+    vector<string> files = io_delegate.ListDirectory(dir);
+    it = dirs_.emplace(dir, set<string>(files.begin(), files.end())).first;
+  }
+  return it->second.count(name) > 0;
+}
+
 ImportResolver::ImportResolver(const IoDelegate& io_delegate, const string& input_file_name,
-                               const set<string>& import_paths, const vector<string>& input_files)
-    : io_delegate_(io_delegate), input_file_name_(input_file_name), input_files_(input_files) {
+                               const set<string>& import_paths, const vector<string>& input_files,
+                               ImportIndex* index)
+    : io_delegate_(io_delegate),
+      input_file_name_(input_file_name),
+      input_files_(input_files),
+      index_(index != nullptr ? index : &own_index_) {
   for (string path : import_paths) {
     if (path.empty()) {
       path = ".";
@@ -50,6 +64,7 @@ ImportResolver::ImportResolver(const IoDelegate& io_delegate, const string& inpu
 }
 
 string ImportResolver::FindImportFile(const string& canonical_name) const {
+  ProfileScope profile_scope("find import", canonical_name);
   // Convert the canonical name to a relative file path.
   string relative_path = canonical_name;
   for (char& c : relative_path) {
@@ -61,12 +76,26 @@ string ImportResolver::FindImportFile(const string& canonical_name) const {
 
   // Look for that relative path at each of our import roots.
   vector<string> found_paths;
+#ifdef _WIN32
+  // ListDirectory() is not implemented on Windows.
   for (string path : import_paths_) {
     path = path + relative_path;
     if (io_delegate_.FileIsReadable(path)) {
       found_paths.emplace_back(path);
     }
   }
+#else
+  // Each package directory is listed once rather than probed for every
+  // import, at every root.
+  const size_t slash = relative_path.rfind(OS_PATH_SEPARATOR);
+  const string package_dir = slash == string::npos ? "" : relative_path.substr(0, slash);
+  const string name = relative_path.substr(slash == string::npos ? 0 : slash + 1);
+  for (const string& path : import_paths_) {
+    if (index_->HasFile(io_delegate_, path + package_dir, name)) {
+      found_paths.emplace_back(path + relative_path);
+    }
+  }
+#endif
   // remove duplicates
   std::sort(found_paths.begin(), found_paths.end());
   auto last = std::unique(found_paths.begin(), found_paths.end());
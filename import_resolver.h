@@ -18,6 +18,7 @@
 
 #include <set>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <android-base/macros.h>
@@ -27,11 +28,35 @@
 namespace android {
 namespace aidl {
 
+// The files of the package directories under the import roots, each listed
+// once for all the ImportResolvers that share the index, e.g. those of the
+// inputs of one compile_aidl() invocation. Only the directories that the
+// imports are looked for in are listed.
+class ImportIndex {
+ public:
+  ImportIndex() = default;
+
+  // Whether |dir| has a file named |name|. |dir| is listed with |io_delegate|
+  // the first time that it is asked about.
+  bool HasFile(const IoDelegate& io_delegate, const std::string& dir, const std::string& name);
+
+  // Forgets the listings, e.g. before the next job of a resident compiler,
+  // since files may have been added since.
+  void Clear() { dirs_.clear(); }
+
+ private:
+  std::unordered_map<std::string, std::set<std::string>> dirs_;
+
+  DISALLOW_COPY_AND_ASSIGN(ImportIndex);
+};
+
 class ImportResolver {
  public:
+  // The directories are listed into |index| when it is not null, and into an
+  // index of the resolver's own otherwise.
   ImportResolver(const IoDelegate& io_delegate, const std::string& input_file_name,
                  const std::set<std::string>& import_paths,
-                 const std::vector<std::string>& input_files);
+                 const std::vector<std::string>& input_files, ImportIndex* index = nullptr);
   virtual ~ImportResolver() = default;
 
   // Resolve the canonical name for a class to a file that exists
@@ -43,6 +68,8 @@ class ImportResolver {
   const std::string& input_file_name_;
   std::vector<std::string> import_paths_;
   std::vector<std::string> input_files_;
+  ImportIndex own_index_;
+  ImportIndex* const index_;
 
   DISALLOW_COPY_AND_ASSIGN(ImportResolver);
 };
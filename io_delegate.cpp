@@ -16,20 +16,28 @@
 
 #include "io_delegate.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cstring>
 #include <fstream>
+#include <iterator>
+#include <thread>
 #include <vector>
 
 #ifdef _WIN32
 #include <direct.h>
+#include <sys/stat.h>
 #else
 #include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 #endif
 
 #include <android-base/strings.h>
+#include <android-base/unique_fd.h>
 
 #include "logging.h"
 #include "os.h"
@@ -104,6 +112,74 @@ unique_ptr<string> IoDelegate::GetFileContents(
   return contents;
 }
 
+namespace {
+
+class StringFileBuffer : public FileBuffer {
+ public:
+  explicit StringFileBuffer(unique_ptr<string> contents)
+      : FileBuffer(&(*contents)[0], contents->size() - 2), contents_(std::move(contents)) {}
+
+ private:
+  const unique_ptr<string> contents_;
+};
+
+#ifndef _WIN32
+class MappedFileBuffer : public FileBuffer {
+ public:
+  MappedFileBuffer(void* base, size_t size, size_t mapped_size)
+      : FileBuffer(static_cast<char*>(base), size), base_(base), mapped_size_(mapped_size) {}
+  ~MappedFileBuffer() override { munmap(base_, mapped_size_); }
+
+ private:
+  void* const base_;
+  const size_t mapped_size_;
+};
+
+unique_ptr<FileBuffer> MapFile(const string& filename) {
+  android::base::unique_fd fd(open(filename.c_str(), O_RDONLY | O_CLOEXEC));
+  struct stat st;
+  if (fd.get() < 0 || fstat(fd.get(), &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+    return nullptr;
+  }
+  const size_t size = st.st_size;
+  const size_t page_size = sysconf(_SC_PAGESIZE);
+  const size_t mapped_size = (size + 2 + page_size - 1) / page_size * page_size;
+  // Reserve zeroed memory for the contents and the NULs, and map the file over
+  // its beginning. The rest of the last page of the file reads as zeros as well.
+  void* base = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                    -1, 0);
+  if (base == MAP_FAILED) {
+    return nullptr;
+  }
+  if (mmap(base, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd.get(), 0) ==
+      MAP_FAILED) {
+    munmap(base, mapped_size);
+    return nullptr;
+  }
+  return std::make_unique<MappedFileBuffer>(base, size, mapped_size);
+}
+#endif
+
+}  // namespace
+
+unique_ptr<FileBuffer> FileBuffer::FromString(unique_ptr<string> contents) {
+  if (contents == nullptr) {
+    return nullptr;
+  }
+  contents->append(2u, '\0');
+  return std::make_unique<StringFileBuffer>(std::move(contents));
+}
+
+unique_ptr<FileBuffer> IoDelegate::GetFileBuffer(const string& filename) const {
+#ifndef _WIN32
+  if (unique_ptr<FileBuffer> mapped = MapFile(filename); mapped != nullptr) {
+    return mapped;
+  }
+#endif
+  // e.g. empty files, which can't be mapped
+  return FileBuffer::FromString(GetFileContents(filename));
+}
+
 unique_ptr<LineReader> IoDelegate::GetLineReader(
     const string& file_path) const {
   return LineReader::ReadFromFile(file_path);
@@ -119,6 +195,27 @@ bool IoDelegate::FileIsReadable(const string& path) const {
 #endif
 }
 
+std::optional<FileStamp> IoDelegate::GetFileStamp(const string& path) const {
+#ifdef _WIN32
+  struct _stat64 st;
+  if (_stat64(path.c_str(), &st) != 0) {
+    return std::nullopt;
+  }
+  return FileStamp{st.st_size, static_cast<int64_t>(st.st_mtime) * 1000000000};
+#else
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0) {
+    return std::nullopt;
+  }
+#ifdef __APPLE__
+  const struct timespec& mtime = st.st_mtimespec;
+#else
+  const struct timespec& mtime = st.st_mtim;
+#endif
+  return FileStamp{st.st_size, static_cast<int64_t>(mtime.tv_sec) * 1000000000 + mtime.tv_nsec};
+#endif
+}
+
 static bool CreateNestedDirs(const string& caller_base_dir, const vector<string>& nested_subdirs) {
   string base_dir = caller_base_dir;
   if (base_dir.empty()) {
@@ -179,7 +276,10 @@ bool IoDelegate::CreateDirForPath(const string& path) const {
 unique_ptr<CodeWriter> IoDelegate::GetCodeWriter(
     const string& file_path) const {
   if (CreateDirForPath(file_path)) {
-    return CodeWriter::ForFile(file_path);
+    CodeWriterPtr writer = write_if_changed_ ? CodeWriter::ForFileIfChanged(file_path)
+                                             : CodeWriter::ForFile(file_path);
+    writer->CountAsOutput();
+    return writer;
   } else {
     return nullptr;
   }
@@ -193,33 +293,237 @@ void IoDelegate::RemovePath(const std::string& file_path) const {
 #endif
 }
 
+bool IoDelegate::LinkOrCopyFile(const string& from, const string& to) const {
+  if (!CreateDirForPath(to)) {
+    return false;
+  }
+  unique_ptr<string> contents;
+  if (write_if_changed_) {
+    contents = GetFileContents(from);
+    unique_ptr<string> existing = GetFileContents(to);
+    if (contents != nullptr && existing != nullptr && *contents == *existing) {
+      return true;
+    }
+  }
+  RemovePath(to);
+#ifndef _WIN32
+  if (link(from.c_str(), to.c_str()) == 0) {
+    return true;
+  }
+#endif
+  if (contents == nullptr) {
+    contents = GetFileContents(from);
+  }
+  if (contents == nullptr) {
+    return false;
+  }
+  CodeWriterPtr writer = GetCodeWriter(to);
+  return writer != nullptr && writer->WriteBytes(*contents) && writer->Close();
+}
+
+ReadAheadIoDelegate::ReadAheadIoDelegate(const IoDelegate& io_delegate, vector<string> files,
+                                         size_t num_threads)
+    : io_delegate_(io_delegate), files_(std::move(files)), slots_(files_.size()) {
+  for (size_t i = 0; i < files_.size(); i++) {
+    index_.emplace(files_[i], i);
+  }
+  for (size_t t = 0; t < std::min(num_threads, files_.size()); t++) {
+    threads_.emplace_back(&ReadAheadIoDelegate::ReadAhead, this);
+  }
+}
+
+ReadAheadIoDelegate::~ReadAheadIoDelegate() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  for (std::thread& thread : threads_) {
+    thread.join();
+  }
+}
+
+void ReadAheadIoDelegate::ReadAhead() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stopping_) {
+    while (next_ < slots_.size() && slots_[next_].state != State::PENDING) {
+      next_++;
+    }
+    if (next_ == slots_.size()) {
+      return;
+    }
+    const size_t i = next_++;
+    slots_[i].state = State::READING;
+    lock.unlock();
+    unique_ptr<FileBuffer> buffer = io_delegate_.GetFileBuffer(files_[i]);
+    if (buffer != nullptr) {
+      // Faults in the pages of a mapped file, which would otherwise be read
+      // only when the caller gets to them.
+      volatile char sink = 0;
+      for (size_t offset = 0; offset < buffer->Size(); offset += 4096) {
+        sink = sink + buffer->Data()[offset];
+      }
+    }
+    lock.lock();
+    slots_[i].buffer = std::move(buffer);
+    slots_[i].state = State::READ;
+    read_.notify_all();
+  }
+}
+
+unique_ptr<FileBuffer> ReadAheadIoDelegate::GetFileBuffer(const string& filename) const {
+  auto found = index_.find(filename);
+  if (found == index_.end()) {
+    return io_delegate_.GetFileBuffer(filename);
+  }
+  Slot& slot = slots_[found->second];
+  std::unique_lock<std::mutex> lock(mutex_);
+  read_.wait(lock, [&]() { return slot.state != State::READING; });
+  const State state = slot.state;
+  slot.state = State::TAKEN;
+  if (state == State::READ) {
+    return std::move(slot.buffer);
+  }
+  // Not read ahead yet, or handed out already
+  lock.unlock();
+  return io_delegate_.GetFileBuffer(filename);
+}
+
+unique_ptr<string> ReadAheadIoDelegate::GetFileContents(const string& filename,
+                                                        const string& content_suffix) const {
+  return io_delegate_.GetFileContents(filename, content_suffix);
+}
+
+unique_ptr<LineReader> ReadAheadIoDelegate::GetLineReader(const string& file_path) const {
+  return io_delegate_.GetLineReader(file_path);
+}
+
+bool ReadAheadIoDelegate::FileIsReadable(const string& path) const {
+  return io_delegate_.FileIsReadable(path);
+}
+
+std::optional<FileStamp> ReadAheadIoDelegate::GetFileStamp(const string& path) const {
+  return io_delegate_.GetFileStamp(path);
+}
+
+unique_ptr<CodeWriter> ReadAheadIoDelegate::GetCodeWriter(const string& file_path) const {
+  return io_delegate_.GetCodeWriter(file_path);
+}
+
+void ReadAheadIoDelegate::RemovePath(const string& file_path) const {
+  io_delegate_.RemovePath(file_path);
+}
+
+bool ReadAheadIoDelegate::LinkOrCopyFile(const string& from, const string& to) const {
+  return io_delegate_.LinkOrCopyFile(from, to);
+}
+
+vector<string> ReadAheadIoDelegate::ListFiles(const string& dir) const {
+  return io_delegate_.ListFiles(dir);
+}
+
+vector<string> ReadAheadIoDelegate::ListDirectory(const string& dir) const {
+  return io_delegate_.ListDirectory(dir);
+}
+
 #ifdef _WIN32
 vector<string> IoDelegate::ListFiles(const string&) const {
   vector<string> result;
   return result;
 }
 
+vector<string> IoDelegate::ListDirectory(const string&) const {
+  vector<string> result;
+  return result;
+}
+
 #else
-static void add_list_files(const string& dirname, vector<string>* result) {
-  CHECK(result != nullptr);
+// Lists the regular files in |dirname| into |files|, and the directories in
+// it into |dirs|. The links are left out, as find(1) doesn't follow them.
+static void list_dir(const string& dirname, vector<string>* files, vector<string>* dirs) {
   std::unique_ptr<DIR, decltype(&closedir)> dir(opendir(dirname.c_str()), closedir);
-  if (dir != nullptr) {
-    while (struct dirent* ent = readdir(dir.get())) {
-      if (!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, "..")) {
+  if (dir == nullptr) {
+    return;
+  }
+  while (struct dirent* ent = readdir(dir.get())) {
+    if (!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, "..")) {
+      continue;
+    }
+    const string path = dirname + OS_PATH_SEPARATOR + ent->d_name;
+    unsigned char type = ent->d_type;
+    if (type == DT_UNKNOWN) {
+      // Some filesystems don't report the type.
+      struct stat st;
+      if (lstat(path.c_str(), &st) != 0) {
         continue;
       }
-      if (ent->d_type == DT_REG) {
-        result->emplace_back(dirname + OS_PATH_SEPARATOR + ent->d_name);
-      } else if (ent->d_type == DT_DIR) {
-        add_list_files(dirname + OS_PATH_SEPARATOR + ent->d_name, result);
-      }
+      type = S_ISREG(st.st_mode) ? DT_REG : S_ISDIR(st.st_mode) ? DT_DIR : DT_UNKNOWN;
+    }
+    if (type == DT_REG) {
+      files->emplace_back(path);
+    } else if (type == DT_DIR) {
+      dirs->emplace_back(path);
     }
   }
 }
 
 vector<string> IoDelegate::ListFiles(const string& dir) const {
+  // The tree is walked a level at a time, the directories of a level side by
+  // side: on remote file systems the time goes to the round trips of opendir,
+  // readdir and stat rather than to any work.
+  constexpr size_t kMaxThreads = 8;
   vector<string> result;
-  add_list_files(dir, &result);
+  vector<string> level = {dir};
+  while (!level.empty()) {
+    vector<vector<string>> files(level.size());
+    vector<vector<string>> dirs(level.size());
+    std::atomic_size_t next = 0;
+    auto list = [&]() {
+      for (size_t i; (i = next.fetch_add(1)) < level.size();) {
+        list_dir(level[i], &files[i], &dirs[i]);
+      }
+    };
+    vector<std::thread> threads;
+    for (size_t t = 1; t < std::min(level.size(), kMaxThreads); t++) {
+      threads.emplace_back(list);
+    }
+    list();
+    for (std::thread& thread : threads) {
+      thread.join();
+    }
+    vector<string> next_level;
+    for (size_t i = 0; i < level.size(); i++) {
+      std::move(files[i].begin(), files[i].end(), std::back_inserter(result));
+      std::move(dirs[i].begin(), dirs[i].end(), std::back_inserter(next_level));
+    }
+    level = std::move(next_level);
+  }
+  // In the same order whatever the order the file system lists them in
+  std::sort(result.begin(), result.end());
+  return result;
+}
+
+vector<string> IoDelegate::ListDirectory(const string& dir) const {
+  vector<string> result;
+  std::unique_ptr<DIR, decltype(&closedir)> d(opendir(dir.c_str()), closedir);
+  if (d == nullptr) {
+    return result;
+  }
+  while (struct dirent* ent = readdir(d.get())) {
+    unsigned char type = ent->d_type;
+    if (type == DT_UNKNOWN || type == DT_LNK) {
+      // Some filesystems don't report the type, and a link to a file is read
+      // as the file, as FileIsReadable() finds it.
+      struct stat st;
+      if (fstatat(dirfd(d.get()), ent->d_name, &st, 0) != 0) {
+        continue;
+      }
+      type = S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+    }
+    if (type == DT_REG) {
+      result.emplace_back(ent->d_name);
+    }
+  }
+  std::sort(result.begin(), result.end());
   return result;
 }
 #endif
@@ -18,8 +18,15 @@
 
 #include <android-base/macros.h>
 
+#include <condition_variable>
+#include <cstdint>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 #include "code_writer.h"
@@ -28,6 +35,41 @@
 namespace android {
 namespace aidl {
 
+// The contents of a file followed by two NULs, which is the form the lexer
+// scans in place. The buffer is writable, but writes never reach the file.
+class FileBuffer {
+ public:
+  virtual ~FileBuffer() = default;
+
+  // Takes |contents| onto the heap. Returns nullptr if |contents| is null.
+  static std::unique_ptr<FileBuffer> FromString(std::unique_ptr<std::string> contents);
+
+  char* Data() const { return data_; }
+  // Size of the contents, excluding the two NULs.
+  size_t Size() const { return size_; }
+
+ protected:
+  FileBuffer(char* data, size_t size) : data_(data), size_(size) {}
+
+ private:
+  char* const data_;
+  const size_t size_;
+
+  DISALLOW_COPY_AND_ASSIGN(FileBuffer);
+};
+
+// The size and the modification time of a file, which tell whether it may
+// have been written since it was last looked at.
+struct FileStamp {
+  int64_t size = 0;
+  int64_t mtime_ns = 0;
+
+  bool operator==(const FileStamp& other) const {
+    return size == other.size && mtime_ns == other.mtime_ns;
+  }
+  bool operator!=(const FileStamp& other) const { return !(*this == other); }
+};
+
 class IoDelegate {
  public:
   IoDelegate() = default;
@@ -45,25 +87,95 @@ class IoDelegate {
       const std::string& filename,
       const std::string& content_suffix = "") const;
 
+  // Returns the contents of |filename| followed by two NULs, or nullptr on
+  // error. The file is memory-mapped when possible.
+  virtual std::unique_ptr<FileBuffer> GetFileBuffer(const std::string& filename) const;
+
   virtual std::unique_ptr<LineReader> GetLineReader(
       const std::string& file_path) const;
 
   virtual bool FileIsReadable(const std::string& path) const;
 
+  // Returns the stamp of |path|, or nullopt if it doesn't exist.
+  virtual std::optional<FileStamp> GetFileStamp(const std::string& path) const;
+
   virtual std::unique_ptr<CodeWriter> GetCodeWriter(
       const std::string& file_path) const;
 
+  // Makes GetCodeWriter() leave the files whose contents don't change alone,
+  // so that build systems can skip whatever depends on them.
+  void SetWriteIfChanged(bool write_if_changed) { write_if_changed_ = write_if_changed; }
+
   virtual void RemovePath(const std::string& file_path) const;
 
+  // Makes |to| a hard link to |from| where the file system allows, or a
+  // copy of it otherwise. With SetWriteIfChanged(), a |to| that has the
+  // contents of |from| already is left as it is.
+  virtual bool LinkOrCopyFile(const std::string& from, const std::string& to) const;
+
+  // Returns the paths of the regular files in the tree under |dir|, sorted.
+  // Like find(1), the links are not followed.
   virtual std::vector<std::string> ListFiles(const std::string& dir) const;
 
+  // Returns the names of the files in |dir|, not in the directories under it,
+  // sorted. Unlike ListFiles(), the links to files are listed too.
+  virtual std::vector<std::string> ListDirectory(const std::string& dir) const;
+
  private:
   // Create the directory when path is a dir or the parent directory when
   // path is a file. Path is a dir if it ends with the path separator.
   bool CreateDirForPath(const std::string& path) const;
 
+  bool write_if_changed_ = false;
+
   DISALLOW_COPY_AND_ASSIGN(IoDelegate);
 };  // class IoDelegate
 
+// Forwards to another IoDelegate, reading |files| ahead on up to |num_threads|
+// background threads, in their order, so that each file is likely loaded by
+// the time GetFileBuffer() asks for it. With high latency file systems the
+// caller then parses one file while the next ones arrive. A file that is read
+// ahead is handed out once; asking for it again reads it again.
+class ReadAheadIoDelegate : public IoDelegate {
+ public:
+  ReadAheadIoDelegate(const IoDelegate& io_delegate, std::vector<std::string> files,
+                      size_t num_threads);
+  // Waits for the reads under way.
+  ~ReadAheadIoDelegate() override;
+
+  std::unique_ptr<std::string> GetFileContents(
+      const std::string& filename, const std::string& content_suffix = "") const override;
+  std::unique_ptr<FileBuffer> GetFileBuffer(const std::string& filename) const override;
+  std::unique_ptr<LineReader> GetLineReader(const std::string& file_path) const override;
+  bool FileIsReadable(const std::string& path) const override;
+  std::optional<FileStamp> GetFileStamp(const std::string& path) const override;
+  std::unique_ptr<CodeWriter> GetCodeWriter(const std::string& file_path) const override;
+  void RemovePath(const std::string& file_path) const override;
+  bool LinkOrCopyFile(const std::string& from, const std::string& to) const override;
+  std::vector<std::string> ListFiles(const std::string& dir) const override;
+  std::vector<std::string> ListDirectory(const std::string& dir) const override;
+
+ private:
+  enum class State { PENDING, READING, READ, TAKEN };
+  struct Slot {
+    State state = State::PENDING;
+    std::unique_ptr<FileBuffer> buffer;
+  };
+
+  void ReadAhead();
+
+  const IoDelegate& io_delegate_;
+  const std::vector<std::string> files_;
+  std::unordered_map<std::string_view, size_t> index_;
+  mutable std::mutex mutex_;
+  mutable std::condition_variable read_;
+  mutable std::vector<Slot> slots_;
+  size_t next_ = 0;  // the first slot that may still be pending
+  bool stopping_ = false;
+  std::vector<std::thread> threads_;
+
+  DISALLOW_COPY_AND_ASSIGN(ReadAheadIoDelegate);
+};
+
 }  // namespace aidl
 }  // namespace android
@@ -14,13 +14,25 @@
  * limitations under the License.
  */
 
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fstream>
 #include <string>
+#include <vector>
 
 #include <gtest/gtest.h>
 
+#include "aidl.h"
+#include "code_writer.h"
 #include "io_delegate.h"
+#include "options.h"
+#include "tests/fake_io_delegate.h"
 
+using android::aidl::test::FakeIoDelegate;
 using std::string;
+using std::vector;
 
 namespace android {
 namespace aidl {
@@ -42,5 +54,165 @@ TEST(IoDelegateTest, CurrentlyInfersLinuxAbsolutePath) {
   EXPECT_EQ(absolute_path[0], '/');
 }
 
+TEST(IoDelegateTest, FileBufferIsFollowedByTwoNulls) {
+  char path[] = "/tmp/aidl_io_delegate_test_XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_GE(fd, 0);
+  close(fd);
+
+  IoDelegate io_delegate;
+  // Sizes around a page boundary, where the NULs no longer fit into the last
+  // page of the file, and an empty file, which can't be mapped.
+  const size_t page_size = sysconf(_SC_PAGESIZE);
+  for (size_t size : {page_size - 2, page_size - 1, page_size, size_t(10), size_t(0)}) {
+    const string contents(size, 'x');
+    std::ofstream(path, std::ios::binary | std::ios::trunc) << contents;
+    std::unique_ptr<FileBuffer> buffer = io_delegate.GetFileBuffer(path);
+    ASSERT_NE(nullptr, buffer);
+    ASSERT_EQ(size, buffer->Size());
+    EXPECT_EQ(contents, string(buffer->Data(), buffer->Size()));
+    EXPECT_EQ('\0', buffer->Data()[size]);
+    EXPECT_EQ('\0', buffer->Data()[size + 1]);
+  }
+  unlink(path);
+
+  EXPECT_EQ(nullptr, io_delegate.GetFileBuffer(path));
+}
+
+TEST(IoDelegateTest, WriteIfChangedKeepsUnchangedFiles) {
+  char path[] = "/tmp/aidl_io_delegate_test_XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_GE(fd, 0);
+  close(fd);
+  std::ofstream(path, std::ios::binary | std::ios::trunc) << "same";
+  struct stat before;
+  ASSERT_EQ(0, stat(path, &before));
+
+  IoDelegate io_delegate;
+  io_delegate.SetWriteIfChanged(true);
+  auto write = [&](const string& contents) {
+    std::unique_ptr<CodeWriter> writer = io_delegate.GetCodeWriter(path);
+    ASSERT_NE(nullptr, writer);
+    *writer << contents;
+    EXPECT_TRUE(writer->Close());
+  };
+
+  // Changed files are replaced by a new one, so the inode tells them apart.
+  write("same");
+  struct stat after;
+  ASSERT_EQ(0, stat(path, &after));
+  EXPECT_EQ(before.st_ino, after.st_ino);
+
+  write("different");
+  ASSERT_EQ(0, stat(path, &after));
+  EXPECT_NE(before.st_ino, after.st_ino);
+  std::unique_ptr<string> contents = io_delegate.GetFileContents(path);
+  ASSERT_NE(nullptr, contents);
+  EXPECT_EQ("different", *contents);
+  unlink(path);
+}
+
+TEST(IoDelegateTest, ListsTheFilesOfATreeInOrder) {
+  char dir[] = "/tmp/aidl_io_delegate_test_XXXXXX";
+  ASSERT_NE(nullptr, mkdtemp(dir));
+  const string root = dir;
+  for (const char* sub : {"/b", "/a", "/a/z", "/a/y", "/c"}) {
+    ASSERT_EQ(0, mkdir((root + sub).c_str(), 0700));
+  }
+  const vector<string> files = {"/a/y/1", "/a/z/2", "/a/3", "/b/4", "/5"};
+  for (const string& file : files) {
+    std::ofstream(root + file) << file;
+  }
+
+  IoDelegate io_delegate;
+  EXPECT_EQ((vector<string>{root + "/5", root + "/a/3", root + "/a/y/1", root + "/a/z/2",
+                            root + "/b/4"}),
+            io_delegate.ListFiles(root));
+  EXPECT_EQ(vector<string>{}, io_delegate.ListFiles(root + "/c"));
+
+  for (const string& file : files) {
+    unlink((root + file).c_str());
+  }
+  for (const char* sub : {"/a/z", "/a/y", "/a", "/b", "/c", ""}) {
+    rmdir((root + sub).c_str());
+  }
+}
+
+TEST(IoDelegateTest, ListsTheFilesOfATreeWithoutFollowingLinks) {
+  char dir[] = "/tmp/aidl_io_delegate_test_XXXXXX";
+  ASSERT_NE(nullptr, mkdtemp(dir));
+  const string root = dir;
+  ASSERT_EQ(0, mkdir((root + "/a").c_str(), 0700));
+  std::ofstream(root + "/a/1") << "1";
+  // A cycle back to the root, a second path to a, and a link to a file
+  ASSERT_EQ(0, symlink(root.c_str(), (root + "/a/up").c_str()));
+  ASSERT_EQ(0, symlink("a", (root + "/also_a").c_str()));
+  ASSERT_EQ(0, symlink("a/1", (root + "/2").c_str()));
+
+  IoDelegate io_delegate;
+  EXPECT_EQ((vector<string>{root + "/a/1"}), io_delegate.ListFiles(root));
+  // Links to files are listed in a directory, as FileIsReadable() finds them.
+  EXPECT_EQ((vector<string>{"2"}), io_delegate.ListDirectory(root));
+  EXPECT_EQ((vector<string>{"1"}), io_delegate.ListDirectory(root + "/also_a"));
+  EXPECT_EQ(vector<string>{}, io_delegate.ListDirectory(root + "/b"));
+
+  for (const char* path : {"/2", "/also_a", "/a/up", "/a/1"}) {
+    unlink((root + path).c_str());
+  }
+  for (const char* sub : {"/a", ""}) {
+    rmdir((root + sub).c_str());
+  }
+}
+
+TEST(IoDelegateTest, HashApiIgnoresLinksToDirectories) {
+  char dir[] = "/tmp/aidl_io_delegate_test_XXXXXX";
+  ASSERT_NE(nullptr, mkdtemp(dir));
+  const string root = dir;
+  for (const char* sub : {"/p", "/p/q"}) {
+    ASSERT_EQ(0, mkdir((root + sub).c_str(), 0700));
+  }
+  std::ofstream(root + "/p/IFoo.aidl") << "a\n";
+  std::ofstream(root + "/p/q/B.aidl") << "b\n";
+  ASSERT_EQ(0, symlink("p", (root + "/linked").c_str()));
+  // (find ./ -name "*.aidl" -print0 | LC_ALL=C sort -z | xargs -0 sha1sum && echo 3) |
+  //     sha1sum
+  // which doesn't follow linked/
+  std::ofstream(root + "/.hash") << "e931a56dcf12d9ed7874b86d834a9d3850dfab64\n";
+
+  IoDelegate io_delegate;
+  EXPECT_TRUE(hash_api(Options::From("aidl --hashapi=3 " + root), io_delegate));
+
+  for (const char* path : {"/.hash", "/linked", "/p/q/B.aidl", "/p/IFoo.aidl"}) {
+    unlink((root + path).c_str());
+  }
+  for (const char* sub : {"/p/q", "/p", ""}) {
+    rmdir((root + sub).c_str());
+  }
+}
+
+TEST(IoDelegateTest, ReadsFilesAhead) {
+  FakeIoDelegate fake;
+  vector<string> files;
+  for (int i = 0; i < 20; i++) {
+    files.push_back("f" + std::to_string(i));
+    fake.SetFileContents(files.back(), "contents of " + files.back());
+  }
+  fake.SetFileContents("other", "other");
+  files.push_back("missing");
+
+  for (size_t num_threads : {size_t(0), size_t(1), size_t(4)}) {
+    ReadAheadIoDelegate read_ahead(fake, files, num_threads);
+    // In any order, and again once they were taken
+    for (const char* file : {"f3", "f0", "f3", "f19", "other"}) {
+      std::unique_ptr<FileBuffer> buffer = read_ahead.GetFileBuffer(file);
+      ASSERT_NE(nullptr, buffer) << file;
+      EXPECT_EQ(*fake.GetFileContents(file), string(buffer->Data(), buffer->Size()));
+    }
+    EXPECT_EQ(nullptr, read_ahead.GetFileBuffer("missing"));
+    EXPECT_TRUE(read_ahead.FileIsReadable("f1"));
+    // The files that are never asked for are dropped with the delegate.
+  }
+}
+
 }  // namespace aidl
 }  // namespace android
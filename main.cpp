@@ -16,11 +16,48 @@
 
 #include "aidl.h"
 #include "aidl_checkapi.h"
+#include "aidl_language.h"
+#include "aidl_profile.h"
+#include "aidl_scandeps.h"
 #include "io_delegate.h"
 #include "logging.h"
 #include "options.h"
 
+#ifndef _WIN32
+#include "aidl_server.h"
+#endif
+
+#include <stdlib.h>
+
 #include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+// Allocations are counted for --profile. The other forms of operator new
+// and delete end up here as well.
+void* operator new(size_t size) {
+  android::aidl::CountAllocation(size);
+  void* p = malloc(size == 0 ? 1 : size);
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  android::aidl::CountAllocation(size);
+  return malloc(size == 0 ? 1 : size);
+}
+
+void operator delete(void* p) noexcept {
+  free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  free(p);
+}
 
 #ifdef AIDL_CPP_BUILD
 constexpr Options::Language kDefaultLang = Options::Language::CPP;
@@ -30,27 +67,143 @@ constexpr Options::Language kDefaultLang = Options::Language::JAVA;
 
 using android::aidl::Options;
 
-int process_options(const Options& options) {
+int process_options(const Options& options,
+                    android::aidl::CompileSession* session = nullptr) {
   android::aidl::IoDelegate io_delegate;
+  io_delegate.SetWriteIfChanged(options.WriteIfChanged());
   switch (options.GetTask()) {
     case Options::Task::COMPILE:
+      if (session != nullptr) {
+        return android::aidl::compile_aidl(options, io_delegate, session);
+      }
       return android::aidl::compile_aidl(options, io_delegate);
     case Options::Task::PREPROCESS:
       return android::aidl::preprocess_aidl(options, io_delegate) ? 0 : 1;
+    case Options::Task::PRECOMPILE:
+      return android::aidl::precompile_aidl(options, io_delegate) ? 0 : 1;
     case Options::Task::DUMP_API:
       return android::aidl::dump_api(options, io_delegate) ? 0 : 1;
+    case Options::Task::HASH_API:
+      return android::aidl::hash_api(options, io_delegate) ? 0 : 1;
     case Options::Task::CHECK_API:
       return android::aidl::check_api(options, io_delegate) ? 0 : 1;
     case Options::Task::DUMP_MAPPINGS:
       return android::aidl::dump_mappings(options, io_delegate) ? 0 : 1;
+    case Options::Task::SCAN_DEPS:
+      return android::aidl::scan_deps(options, io_delegate) ? 0 : 1;
     default:
       LOG(FATAL) << "aidl: internal error" << std::endl;
       return 1;
   }
 }
 
+int run_options(const Options& options, android::aidl::CompileSession* session = nullptr) {
+  Parser::SetHandWrittenLexer(options.HandWrittenLexer());
+  std::unique_ptr<android::aidl::Profile> profile;
+  if (!options.ProfileFile().empty()) {
+    profile = std::make_unique<android::aidl::Profile>();
+  }
+  std::unique_ptr<android::aidl::Stats> stats;
+  if (!options.StatsFile().empty()) {
+    stats = std::make_unique<android::aidl::Stats>();
+  }
+  std::unique_ptr<android::aidl::SizeReport> size_report;
+  if (!options.SizeReportFile().empty()) {
+    size_report = std::make_unique<android::aidl::SizeReport>();
+  }
+  int ret;
+  {
+    android::aidl::ProfileScope scope("aidl");
+    ret = process_options(options, session);
+  }
+  if (profile != nullptr) {
+    android::aidl::IoDelegate io_delegate;
+    android::aidl::CodeWriterPtr writer = io_delegate.GetCodeWriter(options.ProfileFile());
+    profile->WriteTrace(writer.get());
+    if (!writer->Close()) {
+      AIDL_ERROR(options.ProfileFile()) << "Can't write the profile.";
+      ret = 1;
+    }
+  }
+  if (stats != nullptr) {
+    android::aidl::IoDelegate io_delegate;
+    android::aidl::CodeWriterPtr writer = io_delegate.GetCodeWriter(options.StatsFile());
+    stats->WriteJson(writer.get());
+    if (!writer->Close()) {
+      AIDL_ERROR(options.StatsFile()) << "Can't write the stats.";
+      ret = 1;
+    }
+  }
+  if (size_report != nullptr) {
+    android::aidl::IoDelegate io_delegate;
+    android::aidl::CodeWriterPtr writer = io_delegate.GetCodeWriter(options.SizeReportFile());
+    size_report->WriteJson(writer.get());
+    if (!writer->Close()) {
+      AIDL_ERROR(options.SizeReportFile()) << "Can't write the size report.";
+      ret = 1;
+    }
+  }
+
+  // compiler invariants
+
+  // once AIDL_ERROR/AIDL_FATAL are used everywhere instead of std::cerr/LOG, we
+  // can make this assertion in both directions.
+  if (ret == 0) {
+    AIDL_FATAL_IF(AidlError::hadError(), "Compiler success, but error emitted");
+  }
+
+  return ret;
+}
+
+// Runs the jobs of --job-file in order, keeping the parsed files between them,
+// and stops at the first one that fails.
+int run_jobs(const Options& options) {
+  std::vector<Options> jobs;
+  std::string error;
+  if (!options.ReadJobs(&jobs, &error)) {
+    std::cerr << error;
+    return 1;
+  }
+  android::aidl::CompileSession session;
+  for (const Options& job : jobs) {
+    const int ret = run_options(job, &session);
+    if (ret != 0) {
+      return ret;
+    }
+  }
+  return 0;
+}
+
+#ifndef _WIN32
+// Runs the jobs sent by the clients, keeping the parsed files between them.
+int run_server(const Options& server_options) {
+  android::aidl::CompileSession session;
+  return android::aidl::run_server(
+      server_options.ServerSocket(), [&](const std::vector<std::string>& args) {
+        return android::aidl::run_server_job(args, kDefaultLang, [&](const Options& options) {
+          return run_options(options, &session);
+        });
+      });
+}
+
+// The command line without --connect, for the server to run.
+std::vector<std::string> forwarded_args(int argc, char* argv[]) {
+  std::vector<std::string> args;
+  for (int i = 0; i < argc; i++) {
+    const std::string arg = argv[i];
+    if (arg == "--connect") {
+      i++;  // skip the socket as well
+    } else if (arg.rfind("--connect=", 0) != 0) {
+      args.push_back(arg);
+    }
+  }
+  return args;
+}
+#endif
+
 int main(int argc, char* argv[]) {
-  android::base::InitLogging(argv);
+  // The messages of the parallel jobs are printed in the order of the jobs.
+  android::base::InitLogging(argv, ::AidlError::Logger);
   LOG(DEBUG) << "aidl starting";
 
   Options options(argc, argv, kDefaultLang);
@@ -59,16 +212,26 @@ int main(int argc, char* argv[]) {
     std::cerr << options.GetUsage();
     return 1;
   }
+  if (options.UsageRequested()) {
+    std::cerr << options.GetUsage();
+    return 0;
+  }
 
-  int ret = process_options(options);
-
-  // compiler invariants
-
-  // once AIDL_ERROR/AIDL_FATAL are used everywhere instead of std::cerr/LOG, we
-  // can make this assertion in both directions.
-  if (ret == 0) {
-    AIDL_FATAL_IF(AidlError::hadError(), "Compiler success, but error emitted");
+  if (options.GetTask() == Options::Task::JOBS) {
+    return run_jobs(options);
+  }
+#ifndef _WIN32
+  if (options.GetTask() == Options::Task::SERVER) {
+    return run_server(options);
   }
+  if (!options.ConnectSocket().empty()) {
+    int status;
+    if (android::aidl::run_client(options.ConnectSocket(), forwarded_args(argc, argv), &status)) {
+      return status;
+    }
+    // No server is running; do the job here.
+  }
+#endif
 
-  return ret;
+  return run_options(options);
 }
@@ -0,0 +1,180 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+// The table of transaction codes that --apimapping writes with
+// --apimapping-format=binary, which symbolizes the binder transactions of a
+// trace with a binary search, rather than by parsing the text mapping:
+//
+//   const android::aidl::mapping_table::Table table(mmapped_data, size);
+//   android::aidl::mapping_table::Method method;
+//   if (table.Find("foo.bar.IFoo", code, &method)) ...
+//
+// The table refers to the bytes that it was opened on, e.g. a mapping of the
+// file, and doesn't copy them.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+namespace android {
+namespace aidl {
+namespace mapping_table {
+
+// A method of the table. The views refer to the bytes of the table.
+struct Method {
+  std::string_view descriptor;  // of the interface, e.g. foo.bar.IFoo
+  uint32_t code;                // the transaction code
+  std::string_view name;
+  std::string_view signature;  // e.g. "void doFoo(int,java.lang.String)"
+  std::string_view arguments;  // the types, e.g. "int,java.lang.String"
+  bool oneway;
+};
+
+// The table starts with kMagic, the number of methods and the offset of the
+// strings, followed by the methods, sorted by descriptor and code, and the
+// strings. Each method is six 32-bit words: the offsets of its descriptor,
+// its code, the offsets of its name, its signature and its arguments, and its
+// flags. Each string is a 32-bit length and its bytes. Integers are little
+// endian.
+constexpr char kMagic[] = "AIDLMAP1";
+constexpr size_t kMagicSize = sizeof(kMagic) - 1;
+constexpr size_t kHeaderSize = kMagicSize + 8;
+constexpr size_t kMethodWords = 6;
+constexpr uint32_t kOneway = 1;
+
+inline void AppendWord(uint32_t value, std::string* out) {
+  for (size_t i = 0; i < 4; i++) {
+    out->push_back(static_cast<char>(value >> (8 * i)));
+  }
+}
+
+inline std::string Encode(std::vector<Method> methods) {
+  std::sort(methods.begin(), methods.end(), [](const Method& a, const Method& b) {
+    return std::tie(a.descriptor, a.code) < std::tie(b.descriptor, b.code);
+  });
+
+  // Each distinct string is written once
+  std::string strings;
+  std::map<std::string_view, uint32_t> offsets;
+  auto offset_of = [&](std::string_view s) {
+    auto [it, added] = offsets.emplace(s, strings.size());
+    if (added) {
+      AppendWord(s.size(), &strings);
+      strings.append(s.data(), s.size());
+    }
+    return it->second;
+  };
+
+  std::string out(kMagic, kMagicSize);
+  AppendWord(methods.size(), &out);
+  AppendWord(kHeaderSize + methods.size() * kMethodWords * 4, &out);
+  for (const Method& m : methods) {
+    AppendWord(offset_of(m.descriptor), &out);
+    AppendWord(m.code, &out);
+    AppendWord(offset_of(m.name), &out);
+    AppendWord(offset_of(m.signature), &out);
+    AppendWord(offset_of(m.arguments), &out);
+    AppendWord(m.oneway ? kOneway : 0, &out);
+  }
+  return out + strings;
+}
+
+class Table {
+ public:
+  // An empty table unless |data| is a whole table
+  Table(const void* data, size_t size) : data_(static_cast<const char*>(data)), size_(size) {
+    if (size_ < kHeaderSize || std::string_view(data_, kMagicSize) != kMagic) {
+      return;
+    }
+    const uint32_t count = Word(kMagicSize);
+    strings_ = Word(kMagicSize + 4);
+    if (strings_ > size_ || strings_ - kHeaderSize != size_t{count} * kMethodWords * 4) {
+      return;
+    }
+    // Each string must lie in the table
+    for (uint32_t i = 0; i < count; i++) {
+      for (size_t word : {0, 2, 3, 4}) {
+        if (!ValidString(Word(MethodOffset(i) + word * 4))) return;
+      }
+    }
+    count_ = count;
+  }
+
+  size_t size() const { return count_; }
+
+  Method At(size_t i) const {
+    const size_t offset = MethodOffset(i);
+    return Method{String(Word(offset)),      Word(offset + 4),
+                  String(Word(offset + 8)),  String(Word(offset + 12)),
+                  String(Word(offset + 16)), (Word(offset + 20) & kOneway) != 0};
+  }
+
+  // The method of |descriptor| with the transaction code |code|, if any
+  bool Find(std::string_view descriptor, uint32_t code, Method* method) const {
+    size_t low = 0;
+    size_t high = count_;
+    while (low < high) {
+      const size_t mid = low + (high - low) / 2;
+      const size_t offset = MethodOffset(mid);
+      if (std::make_tuple(String(Word(offset)), Word(offset + 4)) <
+          std::make_tuple(descriptor, code)) {
+        low = mid + 1;
+      } else {
+        high = mid;
+      }
+    }
+    if (low == count_) return false;
+    *method = At(low);
+    return method->descriptor == descriptor && method->code == code;
+  }
+
+ private:
+  size_t MethodOffset(size_t i) const { return kHeaderSize + i * kMethodWords * 4; }
+
+  uint32_t Word(size_t offset) const {
+    uint32_t value = 0;
+    for (size_t i = 0; i < 4; i++) {
+      value |= static_cast<uint32_t>(static_cast<uint8_t>(data_[offset + i])) << (8 * i);
+    }
+    return value;
+  }
+
+  bool ValidString(uint32_t offset) const {
+    const size_t start = strings_ + static_cast<size_t>(offset);
+    return start <= size_ && size_ - start >= 4 && size_ - start - 4 >= Word(start);
+  }
+
+  std::string_view String(uint32_t offset) const {
+    const size_t start = strings_ + static_cast<size_t>(offset);
+    return std::string_view(data_ + start + 4, Word(start));
+  }
+
+  const char* data_;
+  size_t size_;
+  size_t strings_ = 0;
+  size_t count_ = 0;
+};
+
+}  // namespace mapping_table
+}  // namespace aidl
+}  // namespace android
@@ -0,0 +1,270 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+// The marshalling programs of --marshal=tables. Rather than a call and a
+// status check for each argument of each method, the C++ and NDK proxies and
+// stubs pass the arguments of a request or a reply as an array of pointers to
+// one interpreter, with a program of the operations below that says what each
+// of them points to:
+//
+//   // int f(int a, float b, String c, out long[] d)
+//   constexpr uint8_t f_request[] = {kRun32, 2, kString, kSize | kInt64Vector, kEnd};
+//   constexpr uint8_t f_reply[] = {kInt32, kInt64Vector, kEnd};
+//
+// The interpreter is a template over an adapter of the parcel of a backend,
+// see aidl/marshal_parcel.h and aidl/marshal_ndk.h, which instantiate it once
+// per library. The layout in the parcel is the same as that of the generated
+// calls.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+namespace android {
+namespace aidl {
+namespace marshal {
+
+enum Op : uint8_t {
+  kEnd = 0,
+  kBool = 1,    // bool
+  kByte = 2,    // int8_t
+  kChar = 3,    // char16_t
+  kInt32 = 4,   // int32_t
+  kInt64 = 5,   // int64_t
+  kFloat = 6,   // float
+  kDouble = 7,  // double
+  // The String of the backend, ::android::String16 or std::string
+  kString = 8,
+  // A std::string that is written as UTF-16, @utf8InCpp in the C++ backend
+  kUtf8String = 9,
+  kBoolVector = 10,    // std::vector<bool>
+  kByteVector = 11,    // std::vector of the byte of the backend
+  kCharVector = 12,    // std::vector<char16_t>
+  kInt32Vector = 13,   // std::vector<int32_t>
+  kInt64Vector = 14,   // std::vector<int64_t>
+  kFloatVector = 15,   // std::vector<float>
+  kDoubleVector = 16,  // std::vector<double>
+  // Followed by the number N of the arguments of the run: N int32_t and
+  // float, or N int64_t and double, which the adapters copy at once
+  kRun32 = 17,
+  kRun64 = 18,
+
+  // On a vector, only its size: the request of an out array, to which the
+  // stub resizes the vector of the call
+  kSize = 0x80,
+};
+
+// Writes the arguments that |args| points to, as |program| says, with
+// |writer|. A Writer has the Status type of its parcel, with kOk and
+// kBadValue, and the writes
+//   Write(T) of bool, int8_t, char16_t, int32_t, int64_t, float, double,
+//   Write(const String&), WriteUtf8(const std::string&),
+//   Write(const std::vector<T>&), WriteSize(const std::vector<T>&) with the T
+//   of the vectors above and the Byte of the backend, and
+//   WriteRun(const void* const* args, size_t count, size_t size).
+template <typename Writer>
+typename Writer::Status WriteProgram(Writer& writer, const uint8_t* program,
+                                     const void* const* args) {
+  using Status = typename Writer::Status;
+  using String = typename Writer::String;
+  using Byte = typename Writer::Byte;
+  for (const uint8_t* op = program; *op != kEnd; op++) {
+    Status status = Writer::kOk;
+    switch (*op) {
+      case kBool:
+        status = writer.Write(*static_cast<const bool*>(*args++));
+        break;
+      case kByte:
+        status = writer.Write(*static_cast<const int8_t*>(*args++));
+        break;
+      case kChar:
+        status = writer.Write(*static_cast<const char16_t*>(*args++));
+        break;
+      case kInt32:
+        status = writer.Write(*static_cast<const int32_t*>(*args++));
+        break;
+      case kInt64:
+        status = writer.Write(*static_cast<const int64_t*>(*args++));
+        break;
+      case kFloat:
+        status = writer.Write(*static_cast<const float*>(*args++));
+        break;
+      case kDouble:
+        status = writer.Write(*static_cast<const double*>(*args++));
+        break;
+      case kString:
+        status = writer.Write(*static_cast<const String*>(*args++));
+        break;
+      case kUtf8String:
+        status = writer.WriteUtf8(*static_cast<const std::string*>(*args++));
+        break;
+      case kBoolVector:
+        status = writer.Write(*static_cast<const std::vector<bool>*>(*args++));
+        break;
+      case kByteVector:
+        status = writer.Write(*static_cast<const std::vector<Byte>*>(*args++));
+        break;
+      case kCharVector:
+        status = writer.Write(*static_cast<const std::vector<char16_t>*>(*args++));
+        break;
+      case kInt32Vector:
+        status = writer.Write(*static_cast<const std::vector<int32_t>*>(*args++));
+        break;
+      case kInt64Vector:
+        status = writer.Write(*static_cast<const std::vector<int64_t>*>(*args++));
+        break;
+      case kFloatVector:
+        status = writer.Write(*static_cast<const std::vector<float>*>(*args++));
+        break;
+      case kDoubleVector:
+        status = writer.Write(*static_cast<const std::vector<double>*>(*args++));
+        break;
+      case kRun32:
+      case kRun64:
+        status = writer.WriteRun(args, op[1], *op == kRun32 ? 4 : 8);
+        args += op[1];
+        op++;
+        break;
+      case kSize | kBoolVector:
+        status = writer.WriteSize(*static_cast<const std::vector<bool>*>(*args++));
+        break;
+      case kSize | kByteVector:
+        status = writer.WriteSize(*static_cast<const std::vector<Byte>*>(*args++));
+        break;
+      case kSize | kCharVector:
+        status = writer.WriteSize(*static_cast<const std::vector<char16_t>*>(*args++));
+        break;
+      case kSize | kInt32Vector:
+        status = writer.WriteSize(*static_cast<const std::vector<int32_t>*>(*args++));
+        break;
+      case kSize | kInt64Vector:
+        status = writer.WriteSize(*static_cast<const std::vector<int64_t>*>(*args++));
+        break;
+      case kSize | kFloatVector:
+        status = writer.WriteSize(*static_cast<const std::vector<float>*>(*args++));
+        break;
+      case kSize | kDoubleVector:
+        status = writer.WriteSize(*static_cast<const std::vector<double>*>(*args++));
+        break;
+      default:
+        return Writer::kBadValue;
+    }
+    if (status != Writer::kOk) return status;
+  }
+  return Writer::kOk;
+}
+
+// Reads the arguments that |args| points to, as |program| says, with
+// |reader|, which has the reads that match the writes of a Writer:
+//   Read(T*), ReadUtf8(std::string*), Read(std::vector<T>*),
+//   Resize(std::vector<T>*) and ReadRun(void* const* args, count, size).
+template <typename Reader>
+typename Reader::Status ReadProgram(Reader& reader, const uint8_t* program, void* const* args) {
+  using Status = typename Reader::Status;
+  using String = typename Reader::String;
+  using Byte = typename Reader::Byte;
+  for (const uint8_t* op = program; *op != kEnd; op++) {
+    Status status = Reader::kOk;
+    switch (*op) {
+      case kBool:
+        status = reader.Read(static_cast<bool*>(*args++));
+        break;
+      case kByte:
+        status = reader.Read(static_cast<int8_t*>(*args++));
+        break;
+      case kChar:
+        status = reader.Read(static_cast<char16_t*>(*args++));
+        break;
+      case kInt32:
+        status = reader.Read(static_cast<int32_t*>(*args++));
+        break;
+      case kInt64:
+        status = reader.Read(static_cast<int64_t*>(*args++));
+        break;
+      case kFloat:
+        status = reader.Read(static_cast<float*>(*args++));
+        break;
+      case kDouble:
+        status = reader.Read(static_cast<double*>(*args++));
+        break;
+      case kString:
+        status = reader.Read(static_cast<String*>(*args++));
+        break;
+      case kUtf8String:
+        status = reader.ReadUtf8(static_cast<std::string*>(*args++));
+        break;
+      case kBoolVector:
+        status = reader.Read(static_cast<std::vector<bool>*>(*args++));
+        break;
+      case kByteVector:
+        status = reader.Read(static_cast<std::vector<Byte>*>(*args++));
+        break;
+      case kCharVector:
+        status = reader.Read(static_cast<std::vector<char16_t>*>(*args++));
+        break;
+      case kInt32Vector:
+        status = reader.Read(static_cast<std::vector<int32_t>*>(*args++));
+        break;
+      case kInt64Vector:
+        status = reader.Read(static_cast<std::vector<int64_t>*>(*args++));
+        break;
+      case kFloatVector:
+        status = reader.Read(static_cast<std::vector<float>*>(*args++));
+        break;
+      case kDoubleVector:
+        status = reader.Read(static_cast<std::vector<double>*>(*args++));
+        break;
+      case kRun32:
+      case kRun64:
+        status = reader.ReadRun(args, op[1], *op == kRun32 ? 4 : 8);
+        args += op[1];
+        op++;
+        break;
+      case kSize | kBoolVector:
+        status = reader.Resize(static_cast<std::vector<bool>*>(*args++));
+        break;
+      case kSize | kByteVector:
+        status = reader.Resize(static_cast<std::vector<Byte>*>(*args++));
+        break;
+      case kSize | kCharVector:
+        status = reader.Resize(static_cast<std::vector<char16_t>*>(*args++));
+        break;
+      case kSize | kInt32Vector:
+        status = reader.Resize(static_cast<std::vector<int32_t>*>(*args++));
+        break;
+      case kSize | kInt64Vector:
+        status = reader.Resize(static_cast<std::vector<int64_t>*>(*args++));
+        break;
+      case kSize | kFloatVector:
+        status = reader.Resize(static_cast<std::vector<float>*>(*args++));
+        break;
+      case kSize | kDoubleVector:
+        status = reader.Resize(static_cast<std::vector<double>*>(*args++));
+        break;
+      default:
+        return Reader::kBadValue;
+    }
+    if (status != Reader::kOk) return status;
+  }
+  return Reader::kOk;
+}
+
+}  // namespace marshal
+}  // namespace aidl
+}  // namespace android
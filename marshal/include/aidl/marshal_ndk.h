@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+// The marshalling programs of aidl/marshal.h over an AParcel, for the NDK
+// backend. AParcel cannot point into its data, so the runs of primitives are
+// written and read one by one, still without a call of its own in the code of
+// each method.
+
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include <aidl/marshal.h>
+#include <android/binder_parcel_utils.h>
+
+namespace android {
+namespace aidl {
+namespace marshal {
+
+class AParcelWriter {
+ public:
+  using Status = binder_status_t;
+  using String = std::string;
+  using Byte = int8_t;
+  static constexpr binder_status_t kOk = STATUS_OK;
+  static constexpr binder_status_t kBadValue = STATUS_BAD_VALUE;
+
+  explicit AParcelWriter(AParcel* parcel) : parcel_(parcel) {}
+
+  binder_status_t Write(bool value) { return AParcel_writeBool(parcel_, value); }
+  binder_status_t Write(int8_t value) { return AParcel_writeByte(parcel_, value); }
+  binder_status_t Write(char16_t value) { return AParcel_writeChar(parcel_, value); }
+  binder_status_t Write(int32_t value) { return AParcel_writeInt32(parcel_, value); }
+  binder_status_t Write(int64_t value) { return AParcel_writeInt64(parcel_, value); }
+  binder_status_t Write(float value) { return AParcel_writeFloat(parcel_, value); }
+  binder_status_t Write(double value) { return AParcel_writeDouble(parcel_, value); }
+  binder_status_t Write(const std::string& value) {
+    return ::ndk::AParcel_writeString(parcel_, value);
+  }
+  binder_status_t WriteUtf8(const std::string& value) { return Write(value); }
+  template <typename T>
+  binder_status_t Write(const std::vector<T>& value) {
+    return ::ndk::AParcel_writeVector(parcel_, value);
+  }
+  template <typename T>
+  binder_status_t WriteSize(const std::vector<T>& value) {
+    return ::ndk::AParcel_writeVectorSize(parcel_, value);
+  }
+
+  binder_status_t WriteRun(const void* const* args, size_t count, size_t size) {
+    for (size_t i = 0; i < count; i++) {
+      binder_status_t status;
+      if (size == sizeof(int32_t)) {
+        int32_t value;
+        memcpy(&value, args[i], sizeof(value));
+        status = AParcel_writeInt32(parcel_, value);
+      } else {
+        int64_t value;
+        memcpy(&value, args[i], sizeof(value));
+        status = AParcel_writeInt64(parcel_, value);
+      }
+      if (status != STATUS_OK) return status;
+    }
+    return STATUS_OK;
+  }
+
+ private:
+  AParcel* const parcel_;
+};
+
+class AParcelReader {
+ public:
+  using Status = binder_status_t;
+  using String = std::string;
+  using Byte = int8_t;
+  static constexpr binder_status_t kOk = STATUS_OK;
+  static constexpr binder_status_t kBadValue = STATUS_BAD_VALUE;
+
+  explicit AParcelReader(const AParcel* parcel) : parcel_(parcel) {}
+
+  binder_status_t Read(bool* value) { return AParcel_readBool(parcel_, value); }
+  binder_status_t Read(int8_t* value) { return AParcel_readByte(parcel_, value); }
+  binder_status_t Read(char16_t* value) { return AParcel_readChar(parcel_, value); }
+  binder_status_t Read(int32_t* value) { return AParcel_readInt32(parcel_, value); }
+  binder_status_t Read(int64_t* value) { return AParcel_readInt64(parcel_, value); }
+  binder_status_t Read(float* value) { return AParcel_readFloat(parcel_, value); }
+  binder_status_t Read(double* value) { return AParcel_readDouble(parcel_, value); }
+  binder_status_t Read(std::string* value) { return ::ndk::AParcel_readString(parcel_, value); }
+  binder_status_t ReadUtf8(std::string* value) { return Read(value); }
+  template <typename T>
+  binder_status_t Read(std::vector<T>* value) {
+    return ::ndk::AParcel_readVector(parcel_, value);
+  }
+  template <typename T>
+  binder_status_t Resize(std::vector<T>* value) {
+    return ::ndk::AParcel_resizeVector(parcel_, value);
+  }
+
+  binder_status_t ReadRun(void* const* args, size_t count, size_t size) {
+    for (size_t i = 0; i < count; i++) {
+      binder_status_t status;
+      if (size == sizeof(int32_t)) {
+        int32_t value;
+        status = AParcel_readInt32(parcel_, &value);
+        memcpy(args[i], &value, sizeof(value));
+      } else {
+        int64_t value;
+        status = AParcel_readInt64(parcel_, &value);
+        memcpy(args[i], &value, sizeof(value));
+      }
+      if (status != STATUS_OK) return status;
+    }
+    return STATUS_OK;
+  }
+
+ private:
+  const AParcel* const parcel_;
+};
+
+// The entry points of the proxies and the stubs, which stay out of line so
+// that a library has a single copy of the interpreter
+__attribute__((noinline)) inline binder_status_t Write(AParcel* parcel, const uint8_t* program,
+                                                       const void* const* args) {
+  AParcelWriter writer(parcel);
+  return WriteProgram(writer, program, args);
+}
+
+__attribute__((noinline)) inline binder_status_t Read(const AParcel* parcel,
+                                                      const uint8_t* program,
+                                                      void* const* args) {
+  AParcelReader reader(parcel);
+  return ReadProgram(reader, program, args);
+}
+
+}  // namespace marshal
+}  // namespace aidl
+}  // namespace android
@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+// The marshalling programs of aidl/marshal.h over a ::android::Parcel, for
+// the C++ backend. The runs of primitives are copied in and out of the parcel
+// at once, between a single check of its size.
+
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include <aidl/marshal.h>
+#include <binder/Parcel.h>
+#include <utils/String16.h>
+
+namespace android {
+namespace aidl {
+namespace marshal {
+
+class ParcelWriter {
+ public:
+  using Status = status_t;
+  using String = String16;
+  using Byte = uint8_t;
+  static constexpr status_t kOk = OK;
+  static constexpr status_t kBadValue = BAD_VALUE;
+
+  explicit ParcelWriter(Parcel* parcel) : parcel_(parcel) {}
+
+  status_t Write(bool value) { return parcel_->writeBool(value); }
+  status_t Write(int8_t value) { return parcel_->writeByte(value); }
+  status_t Write(char16_t value) { return parcel_->writeChar(value); }
+  status_t Write(int32_t value) { return parcel_->writeInt32(value); }
+  status_t Write(int64_t value) { return parcel_->writeInt64(value); }
+  status_t Write(float value) { return parcel_->writeFloat(value); }
+  status_t Write(double value) { return parcel_->writeDouble(value); }
+  status_t Write(const String16& value) { return parcel_->writeString16(value); }
+  status_t WriteUtf8(const std::string& value) { return parcel_->writeUtf8AsUtf16(value); }
+  status_t Write(const std::vector<bool>& value) { return parcel_->writeBoolVector(value); }
+  status_t Write(const std::vector<uint8_t>& value) { return parcel_->writeByteVector(value); }
+  status_t Write(const std::vector<char16_t>& value) { return parcel_->writeCharVector(value); }
+  status_t Write(const std::vector<int32_t>& value) { return parcel_->writeInt32Vector(value); }
+  status_t Write(const std::vector<int64_t>& value) { return parcel_->writeInt64Vector(value); }
+  status_t Write(const std::vector<float>& value) { return parcel_->writeFloatVector(value); }
+  status_t Write(const std::vector<double>& value) { return parcel_->writeDoubleVector(value); }
+  template <typename T>
+  status_t WriteSize(const std::vector<T>& value) {
+    return parcel_->writeVectorSize(value);
+  }
+
+  status_t WriteRun(const void* const* args, size_t count, size_t size) {
+    uint8_t* data = static_cast<uint8_t*>(parcel_->writeInplace(count * size));
+    if (data == nullptr) return NO_MEMORY;
+    for (size_t i = 0; i < count; i++) {
+      memcpy(data + i * size, args[i], size);
+    }
+    return OK;
+  }
+
+ private:
+  Parcel* const parcel_;
+};
+
+class ParcelReader {
+ public:
+  using Status = status_t;
+  using String = String16;
+  using Byte = uint8_t;
+  static constexpr status_t kOk = OK;
+  static constexpr status_t kBadValue = BAD_VALUE;
+
+  explicit ParcelReader(const Parcel& parcel) : parcel_(parcel) {}
+
+  status_t Read(bool* value) { return parcel_.readBool(value); }
+  status_t Read(int8_t* value) { return parcel_.readByte(value); }
+  status_t Read(char16_t* value) { return parcel_.readChar(value); }
+  status_t Read(int32_t* value) { return parcel_.readInt32(value); }
+  status_t Read(int64_t* value) { return parcel_.readInt64(value); }
+  status_t Read(float* value) { return parcel_.readFloat(value); }
+  status_t Read(double* value) { return parcel_.readDouble(value); }
+  status_t Read(String16* value) { return parcel_.readString16(value); }
+  status_t ReadUtf8(std::string* value) { return parcel_.readUtf8FromUtf16(value); }
+  status_t Read(std::vector<bool>* value) { return parcel_.readBoolVector(value); }
+  status_t Read(std::vector<uint8_t>* value) { return parcel_.readByteVector(value); }
+  status_t Read(std::vector<char16_t>* value) { return parcel_.readCharVector(value); }
+  status_t Read(std::vector<int32_t>* value) { return parcel_.readInt32Vector(value); }
+  status_t Read(std::vector<int64_t>* value) { return parcel_.readInt64Vector(value); }
+  status_t Read(std::vector<float>* value) { return parcel_.readFloatVector(value); }
+  status_t Read(std::vector<double>* value) { return parcel_.readDoubleVector(value); }
+  template <typename T>
+  status_t Resize(std::vector<T>* value) {
+    return parcel_.resizeOutVector(value);
+  }
+
+  status_t ReadRun(void* const* args, size_t count, size_t size) {
+    // Fails like the reads of the values one by one would
+    if (parcel_.dataAvail() < count * size) return NOT_ENOUGH_DATA;
+    const uint8_t* data = static_cast<const uint8_t*>(parcel_.readInplace(count * size));
+    if (data == nullptr) return BAD_VALUE;
+    for (size_t i = 0; i < count; i++) {
+      memcpy(args[i], data + i * size, size);
+    }
+    return OK;
+  }
+
+ private:
+  const Parcel& parcel_;
+};
+
+// The entry points of the proxies and the stubs, which stay out of line so
+// that a library has a single copy of the interpreter
+__attribute__((noinline)) inline status_t Write(Parcel* parcel, const uint8_t* program,
+                                                const void* const* args) {
+  ParcelWriter writer(parcel);
+  return WriteProgram(writer, program, args);
+}
+
+__attribute__((noinline)) inline status_t Read(const Parcel& parcel, const uint8_t* program,
+                                               void* const* args) {
+  ParcelReader reader(parcel);
+  return ReadProgram(reader, program, args);
+}
+
+}  // namespace marshal
+}  // namespace aidl
+}  // namespace android
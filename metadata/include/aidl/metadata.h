@@ -16,11 +16,36 @@
 
 #pragma once
 
+#include <stddef.h>
+
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace android {
 
+// A range of the constant tables that the metadata is generated into
+template <typename T>
+struct AidlMetadataList {
+  const T* data;
+  size_t size;
+
+  const T* begin() const { return data; }
+  const T* end() const { return data + size; }
+  const T& operator[](size_t i) const { return data[i]; }
+};
+
+// An interface of AidlInterfaceMetadata::all(), which refers to the tables
+// that it is generated into rather than copy them
+struct AidlInterfaceMetadataView {
+  std::string_view name;
+  std::string_view stability;
+  AidlMetadataList<std::string_view> types;
+  AidlMetadataList<std::string_view> hashes;
+
+  bool hasHash(std::string_view hash) const;
+};
+
 struct AidlInterfaceMetadata {
   // name of module defining package
   std::string name;
@@ -34,7 +59,21 @@ struct AidlInterfaceMetadata {
   // list of all hashes
   std::vector<std::string> hashes;
 
+  // Copies all the interfaces. The lookups below don't allocate, and take a
+  // constant time through the hash indexes generated with the tables.
   static std::vector<AidlInterfaceMetadata> all();
+
+  static AidlMetadataList<AidlInterfaceMetadataView> views();
+
+  // The interface of the module |name|, or nullptr
+  static const AidlInterfaceMetadataView* find(std::string_view name);
+
+  // The interface that has the type |fqname|, e.g. android.hardware.foo.IFoo,
+  // or nullptr
+  static const AidlInterfaceMetadataView* findByType(std::string_view fqname);
+
+  // Whether the module |name| has a version with the hash |hash|
+  static bool hasHash(std::string_view name, std::string_view hash);
 };
 
 }  // namespace android
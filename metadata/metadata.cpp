@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <aidl/metadata.h>
+
+#include "tables.h"
+
+namespace android {
+
+using aidl_metadata::kEmptySlot;
+using aidl_metadata::kInterfaces;
+using aidl_metadata::Slot;
+
+namespace {
+
+// The slot of |key| in |index|, whose item |key_of| returns the key of, or
+// nullptr
+template <typename KeyOf>
+const Slot* Lookup(const Slot* index, size_t size, std::string_view key, KeyOf key_of) {
+  if (size == 0) return nullptr;
+  for (size_t i = aidl_metadata::Hash(key) & (size - 1);; i = (i + 1) & (size - 1)) {
+    const Slot& slot = index[i];
+    if (slot.interface == kEmptySlot) return nullptr;
+    if (key_of(slot) == key) return &slot;
+  }
+}
+
+}  // namespace
+
+bool AidlInterfaceMetadataView::hasHash(std::string_view hash) const {
+  for (std::string_view h : hashes) {
+    if (h == hash) return true;
+  }
+  return false;
+}
+
+std::vector<AidlInterfaceMetadata> AidlInterfaceMetadata::all() {
+  std::vector<AidlInterfaceMetadata> interfaces;
+  interfaces.reserve(aidl_metadata::kInterfaceCount);
+  for (const AidlInterfaceMetadataView& view : views()) {
+    interfaces.push_back(AidlInterfaceMetadata{
+        std::string(view.name),
+        std::string(view.stability),
+        std::vector<std::string>(view.types.begin(), view.types.end()),
+        std::vector<std::string>(view.hashes.begin(), view.hashes.end()),
+    });
+  }
+  return interfaces;
+}
+
+AidlMetadataList<AidlInterfaceMetadataView> AidlInterfaceMetadata::views() {
+  return {kInterfaces, aidl_metadata::kInterfaceCount};
+}
+
+const AidlInterfaceMetadataView* AidlInterfaceMetadata::find(std::string_view name) {
+  const Slot* slot =
+      Lookup(aidl_metadata::kNameIndex, aidl_metadata::kNameIndexSize, name,
+             [](const Slot& s) { return kInterfaces[s.interface].name; });
+  return slot != nullptr ? &kInterfaces[slot->interface] : nullptr;
+}
+
+const AidlInterfaceMetadataView* AidlInterfaceMetadata::findByType(std::string_view fqname) {
+  const Slot* slot =
+      Lookup(aidl_metadata::kTypeIndex, aidl_metadata::kTypeIndexSize, fqname,
+             [](const Slot& s) { return kInterfaces[s.interface].types[s.item]; });
+  return slot != nullptr ? &kInterfaces[slot->interface] : nullptr;
+}
+
+bool AidlInterfaceMetadata::hasHash(std::string_view name, std::string_view hash) {
+  const AidlInterfaceMetadataView* view = find(name);
+  return view != nullptr && view->hasHash(hash);
+}
+
+}  // namespace android
@@ -14,11 +14,65 @@
  * limitations under the License.
  */
 
+#include <stdint.h>
+
 #include <fstream>
 #include <iostream>
+#include <string>
+#include <vector>
 
 #include <json/json.h>
 
+#include "tables.h"
+
+using android::aidl_metadata::Hash;
+using android::aidl_metadata::kEmptySlot;
+using android::aidl_metadata::Slot;
+
+namespace {
+
+// The hash index of |keys|, whose slots refer to |items|
+std::vector<Slot> BuildIndex(const std::vector<std::string>& keys, const std::vector<Slot>& items) {
+  size_t size = 1;
+  while (size < keys.size() * 2) size *= 2;
+  std::vector<Slot> index(size, Slot{kEmptySlot, 0});
+  for (size_t k = 0; k < keys.size(); k++) {
+    size_t i = Hash(keys[k]) & (size - 1);
+    while (index[i].interface != kEmptySlot) i = (i + 1) & (size - 1);
+    index[i] = items[k];
+  }
+  return index;
+}
+
+void PrintIndex(const char* name, const std::vector<Slot>& index) {
+  std::cout << "const Slot " << name << "[] = {" << std::endl;
+  for (const Slot& slot : index) {
+    if (slot.interface == kEmptySlot) {
+      std::cout << "{kEmptySlot, 0}," << std::endl;
+    } else {
+      std::cout << "{" << slot.interface << ", " << slot.item << "}," << std::endl;
+    }
+  }
+  std::cout << "};" << std::endl;
+  std::cout << "const size_t " << name << "Size = " << index.size() << ";" << std::endl;
+}
+
+// The constant array |name| of |values|, and the AidlMetadataList of it
+std::string PrintList(const std::string& name, const Json::Value& values) {
+  if (values.empty()) {
+    return "{nullptr, 0}";
+  }
+  std::cout << "constexpr std::string_view " << name << "[] = {" << std::endl;
+  for (const Json::Value& value : values) {
+    // AIDL interface characters guaranteed to be accepted in C++ string
+    std::cout << "\"" << value.asString() << "\"," << std::endl;
+  }
+  std::cout << "};" << std::endl;
+  return "{" + name + ", " + std::to_string(values.size()) + "}";
+}
+
+}  // namespace
+
 int main(int argc, char** argv) {
   if (argc != 2) {
     std::cerr << "Usage: aidl_metadata_parser *.json" << std::endl;
@@ -36,29 +90,45 @@ int main(int argc, char** argv) {
     return EXIT_FAILURE;
   }
 
-  std::cout << "#include <aidl/metadata.h>" << std::endl;
+  // The tables of the interfaces, and the indexes of their names and types,
+  // which the lookups of metadata.cpp read without allocating
+  std::cout << "#include \"tables.h\"" << std::endl;
   std::cout << "namespace android {" << std::endl;
-  std::cout << "std::vector<AidlInterfaceMetadata> AidlInterfaceMetadata::all() {" << std::endl;
-  std::cout << "return std::vector<AidlInterfaceMetadata>{" << std::endl;
+  std::cout << "namespace aidl_metadata {" << std::endl;
+  std::cout << "namespace {" << std::endl;
+  std::vector<std::string> interfaces;
+  std::vector<std::string> names;
+  std::vector<Slot> name_slots;
+  std::vector<std::string> types;
+  std::vector<Slot> type_slots;
   for (const Json::Value& entry : root) {
-    std::cout << "AidlInterfaceMetadata{" << std::endl;
-    // AIDL interface characters guaranteed to be accepted in C++ string
-    std::cout << "std::string(\"" << entry["name"].asString() << "\")," << std::endl;
-    std::cout << "std::string(\"" << entry["stability"].asString() << "\")," << std::endl;
-    std::cout << "std::vector<std::string>{" << std::endl;
-    for (const Json::Value& intf : entry["types"]) {
-      std::cout << "std::string(\"" << intf.asString() << "\")," << std::endl;
-    }
-    std::cout << "}," << std::endl;
-    std::cout << "std::vector<std::string>{" << std::endl;
-    for (const Json::Value& intf : entry["hashes"]) {
-      std::cout << "std::string(\"" << intf.asString() << "\")," << std::endl;
+    const uint32_t i = interfaces.size();
+    const std::string name = entry["name"].asString();
+    const std::string type_list = PrintList("kTypes" + std::to_string(i), entry["types"]);
+    const std::string hash_list = PrintList("kHashes" + std::to_string(i), entry["hashes"]);
+    interfaces.push_back("{\"" + name + "\", \"" + entry["stability"].asString() + "\", " +
+                         type_list + ", " + hash_list + "}");
+    names.push_back(name);
+    name_slots.push_back(Slot{i, 0});
+    uint32_t item = 0;
+    for (const Json::Value& type : entry["types"]) {
+      type_slots.push_back(Slot{i, item++});
+      types.push_back(type.asString());
     }
-    std::cout << "}," << std::endl;
-    std::cout << "}," << std::endl;
+  }
+  std::cout << "}  // namespace" << std::endl;
+  std::cout << "const AidlInterfaceMetadataView kInterfaces[] = {" << std::endl;
+  for (const std::string& interface : interfaces) {
+    std::cout << interface << "," << std::endl;
+  }
+  if (interfaces.empty()) {
+    std::cout << "{}," << std::endl;
   }
   std::cout << "};" << std::endl;
-  std::cout << "}" << std::endl;
+  std::cout << "const size_t kInterfaceCount = " << interfaces.size() << ";" << std::endl;
+  PrintIndex("kNameIndex", BuildIndex(names, name_slots));
+  PrintIndex("kTypeIndex", BuildIndex(types, type_slots));
+  std::cout << "}  // namespace aidl_metadata" << std::endl;
   std::cout << "}  // namespace android" << std::endl;
   return EXIT_SUCCESS;
 }
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+// The tables that aidl_metadata_parser generates metadata.cpp into, shared
+// by the parser and the lookups of libaidlmetadata
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string_view>
+
+#include <aidl/metadata.h>
+
+namespace android {
+namespace aidl_metadata {
+
+// A slot of a hash index: the interface, and the type of the interface for
+// the index of the types. The indexes have a power of two of slots, at least
+// twice as many as their keys, and resolve collisions with linear probing.
+struct Slot {
+  uint32_t interface;
+  uint32_t item;
+};
+
+constexpr uint32_t kEmptySlot = UINT32_MAX;
+
+// FNV-1a, which the parser hashes the keys with as well
+constexpr uint32_t Hash(std::string_view key) {
+  uint32_t hash = 2166136261u;
+  for (char c : key) {
+    hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+  }
+  return hash;
+}
+
+extern const AidlInterfaceMetadataView kInterfaces[];
+extern const size_t kInterfaceCount;
+extern const Slot kNameIndex[];
+extern const size_t kNameIndexSize;
+extern const Slot kTypeIndex[];
+extern const size_t kTypeIndexSize;
+
+}  // namespace aidl_metadata
+}  // namespace android
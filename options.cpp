@@ -18,6 +18,7 @@
 #include "logging.h"
 #include "os.h"
 
+#include <ctype.h>
 #include <getopt.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -26,33 +27,192 @@
 #include <sstream>
 #include <string>
 
+#include <android-base/file.h>
+#include <android-base/parseint.h>
 #include <android-base/strings.h>
 
 using android::base::Split;
 using android::base::Trim;
 using std::endl;
 using std::string;
+using std::vector;
 
 namespace android {
 namespace aidl {
 
+namespace {
+
+bool LanguageFromString(const string& name, Options::Language* language) {
+  if (name == "java") {
+    *language = Options::Language::JAVA;
+  } else if (name == "cpp") {
+    *language = Options::Language::CPP;
+  } else if (name == "ndk") {
+    *language = Options::Language::NDK;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// Response files can name other response files, up to this depth.
+constexpr int kMaxResponseFileDepth = 8;
+
+// Splits |text| into arguments at whitespace. Quotes keep the whitespace
+// between them in one argument, and a backslash escapes a whitespace, a quote
+// or a backslash after it, so that backslashes in Windows paths stay as they
+// are.
+vector<string> SplitArgs(const string& text) {
+  auto escapable = [](char c) { return isspace(c) || c == '"' || c == '\'' || c == '\\'; };
+  vector<string> args;
+  string arg;
+  bool in_arg = false;
+  char quote = '\0';
+  for (size_t i = 0; i < text.size(); i++) {
+    const char c = text[i];
+    if (quote != '\0') {
+      if (c == quote) {
+        quote = '\0';
+      } else if (c == '\\' && quote == '"' && i + 1 < text.size() &&
+                 (text[i + 1] == '"' || text[i + 1] == '\\')) {
+        arg += text[++i];
+      } else {
+        arg += c;
+      }
+    } else if (isspace(c)) {
+      if (in_arg) {
+        args.push_back(arg);
+        arg.clear();
+        in_arg = false;
+      }
+    } else {
+      in_arg = true;
+      if (c == '"' || c == '\'') {
+        quote = c;
+      } else if (c == '\\' && i + 1 < text.size() && escapable(text[i + 1])) {
+        arg += text[++i];
+      } else {
+        arg += c;
+      }
+    }
+  }
+  if (in_arg) {
+    args.push_back(arg);
+  }
+  return args;
+}
+
+// Appends |args| to |out|, with each "@FILE" replaced by the arguments in
+// FILE. Returns false, with the reason in |error|, if a file can't be read.
+bool ExpandResponseFiles(const vector<string>& args, int depth, vector<string>* out,
+                         std::ostream& error) {
+  for (const string& arg : args) {
+    if (arg.size() < 2 || arg[0] != '@') {
+      out->push_back(arg);
+      continue;
+    }
+    const string file = arg.substr(1);
+    if (depth >= kMaxResponseFileDepth) {
+      error << "Response files are nested too deeply at '" << file << "'." << endl;
+      return false;
+    }
+    string contents;
+    if (!android::base::ReadFileToString(file, &contents)) {
+      error << "Can't read response file '" << file << "'." << endl;
+      return false;
+    }
+    if (!ExpandResponseFiles(SplitArgs(contents), depth + 1, out, error)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Parses the DIR of --out and --header_out, which may be prefixed with the
+// language it is for, e.g. "cpp:gen/cpp". The DIR always ends with a path
+// separator. Returns the language, or UNSPECIFIED.
+Options::Language ParseOutputDir(const string& arg, string* dir) {
+  Options::Language language = Options::Language::UNSPECIFIED;
+  *dir = Trim(arg);
+  const size_t colon = dir->find(':');
+  if (colon != string::npos && LanguageFromString(dir->substr(0, colon), &language)) {
+    dir->erase(0, colon + 1);
+  }
+  if (!dir->empty() && dir->back() != OS_PATH_SEPARATOR) {
+    dir->push_back(OS_PATH_SEPARATOR);
+  }
+  return language;
+}
+
+}  // namespace
+
+vector<Options::Language> Options::TargetLanguages() const {
+  if (languages_.empty()) {
+    return {language_};
+  }
+  return languages_;
+}
+
+Options Options::ForLanguage(Language language) const {
+  Options options(*this);
+  options.language_ = language;
+  options.languages_ = {language};
+  if (auto it = language_output_dirs_.find(language); it != language_output_dirs_.end()) {
+    options.output_dir_ = it->second;
+  }
+  if (auto it = language_output_header_dirs_.find(language);
+      it != language_output_header_dirs_.end()) {
+    options.output_header_dir_ = it->second;
+  } else if (language == Language::JAVA) {
+    // A shared --header_out is for the C++ backends.
+    options.output_header_dir_.clear();
+  }
+  options.language_output_dirs_.clear();
+  options.language_output_header_dirs_.clear();
+  return options;
+}
+
 string Options::GetUsage() const {
   std::ostringstream sstr;
   sstr << "usage:" << endl
-       << myname_ << " --lang={java|cpp|ndk} [OPTION]... INPUT..." << endl
-       << "   Generate Java or C++ files for AIDL file(s)." << endl
+       << myname_ << " --lang={java|cpp|ndk}[,...] [OPTION]... INPUT..." << endl
+       << "   Generate Java or C++ files for AIDL file(s). The files for several" << endl
+       << "   languages are generated from a single parse." << endl
        << endl
        << myname_ << " --preprocess OUTPUT INPUT..." << endl
        << "   Create an AIDL file having declarations of AIDL file(s)." << endl
        << endl
+       << myname_ << " --precompile OUTPUT INPUT..." << endl
+       << "   Create a binary module having the types of AIDL file(s)." << endl
+       << endl
+       << myname_ << " --scan-deps [-d FILE] INPUT..." << endl
+       << "   List the files that each INPUT imports, directly or through other" << endl
+       << "   imports, to FILE or stdout without compiling. One line per INPUT:" << endl
+       << "   INPUT : FILE..." << endl
+       << endl
 #ifndef _WIN32
        << myname_ << " --dumpapi --out=DIR INPUT..." << endl
        << "   Dump API signature of AIDL file(s) to DIR." << endl
        << endl
-       << myname_ << " --checkapi OLD_DIR NEW_DIR" << endl
+       << myname_ << " --hashapi=VERSION DIR" << endl
+       << "   Checks that DIR/.hash is the hash of API dump DIR at VERSION." << endl
+       << endl
+       << myname_ << " --checkapi OLD_DIR NEW_DIR..." << endl
        << "   Checkes whether API dump NEW_DIR is backwards compatible extension " << endl
-       << "   of the API dump OLD_DIR." << endl
+       << "   of the API dump OLD_DIR. With more dumps, e.g. the frozen versions" << endl
+       << "   in order and then the current one, checks each against the one" << endl
+       << "   before it, loading each dump once." << endl
+       << endl
+       << myname_ << " --server=SOCKET" << endl
+       << "   Stay resident and run the jobs that are sent to SOCKET with --connect." << endl
+       << "   An input is left out of a job when neither it, nor the files that it" << endl
+       << "   imports, nor its outputs have changed since an earlier job compiled it." << endl
+       << endl
 #endif
+       << myname_ << " --job-file=FILE [OPTION]..." << endl
+       << "   Run the jobs that FILE lists, one command line per line, in a single" << endl
+       << "   process. The OPTIONs, e.g. the import directories, are shared by the" << endl
+       << "   jobs; a job may add to them and override them." << endl
        << endl;
 
   // Legacy option formats
@@ -73,13 +233,17 @@ string Options::GetUsage() const {
        << "          Import FILE directly without searching in the search paths." << endl
        << "  -p FILE, --preprocessed=FILE" << endl
        << "          Include FILE which is created by --preprocess." << endl
+       << "  --precompiled=FILE" << endl
+       << "          Include the types of FILE which is created by --precompile." << endl
        << "  -d FILE, --dep=FILE" << endl
-       << "          Generate dependency file as FILE. Don't use this when" << endl
-       << "          there are multiple input files. Use -a then." << endl
-       << "  -o DIR, --out=DIR" << endl
+       << "          Generate dependency file as FILE. With multiple input files," << endl
+       << "          all outputs depend on all inputs. Use -a for one per output." << endl
+       << "  -o DIR, --out=[LANG:]DIR" << endl
        << "          Use DIR as the base output directory for generated files." << endl
-       << "  -h DIR, --header_out=DIR" << endl
+       << "          With LANG, only for the files of that language." << endl
+       << "  -h DIR, --header_out=[LANG:]DIR" << endl
        << "          Generate C++ headers under DIR." << endl
+       << "          With LANG, only for the headers of that language." << endl
        << "  -a" << endl
        << "          Generate dependency file next to the output file with the" << endl
        << "          name based on the input file." << endl
@@ -92,12 +256,43 @@ string Options::GetUsage() const {
        << "          It is therefore a candidate for stabilization." << endl
        << "  --stability=<level>" << endl
        << "          The stability requirement of this interface." << endl
-       << "  -t, --trace" << endl
+       << "  -t, --trace[=perfetto]" << endl
        << "          Include tracing code for systrace. Note that if either" << endl
        << "          the client or service code is not auto-generated by this" << endl
-       << "          tool, that part will not be traced." << endl
+       << "          tool, that part will not be traced. For C++ and NDK," << endl
+       << "          'perfetto' emits Perfetto track events instead, with the" << endl
+       << "          sizes and the status of the transactions and their phases." << endl
        << "  --transaction_names" << endl
-       << "          Generate transaction names." << endl
+       << "          Generate transaction names. In C++ and the NDK, BnFoo (and" << endl
+       << "          the NDK BpFoo) get a constexpr table kTransactionNames and" << endl
+       << "          getTransactionName(code)." << endl
+       << "  --gen-stats[=sizes]" << endl
+       << "          Count the transactions of each method of the proxies and stubs," << endl
+       << "          with a histogram of their latencies, and generate an accessor" << endl
+       << "          of the counts, getTransactionStats(). With 'sizes', also add up" << endl
+       << "          the sizes of the requests and the replies, and keep their maxima." << endl
+       << "  --gen-async" << endl
+       << "          Generate an asynchronous variant of each blocking method of the" << endl
+       << "          C++ and NDK interfaces, methodAsync(), which runs the call on the" << endl
+       << "          threads of ::android::aidl::AsyncExecutor and returns a future." << endl
+       << "  --gen-lazy-proxy" << endl
+       << "          Generate a lazy proxy of each interface, IFooLazy in C++ and the" << endl
+       << "          NDK and IFoo.Lazy in Java, which looks its service up by name on" << endl
+       << "          its first call rather than when it is created." << endl
+       << "  --java-compact" << endl
+       << "          Marshal the nullable parcelables of the Java proxies and stubs" << endl
+       << "          with Parcel.writeTypedObject and Parcel.readTypedObject, which" << endl
+       << "          need SDK 23, rather than inline, to shrink their bytecode." << endl
+       << "  --java-reuse" << endl
+       << "          Have readFromParcel() of the Java parcelables read into the arrays" << endl
+       << "          of the same length and the Lists and the Maps that they already" << endl
+       << "          have, and let the stubs recycle their in parcelable arguments." << endl
+       << "          Only the parcelables of the input files are recycled or read into," << endl
+       << "          not the imported ones." << endl
+       << "  --fwd-headers" << endl
+       << "          Also generate pkg/Foo_fwd.h headers, which forward-declare the" << endl
+       << "          types, and declare the types of the methods of IFoo.h from those" << endl
+       << "          headers. BpFoo.h and BnFoo.h still include their definitions." << endl
        << "  --apimapping" << endl
        << "          Generates a mapping of declared aidl method signatures to" << endl
        << "          the original line number. e.g.: " << endl
@@ -106,17 +301,104 @@ string Options::GetUsage() const {
        << "              Then the result would be:" << endl
        << "              foo.bar.Baz|doFoo|int,String,|void" << endl
        << "              foo/bar/IFoo.aidl:39" << endl
+       << "  --apimapping-format=FORMAT" << endl
+       << "          The format of --apimapping: text, the default, or binary, a table" << endl
+       << "          of the transaction codes of the methods, sorted by descriptor and" << endl
+       << "          code, which aidl/mapping_table.h reads." << endl
        << "  -v VER, --version=VER" << endl
        << "          Set the version of the interface and parcelable to VER." << endl
        << "          VER must be an interger greater than 0." << endl
        << "  --hash=HASH" << endl
        << "          Set the interface hash to HASH." << endl
-       << "  --log" << endl
+       << "  --log[=FORMAT]" << endl
        << "          Information about the transaction, e.g., method name, argument" << endl
        << "          values, execution time, etc., is provided via callback." << endl
+       << "          With FORMAT binary, a record of the method, its times, status and" << endl
+       << "          parcel sizes is appended to the ring buffer of aidl/binary_log.h" << endl
+       << "          instead, while that log is enabled, and stubs capture their" << endl
+       << "          requests for aidl_replay while aidl/transaction_capture.h is" << endl
+       << "          enabled. FORMAT defaults to json." << endl
+       << "  --nullable=KIND" << endl
+       << "          Hold the @nullable types of the C++ backend, other than IBinder," << endl
+       << "          in ::std::optional with KIND optional rather than in" << endl
+       << "          ::std::unique_ptr. KIND defaults to unique_ptr." << endl
+       << "  --gen-wire-schema" << endl
+       << "          Embed the compact wire schema of each interface and structured" << endl
+       << "          parcelable, see aidl/wire_schema.h, in the generated code: a" << endl
+       << "          static getWireSchema() that returns it, and in C++ and NDK an" << endl
+       << "          \"aidl_wire_schema\" section of the library that holds them all." << endl
+       << "  --marshal=KIND" << endl
+       << "          Marshal the arguments of the C++ and NDK methods of primitives," << endl
+       << "          Strings and arrays of primitives with KIND tables, a program per" << endl
+       << "          request and reply for the interpreter of aidl/marshal.h, rather" << endl
+       << "          than with KIND code, the default: a call for each argument." << endl
+       << "  --dedup-with=DIR" << endl
+       << "          The API dump of a frozen version, to be given for each of them," << endl
+       << "          the compiled one included. The C++ and NDK code of the structured" << endl
+       << "          parcelables that are the same in every version, and refer to only" << endl
+       << "          such types, is left out of the sources, for --dedup-shared." << endl
+       << "  --dedup-shared" << endl
+       << "          With --dedup-with, generate the sources of only the types that" << endl
+       << "          the frozen versions share, for the library they all link." << endl
        << "  --parcelable-to-string" << endl
-       << "          Generates an implementation of toString() for Java parcelables," << endl
-       << "          and ostream& operator << for C++ parcelables." << endl
+       << "          Generates appendTo(std::string&) for the C++ and NDK parcelables," << endl
+       << "          which appends their fields to the string without building any" << endl
+       << "          other, and a toString() over it." << endl
+       << "  --unity-sources[=N]" << endl
+       << "          Also generate aidl_unity_0.cpp to aidl_unity_<N-1>.cpp in the" << endl
+       << "          output directory, which include the C++ sources of the inputs" << endl
+       << "          between them, so that a library of many types compiles N" << endl
+       << "          translation units. N defaults to 1." << endl
+       << "  -j N, --jobs=N" << endl
+       << "          Validate and compile up to N input files in parallel, once" << endl
+       << "          they have all been parsed. With --checkapi," << endl
+       << "          up to N dumps are loaded in parallel, and with --preprocess," << endl
+       << "          up to N input files are parsed in parallel." << endl
+       << "  --write-if-changed" << endl
+       << "          Don't touch output files whose contents stay the same, e.g." << endl
+       << "          for ninja rules with restat." << endl
+       << "  --lexer=NAME" << endl
+       << "          Scan the files with flex, the default, or with hand-written," << endl
+       << "          a scanner that returns the same tokens in less time." << endl
+       << "  --profile=FILE" << endl
+       << "          Write the time and the allocations of each phase, input file" << endl
+       << "          and generated type to FILE, as trace-event JSON for Perfetto." << endl
+       << "  --cache-dir=DIR" << endl
+       << "          Keep the outputs in DIR, keyed by the options and by the" << endl
+       << "          contents of the inputs, and restore them from there when" << endl
+       << "          neither these nor the files that the inputs import have" << endl
+       << "          changed. Restored outputs are hard links into DIR where the" << endl
+       << "          file system allows. The cache is not used with --profile or" << endl
+       << "          --stats, which report on the compilation itself, nor where the" << endl
+       << "          build of aidl can't be identified (other hosts than Linux)." << endl
+       << "  --stats=FILE" << endl
+       << "          Write the number and the bytes of the AST nodes by class, the" << endl
+       << "          sizes of the input files and of the outputs of each backend," << endl
+       << "          and the peak RSS after each phase to FILE, as JSON." << endl
+       << "  --size-report=FILE" << endl
+       << "          Write the lines and the bytes of the code generated for each" << endl
+       << "          type and method to FILE, as JSON: its proxy, stub, default" << endl
+       << "          implementation, parcel reading and writing, and logging." << endl
+       << "  --transact_profile=FILE" << endl
+       << "          For Java, order the cases of onTransact by the calls of their" << endl
+       << "          methods, and keep only those of hot methods in it when cases" << endl
+       << "          are outlined. Each line of FILE is 'INTERFACE#METHOD CALLS'." << endl
+#ifndef _WIN32
+       << "  --hashapi=VERSION" << endl
+       << "          With --dumpapi, also write the hash of the dump at VERSION" << endl
+       << "          to DIR/.hash." << endl
+       << "  --api-manifest=FILE" << endl
+       << "          Keep the hash, the size and the modification time of each" << endl
+       << "          file of the API dump in FILE. --dumpapi then rewrites only the" << endl
+       << "          files whose contents change, and removes those of the types" << endl
+       << "          that are gone; --hashapi rehashes only the files whose size" << endl
+       << "          or modification time changed." << endl
+       << "  --connect=SOCKET" << endl
+       << "          Run the job in the server listening on SOCKET, or here if" << endl
+       << "          there is none." << endl
+#endif
+       << "  @FILE" << endl
+       << "          Read more arguments from FILE, separated by whitespace." << endl
        << "  --help" << endl
        << "          Show this help." << endl
        << endl
@@ -165,37 +447,120 @@ Options Options::From(const vector<string>& args) {
 
 Options::Options(int argc, const char* const argv[], Options::Language default_lang)
     : myname_(argv[0]), language_(default_lang) {
-  bool lang_option_found = false;
+  vector<string> args = {argv[0]};
+  if (ExpandResponseFiles(vector<string>(argv + 1, argv + argc), 0, &args,
+                          error_message_.stream_)) {
+    Parse(args);
+  }
+}
+
+Options Options::ForJob(const vector<string>& job_args) const {
+  Options job(*this);
+  job.task_ = Task::COMPILE;
+  job.job_file_.clear();
+  vector<string> args = {myname_};
+  if (ExpandResponseFiles(job_args, 0, &args, job.error_message_.stream_)) {
+    job.Parse(args);
+  }
+  return job;
+}
+
+bool Options::ReadJobs(vector<Options>* jobs, string* error) const {
+  string contents;
+  if (!android::base::ReadFileToString(job_file_, &contents)) {
+    *error = "Can't read job file '" + job_file_ + "'.\n";
+    return false;
+  }
+  const vector<string> lines = Split(contents, "\n");
+  for (size_t i = 0; i < lines.size(); i++) {
+    const string line = Trim(lines[i]);
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    const Options job = ForJob(SplitArgs(line));
+    const string location = job_file_ + ":" + std::to_string(i + 1) + ": ";
+    if (!job.Ok()) {
+      *error = location + job.GetErrorMessage();
+      return false;
+    }
+    if (job.task_ == Task::SERVER || job.task_ == Task::JOBS || job.usage_requested_) {
+      *error = location + "A job can't run --server, --job-file or --help.\n";
+      return false;
+    }
+    jobs->push_back(job);
+  }
+  return true;
+}
+
+void Options::Parse(const vector<string>& args) {
+  vector<const char*> arg_pointers;
+  for (const string& arg : args) {
+    arg_pointers.push_back(arg.c_str());
+  }
+  arg_pointers.push_back(nullptr);
+  const int argc = args.size();
+  const char* const* argv = arg_pointers.data();
+
+  args_.insert(args_.end(), args.begin() + 1, args.end());
   optind = 0;
   while (true) {
     static struct option long_options[] = {
         {"lang", required_argument, 0, 'l'},
         {"preprocess", no_argument, 0, 's'},
+        {"precompile", no_argument, 0, 'C'},
+        {"scan-deps", no_argument, 0, 'D'},
 #ifndef _WIN32
         {"dumpapi", no_argument, 0, 'u'},
         {"checkapi", no_argument, 0, 'A'},
+        {"hashapi", required_argument, 0, 'T'},
+        {"api-manifest", required_argument, 0, 'V'},
+        {"server", required_argument, 0, 'R'},
+        {"connect", required_argument, 0, 'N'},
 #endif
+        {"job-file", required_argument, 0, 'E'},
         {"apimapping", required_argument, 0, 'i'},
+        {"apimapping-format", required_argument, 0, 'B'},
         {"include", required_argument, 0, 'I'},
         {"import", required_argument, 0, 'm'},
         {"preprocessed", required_argument, 0, 'p'},
+        {"precompiled", required_argument, 0, 'M'},
         {"dep", required_argument, 0, 'd'},
         {"out", required_argument, 0, 'o'},
         {"header_out", required_argument, 0, 'h'},
         {"ninja", no_argument, 0, 'n'},
         {"stability", required_argument, 0, 'Y'},
         {"structured", no_argument, 0, 'S'},
-        {"trace", no_argument, 0, 't'},
+        {"trace", optional_argument, 0, 't'},
         {"transaction_names", no_argument, 0, 'c'},
+        {"gen-stats", optional_argument, 0, 'G'},
+        {"gen-async", no_argument, 0, 'X'},
+        {"gen-lazy-proxy", no_argument, 0, 'Z'},
+        {"fwd-headers", no_argument, 0, 'K'},
+        {"java-compact", no_argument, 0, 'J'},
+        {"java-reuse", no_argument, 0, 'r'},
         {"version", required_argument, 0, 'v'},
-        {"log", no_argument, 0, 'L'},
+        {"log", optional_argument, 0, 'L'},
+        {"nullable", required_argument, 0, 'U'},
         {"parcelable-to-string", no_argument, 0, 'P'},
+        {"gen-wire-schema", no_argument, 0, 'w'},
+        {"marshal", required_argument, 0, 'q'},
+        {"dedup-with", required_argument, 0, 'f'},
+        {"dedup-shared", no_argument, 0, 'g'},
         {"hash", required_argument, 0, 'H'},
+        {"jobs", required_argument, 0, 'j'},
+        {"unity-sources", optional_argument, 0, 'Q'},
+        {"write-if-changed", no_argument, 0, 'W'},
+        {"lexer", required_argument, 0, 'x'},
+        {"profile", required_argument, 0, 'F'},
+        {"stats", required_argument, 0, 'k'},
+        {"size-report", required_argument, 0, 'z'},
+        {"cache-dir", required_argument, 0, 'y'},
+        {"transact_profile", required_argument, 0, 'O'},
         {"help", no_argument, 0, 'e'},
         {0, 0, 0, 0},
     };
     const int c = getopt_long(argc, const_cast<char* const*>(argv),
-                              "I:m:p:d:o:h:abtv:", long_options, nullptr);
+                              "I:m:p:d:o:h:abtv:j:", long_options, nullptr);
     if (c == -1) {
       // no more options
       break;
@@ -208,21 +573,22 @@ Options::Options(int argc, const char* const argv[], Options::Language default_l
           error_message_ << "aidl-cpp does not support --lang." << endl;
           return;
         } else {
-          lang_option_found = true;
-          string lang = Trim(optarg);
-          if (lang == "java") {
-            language_ = Options::Language::JAVA;
-            task_ = Options::Task::COMPILE;
-          } else if (lang == "cpp") {
-            language_ = Options::Language::CPP;
-            task_ = Options::Task::COMPILE;
-          } else if (lang == "ndk") {
-            language_ = Options::Language::NDK;
-            task_ = Options::Task::COMPILE;
-          } else {
-            error_message_ << "Unsupported language: '" << lang << "'" << endl;
-            return;
+          lang_option_found_ = true;
+          languages_.clear();
+          for (const string& lang : Split(Trim(optarg), ",")) {
+            Options::Language language;
+            if (!LanguageFromString(lang, &language)) {
+              error_message_ << "Unsupported language: '" << lang << "'" << endl;
+              return;
+            }
+            if (std::find(languages_.begin(), languages_.end(), language) != languages_.end()) {
+              error_message_ << "Language '" << lang << "' is given more than once." << endl;
+              return;
+            }
+            languages_.push_back(language);
           }
+          language_ = languages_.front();
+          task_ = Options::Task::COMPILE;
         }
         break;
       case 's':
@@ -230,6 +596,16 @@ Options::Options(int argc, const char* const argv[], Options::Language default_l
           task_ = Options::Task::PREPROCESS;
         }
         break;
+      case 'C':
+        if (task_ != Options::Task::UNSPECIFIED) {
+          task_ = Options::Task::PRECOMPILE;
+        }
+        break;
+      case 'D':
+        if (task_ != Options::Task::UNSPECIFIED) {
+          task_ = Options::Task::SCAN_DEPS;
+        }
+        break;
 #ifndef _WIN32
       case 'u':
         if (task_ != Options::Task::UNSPECIFIED) {
@@ -243,7 +619,32 @@ Options::Options(int argc, const char* const argv[], Options::Language default_l
           structured_ = true;
         }
         break;
+      case 'T':
+        // Only checks the hash of a dump unless the dump is being made.
+        if (task_ != Options::Task::UNSPECIFIED && task_ != Options::Task::DUMP_API) {
+          task_ = Options::Task::HASH_API;
+        }
+        hash_api_version_ = Trim(optarg);
+        break;
+      case 'V':
+        api_manifest_file_ = Trim(optarg);
+        break;
+      case 'R':
+        if (task_ != Options::Task::UNSPECIFIED) {
+          task_ = Options::Task::SERVER;
+        }
+        server_socket_ = Trim(optarg);
+        break;
+      case 'N':
+        connect_socket_ = Trim(optarg);
+        break;
 #endif
+      case 'E':
+        if (task_ != Options::Task::UNSPECIFIED) {
+          task_ = Options::Task::JOBS;
+        }
+        job_file_ = Trim(optarg);
+        break;
       case 'I': {
         import_dirs_.emplace(Trim(optarg));
         break;
@@ -255,21 +656,27 @@ Options::Options(int argc, const char* const argv[], Options::Language default_l
       case 'p':
         preprocessed_files_.emplace_back(Trim(optarg));
         break;
+      case 'M':
+        precompiled_files_.emplace_back(Trim(optarg));
+        break;
       case 'd':
         dependency_file_ = Trim(optarg);
         break;
-      case 'o':
-        output_dir_ = Trim(optarg);
-        if (output_dir_.back() != OS_PATH_SEPARATOR) {
-          output_dir_.push_back(OS_PATH_SEPARATOR);
-        }
+      case 'o': {
+        string dir;
+        const Options::Language language = ParseOutputDir(optarg, &dir);
+        (language == Options::Language::UNSPECIFIED ? output_dir_
+                                                    : language_output_dirs_[language]) = dir;
         break;
-      case 'h':
-        output_header_dir_ = Trim(optarg);
-        if (output_header_dir_.back() != OS_PATH_SEPARATOR) {
-          output_header_dir_.push_back(OS_PATH_SEPARATOR);
-        }
+      }
+      case 'h': {
+        string dir;
+        const Options::Language language = ParseOutputDir(optarg, &dir);
+        (language == Options::Language::UNSPECIFIED ? output_header_dir_
+                                                    : language_output_header_dirs_[language]) =
+            dir;
         break;
+      }
       case 'n':
         dependency_file_ninja_ = true;
         break;
@@ -286,7 +693,14 @@ Options::Options(int argc, const char* const argv[], Options::Language default_l
         break;
       }
       case 't':
-        gen_traces_ = true;
+        if (optarg == nullptr) {
+          gen_traces_ = true;
+        } else if (string(optarg) == "perfetto") {
+          gen_perfetto_traces_ = true;
+        } else {
+          error_message_ << "Unrecognized trace format: '" << optarg << "'" << endl;
+          return;
+        }
         break;
       case 'a':
         auto_dep_file_ = true;
@@ -297,6 +711,31 @@ Options::Options(int argc, const char* const argv[], Options::Language default_l
       case 'c':
         gen_transaction_names_ = true;
         break;
+      case 'G':
+        gen_stats_ = true;
+        if (optarg != nullptr) {
+          if (string(optarg) != "sizes") {
+            error_message_ << "Unrecognized stats: '" << optarg << "'" << endl;
+            return;
+          }
+          gen_parcel_sizes_ = true;
+        }
+        break;
+      case 'X':
+        gen_async_ = true;
+        break;
+      case 'Z':
+        gen_lazy_proxy_ = true;
+        break;
+      case 'K':
+        gen_fwd_headers_ = true;
+        break;
+      case 'J':
+        java_compact_ = true;
+        break;
+      case 'r':
+        java_reuse_ = true;
+        break;
       case 'v': {
         const string ver_str = Trim(optarg);
         int ver = atoi(ver_str.c_str());
@@ -312,19 +751,106 @@ Options::Options(int argc, const char* const argv[], Options::Language default_l
       case 'H':
         hash_ = Trim(optarg);
         break;
+      case 'j': {
+        const string jobs_str = Trim(optarg);
+        if (!android::base::ParseInt(jobs_str, &jobs_, 1)) {
+          error_message_ << "Invalid number of jobs: '" << jobs_str << "'. "
+                         << "It must be a positive natural number." << endl;
+          return;
+        }
+        break;
+      }
+      case 'Q': {
+        const string shards_str = optarg == nullptr ? "1" : Trim(optarg);
+        if (!android::base::ParseInt(shards_str, &unity_sources_, 1)) {
+          error_message_ << "Invalid number of unity sources: '" << shards_str << "'. "
+                         << "It must be a positive natural number." << endl;
+          return;
+        }
+        break;
+      }
       case 'L':
-        gen_log_ = true;
+        if (optarg == nullptr || string(optarg) == "json") {
+          gen_log_ = true;
+        } else if (string(optarg) == "binary") {
+          gen_binary_log_ = true;
+        } else {
+          error_message_ << "Unrecognized log format: '" << optarg << "'" << endl;
+          return;
+        }
+        break;
+      case 'U':
+        if (string(optarg) == "optional") {
+          nullable_as_optional_ = true;
+        } else if (string(optarg) != "unique_ptr") {
+          error_message_ << "Unrecognized nullable kind: '" << optarg << "'" << endl;
+          return;
+        }
+        break;
+      case 'W':
+        write_if_changed_ = true;
+        break;
+      case 'x':
+        if (string(optarg) == "hand-written") {
+          hand_written_lexer_ = true;
+        } else if (string(optarg) != "flex") {
+          error_message_ << "Unrecognized lexer: '" << optarg << "'" << endl;
+          return;
+        }
+        break;
+      case 'F':
+        profile_file_ = Trim(optarg);
+        break;
+      case 'k':
+        stats_file_ = Trim(optarg);
+        break;
+      case 'z':
+        size_report_file_ = Trim(optarg);
+        break;
+      case 'y':
+        cache_dir_ = Trim(optarg);
+        if (!cache_dir_.empty() && cache_dir_.back() != OS_PATH_SEPARATOR) {
+          cache_dir_.push_back(OS_PATH_SEPARATOR);
+        }
+        break;
+      case 'O':
+        transact_profile_file_ = Trim(optarg);
         break;
       case 'e':
-        std::cerr << GetUsage();
-        exit(0);
+        usage_requested_ = true;
+        return;
       case 'i':
         output_file_ = Trim(optarg);
         task_ = Task::DUMP_MAPPINGS;
         break;
+      case 'B':
+        if (string(optarg) == "binary") {
+          api_mapping_binary_ = true;
+        } else if (string(optarg) != "text") {
+          error_message_ << "Unrecognized API mapping format: '" << optarg << "'" << endl;
+          return;
+        }
+        break;
       case 'P':
         gen_parcelable_to_string_ = true;
         break;
+      case 'w':
+        gen_wire_schema_ = true;
+        break;
+      case 'q':
+        if (string(optarg) == "tables") {
+          marshal_with_tables_ = true;
+        } else if (string(optarg) != "code") {
+          error_message_ << "Unrecognized marshal kind: '" << optarg << "'" << endl;
+          return;
+        }
+        break;
+      case 'f':
+        dedup_dirs_.emplace_back(Trim(optarg));
+        break;
+      case 'g':
+        dedup_shared_ = true;
+        break;
       default:
         std::cerr << GetUsage();
         exit(1);
@@ -332,7 +858,7 @@ Options::Options(int argc, const char* const argv[], Options::Language default_l
   }  // while
 
   // Positional arguments
-  if (!lang_option_found && task_ == Options::Task::COMPILE) {
+  if (!lang_option_found_ && task_ == Options::Task::COMPILE) {
     // the legacy arguments format
     if (argc - optind <= 0) {
       error_message_ << "No input file" << endl;
@@ -373,9 +899,20 @@ Options::Options(int argc, const char* const argv[], Options::Language default_l
       }
       error_message_ << endl;
     }
+  } else if (task_ == Options::Task::SERVER) {
+    if (argc - optind > 0) {
+      error_message_ << "--server doesn't take any input." << endl;
+      return;
+    }
+  } else if (task_ == Options::Task::JOBS) {
+    if (argc - optind > 0) {
+      error_message_ << "--job-file doesn't take any input. List it in the jobs." << endl;
+      return;
+    }
   } else {
     // the new arguments format
-    if (task_ == Options::Task::COMPILE || task_ == Options::Task::DUMP_API) {
+    if (task_ == Options::Task::COMPILE || task_ == Options::Task::DUMP_API ||
+        task_ == Options::Task::HASH_API || task_ == Options::Task::SCAN_DEPS) {
       if (argc - optind < 1) {
         error_message_ << "No input file." << endl;
         return;
@@ -395,29 +932,39 @@ Options::Options(int argc, const char* const argv[], Options::Language default_l
     }
   }
 
+  if (api_mapping_binary_ && task_ != Options::Task::DUMP_MAPPINGS) {
+    error_message_ << "--apimapping-format is only supported with --apimapping" << endl;
+    return;
+  }
+
   // filter out invalid combinations
-  if (lang_option_found) {
-    if (IsCppOutput() && task_ == Options::Task::COMPILE) {
-      if (output_dir_.empty()) {
+  if (lang_option_found_ && task_ == Options::Task::COMPILE) {
+    for (Options::Language language : languages_) {
+      const Options options = ForLanguage(language);
+      if (options.output_dir_.empty()) {
         error_message_ << "Output directory is not set. Set with --out." << endl;
         return;
       }
-      if (output_header_dir_.empty()) {
+      if (options.IsCppOutput() && options.output_header_dir_.empty()) {
         error_message_ << "Header output directory is not set. Set with "
                        << "--header_out." << endl;
         return;
       }
     }
-    if (language_ == Options::Language::JAVA && task_ == Options::Task::COMPILE) {
-      if (output_dir_.empty()) {
-        error_message_ << "Output directory is not set. Set with --out." << endl;
-        return;
-      }
-      if (!output_header_dir_.empty()) {
-        error_message_ << "Header output directory is set, which does not make "
-                       << "sense for Java." << endl;
-        return;
-      }
+    const bool java_header_dir =
+        language_output_header_dirs_.count(Options::Language::JAVA) > 0 ||
+        (languages_.size() == 1 && language_ == Options::Language::JAVA &&
+         !output_header_dir_.empty());
+    if (java_header_dir) {
+      error_message_ << "Header output directory is set, which does not make "
+                     << "sense for Java." << endl;
+      return;
+    }
+    if (languages_.size() > 1 && !dependency_file_.empty()) {
+      error_message_ << "-d or --dep doesn't work when compiling for multiple "
+                     << "languages. Use '-a' to generate dependency file next to "
+                     << "each output file." << endl;
+      return;
     }
   }
   if (task_ == Options::Task::COMPILE) {
@@ -433,27 +980,103 @@ Options::Options(int argc, const char* const argv[], Options::Language default_l
                      << "Use --out=DIR instead for output files." << endl;
       return;
     }
-    if (!dependency_file_.empty() && input_files_.size() > 1) {
-      error_message_ << "-d or --dep doesn't work when compiling multiple AIDL "
-                     << "files. Use '-a' to generate dependency file next to "
-                     << "the output file with the name based on the input "
-                     << "file." << endl;
+    const auto languages = TargetLanguages();
+    if ((gen_log_ || gen_binary_log_) &&
+        std::any_of(languages.begin(), languages.end(), [](Options::Language l) {
+          return l != Options::Language::CPP && l != Options::Language::NDK;
+        })) {
+      error_message_ << "--log is currently supported for either --lang=cpp or --lang=ndk" << endl;
       return;
     }
-    if (gen_log_ && (language_ != Options::Language::CPP && language_ != Options::Language::NDK)) {
-      error_message_ << "--log is currently supported for either --lang=cpp or --lang=ndk" << endl;
+    if (!transact_profile_file_.empty() &&
+        std::find(languages.begin(), languages.end(), Options::Language::JAVA) ==
+            languages.end()) {
+      error_message_ << "--transact_profile is only supported for --lang=java" << endl;
+      return;
+    }
+    if (gen_fwd_headers_ &&
+        std::any_of(languages.begin(), languages.end(),
+                    [](Options::Language l) { return l != Options::Language::CPP; })) {
+      error_message_ << "--fwd-headers is only supported for --lang=cpp" << endl;
+      return;
+    }
+    if (java_compact_ &&
+        std::find(languages.begin(), languages.end(), Options::Language::JAVA) ==
+            languages.end()) {
+      error_message_ << "--java-compact is only supported for --lang=java" << endl;
+      return;
+    }
+    if (java_reuse_ &&
+        std::find(languages.begin(), languages.end(), Options::Language::JAVA) ==
+            languages.end()) {
+      error_message_ << "--java-reuse is only supported for --lang=java" << endl;
+      return;
+    }
+    if (gen_perfetto_traces_ &&
+        std::any_of(languages.begin(), languages.end(),
+                    [](Options::Language l) { return l == Options::Language::JAVA; })) {
+      error_message_ << "--trace=perfetto is only supported for --lang=cpp or --lang=ndk" << endl;
+      return;
+    }
+    if (unity_sources_ > 0 &&
+        std::any_of(languages.begin(), languages.end(),
+                    [](Options::Language l) { return l == Options::Language::JAVA; })) {
+      error_message_ << "--unity-sources is only supported for --lang=cpp or --lang=ndk" << endl;
+      return;
+    }
+    if (marshal_with_tables_ &&
+        std::any_of(languages.begin(), languages.end(),
+                    [](Options::Language l) { return l == Options::Language::JAVA; })) {
+      error_message_ << "--marshal=tables is only supported for --lang=cpp or --lang=ndk" << endl;
+      return;
+    }
+    if (!dedup_dirs_.empty() &&
+        std::any_of(languages.begin(), languages.end(),
+                    [](Options::Language l) { return l == Options::Language::JAVA; })) {
+      error_message_ << "--dedup-with is only supported for --lang=cpp or --lang=ndk" << endl;
+      return;
+    }
+    if (dedup_shared_ && dedup_dirs_.empty()) {
+      error_message_ << "--dedup-shared requires --dedup-with." << endl;
       return;
     }
   }
+  if (!api_manifest_file_.empty() && task_ != Options::Task::DUMP_API &&
+      task_ != Options::Task::HASH_API) {
+    error_message_ << "--api-manifest is only supported with --dumpapi and --hashapi." << endl;
+    return;
+  }
+  if (!cache_dir_.empty() && task_ != Options::Task::COMPILE &&
+      task_ != Options::Task::JOBS && task_ != Options::Task::SERVER) {
+    error_message_ << "--cache-dir is only supported for compiling." << endl;
+    return;
+  }
+  if (!size_report_file_.empty() && !cache_dir_.empty()) {
+    // The outputs restored from the cache are not generated.
+    error_message_ << "--size-report can't be used with --cache-dir." << endl;
+    return;
+  }
   if (task_ == Options::Task::PREPROCESS) {
     if (version_ > 0) {
       error_message_ << "--version should not be used with '--preprocess'." << endl;
       return;
     }
   }
+  if (task_ == Options::Task::PRECOMPILE) {
+    if (version_ > 0) {
+      error_message_ << "--version should not be used with '--precompile'." << endl;
+      return;
+    }
+    for (const string& input : input_files_) {
+      if (!android::base::EndsWith(input, ".aidl")) {
+        error_message_ << "Expected .aidl file for input but got '" << input << "'" << endl;
+        return;
+      }
+    }
+  }
   if (task_ == Options::Task::CHECK_API) {
-    if (input_files_.size() != 2) {
-      error_message_ << "--checkapi requires two inputs for comparing, "
+    if (input_files_.size() < 2) {
+      error_message_ << "--checkapi requires at least two inputs for comparing, "
                      << "but got " << input_files_.size() << "." << endl;
       return;
     }
@@ -464,10 +1087,48 @@ Options::Options(int argc, const char* const argv[], Options::Language default_l
       return;
     }
   }
+  if (task_ == Options::Task::HASH_API) {
+    if (hash_api_version_.empty()) {
+      error_message_ << "--hashapi requires a version." << endl;
+      return;
+    }
+    if (input_files_.size() != 1) {
+      error_message_ << "--hashapi requires one API dump directory, "
+                     << "but got " << input_files_.size() << "." << endl;
+      return;
+    }
+  }
+  if (task_ == Options::Task::SERVER) {
+    if (server_socket_.empty()) {
+      error_message_ << "--server requires a socket path." << endl;
+      return;
+    }
+    if (!connect_socket_.empty()) {
+      error_message_ << "--connect should not be used with '--server'." << endl;
+      return;
+    }
+  }
+  if (task_ == Options::Task::JOBS && !connect_socket_.empty()) {
+    error_message_ << "--connect should not be used with '--job-file'." << endl;
+    return;
+  }
 
   CHECK(output_dir_.empty() || output_dir_.back() == OS_PATH_SEPARATOR);
   CHECK(output_header_dir_.empty() || output_header_dir_.back() == OS_PATH_SEPARATOR);
 }
 
+string to_string(Options::Language language) {
+  switch (language) {
+    case Options::Language::JAVA:
+      return "java";
+    case Options::Language::CPP:
+      return "cpp";
+    case Options::Language::NDK:
+      return "ndk";
+    default:
+      return "unspecified";
+  }
+}
+
 }  // namespace aidl
 }  // namespace android
@@ -15,6 +15,7 @@
 
 #pragma once
 
+#include <map>
 #include <set>
 #include <sstream>
 #include <string>
@@ -23,6 +24,7 @@
 namespace android {
 namespace aidl {
 
+using std::map;
 using std::set;
 using std::string;
 using std::vector;
@@ -61,7 +63,19 @@ class Options final {
  public:
   enum class Language { UNSPECIFIED, JAVA, CPP, NDK };
 
-  enum class Task { UNSPECIFIED, COMPILE, PREPROCESS, DUMP_API, CHECK_API, DUMP_MAPPINGS };
+  enum class Task {
+    UNSPECIFIED,
+    COMPILE,
+    PREPROCESS,
+    PRECOMPILE,
+    DUMP_API,
+    HASH_API,
+    CHECK_API,
+    DUMP_MAPPINGS,
+    SCAN_DEPS,
+    SERVER,
+    JOBS
+  };
 
   enum class Stability { UNSPECIFIED, VINTF };
   bool StabilityFromString(const std::string& stability, Stability* out_stability);
@@ -72,6 +86,15 @@ class Options final {
 
   static Options From(const vector<string>& args);
 
+  // The options of one of the jobs of JobFile(): these options, followed by
+  // |job_args|. The import directories and other options that the jobs share
+  // are not parsed again.
+  Options ForJob(const vector<string>& job_args) const;
+
+  // Parses the jobs of JobFile() to |jobs|. Returns false, with the reason in
+  // |error|, if the file can't be read or one of the jobs is invalid.
+  bool ReadJobs(vector<Options>* jobs, string* error) const;
+
   // Contain no references to unstructured data types (such as a parcelable that is
   // implemented in Java). These interfaces aren't inherently stable but they have the
   // capacity to be stabilized.
@@ -80,6 +103,11 @@ class Options final {
   Stability GetStability() const { return stability_; }
 
   Language TargetLanguage() const { return language_; }
+  // All languages given to --lang, starting with TargetLanguage().
+  vector<Language> TargetLanguages() const;
+  // The options for generating the code of one of TargetLanguages(), with
+  // the output directories of that language.
+  Options ForLanguage(Language language) const;
   bool IsCppOutput() const { return language_ == Language::CPP || language_ == Language::NDK; }
 
   Task GetTask() const { return task_; }
@@ -90,6 +118,8 @@ class Options final {
 
   const vector<string>& PreprocessedFiles() const { return preprocessed_files_; }
 
+  const vector<string>& PrecompiledFiles() const { return precompiled_files_; }
+
   string DependencyFile() const {
     return dependency_file_;
   }
@@ -98,8 +128,38 @@ class Options final {
 
   bool GenTraces() const { return gen_traces_; }
 
+  // Whether the C++ and NDK proxies and stubs emit the Perfetto track events
+  // of aidl/trace_events.h instead (--trace=perfetto)
+  bool GenPerfettoTraces() const { return gen_perfetto_traces_; }
+
   bool GenTransactionNames() const { return gen_transaction_names_; }
 
+  // Counting of the transactions of each method, with latency histograms
+  bool GenStats() const { return gen_stats_; }
+
+  // Whether the counts of GenStats() include the sizes of the parcels
+  bool GenParcelSizes() const { return gen_parcel_sizes_; }
+
+  // Whether the C++ and NDK interfaces have asynchronous variants of their
+  // blocking methods
+  bool GenAsync() const { return gen_async_; }
+
+  // Whether each interface has a lazy proxy, which looks its service up on
+  // its first call
+  bool GenLazyProxy() const { return gen_lazy_proxy_; }
+
+  // Whether the C++ backend writes the _fwd.h headers of the types, and
+  // includes them rather than the definitions in IFoo.h
+  bool GenFwdHeaders() const { return gen_fwd_headers_; }
+
+  // Whether the Java proxies and stubs call the helpers of Parcel for the
+  // nullable parcelables rather than inline them
+  bool JavaCompact() const { return java_compact_; }
+
+  // Whether the Java parcelables reuse their arrays, Lists and Maps when they
+  // are read again, and the stubs recycle their in parcelable arguments
+  bool JavaReuse() const { return java_reuse_; }
+
   bool DependencyFileNinja() const { return dependency_file_ninja_; }
 
   const vector<string>& InputFiles() const { return input_files_; }
@@ -123,51 +183,179 @@ class Options final {
 
   string Hash() const { return hash_; }
 
+  // Version that the hash of an API dump is computed for. The hash is that
+  // of the .aidl files of the dump, followed by the version.
+  const string& HashApiVersion() const { return hash_api_version_; }
+
+  // File that the hashes and the stamps of the files of an API dump are kept
+  // in, see --api-manifest.
+  const string& ApiManifestFile() const { return api_manifest_file_; }
+
+  // Logging of transactions as JSON objects to a callback (--log)
   bool GenLog() const { return gen_log_; }
 
+  // Logging of transactions to a binary ring buffer (--log=binary)
+  bool GenBinaryLog() const { return gen_binary_log_; }
+
   bool GenParcelableToString() const { return gen_parcelable_to_string_; }
 
+  // Whether the wire schemas of the types are embedded (--gen-wire-schema)
+  bool GenWireSchema() const { return gen_wire_schema_; }
+
+  // Whether the C++ and NDK methods that can marshal their arguments with the
+  // programs of aidl/marshal.h do (--marshal=tables)
+  bool MarshalWithTables() const { return marshal_with_tables_; }
+
+  // The API dumps of the frozen versions whose shared types are generated
+  // once (--dedup-with), and whether those are the ones generated
+  // (--dedup-shared) rather than all the others
+  const vector<string>& DedupDirs() const { return dedup_dirs_; }
+  bool DedupShared() const { return dedup_shared_; }
+
+  // Whether the C++ backend holds @nullable types in ::std::optional instead
+  // of ::std::unique_ptr (--nullable=optional)
+  bool NullableAsOptional() const { return nullable_as_optional_; }
+
+  // Number of input files that are compiled in parallel.
+  int Jobs() const { return jobs_; }
+
+  // The number of aidl_unity_<i>.cpp sources that include the generated
+  // sources, or 0 for none
+  int UnitySources() const { return unity_sources_; }
+
+  // Leave generated files whose contents don't change untouched.
+  bool WriteIfChanged() const { return write_if_changed_; }
+
+  // Scan the files with the hand-written AidlLexer instead of flex.
+  bool HandWrittenLexer() const { return hand_written_lexer_; }
+
+  // File that a trace of the phases of the job is written to.
+  const string& ProfileFile() const { return profile_file_; }
+
+  // File that the sizes of the AST, the inputs and the outputs of the job
+  // and its peak memory are written to, as JSON.
+  const string& StatsFile() const { return stats_file_; }
+
+  // File that the sizes of the generated code are written to, by type,
+  // method and section, as JSON (see SizeReport).
+  const string& SizeReportFile() const { return size_report_file_; }
+
+  // Directory of the cache of outputs, see compile_cached(). It ends with a
+  // path separator.
+  const string& CacheDir() const { return cache_dir_; }
+
+  // The arguments that the options were parsed from, after the response
+  // files were expanded, without the name of the program
+  const vector<string>& Args() const { return args_; }
+
+  // File with the call counts of transactions, which decide the methods whose
+  // cases stay in the Java onTransact.
+  const string& TransactProfileFile() const { return transact_profile_file_; }
+
+  // Unix socket that --server listens on.
+  const string& ServerSocket() const { return server_socket_; }
+
+  // Unix socket of a server that the job is sent to, if one is running.
+  const string& ConnectSocket() const { return connect_socket_; }
+
+  // File that lists the jobs of --job-file, one command line per line.
+  const string& JobFile() const { return job_file_; }
+
   bool Ok() const { return error_message_.stream_.str().empty(); }
 
   string GetErrorMessage() const { return error_message_.stream_.str(); }
 
   string GetUsage() const;
 
+  // Whether --help was given, in which case the rest of the command line is
+  // not parsed and the caller prints GetUsage().
+  bool UsageRequested() const { return usage_requested_; }
+
   bool GenApiMapping() const { return task_ == Task::DUMP_MAPPINGS; }
 
+  // Whether --apimapping writes the binary table of aidl/mapping_table.h
+  bool ApiMappingBinary() const { return api_mapping_binary_; }
+
   // The following are for testability, but cannot be influenced on the command line.
   // Threshold of interface methods to enable outlining of onTransact cases.
   size_t onTransact_outline_threshold_{275u};
   // Number of cases to _not_ outline, if outlining is enabled.
   size_t onTransact_non_outline_count_{275u};
+  // Threshold of interface methods to dispatch transactions in the C++ and NDK
+  // onTransact with a table of handlers instead of a switch statement.
+  size_t onTransact_table_threshold_{275u};
 
  private:
   Options() = default;
 
+  // Parses |args|, the command line after the response files are expanded,
+  // on top of the options that are already set.
+  void Parse(const vector<string>& args);
+
   const string myname_;
   Language language_ = Language::UNSPECIFIED;
+  vector<Language> languages_;
+  bool lang_option_found_ = false;
   Task task_ = Task::COMPILE;
   set<string> import_dirs_;
   set<string> import_files_;
   vector<string> preprocessed_files_;
+  vector<string> precompiled_files_;
   string dependency_file_;
   bool gen_traces_ = false;
+  bool gen_perfetto_traces_ = false;
   bool gen_transaction_names_ = false;
+  bool gen_stats_ = false;
+  bool gen_parcel_sizes_ = false;
+  bool gen_async_ = false;
+  bool gen_lazy_proxy_ = false;
+  bool gen_fwd_headers_ = false;
+  bool java_compact_ = false;
+  bool java_reuse_ = false;
+  bool api_mapping_binary_ = false;
   bool dependency_file_ninja_ = false;
   bool structured_ = false;
   Stability stability_ = Stability::UNSPECIFIED;
   string output_dir_;
   string output_header_dir_;
+  // Set by --out=LANG:DIR and --header_out=LANG:DIR
+  map<Language, string> language_output_dirs_;
+  map<Language, string> language_output_header_dirs_;
   bool fail_on_parcelable_ = false;
   bool auto_dep_file_ = false;
   vector<string> input_files_;
   string output_file_;
   int version_ = 0;
   string hash_ = "";
+  string hash_api_version_;
+  string api_manifest_file_;
   bool gen_log_ = false;
+  bool gen_binary_log_ = false;
   bool gen_parcelable_to_string_ = false;
+  bool gen_wire_schema_ = false;
+  bool marshal_with_tables_ = false;
+  vector<string> dedup_dirs_;
+  bool dedup_shared_ = false;
+  bool nullable_as_optional_ = false;
+  int jobs_ = 1;
+  int unity_sources_ = 0;
+  bool write_if_changed_ = false;
+  bool hand_written_lexer_ = false;
+  string profile_file_;
+  string stats_file_;
+  string size_report_file_;
+  string cache_dir_;
+  vector<string> args_;
+  string transact_profile_file_;
+  string server_socket_;
+  string connect_socket_;
+  bool usage_requested_ = false;
+  string job_file_;
   ErrorMessage error_message_;
 };
 
+// "java", "cpp" or "ndk", as in --lang
+string to_string(Options::Language language);
+
 }  // namespace aidl
 }  // namespace android
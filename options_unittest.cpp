@@ -16,8 +16,13 @@
 
 #include "options.h"
 
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <fstream>
 #include <iostream>
 #include <memory>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -25,6 +30,7 @@
 
 using std::cerr;
 using std::endl;
+using std::set;
 using std::string;
 using std::unique_ptr;
 using std::vector;
@@ -136,10 +142,11 @@ TEST(OptionsTests, ParsesCompileJava) {
   EXPECT_EQ(false, options->AutoDepFile());
   EXPECT_EQ(false, options->DependencyFileNinja());
   EXPECT_EQ(false, options->GenParcelableToString());
+  EXPECT_EQ(false, options->GenWireSchema());
 
   const char* argv[] = {
       "aidl",  "-b", kCompileCommandIncludePath, kCompileCommandInput, "--parcelable-to-string",
-      nullptr,
+      "--gen-wire-schema", nullptr,
   };
   options = GetOptions(argv);
   EXPECT_EQ(Options::Task::COMPILE, options->GetTask());
@@ -152,6 +159,7 @@ TEST(OptionsTests, ParsesCompileJava) {
   EXPECT_EQ(false, options->AutoDepFile());
   EXPECT_EQ(false, options->DependencyFileNinja());
   EXPECT_EQ(true, options->GenParcelableToString());
+  EXPECT_EQ(true, options->GenWireSchema());
 }
 
 TEST(OptionsTests, ParsesCompileJavaNinja) {
@@ -237,6 +245,354 @@ TEST(OptionsTests, ParsesCompileJavaMultiInput) {
   EXPECT_EQ(string{"src_out/"}, options->OutputDir());
 }
 
+TEST(OptionsTests, ParsesJobs) {
+  EXPECT_EQ(1, Options::From("aidl --lang=java -o out a/IFoo.aidl").Jobs());
+  EXPECT_EQ(4, Options::From("aidl --lang=java -j 4 -o out a/IFoo.aidl").Jobs());
+  EXPECT_EQ(8, Options::From("aidl --lang=java --jobs=8 -o out a/IFoo.aidl").Jobs());
+  EXPECT_FALSE(Options::From("aidl --lang=java -j 0 -o out a/IFoo.aidl").Ok());
+  EXPECT_FALSE(Options::From("aidl --lang=java -j 3abc -o out a/IFoo.aidl").Ok());
+  EXPECT_FALSE(Options::From("aidl --lang=java -j 99999999999 -o out a/IFoo.aidl").Ok());
+}
+
+TEST(OptionsTests, ParsesSeveralLanguages) {
+  Options options = Options::From(
+      "aidl --lang=cpp,ndk,java --out=java:out/java --out=out --header_out=cpp:include/cpp "
+      "--header_out=ndk:include/ndk a/IFoo.aidl");
+  ASSERT_TRUE(options.Ok()) << options.GetErrorMessage();
+  EXPECT_EQ(Options::Language::CPP, options.TargetLanguage());
+  EXPECT_EQ((vector<Options::Language>{Options::Language::CPP, Options::Language::NDK,
+                                       Options::Language::JAVA}),
+            options.TargetLanguages());
+
+  const Options cpp = options.ForLanguage(Options::Language::CPP);
+  EXPECT_EQ(Options::Language::CPP, cpp.TargetLanguage());
+  EXPECT_EQ("out/", cpp.OutputDir());
+  EXPECT_EQ("include/cpp/", cpp.OutputHeaderDir());
+  const Options java = options.ForLanguage(Options::Language::JAVA);
+  EXPECT_EQ("out/java/", java.OutputDir());
+  EXPECT_EQ("", java.OutputHeaderDir());
+
+  // Every C++ backend needs a header directory.
+  EXPECT_FALSE(Options::From("aidl --lang=cpp,ndk -o out -h cpp:include a/IFoo.aidl").Ok());
+  EXPECT_FALSE(Options::From("aidl --lang=cpp,cpp -o out -h include a/IFoo.aidl").Ok());
+  EXPECT_FALSE(
+      Options::From("aidl --lang=cpp,java -o out -h include -d dep a/IFoo.aidl").Ok());
+}
+
+TEST(OptionsTests, ParsesServerAndConnect) {
+  Options server = Options::From("aidl --server=/tmp/aidl.sock");
+  EXPECT_TRUE(server.Ok());
+  EXPECT_EQ(Options::Task::SERVER, server.GetTask());
+  EXPECT_EQ("/tmp/aidl.sock", server.ServerSocket());
+  EXPECT_FALSE(Options::From("aidl --server=/tmp/aidl.sock a/IFoo.aidl").Ok());
+
+  Options client = Options::From("aidl --connect=/tmp/aidl.sock --lang=java -o out a/IFoo.aidl");
+  EXPECT_TRUE(client.Ok());
+  EXPECT_EQ(Options::Task::COMPILE, client.GetTask());
+  EXPECT_EQ("/tmp/aidl.sock", client.ConnectSocket());
+}
+
+TEST(OptionsTests, RecordsThatTheUsageIsRequested) {
+  // The caller prints the usage: a resident compiler must not exit.
+  Options options = Options::From("aidl --connect=/tmp/aidl.sock --help --lang=java");
+  EXPECT_TRUE(options.Ok());
+  EXPECT_TRUE(options.UsageRequested());
+  EXPECT_FALSE(Options::From("aidl --lang=java -o out a/IFoo.aidl").UsageRequested());
+}
+
+TEST(OptionsTests, ParsesCheckApiOfSeveralVersions) {
+  Options options = Options::From("aidl --checkapi api/1 api/2 api/current");
+  EXPECT_TRUE(options.Ok());
+  EXPECT_EQ(Options::Task::CHECK_API, options.GetTask());
+  EXPECT_EQ((vector<string>{"api/1", "api/2", "api/current"}), options.InputFiles());
+  EXPECT_FALSE(Options::From("aidl --checkapi api/1").Ok());
+}
+
+TEST(OptionsTests, ParsesHashApi) {
+  Options check = Options::From("aidl --hashapi=3 api/3");
+  EXPECT_TRUE(check.Ok());
+  EXPECT_EQ(Options::Task::HASH_API, check.GetTask());
+  EXPECT_EQ("3", check.HashApiVersion());
+  EXPECT_FALSE(Options::From("aidl --hashapi=3").Ok());
+  EXPECT_FALSE(Options::From("aidl --hashapi=3 api/2 api/3").Ok());
+
+  Options dump = Options::From("aidl --hashapi=latest-version --dumpapi -o dump a/IFoo.aidl");
+  EXPECT_TRUE(dump.Ok());
+  EXPECT_EQ(Options::Task::DUMP_API, dump.GetTask());
+  EXPECT_EQ("latest-version", dump.HashApiVersion());
+}
+
+TEST(OptionsTests, ParsesApiManifest) {
+  Options dump = Options::From("aidl --dumpapi --api-manifest=dump.manifest -o dump a/IFoo.aidl");
+  EXPECT_TRUE(dump.Ok());
+  EXPECT_EQ("dump.manifest", dump.ApiManifestFile());
+  EXPECT_TRUE(Options::From("aidl --hashapi=3 --api-manifest=3.manifest api/3").Ok());
+  EXPECT_FALSE(Options::From("aidl --lang=java --api-manifest=m -o out a/IFoo.aidl").Ok());
+}
+
+TEST(OptionsTests, ParsesProfile) {
+  Options options = Options::From("aidl --lang=java --profile=trace.json -o out a/IFoo.aidl");
+  EXPECT_TRUE(options.Ok());
+  EXPECT_EQ("trace.json", options.ProfileFile());
+  EXPECT_EQ("", Options::From("aidl --lang=java -o out a/IFoo.aidl").ProfileFile());
+}
+
+TEST(OptionsTests, ParsesStats) {
+  Options options = Options::From("aidl --lang=java --stats=stats.json -o out a/IFoo.aidl");
+  EXPECT_TRUE(options.Ok());
+  EXPECT_EQ("stats.json", options.StatsFile());
+  EXPECT_EQ("", Options::From("aidl --lang=java -o out a/IFoo.aidl").StatsFile());
+}
+
+TEST(OptionsTests, ParsesSizeReport) {
+  Options options = Options::From("aidl --lang=cpp --size-report=sizes.json -o out -h out "
+                                  "a/IFoo.aidl");
+  EXPECT_TRUE(options.Ok());
+  EXPECT_EQ("sizes.json", options.SizeReportFile());
+  EXPECT_EQ("", Options::From("aidl --lang=java -o out a/IFoo.aidl").SizeReportFile());
+}
+
+TEST(OptionsTests, ParsesCacheDir) {
+  Options options = Options::From("aidl --lang=java --cache-dir=cache -o out a/IFoo.aidl");
+  EXPECT_TRUE(options.Ok());
+  EXPECT_EQ("cache/", options.CacheDir());
+  EXPECT_EQ("", Options::From("aidl --lang=java -o out a/IFoo.aidl").CacheDir());
+
+  Options dumpapi = Options::From("aidl --dumpapi --cache-dir=cache --out=dump a/IFoo.aidl");
+  EXPECT_FALSE(dumpapi.Ok());
+  EXPECT_NE(string::npos,
+            dumpapi.GetErrorMessage().find("--cache-dir is only supported for compiling."));
+}
+
+TEST(OptionsTests, ParsesLexer) {
+  EXPECT_FALSE(Options::From("aidl --lang=java -o out a/IFoo.aidl").HandWrittenLexer());
+  EXPECT_FALSE(Options::From("aidl --lang=java --lexer=flex -o out a/IFoo.aidl").HandWrittenLexer());
+  Options hand_written =
+      Options::From("aidl --lang=java --lexer=hand-written -o out a/IFoo.aidl");
+  EXPECT_TRUE(hand_written.Ok());
+  EXPECT_TRUE(hand_written.HandWrittenLexer());
+
+  Options unknown = Options::From("aidl --lang=java --lexer=re2c -o out a/IFoo.aidl");
+  EXPECT_FALSE(unknown.Ok());
+  EXPECT_NE(string::npos, unknown.GetErrorMessage().find("Unrecognized lexer: 're2c'"));
+}
+
+TEST(OptionsTests, ParsesMarshal) {
+  EXPECT_FALSE(Options::From("aidl --lang=cpp -o out -h out a/IFoo.aidl").MarshalWithTables());
+  Options code = Options::From("aidl --lang=cpp --marshal=code -o out -h out a/IFoo.aidl");
+  EXPECT_TRUE(code.Ok());
+  EXPECT_FALSE(code.MarshalWithTables());
+  Options tables = Options::From("aidl --lang=ndk --marshal=tables -o out -h out a/IFoo.aidl");
+  EXPECT_TRUE(tables.Ok());
+  EXPECT_TRUE(tables.MarshalWithTables());
+
+  Options unknown = Options::From("aidl --lang=cpp --marshal=jit -o out -h out a/IFoo.aidl");
+  EXPECT_FALSE(unknown.Ok());
+  EXPECT_NE(string::npos, unknown.GetErrorMessage().find("Unrecognized marshal kind: 'jit'"));
+  EXPECT_FALSE(Options::From("aidl --lang=java --marshal=tables -o out a/IFoo.aidl").Ok());
+}
+
+TEST(OptionsTests, ParsesDedup) {
+  Options versioned = Options::From(
+      "aidl --lang=cpp --dedup-with=api/1 --dedup-with=api/2 -o out -h out a/IFoo.aidl");
+  EXPECT_TRUE(versioned.Ok());
+  EXPECT_EQ((vector<string>{"api/1", "api/2"}), versioned.DedupDirs());
+  EXPECT_FALSE(versioned.DedupShared());
+  Options shared =
+      Options::From("aidl --lang=ndk --dedup-with=api/1 --dedup-shared -o out -h out a/IFoo.aidl");
+  EXPECT_TRUE(shared.Ok());
+  EXPECT_TRUE(shared.DedupShared());
+
+  Options alone = Options::From("aidl --lang=cpp --dedup-shared -o out -h out a/IFoo.aidl");
+  EXPECT_FALSE(alone.Ok());
+  EXPECT_NE(string::npos, alone.GetErrorMessage().find("--dedup-shared requires --dedup-with."));
+  EXPECT_FALSE(Options::From("aidl --lang=java --dedup-with=api/1 -o out a/IFoo.aidl").Ok());
+}
+
+TEST(OptionsTests, ParsesLogFormat) {
+  Options json = Options::From("aidl --lang=cpp --log -o out -h out a/IFoo.aidl");
+  EXPECT_TRUE(json.Ok());
+  EXPECT_TRUE(json.GenLog());
+  EXPECT_FALSE(json.GenBinaryLog());
+  EXPECT_TRUE(Options::From("aidl --lang=cpp --log=json -o out -h out a/IFoo.aidl").GenLog());
+
+  Options binary = Options::From("aidl --lang=ndk --log=binary -o out -h out a/IFoo.aidl");
+  EXPECT_TRUE(binary.Ok());
+  EXPECT_FALSE(binary.GenLog());
+  EXPECT_TRUE(binary.GenBinaryLog());
+  EXPECT_FALSE(Options::From("aidl --lang=cpp --log=xml -o out -h out a/IFoo.aidl").Ok());
+  EXPECT_FALSE(Options::From("aidl --lang=java --log=binary -o out a/IFoo.aidl").Ok());
+}
+
+TEST(OptionsTests, ParsesTraceFormat) {
+  Options atrace = Options::From("aidl --lang=cpp --trace -o out -h out a/IFoo.aidl");
+  EXPECT_TRUE(atrace.Ok());
+  EXPECT_TRUE(atrace.GenTraces());
+  EXPECT_FALSE(atrace.GenPerfettoTraces());
+
+  Options perfetto = Options::From("aidl --lang=ndk --trace=perfetto -o out -h out a/IFoo.aidl");
+  EXPECT_TRUE(perfetto.Ok());
+  EXPECT_FALSE(perfetto.GenTraces());
+  EXPECT_TRUE(perfetto.GenPerfettoTraces());
+  EXPECT_FALSE(Options::From("aidl --lang=cpp --trace=xml -o out -h out a/IFoo.aidl").Ok());
+  EXPECT_FALSE(Options::From("aidl --lang=java --trace=perfetto -o out a/IFoo.aidl").Ok());
+}
+
+TEST(OptionsTests, ParsesGenStats) {
+  EXPECT_FALSE(Options::From("aidl --lang=cpp -o out -h out a/IFoo.aidl").GenStats());
+  EXPECT_TRUE(Options::From("aidl --lang=cpp --gen-stats -o out -h out a/IFoo.aidl").GenStats());
+  EXPECT_TRUE(Options::From("aidl --lang=java --gen-stats -o out a/IFoo.aidl").GenStats());
+  EXPECT_FALSE(
+      Options::From("aidl --lang=cpp --gen-stats -o out -h out a/IFoo.aidl").GenParcelSizes());
+
+  Options sizes = Options::From("aidl --lang=ndk --gen-stats=sizes -o out -h out a/IFoo.aidl");
+  EXPECT_TRUE(sizes.Ok());
+  EXPECT_TRUE(sizes.GenStats());
+  EXPECT_TRUE(sizes.GenParcelSizes());
+  EXPECT_FALSE(Options::From("aidl --lang=cpp --gen-stats=bytes -o out -h out a/IFoo.aidl").Ok());
+}
+
+TEST(OptionsTests, ParsesGenAsync) {
+  EXPECT_FALSE(Options::From("aidl --lang=cpp -o out -h out a/IFoo.aidl").GenAsync());
+  EXPECT_TRUE(Options::From("aidl --lang=ndk --gen-async -o out -h out a/IFoo.aidl").GenAsync());
+}
+
+TEST(OptionsTests, ParsesGenLazyProxy) {
+  EXPECT_FALSE(Options::From("aidl --lang=java -o out a/IFoo.aidl").GenLazyProxy());
+  EXPECT_TRUE(Options::From("aidl --lang=java --gen-lazy-proxy -o out a/IFoo.aidl").GenLazyProxy());
+}
+
+TEST(OptionsTests, ParsesFwdHeaders) {
+  EXPECT_FALSE(Options::From("aidl --lang=cpp -o out -h out a/IFoo.aidl").GenFwdHeaders());
+  EXPECT_TRUE(Options::From("aidl --lang=cpp --fwd-headers -o out -h out a/IFoo.aidl").GenFwdHeaders());
+  EXPECT_FALSE(Options::From("aidl --lang=ndk --fwd-headers -o out -h out a/IFoo.aidl").Ok());
+}
+
+TEST(OptionsTests, ParsesJavaCompact) {
+  EXPECT_FALSE(Options::From("aidl --lang=java -o out a/IFoo.aidl").JavaCompact());
+  EXPECT_TRUE(Options::From("aidl --lang=java --java-compact -o out a/IFoo.aidl").JavaCompact());
+  EXPECT_FALSE(Options::From("aidl --lang=cpp --java-compact -o out -h out a/IFoo.aidl").Ok());
+}
+
+TEST(OptionsTests, ParsesJavaReuse) {
+  EXPECT_FALSE(Options::From("aidl --lang=java -o out a/IFoo.aidl").JavaReuse());
+  EXPECT_TRUE(Options::From("aidl --lang=java --java-reuse -o out a/IFoo.aidl").JavaReuse());
+  EXPECT_FALSE(Options::From("aidl --lang=ndk --java-reuse -o out -h out a/IFoo.aidl").Ok());
+}
+
+TEST(OptionsTests, ParsesApiMappingFormat) {
+  const string inputs = " a/IFoo.aidl a/IBar.aidl";
+  EXPECT_FALSE(Options::From("aidl --apimapping=out" + inputs).ApiMappingBinary());
+  Options text = Options::From("aidl --apimapping=out --apimapping-format=text" + inputs);
+  EXPECT_TRUE(text.Ok()) << text.GetErrorMessage();
+  EXPECT_FALSE(text.ApiMappingBinary());
+  Options binary = Options::From("aidl --apimapping=out --apimapping-format=binary" + inputs);
+  EXPECT_TRUE(binary.Ok()) << binary.GetErrorMessage();
+  EXPECT_TRUE(binary.ApiMappingBinary());
+  EXPECT_FALSE(Options::From("aidl --apimapping=out --apimapping-format=xml" + inputs).Ok());
+  EXPECT_FALSE(
+      Options::From("aidl --lang=java --apimapping-format=binary -o out a/IFoo.aidl").Ok());
+}
+
+TEST(OptionsTests, ParsesUnitySources) {
+  EXPECT_EQ(0, Options::From("aidl --lang=cpp -o out -h out a/IFoo.aidl").UnitySources());
+  EXPECT_EQ(1, Options::From("aidl --lang=cpp --unity-sources -o out -h out a/IFoo.aidl")
+                   .UnitySources());
+  EXPECT_EQ(4, Options::From("aidl --lang=ndk --unity-sources=4 -o out -h out a/IFoo.aidl")
+                   .UnitySources());
+  EXPECT_FALSE(Options::From("aidl --lang=cpp --unity-sources=0 -o out -h out a/IFoo.aidl").Ok());
+  EXPECT_FALSE(Options::From("aidl --lang=cpp --unity-sources=2x -o out -h out a/IFoo.aidl").Ok());
+  EXPECT_FALSE(Options::From("aidl --lang=java --unity-sources -o out a/IFoo.aidl").Ok());
+}
+
+TEST(OptionsTests, ParsesNullableKind) {
+  EXPECT_FALSE(Options::From("aidl --lang=cpp -o out -h out a/IFoo.aidl").NullableAsOptional());
+  EXPECT_FALSE(Options::From("aidl --lang=cpp --nullable=unique_ptr -o out -h out a/IFoo.aidl")
+                   .NullableAsOptional());
+
+  Options optional = Options::From("aidl --lang=cpp --nullable=optional -o out -h out a/IFoo.aidl");
+  EXPECT_TRUE(optional.Ok());
+  EXPECT_TRUE(optional.NullableAsOptional());
+  EXPECT_FALSE(
+      Options::From("aidl --lang=cpp --nullable=shared_ptr -o out -h out a/IFoo.aidl").Ok());
+}
+
+TEST(OptionsTests, ParsesScanDeps) {
+  Options options = Options::From("aidl --scan-deps -I src -d deps src/p/IFoo.aidl");
+  EXPECT_TRUE(options.Ok());
+  EXPECT_EQ(Options::Task::SCAN_DEPS, options.GetTask());
+  EXPECT_EQ("deps", options.DependencyFile());
+  EXPECT_EQ(vector<string>{"src/p/IFoo.aidl"}, options.InputFiles());
+  EXPECT_FALSE(Options::From("aidl --scan-deps").Ok());
+}
+
+namespace {
+
+// Writes |contents| to a new temporary file and returns its path.
+string WriteTempFile(const string& contents) {
+  char path[] = "/tmp/aidl_options_test_XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) return "";
+  close(fd);
+  std::ofstream(path, std::ios::binary | std::ios::trunc) << contents;
+  return path;
+}
+
+}  // namespace
+
+TEST(OptionsTests, ExpandsResponseFiles) {
+  const string inner = WriteTempFile("-h out a/IFoo.aidl");
+  const string outer =
+      WriteTempFile("--lang=cpp -I \"dir with space\" -I C:\\dir\n-o out @" + inner);
+  ASSERT_FALSE(inner.empty());
+  ASSERT_FALSE(outer.empty());
+
+  Options options = Options::From(vector<string>{"aidl", "@" + outer, "a/IBar.aidl"});
+  EXPECT_TRUE(options.Ok()) << options.GetErrorMessage();
+  EXPECT_EQ(Options::Language::CPP, options.TargetLanguage());
+  EXPECT_EQ((set<string>{"C:\\dir", "dir with space"}), options.ImportDirs());
+  EXPECT_EQ((vector<string>{"a/IFoo.aidl", "a/IBar.aidl"}), options.InputFiles());
+  EXPECT_FALSE(Options::From(vector<string>{"aidl", "@" + outer + ".missing"}).Ok());
+  unlink(inner.c_str());
+  unlink(outer.c_str());
+}
+
+TEST(OptionsTests, ParsesJobFile) {
+  const string path = WriteTempFile(
+      "# one job per line\n"
+      "--lang=java -o out/java a/IFoo.aidl\n"
+      "\n"
+      "--lang=ndk --version=2 --hash=abc -I more -o out/ndk -h out/ndk a/IFoo.aidl\n");
+  ASSERT_FALSE(path.empty());
+  Options options = Options::From("aidl -I shared -p framework.aidl --job-file=" + path);
+  ASSERT_TRUE(options.Ok()) << options.GetErrorMessage();
+  EXPECT_EQ(Options::Task::JOBS, options.GetTask());
+
+  vector<Options> jobs;
+  string error;
+  ASSERT_TRUE(options.ReadJobs(&jobs, &error)) << error;
+  ASSERT_EQ(2u, jobs.size());
+  EXPECT_EQ(Options::Task::COMPILE, jobs[0].GetTask());
+  EXPECT_EQ(Options::Language::JAVA, jobs[0].TargetLanguage());
+  EXPECT_EQ(set<string>{"shared"}, jobs[0].ImportDirs());
+  EXPECT_EQ(vector<string>{"framework.aidl"}, jobs[0].PreprocessedFiles());
+  EXPECT_EQ(Options::Language::NDK, jobs[1].TargetLanguage());
+  EXPECT_EQ((set<string>{"more", "shared"}), jobs[1].ImportDirs());
+  EXPECT_EQ(2, jobs[1].Version());
+  EXPECT_EQ("abc", jobs[1].Hash());
+  EXPECT_EQ("out/ndk/", jobs[1].OutputDir());
+  unlink(path.c_str());
+
+  const string invalid = WriteTempFile("--lang=java -o out a/IFoo.aidl\n--lang=cpp a/IFoo.aidl\n");
+  ASSERT_FALSE(invalid.empty());
+  jobs.clear();
+  EXPECT_FALSE(Options::From("aidl --job-file=" + invalid).ReadJobs(&jobs, &error));
+  EXPECT_EQ(0u, error.find(invalid + ":2: ")) << error;
+  unlink(invalid.c_str());
+
+  EXPECT_FALSE(Options::From("aidl --job-file=jobs a/IFoo.aidl").Ok());
+}
+
 TEST(OptionsTests, ParsesCompileJavaInvalid) {
   // -o option is required
   const char* arg_with_no_out_dir[] = {
@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+// The ::std::pmr containers of the parcelables with @PolymorphicAllocator,
+// which the C++ (aidl/pmr_parcel.h) and NDK (aidl/pmr_ndk.h) backends write
+// and read as they do the ::std::vectors and ::std::strings of the other
+// parcelables. A container takes its memory from the allocator that the
+// parcelable was constructed with, e.g. from a ::std::pmr::monotonic_buffer_resource
+// for the duration of a transaction:
+//
+//   ::std::pmr::monotonic_buffer_resource arena;
+//   Foo foo(&arena);
+//   status_t status = foo.readFromParcel(parcel);
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <type_traits>
+
+namespace android {
+namespace aidl {
+namespace pmr {
+
+// Whether the elements of a vector of T are packed into bytes in a parcel, as
+// the byte[]s and the arrays of byte enums are. The other primitives take
+// four or eight bytes each.
+template <typename T>
+constexpr bool kIsPacked = (std::is_arithmetic_v<T> || std::is_enum_v<T>) &&
+                           sizeof(T) == 1 && !std::is_same_v<T, bool>;
+
+// Whether |size| elements, which take at least four bytes each unless they
+// are packed, may be in the |available| bytes of a parcel. Checked before a
+// vector is resized for them, so that a bad size cannot exhaust the resource.
+template <typename T>
+bool MayHold(int32_t size, size_t available) {
+  if (size < 0) return false;
+  return static_cast<size_t>(size) <= (kIsPacked<T> ? available : available / 4);
+}
+
+}  // namespace pmr
+}  // namespace aidl
+}  // namespace android
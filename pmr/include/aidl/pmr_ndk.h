@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+// The @PolymorphicAllocator containers of the NDK backend, see aidl/pmr.h.
+// The AParcel reads call back for the buffers of the arrays and the Strings,
+// which come from the resources of the containers.
+
+#include <stdint.h>
+
+#include <limits>
+#include <memory_resource>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <aidl/pmr.h>
+#include <android/binder_parcel.h>
+#include <android/binder_parcel_utils.h>
+
+namespace android {
+namespace aidl {
+namespace pmr {
+
+inline binder_status_t WriteToParcel(AParcel* parcel, const std::pmr::string& value) {
+  if (value.size() > static_cast<size_t>(std::numeric_limits<int32_t>::max())) {
+    return STATUS_BAD_VALUE;
+  }
+  return AParcel_writeString(parcel, value.data(), static_cast<int32_t>(value.size()));
+}
+
+inline binder_status_t ReadFromParcel(const AParcel* parcel, std::pmr::string* value) {
+  // The length counts the null terminator, and is -1 for a null String
+  const auto allocator = [](void* string_data, int32_t length, char** buffer) {
+    if (length <= 0) return false;
+    auto* string = static_cast<std::pmr::string*>(string_data);
+    string->resize(static_cast<size_t>(length) - 1);
+    *buffer = string->data();
+    return true;
+  };
+  return AParcel_readString(parcel, value, allocator);
+}
+
+// The arrays of primitives go through the AParcel array calls for their
+// element types, where the enums are arrays of their backing types
+template <typename T>
+binder_status_t WriteToParcel(AParcel* parcel, const std::pmr::vector<T>& values) {
+  if (values.size() > static_cast<size_t>(std::numeric_limits<int32_t>::max())) {
+    return STATUS_BAD_VALUE;
+  }
+  const int32_t size = static_cast<int32_t>(values.size());
+  if constexpr (std::is_enum_v<T>) {
+    using Backing = std::underlying_type_t<T>;
+    const auto* data = reinterpret_cast<const Backing*>(values.data());
+    if constexpr (std::is_same_v<Backing, int8_t>) {
+      return AParcel_writeByteArray(parcel, data, size);
+    } else if constexpr (std::is_same_v<Backing, int32_t>) {
+      return AParcel_writeInt32Array(parcel, data, size);
+    } else {
+      return AParcel_writeInt64Array(parcel, data, size);
+    }
+  } else if constexpr (std::is_same_v<T, bool>) {
+    const auto getter = [](const void* array_data, size_t index) {
+      return (*static_cast<const std::pmr::vector<bool>*>(array_data))[index];
+    };
+    return AParcel_writeBoolArray(parcel, &values, size, getter);
+  } else if constexpr (std::is_same_v<T, int8_t>) {
+    return AParcel_writeByteArray(parcel, values.data(), size);
+  } else if constexpr (std::is_same_v<T, char16_t>) {
+    return AParcel_writeCharArray(parcel, values.data(), size);
+  } else if constexpr (std::is_same_v<T, int32_t>) {
+    return AParcel_writeInt32Array(parcel, values.data(), size);
+  } else if constexpr (std::is_same_v<T, int64_t>) {
+    return AParcel_writeInt64Array(parcel, values.data(), size);
+  } else if constexpr (std::is_same_v<T, float>) {
+    return AParcel_writeFloatArray(parcel, values.data(), size);
+  } else if constexpr (std::is_same_v<T, double>) {
+    return AParcel_writeDoubleArray(parcel, values.data(), size);
+  } else {
+    // The Strings and the parcelables, one by one after the size
+    binder_status_t status = AParcel_writeInt32(parcel, size);
+    if (status != STATUS_OK) return status;
+    for (const T& value : values) {
+      if constexpr (std::is_same_v<T, std::pmr::string>) {
+        status = WriteToParcel(parcel, value);
+      } else {
+        status = ::ndk::AParcel_writeParcelable(parcel, value);
+      }
+      if (status != STATUS_OK) return status;
+    }
+    return STATUS_OK;
+  }
+}
+
+// Resizes the std::pmr::vector<T> at |array_data| for the |length| elements
+// of an AParcel array read, and points |buffer| at them
+template <typename T, typename Element>
+bool AllocateArray(void* array_data, int32_t length, Element** buffer) {
+  if (length < 0) return false;
+  auto* values = static_cast<std::pmr::vector<T>*>(array_data);
+  values->resize(static_cast<size_t>(length));
+  *buffer = reinterpret_cast<Element*>(values->data());
+  return true;
+}
+
+template <typename T>
+binder_status_t ReadFromParcel(const AParcel* parcel, std::pmr::vector<T>* values) {
+  if constexpr (std::is_enum_v<T>) {
+    using Backing = std::underlying_type_t<T>;
+    if constexpr (std::is_same_v<Backing, int8_t>) {
+      return AParcel_readByteArray(parcel, values, AllocateArray<T, int8_t>);
+    } else if constexpr (std::is_same_v<Backing, int32_t>) {
+      return AParcel_readInt32Array(parcel, values, AllocateArray<T, int32_t>);
+    } else {
+      return AParcel_readInt64Array(parcel, values, AllocateArray<T, int64_t>);
+    }
+  } else if constexpr (std::is_same_v<T, bool>) {
+    const auto allocator = [](void* array_data, int32_t length) {
+      if (length < 0) return false;
+      static_cast<std::pmr::vector<bool>*>(array_data)->resize(static_cast<size_t>(length));
+      return true;
+    };
+    const auto setter = [](void* array_data, size_t index, bool value) {
+      (*static_cast<std::pmr::vector<bool>*>(array_data))[index] = value;
+    };
+    return AParcel_readBoolArray(parcel, values, allocator, setter);
+  } else if constexpr (std::is_same_v<T, int8_t>) {
+    return AParcel_readByteArray(parcel, values, AllocateArray<T, int8_t>);
+  } else if constexpr (std::is_same_v<T, char16_t>) {
+    return AParcel_readCharArray(parcel, values, AllocateArray<T, char16_t>);
+  } else if constexpr (std::is_same_v<T, int32_t>) {
+    return AParcel_readInt32Array(parcel, values, AllocateArray<T, int32_t>);
+  } else if constexpr (std::is_same_v<T, int64_t>) {
+    return AParcel_readInt64Array(parcel, values, AllocateArray<T, int64_t>);
+  } else if constexpr (std::is_same_v<T, float>) {
+    return AParcel_readFloatArray(parcel, values, AllocateArray<T, float>);
+  } else if constexpr (std::is_same_v<T, double>) {
+    return AParcel_readDoubleArray(parcel, values, AllocateArray<T, double>);
+  } else {
+    // The elements are constructed with the allocator of |values|, so that the
+    // containers within them take their memory from its resource too
+    int32_t size;
+    binder_status_t status = AParcel_readInt32(parcel, &size);
+    if (status != STATUS_OK) return status;
+    if (size < 0) return STATUS_UNEXPECTED_NULL;
+    values->clear();
+    values->resize(static_cast<size_t>(size));
+    for (T& value : *values) {
+      if constexpr (std::is_same_v<T, std::pmr::string>) {
+        status = ReadFromParcel(parcel, &value);
+      } else {
+        status = ::ndk::AParcel_readParcelable(parcel, &value);
+      }
+      if (status != STATUS_OK) return status;
+    }
+    return STATUS_OK;
+  }
+}
+
+}  // namespace pmr
+}  // namespace aidl
+}  // namespace android
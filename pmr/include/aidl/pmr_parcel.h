@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+// The @PolymorphicAllocator containers of the C++ backend, see aidl/pmr.h.
+// They are in a Parcel as the Parcel writes the ::std::vectors and the
+// ::std::strings of the @utf8InCpp Strings.
+
+#include <stdint.h>
+#include <string.h>
+
+#include <limits>
+#include <memory_resource>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <aidl/pmr.h>
+#include <binder/Parcel.h>
+#include <utils/Unicode.h>
+
+namespace android {
+namespace aidl {
+namespace pmr {
+
+// A String as UTF-16, as Parcel::writeUtf8AsUtf16() writes it, converted in a
+// buffer from the resource of |value|
+inline status_t WriteToParcel(Parcel* parcel, const std::pmr::string& value) {
+  const uint8_t* utf8 = reinterpret_cast<const uint8_t*>(value.data());
+  const ssize_t size = utf8_to_utf16_length(utf8, value.size());
+  if (size < 0) return BAD_VALUE;
+  std::pmr::u16string utf16(static_cast<size_t>(size), u'\0', value.get_allocator());
+  if (size > 0) utf8_to_utf16(utf8, value.size(), utf16.data(), utf16.size() + 1);
+  return parcel->writeString16(utf16.data(), utf16.size());
+}
+
+// A String from UTF-16, as Parcel::readUtf8FromUtf16() reads it, converted in
+// place
+inline status_t ReadFromParcel(const Parcel* parcel, std::pmr::string* value) {
+  size_t size;
+  const char16_t* utf16 = parcel->readString16Inplace(&size);
+  if (utf16 == nullptr) return UNEXPECTED_NULL;
+  const ssize_t utf8_size = utf16_to_utf8_length(utf16, size);
+  if (utf8_size < 0) return BAD_VALUE;
+  value->resize(static_cast<size_t>(utf8_size));
+  if (utf8_size > 0) utf16_to_utf8(utf16, size, value->data(), value->size() + 1);
+  return OK;
+}
+
+template <typename T>
+status_t WriteElement(Parcel* parcel, const T& value) {
+  if constexpr (std::is_enum_v<T>) {
+    return WriteElement(parcel, static_cast<std::underlying_type_t<T>>(value));
+  } else if constexpr (std::is_same_v<T, bool>) {
+    return parcel->writeBool(value);
+  } else if constexpr (std::is_same_v<T, char16_t>) {
+    return parcel->writeChar(value);
+  } else if constexpr (std::is_same_v<T, int32_t>) {
+    return parcel->writeInt32(value);
+  } else if constexpr (std::is_same_v<T, int64_t>) {
+    return parcel->writeInt64(value);
+  } else if constexpr (std::is_same_v<T, float>) {
+    return parcel->writeFloat(value);
+  } else if constexpr (std::is_same_v<T, double>) {
+    return parcel->writeDouble(value);
+  } else if constexpr (std::is_same_v<T, std::pmr::string>) {
+    return WriteToParcel(parcel, value);
+  } else {
+    return parcel->writeParcelable(value);
+  }
+}
+
+template <typename T>
+status_t ReadElement(const Parcel* parcel, T* value) {
+  if constexpr (std::is_enum_v<T>) {
+    std::underlying_type_t<T> backing;
+    status_t status = ReadElement(parcel, &backing);
+    if (status != OK) return status;
+    *value = static_cast<T>(backing);
+    return OK;
+  } else if constexpr (std::is_same_v<T, bool>) {
+    return parcel->readBool(value);
+  } else if constexpr (std::is_same_v<T, char16_t>) {
+    return parcel->readChar(value);
+  } else if constexpr (std::is_same_v<T, int32_t>) {
+    return parcel->readInt32(value);
+  } else if constexpr (std::is_same_v<T, int64_t>) {
+    return parcel->readInt64(value);
+  } else if constexpr (std::is_same_v<T, float>) {
+    return parcel->readFloat(value);
+  } else if constexpr (std::is_same_v<T, double>) {
+    return parcel->readDouble(value);
+  } else if constexpr (std::is_same_v<T, std::pmr::string>) {
+    return ReadFromParcel(parcel, value);
+  } else {
+    return parcel->readParcelable(value);
+  }
+}
+
+// An array or a List: its size, followed by its elements, which are packed
+// into bytes as Parcel::writeByteVector() does for the byte[]s
+template <typename T>
+status_t WriteToParcel(Parcel* parcel, const std::pmr::vector<T>& values) {
+  if (values.size() > static_cast<size_t>(std::numeric_limits<int32_t>::max())) {
+    return BAD_VALUE;
+  }
+  status_t status = parcel->writeInt32(static_cast<int32_t>(values.size()));
+  if (status != OK) return status;
+  if constexpr (kIsPacked<T>) {
+    return parcel->write(values.data(), values.size());
+  } else {
+    for (const T& value : values) {
+      status = WriteElement(parcel, value);
+      if (status != OK) return status;
+    }
+    return OK;
+  }
+}
+
+// The elements are constructed with the allocator of |values|, so that the
+// containers within them take their memory from its resource too
+template <typename T>
+status_t ReadFromParcel(const Parcel* parcel, std::pmr::vector<T>* values) {
+  int32_t size;
+  status_t status = parcel->readInt32(&size);
+  if (status != OK) return status;
+  if (size < 0) return UNEXPECTED_NULL;
+  if (!MayHold<T>(size, parcel->dataAvail())) return BAD_VALUE;
+  if constexpr (kIsPacked<T>) {
+    const void* data = parcel->readInplace(static_cast<size_t>(size));
+    if (data == nullptr) return BAD_VALUE;
+    values->resize(static_cast<size_t>(size));
+    if (size > 0) memcpy(values->data(), data, static_cast<size_t>(size));
+    return OK;
+  } else {
+    values->clear();
+    values->resize(static_cast<size_t>(size));
+    for (T& value : *values) {
+      status = ReadElement(parcel, &value);
+      if (status != OK) return status;
+    }
+    return OK;
+  }
+}
+
+}  // namespace pmr
+}  // namespace aidl
+}  // namespace android
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+// The results of the @Cacheable methods, which the C++ and NDK proxies keep
+// per method, keyed by the in arguments of the calls. An interface counts the
+// generations of its results: invalidateCaches() starts a new one, and the
+// results of the earlier generations are not returned any more.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <mutex>
+
+namespace android {
+namespace aidl {
+
+class CacheGeneration {
+ public:
+  constexpr CacheGeneration() = default;
+  CacheGeneration(const CacheGeneration&) = delete;
+  CacheGeneration& operator=(const CacheGeneration&) = delete;
+
+  uint64_t Get() const { return value_.load(std::memory_order_acquire); }
+  void Invalidate() { value_.fetch_add(1, std::memory_order_acq_rel); }
+
+ private:
+  std::atomic<uint64_t> value_{0};
+};
+
+// Key is a std::tuple of the in arguments, which are looked up as a
+// std::tuple of references to them
+template <typename Key, typename Value, size_t kCapacity = 64>
+class ResultCache {
+ public:
+  ResultCache() = default;
+  ResultCache(const ResultCache&) = delete;
+  ResultCache& operator=(const ResultCache&) = delete;
+
+  // Copies the result cached for |key| into |value|, if it was cached in
+  // |generation|
+  template <typename K>
+  bool Get(uint64_t generation, const K& key, Value* value) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (generation != generation_) return false;
+    auto it = entries_.find(key);
+    if (it == entries_.end()) return false;
+    *value = it->second;
+    return true;
+  }
+
+  // Caches |value| for |key|, as the result of a call that started in
+  // |generation|. The results of the calls that an invalidation overtook are
+  // dropped, and the cache starts over when it is full.
+  template <typename K>
+  void Put(uint64_t generation, const K& key, const Value& value) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (generation < generation_) return;
+    if (generation != generation_ || entries_.size() >= kCapacity) {
+      entries_.clear();
+      generation_ = generation;
+    }
+    entries_.insert_or_assign(Key(key), value);
+  }
+
+ private:
+  mutable std::mutex mutex_;
+  std::map<Key, Value, std::less<>> entries_;
+  uint64_t generation_ = 0;
+};
+
+}  // namespace aidl
+}  // namespace android
@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+// The regions of shared memory that carry the byte[] arguments and fields
+// annotated with @SharedMemory(threshold=N) once they are longer than N bytes.
+// In a parcel, such a byte[] is
+//
+//   int32 kInline, followed by the byte[] as usual, or
+//   int32 kShared, int32 length, followed by the ParcelFileDescriptor of a
+//                  region holding at least length bytes
+//
+// which the C++ (aidl/shared_memory_parcel.h), NDK (aidl/shared_memory_ndk.h)
+// and Java backends all write and read alike.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <utility>
+#include <vector>
+
+namespace android {
+namespace aidl {
+namespace shared_memory {
+
+constexpr int32_t kInline = 0;
+constexpr int32_t kShared = 1;
+
+// Returns a memfd holding the |size| bytes of |data|, sealed so that it can
+// no longer change, or -1 with errno set.
+inline int CreateRegion(const uint8_t* data, size_t size) {
+  constexpr unsigned int kFlags = 0x0001U /* MFD_CLOEXEC */ | 0x0002U /* MFD_ALLOW_SEALING */;
+  const int fd = static_cast<int>(syscall(__NR_memfd_create, "aidl", kFlags));
+  if (fd < 0) return -1;
+  for (size_t written = 0; written < size;) {
+    const ssize_t n = TEMP_FAILURE_RETRY(write(fd, data + written, size - written));
+    if (n <= 0) {
+      const int error = n < 0 ? errno : EIO;
+      close(fd);
+      errno = error;
+      return -1;
+    }
+    written += static_cast<size_t>(n);
+  }
+  if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) != 0) {
+    const int error = errno;
+    close(fd);
+    errno = error;
+    return -1;
+  }
+  return fd;
+}
+
+// Copies the first |size| bytes of the region |fd| to |bytes|. Fails if the
+// region is shorter. The region comes from the sender, which may send a file
+// or a memfd without seals and shrink it meanwhile, so it is read rather than
+// mapped: a mapping would fault past the new end of the file.
+inline bool ReadRegion(int fd, size_t size, std::vector<uint8_t>* bytes) {
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < 0 || static_cast<size_t>(st.st_size) < size) {
+    return false;
+  }
+  std::vector<uint8_t> data(size);
+  for (size_t read = 0; read < size;) {
+    const ssize_t n = TEMP_FAILURE_RETRY(pread(fd, data.data() + read, size - read, read));
+    if (n <= 0) return false;
+    read += static_cast<size_t>(n);
+  }
+  *bytes = std::move(data);
+  return true;
+}
+
+}  // namespace shared_memory
+}  // namespace aidl
+}  // namespace android
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+// The @SharedMemory byte[]s of the NDK backend, see aidl/shared_memory.h
+
+#include <stdint.h>
+
+#include <limits>
+#include <vector>
+
+#include <aidl/shared_memory.h>
+#include <android/binder_auto_utils.h>
+#include <android/binder_parcel.h>
+#include <android/binder_parcel_utils.h>
+
+namespace android {
+namespace aidl {
+namespace shared_memory {
+
+inline binder_status_t WriteBytes(AParcel* parcel, const std::vector<uint8_t>& bytes,
+                                  size_t threshold) {
+  if (bytes.size() <= threshold) {
+    binder_status_t status = AParcel_writeInt32(parcel, kInline);
+    if (status != STATUS_OK) return status;
+    return ::ndk::AParcel_writeVector(parcel, bytes);
+  }
+  if (bytes.size() > static_cast<size_t>(std::numeric_limits<int32_t>::max())) {
+    return STATUS_BAD_VALUE;
+  }
+  ::ndk::ScopedFileDescriptor fd(CreateRegion(bytes.data(), bytes.size()));
+  if (fd.get() < 0) return STATUS_NO_MEMORY;
+  binder_status_t status = AParcel_writeInt32(parcel, kShared);
+  if (status != STATUS_OK) return status;
+  status = AParcel_writeInt32(parcel, static_cast<int32_t>(bytes.size()));
+  if (status != STATUS_OK) return status;
+  // The descriptor is duplicated into the parcel.
+  return AParcel_writeParcelFileDescriptor(parcel, fd.get());
+}
+
+inline binder_status_t ReadBytes(const AParcel* parcel, std::vector<uint8_t>* bytes) {
+  int32_t kind;
+  binder_status_t status = AParcel_readInt32(parcel, &kind);
+  if (status != STATUS_OK) return status;
+  if (kind == kInline) return ::ndk::AParcel_readVector(parcel, bytes);
+  if (kind != kShared) return STATUS_BAD_VALUE;
+  int32_t size;
+  status = AParcel_readInt32(parcel, &size);
+  if (status != STATUS_OK) return status;
+  if (size < 0) return STATUS_BAD_VALUE;
+  int raw_fd;
+  status = AParcel_readParcelFileDescriptor(parcel, &raw_fd);
+  if (status != STATUS_OK) return status;
+  ::ndk::ScopedFileDescriptor region(raw_fd);
+  if (region.get() < 0 || !ReadRegion(region.get(), static_cast<size_t>(size), bytes)) {
+    return STATUS_BAD_VALUE;
+  }
+  return STATUS_OK;
+}
+
+}  // namespace shared_memory
+}  // namespace aidl
+}  // namespace android
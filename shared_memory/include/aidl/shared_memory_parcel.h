@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+// The @SharedMemory byte[]s of the C++ backend, see aidl/shared_memory.h
+
+#include <stdint.h>
+
+#include <limits>
+#include <vector>
+
+#include <aidl/shared_memory.h>
+#include <android-base/unique_fd.h>
+#include <binder/Parcel.h>
+#include <binder/ParcelFileDescriptor.h>
+
+namespace android {
+namespace aidl {
+namespace shared_memory {
+
+inline status_t WriteBytes(Parcel* parcel, const std::vector<uint8_t>& bytes, size_t threshold) {
+  if (bytes.size() <= threshold) {
+    status_t status = parcel->writeInt32(kInline);
+    if (status != OK) return status;
+    return parcel->writeByteVector(bytes);
+  }
+  if (bytes.size() > static_cast<size_t>(std::numeric_limits<int32_t>::max())) {
+    return BAD_VALUE;
+  }
+  base::unique_fd fd(CreateRegion(bytes.data(), bytes.size()));
+  if (!fd.ok()) return -errno;
+  status_t status = parcel->writeInt32(kShared);
+  if (status != OK) return status;
+  status = parcel->writeInt32(static_cast<int32_t>(bytes.size()));
+  if (status != OK) return status;
+  return parcel->writeParcelable(os::ParcelFileDescriptor(std::move(fd)));
+}
+
+inline status_t ReadBytes(const Parcel* parcel, std::vector<uint8_t>* bytes) {
+  int32_t kind;
+  status_t status = parcel->readInt32(&kind);
+  if (status != OK) return status;
+  if (kind == kInline) return parcel->readByteVector(bytes);
+  if (kind != kShared) return BAD_VALUE;
+  int32_t size;
+  status = parcel->readInt32(&size);
+  if (status != OK) return status;
+  if (size < 0) return BAD_VALUE;
+  os::ParcelFileDescriptor region;
+  status = parcel->readParcelable(&region);
+  if (status != OK) return status;
+  if (!ReadRegion(region.get(), static_cast<size_t>(size), bytes)) return BAD_VALUE;
+  return OK;
+}
+
+}  // namespace shared_memory
+}  // namespace aidl
+}  // namespace android
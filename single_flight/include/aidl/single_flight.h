@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+// The calls in flight of the @SingleFlight methods, which the C++ and NDK
+// stubs keep per method, keyed by the in arguments of the calls. A call whose
+// arguments equal those of a call under way waits for it, and gets copies of
+// its status and result instead of calling the service again.
+
+#include <stddef.h>
+
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+
+namespace android {
+namespace aidl {
+
+// How the status of a call is copied for the calls that waited for it, which
+// the move-only statuses specialize
+template <typename Status>
+struct StatusCopy {
+  static Status Of(const Status& status) { return status; }
+};
+
+// The result of a method that returns void
+struct NoResult {};
+
+// Key is a std::tuple of the in arguments, which are looked up as a
+// std::tuple of references to them
+template <typename Key, typename Status, typename Result = NoResult>
+class SingleFlight {
+ public:
+  SingleFlight() = default;
+  SingleFlight(const SingleFlight&) = delete;
+  SingleFlight& operator=(const SingleFlight&) = delete;
+
+  // Returns the status of |call|, which writes its result to |result| (or
+  // nullptr for void), unless a call for an equal |key| is under way, in
+  // which case it waits for that one and copies its status and result.
+  template <typename K, typename Call>
+  Status Do(const K& key, Result* result, Call&& call) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (auto it = flights_.find(key); it != flights_.end()) {
+      std::shared_ptr<Flight> flight = it->second;
+      flight->followers++;
+      done_.wait(lock, [&] { return flight->status.has_value(); });
+      if (result != nullptr) *result = flight->result;
+      return StatusCopy<Status>::Of(*flight->status);
+    }
+    auto flight = std::make_shared<Flight>();
+    auto it = flights_.emplace(Key(key), flight).first;
+    lock.unlock();
+
+    Status status = call();
+
+    lock.lock();
+    flights_.erase(it);
+    // The copies are only made for the calls that wait
+    if (flight->followers == 0) return status;
+    if (result != nullptr) flight->result = *result;
+    flight->status.emplace(StatusCopy<Status>::Of(status));
+    lock.unlock();
+    done_.notify_all();
+    return status;
+  }
+
+  // The number of the calls that are under way, and of the calls that wait
+  // for them, for tests
+  size_t InFlight() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return flights_.size();
+  }
+  size_t Waiting() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t waiting = 0;
+    for (const auto& entry : flights_) waiting += entry.second->followers;
+    return waiting;
+  }
+
+ private:
+  struct Flight {
+    size_t followers = 0;
+    std::optional<Status> status;
+    Result result{};
+  };
+
+  mutable std::mutex mutex_;
+  std::condition_variable done_;
+  std::map<Key, std::shared_ptr<Flight>, std::less<>> flights_;
+};
+
+}  // namespace aidl
+}  // namespace android
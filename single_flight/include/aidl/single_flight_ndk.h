@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+// The calls in flight of the @SingleFlight methods of the NDK backend (see
+// aidl/single_flight.h), whose ScopedAStatus is copied by its parts.
+
+#include <android/binder_auto_utils.h>
+#include <android/binder_status.h>
+
+#include "aidl/single_flight.h"
+
+namespace android {
+namespace aidl {
+
+template <>
+struct StatusCopy<::ndk::ScopedAStatus> {
+  static ::ndk::ScopedAStatus Of(const ::ndk::ScopedAStatus& status) {
+    switch (status.getExceptionCode()) {
+      case EX_NONE:
+        return ::ndk::ScopedAStatus::ok();
+      case EX_SERVICE_SPECIFIC:
+        return ::ndk::ScopedAStatus::fromServiceSpecificErrorWithMessage(
+            status.getServiceSpecificError(), status.getMessage());
+      case EX_TRANSACTION_FAILED:
+        return ::ndk::ScopedAStatus::fromStatus(status.getStatus());
+      default:
+        return ::ndk::ScopedAStatus::fromExceptionCodeWithMessage(status.getExceptionCode(),
+                                                                  status.getMessage());
+    }
+  }
+};
+
+}  // namespace aidl
+}  // namespace android
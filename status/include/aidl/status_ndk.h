@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+// The status headers of the replies of the NDK backend. An OK status is just
+// EX_NONE on the wire, as Status::writeToParcel() writes it, so it is written
+// without going through the AStatus, and read into ScopedAStatus::ok() rather
+// than into a status made from the parcel. The other statuses go through
+// AParcel_writeStatusHeader() and AParcel_readStatusHeader().
+
+#include <stdint.h>
+
+#include <android/binder_auto_utils.h>
+#include <android/binder_parcel.h>
+#include <android/binder_status.h>
+
+namespace android {
+namespace aidl {
+
+// The exception code of an OK status
+constexpr int32_t kExNone = 0;
+
+inline binder_status_t WriteStatusHeader(AParcel* parcel, const AStatus* status) {
+  if (AStatus_isOk(status)) return AParcel_writeInt32(parcel, kExNone);
+  return AParcel_writeStatusHeader(parcel, status);
+}
+
+inline binder_status_t ReadStatusHeader(const AParcel* parcel, ::ndk::ScopedAStatus* status) {
+  const int32_t position = AParcel_getDataPosition(parcel);
+  int32_t exception;
+  if (AParcel_readInt32(parcel, &exception) == STATUS_OK && exception == kExNone) {
+    *status = ::ndk::ScopedAStatus::ok();
+    return STATUS_OK;
+  }
+  // e.g. a service specific error, or the header of a strict mode reply
+  binder_status_t ret = AParcel_setDataPosition(parcel, position);
+  if (ret != STATUS_OK) return ret;
+  return AParcel_readStatusHeader(parcel, status->getR());
+}
+
+}  // namespace aidl
+}  // namespace android
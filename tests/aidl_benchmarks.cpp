@@ -0,0 +1,300 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Benchmarks of the compiler pipeline over synthetic corpora of controlled
+// size (see tests/aidl_corpus.h), kept in memory by a FakeIoDelegate so that disk I/O does not add
+// noise. To compare two builds, run both with
+//
+//   aidl_benchmarks --benchmark_repetitions=10 --benchmark_report_aggregates_only
+//       --benchmark_out_format=json --benchmark_out=FILE
+//
+// and compare the medians, e.g. with google-benchmark's tools/compare.py.
+
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <android-base/stringprintf.h>
+#include <benchmark/benchmark.h>
+
+#include "aidl.h"
+#include "aidl_checkapi.h"
+#include "aidl_language.h"
+#include "aidl_typenames.h"
+#include "options.h"
+#include "tests/aidl_corpus.h"
+#include "tests/aidl_fuzz_generator.h"
+#include "tests/fake_io_delegate.h"
+
+using android::aidl::test::Corpus;
+using android::aidl::test::CorpusSpec;
+using android::aidl::test::FakeIoDelegate;
+using android::aidl::test::FuzzCompiler;
+using android::base::StringPrintf;
+using std::string;
+using std::vector;
+
+namespace android {
+namespace aidl {
+namespace {
+
+// Adds the files of a corpus of |spec| to |io|.
+void AddCorpus(const CorpusSpec& spec, FakeIoDelegate* io, string* import_flags = nullptr) {
+  Corpus corpus(spec);
+  corpus.AddTo(io);
+  if (import_flags != nullptr) {
+    *import_flags = corpus.ImportFlags();
+  }
+}
+
+void Compile(benchmark::State& state, const string& cmdline, const FakeIoDelegate& io) {
+  Options options = Options::From(cmdline);
+  for (auto _ : state) {
+    if (compile_aidl(options, io) != 0) {
+      state.SkipWithError("compile failed");
+      return;
+    }
+  }
+}
+
+void Load(benchmark::State& state, const string& input, const string& cmdline,
+          const FakeIoDelegate& io) {
+  Options options = Options::From(cmdline);
+  for (auto _ : state) {
+    AidlTypenames typenames;
+    vector<AidlDefinedType*> defined_types;
+    vector<string> imported_files;
+    if (internals::load_and_validate_aidl(input, options, io, &typenames, &defined_types,
+                                          &imported_files) != AidlError::OK) {
+      state.SkipWithError("load failed");
+      return;
+    }
+  }
+}
+
+// Lookups of the built-in type names, which every aidl process does for each
+// type it resolves. Their tables are constexpr, so this must not allocate.
+void BM_BuiltinTypeLookups(benchmark::State& state) {
+  const vector<string> names = {
+      "int",     "String", "java.util.List", "android.os.ParcelFileDescriptor", "p.IFoo",
+      "IBinder", "double", "Map",            "FileDescriptor",                  "p.q.Parcel"};
+  for (auto _ : state) {
+    for (const string& name : names) {
+      benchmark::DoNotOptimize(AidlTypenames::GetBuiltinKind(name));
+      benchmark::DoNotOptimize(AidlTypenames::IsPrimitiveTypename(name));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * names.size());
+}
+BENCHMARK(BM_BuiltinTypeLookups);
+
+// Compilation of an interface with a single method, which is what most of the
+// many short-lived aidl processes of a build do; fixed costs dominate it.
+void BM_Startup(benchmark::State& state, const char* lang) {
+  FakeIoDelegate io;
+  CorpusSpec spec;
+  spec.methods = 1;
+  spec.constants = 0;
+  AddCorpus(spec, &io);
+  Compile(state, StringPrintf("aidl --lang=%s -I src -o out -h out src/p/IFoo.aidl", lang), io);
+}
+BENCHMARK_CAPTURE(BM_Startup, java, "java");
+BENCHMARK_CAPTURE(BM_Startup, cpp, "cpp");
+BENCHMARK_CAPTURE(BM_Startup, ndk, "ndk");
+
+// Lexing and parsing of a single file, without resolving its types, with
+// either lexer.
+void BM_Parse(benchmark::State& state, bool hand_written_lexer) {
+  Parser::SetHandWrittenLexer(hand_written_lexer);
+  FakeIoDelegate io;
+  CorpusSpec spec;
+  spec.methods = static_cast<int>(state.range(0));
+  spec.constants = 0;
+  AddCorpus(spec, &io);
+  for (auto _ : state) {
+    AidlTypenames typenames;
+    if (Parser::Parse("src/p/IFoo.aidl", io, typenames) == nullptr) {
+      state.SkipWithError("parse failed");
+      return;
+    }
+  }
+  state.SetComplexityN(state.range(0));
+  Parser::SetHandWrittenLexer(false);
+}
+BENCHMARK_CAPTURE(BM_Parse, flex, false)->RangeMultiplier(4)->Range(16, 4096)->Complexity();
+BENCHMARK_CAPTURE(BM_Parse, hand_written, true)
+    ->RangeMultiplier(4)
+    ->Range(16, 4096)
+    ->Complexity();
+
+// Loading, type resolution and validation of an interface that imports a
+// chain of range(0) parcelables from 8 import roots.
+void BM_ResolveImports(benchmark::State& state) {
+  FakeIoDelegate io;
+  string import_flags;
+  CorpusSpec spec;
+  spec.imports = static_cast<int>(state.range(0));
+  spec.import_roots = 8;
+  spec.import_chain = true;
+  AddCorpus(spec, &io, &import_flags);
+  Load(state, "src/p/IFoo.aidl",
+       "aidl --lang=java -I src " + import_flags + " -o out src/p/IFoo.aidl", io);
+  state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_ResolveImports)->RangeMultiplier(4)->Range(1, 256)->Complexity();
+
+// Evaluation of range(0) constants, each an expression of depth range(1).
+void BM_ConstExpressions(benchmark::State& state) {
+  FakeIoDelegate io;
+  CorpusSpec spec;
+  spec.methods = 0;
+  spec.constants = static_cast<int>(state.range(0));
+  spec.expression_depth = static_cast<int>(state.range(1));
+  AddCorpus(spec, &io);
+  Load(state, "src/p/IFoo.aidl", "aidl --lang=java -I src -o out src/p/IFoo.aidl", io);
+}
+BENCHMARK(BM_ConstExpressions)->Args({16, 16})->Args({256, 16})->Args({16, 128});
+
+// Evaluation of an enum of range(0) implicitly numbered enumerators.
+void BM_Enumerators(benchmark::State& state) {
+  FakeIoDelegate io;
+  CorpusSpec spec;
+  spec.enumerators = static_cast<int>(state.range(0));
+  AddCorpus(spec, &io);
+  Load(state, "src/p/Kind.aidl", "aidl --lang=java -o out src/p/Kind.aidl", io);
+  state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_Enumerators)->RangeMultiplier(4)->Range(16, 1024)->Complexity();
+
+// The whole pipeline of a backend for an interface with range(0) methods.
+void BM_GenerateInterface(benchmark::State& state, const char* lang) {
+  FakeIoDelegate io;
+  CorpusSpec spec;
+  spec.methods = static_cast<int>(state.range(0));
+  AddCorpus(spec, &io);
+  Compile(state, StringPrintf("aidl --lang=%s -I src -o out -h out src/p/IFoo.aidl", lang), io);
+  state.SetComplexityN(state.range(0));
+}
+BENCHMARK_CAPTURE(BM_GenerateInterface, java, "java")->RangeMultiplier(4)->Range(16, 1024);
+BENCHMARK_CAPTURE(BM_GenerateInterface, cpp, "cpp")->RangeMultiplier(4)->Range(16, 1024);
+BENCHMARK_CAPTURE(BM_GenerateInterface, ndk, "ndk")->RangeMultiplier(4)->Range(16, 1024);
+
+// The whole pipeline of a backend for a parcelable with range(0) fields.
+void BM_GenerateParcelable(benchmark::State& state, const char* lang) {
+  FakeIoDelegate io;
+  CorpusSpec spec;
+  spec.fields = static_cast<int>(state.range(0));
+  AddCorpus(spec, &io);
+  Compile(state, StringPrintf("aidl --lang=%s -o out -h out src/p/Data.aidl", lang), io);
+  state.SetComplexityN(state.range(0));
+}
+BENCHMARK_CAPTURE(BM_GenerateParcelable, java, "java")->RangeMultiplier(4)->Range(16, 1024);
+BENCHMARK_CAPTURE(BM_GenerateParcelable, cpp, "cpp")->RangeMultiplier(4)->Range(16, 1024);
+BENCHMARK_CAPTURE(BM_GenerateParcelable, ndk, "ndk")->RangeMultiplier(4)->Range(16, 1024);
+
+// Compiles all sources of a corpus whose types have range(0) members each and
+// which imports range(0) parcelables from 16 import roots.
+void BM_CompileCorpus(benchmark::State& state) {
+  FakeIoDelegate io;
+  const int n = state.range(0);
+  string import_flags;
+  CorpusSpec spec;
+  spec.methods = n;
+  spec.fields = n;
+  spec.enumerators = n;
+  spec.imports = n;
+  spec.import_roots = 16;
+  AddCorpus(spec, &io, &import_flags);
+  Compile(state,
+          "aidl --lang=java -I src " + import_flags +
+              " -o out src/p/IFoo.aidl src/p/Data.aidl src/p/Kind.aidl",
+          io);
+  state.SetComplexityN(n);
+}
+BENCHMARK(BM_CompileCorpus)->RangeMultiplier(4)->Range(16, 1024)->Complexity();
+
+void BM_DumpApi(benchmark::State& state) {
+  FakeIoDelegate io;
+  const int n = state.range(0);
+  CorpusSpec spec;
+  spec.methods = n;
+  spec.fields = n;
+  spec.enumerators = n;
+  AddCorpus(spec, &io);
+  Options options = Options::From(
+      "aidl --dumpapi -I src -o dump src/p/IFoo.aidl src/p/Data.aidl src/p/Kind.aidl");
+  for (auto _ : state) {
+    if (!dump_api(options, io)) {
+      state.SkipWithError("dump failed");
+      return;
+    }
+  }
+  state.SetComplexityN(n);
+}
+BENCHMARK(BM_DumpApi)->RangeMultiplier(4)->Range(16, 1024)->Complexity();
+
+// Checks a compatible change of types with range(0) members each.
+void BM_CheckApi(benchmark::State& state) {
+  FakeIoDelegate io;
+  const int n = state.range(0);
+  CorpusSpec spec;
+  spec.methods = n;
+  spec.fields = n;
+  spec.enumerators = n;
+  spec.versions = 2;
+  AddCorpus(spec, &io);
+  Options options =
+      Options::From("aidl --checkapi " + Corpus::VersionDir(1) + " " + Corpus::VersionDir(2));
+  for (auto _ : state) {
+    if (!check_api(options, io)) {
+      state.SkipWithError("check failed");
+      return;
+    }
+  }
+  state.SetComplexityN(n);
+}
+BENCHMARK(BM_CheckApi)->RangeMultiplier(4)->Range(16, 1024)->Complexity();
+
+// Compiles the sources that aidl_structured_fuzzer generates from random
+// bytes for all three backends, which is the rate that the fuzzer executes at.
+void BM_CompileFuzzedInputs(benchmark::State& state) {
+  FuzzCompiler compiler;
+  std::mt19937 random(2020);
+  vector<vector<uint8_t>> inputs(64);
+  for (vector<uint8_t>& input : inputs) {
+    input.resize(random() % 512);
+    for (uint8_t& byte : input) {
+      byte = static_cast<uint8_t>(random());
+    }
+  }
+  size_t i = 0;
+  for (auto _ : state) {
+    const vector<uint8_t>& input = inputs[i++ % inputs.size()];
+    if (compiler.Compile(input.data(), input.size()) != 0) {
+      state.SkipWithError("compile failed");
+      return;
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_CompileFuzzedInputs);
+
+}  // namespace
+}  // namespace aidl
+}  // namespace android
+
+BENCHMARK_MAIN();
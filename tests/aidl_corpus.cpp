@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "tests/aidl_corpus.h"
+
+#include <android-base/macros.h>
+#include <android-base/stringprintf.h>
+
+using android::base::StringAppendF;
+using android::base::StringPrintf;
+using std::string;
+
+namespace android {
+namespace aidl {
+namespace test {
+
+namespace {
+
+// Operators that keep the value of an expression small however deep it is.
+const char* kOperators[] = {"+", "|", "-", "^", "&"};
+const char* kFieldTypes[] = {"int", "long", "String", "boolean[]", "List<String>", "double"};
+
+string ConstExpression(int depth) {
+  string expression;
+  for (int i = depth; i > 0; i--) {
+    StringAppendF(&expression, "(%d %s ", i % 7, kOperators[i % arraysize(kOperators)]);
+  }
+  return expression + "1" + string(depth, ')');
+}
+
+// Like the dumps of frozen versions, |frozen| refers to other types by their
+// qualified names instead of importing them.
+string Interface(const CorpusSpec& spec, int extra_methods, bool frozen) {
+  const char* p = frozen ? "p." : "";
+  const char* q = frozen ? "q." : "";
+  string aidl = "package p;\n";
+  if (!frozen) {
+    aidl += "import p.Data;\nimport p.Kind;\n";
+    for (int i = 0; i < spec.imports; i++) {
+      StringAppendF(&aidl, "import q.X%d;\n", i);
+    }
+  }
+  aidl += "interface IFoo {\n";
+  const string expression = ConstExpression(spec.expression_depth);
+  for (int i = 0; i < spec.constants; i++) {
+    StringAppendF(&aidl, "  const int C%d = %s;\n", i, expression.c_str());
+  }
+  for (int i = 0; i < spec.imports; i++) {
+    StringAppendF(&aidl, "  void take%d(in %sX%d x);\n", i, q, i);
+  }
+  for (int i = 0; i < spec.methods; i++) {
+    StringAppendF(&aidl, "  int m%d(int a, in String b, out long[] c, inout List<String> d);\n", i);
+  }
+  for (int i = 0; i < extra_methods; i++) {
+    StringAppendF(&aidl, "  void added%d(in %sData data, %sKind kind);\n", i, p, p);
+  }
+  return aidl + "}\n";
+}
+
+string Data(const CorpusSpec& spec, int extra_fields) {
+  string aidl = "package p;\nparcelable Data {\n";
+  for (int i = 0; i < spec.fields + extra_fields; i++) {
+    StringAppendF(&aidl, "  %s f%d;\n", kFieldTypes[i % arraysize(kFieldTypes)], i);
+  }
+  return aidl + "}\n";
+}
+
+string Kind(const CorpusSpec& spec) {
+  string aidl = "package p;\n@Backing(type=\"int\")\nenum Kind {\n";
+  for (int i = 0; i < spec.enumerators; i++) {
+    StringAppendF(&aidl, "  K%d,\n", i);
+  }
+  return aidl + "}\n";
+}
+
+string Imported(const CorpusSpec& spec, int index) {
+  const bool has_next = spec.import_chain && index + 1 < spec.imports;
+  string aidl = "package q;\n";
+  if (has_next) {
+    StringAppendF(&aidl, "import q.X%d;\n", index + 1);
+  }
+  StringAppendF(&aidl, "parcelable X%d {\n  int id;\n  String name;\n", index);
+  if (has_next) {
+    StringAppendF(&aidl, "  X%d next;\n", index + 1);
+  }
+  return aidl + "}\n";
+}
+
+}  // namespace
+
+Corpus::Corpus(const CorpusSpec& spec) {
+  for (int root = 0; root < spec.import_roots; root++) {
+    import_roots_.push_back(StringPrintf("root%d", root));
+  }
+  for (int i = 0; i < spec.imports; i++) {
+    const string& root = import_roots_[i % import_roots_.size()];
+    files_[StringPrintf("%s/q/X%d.aidl", root.c_str(), i)] = Imported(spec, i);
+  }
+  for (int version = 1; version <= spec.versions + 1; version++) {
+    const string dir = version <= spec.versions ? VersionDir(version) : "src";
+    files_[dir + "/p/IFoo.aidl"] = Interface(spec, version - 1, version <= spec.versions);
+    files_[dir + "/p/Data.aidl"] = Data(spec, version - 1);
+    files_[dir + "/p/Kind.aidl"] = Kind(spec);
+  }
+  inputs_ = {"src/p/IFoo.aidl", "src/p/Data.aidl", "src/p/Kind.aidl"};
+}
+
+string Corpus::ImportFlags() const {
+  string flags;
+  for (const string& root : import_roots_) {
+    flags += (flags.empty() ? "-I " : " -I ") + root;
+  }
+  return flags;
+}
+
+string Corpus::VersionDir(int version) {
+  return StringPrintf("api/%d", version);
+}
+
+void Corpus::AddTo(FakeIoDelegate* io_delegate) const {
+  for (const auto& [path, contents] : files_) {
+    io_delegate->SetFileContents(path, contents);
+  }
+}
+
+}  // namespace test
+}  // namespace aidl
+}  // namespace android
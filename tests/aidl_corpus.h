@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "tests/fake_io_delegate.h"
+
+namespace android {
+namespace aidl {
+namespace test {
+
+// The size of a synthetic corpus, see Corpus.
+struct CorpusSpec {
+  // Methods of p.IFoo, on top of one method per import.
+  int methods = 16;
+  // Fields of p.Data.
+  int fields = 16;
+  // Enumerators of p.Kind, which are numbered implicitly.
+  int enumerators = 16;
+  // Constants of p.IFoo, each a constant expression nested this deep.
+  int constants = 16;
+  int expression_depth = 4;
+  // Parcelables q.X0 ... that p.IFoo imports, spread over this many import
+  // roots. With |import_chain|, each of them also imports the next one.
+  int imports = 0;
+  int import_roots = 1;
+  bool import_chain = false;
+  // Frozen versions of the API, each of which has one method and one field
+  // more than the previous one. The sources have one more again.
+  int versions = 0;
+};
+
+// A synthetic corpus to stress the compiler with:
+//   src/p/IFoo.aidl, src/p/Data.aidl, src/p/Kind.aidl  the sources
+//   root<R>/q/X<I>.aidl                               the imported parcelables
+//   api/<V>/p/...                                     the frozen versions
+class Corpus {
+ public:
+  explicit Corpus(const CorpusSpec& spec);
+
+  // Contents by path.
+  const std::map<std::string, std::string>& Files() const { return files_; }
+
+  // The sources, which are to be compiled with "-I src" and ImportFlags().
+  const std::vector<std::string>& Inputs() const { return inputs_; }
+  // "-I root0 -I root1 ...", the import roots of the imported parcelables.
+  std::string ImportFlags() const;
+  // The directory of frozen version |version|, 1 to spec.versions.
+  static std::string VersionDir(int version);
+
+  void AddTo(FakeIoDelegate* io_delegate) const;
+
+ private:
+  std::map<std::string, std::string> files_;
+  std::vector<std::string> inputs_;
+  std::vector<std::string> import_roots_;
+};
+
+}  // namespace test
+}  // namespace aidl
+}  // namespace android
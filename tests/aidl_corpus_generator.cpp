@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Writes a synthetic corpus (see tests/aidl_corpus.h) to a directory, to
+// stress the aidl binary or the build rules with, e.g.
+//
+//   aidl_corpus_generator --methods=5000 --imports=300 --import_roots=20 --versions=3 out
+//   cd out && aidl --lang=java -I src -I root0 ... -o gen src/p/IFoo.aidl
+
+#include <iostream>
+#include <map>
+#include <string>
+
+#include <android-base/parseint.h>
+#include <android-base/strings.h>
+
+#include "io_delegate.h"
+#include "tests/aidl_corpus.h"
+
+using android::aidl::IoDelegate;
+using android::aidl::test::Corpus;
+using android::aidl::test::CorpusSpec;
+using std::cerr;
+using std::endl;
+using std::string;
+
+namespace {
+
+int Usage(const char* myname) {
+  cerr << "usage: " << myname << " [--NAME=N]... DIR" << endl
+       << "NAME is one of methods, fields, enumerators, constants, expression_depth," << endl
+       << "imports, import_roots, import_chain (0 or 1) and versions." << endl;
+  return 1;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  CorpusSpec spec;
+  int import_chain = 0;
+  const std::map<string, int*> sizes = {
+      {"methods", &spec.methods},
+      {"fields", &spec.fields},
+      {"enumerators", &spec.enumerators},
+      {"constants", &spec.constants},
+      {"expression_depth", &spec.expression_depth},
+      {"imports", &spec.imports},
+      {"import_roots", &spec.import_roots},
+      {"versions", &spec.versions},
+      {"import_chain", &import_chain},
+  };
+  string dir;
+  for (int i = 1; i < argc; i++) {
+    const string arg = argv[i];
+    if (!android::base::StartsWith(arg, "--")) {
+      if (!dir.empty()) return Usage(argv[0]);
+      dir = arg;
+      continue;
+    }
+    const size_t equals = arg.find('=');
+    if (equals == string::npos) return Usage(argv[0]);
+    const string name = arg.substr(2, equals - 2);
+    const string value = arg.substr(equals + 1);
+    auto it = sizes.find(name);
+    if (it == sizes.end() || !android::base::ParseInt(value, it->second, 0)) {
+      return Usage(argv[0]);
+    }
+  }
+  if (dir.empty() || spec.import_roots < 1) return Usage(argv[0]);
+  spec.import_chain = import_chain != 0;
+
+  const Corpus corpus(spec);
+  IoDelegate io_delegate;
+  for (const auto& [path, contents] : corpus.Files()) {
+    auto writer = io_delegate.GetCodeWriter(dir + "/" + path);
+    if (writer != nullptr) {
+      (*writer) << contents;
+    }
+    if (writer == nullptr || !writer->Close()) {
+      cerr << "Failed to write " << dir << "/" << path << endl;
+      return 1;
+    }
+  }
+  return 0;
+}
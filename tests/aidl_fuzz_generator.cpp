@@ -0,0 +1,295 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "tests/aidl_fuzz_generator.h"
+
+#include <string>
+#include <vector>
+
+#include <android-base/stringprintf.h>
+
+#include "options.h"
+
+using android::base::StringPrintf;
+using std::string;
+using std::vector;
+
+namespace android {
+namespace aidl {
+namespace test {
+
+const char kFuzzImportDir[] = ".";
+
+namespace {
+
+// Reads the choices of the generator from the fuzzer bytes
+class ByteReader {
+ public:
+  ByteReader(const uint8_t* data, size_t size) : data_(data), size_(size) {}
+
+  uint8_t Byte() { return pos_ < size_ ? data_[pos_++] : 0; }
+  // A number in [0, n)
+  size_t Below(size_t n) { return Byte() % n; }
+  bool Bool() { return (Byte() & 1) != 0; }
+
+ private:
+  const uint8_t* const data_;
+  const size_t size_;
+  size_t pos_ = 0;
+};
+
+enum class Kind {
+  BOOLEAN,
+  INTEGRAL,  // byte, int and long, which take constant expressions
+  CHAR,
+  FLOATING,
+  STRING,
+  NULLABLE,  // IBinder and interfaces, which may be @nullable
+  ENUM,
+  DIRECTED,  // arrays, lists and parcelables, which need a direction
+};
+
+struct FuzzType {
+  const char* name;
+  Kind kind;
+};
+
+constexpr FuzzType kTypes[] = {
+    {"boolean", Kind::BOOLEAN},
+    {"byte", Kind::INTEGRAL},
+    {"char", Kind::CHAR},
+    {"int", Kind::INTEGRAL},
+    {"long", Kind::INTEGRAL},
+    {"float", Kind::FLOATING},
+    {"double", Kind::FLOATING},
+    {"String", Kind::STRING},
+    {"IBinder", Kind::NULLABLE},
+    {"ICallback", Kind::NULLABLE},
+    {"Color", Kind::ENUM},
+    {"Point", Kind::DIRECTED},
+    {"ParcelFileDescriptor", Kind::DIRECTED},
+    {"int[]", Kind::DIRECTED},
+    {"byte[]", Kind::DIRECTED},
+    {"String[]", Kind::DIRECTED},
+    {"Point[]", Kind::DIRECTED},
+    {"List<String>", Kind::DIRECTED},
+};
+
+const FuzzType& AnyType(ByteReader* in) {
+  return kTypes[in->Below(sizeof(kTypes) / sizeof(kTypes[0]))];
+}
+
+// The annotations that |type| may take as a member or an argument
+string Annotations(ByteReader* in, const FuzzType& type) {
+  if (type.kind == Kind::STRING) {
+    const char* const annotations[] = {"", "@utf8InCpp ", "@nullable ",
+                                       "@nullable @utf8InCpp "};
+    return annotations[in->Below(4)];
+  }
+  if (type.kind == Kind::NULLABLE && in->Bool()) {
+    return "@nullable ";
+  }
+  return "";
+}
+
+// A constant expression of type int that is nested up to |depth| deep. Its
+// operands stay small enough for the value not to overflow, and the right
+// operands of divisions and shifts are literals, so that it always evaluates.
+string IntExpression(ByteReader* in, int depth) {
+  auto literal = [&](int max) {
+    const int value = in->Below(max + 1);
+    return in->Bool() ? StringPrintf("0x%x", value) : std::to_string(value);
+  };
+  if (depth <= 0 || in->Below(4) == 0) {
+    return literal(7);
+  }
+  static const char* const kBinaryOperators[] = {"+", "-", "*", "&", "|", "^"};
+  switch (in->Below(5)) {
+    case 0:
+    case 1: {
+      const string lhs = IntExpression(in, depth - 1);
+      const char* op = kBinaryOperators[in->Below(6)];
+      return "(" + lhs + " " + op + " " + IntExpression(in, depth - 1) + ")";
+    }
+    case 2: {
+      const char* op = in->Bool() ? "/" : "%";
+      return "(" + IntExpression(in, depth - 1) + " " + op + " " + std::to_string(1 + in->Below(7)) +
+             ")";
+    }
+    case 3: {
+      const char* op = in->Bool() ? "<<" : ">>";
+      return "(" + literal(7) + " " + op + " " + std::to_string(in->Below(4)) + ")";
+    }
+    default: {
+      const char* op = in->Bool() ? "-" : "~";
+      return op + string("(") + IntExpression(in, depth - 1) + ")";
+    }
+  }
+}
+
+// A default value of a field of |type|, or "" for none
+string DefaultValue(ByteReader* in, const FuzzType& type) {
+  if (!in->Bool()) return "";
+  switch (type.kind) {
+    case Kind::BOOLEAN:
+      return in->Bool() ? "true" : "false";
+    case Kind::INTEGRAL:
+      // A byte takes a literal, which always fits
+      return string(type.name) == "byte" ? std::to_string(in->Below(100))
+                                         : IntExpression(in, 3);
+    case Kind::CHAR:
+      return StringPrintf("'%c'", 'a' + static_cast<char>(in->Below(26)));
+    case Kind::FLOATING:
+      return StringPrintf("%d.5%s", static_cast<int>(in->Below(10)),
+                          string(type.name) == "float" ? "f" : "");
+    case Kind::STRING:
+      return StringPrintf("\"s%d\"", static_cast<int>(in->Below(10)));
+    default:
+      return "";
+  }
+}
+
+string Interface(ByteReader* in, const string& name) {
+  string code = "interface " + name + " {\n";
+  const size_t constants = in->Below(4);
+  for (size_t i = 0; i < constants; i++) {
+    if (in->Bool()) {
+      code += StringPrintf("  const int C%zu = %s;\n", i, IntExpression(in, 4).c_str());
+    } else {
+      code += StringPrintf("  const String S%zu = \"s%zu\";\n", i, i);
+    }
+  }
+  // Either all or none of the methods have explicit ids
+  const bool explicit_ids = in->Below(4) == 0;
+  const size_t methods = in->Below(8);
+  for (size_t i = 0; i < methods; i++) {
+    const bool oneway = in->Below(4) == 0;
+    string return_type = "void";
+    if (!oneway && in->Bool()) {
+      const FuzzType& type = AnyType(in);
+      return_type = Annotations(in, type) + type.name;
+    }
+    vector<string> args;
+    const size_t num_args = in->Below(5);
+    for (size_t j = 0; j < num_args; j++) {
+      const FuzzType& type = AnyType(in);
+      string direction;
+      if (type.kind == Kind::DIRECTED) {
+        static const char* const kDirections[] = {"in ", "out ", "inout "};
+        direction = kDirections[oneway ? 0 : in->Below(3)];
+      }
+      args.push_back(Annotations(in, type) + direction + type.name + " a" + std::to_string(j));
+    }
+    code += StringPrintf("  %s%s m%zu(", oneway ? "oneway " : "", return_type.c_str(), i);
+    for (size_t j = 0; j < args.size(); j++) {
+      code += (j > 0 ? ", " : "") + args[j];
+    }
+    code += explicit_ids ? StringPrintf(") = %zu;\n", 10 + i * 3) : ");\n";
+  }
+  return code + "}\n";
+}
+
+string Parcelable(ByteReader* in, const string& name) {
+  string code = "parcelable " + name + " {\n";
+  const size_t fields = in->Below(9);
+  for (size_t i = 0; i < fields; i++) {
+    const FuzzType& type = AnyType(in);
+    const string value = DefaultValue(in, type);
+    code += StringPrintf("  %s%s f%zu%s;\n", Annotations(in, type).c_str(), type.name, i,
+                         value.empty() ? "" : (" = " + value).c_str());
+  }
+  return code + "}\n";
+}
+
+string Enum(ByteReader* in, const string& name) {
+  static const char* const kBackingTypes[] = {"byte", "int", "long"};
+  const string backing = kBackingTypes[in->Below(3)];
+  string code = "@Backing(type=\"" + backing + "\")\nenum " + name + " {\n";
+  const size_t enumerators = 1 + in->Below(8);
+  for (size_t i = 0; i < enumerators; i++) {
+    string value;
+    if (in->Bool()) {
+      // A byte takes a shallow expression, which fits
+      value = " = " + IntExpression(in, backing == "byte" ? 1 : 3);
+    }
+    code += StringPrintf("  E%zu%s,\n", i, value.c_str());
+  }
+  return code + "}\n";
+}
+
+}  // namespace
+
+void AddFuzzImports(FakeIoDelegate* io_delegate) {
+  io_delegate->SetFileContents("common/Point.aidl",
+                               "package common;\n"
+                               "parcelable Point { int x; int y; }\n");
+  io_delegate->SetFileContents("common/Color.aidl",
+                               "package common;\n"
+                               "@Backing(type=\"byte\") enum Color { RED, GREEN, BLUE }\n");
+  io_delegate->SetFileContents("common/ICallback.aidl",
+                               "package common;\n"
+                               "interface ICallback { void onEvent(int code); }\n");
+}
+
+string GenerateFuzzAidl(const uint8_t* data, size_t size, const string& name) {
+  ByteReader in(data, size);
+  string code =
+      "package fuzz;\n"
+      "import common.Color;\n"
+      "import common.ICallback;\n"
+      "import common.Point;\n";
+  switch (in.Below(3)) {
+    case 0:
+      return code + Interface(&in, name);
+    case 1:
+      return code + Parcelable(&in, name);
+    default:
+      return code + Enum(&in, name);
+  }
+}
+
+FuzzCompiler::FuzzCompiler(size_t reset_interval)
+    : reset_interval_(reset_interval > 0 ? reset_interval : 1) {
+  Reset();
+}
+
+void FuzzCompiler::Reset() {
+  io_delegate_ = std::make_unique<FakeIoDelegate>();
+  AddFuzzImports(io_delegate_.get());
+  session_ = std::make_unique<CompileSession>();
+}
+
+int FuzzCompiler::Compile(const uint8_t* data, size_t size) {
+  if (compiled_ > 0 && compiled_ % reset_interval_ == 0) {
+    Reset();
+  }
+  // Each source defines a type of its own, so that the session keeps the
+  // imports that it has parsed for the previous ones.
+  const string name = "Fuzz" + std::to_string(compiled_++);
+  const string path = "fuzz/" + name + ".aidl";
+  source_ = GenerateFuzzAidl(data, size, name);
+  io_delegate_->SetFileContents(path, source_);
+
+  const Options options = Options::From(
+      StringPrintf("aidl --lang=cpp,ndk,java -I %s --out=cpp:out/cpp --out=ndk:out/ndk "
+                   "--out=java:out/java --header_out=cpp:out/cpp --header_out=ndk:out/ndk %s",
+                   kFuzzImportDir, path.c_str()));
+  return compile_aidl(options, *io_delegate_, session_.get());
+}
+
+}  // namespace test
+}  // namespace aidl
+}  // namespace android
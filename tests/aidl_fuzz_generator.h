@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "aidl.h"
+#include "tests/fake_io_delegate.h"
+
+namespace android {
+namespace aidl {
+namespace test {
+
+// The directory of the files that every generated type may import:
+//   common/Point.aidl      parcelable common.Point
+//   common/Color.aidl      enum common.Color
+//   common/ICallback.aidl  interface common.ICallback
+extern const char kFuzzImportDir[];
+
+void AddFuzzImports(FakeIoDelegate* io_delegate);
+
+// Turns fuzzer bytes into the source of an AIDL file that defines the type
+// fuzz.<name>: an interface, a parcelable or an enum with members of the
+// builtin and the imported types, and constants and default values that are
+// nested constant expressions. Every source parses, so that a mutation of the
+// bytes changes the declarations rather than breaking the lexer. The same
+// bytes always make the same source; once they run out, they read as zeros.
+std::string GenerateFuzzAidl(const uint8_t* data, size_t size, const std::string& name);
+
+// Compiles generated sources for all three backends in memory. The imports
+// are parsed once and shared by the compilations, see CompileSession, until
+// |reset_interval| sources have been compiled, which bounds the memory of the
+// types that the sources add.
+class FuzzCompiler {
+ public:
+  explicit FuzzCompiler(size_t reset_interval = 256);
+
+  // Generates the next type from |data| and compiles it, returning the exit
+  // code of the compiler.
+  int Compile(const uint8_t* data, size_t size);
+
+  // The source that the last call of Compile() compiled
+  const std::string& LastSource() const { return source_; }
+
+ private:
+  void Reset();
+
+  const size_t reset_interval_;
+  size_t compiled_ = 0;
+  std::unique_ptr<FakeIoDelegate> io_delegate_;
+  std::unique_ptr<CompileSession> session_;
+  std::string source_;
+};
+
+}  // namespace test
+}  // namespace aidl
+}  // namespace android
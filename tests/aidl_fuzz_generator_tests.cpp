@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "tests/aidl_fuzz_generator.h"
+
+using std::string;
+using std::vector;
+
+namespace android {
+namespace aidl {
+namespace test {
+
+namespace {
+
+vector<uint8_t> RandomBytes(std::mt19937* random, size_t size) {
+  vector<uint8_t> bytes(size);
+  for (uint8_t& byte : bytes) {
+    byte = static_cast<uint8_t>((*random)());
+  }
+  return bytes;
+}
+
+}  // namespace
+
+TEST(AidlFuzzGeneratorTest, GeneratesTheSameSourceFromTheSameBytes) {
+  std::mt19937 random(1);
+  const vector<uint8_t> bytes = RandomBytes(&random, 256);
+  EXPECT_EQ(GenerateFuzzAidl(bytes.data(), bytes.size(), "Fuzz"),
+            GenerateFuzzAidl(bytes.data(), bytes.size(), "Fuzz"));
+}
+
+TEST(AidlFuzzGeneratorTest, GeneratesADeclarationFromNoBytes) {
+  const string source = GenerateFuzzAidl(nullptr, 0, "Fuzz");
+  EXPECT_NE(string::npos, source.find("package fuzz;\n")) << source;
+  EXPECT_NE(string::npos, source.find("interface Fuzz {\n}\n")) << source;
+}
+
+TEST(AidlFuzzGeneratorTest, GeneratedSourcesCompileForAllBackends) {
+  // Resets the session during the run as well
+  FuzzCompiler compiler(64);
+  std::mt19937 random(2020);
+  for (int i = 0; i < 200; i++) {
+    const vector<uint8_t> bytes = RandomBytes(&random, random() % 512);
+    ASSERT_EQ(0, compiler.Compile(bytes.data(), bytes.size())) << compiler.LastSource();
+  }
+}
+
+}  // namespace test
+}  // namespace aidl
+}  // namespace android
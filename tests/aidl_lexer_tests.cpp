@@ -0,0 +1,182 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <dirent.h>
+
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+
+#include "aidl_language.h"
+#include "aidl_language_y-module.h"
+#include "aidl_lexer.h"
+
+using std::string;
+using std::vector;
+
+// The flex scanner, see aidl_language_l.ll
+void yylex_init(void**);
+void yylex_destroy(void*);
+YY_BUFFER_STATE yy_scan_buffer(char*, size_t, void*);
+void yy_delete_buffer(YY_BUFFER_STATE, void*);
+int yylex(yy::parser::semantic_type*, yy::parser::location_type*, void*);
+
+namespace android {
+namespace aidl {
+
+namespace {
+
+// What the parser sees of a token
+struct Token {
+  int kind;
+  string text;
+  string comments;
+  int begin_line, begin_column, end_line, end_column;
+
+  bool operator==(const Token& o) const {
+    return kind == o.kind && text == o.text && comments == o.comments &&
+           begin_line == o.begin_line && begin_column == o.begin_column &&
+           end_line == o.end_line && end_column == o.end_column;
+  }
+};
+
+std::ostream& operator<<(std::ostream& out, const Token& t) {
+  return out << t.kind << " '" << t.text << "' /" << t.comments << "/ " << t.begin_line << ":"
+             << t.begin_column << "-" << t.end_line << ":" << t.end_column;
+}
+
+bool HasValue(int kind) {
+  using token = yy::parser::token;
+  switch (kind) {
+    case token::C_STR:
+    case token::ANNOTATION:
+    case token::PARCELABLE:
+    case token::CONST:
+    case token::INTERFACE:
+    case token::ONEWAY:
+    case token::ENUM:
+    case token::IDENTIFIER:
+    case token::INTVALUE:
+    case token::FLOATVALUE:
+    case token::HEXVALUE:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// The tokens of |source|, up to the end of the input, scanned by |lex|
+template <typename Lex>
+vector<Token> Scan(Lex lex) {
+  string filename = "a/IFoo.aidl";
+  yy::parser::location_type loc;
+  loc.initialize(&filename);
+  vector<Token> tokens;
+  while (true) {
+    yy::parser::semantic_type value;
+    const int kind = lex(&value, &loc);
+    if (kind == 0) break;
+    Token t{kind, "", "", loc.begin.line, loc.begin.column, loc.end.line, loc.end.column};
+    if (HasValue(kind)) {
+      std::unique_ptr<AidlToken> token(value.token);
+      t.text = token->GetText();
+      t.comments = token->GetComments().str();
+    } else if (kind == yy::parser::token::CHARVALUE) {
+      t.text = string(1, value.character);
+    }
+    tokens.push_back(t);
+  }
+  return tokens;
+}
+
+vector<Token> ScanWithFlex(const string& source) {
+  // flex scans in place, and demands two nulls after the input
+  string buffer = source + string(2, '\0');
+  void* scanner;
+  yylex_init(&scanner);
+  YY_BUFFER_STATE state = yy_scan_buffer(buffer.data(), buffer.size(), scanner);
+  vector<Token> tokens = Scan([&](yy::parser::semantic_type* value,
+                                  yy::parser::location_type* loc) {
+    return yylex(value, loc, scanner);
+  });
+  yy_delete_buffer(state, scanner);
+  yylex_destroy(scanner);
+  return tokens;
+}
+
+vector<Token> ScanWithAidlLexer(const string& source) {
+  AidlLexer lexer(source.data(), source.size());
+  return Scan([&](yy::parser::semantic_type* value, yy::parser::location_type* loc) {
+    return lexer.Lex(value, loc);
+  });
+}
+
+const char* const kSources[] = {
+    "package a;\nimport b.C;\ninterface IFoo { void f(in int a, out String[] b); }\n",
+    "/** doc\n * of\n */\n@nullable(heap=true) oneway interface IFoo {\n"
+    "  // line\n  const int X = 1 << 3 | 0x1F & ~0 >> 1;\n}\n",
+    "parcelable P { int a = -1; long b = 2L; float c = 1.5e-3f; double d = .5; }",
+    "enum E { A = 'a', B = (1 <= 2) && (3 >= 4) || 5 == 6 != 7, C }",
+    "const String s = \"multi\nline\" ;\n\r\n\t x",
+    "1f 1. 1e 1e+ 1e+5 0x 0|ab 0xG 12abc 3.4.5 ..1 00 007L",
+    "/* unterminated\n comment",
+    "/*/ still a comment */ /**/ /***/ /* ** * / */ o",
+    "@ @1 @_a ' 'a' '\n' 'ab' \"unterminated\nstring",
+    "# $ ` \\ ? \x01 \xc3\xa9 in inout ins cpp_header true false truex",
+    "//",
+    "a//b\n/*c*/d/*e\n\n*/ f\n\n\n g",
+    "",
+};
+
+}  // namespace
+
+TEST(AidlLexerTest, MatchesFlexOnSources) {
+  for (const char* source : kSources) {
+    EXPECT_EQ(ScanWithFlex(source), ScanWithAidlLexer(source)) << source;
+  }
+}
+
+TEST(AidlLexerTest, MatchesFlexOnTheFuzzerCorpus) {
+  const string dir = android::base::GetExecutableDirectory() + "/tests/corpus";
+  std::unique_ptr<DIR, decltype(&closedir)> entries(opendir(dir.c_str()), closedir);
+  ASSERT_NE(nullptr, entries) << dir;
+  int files = 0;
+  while (struct dirent* entry = readdir(entries.get())) {
+    string source;
+    const string path = dir + "/" + entry->d_name;
+    if (entry->d_name[0] == '.' || !android::base::ReadFileToString(path, &source)) continue;
+    files++;
+    EXPECT_EQ(ScanWithFlex(source), ScanWithAidlLexer(source)) << path;
+  }
+  EXPECT_GT(files, 0);
+}
+
+TEST(AidlLexerTest, ReturnsTheTokensOfASource) {
+  using token = yy::parser::token;
+  const vector<Token> tokens = ScanWithAidlLexer("/* c */ @utf8InCpp\n  String  s;");
+  ASSERT_EQ(4u, tokens.size());
+  EXPECT_EQ((Token{token::ANNOTATION, "utf8InCpp", "/* c */", 1, 8, 1, 19}), tokens[0]);
+  EXPECT_EQ((Token{token::IDENTIFIER, "String", "", 2, 1, 2, 9}), tokens[1]);
+  EXPECT_EQ((Token{token::IDENTIFIER, "s", "", 2, 9, 2, 12}), tokens[2]);
+  EXPECT_EQ((Token{';', "", "", 2, 12, 2, 13}), tokens[3]);
+}
+
+}  // namespace aidl
+}  // namespace android
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Fuzzes the backends rather than the lexer: the bytes choose the declarations
+// of a source that always parses, see GenerateFuzzAidl(), and the source is
+// compiled for cpp, ndk and java at once. Unlike aidl_parser_fuzzer, the
+// imports stay parsed across the inputs, so most of an execution is spent in
+// the checks and the code generators.
+//
+// Every 10000 executions, the rate is printed to stderr. An input that takes
+// longer than AIDL_FUZZ_SLOW_MS milliseconds (500 by default) to compile
+// aborts, so that a performance cliff is reported with its input like a crash.
+
+#include <stdlib.h>
+
+#include <chrono>
+#include <iostream>
+
+#include "tests/aidl_fuzz_generator.h"
+
+using android::aidl::test::FuzzCompiler;
+using std::chrono::duration;
+using std::chrono::steady_clock;
+
+namespace {
+
+constexpr size_t kReportInterval = 10000;
+
+double SlowThresholdMs() {
+  const char* value = getenv("AIDL_FUZZ_SLOW_MS");
+  return value != nullptr ? atof(value) : 500;
+}
+
+}  // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  static FuzzCompiler compiler;
+  static const double slow_ms = SlowThresholdMs();
+  static const steady_clock::time_point started = steady_clock::now();
+  static size_t executions = 0;
+
+  const steady_clock::time_point begin = steady_clock::now();
+  compiler.Compile(data, size);
+  const steady_clock::time_point end = steady_clock::now();
+
+  const double elapsed_ms = duration<double, std::milli>(end - begin).count();
+  if (slow_ms > 0 && elapsed_ms > slow_ms) {
+    std::cerr << "Compiling the input took " << elapsed_ms << "ms, more than " << slow_ms
+              << "ms:\n"
+              << compiler.LastSource();
+    abort();
+  }
+  if (++executions % kReportInterval == 0) {
+    const double seconds = duration<double>(end - started).count();
+    std::cerr << "aidl_structured_fuzzer: " << executions << " execs, "
+              << static_cast<size_t>(executions / seconds) << " execs/s\n";
+  }
+  return 0;
+}
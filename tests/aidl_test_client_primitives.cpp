@@ -52,6 +52,14 @@ namespace aidl {
 namespace tests {
 namespace client {
 
+// The names of the enumerators are known at compile time, both ways
+static_assert(toStringView(ByteEnum::BAZ) == "BAZ");
+static_assert(toStringView(static_cast<ByteEnum>(-1)).empty());
+static_assert([] {
+  ByteEnum value = ByteEnum::FOO;
+  return fromString("BAR", &value) && value == ByteEnum::BAR && !fromString("QUX", &value);
+}());
+
 bool ConfirmPrimitiveRepeat(const sp<ITestService>& s) {
   cout << "Confirming passing and returning primitives works." << endl;
 
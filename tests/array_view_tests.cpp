@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstdint>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "aidl/array_view.h"
+
+namespace android {
+namespace aidl {
+
+static int32_t Sum(ArrayView<int32_t> view) {
+  int32_t sum = 0;
+  for (int32_t value : view) sum += value;
+  return sum;
+}
+
+TEST(ArrayViewTest, ViewsVectorsArraysAndPointers) {
+  const std::vector<int32_t> vector = {1, 2, 3};
+  const int32_t array[] = {4, 5};
+  EXPECT_EQ(6, Sum(vector));
+  EXPECT_EQ(9, Sum(array));
+  EXPECT_EQ(2, Sum(ArrayView<int32_t>(vector.data() + 1, 1)));
+  EXPECT_EQ(0, Sum({}));
+
+  const ArrayView<int32_t> view(vector);
+  EXPECT_EQ(vector.data(), view.data());
+  EXPECT_EQ(3u, view.size());
+  EXPECT_FALSE(view.empty());
+  EXPECT_EQ(2, view[1]);
+  EXPECT_EQ(vector, view.ToVector());
+}
+
+}  // namespace aidl
+}  // namespace android
@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <future>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "aidl/async_executor.h"
+
+namespace android {
+namespace aidl {
+
+namespace {
+
+struct Status {
+  bool ok = true;
+};
+
+}  // namespace
+
+TEST(AsyncExecutorTest, ReturnsTheResultsOfTheCalls) {
+  AsyncExecutor executor;
+  auto name = std::make_unique<std::string>("name");
+  std::future<AsyncResult<Status, std::string>> result =
+      executor.Submit([name = std::move(name)]() mutable {
+        AsyncResult<Status, std::string> result;
+        result.value = *name + "!";
+        return result;
+      });
+  AsyncResult<Status, std::string> r = result.get();
+  EXPECT_TRUE(r.status.ok);
+  EXPECT_EQ("name!", r.value);
+}
+
+TEST(AsyncExecutorTest, RunsTheCallsOnABoundedNumberOfThreads) {
+  AsyncExecutor executor(2);
+  std::promise<void> release;
+  std::shared_future<void> released = release.get_future().share();
+  std::vector<std::future<int>> results;
+  for (int i = 0; i < 8; i++) {
+    results.push_back(executor.Submit([released, i]() {
+      released.wait();
+      return i;
+    }));
+  }
+  EXPECT_EQ(2u, executor.GetThreadCount());
+  release.set_value();
+  for (int i = 0; i < 8; i++) {
+    EXPECT_EQ(i, results[i].get());
+  }
+  EXPECT_EQ(2u, executor.GetThreadCount());
+}
+
+TEST(AsyncExecutorTest, CountsTheTimeThatTheCallsWaitAndRun) {
+  AsyncExecutor executor(1);
+  executor.Submit([]() {}).wait();
+  executor.Submit([]() {}).wait();
+
+  transaction_stats::Table stats = executor.GetStats();
+  ASSERT_EQ(2u, stats.size());
+  EXPECT_STREQ("wait", stats.begin()[0].method_name);
+  EXPECT_STREQ("run", stats.begin()[1].method_name);
+  EXPECT_EQ(2u, stats.begin()[0].calls.load());
+  // The single thread records the run of a call before it starts the next one
+  EXPECT_GE(stats.begin()[1].calls.load(), 1u);
+}
+
+TEST(AsyncExecutorTest, RunsTheSubmittedCallsBeforeItIsDestroyed) {
+  int runs = 0;
+  {
+    AsyncExecutor executor(1);
+    for (int i = 0; i < 4; i++) {
+      executor.Post([&runs]() { runs++; });
+    }
+  }
+  EXPECT_EQ(4, runs);
+}
+
+}  // namespace aidl
+}  // namespace android
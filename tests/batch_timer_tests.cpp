@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <chrono>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "aidl/batch_timer.h"
+
+namespace android {
+namespace aidl {
+
+using std::chrono::milliseconds;
+
+TEST(BatchTimerTest, RunsTheFlushesInTheOrderOfTheirDeadlines) {
+  BatchTimer timer;
+  const BatchTimer::Clock::time_point now = BatchTimer::Clock::now();
+  std::mutex mutex;
+  std::vector<int> order;
+  std::promise<void> done;
+  timer.Schedule(now + milliseconds(20), [&]() {
+    std::lock_guard<std::mutex> lock(mutex);
+    order.push_back(2);
+    done.set_value();
+  });
+  timer.Schedule(now + milliseconds(5), [&]() {
+    std::lock_guard<std::mutex> lock(mutex);
+    order.push_back(1);
+  });
+  done.get_future().wait();
+  std::lock_guard<std::mutex> lock(mutex);
+  EXPECT_EQ((std::vector<int>{1, 2}), order);
+  EXPECT_EQ(0u, timer.Pending());
+}
+
+TEST(BatchTimerTest, WaitsForTheDeadline) {
+  BatchTimer timer;
+  const BatchTimer::Clock::time_point deadline = BatchTimer::Clock::now() + milliseconds(10);
+  std::promise<BatchTimer::Clock::time_point> ran;
+  timer.Schedule(deadline, [&]() { ran.set_value(BatchTimer::Clock::now()); });
+  EXPECT_GE(ran.get_future().get(), deadline);
+}
+
+// What the proxies rely on: a flush may take a lock that is held while
+// another flush is scheduled.
+TEST(BatchTimerTest, RunsTheFlushesWithoutItsLock) {
+  BatchTimer timer;
+  std::mutex proxy_lock;
+  std::promise<void> done;
+  {
+    std::lock_guard<std::mutex> lock(proxy_lock);
+    timer.Schedule(BatchTimer::Clock::now(), [&]() {
+      std::lock_guard<std::mutex> lock(proxy_lock);
+      timer.Schedule(BatchTimer::Clock::now(), [&]() { done.set_value(); });
+    });
+  }
+  done.get_future().wait();
+}
+
+TEST(BatchTimerTest, ReleasesTheReferencesOfTheFlushesThatDidNotRun) {
+  auto proxy = std::make_shared<int>(0);
+  {
+    BatchTimer timer;
+    timer.Schedule(BatchTimer::Clock::now() + std::chrono::hours(1), [proxy]() { (*proxy)++; });
+    EXPECT_EQ(1u, timer.Pending());
+    EXPECT_EQ(2, proxy.use_count());
+  }
+  EXPECT_EQ(1, proxy.use_count());
+  EXPECT_EQ(0, *proxy);
+}
+
+}  // namespace aidl
+}  // namespace android
@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "aidl/binary_log.h"
+#include "aidl/binary_log_decoder.h"
+#include "aidl_profile.h"
+
+using std::string;
+using std::vector;
+
+namespace android {
+namespace aidl {
+namespace binary_log {
+
+namespace {
+
+Transaction MakeTransaction(uint32_t method_id) {
+  static const int object = 0;
+  return Transaction{"foo.bar.IFoo", "TestMethod", &object, method_id, Side::STUB, 1000, 43000,
+                     -8, 0, -42, 84, 12};
+}
+
+}  // namespace
+
+TEST(BinaryLogTest, DecodesTheJsonOfDumpedTransactions) {
+  auto buffer = std::make_unique<RingBuffer>();
+  buffer->Append(MakeTransaction(3));
+  vector<Record> records;
+  ASSERT_TRUE(Decode(Encode(buffer->Snapshot()), &records));
+  ASSERT_EQ(1u, records.size());
+  const string json = ToJson(records[0]);
+  EXPECT_EQ(0u, json.find("{\"duration_ms\": 0.042000, \"interface_name\": \"foo.bar.IFoo\", "
+                          "\"method_name\": \"TestMethod\", \"method_id\": 3, "
+                          "\"stub_address\": \"0x"))
+      << json;
+  EXPECT_NE(string::npos, json.find("\"input_size\": 84, \"output_size\": 12, "
+                                    "\"binder_status\": {\"exception_code\": -8, "
+                                    "\"transaction_error\": 0, "
+                                    "\"service_specific_error_code\": -42}}"))
+      << json;
+
+  const string dump = Encode(buffer->Snapshot());
+  EXPECT_FALSE(Decode(dump.substr(0, dump.size() - 1), &records));
+  EXPECT_FALSE(Decode("not a dump", &records));
+}
+
+TEST(BinaryLogTest, KeepsTheLatestTransactions) {
+  auto buffer = std::make_unique<RingBuffer>();
+  EXPECT_TRUE(buffer->Snapshot().empty());
+  for (uint32_t id = 0; id < RingBuffer::kCapacity + 10; id++) {
+    buffer->Append(MakeTransaction(id));
+  }
+  const vector<Transaction> transactions = buffer->Snapshot();
+  ASSERT_EQ(RingBuffer::kCapacity, transactions.size());
+  EXPECT_EQ(10u, transactions.front().method_id);
+  EXPECT_EQ(RingBuffer::kCapacity + 9, transactions.back().method_id);
+}
+
+TEST(BinaryLogTest, AppendsWithoutAllocating) {
+  auto buffer = std::make_unique<RingBuffer>();
+  const Transaction transaction = MakeTransaction(1);
+  const uint64_t bytes = ThreadAllocatedBytes();
+  buffer->Append(transaction);
+  EXPECT_EQ(bytes, ThreadAllocatedBytes());
+}
+
+TEST(BinaryLogTest, AppendsFromSeveralThreads) {
+  auto buffer = std::make_unique<RingBuffer>();
+  constexpr uint32_t kThreads = 4;
+  constexpr uint32_t kPerThread = 1000;
+  vector<std::thread> threads;
+  for (uint32_t i = 0; i < kThreads; i++) {
+    threads.emplace_back([&buffer, i] {
+      for (uint32_t j = 0; j < kPerThread; j++) {
+        buffer->Append(MakeTransaction(i * kPerThread + j));
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  vector<bool> seen(kThreads * kPerThread);
+  for (const Transaction& t : buffer->Snapshot()) {
+    ASSERT_LT(t.method_id, seen.size());
+    EXPECT_FALSE(seen[t.method_id]);
+    seen[t.method_id] = true;
+    EXPECT_STREQ("TestMethod", t.method_name);
+  }
+  EXPECT_EQ(std::vector<bool>(kThreads * kPerThread, true), seen);
+}
+
+TEST(BinaryLogTest, IsDisabledByDefault) {
+  EXPECT_FALSE(Enabled());
+  SetEnabled(true);
+  EXPECT_TRUE(Enabled());
+  SetEnabled(false);
+}
+
+}  // namespace binary_log
+}  // namespace aidl
+}  // namespace android
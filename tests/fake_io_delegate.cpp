@@ -36,6 +36,7 @@ namespace test {
 // Claims to always write successfully, but can't close the file.
 class BrokenCodeWriter : public CodeWriter {
   bool Write(const char* /* format */, ...) override {  return true; }
+  bool WriteBytes(const std::string& /* bytes */) override { return true; }
   bool Close() override { return false; }
   ~BrokenCodeWriter() override = default;
 };  // class BrokenCodeWriter
@@ -56,6 +57,10 @@ unique_ptr<string> FakeIoDelegate::GetFileContents(
   return contents;
 }
 
+unique_ptr<FileBuffer> FakeIoDelegate::GetFileBuffer(const string& filename) const {
+  return FileBuffer::FromString(GetFileContents(filename));
+}
+
 unique_ptr<LineReader> FakeIoDelegate::GetLineReader(
     const string& file_path) const {
   unique_ptr<LineReader> ret;
@@ -70,36 +75,87 @@ bool FakeIoDelegate::FileIsReadable(const string& path) const {
   return file_contents_.find(CleanPath(path)) != file_contents_.end();
 }
 
+std::optional<FileStamp> FakeIoDelegate::GetFileStamp(const string& path) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (removed_files_.count(path) > 0) {
+    return std::nullopt;
+  }
+  auto written = written_file_contents_.find(path);
+  if (written != written_file_contents_.end()) {
+    return FileStamp{static_cast<int64_t>(written->second.size()), mtimes_[path]};
+  }
+  auto file = file_contents_.find(CleanPath(path));
+  if (file != file_contents_.end()) {
+    return FileStamp{static_cast<int64_t>(file->second.size()), mtimes_[file->first]};
+  }
+  return std::nullopt;
+}
+
 std::unique_ptr<CodeWriter> FakeIoDelegate::GetCodeWriter(
     const std::string& file_path) const {
   if (broken_files_.count(file_path) > 0) {
     return unique_ptr<CodeWriter>(new BrokenCodeWriter);
   }
+  std::lock_guard<std::mutex> lock(mutex_);
   removed_files_.erase(file_path);
+  mtimes_[file_path] = writes_++;
   written_file_contents_[file_path] = "";
-  return CodeWriter::ForString(&written_file_contents_[file_path]);
+  CodeWriterPtr writer = CodeWriter::ForString(&written_file_contents_[file_path]);
+  writer->CountAsOutput();
+  return writer;
 }
 
 void FakeIoDelegate::RemovePath(const std::string& file_path) const {
+  std::lock_guard<std::mutex> lock(mutex_);
   removed_files_.insert(file_path);
 }
 
+bool FakeIoDelegate::LinkOrCopyFile(const string& from, const string& to) const {
+  unique_ptr<string> contents = GetFileContents(from);
+  if (contents == nullptr) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  removed_files_.erase(to);
+  mtimes_[to] = writes_++;
+  written_file_contents_[to] = *contents;
+  return true;
+}
+
 void FakeIoDelegate::SetFileContents(const string& filename,
                                      const string& contents) {
   file_contents_[filename] = contents;
+  std::lock_guard<std::mutex> lock(mutex_);
+  mtimes_[filename] = writes_++;
 }
 
 vector<string> FakeIoDelegate::ListFiles(const string& dir) const {
   const string dir_name = dir.back() == OS_PATH_SEPARATOR ? dir : dir + OS_PATH_SEPARATOR;
+  // Files are stored with clean paths, but listed under |dir| as it is given.
+  const string clean_dir_name = CleanPath(dir_name);
   vector<string> files;
   for (auto it = file_contents_.begin(); it != file_contents_.end(); it++) {
-    if (android::base::StartsWith(it->first, dir_name) && !it->second.empty()) {
-      files.emplace_back(it->first);
+    if (android::base::StartsWith(it->first, clean_dir_name) && !it->second.empty()) {
+      files.emplace_back(dir_name + it->first.substr(clean_dir_name.size()));
     }
   }
   return files;
 }
 
+vector<string> FakeIoDelegate::ListDirectory(const string& dir) const {
+  const string dir_name =
+      CleanPath(dir.back() == OS_PATH_SEPARATOR ? dir : dir + OS_PATH_SEPARATOR);
+  vector<string> names;
+  for (auto it = file_contents_.lower_bound(dir_name);
+       it != file_contents_.end() && android::base::StartsWith(it->first, dir_name); it++) {
+    const string name = it->first.substr(dir_name.size());
+    if (name.find(OS_PATH_SEPARATOR) == string::npos) {
+      names.push_back(name);
+    }
+  }
+  return names;
+}
+
 void FakeIoDelegate::AddStubParcelable(const string& canonical_name,
                                        const string& cpp_header) {
   string package, class_name, rel_path;
@@ -21,6 +21,7 @@
 
 #include <map>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <string>
 #include <vector>
@@ -40,13 +41,19 @@ class FakeIoDelegate : public IoDelegate {
   std::unique_ptr<std::string> GetFileContents(
       const std::string& filename,
       const std::string& append_content_suffix = "") const override;
+  std::unique_ptr<FileBuffer> GetFileBuffer(const std::string& filename) const override;
   std::unique_ptr<LineReader> GetLineReader(
       const std::string& file_path) const override;
   bool FileIsReadable(const std::string& path) const override;
+  // The modification time of a file is the number of writes before its last
+  // one, written files included.
+  std::optional<FileStamp> GetFileStamp(const std::string& path) const override;
   std::unique_ptr<CodeWriter> GetCodeWriter(
       const std::string& file_path) const override;
   void RemovePath(const std::string& file_path) const override;
+  bool LinkOrCopyFile(const std::string& from, const std::string& to) const override;
   std::vector<std::string> ListFiles(const std::string& dir) const override;
+  std::vector<std::string> ListDirectory(const std::string& dir) const override;
 
   // Methods added to facilitate testing.
   void SetFileContents(const std::string& filename,
@@ -78,6 +85,11 @@ class FakeIoDelegate : public IoDelegate {
   // files in this list, we simulate I/O errors.
   std::set<std::string> broken_files_;
   mutable std::set<std::string> removed_files_;
+  mutable std::map<std::string, int64_t> mtimes_;
+  mutable int64_t writes_ = 0;
+
+  // Guards the written and removed files, which parallel compile jobs update.
+  mutable std::mutex mutex_;
 
   DISALLOW_COPY_AND_ASSIGN(FakeIoDelegate);
 };  // class FakeIoDelegate
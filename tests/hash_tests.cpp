@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <array>
+#include <cstdint>
+#include <memory_resource>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "aidl/hash.h"
+
+namespace android {
+namespace aidl {
+
+namespace {
+
+// The characters of an ::android::String16
+class FakeString16 {
+ public:
+  explicit FakeString16(std::u16string value) : value_(std::move(value)) {}
+  const char16_t* string() const { return value_.data(); }
+  size_t size() const { return value_.size(); }
+
+ private:
+  std::u16string value_;
+};
+
+enum class Color : int8_t { RED, GREEN };
+
+}  // namespace
+
+TEST(HashTest, RecognizesString16s) {
+  EXPECT_TRUE(kIsString16<FakeString16>);
+  EXPECT_FALSE(kIsString16<std::u16string>);
+  EXPECT_FALSE(kIsString16<int32_t>);
+}
+
+TEST(HashTest, HashesStringsByTheirCharacters) {
+  EXPECT_EQ(HashOf(std::string("abc")), HashOf(std::pmr::string("abc")));
+  EXPECT_EQ(HashOf(std::u16string(u"abc")), HashOf(FakeString16(u"abc")));
+  EXPECT_NE(HashOf(std::string("abc")), HashOf(std::string("abd")));
+}
+
+TEST(HashTest, HashesArraysByTheirElementsInOrder) {
+  EXPECT_EQ(HashOf(std::vector<int32_t>{1, 2}), HashOf(std::vector<int32_t>{1, 2}));
+  EXPECT_EQ(HashOf(std::vector<int32_t>{1, 2}), HashOf(std::pmr::vector<int32_t>{1, 2}));
+  EXPECT_NE(HashOf(std::vector<int32_t>{1, 2}), HashOf(std::vector<int32_t>{2, 1}));
+  EXPECT_NE(HashOf(std::vector<int32_t>{}), HashOf(std::vector<int32_t>{0}));
+  EXPECT_NE(HashOf(std::vector<Color>{Color::RED}), HashOf(std::vector<Color>{Color::GREEN}));
+  EXPECT_NE(HashOf(std::vector<bool>{true}), HashOf(std::vector<bool>{false}));
+  EXPECT_EQ(HashOf(std::vector<std::string>{"a", "b"}),
+            HashOf(std::vector<std::string>{"a", "b"}));
+}
+
+TEST(HashTest, HashesFixedSizeArraysAsArrays) {
+  EXPECT_EQ(HashOf(std::vector<int32_t>{1, 2}), HashOf(std::array<int32_t, 2>{1, 2}));
+  EXPECT_NE(HashOf(std::array<int32_t, 2>{1, 2}), HashOf(std::array<int32_t, 2>{2, 1}));
+  EXPECT_NE(HashOf(std::array<bool, 1>{true}), HashOf(std::array<bool, 1>{false}));
+}
+
+}  // namespace aidl
+}  // namespace android
@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Times the calls from a client of the C++ backend to each server that is
+// running. The results are machine-readable with --benchmark_format=json.
+
+#include <iostream>
+#include <string>
+
+#include <benchmark/benchmark.h>
+#include <binder/IServiceManager.h>
+#include <binder/ProcessState.h>
+#include <utils/String16.h>
+
+#include "android/aidl/benchmark/IIpcBenchmark.h"
+#include "android/aidl/benchmark/Payload.h"
+#include "ipc_benchmark_client.h"
+
+using android::IBinder;
+using android::interface_cast;
+using android::ProcessState;
+using android::sp;
+using android::String16;
+using android::aidl::benchmark::IIpcBenchmark;
+using android::aidl::ipc_benchmark::RegisterBenchmarks;
+
+namespace {
+
+struct CppBackend {
+  using Server = sp<IIpcBenchmark>;
+  using String = String16;
+  using Payload = android::aidl::benchmark::Payload;
+
+  static String MakeString(const std::string& s) { return String16(s.c_str()); }
+
+  static Server GetServer(const std::string& name) {
+    sp<IBinder> binder = android::defaultServiceManager()->checkService(String16(name.c_str()));
+    return binder == nullptr ? nullptr : interface_cast<IIpcBenchmark>(binder);
+  }
+};
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  ::benchmark::Initialize(&argc, argv);
+  ProcessState::self()->startThreadPool();
+  if (RegisterBenchmarks<CppBackend>("cpp") == 0) {
+    std::cerr << "No aidl_ipc_benchmark_service_* is running." << std::endl;
+    return 1;
+  }
+  ::benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
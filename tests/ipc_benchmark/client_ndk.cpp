@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Times the calls from a client of the NDK backend to each server that is
+// running. The results are machine-readable with --benchmark_format=json.
+
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include <android/binder_manager.h>
+#include <android/binder_process.h>
+#include <benchmark/benchmark.h>
+
+#include "aidl/android/aidl/benchmark/IIpcBenchmark.h"
+#include "aidl/android/aidl/benchmark/Payload.h"
+#include "ipc_benchmark_client.h"
+
+using aidl::android::aidl::benchmark::IIpcBenchmark;
+using android::aidl::ipc_benchmark::RegisterBenchmarks;
+
+namespace {
+
+struct NdkBackend {
+  using Server = std::shared_ptr<IIpcBenchmark>;
+  using String = std::string;
+  using Payload = aidl::android::aidl::benchmark::Payload;
+
+  static String MakeString(const std::string& s) { return s; }
+
+  static Server GetServer(const std::string& name) {
+    ndk::SpAIBinder binder(AServiceManager_checkService(name.c_str()));
+    return binder.get() == nullptr ? nullptr : IIpcBenchmark::fromBinder(binder);
+  }
+};
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  ::benchmark::Initialize(&argc, argv);
+  ABinderProcess_startThreadPool();
+  if (RegisterBenchmarks<NdkBackend>("ndk") == 0) {
+    std::cerr << "No aidl_ipc_benchmark_service_* is running." << std::endl;
+    return 1;
+  }
+  ::benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
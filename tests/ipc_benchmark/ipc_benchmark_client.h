@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+// The benchmarks that the clients of each backend run against the servers of
+// each backend. A client backend provides the traits of its generated code:
+//
+//   struct Backend {
+//     using Server = ...;   // the pointer to an IIpcBenchmark
+//     using String = ...;   // the type of an AIDL String
+//     using Payload = ...;  // the type of the Payload parcelable
+//     static String MakeString(const std::string& s);
+//     // The server registered under |name|, or null if none is running
+//     static Server GetServer(const std::string& name);
+//   };
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "ipc_benchmark_server.h"
+
+namespace android {
+namespace aidl {
+namespace ipc_benchmark {
+
+constexpr const char* kServerBackends[] = {"cpp", "ndk", "java"};
+
+// Skips the rest of the benchmark if |status| is an error
+template <typename Status>
+bool CallOk(::benchmark::State& state, const Status& status) {
+  if (status.isOk()) return true;
+  state.SkipWithError("The call to the server failed");
+  return false;
+}
+
+template <typename Backend>
+void BM_Noop(::benchmark::State& state, typename Backend::Server server) {
+  for (auto _ : state) {
+    if (!CallOk(state, server->noop())) break;
+  }
+}
+
+template <typename Backend>
+void BM_AddInts(::benchmark::State& state, typename Backend::Server server) {
+  int32_t sum = 0;
+  for (auto _ : state) {
+    if (!CallOk(state, server->addInts(sum, 1, &sum))) break;
+  }
+  ::benchmark::DoNotOptimize(sum);
+}
+
+// range(0): the size of the array in bytes
+template <typename Backend>
+void BM_EchoBytes(::benchmark::State& state, typename Backend::Server server) {
+  const std::vector<uint8_t> data(state.range(0), 0xa5);
+  std::vector<uint8_t> echo;
+  for (auto _ : state) {
+    if (!CallOk(state, server->echoBytes(data, &echo))) break;
+  }
+  state.SetBytesProcessed(2 * state.iterations() * data.size());
+}
+
+// range(0): the number of strings, of 16 characters each
+template <typename Backend>
+void BM_EchoStrings(::benchmark::State& state, typename Backend::Server server) {
+  const std::vector<typename Backend::String> data(state.range(0),
+                                                   Backend::MakeString("0123456789abcdef"));
+  std::vector<typename Backend::String> echo;
+  for (auto _ : state) {
+    if (!CallOk(state, server->echoStrings(data, &echo))) break;
+  }
+  state.SetItemsProcessed(2 * state.iterations() * data.size());
+}
+
+// range(0): the number of parcelables, with 64 bytes of data each
+template <typename Backend>
+void BM_EchoPayloads(::benchmark::State& state, typename Backend::Server server) {
+  std::vector<typename Backend::Payload> data(state.range(0));
+  for (size_t i = 0; i < data.size(); i++) {
+    data[i].id = i;
+    data[i].timestamp = i;
+    data[i].name = Backend::MakeString("payload");
+    data[i].data.assign(64, static_cast<uint8_t>(i));
+  }
+  std::vector<typename Backend::Payload> echo;
+  for (auto _ : state) {
+    if (!CallOk(state, server->echoPayloads(data, &echo))) break;
+  }
+  state.SetItemsProcessed(2 * state.iterations() * data.size());
+}
+
+// range(0): the number of ints of the inout array
+template <typename Backend>
+void BM_ReverseInts(::benchmark::State& state, typename Backend::Server server) {
+  std::vector<int32_t> data(state.range(0));
+  for (size_t i = 0; i < data.size(); i++) {
+    data[i] = i;
+  }
+  for (auto _ : state) {
+    if (!CallOk(state, server->reverseInts(&data))) break;
+  }
+  state.SetBytesProcessed(2 * state.iterations() * data.size() * sizeof(int32_t));
+}
+
+// range(0): the number of oneway calls, with 64 bytes each, that are sent
+// before waiting for the server to receive them all
+template <typename Backend>
+void BM_OnewayFlood(::benchmark::State& state, typename Backend::Server server) {
+  const std::vector<uint8_t> data(64, 0xa5);
+  const int32_t calls = state.range(0);
+  for (auto _ : state) {
+    bool ok = true;
+    for (int32_t i = 0; i < calls && ok; i++) {
+      ok = CallOk(state, server->countOneway(data));
+    }
+    if (!ok || !CallOk(state, server->awaitOneway(calls))) break;
+  }
+  state.SetItemsProcessed(state.iterations() * calls);
+}
+
+// Registers the benchmarks against each server that is running, named after
+// the backends of |client| and of the server, e.g. BM_EchoBytes/cpp_to_java/4096.
+// Returns the number of servers found.
+template <typename Backend>
+int RegisterBenchmarks(const std::string& client) {
+  int servers = 0;
+  for (const char* backend : kServerBackends) {
+    typename Backend::Server server = Backend::GetServer(std::string(kServiceName) + backend);
+    if (server == nullptr) continue;
+    servers++;
+    const std::string suffix = "/" + client + "_to_" + backend;
+    auto add = [&](const std::string& name, void (*fn)(::benchmark::State&,
+                                                        typename Backend::Server)) {
+      return ::benchmark::RegisterBenchmark((name + suffix).c_str(), fn, server);
+    };
+    add("BM_Noop", BM_Noop<Backend>);
+    add("BM_AddInts", BM_AddInts<Backend>);
+    add("BM_EchoBytes", BM_EchoBytes<Backend>)->RangeMultiplier(8)->Range(16, 256 << 10);
+    add("BM_EchoStrings", BM_EchoStrings<Backend>)->RangeMultiplier(8)->Range(1, 4096);
+    add("BM_EchoPayloads", BM_EchoPayloads<Backend>)->RangeMultiplier(8)->Range(1, 4096);
+    add("BM_ReverseInts", BM_ReverseInts<Backend>)->RangeMultiplier(8)->Range(16, 64 << 10);
+    add("BM_OnewayFlood", BM_OnewayFlood<Backend>)->RangeMultiplier(4)->Range(1, 256);
+  }
+  return servers;
+}
+
+}  // namespace ipc_benchmark
+}  // namespace aidl
+}  // namespace android
@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <condition_variable>
+#include <mutex>
+
+namespace android {
+namespace aidl {
+namespace ipc_benchmark {
+
+// The name that a server registers itself under, followed by its backend
+constexpr char kServiceName[] = "android.aidl.benchmark.IIpcBenchmark/";
+
+// The oneway calls that a server has received, for awaitOneway()
+class OnewayCounter {
+ public:
+  void Add() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    count_++;
+    arrived_.notify_all();
+  }
+
+  // Waits for |count| calls, then drops them from the count
+  void Await(int32_t count) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    arrived_.wait(lock, [&]() { return count_ >= count; });
+    count_ -= count;
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable arrived_;
+  int32_t count_ = 0;
+};
+
+}  // namespace ipc_benchmark
+}  // namespace aidl
+}  // namespace android
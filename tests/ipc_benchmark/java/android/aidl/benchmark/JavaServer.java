@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package android.aidl.benchmark;
+
+import android.os.Looper;
+import android.os.ServiceManager;
+
+/**
+ * The server of the Java backend. Run it with
+ *
+ *   CLASSPATH=/system/framework/aidl_ipc_benchmark_service_java.jar \
+ *       app_process /system/bin android.aidl.benchmark.JavaServer
+ */
+public class JavaServer extends IIpcBenchmark.Stub {
+    private static final String SERVICE_NAME = "android.aidl.benchmark.IIpcBenchmark/java";
+
+    private final Object mLock = new Object();
+    private int mOnewayCount = 0;
+
+    @Override
+    public void noop() {}
+
+    @Override
+    public int addInts(int a, int b) {
+        return a + b;
+    }
+
+    @Override
+    public byte[] echoBytes(byte[] data) {
+        return data;
+    }
+
+    @Override
+    public String[] echoStrings(String[] data) {
+        return data;
+    }
+
+    @Override
+    public Payload[] echoPayloads(Payload[] data) {
+        return data;
+    }
+
+    @Override
+    public void reverseInts(int[] data) {
+        for (int i = 0, j = data.length - 1; i < j; i++, j--) {
+            int t = data[i];
+            data[i] = data[j];
+            data[j] = t;
+        }
+    }
+
+    @Override
+    public void countOneway(byte[] data) {
+        synchronized (mLock) {
+            mOnewayCount++;
+            mLock.notifyAll();
+        }
+    }
+
+    @Override
+    public void awaitOneway(int count) {
+        synchronized (mLock) {
+            while (mOnewayCount < count) {
+                try {
+                    mLock.wait();
+                } catch (InterruptedException e) {
+                    Thread.currentThread().interrupt();
+                    return;
+                }
+            }
+            mOnewayCount -= count;
+        }
+    }
+
+    public static void main(String[] args) {
+        Looper.prepareMainLooper();
+        ServiceManager.addService(SERVICE_NAME, new JavaServer());
+        // app_process has started the binder threads that serve the calls.
+        Looper.loop();
+    }
+}
@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <binder/IPCThreadState.h>
+#include <binder/IServiceManager.h>
+#include <binder/ProcessState.h>
+#include <utils/Log.h>
+#include <utils/String16.h>
+
+#include "android/aidl/benchmark/BnIpcBenchmark.h"
+#include "ipc_benchmark_server.h"
+
+using android::IPCThreadState;
+using android::OK;
+using android::ProcessState;
+using android::sp;
+using android::String16;
+using android::aidl::benchmark::BnIpcBenchmark;
+using android::aidl::benchmark::Payload;
+using android::aidl::ipc_benchmark::kServiceName;
+using android::aidl::ipc_benchmark::OnewayCounter;
+using android::binder::Status;
+using std::vector;
+
+namespace {
+
+class IpcBenchmark : public BnIpcBenchmark {
+ public:
+  Status noop() override { return Status::ok(); }
+
+  Status addInts(int32_t a, int32_t b, int32_t* _aidl_return) override {
+    *_aidl_return = a + b;
+    return Status::ok();
+  }
+
+  Status echoBytes(const vector<uint8_t>& data, vector<uint8_t>* _aidl_return) override {
+    *_aidl_return = data;
+    return Status::ok();
+  }
+
+  Status echoStrings(const vector<String16>& data, vector<String16>* _aidl_return) override {
+    *_aidl_return = data;
+    return Status::ok();
+  }
+
+  Status echoPayloads(const vector<Payload>& data, vector<Payload>* _aidl_return) override {
+    *_aidl_return = data;
+    return Status::ok();
+  }
+
+  Status reverseInts(vector<int32_t>* data) override {
+    std::reverse(data->begin(), data->end());
+    return Status::ok();
+  }
+
+  Status countOneway(const vector<uint8_t>& /* data */) override {
+    oneway_calls_.Add();
+    return Status::ok();
+  }
+
+  Status awaitOneway(int32_t count) override {
+    oneway_calls_.Await(count);
+    return Status::ok();
+  }
+
+ private:
+  OnewayCounter oneway_calls_;
+};
+
+}  // namespace
+
+int main(int /* argc */, char* /* argv */[]) {
+  sp<IpcBenchmark> service = new IpcBenchmark();
+  const String16 name((std::string(kServiceName) + "cpp").c_str());
+  LOG_ALWAYS_FATAL_IF(OK != android::defaultServiceManager()->addService(name, service),
+                      "Can't register the benchmark service");
+  ProcessState::self()->startThreadPool();
+  IPCThreadState::self()->joinThreadPool();
+  return 1;
+}
@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <android/binder_manager.h>
+#include <android/binder_process.h>
+#include <utils/Log.h>
+
+#include "aidl/android/aidl/benchmark/BnIpcBenchmark.h"
+#include "ipc_benchmark_server.h"
+
+using aidl::android::aidl::benchmark::BnIpcBenchmark;
+using aidl::android::aidl::benchmark::Payload;
+using android::aidl::ipc_benchmark::kServiceName;
+using android::aidl::ipc_benchmark::OnewayCounter;
+using ndk::ScopedAStatus;
+using std::string;
+using std::vector;
+
+namespace {
+
+class IpcBenchmark : public BnIpcBenchmark {
+ public:
+  ScopedAStatus noop() override { return ScopedAStatus::ok(); }
+
+  ScopedAStatus addInts(int32_t a, int32_t b, int32_t* _aidl_return) override {
+    *_aidl_return = a + b;
+    return ScopedAStatus::ok();
+  }
+
+  ScopedAStatus echoBytes(const vector<uint8_t>& data, vector<uint8_t>* _aidl_return) override {
+    *_aidl_return = data;
+    return ScopedAStatus::ok();
+  }
+
+  ScopedAStatus echoStrings(const vector<string>& data, vector<string>* _aidl_return) override {
+    *_aidl_return = data;
+    return ScopedAStatus::ok();
+  }
+
+  ScopedAStatus echoPayloads(const vector<Payload>& data, vector<Payload>* _aidl_return) override {
+    *_aidl_return = data;
+    return ScopedAStatus::ok();
+  }
+
+  ScopedAStatus reverseInts(vector<int32_t>* data) override {
+    std::reverse(data->begin(), data->end());
+    return ScopedAStatus::ok();
+  }
+
+  ScopedAStatus countOneway(const vector<uint8_t>& /* data */) override {
+    oneway_calls_.Add();
+    return ScopedAStatus::ok();
+  }
+
+  ScopedAStatus awaitOneway(int32_t count) override {
+    oneway_calls_.Await(count);
+    return ScopedAStatus::ok();
+  }
+
+ private:
+  OnewayCounter oneway_calls_;
+};
+
+}  // namespace
+
+int main(int /* argc */, char* /* argv */[]) {
+  std::shared_ptr<IpcBenchmark> service = ndk::SharedRefBase::make<IpcBenchmark>();
+  const string name = string(kServiceName) + "ndk";
+  LOG_ALWAYS_FATAL_IF(STATUS_OK != AServiceManager_addService(service->asBinder().get(),
+                                                              name.c_str()),
+                      "Can't register the benchmark service");
+  ABinderProcess_startThreadPool();
+  ABinderProcess_joinThreadPool();
+  return 1;
+}
@@ -1,5 +1,35 @@
+#include <stdlib.h>
+
+#include <new>
+
 #include <gtest/gtest.h>
 
+#include "aidl_profile.h"
+
+// Allocations are counted as in the aidl binary, so that tests can check how
+// much memory the compiler allocates.
+void* operator new(size_t size) {
+  android::aidl::CountAllocation(size);
+  void* p = malloc(size == 0 ? 1 : size);
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  android::aidl::CountAllocation(size);
+  return malloc(size == 0 ? 1 : size);
+}
+
+void operator delete(void* p) noexcept {
+  free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  free(p);
+}
+
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "aidl/mapping_table.h"
+
+using std::string;
+
+namespace android {
+namespace aidl {
+namespace mapping_table {
+
+namespace {
+
+string EncodeExample() {
+  return Encode({
+      Method{"foo.bar.IFoo", 2, "second", "int second(java.lang.String)", "java.lang.String",
+             false},
+      Method{"foo.bar.IBar", 1, "ping", "void ping()", "", true},
+      Method{"foo.bar.IFoo", 1, "first", "void first(int,int)", "int,int", false},
+  });
+}
+
+}  // namespace
+
+TEST(MappingTableTest, FindsTheMethodsByDescriptorAndCode) {
+  const string data = EncodeExample();
+  const Table table(data.data(), data.size());
+  ASSERT_EQ(3u, table.size());
+  EXPECT_EQ("foo.bar.IBar", table.At(0).descriptor);
+  EXPECT_EQ("first", table.At(1).name);
+
+  Method method;
+  ASSERT_TRUE(table.Find("foo.bar.IFoo", 2, &method));
+  EXPECT_EQ("second", method.name);
+  EXPECT_EQ("int second(java.lang.String)", method.signature);
+  EXPECT_EQ("java.lang.String", method.arguments);
+  EXPECT_FALSE(method.oneway);
+  ASSERT_TRUE(table.Find("foo.bar.IBar", 1, &method));
+  EXPECT_TRUE(method.oneway);
+  EXPECT_EQ("", method.arguments);
+
+  EXPECT_FALSE(table.Find("foo.bar.IFoo", 3, &method));
+  EXPECT_FALSE(table.Find("foo.bar.IBaz", 1, &method));
+  EXPECT_FALSE(table.Find("", 0, &method));
+}
+
+TEST(MappingTableTest, WritesEachStringOnce) {
+  const string data = EncodeExample();
+  EXPECT_EQ(data.find("foo.bar.IFoo"), data.rfind("foo.bar.IFoo"));
+}
+
+TEST(MappingTableTest, IsEmptyUnlessTheDataIsAWholeTable) {
+  const string data = EncodeExample();
+  Method method;
+  for (size_t size : {size_t{0}, kHeaderSize, data.size() - 1}) {
+    const Table table(data.data(), size);
+    EXPECT_EQ(0u, table.size()) << size;
+    EXPECT_FALSE(table.Find("foo.bar.IFoo", 1, &method)) << size;
+  }
+  const string not_a_table = "not a mapping table at all";
+  EXPECT_EQ(0u, Table(not_a_table.data(), not_a_table.size()).size());
+
+  const string empty = Encode({});
+  EXPECT_EQ(kHeaderSize, empty.size());
+  EXPECT_EQ(0u, Table(empty.data(), empty.size()).size());
+}
+
+}  // namespace mapping_table
+}  // namespace aidl
+}  // namespace android
@@ -0,0 +1,231 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "aidl/marshal.h"
+
+namespace android {
+namespace aidl {
+namespace marshal {
+
+namespace {
+
+// A parcel of the values one after the other, as their bytes, with the size
+// of a string or a vector before it
+struct FakeParcel {
+  using Status = int;
+  using String = std::string;
+  using Byte = int8_t;
+  static constexpr int kOk = 0;
+  static constexpr int kBadValue = -1;
+  static constexpr int kNotEnoughData = -2;
+
+  std::string data;
+  size_t pos = 0;
+  int runs = 0;
+
+  template <typename T>
+  int Write(T value) {
+    data.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    return kOk;
+  }
+  int Write(const std::string& value) {
+    Write(static_cast<int32_t>(value.size()));
+    data += value;
+    return kOk;
+  }
+  int WriteUtf8(const std::string& value) { return Write("utf8:" + value); }
+  template <typename T>
+  int Write(const std::vector<T>& value) {
+    WriteSize(value);
+    for (T v : value) Write(v);
+    return kOk;
+  }
+  template <typename T>
+  int WriteSize(const std::vector<T>& value) {
+    return Write(static_cast<int32_t>(value.size()));
+  }
+  int WriteRun(const void* const* args, size_t count, size_t size) {
+    runs++;
+    for (size_t i = 0; i < count; i++) {
+      data.append(static_cast<const char*>(args[i]), size);
+    }
+    return kOk;
+  }
+
+  int ReadBytes(void* out, size_t size) {
+    if (data.size() - pos < size) return kNotEnoughData;
+    memcpy(out, data.data() + pos, size);
+    pos += size;
+    return kOk;
+  }
+  template <typename T>
+  int Read(T* value) {
+    return ReadBytes(value, sizeof(*value));
+  }
+  int Read(std::string* value) {
+    int32_t size;
+    if (int status = Read(&size); status != kOk) return status;
+    if (size < 0 || data.size() - pos < static_cast<size_t>(size)) return kNotEnoughData;
+    value->assign(data, pos, size);
+    pos += size;
+    return kOk;
+  }
+  int ReadUtf8(std::string* value) {
+    if (int status = Read(value); status != kOk) return status;
+    if (value->compare(0, 5, "utf8:") != 0) return kBadValue;
+    value->erase(0, 5);
+    return kOk;
+  }
+  template <typename T>
+  int Read(std::vector<T>* value) {
+    if (int status = Resize(value); status != kOk) return status;
+    for (size_t i = 0; i < value->size(); i++) {
+      T v;
+      if (int status = Read(&v); status != kOk) return status;
+      (*value)[i] = v;
+    }
+    return kOk;
+  }
+  template <typename T>
+  int Resize(std::vector<T>* value) {
+    int32_t size;
+    if (int status = Read(&size); status != kOk) return status;
+    if (size < 0) return kBadValue;
+    value->resize(size);
+    return kOk;
+  }
+  int ReadRun(void* const* args, size_t count, size_t size) {
+    runs++;
+    if (data.size() - pos < count * size) return kNotEnoughData;
+    for (size_t i = 0; i < count; i++) ReadBytes(args[i], size);
+    return kOk;
+  }
+};
+
+}  // namespace
+
+TEST(MarshalTest, ReadsWhatItWrites) {
+  // void f(in boolean a, in byte b, in char c, in int d, in float e, in long f,
+  //        in double g, in String h, in @utf8InCpp String i, in int[] j,
+  //        in byte[] k, in boolean[] l)
+  constexpr uint8_t program[] = {
+      kBool, kByte, kChar, kRun32, 2, kRun64, 2, kString, kUtf8String,
+      kInt32Vector, kByteVector, kBoolVector, kEnd,
+  };
+  bool a = true;
+  int8_t b = -3;
+  char16_t c = u'é';
+  int32_t d = -42;
+  float e = 1.5f;
+  int64_t f = int64_t{1} << 40;
+  double g = -0.25;
+  std::string h = "h", i = "ii";
+  std::vector<int32_t> j = {1, 2, 3};
+  std::vector<int8_t> k = {4, -5};
+  std::vector<bool> l = {true, false, true};
+  const void* const write_args[] = {&a, &b, &c, &d, &e, &f, &g, &h, &i, &j, &k, &l};
+
+  FakeParcel parcel;
+  ASSERT_EQ(FakeParcel::kOk, WriteProgram(parcel, program, write_args));
+  EXPECT_EQ(2, parcel.runs);
+  EXPECT_EQ(1u + 1 + 2 + 2 * 4 + 2 * 8 + 5 + 11 + 16 + 6 + 7, parcel.data.size());
+
+  bool ra = false;
+  int8_t rb = 0;
+  char16_t rc = 0;
+  int32_t rd = 0;
+  float re = 0;
+  int64_t rf = 0;
+  double rg = 0;
+  std::string rh, ri;
+  std::vector<int32_t> rj;
+  std::vector<int8_t> rk;
+  std::vector<bool> rl;
+  void* const read_args[] = {&ra, &rb, &rc, &rd, &re, &rf, &rg, &rh, &ri, &rj, &rk, &rl};
+  ASSERT_EQ(FakeParcel::kOk, ReadProgram(parcel, program, read_args));
+  EXPECT_EQ(parcel.data.size(), parcel.pos);
+  EXPECT_EQ(a, ra);
+  EXPECT_EQ(b, rb);
+  EXPECT_EQ(c, rc);
+  EXPECT_EQ(d, rd);
+  EXPECT_EQ(e, re);
+  EXPECT_EQ(f, rf);
+  EXPECT_EQ(g, rg);
+  EXPECT_EQ(h, rh);
+  EXPECT_EQ(i, ri);
+  EXPECT_EQ(j, rj);
+  EXPECT_EQ(k, rk);
+  EXPECT_EQ(l, rl);
+}
+
+TEST(MarshalTest, SendsOnlyTheSizesOfOutArrays) {
+  constexpr uint8_t program[] = {kSize | kInt64Vector, kSize | kCharVector, kEnd};
+  std::vector<int64_t> a(5);
+  std::vector<char16_t> b;
+  const void* const write_args[] = {&a, &b};
+  FakeParcel parcel;
+  ASSERT_EQ(FakeParcel::kOk, WriteProgram(parcel, program, write_args));
+  EXPECT_EQ(8u, parcel.data.size());
+
+  std::vector<int64_t> ra;
+  std::vector<char16_t> rb = {u'x'};
+  void* const read_args[] = {&ra, &rb};
+  ASSERT_EQ(FakeParcel::kOk, ReadProgram(parcel, program, read_args));
+  EXPECT_EQ(5u, ra.size());
+  EXPECT_TRUE(rb.empty());
+}
+
+TEST(MarshalTest, StopsAtTheFirstError) {
+  constexpr uint8_t program[] = {kInt32, kRun64, 2, kInt32, kEnd};
+  int32_t a = 1;
+  int64_t b = 2;
+  FakeParcel parcel;
+  parcel.Write(a);
+  parcel.Write(b);
+
+  int32_t ra = 0, rd = 7;
+  int64_t rb = 0, rc = 0;
+  void* const read_args[] = {&ra, &rb, &rc, &rd};
+  EXPECT_EQ(FakeParcel::kNotEnoughData, ReadProgram(parcel, program, read_args));
+  EXPECT_EQ(1, ra);
+  EXPECT_EQ(7, rd);
+}
+
+TEST(MarshalTest, RejectsUnknownOperations) {
+  constexpr uint8_t program[] = {kInt32, 0x7f, kInt32, kEnd};
+  int32_t a = 1;
+  const void* const args[] = {&a, &a};
+  FakeParcel parcel;
+  EXPECT_EQ(FakeParcel::kBadValue, WriteProgram(parcel, program, args));
+  EXPECT_EQ(4u, parcel.data.size());
+
+  constexpr uint8_t resize_of_a_string[] = {kSize | kString, kEnd};
+  std::string s;
+  void* const read_args[] = {&s};
+  EXPECT_EQ(FakeParcel::kBadValue, ReadProgram(parcel, resize_of_a_string, read_args));
+}
+
+}  // namespace marshal
+}  // namespace aidl
+}  // namespace android
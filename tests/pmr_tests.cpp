@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstdint>
+#include <memory_resource>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "aidl/pmr.h"
+
+namespace android {
+namespace aidl {
+namespace pmr {
+
+namespace {
+
+enum class ByteEnum : int8_t { FOO };
+enum class IntEnum : int32_t { FOO };
+
+// A class as aidl generates for
+//
+//   @PolymorphicAllocator parcelable Bar { int n = 3; @utf8InCpp String s = "bar"; }
+class Bar {
+ public:
+  using allocator_type = ::std::pmr::polymorphic_allocator<char>;
+  Bar() = default;
+  explicit Bar(const allocator_type& _aidl_allocator) : s("bar", _aidl_allocator) {}
+  Bar(const Bar& _aidl_other, const allocator_type& _aidl_allocator)
+      : n(_aidl_other.n), s(_aidl_other.s, _aidl_allocator) {}
+  Bar(Bar&& _aidl_other, const allocator_type& _aidl_allocator)
+      : n(std::move(_aidl_other.n)), s(std::move(_aidl_other.s), _aidl_allocator) {}
+
+  int32_t n = int32_t(3);
+  ::std::pmr::string s = ::std::pmr::string("bar");
+};
+
+}  // namespace
+
+TEST(PmrTest, PacksBytesAndByteEnums) {
+  EXPECT_TRUE(kIsPacked<uint8_t>);
+  EXPECT_TRUE(kIsPacked<int8_t>);
+  EXPECT_TRUE(kIsPacked<ByteEnum>);
+  EXPECT_FALSE(kIsPacked<bool>);
+  EXPECT_FALSE(kIsPacked<char16_t>);
+  EXPECT_FALSE(kIsPacked<int32_t>);
+  EXPECT_FALSE(kIsPacked<IntEnum>);
+  EXPECT_FALSE(kIsPacked<std::pmr::string>);
+}
+
+TEST(PmrTest, SizesMustFitInTheParcel) {
+  EXPECT_TRUE(MayHold<uint8_t>(8, 8));
+  EXPECT_FALSE(MayHold<uint8_t>(9, 8));
+  EXPECT_TRUE(MayHold<int32_t>(2, 8));
+  EXPECT_FALSE(MayHold<int32_t>(3, 8));
+  EXPECT_TRUE(MayHold<std::pmr::string>(0, 0));
+  EXPECT_FALSE(MayHold<int32_t>(-1, 8));
+}
+
+TEST(PmrTest, ElementsTakeTheResourceOfTheirVector) {
+  std::pmr::monotonic_buffer_resource arena;
+  std::pmr::vector<Bar> bars(&arena);
+  bars.resize(2);
+  bars.push_back(Bar());
+  for (const Bar& bar : bars) {
+    EXPECT_EQ(3, bar.n);
+    EXPECT_EQ("bar", bar.s);
+    EXPECT_EQ(&arena, bar.s.get_allocator().resource());
+  }
+
+  std::pmr::vector<std::pmr::string> strings(&arena);
+  strings.resize(1);
+  EXPECT_EQ(&arena, strings[0].get_allocator().resource());
+}
+
+}  // namespace pmr
+}  // namespace aidl
+}  // namespace android
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+
+#include <string>
+#include <tuple>
+
+#include <gtest/gtest.h>
+
+#include "aidl/result_cache.h"
+
+namespace android {
+namespace aidl {
+
+namespace {
+
+// The cache of a proxy for
+//
+//   @Cacheable String getName(int id, String tag);
+using NameCache = ResultCache<std::tuple<int32_t, std::string>, std::string, 2>;
+
+}  // namespace
+
+TEST(ResultCacheTest, ReturnsTheResultsOfTheCurrentGeneration) {
+  CacheGeneration generation;
+  NameCache cache;
+  const int32_t id = 1;
+  const std::string tag = "tag";
+  std::string name;
+  EXPECT_FALSE(cache.Get(generation.Get(), std::tie(id, tag), &name));
+
+  cache.Put(generation.Get(), std::tie(id, tag), "one");
+  EXPECT_TRUE(cache.Get(generation.Get(), std::tie(id, tag), &name));
+  EXPECT_EQ("one", name);
+  EXPECT_FALSE(cache.Get(generation.Get(), std::make_tuple(2, tag), &name));
+
+  generation.Invalidate();
+  EXPECT_FALSE(cache.Get(generation.Get(), std::tie(id, tag), &name));
+  cache.Put(generation.Get(), std::tie(id, tag), "two");
+  EXPECT_TRUE(cache.Get(generation.Get(), std::tie(id, tag), &name));
+  EXPECT_EQ("two", name);
+}
+
+TEST(ResultCacheTest, DropsTheResultsOfTheCallsThatAnInvalidationOvertook) {
+  CacheGeneration generation;
+  NameCache cache;
+  const uint64_t started = generation.Get();
+  generation.Invalidate();
+  cache.Put(generation.Get(), std::make_tuple(1, "tag"), "new");
+
+  // The call that started before the invalidation finishes after it
+  cache.Put(started, std::make_tuple(1, "tag"), "old");
+  std::string name;
+  EXPECT_TRUE(cache.Get(generation.Get(), std::make_tuple(1, "tag"), &name));
+  EXPECT_EQ("new", name);
+  EXPECT_FALSE(cache.Get(started, std::make_tuple(1, "tag"), &name));
+}
+
+TEST(ResultCacheTest, StartsOverWhenFull) {
+  NameCache cache;
+  cache.Put(0, std::make_tuple(1, ""), "one");
+  cache.Put(0, std::make_tuple(2, ""), "two");
+  cache.Put(0, std::make_tuple(3, ""), "three");
+  std::string name;
+  EXPECT_FALSE(cache.Get(0, std::make_tuple(1, ""), &name));
+  EXPECT_FALSE(cache.Get(0, std::make_tuple(2, ""), &name));
+  EXPECT_TRUE(cache.Get(0, std::make_tuple(3, ""), &name));
+  EXPECT_EQ("three", name);
+}
+
+TEST(ResultCacheTest, CachesTheResultsOfMethodsWithoutArguments) {
+  ResultCache<std::tuple<>, int32_t> cache;
+  int32_t count = 0;
+  EXPECT_FALSE(cache.Get(0, std::tie(), &count));
+  cache.Put(0, std::tie(), 3);
+  EXPECT_TRUE(cache.Get(0, std::tie(), &count));
+  EXPECT_EQ(3, count);
+}
+
+}  // namespace aidl
+}  // namespace android
@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "aidl.h"
+#include "aidl_checkapi.h"
+#include "aidl_profile.h"
+#include "options.h"
+#include "tests/aidl_corpus.h"
+#include "tests/fake_io_delegate.h"
+
+using android::aidl::test::Corpus;
+using android::aidl::test::CorpusSpec;
+using android::aidl::test::FakeIoDelegate;
+using std::string;
+
+namespace android {
+namespace aidl {
+namespace {
+
+// Sizes of the small and the large corpora. Linear costs grow by the factor
+// of the sizes, quadratic ones by its square, so the budget for the ratio of
+// the costs sits in between.
+constexpr int kSmall = 100;
+constexpr int kLarge = 400;
+constexpr double kMaxCostRatio = 8;
+
+// Absolute budgets of the large corpus. The one for the time is generous,
+// since the tests also run unoptimized and with sanitizers.
+constexpr uint64_t kMaxAllocatedBytes = 128 << 20;
+constexpr std::chrono::seconds kMaxTime{20};
+
+struct Cost {
+  uint64_t allocated_bytes;
+  std::chrono::steady_clock::duration time;
+};
+
+using Task = std::function<bool(const Corpus& corpus, const FakeIoDelegate& io)>;
+using SpecOfSize = std::function<CorpusSpec(int n)>;
+
+CorpusSpec Spec(int n) {
+  CorpusSpec spec;
+  spec.methods = n;
+  spec.fields = n;
+  spec.enumerators = n;
+  spec.constants = n;
+  spec.imports = n / 4;
+  spec.import_roots = 8;
+  spec.versions = 2;
+  return spec;
+}
+
+// The cheapest of three runs of |task|.
+Cost Measure(const CorpusSpec& spec, const Task& task) {
+  const Corpus corpus(spec);
+  FakeIoDelegate io;
+  corpus.AddTo(&io);
+  Cost cost{UINT64_MAX, std::chrono::steady_clock::duration::max()};
+  for (int i = 0; i < 3; i++) {
+    const uint64_t bytes = ThreadAllocatedBytes();
+    const auto begin = std::chrono::steady_clock::now();
+    EXPECT_TRUE(task(corpus, io));
+    cost.time = std::min(cost.time, std::chrono::steady_clock::now() - begin);
+    cost.allocated_bytes = std::min(cost.allocated_bytes, ThreadAllocatedBytes() - bytes);
+  }
+  return cost;
+}
+
+void ExpectScalesLinearly(const SpecOfSize& spec, const Task& task) {
+  const Cost small = Measure(spec(kSmall), task);
+  const Cost large = Measure(spec(kLarge), task);
+  EXPECT_LT(large.allocated_bytes, kMaxCostRatio * small.allocated_bytes);
+  EXPECT_LT(large.time.count(), kMaxCostRatio * small.time.count());
+  EXPECT_LT(large.allocated_bytes, kMaxAllocatedBytes);
+  EXPECT_LT(large.time, kMaxTime);
+}
+
+void ExpectScalesLinearly(const Task& task) {
+  ExpectScalesLinearly(Spec, task);
+}
+
+bool Compile(const string& lang, const Corpus& corpus, const FakeIoDelegate& io) {
+  string cmdline = "aidl --lang=" + lang + " -I src " + corpus.ImportFlags();
+  cmdline += " -o out -h out";
+  for (const string& input : corpus.Inputs()) {
+    cmdline += " " + input;
+  }
+  return compile_aidl(Options::From(cmdline), io) == 0;
+}
+
+}  // namespace
+
+TEST(ScalingTest, JavaCompilationScalesLinearly) {
+  ExpectScalesLinearly(
+      [](const Corpus& corpus, const FakeIoDelegate& io) { return Compile("java", corpus, io); });
+}
+
+TEST(ScalingTest, CppCompilationScalesLinearly) {
+  ExpectScalesLinearly(
+      [](const Corpus& corpus, const FakeIoDelegate& io) { return Compile("cpp", corpus, io); });
+}
+
+TEST(ScalingTest, NdkCompilationScalesLinearly) {
+  ExpectScalesLinearly(
+      [](const Corpus& corpus, const FakeIoDelegate& io) { return Compile("ndk", corpus, io); });
+}
+
+TEST(ScalingTest, ConstantExpressionsScaleLinearlyWithTheirDepth) {
+  auto spec = [](int n) {
+    CorpusSpec spec;
+    spec.expression_depth = n;
+    return spec;
+  };
+  ExpectScalesLinearly(spec, [](const Corpus& corpus, const FakeIoDelegate& io) {
+    return Compile("cpp", corpus, io);
+  });
+}
+
+TEST(ScalingTest, ApiDumpScalesLinearly) {
+  ExpectScalesLinearly([](const Corpus& corpus, const FakeIoDelegate& io) {
+    string cmdline = "aidl --dumpapi -I src " + corpus.ImportFlags() + " -o dump";
+    for (const string& input : corpus.Inputs()) {
+      cmdline += " " + input;
+    }
+    return dump_api(Options::From(cmdline), io);
+  });
+}
+
+TEST(ScalingTest, ApiCheckScalesLinearly) {
+  ExpectScalesLinearly([](const Corpus& corpus, const FakeIoDelegate& io) {
+    return check_api(Options::From("aidl --checkapi " + corpus.ImportFlags() + " " +
+                                   Corpus::VersionDir(1) + " " + Corpus::VersionDir(2)),
+                     io);
+  });
+}
+
+}  // namespace aidl
+}  // namespace android
@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "aidl/shared_memory.h"
+
+namespace android {
+namespace aidl {
+namespace shared_memory {
+
+TEST(SharedMemoryTest, ReadsTheBytesOfARegion) {
+  std::vector<uint8_t> bytes(100000);
+  for (size_t i = 0; i < bytes.size(); i++) bytes[i] = static_cast<uint8_t>(i * 7);
+  const int fd = CreateRegion(bytes.data(), bytes.size());
+  ASSERT_GE(fd, 0);
+
+  // From the start, although the offset of the descriptor is at the end
+  std::vector<uint8_t> read;
+  ASSERT_TRUE(ReadRegion(fd, bytes.size(), &read));
+  EXPECT_EQ(bytes, read);
+  ASSERT_TRUE(ReadRegion(fd, 10, &read));
+  EXPECT_EQ(std::vector<uint8_t>(bytes.begin(), bytes.begin() + 10), read);
+  close(fd);
+}
+
+TEST(SharedMemoryTest, SealsTheRegion) {
+  const uint8_t bytes[] = {1, 2, 3};
+  const int fd = CreateRegion(bytes, sizeof(bytes));
+  ASSERT_GE(fd, 0);
+  EXPECT_EQ(F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL, fcntl(fd, F_GET_SEALS));
+  EXPECT_EQ(-1, write(fd, bytes, sizeof(bytes)));
+  EXPECT_NE(0, ftruncate(fd, 0));
+  close(fd);
+}
+
+TEST(SharedMemoryTest, RejectsARegionShorterThanItsLength) {
+  const uint8_t bytes[] = {1, 2, 3};
+  const int fd = CreateRegion(bytes, sizeof(bytes));
+  ASSERT_GE(fd, 0);
+  std::vector<uint8_t> read = {9};
+  EXPECT_FALSE(ReadRegion(fd, sizeof(bytes) + 1, &read));
+  EXPECT_EQ(std::vector<uint8_t>{9}, read);
+  EXPECT_TRUE(ReadRegion(fd, 0, &read));
+  EXPECT_TRUE(read.empty());
+  close(fd);
+}
+
+// A hostile sender may send a region without seals, and shrink it after the
+// size was checked. Reading it then fails instead of faulting.
+TEST(SharedMemoryTest, RejectsAnUnsealedRegionThatShrinks) {
+  const int fd = static_cast<int>(syscall(__NR_memfd_create, "aidl", 0x0001U /* MFD_CLOEXEC */));
+  ASSERT_GE(fd, 0);
+  const std::vector<uint8_t> bytes(3 * 4096, 5);
+  ASSERT_EQ(static_cast<ssize_t>(bytes.size()), write(fd, bytes.data(), bytes.size()));
+  EXPECT_EQ(0, fcntl(fd, F_GET_SEALS) & F_SEAL_SHRINK);
+
+  std::vector<uint8_t> read;
+  ASSERT_EQ(0, ftruncate(fd, 4096));
+  EXPECT_FALSE(ReadRegion(fd, bytes.size(), &read));
+
+  // Shrunk between the check of its size and the reads
+  ASSERT_EQ(0, ftruncate(fd, bytes.size()));
+  std::atomic_bool done = false;
+  std::thread shrinker([&] {
+    while (!done) {
+      ftruncate(fd, 0);
+      ftruncate(fd, bytes.size());
+    }
+  });
+  for (int i = 0; i < 1000; i++) {
+    if (ReadRegion(fd, bytes.size(), &read)) {
+      EXPECT_EQ(bytes.size(), read.size());
+    }
+  }
+  done = true;
+  shrinker.join();
+  close(fd);
+}
+
+}  // namespace shared_memory
+}  // namespace aidl
+}  // namespace android
@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+
+#include <atomic>
+#include <future>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "aidl/single_flight.h"
+
+namespace android {
+namespace aidl {
+
+namespace {
+
+// A copyable status, like ::android::binder::Status
+struct Status {
+  int32_t code = 0;
+};
+
+// The calls in flight of a stub for
+//
+//   @SingleFlight String getName(int id, String tag);
+using NameFlight = SingleFlight<std::tuple<int32_t, std::string>, Status, std::string>;
+
+void WaitFor(const NameFlight& flight, size_t waiting) {
+  while (flight.Waiting() < waiting) std::this_thread::yield();
+}
+
+}  // namespace
+
+TEST(SingleFlightTest, CallsOnceForTheCallsWithEqualArguments) {
+  NameFlight flight;
+  std::promise<void> release;
+  std::shared_future<void> released = release.get_future().share();
+  std::atomic<int> calls = 0;
+  const std::string tag = "tag";
+
+  auto call = [&](int32_t id, std::string* name) {
+    return flight.Do(std::tie(id, tag), name, [&, id, name] {
+      calls++;
+      released.wait();
+      *name = "name" + std::to_string(id);
+      return Status{id};
+    });
+  };
+  std::string leader_name;
+  auto leader = std::async(std::launch::async, [&] { return call(7, &leader_name); });
+  while (flight.InFlight() == 0) std::this_thread::yield();
+
+  std::vector<std::string> names(3);
+  std::vector<std::future<Status>> followers;
+  for (std::string& name : names) {
+    followers.push_back(std::async(std::launch::async, [&] { return call(7, &name); }));
+  }
+  WaitFor(flight, names.size());
+  release.set_value();
+
+  EXPECT_EQ(7, leader.get().code);
+  EXPECT_EQ("name7", leader_name);
+  for (size_t i = 0; i < names.size(); i++) {
+    EXPECT_EQ(7, followers[i].get().code);
+    EXPECT_EQ("name7", names[i]);
+  }
+  EXPECT_EQ(1, calls);
+  EXPECT_EQ(0u, flight.InFlight());
+}
+
+TEST(SingleFlightTest, CallsForEachOfTheDifferentArguments) {
+  NameFlight flight;
+  std::promise<void> release;
+  std::shared_future<void> released = release.get_future().share();
+  std::atomic<int> calls = 0;
+
+  auto call = [&](int32_t id, const std::string& tag, std::string* name) {
+    return flight.Do(std::tie(id, tag), name, [&, id, name] {
+      calls++;
+      released.wait();
+      *name = tag + std::to_string(id);
+      return Status{id};
+    });
+  };
+  std::string names[3];
+  auto first = std::async(std::launch::async, [&] { return call(1, "a", &names[0]); });
+  auto second = std::async(std::launch::async, [&] { return call(2, "a", &names[1]); });
+  auto third = std::async(std::launch::async, [&] { return call(1, "b", &names[2]); });
+  while (flight.InFlight() < 3) std::this_thread::yield();
+  release.set_value();
+
+  EXPECT_EQ(1, first.get().code);
+  EXPECT_EQ(2, second.get().code);
+  EXPECT_EQ(1, third.get().code);
+  EXPECT_EQ("a1", names[0]);
+  EXPECT_EQ("a2", names[1]);
+  EXPECT_EQ("b1", names[2]);
+  EXPECT_EQ(3, calls);
+}
+
+TEST(SingleFlightTest, CallsAgainOnceTheCallInFlightEnded) {
+  SingleFlight<std::tuple<>, Status> flight;
+  int calls = 0;
+  for (int i = 0; i < 2; i++) {
+    EXPECT_EQ(i, flight.Do(std::tie(), nullptr, [&] { return Status{calls++}; }).code);
+  }
+  EXPECT_EQ(2, calls);
+  EXPECT_EQ(0u, flight.InFlight());
+}
+
+}  // namespace aidl
+}  // namespace android
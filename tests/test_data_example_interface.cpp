@@ -2331,8 +2331,8 @@ public interface IExampleInterface extends android.os.IInterface
       {
         mRemote = remote;
       }
-      private int mCachedVersion = -1;
-      private String mCachedHash = "-1";
+      private volatile int mCachedVersion = -1;
+      private volatile String mCachedHash = "-1";
       @Override public android.os.IBinder asBinder()
       {
         return mRemote;
@@ -2549,7 +2549,8 @@ public interface IExampleInterface extends android.os.IInterface
       }
       @Override
       public int getInterfaceVersion() throws android.os.RemoteException {
-        if (mCachedVersion == -1) {
+        int _aidl_version = mCachedVersion;
+        if (_aidl_version == -1) {
           android.os.Parcel data = android.os.Parcel.obtain();
           android.os.Parcel reply = android.os.Parcel.obtain();
           try {
@@ -2561,17 +2562,19 @@ public interface IExampleInterface extends android.os.IInterface
               }
             }
             reply.readException();
-            mCachedVersion = reply.readInt();
+            _aidl_version = reply.readInt();
+            mCachedVersion = _aidl_version;
           } finally {
             reply.recycle();
             data.recycle();
           }
         }
-        return mCachedVersion;
+        return _aidl_version;
       }
       @Override
-      public synchronized String getInterfaceHash() throws android.os.RemoteException {
-        if ("-1".equals(mCachedHash)) {
+      public String getInterfaceHash() throws android.os.RemoteException {
+        String _aidl_hash = mCachedHash;
+        if ("-1".equals(_aidl_hash)) {
           android.os.Parcel data = android.os.Parcel.obtain();
           android.os.Parcel reply = android.os.Parcel.obtain();
           try {
@@ -2583,13 +2586,14 @@ public interface IExampleInterface extends android.os.IInterface
               }
             }
             reply.readException();
-            mCachedHash = reply.readString();
+            _aidl_hash = reply.readString();
+            mCachedHash = _aidl_hash;
           } finally {
             reply.recycle();
             data.recycle();
           }
         }
-        return mCachedHash;
+        return _aidl_hash;
       }
       public static android.test.IExampleInterface sDefaultImpl;
     }
@@ -259,6 +259,8 @@ BnPingResponder::BnPingResponder()
   ::android::internal::Stability::markCompilationUnit(this);
 }
 
+static constexpr char16_t _aidl_IPingResponder_token[] = u"android.os.IPingResponder";
+
 ::android::status_t BnPingResponder::onTransact(uint32_t _aidl_code, const ::android::Parcel& _aidl_data, ::android::Parcel* _aidl_reply, uint32_t _aidl_flags) {
   ::android::status_t _aidl_ret_status = ::android::OK;
   switch (_aidl_code) {
@@ -266,7 +268,7 @@ BnPingResponder::BnPingResponder()
   {
     ::android::String16 in_input;
     ::android::String16 _aidl_return;
-    if (!(_aidl_data.checkInterface(this))) {
+    if (!(_aidl_data.enforceInterface(_aidl_IPingResponder_token, 25))) {
       _aidl_ret_status = ::android::BAD_TYPE;
       break;
     }
@@ -292,7 +294,7 @@ BnPingResponder::BnPingResponder()
   {
     ::std::unique_ptr<::android::String16> in_input;
     ::std::unique_ptr<::android::String16> _aidl_return;
-    if (!(_aidl_data.checkInterface(this))) {
+    if (!(_aidl_data.enforceInterface(_aidl_IPingResponder_token, 25))) {
       _aidl_ret_status = ::android::BAD_TYPE;
       break;
     }
@@ -318,7 +320,7 @@ BnPingResponder::BnPingResponder()
   {
     ::std::string in_input;
     ::std::string _aidl_return;
-    if (!(_aidl_data.checkInterface(this))) {
+    if (!(_aidl_data.enforceInterface(_aidl_IPingResponder_token, 25))) {
       _aidl_ret_status = ::android::BAD_TYPE;
       break;
     }
@@ -344,7 +346,7 @@ BnPingResponder::BnPingResponder()
   {
     ::std::unique_ptr<::std::string> in_input;
     ::std::unique_ptr<::std::string> _aidl_return;
-    if (!(_aidl_data.checkInterface(this))) {
+    if (!(_aidl_data.enforceInterface(_aidl_IPingResponder_token, 25))) {
       _aidl_ret_status = ::android::BAD_TYPE;
       break;
     }
@@ -658,7 +660,8 @@ BpPingResponder::BpPingResponder(const ::android::sp<::android::IBinder>& _aidl_
 }
 
 int32_t BpPingResponder::getInterfaceVersion() {
-  if (cached_version_ == -1) {
+  int32_t _aidl_version = cached_version_.load(std::memory_order_acquire);
+  if (_aidl_version == -1) {
     ::android::Parcel data;
     ::android::Parcel reply;
     data.writeInterfaceToken(getInterfaceDescriptor());
@@ -667,29 +670,37 @@ int32_t BpPingResponder::getInterfaceVersion() {
       ::android::binder::Status _aidl_status;
       err = _aidl_status.readFromParcel(reply);
       if (err == ::android::OK && _aidl_status.isOk()) {
-        cached_version_ = reply.readInt32();
+        _aidl_version = reply.readInt32();
+        cached_version_.store(_aidl_version, std::memory_order_release);
       }
     }
   }
-  return cached_version_;
+  return _aidl_version;
 }
 
 std::string BpPingResponder::getInterfaceHash() {
-  std::lock_guard<std::mutex> lockGuard(cached_hash_mutex_);
-  if (cached_hash_ == "-1") {
-    ::android::Parcel data;
-    ::android::Parcel reply;
-    data.writeInterfaceToken(getInterfaceDescriptor());
-    ::android::status_t err = remote()->transact(::android::IBinder::FIRST_CALL_TRANSACTION + 16777213 /* getInterfaceHash */, data, &reply);
-    if (err == ::android::OK) {
-      ::android::binder::Status _aidl_status;
-      err = _aidl_status.readFromParcel(reply);
-      if (err == ::android::OK && _aidl_status.isOk()) {
-        reply.readUtf8FromUtf16(&cached_hash_);
+  if (cached_hash_state_.load(std::memory_order_acquire) == 2) {
+    return cached_hash_;
+  }
+  std::string _aidl_hash = "-1";
+  ::android::Parcel data;
+  ::android::Parcel reply;
+  data.writeInterfaceToken(getInterfaceDescriptor());
+  ::android::status_t err = remote()->transact(::android::IBinder::FIRST_CALL_TRANSACTION + 16777213 /* getInterfaceHash */, data, &reply);
+  if (err == ::android::OK) {
+    ::android::binder::Status _aidl_status;
+    err = _aidl_status.readFromParcel(reply);
+    if (err == ::android::OK && _aidl_status.isOk()) {
+      reply.readUtf8FromUtf16(&_aidl_hash);
+      int _aidl_unset = 0;
+      if (cached_hash_state_.compare_exchange_strong(_aidl_unset, 1,
+                                                     std::memory_order_acquire)) {
+        cached_hash_ = _aidl_hash;
+        cached_hash_state_.store(2, std::memory_order_release);
       }
     }
   }
-  return cached_hash_;
+  return _aidl_hash;
 }
 
 }  // namespace os
@@ -708,6 +719,8 @@ BnPingResponder::BnPingResponder()
   ::android::internal::Stability::markCompilationUnit(this);
 }
 
+static constexpr char16_t _aidl_IPingResponder_token[] = u"android.os.IPingResponder";
+
 ::android::status_t BnPingResponder::onTransact(uint32_t _aidl_code, const ::android::Parcel& _aidl_data, ::android::Parcel* _aidl_reply, uint32_t _aidl_flags) {
   ::android::status_t _aidl_ret_status = ::android::OK;
   switch (_aidl_code) {
@@ -715,7 +728,7 @@ BnPingResponder::BnPingResponder()
   {
     ::android::String16 in_input;
     ::android::String16 _aidl_return;
-    if (!(_aidl_data.checkInterface(this))) {
+    if (!(_aidl_data.enforceInterface(_aidl_IPingResponder_token, 25))) {
       _aidl_ret_status = ::android::BAD_TYPE;
       break;
     }
@@ -741,7 +754,7 @@ BnPingResponder::BnPingResponder()
   {
     ::std::unique_ptr<::android::String16> in_input;
     ::std::unique_ptr<::android::String16> _aidl_return;
-    if (!(_aidl_data.checkInterface(this))) {
+    if (!(_aidl_data.enforceInterface(_aidl_IPingResponder_token, 25))) {
       _aidl_ret_status = ::android::BAD_TYPE;
       break;
     }
@@ -767,7 +780,7 @@ BnPingResponder::BnPingResponder()
   {
     ::std::string in_input;
     ::std::string _aidl_return;
-    if (!(_aidl_data.checkInterface(this))) {
+    if (!(_aidl_data.enforceInterface(_aidl_IPingResponder_token, 25))) {
       _aidl_ret_status = ::android::BAD_TYPE;
       break;
     }
@@ -793,7 +806,7 @@ BnPingResponder::BnPingResponder()
   {
     ::std::unique_ptr<::std::string> in_input;
     ::std::unique_ptr<::std::string> _aidl_return;
-    if (!(_aidl_data.checkInterface(this))) {
+    if (!(_aidl_data.enforceInterface(_aidl_IPingResponder_token, 25))) {
       _aidl_ret_status = ::android::BAD_TYPE;
       break;
     }
@@ -817,14 +830,14 @@ BnPingResponder::BnPingResponder()
   break;
   case ::android::IBinder::FIRST_CALL_TRANSACTION + 16777214 /* getInterfaceVersion */:
   {
-    _aidl_data.checkInterface(this);
+    _aidl_data.enforceInterface(_aidl_IPingResponder_token, 25);
     _aidl_reply->writeNoException();
     _aidl_reply->writeInt32(IPingResponder::VERSION);
   }
   break;
   case ::android::IBinder::FIRST_CALL_TRANSACTION + 16777213 /* getInterfaceHash */:
   {
-    _aidl_data.checkInterface(this);
+    _aidl_data.enforceInterface(_aidl_IPingResponder_token, 25);
     _aidl_reply->writeNoException();
     _aidl_reply->writeUtf8AsUtf16(IPingResponder::HASH);
   }
@@ -924,6 +937,7 @@ R"(#ifndef AIDL_GENERATED_ANDROID_OS_BP_PING_RESPONDER_H_
 #include <binder/IInterface.h>
 #include <utils/Errors.h>
 #include <android/os/IPingResponder.h>
+#include <atomic>
 
 namespace android {
 
@@ -940,9 +954,9 @@ public:
   int32_t getInterfaceVersion() override;
   std::string getInterfaceHash() override;
 private:
-  int32_t cached_version_ = -1;
-  std::string cached_hash_ = "-1";
-  std::mutex cached_hash_mutex_;
+  std::atomic<int32_t> cached_version_{-1};
+  std::atomic<int> cached_hash_state_{0};
+  std::string cached_hash_;
 };  // class BpPingResponder
 
 }  // namespace os
@@ -211,6 +211,8 @@ BnStringConstants::BnStringConstants()
   ::android::internal::Stability::markCompilationUnit(this);
 }
 
+static constexpr char16_t _aidl_IStringConstants_token[] = u"android.os.IStringConstants";
+
 ::android::status_t BnStringConstants::onTransact(uint32_t _aidl_code, const ::android::Parcel& _aidl_data, ::android::Parcel* _aidl_reply, uint32_t _aidl_flags) {
   ::android::status_t _aidl_ret_status = ::android::OK;
   switch (_aidl_code) {
@@ -327,8 +329,8 @@ public interface IStringConstants extends android.os.IInterface
       {
         mRemote = remote;
       }
-      private int mCachedVersion = -1;
-      private String mCachedHash = "-1";
+      private volatile int mCachedVersion = -1;
+      private volatile String mCachedHash = "-1";
       @Override public android.os.IBinder asBinder()
       {
         return mRemote;
@@ -339,7 +341,8 @@ public interface IStringConstants extends android.os.IInterface
       }
       @Override
       public int getInterfaceVersion() throws android.os.RemoteException {
-        if (mCachedVersion == -1) {
+        int _aidl_version = mCachedVersion;
+        if (_aidl_version == -1) {
           android.os.Parcel data = android.os.Parcel.obtain();
           android.os.Parcel reply = android.os.Parcel.obtain();
           try {
@@ -351,17 +354,19 @@ public interface IStringConstants extends android.os.IInterface
               }
             }
             reply.readException();
-            mCachedVersion = reply.readInt();
+            _aidl_version = reply.readInt();
+            mCachedVersion = _aidl_version;
           } finally {
             reply.recycle();
             data.recycle();
           }
         }
-        return mCachedVersion;
+        return _aidl_version;
       }
       @Override
-      public synchronized String getInterfaceHash() throws android.os.RemoteException {
-        if ("-1".equals(mCachedHash)) {
+      public String getInterfaceHash() throws android.os.RemoteException {
+        String _aidl_hash = mCachedHash;
+        if ("-1".equals(_aidl_hash)) {
           android.os.Parcel data = android.os.Parcel.obtain();
           android.os.Parcel reply = android.os.Parcel.obtain();
           try {
@@ -373,13 +378,14 @@ public interface IStringConstants extends android.os.IInterface
               }
             }
             reply.readException();
-            mCachedHash = reply.readString();
+            _aidl_hash = reply.readString();
+            mCachedHash = _aidl_hash;
           } finally {
             reply.recycle();
             data.recycle();
           }
         }
-        return mCachedHash;
+        return _aidl_hash;
       }
       public static android.os.IStringConstants sDefaultImpl;
     }
@@ -484,7 +490,8 @@ BpStringConstants::BpStringConstants(const ::android::sp<::android::IBinder>& _a
 }
 
 int32_t BpStringConstants::getInterfaceVersion() {
-  if (cached_version_ == -1) {
+  int32_t _aidl_version = cached_version_.load(std::memory_order_acquire);
+  if (_aidl_version == -1) {
     ::android::Parcel data;
     ::android::Parcel reply;
     data.writeInterfaceToken(getInterfaceDescriptor());
@@ -493,29 +500,37 @@ int32_t BpStringConstants::getInterfaceVersion() {
       ::android::binder::Status _aidl_status;
       err = _aidl_status.readFromParcel(reply);
       if (err == ::android::OK && _aidl_status.isOk()) {
-        cached_version_ = reply.readInt32();
+        _aidl_version = reply.readInt32();
+        cached_version_.store(_aidl_version, std::memory_order_release);
       }
     }
   }
-  return cached_version_;
+  return _aidl_version;
 }
 
 std::string BpStringConstants::getInterfaceHash() {
-  std::lock_guard<std::mutex> lockGuard(cached_hash_mutex_);
-  if (cached_hash_ == "-1") {
-    ::android::Parcel data;
-    ::android::Parcel reply;
-    data.writeInterfaceToken(getInterfaceDescriptor());
-    ::android::status_t err = remote()->transact(::android::IBinder::FIRST_CALL_TRANSACTION + 16777213 /* getInterfaceHash */, data, &reply);
-    if (err == ::android::OK) {
-      ::android::binder::Status _aidl_status;
-      err = _aidl_status.readFromParcel(reply);
-      if (err == ::android::OK && _aidl_status.isOk()) {
-        reply.readUtf8FromUtf16(&cached_hash_);
+  if (cached_hash_state_.load(std::memory_order_acquire) == 2) {
+    return cached_hash_;
+  }
+  std::string _aidl_hash = "-1";
+  ::android::Parcel data;
+  ::android::Parcel reply;
+  data.writeInterfaceToken(getInterfaceDescriptor());
+  ::android::status_t err = remote()->transact(::android::IBinder::FIRST_CALL_TRANSACTION + 16777213 /* getInterfaceHash */, data, &reply);
+  if (err == ::android::OK) {
+    ::android::binder::Status _aidl_status;
+    err = _aidl_status.readFromParcel(reply);
+    if (err == ::android::OK && _aidl_status.isOk()) {
+      reply.readUtf8FromUtf16(&_aidl_hash);
+      int _aidl_unset = 0;
+      if (cached_hash_state_.compare_exchange_strong(_aidl_unset, 1,
+                                                     std::memory_order_acquire)) {
+        cached_hash_ = _aidl_hash;
+        cached_hash_state_.store(2, std::memory_order_release);
       }
     }
   }
-  return cached_hash_;
+  return _aidl_hash;
 }
 
 }  // namespace os
@@ -534,19 +549,21 @@ BnStringConstants::BnStringConstants()
   ::android::internal::Stability::markCompilationUnit(this);
 }
 
+static constexpr char16_t _aidl_IStringConstants_token[] = u"android.os.IStringConstants";
+
 ::android::status_t BnStringConstants::onTransact(uint32_t _aidl_code, const ::android::Parcel& _aidl_data, ::android::Parcel* _aidl_reply, uint32_t _aidl_flags) {
   ::android::status_t _aidl_ret_status = ::android::OK;
   switch (_aidl_code) {
   case ::android::IBinder::FIRST_CALL_TRANSACTION + 16777214 /* getInterfaceVersion */:
   {
-    _aidl_data.checkInterface(this);
+    _aidl_data.enforceInterface(_aidl_IStringConstants_token, 27);
     _aidl_reply->writeNoException();
     _aidl_reply->writeInt32(IStringConstants::VERSION);
   }
   break;
   case ::android::IBinder::FIRST_CALL_TRANSACTION + 16777213 /* getInterfaceHash */:
   {
-    _aidl_data.checkInterface(this);
+    _aidl_data.enforceInterface(_aidl_IStringConstants_token, 27);
     _aidl_reply->writeNoException();
     _aidl_reply->writeUtf8AsUtf16(IStringConstants::HASH);
   }
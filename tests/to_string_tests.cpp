@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "aidl/to_string.h"
+
+namespace android {
+namespace aidl {
+
+namespace {
+
+// The characters of an ::android::String16
+class FakeString16 {
+ public:
+  explicit FakeString16(std::u16string value) : value_(std::move(value)) {}
+  const char16_t* string() const { return value_.data(); }
+  size_t size() const { return value_.size(); }
+
+ private:
+  std::u16string value_;
+};
+
+enum class Color : int8_t { RED, GREEN };
+enum class Size : int32_t { SMALL = 1 };
+
+// As the C++ and NDK backends generate it
+constexpr std::string_view toStringView(Color value) {
+  return value == Color::RED ? "RED" : value == Color::GREEN ? "GREEN" : "";
+}
+
+// As --parcelable-to-string generates it
+struct Point {
+  int32_t x = 0;
+  std::optional<std::vector<Color>> colors;
+  std::unique_ptr<Point> next;
+
+  void appendTo(std::string& _aidl_os) const {
+    _aidl_os += "Point{x: ";
+    ::android::aidl::AppendTo(_aidl_os, x);
+    _aidl_os += ", colors: ";
+    ::android::aidl::AppendTo(_aidl_os, colors);
+    _aidl_os += ", next: ";
+    ::android::aidl::AppendTo(_aidl_os, next);
+    _aidl_os += '}';
+  }
+};
+
+class FakeBinder {};
+
+// Like an ::ndk::ScopedFileDescriptor
+struct FakeFileDescriptor {
+  int get() const { return 7; }
+};
+
+template <typename T>
+std::string ToString(const T& value) {
+  std::string out;
+  AppendTo(out, value);
+  return out;
+}
+
+}  // namespace
+
+TEST(ToStringTest, AppendsPrimitives) {
+  EXPECT_EQ("true", ToString(true));
+  EXPECT_EQ("-12", ToString(int8_t{-12}));
+  EXPECT_EQ("-2147483648", ToString(INT32_MIN));
+  EXPECT_EQ("9223372036854775807", ToString(INT64_MAX));
+  EXPECT_EQ("1.5", ToString(1.5f));
+  EXPECT_EQ("0.25", ToString(0.25));
+  EXPECT_EQ("a", ToString(u'a'));
+}
+
+TEST(ToStringTest, AppendsEnumsByTheirNames) {
+  EXPECT_EQ("GREEN", ToString(Color::GREEN));
+  // Without a toStringView(), the number will do
+  EXPECT_EQ("1", ToString(Size::SMALL));
+}
+
+TEST(ToStringTest, AppendsStringsAsUtf8) {
+  EXPECT_EQ("abc", ToString(std::string("abc")));
+  EXPECT_EQ("abc", ToString(std::pmr::string("abc")));
+  EXPECT_EQ("\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80", ToString(FakeString16(u"é€\U0001f600")));
+  EXPECT_EQ("a\xef\xbf\xbd", ToString(std::u16string(u"a") + char16_t{0xd800}));
+}
+
+TEST(ToStringTest, AppendsArraysAndNulls) {
+  EXPECT_EQ("[]", ToString(std::vector<int32_t>{}));
+  EXPECT_EQ("[1, 2]", ToString(std::pmr::vector<int32_t>{1, 2}));
+  EXPECT_EQ("[true, false]", ToString(std::vector<bool>{true, false}));
+  EXPECT_EQ("[[a], []]", ToString(std::vector<std::vector<std::string>>{{"a"}, {}}));
+  EXPECT_EQ("[1, 2, 3]", ToString(std::array<int8_t, 3>{1, 2, 3}));
+  EXPECT_EQ("[false]", ToString(std::array<bool, 1>{}));
+  EXPECT_EQ("(null)", ToString(std::optional<std::string>()));
+  EXPECT_EQ("x", ToString(std::optional<std::string>("x")));
+  EXPECT_EQ("7", ToString(FakeFileDescriptor{}));
+}
+
+TEST(ToStringTest, AppendsParcelablesToTheStringOfTheCaller) {
+  Point point;
+  point.x = 1;
+  point.colors = {Color::RED, Color::GREEN};
+  point.next = std::make_unique<Point>();
+  std::string out = "log: ";
+  AppendTo(out, point);
+  EXPECT_EQ("log: Point{x: 1, colors: [RED, GREEN], next: Point{x: 0, colors: (null), next: (null)}}",
+            out);
+}
+
+TEST(ToStringTest, AppendsTheAddressOfValuesWithoutText) {
+  FakeBinder binder;
+  const std::string address = ToString(std::shared_ptr<FakeBinder>(&binder, [](FakeBinder*) {}));
+  EXPECT_NE("(null)", address);
+  EXPECT_FALSE(address.empty());
+  EXPECT_EQ("(null)", ToString(std::shared_ptr<FakeBinder>()));
+  EXPECT_EQ("{no toString() implemented}", ToString(binder));
+}
+
+}  // namespace aidl
+}  // namespace android
@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "aidl/replay.h"
+#include "aidl/transaction_capture.h"
+
+using std::string;
+using std::vector;
+
+namespace android {
+namespace aidl {
+namespace capture {
+
+namespace {
+
+Request MakeRequest(const string& method_name, int64_t time_ns, const string& data) {
+  return Request{"foo.bar.IFoo", method_name, 3, false, time_ns, data};
+}
+
+}  // namespace
+
+TEST(TransactionCaptureTest, DecodesTheEncodedRequests) {
+  const string data("\x01\x00\xff parcel", 9);
+  vector<Request> requests{MakeRequest("Ping", 1000, data), MakeRequest("Pong", 2000, "")};
+  requests[1].code = 0xffffff;
+  requests[1].oneway = true;
+
+  vector<Request> decoded;
+  const string dump = Encode(requests);
+  ASSERT_TRUE(Decode(dump, &decoded));
+  ASSERT_EQ(2u, decoded.size());
+  EXPECT_EQ("foo.bar.IFoo", decoded[0].interface_name);
+  EXPECT_EQ("Ping", decoded[0].method_name);
+  EXPECT_EQ(3u, decoded[0].code);
+  EXPECT_FALSE(decoded[0].oneway);
+  EXPECT_EQ(1000, decoded[0].time_ns);
+  EXPECT_EQ(data, decoded[0].data);
+  EXPECT_EQ(0xffffffu, decoded[1].code);
+  EXPECT_TRUE(decoded[1].oneway);
+  EXPECT_EQ("", decoded[1].data);
+
+  EXPECT_FALSE(Decode(dump.substr(0, dump.size() - 1), &decoded));
+  EXPECT_FALSE(Decode("not a dump", &decoded));
+}
+
+TEST(TransactionCaptureTest, DropsTheRequestsPastTheLimit) {
+  Recorder recorder;
+  const string half(Recorder::kMaxBytes / 2, 'x');
+  recorder.Add(MakeRequest("A", 0, half));
+  recorder.Add(MakeRequest("B", 0, half));
+  recorder.Add(MakeRequest("C", 0, "y"));
+  EXPECT_EQ(1u, recorder.Dropped());
+
+  const vector<Request> requests = recorder.Take();
+  ASSERT_EQ(2u, requests.size());
+  EXPECT_EQ("A", requests[0].method_name);
+  EXPECT_EQ("B", requests[1].method_name);
+  EXPECT_EQ(0u, recorder.Dropped());
+  EXPECT_TRUE(recorder.Take().empty());
+}
+
+TEST(TransactionCaptureTest, CapturesOnlyWhileEnabled) {
+  EXPECT_FALSE(Enabled());
+  Requests().Take();
+  SetEnabled(true);
+  if (Enabled()) Capture("foo.bar.IFoo", "Ping", 1, true, "abc", 3);
+  SetEnabled(false);
+  if (Enabled()) Capture("foo.bar.IFoo", "Pong", 2, false, "def", 3);
+
+  vector<Request> requests;
+  ASSERT_TRUE(Decode(Dump(), &requests));
+  ASSERT_EQ(1u, requests.size());
+  EXPECT_EQ("Ping", requests[0].method_name);
+  EXPECT_EQ("abc", requests[0].data);
+  EXPECT_TRUE(requests[0].oneway);
+}
+
+TEST(TransactionCaptureTest, SchedulesTheGapsOfTheCaptureAtTheRate) {
+  const vector<Request> requests{MakeRequest("A", 5000, ""), MakeRequest("B", 7000, ""),
+                                 MakeRequest("C", 11000, "")};
+  EXPECT_EQ((vector<int64_t>{0, 2000, 6000}), ScheduleOffsets(requests, 1));
+  EXPECT_EQ((vector<int64_t>{0, 1000, 3000}), ScheduleOffsets(requests, 2));
+  EXPECT_EQ((vector<int64_t>{0, 0, 0}), ScheduleOffsets(requests, 0));
+  EXPECT_TRUE(ScheduleOffsets({}, 1).empty());
+}
+
+TEST(TransactionCaptureTest, ReportsThePercentilesOfTheLatencies) {
+  LatencyStats stats;
+  for (int64_t i = 1; i <= 100; i++) {
+    stats.Add("Ping", i * 1000, i != 50);
+  }
+  LatencyStats other;
+  other.Add("Pong", 7000, true);
+  stats.Merge(other);
+
+  EXPECT_EQ(100u, stats.Count("Ping"));
+  EXPECT_EQ(1u, stats.Errors("Ping"));
+  EXPECT_EQ(50000, stats.Percentile("Ping", 50));
+  EXPECT_EQ(99000, stats.Percentile("Ping", 99));
+  EXPECT_EQ(100000, stats.Percentile("Ping", 100));
+  EXPECT_EQ(1000, stats.Percentile("Ping", 0));
+  EXPECT_EQ(0, stats.Percentile("Missing", 50));
+  EXPECT_EQ(
+      "method count errors p50_us p90_us p99_us max_us\n"
+      "Ping 100 1 50 90 99 100\n"
+      "Pong 1 0 7 7 7 7\n",
+      stats.Report());
+}
+
+}  // namespace capture
+}  // namespace aidl
+}  // namespace android
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "aidl/transaction_stats.h"
+#include "aidl_profile.h"
+
+namespace android {
+namespace aidl {
+namespace transaction_stats {
+
+TEST(TransactionStatsTest, BucketsTheLatenciesByPowersOfTwo) {
+  EXPECT_EQ(0u, MethodStats::BucketOf(-5));
+  EXPECT_EQ(0u, MethodStats::BucketOf(0));
+  EXPECT_EQ(0u, MethodStats::BucketOf(1));
+  EXPECT_EQ(1u, MethodStats::BucketOf(2));
+  EXPECT_EQ(1u, MethodStats::BucketOf(3));
+  EXPECT_EQ(10u, MethodStats::BucketOf(1024));
+  EXPECT_EQ(MethodStats::kBuckets - 1, MethodStats::BucketOf(INT64_MAX));
+}
+
+TEST(TransactionStatsTest, RecordsAndFindsTheMethods) {
+  static MethodStats stats[] = {{"a", 1}, {"b", 2}};
+  const Table table(stats, 2);
+  stats[1].Record(3);
+  stats[1].Record(1024);
+  ASSERT_EQ(&stats[1], table.Find(2));
+  EXPECT_EQ(nullptr, table.Find(3));
+  EXPECT_EQ(0u, table.Find(1)->calls.load());
+  EXPECT_EQ(2u, stats[1].calls.load());
+  EXPECT_EQ(1027u, stats[1].total_ns.load());
+  EXPECT_EQ("b: 2 calls, 1027 ns, latencies [2^i ns]: 1:1 10:1", ToString(stats[1]));
+}
+
+TEST(TransactionStatsTest, AddsUpTheSizesAndKeepsTheirMaxima) {
+  static MethodStats stats[] = {{"a", 1}};
+  EXPECT_EQ("a: 0 calls, 0 ns, latencies [2^i ns]:", ToString(stats[0]));
+  stats[0].RecordSizes(100, 8);
+  stats[0].RecordSizes(40, 16);
+  EXPECT_EQ(140u, stats[0].request_bytes.load());
+  EXPECT_EQ(24u, stats[0].reply_bytes.load());
+  EXPECT_EQ(100u, stats[0].max_request_bytes.load());
+  EXPECT_EQ(16u, stats[0].max_reply_bytes.load());
+  EXPECT_EQ(
+      "a: 0 calls, 0 ns, latencies [2^i ns]:, request bytes: 140 (max 100), reply bytes: 24 "
+      "(max 16)",
+      ToString(stats[0]));
+}
+
+TEST(TransactionStatsTest, TimesWithoutAllocating) {
+  static MethodStats stats[] = {{"a", 1}};
+  const uint64_t bytes = ThreadAllocatedBytes();
+  { ScopedTimer timer(&stats[0]); }
+  EXPECT_EQ(bytes, ThreadAllocatedBytes());
+  EXPECT_EQ(1u, stats[0].calls.load());
+}
+
+TEST(TransactionStatsTest, RecordsFromSeveralThreads) {
+  static MethodStats stats[] = {{"a", 1}};
+  constexpr uint64_t kThreads = 4;
+  constexpr uint64_t kPerThread = 1000;
+  std::vector<std::thread> threads;
+  for (uint64_t i = 0; i < kThreads; i++) {
+    threads.emplace_back([] {
+      for (uint64_t j = 0; j < kPerThread; j++) {
+        stats[0].Record(2);
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(kThreads * kPerThread, stats[0].calls.load());
+  EXPECT_EQ(kThreads * kPerThread, stats[0].buckets[1].load());
+  EXPECT_EQ(2 * kThreads * kPerThread, stats[0].total_ns.load());
+}
+
+}  // namespace transaction_stats
+}  // namespace aidl
+}  // namespace android
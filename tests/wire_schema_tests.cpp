@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string>
+#include <string_view>
+
+#include <gtest/gtest.h>
+
+#include "aidl/wire_schema.h"
+
+namespace android {
+namespace aidl {
+namespace wire_schema {
+
+namespace {
+
+using namespace std::string_literals;
+
+// interface p.IFoo { oneway void f(in int a, inout List<p.P> b); p.E[] g(); }
+const std::string kIFooSchema =
+    "AIDL\x01\x01\x06p.IFoo\x02"
+    "\x01\x01\x01" "f" "\x00\x02"
+    "\x01\x01" "a" "\x04"
+    "\x03\x01" "b" "\x89\x01\x11\x03p.P"
+    "\x02\x00\x01" "g" "\xb2\x03p.E\x01\x02"
+    "\x00"s;
+
+// parcelable p.P { @nullable String s; }
+const std::string kPSchema = "AIDL\x01\x02\x03p.P\x01\x01s\x48"s;
+
+}  // namespace
+
+TEST(WireSchemaTest, ParsesTheMethodsOfAnInterface) {
+  Schema schema;
+  ASSERT_TRUE(Parse(kIFooSchema, &schema));
+  EXPECT_EQ(Kind::INTERFACE, schema.kind);
+  EXPECT_EQ("p.IFoo", schema.name);
+  ASSERT_EQ(2u, schema.methods.size());
+
+  const Method& f = schema.methods[0];
+  EXPECT_EQ(1u, f.code);
+  EXPECT_TRUE(f.is_oneway);
+  EXPECT_EQ("f", f.name);
+  EXPECT_EQ(kVoid, f.return_type.tag);
+  ASSERT_EQ(2u, f.arguments.size());
+  EXPECT_EQ(kIn, f.arguments[0].direction);
+  EXPECT_EQ("a", f.arguments[0].name);
+  EXPECT_EQ(kInt, f.arguments[0].type.tag);
+  EXPECT_EQ(kInOut, f.arguments[1].direction);
+  EXPECT_EQ(kList, f.arguments[1].type.tag);
+  ASSERT_EQ(1u, f.arguments[1].type.parameters.size());
+  EXPECT_EQ(kParcelable, f.arguments[1].type.parameters[0].tag);
+  EXPECT_EQ("p.P", f.arguments[1].type.parameters[0].name);
+
+  const Method& g = schema.methods[1];
+  EXPECT_EQ(2u, g.code);
+  EXPECT_FALSE(g.is_oneway);
+  EXPECT_EQ(kEnum, g.return_type.tag);
+  EXPECT_TRUE(g.return_type.is_array);
+  EXPECT_FALSE(g.return_type.is_nullable);
+  EXPECT_EQ("p.E", g.return_type.name);
+  ASSERT_EQ(1u, g.return_type.parameters.size());
+  EXPECT_EQ(kByte, g.return_type.parameters[0].tag);
+  EXPECT_TRUE(g.arguments.empty());
+}
+
+TEST(WireSchemaTest, ParsesTheFieldsOfAParcelable) {
+  Schema schema;
+  ASSERT_TRUE(Parse(kPSchema, &schema));
+  EXPECT_EQ(Kind::PARCELABLE, schema.kind);
+  EXPECT_EQ("p.P", schema.name);
+  ASSERT_EQ(1u, schema.fields.size());
+  EXPECT_EQ("s", schema.fields[0].name);
+  EXPECT_EQ(kString, schema.fields[0].type.tag);
+  EXPECT_TRUE(schema.fields[0].type.is_nullable);
+  EXPECT_TRUE(schema.methods.empty());
+}
+
+TEST(WireSchemaTest, VisitsTheSchemasOfASection) {
+  // Each schema ends in the terminator of its literal, and may be padded
+  const std::string section = kIFooSchema + '\0' + kPSchema + std::string(7, '\0');
+  std::string_view data = section;
+  Schema schema;
+  ASSERT_TRUE(ParseNext(&data, &schema));
+  EXPECT_EQ("p.IFoo", schema.name);
+  ASSERT_TRUE(ParseNext(&data, &schema));
+  EXPECT_EQ("p.P", schema.name);
+  EXPECT_TRUE(schema.methods.empty());
+  EXPECT_FALSE(ParseNext(&data, &schema));
+}
+
+TEST(WireSchemaTest, RejectsBrokenSchemas) {
+  Schema schema;
+  for (size_t size = 0; size < kIFooSchema.size(); size++) {
+    EXPECT_FALSE(Parse(kIFooSchema.substr(0, size), &schema)) << size;
+  }
+  EXPECT_FALSE(Parse(kPSchema + "x", &schema));
+  EXPECT_FALSE(Parse("AIDL\x02\x02\x03p.P\x00"s, &schema));  // version
+  EXPECT_FALSE(Parse("AIDL\x01\x03\x03p.P\x00"s, &schema));  // kind
+  EXPECT_FALSE(Parse("AIDM\x01\x02\x03p.P\x00"s, &schema));
+}
+
+}  // namespace wire_schema
+}  // namespace aidl
+}  // namespace android
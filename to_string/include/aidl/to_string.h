@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+// The formatting of the fields of the parcelables generated with
+// --parcelable-to-string, whose appendTo() appends each of them to the string
+// of the caller. None of them builds a string of its own: the numbers are
+// formatted on the stack and the String16s are encoded to UTF-8 in place.
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <array>
+#include <charconv>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace android {
+namespace aidl {
+
+namespace to_string_internal {
+
+// Whether T is an ::android::String16, as in aidl/hash.h
+template <typename T, typename = void>
+constexpr bool kIsString16 = false;
+template <typename T>
+constexpr bool kIsString16<T, std::void_t<decltype(std::declval<const T&>().string()),
+                                          decltype(std::declval<const T&>().size())>> =
+    std::is_same_v<decltype(std::declval<const T&>().string()), const char16_t*>;
+
+// Whether T is a parcelable generated with --parcelable-to-string
+template <typename T, typename = void>
+constexpr bool kHasAppendTo = false;
+template <typename T>
+constexpr bool kHasAppendTo<T, std::void_t<decltype(std::declval<const T&>().appendTo(
+                                   std::declval<std::string&>()))>> = true;
+
+// Whether the enum T has the toStringView() of the C++ and NDK backends
+template <typename T, typename = void>
+constexpr bool kHasToStringView = false;
+template <typename T>
+constexpr bool kHasToStringView<T, std::void_t<decltype(toStringView(std::declval<T>()))>> = true;
+
+// Whether T holds its value through get(), as the smart pointers,
+// ::android::sp, the binders and the file descriptors do
+template <typename T, typename = void>
+constexpr bool kHasGet = false;
+template <typename T>
+constexpr bool kHasGet<T, std::void_t<decltype(std::declval<const T&>().get())>> = true;
+
+template <typename T>
+void AppendInteger(std::string& out, T value) {
+  char buffer[24];
+  const auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+  out.append(buffer, result.ptr);
+}
+
+// The UTF-8 of |chars|, with U+FFFD for the unpaired surrogates
+inline void AppendUtf16(std::string& out, std::u16string_view chars) {
+  for (size_t i = 0; i < chars.size(); i++) {
+    uint32_t c = chars[i];
+    if (c >= 0xd800 && c < 0xe000) {
+      if (c < 0xdc00 && i + 1 < chars.size() && chars[i + 1] >= 0xdc00 && chars[i + 1] < 0xe000) {
+        c = 0x10000 + ((c - 0xd800) << 10) + (chars[++i] - 0xdc00);
+      } else {
+        c = 0xfffd;
+      }
+    }
+    if (c < 0x80) {
+      out += static_cast<char>(c);
+    } else if (c < 0x800) {
+      out += static_cast<char>(0xc0 | (c >> 6));
+      out += static_cast<char>(0x80 | (c & 0x3f));
+    } else if (c < 0x10000) {
+      out += static_cast<char>(0xe0 | (c >> 12));
+      out += static_cast<char>(0x80 | ((c >> 6) & 0x3f));
+      out += static_cast<char>(0x80 | (c & 0x3f));
+    } else {
+      out += static_cast<char>(0xf0 | (c >> 18));
+      out += static_cast<char>(0x80 | ((c >> 12) & 0x3f));
+      out += static_cast<char>(0x80 | ((c >> 6) & 0x3f));
+      out += static_cast<char>(0x80 | (c & 0x3f));
+    }
+  }
+}
+
+inline void AppendAddress(std::string& out, const void* address) {
+  char buffer[32];
+  const int size = snprintf(buffer, sizeof(buffer), "%p", address);
+  if (size > 0) out.append(buffer, static_cast<size_t>(size));
+}
+
+}  // namespace to_string_internal
+
+// Appends a field to |out|, as the toString() of the Java backend writes it:
+// the enumerators by their names, the arrays and Lists as [a, b], the null
+// values as "(null)" and the parcelables as Name{field: value, ...}. The
+// values that have no text, like the binders, are written as their address.
+template <typename T>
+void AppendTo(std::string& out, const T& value);
+template <typename Char, typename Traits, typename Allocator>
+void AppendTo(std::string& out, const std::basic_string<Char, Traits, Allocator>& value);
+template <typename T, typename Allocator>
+void AppendTo(std::string& out, const std::vector<T, Allocator>& values);
+template <typename T, size_t N>
+void AppendTo(std::string& out, const std::array<T, N>& values);
+template <typename T>
+void AppendTo(std::string& out, const std::optional<T>& value);
+
+template <typename T>
+void AppendTo(std::string& out, const T& value) {
+  using namespace to_string_internal;
+  if constexpr (std::is_same_v<T, bool>) {
+    out += value ? "true" : "false";
+  } else if constexpr (std::is_same_v<T, char16_t>) {
+    AppendUtf16(out, std::u16string_view(&value, 1));
+  } else if constexpr (std::is_integral_v<T>) {
+    AppendInteger(out, value);
+  } else if constexpr (std::is_floating_point_v<T>) {
+    char buffer[32];
+    const int size = snprintf(buffer, sizeof(buffer), "%g", static_cast<double>(value));
+    if (size > 0) out.append(buffer, static_cast<size_t>(size));
+  } else if constexpr (std::is_enum_v<T>) {
+    if constexpr (kHasToStringView<T>) {
+      out += toStringView(value);
+    } else {
+      AppendInteger(out, static_cast<std::underlying_type_t<T>>(value));
+    }
+  } else if constexpr (kIsString16<T>) {
+    AppendUtf16(out, std::u16string_view(value.string(), value.size()));
+  } else if constexpr (kHasAppendTo<T>) {
+    value.appendTo(out);
+  } else if constexpr (kHasGet<T>) {
+    const auto held = value.get();
+    if constexpr (std::is_pointer_v<decltype(held)>) {
+      if (held == nullptr) {
+        out += "(null)";
+      } else if constexpr (kHasAppendTo<std::remove_cv_t<std::remove_pointer_t<decltype(held)>>>) {
+        held->appendTo(out);
+      } else {
+        AppendAddress(out, held);
+      }
+    } else {
+      AppendTo(out, held);
+    }
+  } else {
+    out += "{no toString() implemented}";
+  }
+}
+
+template <typename Char, typename Traits, typename Allocator>
+void AppendTo(std::string& out, const std::basic_string<Char, Traits, Allocator>& value) {
+  if constexpr (std::is_same_v<Char, char16_t>) {
+    to_string_internal::AppendUtf16(out, value);
+  } else {
+    out.append(value.data(), value.size());
+  }
+}
+
+template <typename T, typename Allocator>
+void AppendTo(std::string& out, const std::vector<T, Allocator>& values) {
+  out += '[';
+  bool first = true;
+  for (typename std::vector<T, Allocator>::const_reference value : values) {
+    if (!first) out += ", ";
+    first = false;
+    AppendTo(out, static_cast<const T&>(value));
+  }
+  out += ']';
+}
+
+template <typename T, size_t N>
+void AppendTo(std::string& out, const std::array<T, N>& values) {
+  out += '[';
+  for (size_t i = 0; i < N; i++) {
+    if (i > 0) out += ", ";
+    AppendTo(out, values[i]);
+  }
+  out += ']';
+}
+
+template <typename T>
+void AppendTo(std::string& out, const std::optional<T>& value) {
+  if (value) {
+    AppendTo(out, *value);
+  } else {
+    out += "(null)";
+  }
+}
+
+}  // namespace aidl
+}  // namespace android
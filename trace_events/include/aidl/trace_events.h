@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+// The Perfetto track events of the code generated with --trace=perfetto. A
+// proxy or a stub emits a slice over each of its transactions in the "aidl"
+// category, named e.g. "IFoo::get::cppServer", with the transaction code, the
+// bytes of the request and of the reply, and the status as arguments. Nested
+// slices cover its phases: "marshal", "transact" and "unmarshal" on the
+// client, and "unmarshal", "execute" and "marshal" on the server.
+//
+// The names are string literals, which Perfetto interns. While the category
+// is disabled, a transaction costs a load of an atomic.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <utility>
+
+#include <perfetto/tracing.h>
+
+PERFETTO_DEFINE_CATEGORIES_IN_NAMESPACE(
+    android::aidl::trace_events::categories,
+    perfetto::Category("aidl").SetDescription("Transactions of the AIDL proxies and stubs"));
+
+namespace android {
+namespace aidl {
+namespace trace_events {
+
+PERFETTO_USE_CATEGORIES_FROM_NAMESPACE(categories);
+
+// Connects the process to the system tracing service and registers the
+// category, the first time it is called.
+void Register();
+
+// Whether the transactions are traced now
+inline bool Enabled() {
+  static const bool registered = (Register(), true);
+  (void)registered;
+  return TRACE_EVENT_CATEGORY_ENABLED("aidl");
+}
+
+// The reply of a transaction, when it ends
+struct Reply {
+  size_t bytes;
+  int32_t status;
+};
+
+// The slice over a transaction, from its construction to its destruction.
+// |get_reply| is called when it ends, and returns the Reply.
+template <typename GetReply>
+class ScopedTransaction {
+ public:
+  ScopedTransaction(const char* name, uint32_t code, GetReply get_reply)
+      : get_reply_(std::move(get_reply)), enabled_(Enabled()) {
+    if (enabled_) {
+      TRACE_EVENT_BEGIN("aidl", perfetto::StaticString{name}, "code", code);
+    }
+  }
+  ScopedTransaction(const ScopedTransaction&) = delete;
+  ScopedTransaction& operator=(const ScopedTransaction&) = delete;
+
+  ~ScopedTransaction() {
+    if (!enabled_) return;
+    if (in_phase_) {
+      TRACE_EVENT_END("aidl");
+    }
+    const Reply reply = get_reply_();
+    TRACE_EVENT_END("aidl", "request_bytes", static_cast<uint64_t>(request_bytes_),
+                    "reply_bytes", static_cast<uint64_t>(reply.bytes), "status", reply.status);
+  }
+
+  // Ends the phase that the transaction is in, if any, and starts |phase|
+  void Phase(const char* phase) {
+    if (!enabled_) return;
+    if (in_phase_) {
+      TRACE_EVENT_END("aidl");
+    }
+    TRACE_EVENT_BEGIN("aidl", perfetto::StaticString{phase});
+    in_phase_ = true;
+  }
+
+  void SetRequestBytes(size_t bytes) { request_bytes_ = bytes; }
+
+ private:
+  GetReply get_reply_;
+  // Whether the category was enabled when the transaction started, so that
+  // the slices stay balanced when tracing starts or stops during it
+  const bool enabled_;
+  bool in_phase_ = false;
+  size_t request_bytes_ = 0;
+};
+
+}  // namespace trace_events
+}  // namespace aidl
+}  // namespace android
@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+// The transaction counts of the code generated with --gen-stats. The proxies
+// and the stubs of an interface count the transactions of each of its methods
+// with relaxed atomic increments, e.g. to be printed by a dump():
+//
+//   for (const auto& stats : BnFoo::getTransactionStats()) {
+//     dprintf(fd, "%s\n", ::android::aidl::transaction_stats::ToString(stats).c_str());
+//   }
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+namespace android {
+namespace aidl {
+namespace transaction_stats {
+
+// The transactions of a method. The generated code initializes the name and
+// the transaction code, and the counts start from 0.
+struct MethodStats {
+  // Bucket i counts the latencies from 2^i up to 2^(i + 1) nanoseconds,
+  // except that the first one also counts those below 1 and the last one
+  // those above 2^kBuckets, about 18 minutes.
+  static constexpr size_t kBuckets = 40;
+
+  const char* method_name;
+  uint32_t code;
+  std::atomic<uint64_t> calls{0};
+  std::atomic<uint64_t> total_ns{0};
+  std::atomic<uint64_t> buckets[kBuckets] = {};
+  // The bytes of the requests and of the replies, with --gen-stats=sizes
+  std::atomic<uint64_t> request_bytes{0};
+  std::atomic<uint64_t> reply_bytes{0};
+  std::atomic<uint64_t> max_request_bytes{0};
+  std::atomic<uint64_t> max_reply_bytes{0};
+
+  static size_t BucketOf(int64_t latency_ns) {
+    if (latency_ns <= 1) return 0;
+    const size_t bucket = 63 - __builtin_clzll(static_cast<uint64_t>(latency_ns));
+    return bucket < kBuckets ? bucket : kBuckets - 1;
+  }
+
+  void Record(int64_t latency_ns) {
+    calls.fetch_add(1, std::memory_order_relaxed);
+    total_ns.fetch_add(latency_ns > 0 ? latency_ns : 0, std::memory_order_relaxed);
+    buckets[BucketOf(latency_ns)].fetch_add(1, std::memory_order_relaxed);
+  }
+
+  void RecordSizes(size_t request, size_t reply) {
+    request_bytes.fetch_add(request, std::memory_order_relaxed);
+    reply_bytes.fetch_add(reply, std::memory_order_relaxed);
+    StoreMax(max_request_bytes, request);
+    StoreMax(max_reply_bytes, reply);
+  }
+
+ private:
+  static void StoreMax(std::atomic<uint64_t>& max, uint64_t value) {
+    uint64_t current = max.load(std::memory_order_relaxed);
+    while (current < value &&
+           !max.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+  }
+};
+
+// The methods of a proxy or a stub, in the order of their declarations
+class Table {
+ public:
+  constexpr Table(const MethodStats* stats, size_t size) : stats_(stats), size_(size) {}
+
+  const MethodStats* begin() const { return stats_; }
+  const MethodStats* end() const { return stats_ + size_; }
+  size_t size() const { return size_; }
+
+  // The method of transaction |code|, or nullptr if there is none
+  const MethodStats* Find(uint32_t code) const {
+    for (const MethodStats& stats : *this) {
+      if (stats.code == code) return &stats;
+    }
+    return nullptr;
+  }
+
+ private:
+  const MethodStats* stats_;
+  size_t size_;
+};
+
+inline int64_t Now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Records the time from its construction to its destruction in |stats|, so
+// that the early returns of a transaction are counted too
+class ScopedTimer {
+ public:
+  explicit ScopedTimer(MethodStats* stats) : stats_(stats), start_ns_(Now()) {}
+  ~ScopedTimer() { stats_->Record(Now() - start_ns_); }
+
+  ScopedTimer(const ScopedTimer&) = delete;
+  ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+ private:
+  MethodStats* const stats_;
+  const int64_t start_ns_;
+};
+
+// "NAME: CALLS calls, TOTAL ns, latencies [2^i ns]: i:COUNT..." with the
+// buckets that have counts, followed by ", request bytes: TOTAL (max MAX),
+// reply bytes: TOTAL (max MAX)" once sizes have been recorded
+inline std::string ToString(const MethodStats& stats) {
+  std::string s = std::string(stats.method_name) + ": " +
+                  std::to_string(stats.calls.load(std::memory_order_relaxed)) + " calls, " +
+                  std::to_string(stats.total_ns.load(std::memory_order_relaxed)) +
+                  " ns, latencies [2^i ns]:";
+  for (size_t i = 0; i < MethodStats::kBuckets; i++) {
+    const uint64_t count = stats.buckets[i].load(std::memory_order_relaxed);
+    if (count != 0) {
+      s += " " + std::to_string(i) + ":" + std::to_string(count);
+    }
+  }
+  const uint64_t request_bytes = stats.request_bytes.load(std::memory_order_relaxed);
+  const uint64_t reply_bytes = stats.reply_bytes.load(std::memory_order_relaxed);
+  if (request_bytes != 0 || reply_bytes != 0) {
+    s += ", request bytes: " + std::to_string(request_bytes) + " (max " +
+         std::to_string(stats.max_request_bytes.load(std::memory_order_relaxed)) +
+         "), reply bytes: " + std::to_string(reply_bytes) + " (max " +
+         std::to_string(stats.max_reply_bytes.load(std::memory_order_relaxed)) + ")";
+  }
+  return s;
+}
+
+}  // namespace transaction_stats
+}  // namespace aidl
+}  // namespace android
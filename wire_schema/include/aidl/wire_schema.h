@@ -0,0 +1,253 @@
+/*
+ * Copyright (C) 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#pragma once
+
+// The wire schemas of --gen-wire-schema: the methods of an interface or the
+// fields of a parcelable, with their types, as the backends generate them
+// into getWireSchema() and into the "aidl_wire_schema" section of the
+// library, where __start_aidl_wire_schema and __stop_aidl_wire_schema bound
+// them. A schema is
+//
+//   schema    := "AIDL" version:u8 kind:u8 name:string body
+//   body      := count:varint method*    (kind 1, an interface)
+//              | count:varint field*     (kind 2, a parcelable)
+//   method    := code:varint flags:u8 name:string return:type
+//                count:varint argument*
+//   argument  := direction:u8 name:string type
+//   field     := name:string type
+//   type      := tag:u8 [name:string] [count:u8 type*]
+//   string    := size:varint byte*
+//
+// where the varints are unsigned LEB128 and the code of a method is that of
+// its transaction. The low bits of the tag of a type are a Tag; the defined
+// types are followed by their qualified name. With kHasParameters, the type
+// parameters follow: those of a List or a Map, and the backing type of an
+// enum.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string_view>
+#include <vector>
+
+namespace android {
+namespace aidl {
+namespace wire_schema {
+
+constexpr std::string_view kMagic = "AIDL";
+constexpr uint8_t kVersion = 1;
+
+enum class Kind : uint8_t {
+  INTERFACE = 1,
+  PARCELABLE = 2,
+};
+
+enum Tag : uint8_t {
+  // The built-in types, in the order of AidlBuiltinKind
+  kVoid = 0,
+  kBoolean = 1,
+  kByte = 2,
+  kChar = 3,
+  kInt = 4,
+  kLong = 5,
+  kFloat = 6,
+  kDouble = 7,
+  kString = 8,
+  kList = 9,
+  kMap = 10,
+  kIBinder = 11,
+  kFileDescriptor = 12,
+  kCharSequence = 13,
+  kParcelFileDescriptor = 14,
+  // The defined types, which have a name
+  kInterface = 16,
+  kParcelable = 17,
+  kEnum = 18,
+  kUnstructuredParcelable = 19,
+
+  kKindMask = 0x1f,
+  kArray = 0x20,
+  kNullable = 0x40,
+  kHasParameters = 0x80,
+};
+
+enum Direction : uint8_t {
+  kIn = 1,
+  kOut = 2,
+  kInOut = 3,
+};
+
+// The flags of a method
+constexpr uint8_t kOneway = 1 << 0;
+
+// The names refer to the schema that they are parsed from
+struct Type {
+  uint8_t tag = kVoid;  // below kKindMask
+  bool is_array = false;
+  bool is_nullable = false;
+  std::string_view name;
+  std::vector<Type> parameters;
+};
+
+struct Argument {
+  uint8_t direction = kIn;
+  std::string_view name;
+  Type type;
+};
+
+struct Method {
+  uint32_t code = 0;
+  bool is_oneway = false;
+  std::string_view name;
+  Type return_type;
+  std::vector<Argument> arguments;
+};
+
+struct Field {
+  std::string_view name;
+  Type type;
+};
+
+struct Schema {
+  Kind kind = Kind::INTERFACE;
+  std::string_view name;
+  std::vector<Method> methods;  // of an interface
+  std::vector<Field> fields;    // of a parcelable
+};
+
+// Reads the pieces of a schema, each of which fails at the end of the data
+class Reader {
+ public:
+  explicit Reader(std::string_view data) : data_(data) {}
+
+  size_t Remaining() const { return data_.size(); }
+
+  bool ReadByte(uint8_t* out) {
+    if (data_.empty()) return false;
+    *out = static_cast<uint8_t>(data_[0]);
+    data_.remove_prefix(1);
+    return true;
+  }
+
+  bool ReadVarint(uint64_t* out) {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      uint8_t byte;
+      if (!ReadByte(&byte)) return false;
+      value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if ((byte & 0x80) == 0) {
+        *out = value;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool ReadString(std::string_view* out) {
+    uint64_t size;
+    if (!ReadVarint(&size) || size > data_.size()) return false;
+    *out = data_.substr(0, size);
+    data_.remove_prefix(size);
+    return true;
+  }
+
+  bool ReadType(Type* out, int depth = 0) {
+    uint8_t tag;
+    if (depth > 8 || !ReadByte(&tag)) return false;
+    out->tag = tag & kKindMask;
+    out->is_array = (tag & kArray) != 0;
+    out->is_nullable = (tag & kNullable) != 0;
+    if (out->tag >= kInterface && !ReadString(&out->name)) return false;
+    if (tag & kHasParameters) {
+      uint8_t count;
+      if (!ReadByte(&count)) return false;
+      out->parameters.resize(count);
+      for (Type& parameter : out->parameters) {
+        if (!ReadType(&parameter, depth + 1)) return false;
+      }
+    }
+    return true;
+  }
+
+ private:
+  std::string_view data_;
+};
+
+// Parses the schema at the start of |*data| into |out| and moves |*data| past
+// it, false if it is broken. The zeros before the schema are skipped, like
+// the terminators and the padding between the schemas in the section, so
+//
+//   std::string_view section(__start_aidl_wire_schema,
+//                            __stop_aidl_wire_schema - __start_aidl_wire_schema);
+//   while (ParseNext(&section, &schema)) ...
+//
+// visits the schemas of a library.
+inline bool ParseNext(std::string_view* data, Schema* out) {
+  const size_t start = data->find_first_not_of('\0');
+  if (start == std::string_view::npos || data->substr(start, kMagic.size()) != kMagic) {
+    return false;
+  }
+  Reader reader(data->substr(start + kMagic.size()));
+  uint8_t version, kind;
+  uint64_t count;
+  // Each of the items takes at least a byte
+  if (!reader.ReadByte(&version) || version != kVersion || !reader.ReadByte(&kind) ||
+      !reader.ReadString(&out->name) || !reader.ReadVarint(&count) || count > data->size()) {
+    return false;
+  }
+  out->kind = static_cast<Kind>(kind);
+  out->methods.clear();
+  out->fields.clear();
+  if (out->kind == Kind::INTERFACE) {
+    out->methods.resize(count);
+    for (Method& method : out->methods) {
+      uint64_t code, arguments;
+      uint8_t flags;
+      if (!reader.ReadVarint(&code) || !reader.ReadByte(&flags) ||
+          !reader.ReadString(&method.name) || !reader.ReadType(&method.return_type) ||
+          !reader.ReadVarint(&arguments) || arguments > data->size()) {
+        return false;
+      }
+      method.code = static_cast<uint32_t>(code);
+      method.is_oneway = (flags & kOneway) != 0;
+      method.arguments.resize(arguments);
+      for (Argument& argument : method.arguments) {
+        if (!reader.ReadByte(&argument.direction) || !reader.ReadString(&argument.name) ||
+            !reader.ReadType(&argument.type)) {
+          return false;
+        }
+      }
+    }
+  } else if (out->kind == Kind::PARCELABLE) {
+    out->fields.resize(count);
+    for (Field& field : out->fields) {
+      if (!reader.ReadString(&field.name) || !reader.ReadType(&field.type)) return false;
+    }
+  } else {
+    return false;
+  }
+  data->remove_prefix(data->size() - reader.Remaining());
+  return true;
+}
+
+// Parses |data|, which must be a whole schema, such as one of getWireSchema()
+inline bool Parse(std::string_view data, Schema* out) {
+  return ParseNext(&data, out) && data.empty();
+}
+
+}  // namespace wire_schema
+}  // namespace aidl
+}  // namespace android